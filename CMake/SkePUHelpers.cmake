@@ -1,6 +1,7 @@
 # Function to filter sources and build options from argument list.
 macro(skepu_filter_args)
 	set(_fnames_arg OFF)
+	set(_skepu_flags_arg OFF)
 	set(_skepu_src_arg OFF)
 	set(_src_arg OFF)
 	foreach(arg ${ARGN})
@@ -21,19 +22,29 @@ macro(skepu_filter_args)
 			set(_skepu_openmp ON)
 		elseif(${arg} STREQUAL "FNAMES")
 			set(_fnames_arg ON)
+			set(_skepu_flags_arg OFF)
+			set(_src_arg OFF)
+			set(_skepu_src_arg OFF)
+		elseif(${arg} STREQUAL "SKEPUFLAGS")
+			set(_fnames_arg OFF)
+			set(_skepu_flags_arg ON)
 			set(_src_arg OFF)
 			set(_skepu_src_arg OFF)
 		elseif(${arg} STREQUAL "SKEPUSRC")
 			set(_fnames_arg OFF)
+			set(_skepu_flags_arg OFF)
 			set(_skepu_src_arg ON)
 			set(_src_arg OFF)
 		elseif(${arg} STREQUAL "SRC")
 			set(_fnames_arg OFF)
+			set(_skepu_flags_arg OFF)
 			set(_src_arg ON)
 			set(_skepu_src_arg OFF)
 		else()
 			if(_fnames_arg)
 				list(APPEND _skepu_fnames ${arg})
+			elseif(_skepu_flags_arg)
+				list(APPEND _skepu_flags ${arg})
 			elseif(_skepu_src_arg)
 				list(APPEND _skepu_src ${arg})
 			elseif(_src_arg)
@@ -58,18 +69,45 @@ macro(skepu_filter_args)
 	endif()
 endmacro(skepu_filter_args)
 
+# Macro to set the skepu-tool options for the backends and the file extension of
+# the precompiled sources.
+macro(skepu_tool_flags)
+	set(_skepu_ext ".cpp")
+
+	if(SKEPU_RUNTIME_SKELETONS)
+		string(REPLACE ";" "," _skepu_runtime_skeletons "${SKEPU_RUNTIME_SKELETONS}")
+		list(APPEND _skepu_flags "-skeletons=${_skepu_runtime_skeletons}")
+	endif()
+
+	if(_skepu_cuda)
+		list(APPEND _skepu_backends "-cuda")
+		# With -split-cuda the main output stays a .cpp, the kernels go to a
+		# separate _device.cu
+		if(NOT "-split-cuda" IN_LIST _skepu_flags)
+			set(_skepu_ext ".cu")
+		endif()
+	endif()
+	if(_skepu_mpi)
+		list(APPEND _skepu_backends "-starpu-mpi")
+	endif()
+	if(_skepu_opencl)
+		list(APPEND _skepu_backends "-opencl")
+	endif()
+	if(_skepu_openmp)
+		list(APPEND _skepu_backends "-openmp")
+	endif()
+endmacro(skepu_tool_flags)
+
 # Macro to generate target CXXFLAGS and library information for a target. The
 # file extension is also taken care of in this function.
 macro(skepu_configure)
-	set(_skepu_ext ".cpp")
+	skepu_tool_flags()
 	set(_target_libs SkePU::SkePU)
 
 	if(_skepu_cuda)
 		if(NOT CMAKE_CUDA_COMPILER)
 			message(FATAL_ERROR "[SKEPU] No CUDA compiler enabled")
 		endif()
-		list(APPEND _skepu_backends "-cuda")
-		set(_skepu_ext ".cu")
 	endif()
 
 	if(_skepu_mpi)
@@ -88,7 +126,6 @@ macro(skepu_configure)
 			unset(_mpi_ldflags)
 			set(SKEPU_MPI_FIX TRUE PARENT_SCOPE)
 		endif()
-		list(APPEND _skepu_backends "-starpu-mpi")
 		list(APPEND _target_libs MPI::MPI_CXX PkgConfig::STARPU)
 	endif()
 
@@ -96,7 +133,6 @@ macro(skepu_configure)
 		if(NOT OpenCL_FOUND)
 			find_package(OpenCL REQUIRED)
 		endif()
-		list(APPEND _skepu_backends "-opencl")
 		list(APPEND _target_libs OpenCL::OpenCL)
 	endif()
 
@@ -104,7 +140,6 @@ macro(skepu_configure)
 		if(NOT OpenMP_FOUND)
 			find_package(OpenMP REQUIRED)
 		endif()
-		list(APPEND _skepu_backends "-openmp")
 
 		# We need to be a bit careful with the OpenMP flags and libraries if CUDA is
 		# enabled...
@@ -143,38 +178,9 @@ macro(skepu_generate_include_generators)
 		$<$<BOOL:${_isid_prop}>:-I$<JOIN:${_isid_prop}, -I>>)
 endmacro(skepu_generate_include_generators)
 
-#	skepu_add_library(<name> [STATIC | SHARED | MODULE] [EXCLUDE_FROM_ALL]
-#		[[CUDA] [OpenCL] [OpenMP] | [MPI]]
-#		SKEPUSRC ssrc1 [ssrc2 ...]
-#		[SRC	src1 [src2 ...]])
-#
-#	A wrapper function to add_library
-#	Creates a library target. Source files listed after SKEPUSRC will be
-#	precompiled with skepu-tool. Other sources, listed after SRC, will be
-#	redirected to add_library. SkePU headers will be included automatically.
-# Note that the user is resposible for enabling CUDA,OpenCL,OpenMP, and OpenMPI
-# within their cmake scripts.
-function(skepu_add_library name)
-
-endfunction(skepu_add_library)
-
-#	skepu_add_executable(<name> [EXCLUDE_FROM_ALL]
-#		[[CUDA] [OpenCL] [OpenMP] | [MPI]]
-#		SKEPUSRC ssrc1 [ssrc2 ...]
-#		[SRC src1 [src2 ...]])
-#
-#	A wrapper function to add_executable.
-#	Creates an executable target. Source files listed after SKEPUSRC will be
-#	precompiled with skepu-tool. SRC will be redirected together with the
-#	precompiled source to add_executable(). The function will automatically
-#	include the SkePU headers.
-# Note that the user is resposible for enabling CUDA,OpenCL,OpenMP, and OpenMPI
-# within their cmake scripts.
-function(skepu_add_executable name)
-	# We need the skepu headers when building.
-	skepu_filter_args(${ARGN})
-	skepu_configure()
-
+# Macro to add a custom command (per SkePU source file) running skepu-tool on
+# it, into _precompiled_src, and a custom target for it, into _skepu_targets.
+macro(skepu_precompile_sources)
 	# Just keeps the output directory a bit tidier.
 	set(_output_dir ${CMAKE_CURRENT_BINARY_DIR}/skepu_precompiled)
 	if(NOT EXISTS ${_output_dir})
@@ -193,6 +199,7 @@ function(skepu_add_executable name)
 			COMMAND
 				${SKEPU_EXECUTABLE}
 					${_skepu_backends}
+					${_skepu_flags}
 					-silent
 					-name ${_target_name}
 					-dir=${_output_dir}
@@ -215,6 +222,43 @@ function(skepu_add_executable name)
 		list(APPEND _precompiled_src ${_output_dir}/${_target_byprod})
 		list(APPEND _skepu_targets ${_target_name})
 	endforeach()
+endmacro(skepu_precompile_sources)
+
+#	skepu_add_library(<name> [STATIC | SHARED | MODULE] [EXCLUDE_FROM_ALL]
+#		[[CUDA] [OpenCL] [OpenMP] | [MPI]]
+#		SKEPUSRC ssrc1 [ssrc2 ...]
+#		[SRC	src1 [src2 ...]])
+#
+#	A wrapper function to add_library
+#	Creates a library target. Source files listed after SKEPUSRC will be
+#	precompiled with skepu-tool. Other sources, listed after SRC, will be
+#	redirected to add_library. SkePU headers will be included automatically.
+# Note that the user is resposible for enabling CUDA,OpenCL,OpenMP, and OpenMPI
+# within their cmake scripts.
+function(skepu_add_library name)
+
+endfunction(skepu_add_library)
+
+#	skepu_add_executable(<name> [EXCLUDE_FROM_ALL]
+#		[[CUDA] [OpenCL] [OpenMP] | [MPI]]
+#		[SKEPUFLAGS flag1 [flag2 ...]]
+#		SKEPUSRC ssrc1 [ssrc2 ...]
+#		[SRC src1 [src2 ...]])
+#
+#	A wrapper function to add_executable.
+#	Creates an executable target. Source files listed after SKEPUSRC will be
+#	precompiled with skepu-tool, with any options listed after SKEPUFLAGS. SRC
+#	will be redirected together with the precompiled source to
+#	add_executable(). The function will automatically include the SkePU
+#	headers.
+# Note that the user is resposible for enabling CUDA,OpenCL,OpenMP, and OpenMPI
+# within their cmake scripts.
+function(skepu_add_executable name)
+	# We need the skepu headers when building.
+	skepu_filter_args(${ARGN})
+	skepu_configure()
+
+	skepu_precompile_sources()
 
 	# Finally add an executable target with both the procompiled source and C++
 	# source (if any). Cmake will use the file extension to figure out if we are
@@ -225,3 +269,25 @@ function(skepu_add_executable name)
 	target_compile_options(${name} PRIVATE ${_target_cxxflags})
 	add_dependencies(${name} ${_skepu_targets})
 endfunction(skepu_add_executable)
+
+#	skepu_add_precompiled(<name>
+#		[[CUDA] [OpenCL] [OpenMP] | [MPI]]
+#		[SKEPUFLAGS flag1 [flag2 ...]]
+#		SKEPUSRC ssrc1 [ssrc2 ...])
+#
+#	Creates a target which only precompiles the sources listed after SKEPUSRC,
+#	into the same skepu_precompiled files as skepu_add_executable. It is meant
+#	for checking the generated code of options whose runtime half is not in the
+#	SkePU headers, so nothing is compiled and the backends need no compilers.
+function(skepu_add_precompiled name)
+	skepu_filter_args(${ARGN})
+	skepu_tool_flags()
+
+	add_custom_target(${name} ALL)
+	# A custom target can not link SkePU::SkePU, so it gets the headers directly.
+	set_property(TARGET ${name} PROPERTY INCLUDE_DIRECTORIES
+		$<TARGET_PROPERTY:SkePU::SkePU,INTERFACE_INCLUDE_DIRECTORIES>)
+
+	skepu_precompile_sources()
+	add_dependencies(${name} ${_skepu_targets})
+endfunction(skepu_add_precompiled)
@@ -24,6 +24,37 @@ else()
 		OFF)
 endif()
 
+# Performance tests, labeled performance in CTest. Each test compares its
+# throughput with the baseline recorded on this machine, see
+# tests/performance/perf.hpp.
+option(SKEPU_PERFORMANCE_TESTS
+	"If testing, add the fixed-size performance tests."
+	OFF)
+if(SKEPU_PERFORMANCE_TESTS)
+	# Baselines are recorded in the build tree unless a kept directory is
+	# given, so that configuring never writes to the source tree.
+	cmake_host_system_information(RESULT _skepu_perf_host QUERY HOSTNAME)
+	set(SKEPU_PERF_BASELINE_DIR
+		${CMAKE_BINARY_DIR}/perf-baselines/${_skepu_perf_host}
+		CACHE PATH
+		"Directory of the performance baselines of this machine.")
+	set(SKEPU_PERF_TOLERANCE 0.2 CACHE STRING
+		"Fraction of the baseline throughput a performance test may lose.")
+	set(SKEPU_PERF_REPETITIONS 10 CACHE STRING
+		"Timed calls per performance test.")
+	mark_as_advanced(FORCE
+		SKEPU_PERF_BASELINE_DIR
+		SKEPU_PERF_TOLERANCE
+		SKEPU_PERF_REPETITIONS)
+	file(MAKE_DIRECTORY ${SKEPU_PERF_BASELINE_DIR})
+endif()
+
+# Skeletons beyond the SkePU 3 set need a factory and a backend class in the
+# skepu-headers runtime. skepu-tool generates them, and the test suite tests
+# them, only when they are listed here.
+set(SKEPU_RUNTIME_SKELETONS "" CACHE STRING
+	"Skeletons the skepu-headers runtime provides beyond the SkePU 3 set (ReduceByKey, Histogram, Sort, Filter, Gather, Scatter).")
+
 option(SKEPU_TOOL_STATIC
 	"Static linking of skepu-tool."
 	OFF)
@@ -81,6 +112,9 @@ endif()
 option(SKEPU_EXAMPLES_MPI
 	"If building examples, build MPI examples."
 	${SKEPU_MPI})
+option(SKEPU_EXAMPLES_BENCH
+	"If building examples, build the benchmark programs and the skepu-bench target."
+	OFF)
 
 macro(skepu_print_config)
 	message("
@@ -91,7 +125,9 @@ macro(skepu_print_config)
     Buid type           ${CMAKE_BUILD_TYPE}
     Install prefix      ${CMAKE_INSTALL_PREFIX}
     Build examples      ${SKEPU_BUILD_EXAMPLES}
-    Test suite enabled  ${SKEPU_ENABLE_TESTING}")
+    Test suite enabled  ${SKEPU_ENABLE_TESTING}
+    Performance tests   ${SKEPU_PERFORMANCE_TESTS}
+    Runtime skeletons   ${SKEPU_RUNTIME_SKELETONS}")
 
 	if(SKEPU_BUILD_EXAMPLES OR SKEPU_ENABLE_TESTING)
 		message("
@@ -109,7 +145,8 @@ macro(skepu_print_config)
     --------
     Sequential  ${SKEPU_EXAMPLES_SEQ}
     Parallel    ${SKEPU_EXAMPLES_PAR}
-    StarPU-MPI  ${SKEPU_EXAMPLES_MPI}")
+    StarPU-MPI  ${SKEPU_EXAMPLES_MPI}
+    Benchmarks  ${SKEPU_EXAMPLES_BENCH}")
 	endif()
 	message("")
 endmacro(skepu_print_config)
@@ -300,3 +300,17 @@ mark_as_advanced(FORCE
 	SKEPU_EXAMPLE_TAYLOR_MPI_CUDA
 	SKEPU_EXAMPLE_TAYLOR_OPENCL
 	SKEPU_EXAMPLE_TAYLOR_OPENMP)
+
+set(SKEPU_BENCH_WARMUP 1 CACHE STRING
+	"Untimed calls per problem size in the benchmark programs.")
+set(SKEPU_BENCH_REPETITIONS 5 CACHE STRING
+	"Timed calls per problem size in the benchmark programs.")
+set(SKEPU_BENCH_FORMAT csv CACHE STRING
+	"Output format of the benchmark results, csv or json.")
+set_property(CACHE SKEPU_BENCH_FORMAT PROPERTY STRINGS csv json)
+# Comma separated size sweeps overriding a program's default,
+# e.g. -DSKEPU_BENCH_SIZES_mmmult=256,512
+mark_as_advanced(FORCE
+	SKEPU_BENCH_WARMUP
+	SKEPU_BENCH_REPETITIONS
+	SKEPU_BENCH_FORMAT)
@@ -0,0 +1,35 @@
+#include <skepu>
+
+#include "skepu_bench.hpp"
+
+float mult(float a, float b)
+{
+	return a * b;
+}
+
+float add(float a, float b)
+{
+	return a + b;
+}
+
+
+int main(int argc, char *argv[])
+{
+	skepu::bench::Harness bench(argc, argv, "dotproduct", {1 << 16, 1 << 20, 1 << 24});
+	auto dotprod = skepu::MapReduce(mult, add);
+	
+	for (size_t size : bench.sizes())
+	{
+		skepu::Vector<float> a(size), b(size);
+		a.randomize(0, 3);
+		b.randomize(0, 2);
+		
+		volatile float res;
+		bench.run(size, 2.0 * size * sizeof(float), 2.0 * size, [&]
+		{
+			res = dotprod(a, b);
+		});
+	}
+	
+	return 0;
+}
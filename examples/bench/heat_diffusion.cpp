@@ -0,0 +1,42 @@
+#include <skepu>
+
+#include "skepu_bench.hpp"
+
+float heat2D(skepu::Region2D<float> r)
+{
+	float newval = 0;
+	newval += r(-1,  0);
+	newval += r( 1,  0);
+	newval += r( 0, -1);
+	newval += r( 0,  1);
+	newval /= 4;
+	return newval;
+}
+
+
+// One Jacobi step on a square grid of the given order
+int main(int argc, char *argv[])
+{
+	skepu::bench::Harness bench(argc, argv, "heat_diffusion", {256, 1024, 4096});
+	auto update = skepu::MapOverlap(heat2D);
+	update.setOverlap(1, 1);
+	update.setEdgeMode(skepu::Edge::Duplicate);
+	
+	for (size_t n : bench.sizes())
+	{
+		skepu::Matrix<float> domain(n, n, 0), next(n, n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			domain(0, i) = 0;
+			domain(n-1, i) = 5;
+		}
+		
+		bench.run(n, 2.0 * n * n * sizeof(float), 4.0 * n * n, [&]
+		{
+			update(next, domain);
+			next.flush();
+		});
+	}
+	
+	return 0;
+}
@@ -0,0 +1,34 @@
+#include <skepu>
+
+#include "skepu_bench.hpp"
+
+float mmmult_f(skepu::Index2D idx, const skepu::Mat<float> lhs, const skepu::Mat<float> rhs)
+{
+	float res = 0;
+	for (size_t i = 0; i < lhs.cols; ++i)
+		res += lhs.data[idx.row * lhs.cols + i] * rhs.data[i * rhs.cols + idx.col];
+	return res;
+}
+
+
+// Square matrices of the given order
+int main(int argc, char *argv[])
+{
+	skepu::bench::Harness bench(argc, argv, "mmmult", {128, 256, 512, 1024});
+	auto mmprod = skepu::Map<0>(mmmult_f);
+	
+	for (size_t n : bench.sizes())
+	{
+		skepu::Matrix<float> lhs(n, n), rhs(n, n), res(n, n);
+		lhs.randomize(3, 9);
+		rhs.randomize(0, 9);
+		
+		bench.run(n, 3.0 * n * n * sizeof(float), 2.0 * n * n * n, [&]
+		{
+			mmprod(res, lhs, rhs);
+			res.flush();
+		});
+	}
+	
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include <cmath>
+
+#include <skepu>
+
+#include "skepu_bench.hpp"
+
+struct Particle
+{
+	float x, y, z;
+	float vx, vy, vz;
+	float m;
+};
+
+
+constexpr float G [[skepu::userconstant]] = 1;
+constexpr float DELTA_T [[skepu::userconstant]] = 0.1;
+
+
+Particle move(skepu::Index1D index, Particle pi, const skepu::Vec<Particle> parr)
+{
+	size_t i = index.i;
+	float ax = 0.0, ay = 0.0, az = 0.0;
+	
+	for (size_t j = 0; j < parr.size; ++j)
+	{
+		if (i != j)
+		{
+			Particle pj = parr(j);
+			float rij = sqrt((pi.x - pj.x) * (pi.x - pj.x)
+			               + (pi.y - pj.y) * (pi.y - pj.y)
+			               + (pi.z - pj.z) * (pi.z - pj.z));
+			float dum = G * pi.m * pj.m / (rij * rij * rij);
+			ax += dum * (pi.x - pj.x);
+			ay += dum * (pi.y - pj.y);
+			az += dum * (pi.z - pj.z);
+		}
+	}
+	
+	Particle newp;
+	newp.m = pi.m;
+	newp.x = pi.x + DELTA_T * pi.vx + DELTA_T * DELTA_T / 2 * ax;
+	newp.y = pi.y + DELTA_T * pi.vy + DELTA_T * DELTA_T / 2 * ay;
+	newp.z = pi.z + DELTA_T * pi.vz + DELTA_T * DELTA_T / 2 * az;
+	newp.vx = pi.vx + DELTA_T * ax;
+	newp.vy = pi.vy + DELTA_T * ay;
+	newp.vz = pi.vz + DELTA_T * az;
+	return newp;
+}
+
+
+Particle init(skepu::Index1D index, size_t np)
+{
+	int s = index.i;
+	int d = np / 2 + 1;
+	int i = s % np;
+	int j = ((s - i) / np) % np;
+	int k = (((s - i) / np) - j) / np;
+	
+	Particle p;
+	p.x = i - d + 1;
+	p.y = j - d + 1;
+	p.z = k - d + 1;
+	p.vx = 0.0;
+	p.vy = 0.0;
+	p.vz = 0.0;
+	p.m = 1;
+	return p;
+}
+
+
+// One simulation step per call, counting 20 floating-point operations per particle pair
+int main(int argc, char *argv[])
+{
+	skepu::bench::Harness bench(argc, argv, "nbody", {1000, 4000, 16000});
+	auto nbody_init = skepu::Map<0>(init);
+	auto nbody_simulate_step = skepu::Map(move);
+	
+	for (size_t np : bench.sizes())
+	{
+		skepu::Vector<Particle> particles(np), doublebuffer(np);
+		nbody_init(particles, (size_t)std::cbrt(np));
+		
+		bench.run(np, 2.0 * np * sizeof(Particle), 20.0 * np * np, [&]
+		{
+			nbody_simulate_step(doublebuffer, particles, particles);
+			doublebuffer.flush();
+		});
+	}
+	
+	return 0;
+}
@@ -0,0 +1,176 @@
+/*!
+ * Common timing harness for the SkePU benchmark programs.
+ *
+ * A benchmark program creates one Harness from its command line and calls run() once per problem size. run() calls
+ * the body warmup times untimed, then repetitions times timed, and records the minimum, median and mean wall time
+ * together with the throughput derived from the bytes moved and floating-point operations of one call. The body
+ * must leave its results on the host (flush the outputs or read a scalar result), so that device work is included
+ * in the measurement. Results are written as CSV or JSON when the harness is destroyed.
+ *
+ * Options:
+ *   --backend <type>     SkePU backend type (cpu, openmp, cuda, opencl), default cpu
+ *   --sizes <n,n,...>    problem sizes, replacing the program's default sweep
+ *   --warmup <n>         untimed calls per size, default 1
+ *   --reps <n>           timed calls per size, default 5
+ *   --format <csv|json>  output format, default csv
+ *   --output <file>      output file, default standard output
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <skepu>
+
+namespace skepu
+{
+	namespace bench
+	{
+		struct Result
+		{
+			size_t size;
+			double min, median, mean; // seconds
+			double bytes, flops;      // per call
+		};
+
+		class Harness
+		{
+		public:
+			Harness(int argc, char *argv[], std::string name, std::vector<size_t> defaultSizes)
+			: m_name(name), m_sizes(defaultSizes)
+			{
+				for (int i = 1; i < argc; ++i)
+				{
+					std::string arg = argv[i];
+					if (i + 1 >= argc)
+						usage(argv[0]);
+					std::string value = argv[++i];
+
+					if (arg == "--backend") m_backend = value;
+					else if (arg == "--sizes") m_sizes = parseSizes(value);
+					else if (arg == "--warmup") m_warmup = std::stoul(value);
+					else if (arg == "--reps") m_repetitions = std::max<size_t>(1, std::stoul(value));
+					else if (arg == "--format") m_format = value;
+					else if (arg == "--output") m_output = value;
+					else usage(argv[0]);
+				}
+
+				if (m_format != "csv" && m_format != "json")
+					usage(argv[0]);
+
+				skepu::setGlobalBackendSpec(skepu::BackendSpec{m_backend});
+			}
+
+			~Harness()
+			{
+				if (m_output.empty())
+					write(std::cout);
+				else
+				{
+					std::ofstream out(m_output);
+					if (out.is_open())
+						write(out);
+					else
+						std::cerr << "Error: cannot open this file: " << m_output << "\n";
+				}
+			}
+
+			std::vector<size_t> const& sizes() const
+			{
+				return m_sizes;
+			}
+
+			template<typename Body>
+			void run(size_t size, double bytes, double flops, Body &&body)
+			{
+				using clock = std::chrono::steady_clock;
+
+				for (size_t i = 0; i < m_warmup; ++i)
+					body();
+
+				std::vector<double> times;
+				for (size_t i = 0; i < m_repetitions; ++i)
+				{
+					auto start = clock::now();
+					body();
+					times.push_back(std::chrono::duration<double>(clock::now() - start).count());
+				}
+
+				std::sort(times.begin(), times.end());
+				Result res;
+				res.size = size;
+				res.min = times.front();
+				res.median = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+				res.mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+				res.bytes = bytes;
+				res.flops = flops;
+				m_results.push_back(res);
+			}
+
+		private:
+			std::string m_name;
+			std::string m_backend = "cpu";
+			std::vector<size_t> m_sizes;
+			size_t m_warmup = 1;
+			size_t m_repetitions = 5;
+			std::string m_format = "csv";
+			std::string m_output;
+			std::vector<Result> m_results;
+
+			[[noreturn]] static void usage(const char *program)
+			{
+				std::cerr << "Usage: " << program << " [--backend type] [--sizes n,n,...] [--warmup n] [--reps n] [--format csv|json] [--output file]\n";
+				exit(1);
+			}
+
+			static std::vector<size_t> parseSizes(std::string const& list)
+			{
+				std::vector<size_t> sizes;
+				std::stringstream ss(list);
+				std::string item;
+				while (std::getline(ss, item, ','))
+					sizes.push_back(std::stoul(item));
+				return sizes;
+			}
+
+			// Throughput of the median call in GB/s and GFLOP/s, 0 if not applicable
+			static double giga(double amount, double seconds)
+			{
+				return seconds > 0 ? amount / seconds * 1e-9 : 0;
+			}
+
+			void write(std::ostream &os) const
+			{
+				if (m_format == "csv")
+				{
+					os << "benchmark,backend,size,repetitions,min_s,median_s,mean_s,gbps,gflops\n";
+					for (Result const& res : m_results)
+						os << m_name << "," << m_backend << "," << res.size << "," << m_repetitions << ","
+							<< res.min << "," << res.median << "," << res.mean << ","
+							<< giga(res.bytes, res.median) << "," << giga(res.flops, res.median) << "\n";
+				}
+				else
+				{
+					os << "{\n  \"benchmark\": \"" << m_name << "\",\n  \"backend\": \"" << m_backend << "\",\n"
+						<< "  \"warmup\": " << m_warmup << ",\n  \"repetitions\": " << m_repetitions << ",\n  \"results\": [";
+					for (size_t i = 0; i < m_results.size(); ++i)
+					{
+						Result const& res = m_results[i];
+						os << (i ? "," : "") << "\n    { \"size\": " << res.size
+							<< ", \"min_s\": " << res.min << ", \"median_s\": " << res.median << ", \"mean_s\": " << res.mean
+							<< ", \"gbps\": " << giga(res.bytes, res.median) << ", \"gflops\": " << giga(res.flops, res.median) << " }";
+					}
+					os << "\n  ]\n}\n";
+				}
+			}
+		};
+	}
+}
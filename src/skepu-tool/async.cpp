@@ -0,0 +1,174 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Stream scopes for -async. All generated OpenCL kernels are otherwise enqueued on the single queue of their
+ * device, so the skeleton calls of independent threads and their transfers serialize on it. While a
+ * skepu::async::Stream lives, the kernel launches of the generated wrappers on the current thread go to an
+ * in-order queue of the stream, created per device on first use, through SKEPU_CL_QUEUE.
+ *
+ * Each launch first waits for a marker on the device queue, so it sees the uploads the runtime enqueued there
+ * for the call, but does not block the host. The kernels of a stream then run in call order, overlapping
+ * with the transfers and kernels of other streams. Before the host reads a container written by a call in a
+ * stream, call sync, which the destructor also does.
+ *
+ * With CUDA, a Stream owns a non-blocking stream per device, which current_CU returns for the launchers.
+ */
+static const char *AsyncSupport = R"~~~(
+#pragma once
+
+#include <map>
+
+#ifdef SKEPU_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef SKEPU_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace skepu
+{
+	namespace async
+	{
+		class Stream
+		{
+		public:
+			Stream(): outer(current())
+			{
+				current() = this;
+			}
+
+			~Stream()
+			{
+				this->sync();
+#ifdef SKEPU_OPENCL
+				for (auto &pair : this->queues)
+					clReleaseCommandQueue(pair.second);
+#endif
+#ifdef SKEPU_CUDA
+				for (auto &pair : this->streams)
+					cudaStreamDestroy(pair.second);
+#endif
+				current() = this->outer;
+			}
+
+			Stream(Stream const&) = delete;
+			Stream &operator=(Stream const&) = delete;
+
+			// Waits for the kernels launched in this stream
+			void sync()
+			{
+#ifdef SKEPU_OPENCL
+				for (auto &pair : this->queues)
+					clFinish(pair.second);
+#endif
+#ifdef SKEPU_CUDA
+				for (auto &pair : this->streams)
+					cudaStreamSynchronize(pair.second);
+#endif
+			}
+
+			// Innermost stream of the current thread, nullptr outside of stream scopes
+			static Stream *&current()
+			{
+				static thread_local Stream *stream = nullptr;
+				return stream;
+			}
+
+#ifdef SKEPU_OPENCL
+			cl_command_queue queue_CL(cl_command_queue device)
+			{
+				cl_command_queue &queue = this->queues[device];
+				if (!queue)
+				{
+					cl_context context;
+					cl_device_id id;
+					clGetCommandQueueInfo(device, CL_QUEUE_CONTEXT, sizeof(context), &context, NULL);
+					clGetCommandQueueInfo(device, CL_QUEUE_DEVICE, sizeof(id), &id, NULL);
+					cl_int err;
+					queue = clCreateCommandQueue(context, id, 0, &err);
+					if (err != CL_SUCCESS)
+					{
+						queue = NULL;
+						return device;
+					}
+				}
+
+				// Orders the launch after everything enqueued on the device queue so far, such as its uploads
+				cl_event marker;
+				if (clEnqueueMarkerWithWaitList(device, 0, NULL, &marker) == CL_SUCCESS)
+				{
+					clEnqueueBarrierWithWaitList(queue, 1, &marker, NULL);
+					clReleaseEvent(marker);
+				}
+				return queue;
+			}
+#endif
+
+#ifdef SKEPU_CUDA
+			cudaStream_t stream_CU(int device)
+			{
+				auto it = this->streams.find(device);
+				if (it != this->streams.end())
+					return it->second;
+				cudaStream_t stream = 0;
+				cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking);
+				return this->streams[device] = stream;
+			}
+#endif
+
+		private:
+			Stream *outer;
+#ifdef SKEPU_OPENCL
+			std::map<cl_command_queue, cl_command_queue> queues;
+#endif
+#ifdef SKEPU_CUDA
+			std::map<int, cudaStream_t> streams;
+#endif
+		};
+
+#ifdef SKEPU_OPENCL
+		inline cl_command_queue queue_CL(cl_command_queue device)
+		{
+			Stream *stream = Stream::current();
+			return stream ? stream->queue_CL(device) : device;
+		}
+#endif
+
+#ifdef SKEPU_CUDA
+		// Stream of the current scope on the current device, or fallback outside of stream scopes
+		inline cudaStream_t current_CU(cudaStream_t fallback)
+		{
+			Stream *stream = Stream::current();
+			if (!stream)
+				return fallback;
+			int device = 0;
+			cudaGetDevice(&device);
+			return stream->stream_CU(device);
+		}
+#endif
+	}
+}
+
+#ifdef SKEPU_OPENCL
+#define SKEPU_CL_QUEUE(skepu_deviceID) (skepu::async::queue_CL(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue()))
+#endif
+)~~~";
+
+
+std::string generateAsyncSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_async.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << AsyncSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,247 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Runtime support for instances listed in -autotune. The generated declaration wraps the backend skeleton in
+ * skepu::autotune::Tuned, which picks a BackendSpec per (instance key, problem size bucket) on each call.
+ * The first call in a bucket that has no database entry sweeps the candidate configurations. Each candidate
+ * runs the skeleton once on the real arguments, so tuned instances must be safe to evaluate repeatedly
+ * (no output aliasing an input). The fastest candidate is appended to the tuning database file and reused by
+ * later calls and later runs.
+ */
+static const char *AutotuneSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace autotune
+	{
+		struct Config
+		{
+			Backend::Type type;
+			size_t threads; // CPU threads or GPU threads per block, 0 for the backend default
+			size_t blocks;  // GPU blocks, 0 for the backend default
+
+			BackendSpec spec() const
+			{
+				BackendSpec spec{type};
+				if (type == Backend::Type::OpenMP && threads > 0)
+					spec.setCPUThreads(threads);
+				if (type == Backend::Type::CUDA || type == Backend::Type::OpenCL)
+				{
+					if (threads > 0) spec.setGPUThreads(threads);
+					if (blocks > 0)  spec.setGPUBlocks(blocks);
+				}
+				return spec;
+			}
+		};
+
+		// One database file per path, shared by all tuned instances in the program
+		class Database
+		{
+		public:
+			static Database &open(const std::string &path)
+			{
+				static std::map<std::string, Database> databases;
+				static std::mutex lock;
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = databases.find(path);
+				if (it == databases.end())
+					it = databases.emplace(path, Database(path)).first;
+				return it->second;
+			}
+
+			bool lookup(const std::string &key, size_t bucket, Config &config) const
+			{
+				auto it = this->entries.find(std::make_pair(key, bucket));
+				if (it == this->entries.end())
+					return false;
+				config = it->second;
+				return true;
+			}
+
+			void store(const std::string &key, size_t bucket, const Config &config, double seconds)
+			{
+				this->entries[std::make_pair(key, bucket)] = config;
+				std::ofstream file(this->path, std::ios::app);
+				file << key << " " << bucket << " " << static_cast<int>(config.type) << " "
+					<< config.threads << " " << config.blocks << " " << seconds << "\n";
+			}
+
+		private:
+			Database(const std::string &path): path(path)
+			{
+				// Later lines override earlier ones, so re-tuning only has to append
+				std::ifstream file(path);
+				std::string line;
+				while (std::getline(file, line))
+				{
+					std::istringstream fields(line);
+					std::string key;
+					size_t bucket;
+					int type;
+					Config config;
+					if (fields >> key >> bucket >> type >> config.threads >> config.blocks)
+					{
+						config.type = static_cast<Backend::Type>(type);
+						this->entries[std::make_pair(key, bucket)] = config;
+					}
+				}
+			}
+
+			std::string path;
+			std::map<std::pair<std::string, size_t>, Config> entries;
+		};
+
+		// GPU candidates stop at maxThreads, the __launch_bounds__ the kernels were compiled with
+		inline std::vector<Config> candidates(size_t size, size_t maxThreads)
+		{
+			std::vector<Config> configs;
+			configs.push_back({Backend::Type::CPU, 0, 0});
+#ifdef SKEPU_OPENMP
+			configs.push_back({Backend::Type::OpenMP, 0, 0});
+#endif
+			std::vector<Backend::Type> gpuTypes;
+#ifdef SKEPU_CUDA
+			gpuTypes.push_back(Backend::Type::CUDA);
+#endif
+#ifdef SKEPU_OPENCL
+			gpuTypes.push_back(Backend::Type::OpenCL);
+#endif
+			for (Backend::Type type : gpuTypes)
+				for (size_t threads : {64, 128, 256, 512, 1024})
+				{
+					if (threads > maxThreads)
+						break;
+					// One element per thread, then fewer blocks walking the data with a grid stride
+					size_t fullGrid = std::max<size_t>(1, (size + threads - 1) / threads);
+					for (size_t blocks : {fullGrid, std::max<size_t>(1, fullGrid / 4), std::max<size_t>(1, fullGrid / 16)})
+						configs.push_back({type, threads, blocks});
+				}
+			return configs;
+		}
+
+		// Sizes are bucketed by power of two, taking the largest container argument
+		template<typename T>
+		auto sizeOf(const T &arg, int) -> decltype(arg.size(), size_t())
+		{
+			return arg.size();
+		}
+
+		template<typename T>
+		size_t sizeOf(const T &, long)
+		{
+			return 0;
+		}
+
+		template<typename T>
+		auto flush(T &arg, int) -> decltype(arg.flush(), void())
+		{
+			arg.flush();
+		}
+
+		template<typename T>
+		void flush(T &, long) {}
+
+		template<typename... Args>
+		size_t problemSize(const Args&... args)
+		{
+			size_t size = 0;
+			for (size_t s : {size_t(0), sizeOf(args, 0)...})
+				size = std::max(size, s);
+			return size;
+		}
+
+		inline size_t bucketOf(size_t size)
+		{
+			size_t bucket = 0;
+			while (size >>= 1)
+				++bucket;
+			return bucket;
+		}
+
+		// Device results are written back lazily, so results are flushed to have the timing cover the kernel
+		template<typename... Args>
+		void flushAll(Args&... args)
+		{
+			int expand[] = {0, (flush(args, 0), 0)...};
+			(void)expand;
+		}
+
+		template<typename Skeleton>
+		class Tuned: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			Tuned(const char *key, const char *database, size_t maxThreads, CallArgs&&... args)
+			: Skeleton(std::forward<CallArgs>(args)...), key(key), database(database), maxThreads(maxThreads) {}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				size_t size = problemSize(args...);
+				size_t bucket = bucketOf(size);
+				Database &db = Database::open(this->database);
+				Config config;
+				// Entries recorded by a build with larger launch bounds cannot be launched, they are tuned again
+				if (!db.lookup(this->key, bucket, config) || config.threads > this->maxThreads)
+					config = this->sweep(db, size, bucket, args...);
+
+				this->setBackend(config.spec());
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			Config sweep(Database &db, size_t size, size_t bucket, Args&... args)
+			{
+				Config best{Backend::Type::CPU, 0, 0};
+				double bestTime = -1;
+				for (const Config &config : candidates(size, this->maxThreads))
+				{
+					this->setBackend(config.spec());
+					auto start = std::chrono::steady_clock::now();
+					Skeleton::operator()(args...);
+					flushAll(args...);
+					double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					if (bestTime < 0 || time < bestTime)
+					{
+						best = config;
+						bestTime = time;
+					}
+				}
+				db.store(this->key, bucket, best, bestTime);
+				return best;
+			}
+
+			std::string key;
+			std::string database;
+			size_t maxThreads;
+		};
+	}
+}
+)~~~";
+
+std::string generateAutotuneSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_autotune.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << AutotuneSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,198 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Batched calls for instances listed in -batched, for many small independent vectors whose calls would each be a
+ * kernel launch. A batch is a flat vector holding the items one after the other and a vector of items + 1 offsets,
+ * item i being the elements from offsets[i] to offsets[i + 1]; Reduce also takes a list of vectors, copied into a
+ * flat one. Batches of items of one size are the rows of a matrix, which the Reduce instances already reduce
+ * row-wise in one launch.
+ *
+ * Reduce writes one result per item with batched(res, flat, offsets), each combined with the start value. The CUDA
+ * kernel of the instance gets a _Batched variant reducing one item per warp; backends providing batched launch
+ * it, otherwise the items are reduced on the host. Map runs batched(res, offsets, args...) as one call over the
+ * flat vectors when its user function is neither indexed nor random, since the items are then independent
+ * elements, and as one call per item through the iterator interface otherwise, so indices start at each item.
+ */
+static const char *BatchSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace batch
+	{
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		// Elementwise arguments start at the item, the others are passed on
+		template<bool Elementwise>
+		struct Slice
+		{
+			template<typename Arg>
+			static Arg &of(Arg &arg, size_t) { return arg; }
+		};
+
+		template<>
+		struct Slice<true>
+		{
+			template<typename Arg>
+			static auto of(Arg &arg, size_t first) -> decltype(arg.begin() + first) { return arg.begin() + first; }
+		};
+
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename T>
+		auto invalidateDevice(T &arg, int) -> decltype(arg.invalidateDeviceData(), void())
+		{
+			arg.invalidateDeviceData();
+		}
+
+		template<typename T>
+		void invalidateDevice(T &, long) {}
+
+		template<typename Skeleton, typename UF>
+		class Map: public Skeleton
+		{
+			static constexpr size_t elwise = std::tuple_size<typename UF::ElwiseArgs>::value;
+
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename R, typename... Args>
+			Vector<R> &batched(Vector<R> &res, Vector<size_t> &offsets, Args&&... args)
+			{
+				return this->call(std::integral_constant<bool, !UF::indexed && !UF::usesPRNG>{}, res, offsets, args...);
+			}
+
+		private:
+			template<typename R, typename... Args>
+			Vector<R> &call(std::true_type, Vector<R> &res, Vector<size_t> &, Args&... args)
+			{
+				Skeleton::operator()(res, args...);
+				return res;
+			}
+
+			template<typename R, typename... Args>
+			Vector<R> &call(std::false_type, Vector<R> &res, Vector<size_t> &offsets, Args&... args)
+			{
+				updateHost(offsets, 0);
+				const size_t *bounds = offsets.getAddress();
+				auto whole = typename Indices<sizeof...(Args)>::type{};
+				for (size_t i = 0; i + 1 < offsets.size(); ++i)
+					if (bounds[i] < bounds[i + 1])
+						this->item(res, bounds[i], bounds[i + 1], whole, args...);
+				return res;
+			}
+
+			template<typename R, typename... Args, size_t... I>
+			void item(Vector<R> &res, size_t first, size_t last, Sequence<I...>, Args&... args)
+			{
+				Skeleton::operator()(res.begin() + first, res.begin() + last, Slice<(I < elwise)>::of(args, first)...);
+			}
+		};
+
+		template<typename Skeleton, typename ReduceUF>
+		class Reduce: public Skeleton
+		{
+			using Ret = typename ReduceUF::Ret;
+
+		public:
+			using Skeleton::Skeleton;
+
+			void setStartValue(Ret value)
+			{
+				this->start = value;
+				Skeleton::setStartValue(value);
+			}
+
+			template<typename T>
+			Vector<Ret> &batched(Vector<Ret> &res, Vector<T> &flat, Vector<size_t> &offsets)
+			{
+				this->reduceItems(0, res, flat, offsets);
+				return res;
+			}
+
+			// The items are copied into one flat vector, so the batch is still one launch
+			template<typename T>
+			Vector<Ret> &batched(Vector<Ret> &res, std::vector<Vector<T>> &items)
+			{
+				size_t total = 0;
+				for (Vector<T> &item : items)
+					total += item.size();
+
+				Vector<T> flat(total);
+				Vector<size_t> offsets(items.size() + 1);
+				T *out = flat.getAddress();
+				size_t *bounds = offsets.getAddress();
+				bounds[0] = 0;
+				for (size_t i = 0; i < items.size(); ++i)
+				{
+					updateHost(items[i], 0);
+					const T *in = items[i].getAddress();
+					for (size_t j = 0; j < items[i].size(); ++j)
+						out[bounds[i] + j] = in[j];
+					bounds[i + 1] = bounds[i] + items[i].size();
+				}
+				return this->batched(res, flat, offsets);
+			}
+
+		private:
+			template<typename T>
+			auto reduceItems(int, Vector<Ret> &res, Vector<T> &flat, Vector<size_t> &offsets)
+				-> decltype(std::declval<Skeleton&>().Skeleton::batched(res, flat, offsets), void())
+			{
+				Skeleton::batched(res, flat, offsets);
+			}
+
+			template<typename T>
+			void reduceItems(long, Vector<Ret> &res, Vector<T> &flat, Vector<size_t> &offsets)
+			{
+				updateHost(flat, 0);
+				updateHost(offsets, 0);
+				updateHost(res, 0);
+				const T *in = flat.getAddress();
+				const size_t *bounds = offsets.getAddress();
+				Ret *out = res.getAddress();
+				for (size_t i = 0; i + 1 < offsets.size(); ++i)
+				{
+					Ret result = this->start;
+					for (size_t j = bounds[i]; j < bounds[i + 1]; ++j)
+						result = ReduceUF::CPU(result, in[j]);
+					out[i] = result;
+				}
+				invalidateDevice(res, 0);
+			}
+
+			Ret start {};
+		};
+	}
+}
+)~~~";
+
+
+std::string generateBatchSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_batch.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << BatchSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,196 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Brick-ordered copies of the tensors read through Ten3 and Ten4 by -brick-tensors instances. In the row-major
+ * storage of a tensor, the neighbours of an element along i and j are a plane and a row of the tensor away, so a
+ * volumetric neighbourhood touches one cache line (and often one page) per row. In brick order the tensor is cut
+ * into slabs of BrickEdge planes, the slabs into pencils of BrickEdge rows, and the pencils into bricks of
+ * BrickEdge elements along k, each stored contiguously in row-major order; bricks at the far edges are as thin as
+ * the tensor leaves them, so the copy has the size of the tensor. A 3D neighbourhood within a brick then spans
+ * BrickEdge^3 elements instead of BrickEdge planes.
+ *
+ * The user function structs of these instances have brickedTensors set, and the CPU and OpenMP backends then build
+ * the proxies with proxyOf over the copy, while the CPU and OpenMP variants of the user functions index their
+ * Ten3 and Ten4 parameters through index3 and index4. The copies are made and cached like the transposed copies
+ * of -transpose-matcol: on first use, rebuilt when the size or the host storage of the tensor changes, and
+ * dropped by invalidate after the tensor is written through its host accessors.
+ *
+ * GPU kernels keep reading the tensor itself, where neighbouring threads read neighbouring elements along k.
+ */
+static const char *BricksSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifdef __CUDACC__
+#define SKEPU_BRICKS_HOST_DEVICE __host__ __device__
+#else
+#define SKEPU_BRICKS_HOST_DEVICE
+#endif
+
+namespace skepu
+{
+	namespace bricks
+	{
+		// Edges of the bricks of a Tensor3 (512 elements) and a Tensor4 (256 elements)
+		constexpr size_t BrickEdge3 = 8;
+		constexpr size_t BrickEdge4 = 4;
+
+		// Position of (i, j, k) in the brick order of an ni x nj x nk tensor
+		SKEPU_BRICKS_HOST_DEVICE inline size_t index3(size_t ni, size_t nj, size_t nk, size_t i, size_t j, size_t k)
+		{
+			const size_t B = BrickEdge3;
+			const size_t bi = i / B * B, bj = j / B * B, bk = k / B * B;
+			const size_t hi = (ni - bi < B) ? ni - bi : B, hj = (nj - bj < B) ? nj - bj : B, hk = (nk - bk < B) ? nk - bk : B;
+			return bi * nj * nk + bj * hi * nk + bk * hi * hj + ((i - bi) * hj + (j - bj)) * hk + (k - bk);
+		}
+
+		SKEPU_BRICKS_HOST_DEVICE inline size_t index4(size_t ni, size_t nj, size_t nk, size_t nl, size_t i, size_t j, size_t k, size_t l)
+		{
+			const size_t B = BrickEdge4;
+			const size_t bi = i / B * B, bj = j / B * B, bk = k / B * B, bl = l / B * B;
+			const size_t hi = (ni - bi < B) ? ni - bi : B, hj = (nj - bj < B) ? nj - bj : B;
+			const size_t hk = (nk - bk < B) ? nk - bk : B, hl = (nl - bl < B) ? nl - bl : B;
+			return bi * nj * nk * nl + bj * hi * nk * nl + bk * hi * hj * nl + bl * hi * hj * hk
+				+ (((i - bi) * hj + (j - bj)) * hk + (k - bk)) * hl + (l - bl);
+		}
+
+		template<typename T>
+		struct Layout
+		{
+			const T *source = nullptr;
+			size_t size_i = 0;
+			size_t size_j = 0;
+			size_t size_k = 0;
+			size_t size_l = 0;
+			std::vector<T> values;
+		};
+
+		template<typename T>
+		void brickInto(Layout<T> &layout, const T *data, size_t ni, size_t nj, size_t nk)
+		{
+			layout.source = data;
+			layout.size_i = ni;
+			layout.size_j = nj;
+			layout.size_k = nk;
+			layout.size_l = 0;
+			layout.values.resize(ni * nj * nk);
+			T *out = layout.values.data();
+#pragma omp parallel for schedule(static)
+			for (long long i = 0; i < (long long)ni; ++i)
+				for (size_t j = 0; j < nj; ++j)
+					for (size_t k = 0; k < nk; ++k)
+						out[index3(ni, nj, nk, i, j, k)] = data[(i * nj + j) * nk + k];
+		}
+
+		template<typename T>
+		void brickInto(Layout<T> &layout, const T *data, size_t ni, size_t nj, size_t nk, size_t nl)
+		{
+			layout.source = data;
+			layout.size_i = ni;
+			layout.size_j = nj;
+			layout.size_k = nk;
+			layout.size_l = nl;
+			layout.values.resize(ni * nj * nk * nl);
+			T *out = layout.values.data();
+#pragma omp parallel for schedule(static)
+			for (long long i = 0; i < (long long)ni; ++i)
+				for (size_t j = 0; j < nj; ++j)
+					for (size_t k = 0; k < nk; ++k)
+						for (size_t l = 0; l < nl; ++l)
+							out[index4(ni, nj, nk, nl, i, j, k, l)] = data[((i * nj + j) * nk + k) * nl + l];
+		}
+
+		template<typename T>
+		struct Cache
+		{
+			std::mutex mutex;
+			std::map<const void*, Layout<T>> layouts;
+
+			static Cache &instance()
+			{
+				static Cache cache;
+				return cache;
+			}
+		};
+
+		template<typename T>
+		Layout<T> const& layoutOf(skepu::Tensor3<T> &tensor)
+		{
+			tensor.updateHost();
+			Cache<T> &cache = Cache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			Layout<T> &layout = cache.layouts[&tensor];
+			if (layout.source != tensor.getAddress() || layout.size_i != tensor.size_i() || layout.size_j != tensor.size_j()
+				|| layout.size_k != tensor.size_k() || layout.size_l != 0)
+				brickInto(layout, tensor.getAddress(), tensor.size_i(), tensor.size_j(), tensor.size_k());
+			return layout;
+		}
+
+		template<typename T>
+		Layout<T> const& layoutOf(skepu::Tensor4<T> &tensor)
+		{
+			tensor.updateHost();
+			Cache<T> &cache = Cache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			Layout<T> &layout = cache.layouts[&tensor];
+			if (layout.source != tensor.getAddress() || layout.size_i != tensor.size_i() || layout.size_j != tensor.size_j()
+				|| layout.size_k != tensor.size_k() || layout.size_l != tensor.size_l())
+				brickInto(layout, tensor.getAddress(), tensor.size_i(), tensor.size_j(), tensor.size_k(), tensor.size_l());
+			return layout;
+		}
+
+		// The tensor read from the copy, whose sizes are those of the tensor
+		template<typename T>
+		skepu::Ten3<T> proxyOf3(Layout<T> const& layout)
+		{
+			skepu::Ten3<T> proxy;
+			proxy.data = const_cast<T*>(layout.values.data());
+			proxy.size_i = layout.size_i;
+			proxy.size_j = layout.size_j;
+			proxy.size_k = layout.size_k;
+			return proxy;
+		}
+
+		template<typename T>
+		skepu::Ten4<T> proxyOf4(Layout<T> const& layout)
+		{
+			skepu::Ten4<T> proxy;
+			proxy.data = const_cast<T*>(layout.values.data());
+			proxy.size_i = layout.size_i;
+			proxy.size_j = layout.size_j;
+			proxy.size_k = layout.size_k;
+			proxy.size_l = layout.size_l;
+			return proxy;
+		}
+
+		// Drops the cached copy of tensor, the next use bricks it again
+		template<typename Tensor>
+		void invalidate(Tensor &tensor)
+		{
+			Cache<typename Tensor::value_type> &cache = Cache<typename Tensor::value_type>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			cache.layouts.erase(&tensor);
+		}
+	}
+}
+)~~~";
+
+
+std::string generateBricksSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_bricks.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << BricksSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -8,8 +8,9 @@ using namespace clang;
 // ------------------------------
 
 const char *CallKernelTemplate_CL = R"~~~(
-__kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} int dummy)
+__kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} {{EXTENT_PARAMS}} int dummy)
 {
+	{{INDEX_INIT}}
 	{{CONTAINER_PROXIES}}
 	{{CONTAINER_PROXIE_INNER}}
 
@@ -17,52 +18,88 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} int dummy)
 }
 )~~~";
 
+const std::string SingleLauncher = R"~~~(
+	static void call(size_t deviceID, size_t localSize, size_t globalSize, {{HOST_KERNEL_PARAMS}} bool dummy = 0)
+	{
+		skepu_cl_set_kernel_args(kernels(deviceID), {{KERNEL_ARGS}} 0);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernels(deviceID), 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Call kernel");
+	}
+)~~~";
+
+// Indexed user functions run over the shape of the skepu::grid::Call in progress, which the runtime launch does not
+// know, and once without one. Threads past the extent return at once.
+const std::string GridLauncher = R"~~~(
+	static void call(size_t deviceID, size_t localSize, size_t globalSize, {{HOST_KERNEL_PARAMS}} bool dummy = 0)
+	{
+		skepu::grid::Shape const& skepu_shape = skepu::grid::active() ? *skepu::grid::active() : skepu::grid::Shape::single();
+		{{ND_LAUNCH}}
+	}
+
+	static void callND(size_t deviceID, skepu::grid::Shape const& skepu_shape, {{HOST_KERNEL_PARAMS}} bool dummy = 0)
+	{
+		{{ND_LAUNCH}}
+	}
+)~~~";
+
+const std::string NDLaunch = R"~~~(size_t skepu_local[2] = {skepu_shape.block[0], skepu_shape.block[1]};
+		size_t skepu_global[2] = {skepu_shape.blocks(0) * skepu_shape.block[0], skepu_shape.blocks(1) * skepu_shape.block[1]};
+		skepu_cl_set_kernel_args(kernels(deviceID), {{KERNEL_ARGS}} skepu_shape.extent[0], skepu_shape.extent[1], 0);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernels(deviceID), skepu_shape.dims, NULL, skepu_global, skepu_local, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Call kernel");)~~~";
+
 const std::string Constructor = R"~~~(
 class {{KERNEL_CLASS}}
 {
 public:
 
+	static skepu_cl_kernel_table<1> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<1> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, 0, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, 0);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
-
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating Call kernel '{{KERNEL_NAME}}'");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating Call kernel '{{KERNEL_NAME}}'");
 
-			kernels(counter++, &kernel);
-		}
+		kernels(deviceID, &kernel);
+	}
 
-		initialized = true;
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
 	}
 
-	static void call(size_t deviceID, size_t localSize, size_t globalSize, {{HOST_KERNEL_PARAMS}} bool dummy = 0)
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(kernels(deviceID), {{KERNEL_ARGS}} 0);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernels(deviceID), 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
-		CL_CHECK_ERROR(err, "Error launching Call kernel");
+		skepu_kernel_table().prepare(deviceIDs);
 	}
-};
+
+{{LAUNCHERS}}};
 )~~~";
 
 
@@ -74,7 +111,7 @@ std::string createCallKernelProgram_CL(SkeletonInstance &instance, UserFunction
 	bool first = !indexInfo.hasIndex;
 	SSCallFuncArgs << indexInfo.mapFuncParam;
 	
-	auto argsInfo = handleRandomAccessAndUniforms_CL(callFunc, SSCallFuncArgs, SSHostKernelParamList, SSKernelParamList, SSKernelArgs, first);
+	auto argsInfo = handleRandomAccessAndUniforms_CL(callFunc, SSCallFuncArgs, SSHostKernelParamList, SSKernelParamList, SSKernelArgs, first, "deviceID");
 	handleUserTypesConstantsAndPrecision_CL({&callFunc}, sourceStream);
 	proxyCodeGenHelper_CL(argsInfo.containerProxyTypes, sourceStream);
 	sourceStream << generateUserFunctionCode_CL(callFunc) << CallKernelTemplate_CL;
@@ -82,7 +119,11 @@ std::string createCallKernelProgram_CL(SkeletonInstance &instance, UserFunction
 	const std::string kernelName = instance + "_" + ResultName + "_CallKernel_" + callFunc.uniqueName + "_";
 	const std::string className = "CLWrapperClass_" + kernelName;
 
+	const bool grid = callFunc.indexed1D || callFunc.indexed2D;
+	std::string launchers = grid ? GridLauncher : SingleLauncher;
+	replaceTextInString(launchers, "{{ND_LAUNCH}}", NDLaunch);
 	std::string finalSource = Constructor;
+	replaceTextInString(finalSource, "{{LAUNCHERS}}", launchers);
 	replaceTextInString(finalSource, "{{OPENCL_KERNEL}}", sourceStream.str());
 	replaceTextInString(finalSource, "{{KERNEL_NAME}}", kernelName);
 	replaceTextInString(finalSource, "{{FUNCTION_NAME_CALL}}", callFunc.uniqueName);
@@ -93,9 +134,9 @@ std::string createCallKernelProgram_CL(SkeletonInstance &instance, UserFunction
 	replaceTextInString(finalSource, "{{KERNEL_ARGS}}", SSKernelArgs.str());
 	replaceTextInString(finalSource, "{{CONTAINER_PROXIES}}", argsInfo.proxyInitializer);
 	replaceTextInString(finalSource, "{{CONTAINER_PROXIE_INNER}}", argsInfo.proxyInitializerInner);
+	replaceTextInString(finalSource, "{{EXTENT_PARAMS}}", grid ? "size_t skepu_w, size_t skepu_h," : "");
+	replaceTextInString(finalSource, "{{INDEX_INIT}}", callFunc.indexed1D ? "index1_t skepu_index = { .i = get_global_id(0) };\n\tif (skepu_index.i >= skepu_w) return;"
+		: callFunc.indexed2D ? "index2_t skepu_index = { .row = get_global_id(1), .col = get_global_id(0) };\n\tif (skepu_index.row >= skepu_h || skepu_index.col >= skepu_w) return;" : "");
 
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << finalSource;
-
-	return kernelName;
+	return writeKernelProgram_CL(kernelName, finalSource, dir);
 }
@@ -13,17 +13,64 @@ __global__ void SKEPU_KERNEL_NAME(SKEPU_KERNEL_PARAMS)
 }
 )~~~";
 
+// A user function taking an Index1D or Index2D runs once per thread of the grid and gets its global thread index
+// (row = y, col = x for 2D). Inside VARIANT_CUDA blocks it can use threadIdx, blockIdx and an extern __shared__
+// array for the dynamic shared memory of the launch. skepu::grid::Call launches the _Grid kernel over the extent
+// set on the instance, the runtime the other one, which runs the user function once.
+const char *CallGridKernelTemplate_CU = R"~~~(
+__global__ void SKEPU_KERNEL_NAME_Grid(SKEPU_GRID_PARAMS)
+{
+	SKEPU_INDEX_INIT
+	if (SKEPU_OUT_OF_EXTENT) return;
+	SKEPU_FUNCTION_NAME_CALL(SKEPU_CALL_ARGS);
+}
+
+__global__ void SKEPU_KERNEL_NAME(SKEPU_KERNEL_PARAMS)
+{
+	const size_t skepu_w = 1, skepu_h = 1;
+	SKEPU_INDEX_INIT
+	if (SKEPU_OUT_OF_EXTENT) return;
+	SKEPU_FUNCTION_NAME_CALL(SKEPU_CALL_ARGS);
+}
+)~~~";
+
 
 std::string createCallKernelProgram_CU(SkeletonInstance &instance, UserFunction &callFunc, std::string dir)
 {
 	const std::string kernelName = ResultName + "_CallKernel_" + callFunc.uniqueName + "_";;
 
 	std::stringstream SSCallFuncParams, SSKernelParamList;
+	std::stringstream SSGridParamList;
+	std::string indexInit = "", outOfExtent = "";
 	bool first = true;
+	
+	if (callFunc.indexed1D)
+	{
+		indexInit = "skepu::Index1D skepu_index{blockIdx.x * blockDim.x + threadIdx.x};";
+		outOfExtent = "skepu_index.i >= skepu_w";
+		SSCallFuncParams << "skepu_index";
+		first = false;
+	}
+	else if (callFunc.indexed2D)
+	{
+		indexInit = "skepu::Index2D skepu_index{blockIdx.y * blockDim.y + threadIdx.y, blockIdx.x * blockDim.x + threadIdx.x};";
+		outOfExtent = "skepu_index.row >= skepu_h || skepu_index.col >= skepu_w";
+		SSCallFuncParams << "skepu_index";
+		first = false;
+	}
 
 	for (UserFunction::RandomAccessParam& param : callFunc.anyContainerParams)
 	{
-		if (!first) { SSCallFuncParams << ", "; SSKernelParamList << ", "; }
+		if (!first) { SSCallFuncParams << ", "; }
+		// The grid kernel takes every container, in the order skepu::grid::Call passes them
+		SSGridParamList << param.fullTypeName << " " << param.name << ", ";
+		if (param.deviceUnused)
+		{
+			SSCallFuncParams << param.unqualifiedFullTypeName << "{}";
+			first = false;
+			continue;
+		}
+		if (!SSKernelParamList.str().empty()) { SSKernelParamList << ", "; }
 		SSKernelParamList << param.fullTypeName << " " << param.name;
 		SSCallFuncParams << param.name;
 		first = false;
@@ -31,19 +78,25 @@ std::string createCallKernelProgram_CU(SkeletonInstance &instance, UserFunction
 
 	for (UserFunction::Param& param : callFunc.anyScalarParams)
 	{
-		if (!first) { SSCallFuncParams << ", "; SSKernelParamList << ", "; }
+		if (!first) { SSCallFuncParams << ", "; }
+		if (!SSKernelParamList.str().empty()) { SSKernelParamList << ", "; }
 		SSKernelParamList << param.resolvedTypeName << " " << param.name;
+		SSGridParamList << param.resolvedTypeName << " " << param.name << ", ";
 		SSCallFuncParams << param.name;
 		first = false;
 	}
+	SSGridParamList << "size_t skepu_w, size_t skepu_h";
 
-	std::string kernelSource = CallKernelTemplate_CU;
+	std::string kernelSource = indexInit.empty() ? CallKernelTemplate_CU : CallGridKernelTemplate_CU;
 	replaceTextInString(kernelSource, "SKEPU_KERNEL_NAME", kernelName);
 	replaceTextInString(kernelSource, "SKEPU_FUNCTION_NAME_CALL", callFunc.funcNameCUDA());
 	replaceTextInString(kernelSource, "SKEPU_KERNEL_PARAMS", SSKernelParamList.str());
 	replaceTextInString(kernelSource, "SKEPU_CALL_ARGS", SSCallFuncParams.str());
+	replaceTextInString(kernelSource, "SKEPU_GRID_PARAMS", SSGridParamList.str());
+	replaceTextInString(kernelSource, "SKEPU_INDEX_INIT", indexInit);
+	replaceTextInString(kernelSource, "SKEPU_OUT_OF_EXTENT", outOfExtent);
 
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
 	FSOutFile << kernelSource;
 	return kernelName;
 }
@@ -0,0 +1,180 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Launch shapes for Call instances whose user function takes an Index1D or Index2D. The instance is wrapped in
+ * skepu::grid::Call, whose setLaunchShape gives the threads of the grid (rows and columns for an Index2D), the
+ * threads of a block (work-group) and the dynamic shared memory of a block. Every thread calls the user function
+ * with its global index, and the kernels return early for threads past the extent, which rounds up to whole
+ * blocks. Without a shape the user function runs once, with index 0.
+ *
+ * On CUDA the wrapper launches the _Grid kernel itself, with the device proxies of the containers in the access
+ * modes of the user function, so that the containers stay coherent. On OpenCL the shape is active while the
+ * instance runs, and the generated wrapper class launches its NDRange over it. Other backends run the instance
+ * as it is.
+ */
+static const char *CallGridSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace skepu
+{
+	namespace grid
+	{
+		// Dimension 0 is the column of an Index2D, dimension 1 its row
+		struct Shape
+		{
+			unsigned dims;
+			size_t extent[2];
+			size_t block[2];
+			size_t sharedBytes;
+
+			size_t blocks(size_t d) const
+			{
+				return (this->extent[d] + this->block[d] - 1) / this->block[d];
+			}
+
+			static Shape single()
+			{
+				return Shape{1, {1, 1}, {1, 1}, 0};
+			}
+		};
+
+		// The shape of the grid instance running on this thread, if any
+		inline Shape const *&active()
+		{
+			static thread_local Shape const *shape = nullptr;
+			return shape;
+		}
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+#ifdef SKEPU_CUDA
+		// Containers are passed as device proxies, unless the kernel does not use them, and the rest as they are
+		template<bool Container>
+		struct Argument
+		{
+			template<typename UF, size_t I, typename Arg>
+			static Arg &of(size_t, Arg &arg) { return arg; }
+		};
+
+		template<>
+		struct Argument<true>
+		{
+			template<typename UF, size_t I, typename Arg>
+			static typename std::tuple_element<I, typename UF::ContainerArgs>::type of(size_t deviceID, Arg &arg)
+			{
+				if ((UF::deviceUnusedContainers >> I) & 1)
+					return {};
+				return arg.cudaProxy(deviceID, UF::anyAccessMode[I]).second;
+			}
+		};
+
+		template<typename... Params, size_t... I>
+		cudaError_t launch(void (*kernel)(Params...), Shape const& shape, std::tuple<Params...> &values, Sequence<I...>)
+		{
+			void *pointers[] = {static_cast<void*>(&std::get<I>(values))..., nullptr};
+			return cudaLaunchKernel(reinterpret_cast<const void*>(kernel), dim3(shape.blocks(0), shape.blocks(1)),
+				dim3(shape.block[0], shape.block[1]), pointers, shape.sharedBytes, 0);
+		}
+#endif
+
+		template<typename Skeleton, typename UF, typename Grid>
+		class Call: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->cuda = (spec.backend() == Backend::Type::CUDA);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->cuda = defaultCUDA();
+				Skeleton::resetBackend();
+			}
+
+			void setLaunchShape(size_t threads, size_t block = 256, size_t sharedBytes = 0)
+			{
+				this->shape = Shape{1, {threads, 1}, {block, 1}, sharedBytes};
+			}
+
+			void setLaunchShape(size_t rows, size_t cols, size_t blockRows, size_t blockCols, size_t sharedBytes = 0)
+			{
+				this->shape = Shape{2, {cols, rows}, {blockCols, blockRows}, sharedBytes};
+			}
+
+			template<typename... Args>
+			void operator()(Args&&... args)
+			{
+				if (this->shape.extent[0] == 0 || this->shape.extent[1] == 0)
+					return;
+#ifdef SKEPU_CUDA
+				if (this->cuda)
+					return this->launchCUDA(typename Indices<sizeof...(Args)>::type{}, args...);
+#endif
+				Shape const *previous = active();
+				active() = &this->shape;
+				Skeleton::operator()(std::forward<Args>(args)...);
+				active() = previous;
+			}
+
+		private:
+			static constexpr bool defaultCUDA()
+			{
+#ifdef SKEPU_CUDA
+				return true;
+#else
+				return false;
+#endif
+			}
+
+#ifdef SKEPU_CUDA
+			template<size_t... I, typename... Args>
+			void launchCUDA(Sequence<I...>, Args&... args)
+			{
+				constexpr size_t containers = std::tuple_size<typename UF::ContainerArgs>::value;
+				const size_t deviceID = skepu::backend::Environment<int>::getInstance()->bestCUDADevID;
+				cudaSetDevice(deviceID);
+				auto values = this->parameters(Grid::kernel(), Argument<(I < containers)>::template of<UF, I>(deviceID, args)...);
+				cudaError_t err = launch(Grid::kernel(), this->shape, values, typename Indices<std::tuple_size<decltype(values)>::value>::type{});
+				if (err != cudaSuccess)
+					SKEPU_ERROR("Error launching grid Call kernel: " << cudaGetErrorString(err));
+			}
+
+			template<typename... Params, typename... Values>
+			std::tuple<Params...> parameters(void (*)(Params...), Values&&... values) const
+			{
+				return std::tuple<Params...>(std::forward<Values>(values)..., this->shape.extent[0], this->shape.extent[1]);
+			}
+#endif
+
+			Shape shape = Shape::single();
+			bool cuda = defaultCUDA();
+		};
+	}
+}
+)~~~";
+
+
+std::string generateCallGridSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_call_grid.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << CallGridSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -1,3 +1,10 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include "clang/Lex/Lexer.h"
+
 #include "code_gen.h"
 #include "code_gen_cu.h"
 
@@ -32,7 +39,7 @@ int getRangeSize(SourceRange range)
 	return GlobalRewriter.getRangeSize(range);
 }
 
-void printParamList(std::ostream &o, UserFunction &Func)
+void printParamList(std::ostream &o, UserFunction &Func, bool philoxRandom = false)
 {
 	bool first = true;
 
@@ -60,9 +67,14 @@ void printParamList(std::ostream &o, UserFunction &Func)
 	if (UserFunction::RandomParam *param = Func.randomParam)
 	{
 		if (!first) { o << ", "; }
-		o << "skepu::Random<" << param->randomCount << "> ";
-		if (param->isLValueReference) o << "& ";
-		if (param->isRValueReference) o << "&& ";
+		if (philoxRandom)
+			o << "skepu::philox::Stream ";
+		else
+		{
+			o << "skepu::Random<" << param->randomCount << "> ";
+			if (param->isLValueReference) o << "& ";
+			if (param->isRValueReference) o << "&& ";
+		}
 		o << param->name;
 		first = false;
 	}
@@ -108,11 +120,92 @@ void replaceTextInString(std::string& text, const std::string &find, const std::
 	}
 }
 
-std::string templateString(std::string templ, std::vector<std::pair<std::string, std::string>> replacements)
+// Translation units processed concurrently with -j write the shared support headers to the same directory
+static std::mutex OutputFileLock;
+
+bool writeFileIfChanged(const std::string &path, const std::string &content)
+{
+	std::lock_guard<std::mutex> guard(OutputFileLock);
+	std::ifstream existing(path, std::ios::binary);
+	bool unchanged = existing && std::string{std::istreambuf_iterator<char>(existing), std::istreambuf_iterator<char>()} == content;
+	existing.close();
+	
+	if (!unchanged)
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << content;
+		if (!out)
+			SkePUAbort("Could not write output file " + path);
+	}
+	else
+		SkePULog() << "Output file " << path << " is unchanged\n";
+	
+	GeneratedFiles.push_back({path, content.size(), !unchanged});
+	return !unchanged;
+}
+
+/*!
+ * Expands the {{...}} placeholders of templ in one pass. The result is the same as replacing the placeholders one
+ * after another in list order: a replacement value has its placeholders expanded by the entries that follow it in
+ * the list, while the earlier ones are kept verbatim (e.g. {"{{KERNEL_NAME}}", "{{KERNEL_NAME}}_UnitStride"}).
+ */
+static void expandTemplate(std::string &out, const std::string &templ, size_t firstEntry,
+	const std::vector<std::pair<std::string, std::string>> &replacements,
+	const std::unordered_map<std::string, size_t> &index, std::vector<bool> &used)
+{
+	size_t pos = 0;
+	while (true)
+	{
+		size_t begin = templ.find("{{", pos);
+		size_t end = (begin == std::string::npos) ? std::string::npos : templ.find("}}", begin + 2);
+		if (end == std::string::npos)
+		{
+			out.append(templ, pos, std::string::npos);
+			return;
+		}
+		end += 2;
+
+		auto it = index.find(templ.substr(begin, end - begin));
+		if (it == index.end() || it->second < firstEntry)
+		{
+			if (it == index.end())
+				SkePULog() << "Template placeholder " << templ.substr(begin, end - begin) << " left unexpanded\n";
+			// Only skip one brace, a placeholder may start inside this one (e.g. "{{{X}}")
+			out.append(templ, pos, begin + 1 - pos);
+			pos = begin + 1;
+			continue;
+		}
+
+		out.append(templ, pos, begin - pos);
+		const std::string &value = replacements[it->second].second;
+		used[it->second] = true;
+		if (value.find("{{") != std::string::npos)
+			expandTemplate(out, value, it->second + 1, replacements, index, used);
+		else
+			out += value;
+		pos = end;
+	}
+}
+
+std::string templateString(const std::string &templ, const std::vector<std::pair<std::string, std::string>> &replacements)
 {
-	for(std::pair<std::string, std::string> &element : replacements)
-		replaceTextInString(templ, element.first, element.second);
-	return templ;
+	std::unordered_map<std::string, size_t> index;
+	size_t size = templ.size();
+	for (size_t i = 0; i < replacements.size(); ++i)
+	{
+		index.emplace(replacements[i].first, i);
+		size += replacements[i].second.size();
+	}
+
+	std::string out;
+	out.reserve(size);
+	std::vector<bool> used(replacements.size(), false);
+	expandTemplate(out, templ, 0, replacements, index, used);
+
+	for (size_t i = 0; i < replacements.size(); ++i)
+		if (!used[i])
+			SkePULog() << "Template placeholder " << replacements[i].first << " does not occur in the template\n";
+	return out;
 }
 
 std::string transformToCXXIdentifier(std::string &in)
@@ -129,7 +222,8 @@ std::string transformToCXXIdentifier(std::string &in)
 
 
 
-std::map<std::string, std::pair<int, std::string>> proxyInfo = {
+// Read concurrently by the workers of -j, so it is only ever looked up with find()
+static const std::map<std::string, std::pair<int, std::string>> proxyInfo = {
 	{"Vec",      {2, "skepu_vec_proxy_access_"}},
 	{"Mat",      {3, "skepu_mat_proxy_access_"}},
 	{"MatRow",   {2, "skepu_matrow_proxy_access_"}},
@@ -141,9 +235,195 @@ std::map<std::string, std::pair<int, std::string>> proxyInfo = {
 	{"Region3D", {4, "skepu_region_access_3d_"}},
 	{"Region4D", {5, "skepu_region_access_4d_"}},
 };
-std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::function<std::string(UserFunction&)> nameFunc)
+/*!
+ * Fast-math intrinsics for whitelisted single precision library calls (-fast-math). Accuracy contract:
+ * the results follow the CUDA intrinsic (__expf, __sinf, ...) and OpenCL native_* error bounds instead of
+ * the library ones. These bounds are implementation-defined on OpenCL and degrade outside small argument ranges,
+ * e.g. |x| > pi for the CUDA trigonometric intrinsics. pow maps to __powf / native_powr, which require a
+ * non-negative base. Denormals may be flushed to zero. Double precision calls are never rewritten.
+ */
+static const std::map<std::string, std::string> FastMathIntrinsics_CU
+{
+	{"exp",   "__expf"},
+	{"log",   "__logf"},
+	{"log2",  "__log2f"},
+	{"log10", "__log10f"},
+	{"pow",   "__powf"},
+	{"sin",   "__sinf"},
+	{"cos",   "__cosf"},
+	{"tan",   "__tanf"},
+};
+
+static const std::map<std::string, std::string> FastMathIntrinsics_CL
+{
+	{"exp",   "native_exp"},
+	{"exp2",  "native_exp2"},
+	{"exp2f", "native_exp2"},
+	{"log",   "native_log"},
+	{"log2",  "native_log2"},
+	{"log10", "native_log10"},
+	{"pow",   "native_powr"},
+	{"sqrt",  "native_sqrt"},
+	{"sin",   "native_sin"},
+	{"cos",   "native_cos"},
+	{"tan",   "native_tan"},
+};
+
+static bool isSinglePrecision(const Expr *e)
+{
+	return e->getType().getCanonicalType()->isSpecificBuiltinType(BuiltinType::Float);
+}
+
+static void rewriteFastMath(Backend backend, UserFunction &UF, Rewriter &R)
+{
+	if (!FastMath || (backend != Backend::CUDA && backend != Backend::OpenCL))
+		return;
+	
+	const auto &intrinsics = (backend == Backend::CUDA) ? FastMathIntrinsics_CU : FastMathIntrinsics_CL;
+	const std::string rsqrt = (backend == Backend::CUDA) ? "rsqrtf" : "native_rsqrt";
+	
+	std::set<const Expr*> fused;
+	for (const BinaryOperator *div : UF.reciprocalSqrts)
+	{
+		const CallExpr *call = dyn_cast<CallExpr>(div->getRHS()->IgnoreImpCasts());
+		if (!isSinglePrecision(call))
+			continue;
+		R.ReplaceText(SourceRange(div->getBeginLoc(), call->getCallee()->getEndLoc()), rsqrt);
+		fused.insert(call);
+	}
+	
+	for (const CallExpr *call : UF.libraryCalls)
+	{
+		auto it = intrinsics.find(call->getDirectCallee()->getName().str());
+		if (it == intrinsics.end() || fused.count(call) || !isSinglePrecision(call))
+			continue;
+		
+		// All arguments must be single precision too, or the intrinsic would narrow them
+		bool single = true;
+		for (const Expr *arg : call->arguments())
+			single = single && isSinglePrecision(arg->IgnoreImpCasts());
+		if (single)
+			R.ReplaceText(call->getCallee()->getSourceRange(), it->second);
+	}
+}
+
+// Composite reduce functions combine element k of both operands with reduce function k
+std::string generateMultiReduceBody(Backend backend, UserFunction &UF, std::function<std::string(UserFunction&)> nameFunc)
+{
+	std::stringstream SSBody;
+	if (backend == Backend::CUDA)
+		SSBody << "\nreturn " << UF.multiReturnTypeNameGPU() << "::make(";
+	else if (backend == Backend::OpenCL)
+		SSBody << "\nreturn make_" << UF.multiReturnTypeNameGPU() << "(";
+	else
+		SSBody << "\nreturn Ret(";
+	
+	for (size_t k = 0; k < UF.multiReduceParts.size(); ++k)
+	{
+		std::string a = UF.elwiseParams[0].name, b = UF.elwiseParams[1].name, e = std::to_string(k);
+		if (k > 0) SSBody << ", ";
+		if (backend == Backend::CUDA || backend == Backend::OpenCL)
+			SSBody << nameFunc(*UF.multiReduceParts[k]) << "(" << a << ".e" << e << ", " << b << ".e" << e << ")";
+		else
+			SSBody << nameFunc(*UF.multiReduceParts[k]) << "(std::get<" << e << ">(" << a << "), std::get<" << e << ">(" << b << "))";
+	}
+	SSBody << ");";
+	return SSBody.str();
+}
+
+// Collects the reads of the overlap fields oi, oj, ok and ol on the region parameter, by field index
+class RegionOverlapVisitor : public RecursiveASTVisitor<RegionOverlapVisitor>
+{
+public:
+	std::string param;
+	std::vector<std::pair<SourceRange, size_t>> accesses;
+	
+	RegionOverlapVisitor(std::string p): param(p) {}
+	
+	bool VisitMemberExpr(MemberExpr *e)
+	{
+		this->check(e->getBase(), e->getMemberDecl()->getNameAsString(), e->getSourceRange());
+		return true;
+	}
+	
+	// Members of a region with a template element type are resolved at instantiation
+	bool VisitCXXDependentScopeMemberExpr(CXXDependentScopeMemberExpr *e)
+	{
+		if (!e->isImplicitAccess())
+			this->check(e->getBase(), e->getMember().getAsString(), e->getSourceRange());
+		return true;
+	}
+	
+private:
+	void check(const Expr *base, const std::string &member, SourceRange range)
+	{
+		static const std::vector<std::string> fields = {"oi", "oj", "ok", "ol"};
+		auto *ref = dyn_cast<DeclRefExpr>(base->IgnoreParenImpCasts());
+		auto it = std::find(fields.begin(), fields.end(), member);
+		if (ref && ref->getDecl()->getNameAsString() == this->param && it != fields.end())
+			this->accesses.emplace_back(range, it - fields.begin());
+	}
+};
+
+// The overlap of a -static-overlap instance becomes a literal in the user function, so its loops have constant bounds
+static void rewriteStaticOverlap(UserFunction &UF, const FunctionDecl *f, Rewriter &R)
+{
+	if (UF.staticOverlap.empty() || !UF.regionParam)
+		return;
+	
+	RegionOverlapVisitor visitor(UF.regionParam->name);
+	visitor.TraverseStmt(f->getBody());
+	for (auto &access : visitor.accesses)
+		if (access.second < UF.staticOverlap.size())
+			R.ReplaceText(access.first, "(" + std::to_string(UF.staticOverlap[access.second]) + ")");
+}
+
+// Element type of a skepu::complex::complex type, empty for other types
+static std::string complexRealTypeOf(QualType type)
+{
+	auto *spec = dyn_cast_or_null<ClassTemplateSpecializationDecl>(type.getNonReferenceType()->getAsCXXRecordDecl());
+	if (!spec || spec->getQualifiedNameAsString() != "skepu::complex::complex" || spec->getTemplateArgs().size() == 0)
+		return "";
+	return spec->getTemplateArgs()[0].getAsType().getUnqualifiedType().getAsString();
+}
+
+// Accesses of the re and im fields of complex numbers, which are the x and y components of the OpenCL vector
+class ComplexMemberVisitor : public RecursiveASTVisitor<ComplexMemberVisitor>
+{
+public:
+	std::vector<const MemberExpr*> members;
+	
+	bool VisitMemberExpr(MemberExpr *e)
+	{
+		std::string name = e->getMemberDecl()->getNameAsString();
+		if ((name == "re" || name == "im") && !complexRealTypeOf(e->getBase()->getType()->isPointerType()
+			? e->getBase()->getType()->getPointeeType() : e->getBase()->getType()).empty())
+			this->members.push_back(e);
+		return true;
+	}
+};
+
+// The proxy type of the container indexed by a container call, and the name of the container variable
+static const TemplateSpecializationType *containerCallType(CXXOperatorCallExpr *call, std::string &varname)
+{
+	Expr *arg0 = call->getArg(0);
+	if (auto *expr = dyn_cast<ImplicitCastExpr>(arg0))
+		arg0 = expr->getSubExpr();
+	DeclRefExpr* container = dyn_cast<clang::DeclRefExpr>(arg0);
+	
+	auto type = container->getDecl()->getType().getTypePtr();
+	if (auto *innertype = dyn_cast<ElaboratedType>(type))
+		type = innertype->getNamedType().getTypePtr();
+	varname = container->getNameInfo().getAsString();
+	return dyn_cast<TemplateSpecializationType>(type);
+}
+
+std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::function<std::string(UserFunction&)> nameFunc, bool storeOutputs)
 {
 	SkePULog() << "Modifying UF code for " << nameFunc(UF) << "\n";
+	if (UF.multiReduceMap)
+		return generateMultiReduceBody(backend, UF, nameFunc);
+	
 	const FunctionDecl *f = UF.astDeclNode;
 	if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
 		f = f->getTemplateInstantiationPattern();
@@ -151,7 +431,35 @@ std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::
 	// Find references to other userfunctions
 	Rewriter R(GlobalRewriter.getSourceMgr(), LangOptions());
 
-	if (UF.multipleReturnTypes.size() > 0)
+	if (storeOutputs)
+	{
+		// return skepu::ret(a, b); becomes { T0 skepu_result_0 = (a); T1 skepu_result_1 = (b); *skepu_store_0 = skepu_result_0; ... return; },
+		// every argument is evaluated before the first store in case an output aliases something they read. The edits
+		// only cover the text between the arguments, so the arguments are rewritten as usual
+		const SourceManager &SM = GlobalRewriter.getSourceMgr();
+		auto distance = [&SM] (SourceLocation from, SourceLocation to) { return SM.getFileOffset(to) - SM.getFileOffset(from); };
+		std::string stores;
+		for (size_t i = 0; i < UF.multipleReturnTypes.size(); ++i)
+			stores += " *skepu_store_" + std::to_string(i) + " = skepu_result_" + std::to_string(i) + ";";
+		for (auto &returned : UF.returnedRets)
+		{
+			const CallExpr *ret = returned.first;
+			SourceLocation from = returned.second->getReturnLoc();
+			std::string text = "{ ";
+			for (unsigned i = 0; i < ret->getNumArgs(); ++i)
+			{
+				text += UF.multipleReturnTypes[i] + " skepu_result_" + std::to_string(i) + " = (";
+				R.ReplaceText(from, distance(from, ret->getArg(i)->getBeginLoc()), text);
+				from = Lexer::getLocForEndOfToken(ret->getArg(i)->getEndLoc(), 0, SM, LangOptions());
+				text = "); ";
+			}
+			SourceLocation end = Lexer::findLocationAfterToken(ret->getRParenLoc(), tok::semi, SM, LangOptions(), false);
+			if (end.isInvalid())
+				end = Lexer::getLocForEndOfToken(ret->getRParenLoc(), 0, SM, LangOptions());
+			R.ReplaceText(from, distance(from, end), ");" + stores + " return; }");
+		}
+	}
+	else if (UF.multipleReturnTypes.size() > 0)
 	{
 		if (backend == Backend::OpenCL)
 		{
@@ -179,10 +487,13 @@ std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::
 			std::string name = Func->getName();
 			std::string variant = ((name == "get") ? "get" : "get_normalized");
 			
-			R.ReplaceText(ref->getSourceRange(), "skepu_random_" + variant + "(" + varname + ")");
+			R.ReplaceText(ref->getSourceRange(), "skepu_random_" + variant + "(" + (PhiloxRandom ? "&" : "") + varname + ")");
 		}
 	}
 	
+	rewriteFastMath(backend, UF, R);
+	rewriteStaticOverlap(UF, f, R);
+	
 	for (auto &ref : UF.UFReferences)
 	{
 		SkePULog() << "--> Replacing UF reference with " << nameFunc(*ref.second) << "\n";
@@ -195,92 +506,98 @@ std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::
 	for (auto subscript : UF.containerSubscripts)
 		R.InsertText(subscript->getCallee()->getBeginLoc(), ".data");
 	
+	// The host variants of -brick-tensors instances read tensors from their brick-ordered copies
+	if (UF.brickedTensors && (backend == Backend::CPU || backend == Backend::OpenMP))
+		for (auto call : UF.containerCalls)
+		{
+			std::string varname;
+			const auto *templateType = containerCallType(call, varname);
+			std::string templateName = templateType->getTemplateName().getAsTemplateDecl()->getNameAsString();
+			if (templateName != "Ten3" && templateName != "Ten4")
+				continue;
+			
+			std::string sizes = varname + ".size_i, " + varname + ".size_j, " + varname + ".size_k";
+			if (templateName == "Ten4")
+				sizes += ", " + varname + ".size_l";
+			std::string args = getSourceAsString(clang::SourceRange(call->getArg(1)->getBeginLoc(), call->getArg(call->getNumArgs() - 1)->getEndLoc()));
+			std::string index = (templateName == "Ten3") ? "skepu::bricks::index3(" : "skepu::bricks::index4(";
+			R.ReplaceText(call->getSourceRange(), varname + ".data[" + index + sizes + ", " + args + ")]");
+		}
+	
 	if (backend == Backend::OpenCL)
 		for (auto subscript : UF.containerCalls)
 		{
-			Expr *arg0 = subscript->getArg(0);
-			if (auto *expr = dyn_cast<ImplicitCastExpr>(arg0))
-				arg0 = expr->getSubExpr();
-			DeclRefExpr* container = dyn_cast<clang::DeclRefExpr>(arg0);
-			
-			auto type = container->getDecl()->getType().getTypePtr();
-			if (auto *innertype = dyn_cast<ElaboratedType>(type))
-				type = innertype->getNamedType().getTypePtr();
-			const auto *templateType = dyn_cast<TemplateSpecializationType>(type);
+			std::string varname;
+			const auto *templateType = containerCallType(subscript, varname);
 
 			std::string templateName = templateType->getTemplateName().getAsTemplateDecl()->getNameAsString();
-			std::string varname = container->getNameInfo().getAsString();
 			std::string typeName = templateType->getArg(0).getAsType().getAsString();
 			replaceTextInString(typeName, "struct ", "");
 			
+			auto proxy = proxyInfo.find(templateName);
+			if (proxy == proxyInfo.end())
+				SkePUAbort("Unsupported container proxy type in OpenCL user function: " + templateName);
 			int numArgs;
 			std::string fname;
-			std::tie(numArgs, fname) = proxyInfo[templateName];
+			std::tie(numArgs, fname) = proxy->second;
 			fname += transformToCXXIdentifier(typeName);
 			std::string args = getSourceAsString(clang::SourceRange(subscript->getArg(1)->getBeginLoc(), subscript->getArg(numArgs-1)->getEndLoc()));
 			R.ReplaceText(subscript->getSourceRange(), fname + "(" + varname + "," + args + ")");
 		}
 	
 	if (backend == Backend::OpenCL)
+	{
 		for (auto overload : UF.operatorOverloads)
 		{
-			auto ooc = overload->getOperator();
-	//		overload->dump();
-			std::string functionName;
-			int operatorLength = 1;
-			if (ooc == OO_Plus)
-			{
-				functionName = "complex_add"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 1;
-			}
-			else if (ooc == OO_Minus)
-			{
-				functionName = "complex_sub"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 1;
-			}
-			else if (ooc == OO_Star)
-			{
-				functionName = "complex_mul"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 1;
-			}
-			else if (ooc == OO_Slash)
+			static const std::map<OverloadedOperatorKind, std::string> operations
 			{
-				functionName = "complex_div"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 1;
-			}
-			else if (ooc == OO_EqualEqual)
-			{
-				functionName = "complex_equal"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 2;
-			}
-			else if (ooc == OO_ExclaimEqual)
-			{
-				functionName = "complex_notequal"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 2;
-			}
-			else if (ooc == OO_PlusEqual)
-			{
-				functionName = "complex_assign_add"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 2;
-			}
-			else if (ooc == OO_MinusEqual)
-			{
-				functionName = "complex_assign_sub"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 2;
-			}
-			else if (ooc == OO_StarEqual)
-			{
-				functionName = "complex_assign_mul"; // add inner type, differentiate between add, addr, addr2
-				operatorLength = 2;
-			}
+				{OO_Plus, "add"}, {OO_Minus, "sub"}, {OO_Star, "mul"}, {OO_Slash, "div"},
+				{OO_EqualEqual, "equal"}, {OO_ExclaimEqual, "notequal"},
+				{OO_PlusEqual, "assign_add"}, {OO_MinusEqual, "assign_sub"}, {OO_StarEqual, "assign_mul"}, {OO_SlashEqual, "assign_div"},
+			};
+			auto ooc = overload->getOperator();
+			auto operation = operations.find(ooc);
+			if (operation == operations.end() || overload->getNumArgs() != 2)
+				continue;
+			
+			// Only the complex operators, complex_<real>_<operation> where a real operand adds the suffix r or r2
+			std::string lhs = complexRealTypeOf(overload->getArg(0)->getType()), rhs = complexRealTypeOf(overload->getArg(1)->getType());
+			if (lhs.empty() && rhs.empty())
+				continue;
+			std::string functionName = "complex_" + (lhs.empty() ? rhs : lhs) + "_" + operation->second + (rhs.empty() ? "r" : lhs.empty() ? "r2" : "");
+			int operatorLength = (ooc == OO_Plus || ooc == OO_Minus || ooc == OO_Star || ooc == OO_Slash) ? 1 : 2;
 			
 			R.InsertText(overload->getBeginLoc(), functionName + "(");
 			R.InsertText(overload->getArg(1)->getBeginLoc().getLocWithOffset(getRangeSize(overload->getArg(1)->getSourceRange())), ")");
 			R.ReplaceText(clang::SourceRange(overload->getOperatorLoc(), overload->getOperatorLoc().getLocWithOffset(operatorLength)), ",");
 		}
+		
+		ComplexMemberVisitor visitor;
+		visitor.TraverseStmt(UF.astDeclNode->getBody());
+		for (const MemberExpr *member : visitor.members)
+			R.ReplaceText(member->getMemberLoc(), member->getMemberDecl()->getName().size(), member->getMemberDecl()->getName() == "re" ? "x" : "y");
+	}
 
 	const CompoundStmt *Body = dyn_cast<CompoundStmt>(f->getBody());
 	SourceRange SRBody = SourceRange(Body->getBeginLoc().getLocWithOffset(1), Body->getEndLoc().getLocWithOffset(-1));
+	
+	// Composite user functions compute the fused parameter from the producer first
+	if (UF.fusedProducer)
+	{
+		std::stringstream SSProducerCall;
+		SSProducerCall << "\n" << ((backend == Backend::OpenCL) ? UF.fusedParam->typeNameOpenCL() : UF.fusedParam->resolvedTypeName)
+			<< " " << UF.fusedParam->name << " = " << nameFunc(*UF.fusedProducer) << "(";
+		bool first = true;
+		for (std::string &arg : UF.fusedProducerArgs)
+		{
+			if (!first) SSProducerCall << ", ";
+			SSProducerCall << arg;
+			first = false;
+		}
+		SSProducerCall << ");";
+		return SSProducerCall.str() + R.getRewrittenText(SRBody);
+	}
+	
 	return R.getRewrittenText(SRBody);
 }
 
@@ -292,7 +609,31 @@ bool testAndSet(bool &arg, bool newVal = true)
 	return oldVal;
 }
 
-static std::set<std::string> generatedStructs;
+static thread_local std::set<std::string> generatedStructs;
+
+static bool isArithmeticValue(clang::QualType type)
+{
+	return !type->isReferenceType() && !type->isDependentType() && type.getCanonicalType()->isArithmeticType();
+}
+
+// -omp-simd: pure elementwise user functions of arithmetic scalars, optionally 1D-indexed, get a declare simd variant
+static bool hasOMPSIMDVariant(UserFunction &UF)
+{
+	if (!OMPSIMD || !GenOMP)
+		return false;
+	if (UF.indexed2D || UF.indexed3D || UF.indexed4D || UF.randomParam || UF.regionParam || !UF.anyContainerParams.empty()
+		|| !UF.multipleReturnTypes.empty() || UF.fusedProducer || UF.multiReduceMap)
+		return false;
+	if (!isArithmeticValue(UF.astDeclNode->getReturnType()))
+		return false;
+	for (UserFunction::Param &param : UF.elwiseParams)
+		if (!isArithmeticValue(param.astDeclNode->getType()))
+			return false;
+	for (UserFunction::Param &param : UF.anyScalarParams)
+		if (!isArithmeticValue(param.astDeclNode->getType()))
+			return false;
+	return true;
+}
 
 void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clang::SourceLocation loc)
 {
@@ -303,7 +644,6 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 		generateUserFunctionStruct(*referenced, InstanceName, loc);
 
 	// Continue generating functor for this user function
-	const FunctionDecl *f = UF.astDeclNode;
 	std::string FunctorName = SkePU_UF_Prefix + InstanceName + "_" + UF.uniqueName;
 
 	if (std::find(generatedStructs.begin(), generatedStructs.end(), FunctorName) != generatedStructs.end())
@@ -333,7 +673,7 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 
 	size_t outArity = std::max<size_t>(1, UF.multipleReturnTypes.size());
 
-	SSSkepuFunctorStruct << "constexpr static size_t totalArity = " << f->param_size() << ";\n";
+	SSSkepuFunctorStruct << "constexpr static size_t totalArity = " << UF.paramCount() << ";\n";
 	SSSkepuFunctorStruct << "constexpr static size_t outArity = " << outArity << ";\n";
 	SSSkepuFunctorStruct << "constexpr static bool indexed = " << (UF.indexed1D || UF.indexed2D || UF.indexed3D || UF.indexed4D) << ";\n";
 	SSSkepuFunctorStruct << "constexpr static bool usesPRNG = " << (UF.randomParam != nullptr) << ";\n";
@@ -393,6 +733,12 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 	SSSkepuFunctorStruct << "constexpr static skepu::AccessMode anyAccessMode[] = {\n";
 	for (auto param : UF.anyContainerParams)
 	{
+		// Write-only arguments are not uploaded, so one the body also reads has to be passed as read-write
+		if (param.accessMode == AccessMode::Write && UF.readsElements(param))
+		{
+			llvm::errs() << "[SKEPU] Warning: " << UF.rawName << ": write-only parameter " << param.name << " is also read, its contents are uploaded\n";
+			param.accessMode = AccessMode::ReadWrite;
+		}
 		SSSkepuFunctorStruct << "skepu::AccessMode::";
 		if (param.accessMode == AccessMode::Read)
 			SSSkepuFunctorStruct << "Read, ";
@@ -406,12 +752,30 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 	SSSkepuFunctorStruct << "using Ret = " << UF.resolvedReturnTypeName << ";\n\n";
 	if (UF.multipleReturnTypes.size() == 0 && UF.rawReturnTypeName != UF.resolvedReturnTypeName && (std::find(usingDecls.begin(), usingDecls.end(), UF.rawReturnTypeName) == usingDecls.end()))
 		SSSkepuFunctorStruct << "using " << UF.rawReturnTypeName << " = " << UF.resolvedReturnTypeName << ";\n\n";
-	SSSkepuFunctorStruct << "constexpr static bool prefersMatrix = " << (UF.indexed2D) << ";\n\n";
+	SSSkepuFunctorStruct << "constexpr static bool prefersMatrix = " << (UF.indexed2D) << ";\n";
+	SSSkepuFunctorStruct << "constexpr static bool transposedMatCol = " << (UF.transposedMatCol) << ";\n";
+	SSSkepuFunctorStruct << "constexpr static bool brickedTensors = " << (UF.brickedTensors) << ";\n";
+	unsigned long long deviceUnused = 0;
+	for (size_t i = 0; i < UF.anyContainerParams.size() && i < 64; ++i)
+		deviceUnused |= (unsigned long long)UF.anyContainerParams[i].deviceUnused << i;
+	SSSkepuFunctorStruct << "constexpr static unsigned long long deviceUnusedContainers = " << deviceUnused << "ull;\n";
+	const bool ompSIMD = hasOMPSIMDVariant(UF);
+	SSSkepuFunctorStruct << "constexpr static bool ompSIMD = " << ompSIMD << ";\n";
+	
+	UserFunction::Cost cost = UF.estimateCost();
+	SSSkepuFunctorStruct << "constexpr static double flopsPerElement = " << cost.flops << ";\n";
+	SSSkepuFunctorStruct << "constexpr static double transcendentalsPerElement = " << cost.transcendentals << ";\n";
+	SSSkepuFunctorStruct << "constexpr static double bytesPerElement = " << cost.bytes << ";\n\n";
 
 	// CUDA code
 	if (GenCUDA)
 	{
-		SSSkepuFunctorStruct << generateCUDAMultipleReturn(UF);
+		// Composite reduce functions share the multi-return struct of the map function they reduce
+		if (UF.multiReduceMap)
+			SSSkepuFunctorStruct << "using " << UF.multiReturnTypeNameGPU() << " = " << SkePU_UF_Prefix << InstanceName << "_"
+				<< UF.multiReduceMap->uniqueName << "::" << UF.multiReduceMap->multiReturnTypeNameGPU() << ";\n";
+		else
+			SSSkepuFunctorStruct << generateCUDAMultipleReturn(UF);
 		SSSkepuFunctorStruct << "#define SKEPU_USING_BACKEND_CUDA 1\n";
 		SSSkepuFunctorStruct << "#undef VARIANT_CPU\n";
 		SSSkepuFunctorStruct << "#undef VARIANT_OPENMP\n";
@@ -419,14 +783,37 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 		SSSkepuFunctorStruct << "#define VARIANT_CPU(block)\n";
 		SSSkepuFunctorStruct << "#define VARIANT_OPENMP(block)\n";
 		SSSkepuFunctorStruct << "#define VARIANT_CUDA(block) block\n";
+		// Only the device translation unit compiles device code
+		if (SplitCUDA)
+			SSSkepuFunctorStruct << "#ifdef __CUDACC__\n";
 		SSSkepuFunctorStruct << "static inline SKEPU_ATTRIBUTE_FORCE_INLINE " << "__device__ ";
 		if (UF.multipleReturnTypes.size() > 0)
 			SSSkepuFunctorStruct << UF.multiReturnTypeNameGPU();
 		else
 			SSSkepuFunctorStruct << UF.resolvedReturnTypeName;
 		SSSkepuFunctorStruct << " CU(";
-		printParamList(SSSkepuFunctorStruct, UF);
+		if (UF.multiReduceMap)
+			SSSkepuFunctorStruct << UF.multiReturnTypeNameGPU() << " " << UF.elwiseParams[0].name << ", " << UF.multiReturnTypeNameGPU() << " " << UF.elwiseParams[1].name;
+		else
+			printParamList(SSSkepuFunctorStruct, UF, PhiloxRandom);
 		SSSkepuFunctorStruct << ")\n{" << replaceReferencesToOtherUFs(Backend::CUDA, UF, [InstanceName] (UserFunction &UF) { return SkePU_UF_Prefix + InstanceName + "_" + UF.uniqueName + "::CU"; }) << "\n}\n";
+		// Map kernels store each result of a multi-return function straight into its output
+		if (UF.storesOutputs())
+		{
+			std::stringstream SSParams;
+			printParamList(SSParams, UF, PhiloxRandom);
+			for (size_t i = 0; i < UF.multipleReturnTypes.size(); ++i)
+				SSParams << (SSParams.tellp() ? ", " : "") << UF.multipleReturnTypes[i] << " *skepu_store_" << i;
+			SSSkepuFunctorStruct << "static inline SKEPU_ATTRIBUTE_FORCE_INLINE __device__ void CU_Store(" << SSParams.str() << ")\n{" << replaceReferencesToOtherUFs(Backend::CUDA, UF, [InstanceName] (UserFunction &UF) { return SkePU_UF_Prefix + InstanceName + "_" + UF.uniqueName + "::CU"; }, true) << "\n}\n";
+		}
+		if (useFloatAccumulation_CU(UF))
+		{
+			SSSkepuFunctorStruct << "static inline SKEPU_ATTRIBUTE_FORCE_INLINE __device__ float CU_float(float "
+				<< UF.astDeclNode->getParamDecl(0)->getNameAsString() << ", float " << UF.astDeclNode->getParamDecl(1)->getNameAsString() << ")\n{"
+				<< replaceReferencesToOtherUFs(Backend::CUDA, UF, [InstanceName] (UserFunction &UF) { return SkePU_UF_Prefix + InstanceName + "_" + UF.uniqueName + "::CU"; }) << "\n}\n";
+		}
+		if (SplitCUDA)
+			SSSkepuFunctorStruct << "#endif\n";
 		SSSkepuFunctorStruct << "#undef SKEPU_USING_BACKEND_CUDA\n\n";
 	}
 
@@ -442,6 +829,40 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 		SSSkepuFunctorStruct << "static inline SKEPU_ATTRIBUTE_FORCE_INLINE " << UF.resolvedReturnTypeName << " OMP(";
 		printParamList(SSSkepuFunctorStruct, UF);
 		SSSkepuFunctorStruct << ")\n{" << replaceReferencesToOtherUFs(Backend::OpenMP, UF, [InstanceName] (UserFunction &UF) { return SkePU_UF_Prefix + InstanceName + "_" + UF.uniqueName + "::OMP"; }) << "\n}\n";
+		if (ompSIMD)
+		{
+			// Elementwise parameters vary per lane, uniform ones are shared and a 1D index steps by one
+			std::stringstream SSParams, SSArgs, SSUniform;
+			bool first = true;
+			if (UF.indexed1D)
+			{
+				SSParams << "size_t skepu_i";
+				SSArgs << "skepu::Index1D{skepu_i}";
+				first = false;
+			}
+			for (UserFunction::Param &param : UF.elwiseParams)
+			{
+				if (!testAndSet(first, false)) { SSParams << ", "; SSArgs << ", "; }
+				SSParams << param.resolvedTypeName << " " << param.name;
+				SSArgs << param.name;
+			}
+			bool firstUniform = true;
+			for (UserFunction::Param &param : UF.anyScalarParams)
+			{
+				if (!testAndSet(first, false)) { SSParams << ", "; SSArgs << ", "; }
+				if (!testAndSet(firstUniform, false)) SSUniform << ", ";
+				SSParams << param.resolvedTypeName << " " << param.name;
+				SSArgs << param.name;
+				SSUniform << param.name;
+			}
+			SSSkepuFunctorStruct << "#pragma omp declare simd notinbranch";
+			if (!firstUniform)
+				SSSkepuFunctorStruct << " uniform(" << SSUniform.str() << ")";
+			if (UF.indexed1D)
+				SSSkepuFunctorStruct << " linear(skepu_i:1)";
+			SSSkepuFunctorStruct << "\nstatic inline " << UF.resolvedReturnTypeName << " OMP_simd(" << SSParams.str() << ")\n{\n"
+				<< "return OMP(" << SSArgs.str() << ");\n}\n";
+		}
 		SSSkepuFunctorStruct << "#undef SKEPU_USING_BACKEND_OMP\n\n";
 	}
 
@@ -463,111 +884,966 @@ void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clan
 		SkePUAbort("Code gen target source loc not rewritable: UF " + UF.uniqueName + " for instance" + InstanceName);
 }
 
-static int skeletonCounter = 0;
-
-bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceName, std::vector<UserFunction*> FuncArgs, std::vector<size_t> arity, VarDecl *d)
+IncrementalIndexCode incrementalIndexCode(size_t dim, std::string declaration)
 {
-	generatedStructs = {};
-	std::stringstream ss;
-	ss << "skepu_skel_" << skeletonCounter++;
-	std::string skeletonID = ss.str();
-
-	SkePULog() << "Name of skeleton: " << skeleton.name << ", Unique ID: " << skeletonID << "\n";
-
-	if (GlobalRewriter.RemoveText(d->getSourceRange()))
-		SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
-
-	// Find location to insert transformed user function code
-	const DeclContext *DeclCtx = d->getDeclContext();
-	SourceLocation loc = d->getSourceRange().getBegin();
-	if (isa<FunctionDecl>(DeclCtx))
+	IncrementalIndexCode res;
+	if (!IncrementalIndex || dim < 2)
+		return res;
+	
+	// Fields from the outermost dimension in, and the extents skepu_w<d> of the inner ones
+	const std::vector<std::string> fields = (dim == 2) ? std::vector<std::string>{"row", "col"}
+		: std::vector<std::string>{"i", "j", "k", "l"};
+	std::stringstream SSSetup, SSStep;
+	SSSetup << declaration << "\n";
+	for (size_t d = 0; d < dim; ++d)
+		SSSetup << "size_t skepu_step_" << fields[d] << ";\n";
+	SSSetup << "{\n\tsize_t skepu_cindex = skepu_base + skepu_i;\n\tsize_t skepu_cstep = skepu_gridSize;\n";
+	for (size_t d = dim - 1; d > 0; --d)
 	{
-		const FunctionDecl *f = dyn_cast<FunctionDecl>(DeclCtx);
-		if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
-		{
-			// If it is a template, we need to place the code before the template begins
-			loc = f->getPrimaryTemplate()->getBeginLoc();
-		}
-		else
-		{
-			loc = f->getSourceRange().getBegin();
-		}
+		const std::string w = "skepu_w" + std::to_string(d + 1);
+		SSSetup << "\tskepu_index." << fields[d] << " = skepu_cindex % " << w << "; skepu_cindex /= " << w << ";\n";
+		SSSetup << "\tskepu_step_" << fields[d] << " = skepu_cstep % " << w << "; skepu_cstep /= " << w << ";\n";
 	}
-
-	for (UserFunction* UF : FuncArgs)
+	SSSetup << "\tskepu_index." << fields[0] << " = skepu_cindex;\n\tskepu_step_" << fields[0] << " = skepu_cstep;\n}\n";
+	
+	// Both summands are below the extent, so one conditional subtraction handles the carry
+	SSStep << "skepu_index." << fields[dim - 1] << " += skepu_step_" << fields[dim - 1] << ";\n";
+	for (size_t d = dim - 1; d > 0; --d)
 	{
-		generateUserFunctionStruct(*UF, skeletonID + InstanceName, loc);
+		const std::string w = "skepu_w" + std::to_string(d + 1);
+		SSStep << "skepu_index." << fields[d - 1] << " += skepu_step_" << fields[d - 1] << ";\n";
+		SSStep << "if (skepu_index." << fields[d] << " >= " << w << ") { skepu_index." << fields[d] << " -= " << w << "; ++skepu_index." << fields[d - 1] << "; }\n";
 	}
+	
+	res.setup = SSSetup.str();
+	res.step = SSStep.str();
+	return res;
+}
 
+static thread_local int skeletonCounter = 0;
 
-	std::stringstream SSTemplateArgs, SSCallArgs, SSNewDecl;
+bool instanceIsSelected(const llvm::cl::list<std::string> &names, const std::string &InstanceName)
+{
+	return std::find(names.begin(), names.end(), InstanceName) != names.end();
+}
 
-	bool first = true;
-	if (skeleton.type == Skeleton::Type::Map || skeleton.type == Skeleton::Type::MapReduce)
-	{
-		SSTemplateArgs << arity[0];
-		first = false;
-	}
-	else if (skeleton.type == Skeleton::Type::MapPairs || skeleton.type == Skeleton::Type::MapPairsReduce)
-	{
-		SSTemplateArgs << arity[0] << ", " << arity[1];
-		first = false;
-	}
+PairSymmetry pairSymmetryOf(const std::string &InstanceName, UserFunction &mapPairsFunc)
+{
+	bool symmetric = instanceIsSelected(MapPairsSymmetricInstances, InstanceName);
+	bool antisymmetric = instanceIsSelected(MapPairsAntisymmetricInstances, InstanceName);
+	if (!symmetric && !antisymmetric)
+		return PairSymmetry::None;
+	
+	if (symmetric && antisymmetric)
+		SkePUAbort("Instance " + InstanceName + " declared both symmetric and antisymmetric");
+	if (mapPairsFunc.Varity != mapPairsFunc.Harity)
+		SkePUAbort("Symmetric instance " + InstanceName + " requires equal vertical and horizontal arity");
+	for (size_t i = 0; i < mapPairsFunc.Varity; ++i)
+		if (mapPairsFunc.elwiseParams[i].resolvedTypeName != mapPairsFunc.elwiseParams[mapPairsFunc.Varity + i].resolvedTypeName)
+			SkePUAbort("Symmetric instance " + InstanceName + " requires matching vertical and horizontal argument types");
+	if (mapPairsFunc.randomParam)
+		SkePUAbort("Symmetric instance " + InstanceName + " cannot use a random parameter");
+	if (antisymmetric && mapPairsFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("Antisymmetric instance " + InstanceName + " cannot return multiple values");
+	
+	return symmetric ? PairSymmetry::Symmetric : PairSymmetry::Antisymmetric;
+}
 
-	for (UserFunction *func : FuncArgs)
-	{
-		if (!first)
-			SSTemplateArgs << ", ";
-		SSTemplateArgs << SkePU_UF_Prefix << skeletonID << InstanceName << "_" << func->uniqueName;
-		first = false;
-	}
+void checkHistogramInstance(const std::string &InstanceName, UserFunction &binFunc, UserFunction &combineFunc)
+{
+	if (binFunc.elwiseParams.size() != 1 || binFunc.indexParam || binFunc.randomParam || !binFunc.anyContainerParams.empty() || !binFunc.anyScalarParams.empty())
+		SkePUAbort("Histogram instance " + InstanceName + " requires a bin function of exactly one element");
+	if (binFunc.multipleReturnTypes.size() > 2)
+		SkePUAbort("Histogram instance " + InstanceName + ": the bin function returns a bin index or a (bin index, contribution) pair");
+}
 
-	if (GenCUDA)
+bool histogramUsesAtomics(UserFunction &combineFunc, const std::set<std::string> &atomicTypes)
+{
+	if (!atomicTypes.count(combineFunc.resolvedReturnTypeName))
+		return false;
+	
+	// The body has to be 'return a + b;' (or 'b + a') on the two parameters
+	const FunctionDecl *f = combineFunc.astDeclNode;
+	if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
+		f = f->getTemplateInstantiationPattern();
+	const CompoundStmt *Body = dyn_cast_or_null<CompoundStmt>(f->getBody());
+	if (!Body || Body->size() != 1 || f->getNumParams() != 2)
+		return false;
+	const ReturnStmt *Ret = dyn_cast<ReturnStmt>(Body->body_front());
+	const BinaryOperator *Add = (Ret && Ret->getRetValue()) ? dyn_cast<BinaryOperator>(Ret->getRetValue()->IgnoreParenImpCasts()) : nullptr;
+	if (!Add || Add->getOpcode() != BO_Add)
+		return false;
+	
+	auto paramOf = [] (const Expr *e) -> const ParmVarDecl*
 	{
-		std::string KernelName_CU;
-		switch (skeleton.type)
-		{
-		case Skeleton::Type::MapReduce:
-			KernelName_CU = createMapReduceKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], arity[0], ResultDir);
-			SSTemplateArgs << ", decltype(&" << KernelName_CU << "), decltype(&" << KernelName_CU << "_ReduceOnly)";
-			SSCallArgs << KernelName_CU << ", " << KernelName_CU << "_ReduceOnly";
-			break;
+		if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+			return dyn_cast<ParmVarDecl>(Ref->getDecl());
+		return nullptr;
+	};
+	const ParmVarDecl *lhs = paramOf(Add->getLHS()), *rhs = paramOf(Add->getRHS());
+	return lhs && rhs && lhs != rhs && std::find(f->param_begin(), f->param_end(), lhs) != f->param_end() && std::find(f->param_begin(), f->param_end(), rhs) != f->param_end();
+}
 
-		case Skeleton::Type::Map:
-			KernelName_CU = createMapKernelProgram_CU(skeletonID, *FuncArgs[0], arity[0], ResultDir);
-			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
-			SSCallArgs << KernelName_CU;
-			break;
+void checkSortInstance(const std::string &InstanceName, UserFunction &comparator)
+{
+	if (comparator.elwiseParams.size() != 2 || comparator.indexParam || comparator.randomParam || !comparator.anyContainerParams.empty() || !comparator.anyScalarParams.empty())
+		SkePUAbort("Sort instance " + InstanceName + " requires a comparator of exactly two keys");
+	if (comparator.elwiseParams[0].resolvedTypeName != comparator.elwiseParams[1].resolvedTypeName)
+		SkePUAbort("Sort instance " + InstanceName + ": the comparator compares two keys of the same type");
+	if (comparator.multipleReturnTypes.size() > 0 || comparator.resolvedReturnTypeName != "bool")
+		SkePUAbort("Sort instance " + InstanceName + ": the comparator returns bool");
+}
 
-		case Skeleton::Type::MapPairs:
-			KernelName_CU = createMapPairsKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
-			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
-			SSCallArgs << KernelName_CU;
-			break;
+SortRadix sortRadixOf(UserFunction &comparator)
+{
+	SortRadix result;
+	const FunctionDecl *f = comparator.astDeclNode;
+	if (f->getNumParams() != 2)
+		return result;
+	
+	QualType Key = f->getParamDecl(0)->getType().getNonReferenceType().getCanonicalType();
+	const BuiltinType *Builtin = Key->getAs<BuiltinType>();
+	if (!Builtin || Builtin->isBooleanType() || !(Builtin->isInteger() || Builtin->isFloatingPoint()))
+		return result;
+	size_t bytes = f->getASTContext().getTypeSize(Key) / 8;
+	if (bytes > 8 || (Builtin->isFloatingPoint() && bytes != 4 && bytes != 8))
+		return result;
+	
+	// The body has to be 'return a < b;' or 'return a > b;' on the two parameters, in either order
+	if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
+		f = f->getTemplateInstantiationPattern();
+	const CompoundStmt *Body = dyn_cast_or_null<CompoundStmt>(f->getBody());
+	if (!Body || Body->size() != 1)
+		return result;
+	const ReturnStmt *Ret = dyn_cast<ReturnStmt>(Body->body_front());
+	const BinaryOperator *Cmp = (Ret && Ret->getRetValue()) ? dyn_cast<BinaryOperator>(Ret->getRetValue()->IgnoreParenImpCasts()) : nullptr;
+	if (!Cmp || (Cmp->getOpcode() != BO_LT && Cmp->getOpcode() != BO_GT))
+		return result;
+	
+	auto paramOf = [] (const Expr *e) -> const ParmVarDecl*
+	{
+		if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+			return dyn_cast<ParmVarDecl>(Ref->getDecl());
+		return nullptr;
+	};
+	const ParmVarDecl *lhs = paramOf(Cmp->getLHS()), *rhs = paramOf(Cmp->getRHS());
+	if (!lhs || !rhs || lhs == rhs || (lhs != f->getParamDecl(0) && lhs != f->getParamDecl(1)) || (rhs != f->getParamDecl(0) && rhs != f->getParamDecl(1)))
+		return result;
+	
+	result.radix = true;
+	result.descending = (Cmp->getOpcode() == BO_GT) == (lhs == f->getParamDecl(0));
+	result.floating = Builtin->isFloatingPoint();
+	result.isSigned = Builtin->isSignedInteger();
+	result.bytes = bytes;
+	return result;
+}
 
-		case Skeleton::Type::MapPairsReduce:
-			KernelName_CU = createMapPairsReduceKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
-			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
-			SSCallArgs << KernelName_CU;
-			break;
+void checkFilterInstance(const std::string &InstanceName, UserFunction &predicate)
+{
+	if (predicate.elwiseParams.size() != 1 || predicate.indexParam || predicate.randomParam || !predicate.anyContainerParams.empty() || !predicate.anyScalarParams.empty())
+		SkePUAbort("Filter instance " + InstanceName + " requires a predicate of exactly one element");
+	if (predicate.multipleReturnTypes.size() > 0 || predicate.resolvedReturnTypeName != "bool")
+		SkePUAbort("Filter instance " + InstanceName + ": the predicate returns bool");
+}
+
+void checkGatherInstance(const std::string &InstanceName, UserFunction &gatherFunc)
+{
+	if (gatherFunc.elwiseParams.size() != 1 || gatherFunc.indexParam || gatherFunc.randomParam || !gatherFunc.anyContainerParams.empty() || !gatherFunc.anyScalarParams.empty())
+		SkePUAbort("Gather instance " + InstanceName + " requires a gather function of exactly one element");
+	if (gatherFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("Gather instance " + InstanceName + ": the gather function returns a single value");
+}
+
+void checkScatterInstance(const std::string &InstanceName, UserFunction &scatterFunc, UserFunction &combineFunc)
+{
+	if (scatterFunc.elwiseParams.size() != 1 || scatterFunc.indexParam || scatterFunc.randomParam || !scatterFunc.anyContainerParams.empty() || !scatterFunc.anyScalarParams.empty())
+		SkePUAbort("Scatter instance " + InstanceName + " requires a scatter function of exactly one element");
+	if (scatterFunc.multipleReturnTypes.size() > 0 || combineFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("Scatter instance " + InstanceName + ": the scatter and combine functions return a single value");
+	if (combineFunc.elwiseParams.size() != 2)
+		SkePUAbort("Scatter instance " + InstanceName + " requires a combine function of exactly two values");
+}
+
+bool useTemporalMapOverlap(const std::string &InstanceName, UserFunction &mapOverlapFunc)
+{
+	if (!instanceIsSelected(MapOverlapTemporalInstances, InstanceName))
+		return false;
+	
+	// Intermediate steps are kept in shared memory, so the result has to be a valid input element
+	if (mapOverlapFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("Temporally blocked instance " + InstanceName + " cannot return multiple values");
+	if (mapOverlapFunc.resolvedReturnTypeName != mapOverlapFunc.regionParam->resolvedTypeName)
+		SkePUAbort("Temporally blocked instance " + InstanceName + " must return its input element type");
+	if (mapOverlapFunc.randomParam)
+		SkePUAbort("Temporally blocked instance " + InstanceName + " cannot use a random parameter");
+	
+	return true;
+}
+
+bool useRedBlackMapOverlap(const std::string &InstanceName, UserFunction &mapOverlapFunc)
+{
+	if (!instanceIsSelected(MapOverlapRedBlackInstances, InstanceName))
+		return false;
+	
+	// The instance updates its input in place, one colour per launch
+	if (mapOverlapFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("Red-black instance " + InstanceName + " cannot return multiple values");
+	if (mapOverlapFunc.resolvedReturnTypeName != mapOverlapFunc.regionParam->resolvedTypeName)
+		SkePUAbort("Red-black instance " + InstanceName + " must return its input element type");
+	
+	return true;
+}
+
+SpMVLayout spmvLayoutOf(const std::string &InstanceName, UserFunction &mapFunc)
+{
+	const bool sell = instanceIsSelected(SpMVSellInstances, InstanceName);
+	if (!sell && !instanceIsSelected(SpMVInstances, InstanceName))
+		return SpMVLayout::None;
+	
+	// The generated kernel computes the CSR product itself, so the user function has to be exactly a row of it
+	static const std::set<std::string> types = {"float", "double", "int", "unsigned int", "long long", "unsigned long long"};
+	const std::string &type = mapFunc.resolvedReturnTypeName;
+	if (!mapFunc.indexed1D || !mapFunc.elwiseParams.empty() || mapFunc.randomParam || !mapFunc.anyScalarParams.empty() || mapFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("SpMV instance " + InstanceName + " must map a 1D row index over a sparse matrix and a vector only");
+	if (mapFunc.anyContainerParams.size() != 2
+		|| mapFunc.anyContainerParams[0].containerType != ContainerType::SparseMatrix
+		|| mapFunc.anyContainerParams[1].containerType != ContainerType::Vector)
+		SkePUAbort("SpMV instance " + InstanceName + " takes a SparseMat followed by a Vec");
+	if (mapFunc.anyContainerParams[0].resolvedTypeName != type || mapFunc.anyContainerParams[1].resolvedTypeName != type || !types.count(type))
+		SkePUAbort("SpMV instance " + InstanceName + " needs matrix, vector and result of one arithmetic type");
+	
+	return sell ? SpMVLayout::SELL : SpMVLayout::CSR;
+}
+
+std::vector<int> staticOverlapOf(const std::string &InstanceName, const Skeleton &skeleton)
+{
+	std::vector<int> overlap;
+	for (const std::string &entry : StaticOverlapInstances)
+	{
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos)
+			SkePUAbort("Malformed -static-overlap entry " + entry + ", expected name=overlap");
+		if (entry.substr(0, eq) != InstanceName)
+			continue;
+		
+		overlap.clear();
+		llvm::SmallVector<llvm::StringRef, 4> values;
+		llvm::StringRef(entry).substr(eq + 1).split(values, 'x');
+		for (llvm::StringRef value : values)
+		{
+			int o;
+			if (value.getAsInteger(10, o) || o < 0)
+				SkePUAbort("Static overlap of instance " + InstanceName + " must be non-negative integers separated by x");
+			overlap.push_back(o);
+		}
+	}
+	if (overlap.empty())
+		return overlap;
+	
+	size_t dims;
+	switch (skeleton.type)
+	{
+		case Skeleton::Type::MapOverlap1D: dims = 1; break;
+		case Skeleton::Type::MapOverlap2D: dims = 2; break;
+		case Skeleton::Type::MapOverlap3D: dims = 3; break;
+		case Skeleton::Type::MapOverlap4D: dims = 4; break;
+		default: SkePUAbort("Static overlap instance " + InstanceName + " is not a MapOverlap");
+	}
+	
+	// A single value applies to every dimension, like setOverlap(int)
+	if (overlap.size() == 1)
+		overlap.resize(dims, overlap[0]);
+	if (overlap.size() != dims)
+		SkePUAbort("Static overlap of instance " + InstanceName + " needs " + std::to_string(dims) + " values");
+	return overlap;
+}
+
+std::string separableRowsOf(const std::string &InstanceName, const Skeleton &skeleton)
+{
+	std::string rows;
+	for (const std::string &entry : SeparableOverlapInstances)
+	{
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos || eq + 1 == entry.size())
+			SkePUAbort("Malformed -separable-overlap entry " + entry + ", expected cols=rows");
+		if (entry.substr(0, eq) == InstanceName)
+			rows = entry.substr(eq + 1);
+	}
+	if (rows.empty())
+		return rows;
+	
+	if (skeleton.type != Skeleton::Type::MapOverlap1D)
+		SkePUAbort("Separable instance " + InstanceName + " is not a MapOverlap 1D instance");
+	if (rows == InstanceName)
+		SkePUAbort("Separable instance " + InstanceName + " needs another instance for its row pass");
+	return rows;
+}
+
+std::vector<int> mapOverlapOutputsOf(const std::string &InstanceName, const Skeleton &skeleton)
+{
+	std::vector<int> outputs = {1, 1};
+	for (const std::string &entry : MapOverlapOutputsInstances)
+	{
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos)
+			SkePUAbort("Malformed -mapoverlap-outputs entry " + entry + ", expected name=rowsxcols");
+		if (entry.substr(0, eq) != InstanceName)
+			continue;
+		
+		llvm::StringRef rows, cols;
+		std::tie(rows, cols) = llvm::StringRef(entry).substr(eq + 1).split('x');
+		// The strip is unrolled and its results are kept in registers, so it stays small
+		int y, x;
+		if (rows.getAsInteger(10, y) || cols.getAsInteger(10, x) || y < 1 || x < 1 || y * x > 16)
+			SkePUAbort("Outputs per thread of instance " + InstanceName + " must be rowsxcols with at most 16 outputs");
+		if (skeleton.type != Skeleton::Type::MapOverlap2D)
+			SkePUAbort("Instance " + InstanceName + " in -mapoverlap-outputs is not a MapOverlap2D");
+		outputs = {y, x};
+	}
+	return outputs;
+}
+
+bool ompScheduleOf(const std::string &InstanceName, const Skeleton &skeleton, std::string &policy, size_t &chunk)
+{
+	std::string schedule;
+	for (const std::string &entry : OMPScheduleInstances)
+	{
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos)
+			SkePUAbort("Malformed -omp-schedule entry " + entry + ", expected name=policy or name=policy:chunk");
+		if (entry.substr(0, eq) == InstanceName)
+			schedule = entry.substr(eq + 1);
+	}
+	if (schedule.empty())
+		return false;
+	
+	if (!GenOMP)
+		SkePUAbort("Scheduled instance " + InstanceName + " needs the OpenMP backend");
+	if (skeleton.type == Skeleton::Type::Call)
+		SkePUAbort("Scheduled instance " + InstanceName + " is a Call, which has no loop to schedule");
+	
+	std::pair<llvm::StringRef, llvm::StringRef> parts = llvm::StringRef(schedule).split(':');
+	chunk = 0;
+	if (!parts.second.empty() && (parts.second.getAsInteger(10, chunk) || chunk == 0))
+		SkePUAbort("Schedule chunk of instance " + InstanceName + " must be a positive integer");
+	
+	if (parts.first == "static") policy = "Static";
+	else if (parts.first == "dynamic") policy = "Dynamic";
+	else if (parts.first == "guided") policy = "Guided";
+	else if (parts.first == "tasks") policy = "Tasks";
+	else SkePUAbort("Unknown schedule " + parts.first.str() + " of instance " + InstanceName + ", expected static, dynamic, guided or tasks");
+	return true;
+}
+
+// true for 'return a || b;' and false for 'return a && b;' on the two parameters, empty for any other body
+static std::string logicalAbsorbingOf(UserFunction &reduceFunc)
+{
+	const FunctionDecl *f = reduceFunc.astDeclNode;
+	if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
+		f = f->getTemplateInstantiationPattern();
+	const CompoundStmt *Body = dyn_cast_or_null<CompoundStmt>(f->getBody());
+	if (!Body || Body->size() != 1 || f->getNumParams() != 2)
+		return "";
+	const ReturnStmt *Ret = dyn_cast<ReturnStmt>(Body->body_front());
+	const BinaryOperator *Op = (Ret && Ret->getRetValue()) ? dyn_cast<BinaryOperator>(Ret->getRetValue()->IgnoreParenImpCasts()) : nullptr;
+	if (!Op || (Op->getOpcode() != BO_LOr && Op->getOpcode() != BO_LAnd))
+		return "";
+	
+	auto paramOf = [] (const Expr *e) -> const ParmVarDecl*
+	{
+		if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+			return dyn_cast<ParmVarDecl>(Ref->getDecl());
+		return nullptr;
+	};
+	const ParmVarDecl *lhs = paramOf(Op->getLHS()), *rhs = paramOf(Op->getRHS());
+	if (!lhs || !rhs || lhs == rhs || std::find(f->param_begin(), f->param_end(), lhs) == f->param_end() || std::find(f->param_begin(), f->param_end(), rhs) == f->param_end())
+		return "";
+	return (Op->getOpcode() == BO_LOr) ? "true" : "false";
+}
+
+std::string earlyExitAbsorbingOf(const std::string &InstanceName, const Skeleton &skeleton, UserFunction &reduceFunc)
+{
+	bool selected = false;
+	std::string absorbing;
+	for (const std::string &entry : EarlyExitInstances)
+	{
+		size_t eq = entry.find('=');
+		if (entry.substr(0, eq) != InstanceName)
+			continue;
+		selected = true;
+		absorbing = (eq == std::string::npos) ? "" : entry.substr(eq + 1);
+	}
+	if (!selected)
+		return "";
+	
+	if (skeleton.type != Skeleton::Type::Reduce1D && skeleton.type != Skeleton::Type::MapReduce)
+		SkePUAbort("Early exit instance " + InstanceName + " is not a Reduce1D or MapReduce");
+	if (reduceFunc.multipleReturnTypes.size() > 0 || reduceFunc.multiReduceMap)
+		SkePUAbort("Early exit instance " + InstanceName + " cannot reduce multiple values");
+	if (absorbing.empty())
+		absorbing = logicalAbsorbingOf(reduceFunc);
+	if (absorbing.empty())
+		SkePUAbort("Early exit instance " + InstanceName + " needs its absorbing value as name=value, it is only inferred for a || b and a && b");
+	if (instanceIsSelected(OMPScheduleInstances, InstanceName))
+		SkePUAbort("Early exit instance " + InstanceName + " cannot also have an OpenMP schedule, it chunks its own loop");
+	return absorbing;
+}
+
+size_t launchBoundThreads()
+{
+	// 1024 is the largest block size the backends and the -autotune sweep launch
+	return LaunchBoundsThreads ? LaunchBoundsThreads : 1024;
+}
+
+std::string launchBoundsOf(const std::string &InstanceName)
+{
+	size_t registers = 0;
+	for (const std::string &entry : MaxRegisterInstances)
+	{
+		std::pair<llvm::StringRef, llvm::StringRef> parts = llvm::StringRef(entry).split('=');
+		if (parts.first != InstanceName)
+			continue;
+		if (parts.second.getAsInteger(10, registers) || registers < 16 || registers > 255)
+			SkePUAbort("Malformed -max-registers entry " + entry + ", expected name=registers with 16 to 255 registers");
+	}
+	if (!LaunchBoundsThreads && !registers)
+		return "";
+	
+	// 64K registers per multiprocessor on every architecture since Kepler
+	size_t threads = launchBoundThreads();
+	std::string bounds = std::to_string(threads);
+	if (registers)
+		bounds += ", " + std::to_string(std::max<size_t>(1, 65536 / (registers * threads)));
+	return bounds;
+}
+
+bool transposedMatColOf(const std::string &InstanceName, const Skeleton &skeleton, UserFunction &mapFunc)
+{
+	if (!instanceIsSelected(TransposeMatColInstances, InstanceName))
+		return false;
+	
+	if (skeleton.type != Skeleton::Type::Map && skeleton.type != Skeleton::Type::MapReduce)
+		SkePUAbort("Transposed MatCol instance " + InstanceName + " is not a Map or MapReduce");
+	
+	// The proxies over the copy step by one element, so cols no longer is the width of the matrix
+	bool any = false;
+	for (UserFunction::RandomAccessParam &param : mapFunc.anyContainerParams)
+	{
+		if (param.containerType != ContainerType::MatCol)
+			continue;
+		if (mapFunc.readsField(param, "cols"))
+			SkePUAbort("Transposed MatCol instance " + InstanceName + ": parameter " + param.name + " cannot read its cols field");
+		any = true;
+	}
+	if (!any)
+		SkePUAbort("Transposed MatCol instance " + InstanceName + " has no MatCol parameter");
+	
+	return true;
+}
+
+bool brickedTensorsOf(const std::string &InstanceName, const Skeleton &skeleton, UserFunction &mapFunc)
+{
+	if (!instanceIsSelected(BrickTensorInstances, InstanceName))
+		return false;
+	
+	if (skeleton.type != Skeleton::Type::Map && skeleton.type != Skeleton::Type::MapReduce)
+		SkePUAbort("Bricked tensor instance " + InstanceName + " is not a Map or MapReduce");
+	
+	// The copy is read-only, and only the accesses of the instance's own user function are rewritten
+	bool any = false;
+	for (UserFunction::RandomAccessParam &param : mapFunc.anyContainerParams)
+	{
+		if (param.containerType != ContainerType::Tensor3 && param.containerType != ContainerType::Tensor4)
+			continue;
+		if (param.accessMode != AccessMode::Read)
+			SkePUAbort("Bricked tensor instance " + InstanceName + ": parameter " + param.name + " must be read-only");
+		if (!mapFunc.accessesOnlyElements(param))
+			SkePUAbort("Bricked tensor instance " + InstanceName + ": parameter " + param.name + " can only be indexed or have its sizes read");
+		any = true;
+	}
+	if (!any)
+		SkePUAbort("Bricked tensor instance " + InstanceName + " has no Ten3 or Ten4 parameter");
+	
+	return true;
+}
+
+bool useJITMap(const std::string &InstanceName, UserFunction &mapFunc)
+{
+	if (!instanceIsSelected(JITSpecializeInstances, InstanceName))
+		return false;
+	
+	// The run-time copy of the kernel is compiled without the SkePU headers and the other generated code
+	static const std::set<std::string> types = {"bool", "char", "signed char", "unsigned char", "short", "unsigned short", "int", "unsigned int",
+		"long", "unsigned long", "long long", "unsigned long long", "float", "double"};
+	if (mapFunc.indexParam || mapFunc.randomParam || !mapFunc.anyContainerParams.empty() || mapFunc.multipleReturnTypes.size() > 0)
+		SkePUAbort("JIT specialized instance " + InstanceName + " can only take elementwise and uniform scalar arguments and return one value");
+	if (!mapFunc.ReferencedUFs.empty() || !mapFunc.ReferencedUTs.empty() || mapFunc.fusedProducer || mapFunc.fromTemplate)
+		SkePUAbort("JIT specialized instance " + InstanceName + " cannot use templates, user types or other user functions");
+	if (mapFunc.anyScalarParams.empty())
+		SkePUAbort("JIT specialized instance " + InstanceName + " has no uniform scalar arguments to specialize");
+	if (!types.count(mapFunc.resolvedReturnTypeName))
+		SkePUAbort("JIT specialized instance " + InstanceName + " must return an arithmetic type");
+	for (std::vector<UserFunction::Param> *params : {&mapFunc.elwiseParams, &mapFunc.anyScalarParams})
+		for (UserFunction::Param &param : *params)
+			if (!types.count(param.resolvedTypeName))
+				SkePUAbort("JIT specialized instance " + InstanceName + ": parameter " + param.name + " is not of an arithmetic type");
+	
+	return true;
+}
+
+bool useDynamicMap(const std::string &InstanceName, UserFunction &mapFunc)
+{
+	if (!instanceIsSelected(MapDynamicInstances, InstanceName))
+		return false;
+	if (mapFunc.randomParam)
+		SkePUAbort("Dynamic Map instance " + InstanceName + " cannot take a random stream, its elements are not visited in a fixed order");
+	return true;
+}
+
+bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceName, std::vector<UserFunction*> FuncArgs, std::vector<size_t> arity, VarDecl *d)
+{
+	generatedStructs = {};
+	std::stringstream ss;
+	ss << "skepu_skel_" << skeletonCounter++;
+	std::string skeletonID = ss.str();
+
+	SkePULog() << "Name of skeleton: " << skeleton.name << ", Unique ID: " << skeletonID << "\n";
+
+	if (GlobalRewriter.RemoveText(d->getSourceRange()))
+		SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+
+	// Find location to insert transformed user function code
+	const DeclContext *DeclCtx = d->getDeclContext();
+	SourceLocation loc = d->getSourceRange().getBegin();
+	if (isa<FunctionDecl>(DeclCtx))
+	{
+		const FunctionDecl *f = dyn_cast<FunctionDecl>(DeclCtx);
+		if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
+		{
+			// If it is a template, we need to place the code before the template begins
+			loc = f->getPrimaryTemplate()->getBeginLoc();
+		}
+		else
+		{
+			loc = f->getSourceRange().getBegin();
+		}
+	}
+
+	// The CUDA variants of the user functions take the philox stream type
+	if (PhiloxRandom && GenCUDA && std::any_of(FuncArgs.begin(), FuncArgs.end(), [] (UserFunction *UF) { return UF->randomParam != nullptr; }))
+	{
+		std::string supportHeader = generatePhiloxSupport(ResultDir);
+		if (GlobalRewriter.InsertTextBefore(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+
+	// User functions are shared between instances, so the overlap is set for every instance
+	std::vector<int> staticOverlap = staticOverlapOf(InstanceName, skeleton);
+	for (UserFunction* UF : FuncArgs)
+		if (UF->regionParam)
+			UF->staticOverlap = staticOverlap;
+
+	// Also shared: only the map function of the instance takes container arguments
+	bool transposedMatCol = transposedMatColOf(InstanceName, skeleton, *FuncArgs[0]);
+	FuncArgs[0]->transposedMatCol = transposedMatCol;
+	if (transposedMatCol && GlobalRewriter.InsertText(loc, "#include \"" + generateTransposeSupport(ResultDir) + "\"\n" + lineDirectiveForSourceLoc(loc)))
+		SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	
+	// Before the user function structs, whose host variants index the tensors through it
+	bool brickedTensors = brickedTensorsOf(InstanceName, skeleton, *FuncArgs[0]);
+	FuncArgs[0]->brickedTensors = brickedTensors;
+	if (brickedTensors && GlobalRewriter.InsertText(loc, "#include \"" + generateBricksSupport(ResultDir) + "\"\n" + lineDirectiveForSourceLoc(loc)))
+		SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+
+	for (UserFunction* UF : FuncArgs)
+	{
+		generateUserFunctionStruct(*UF, skeletonID + InstanceName, loc);
+	}
+	
+	// The residual functions of a -mapoverlap-reduce instance are generated with it, its kernel calls them
+	auto residual = MapOverlapReductions.find(d);
+	if (residual != MapOverlapReductions.end())
+	{
+		if (FuncArgs[0]->multipleReturnTypes.size() > 0)
+			SkePUAbort("Instance " + InstanceName + " in -mapoverlap-reduce cannot return multiple values");
+		generateUserFunctionStruct(*residual->second.first, skeletonID + InstanceName, loc);
+		generateUserFunctionStruct(*residual->second.second, skeletonID + InstanceName, loc);
+	}
+
+
+	std::stringstream SSTemplateArgs, SSCallArgs, SSNewDecl;
+	
+	// Optional kernels, passed after the OpenCL wrapper so instances not using them are unaffected
+	std::stringstream SSOptionalTemplateArgs, SSOptionalCallArgs;
+
+	bool first = true;
+	if (skeleton.type == Skeleton::Type::Map || skeleton.type == Skeleton::Type::MapReduce)
+	{
+		SSTemplateArgs << arity[0];
+		first = false;
+	}
+	else if (skeleton.type == Skeleton::Type::MapPairs || skeleton.type == Skeleton::Type::MapPairsReduce)
+	{
+		SSTemplateArgs << arity[0] << ", " << arity[1];
+		first = false;
+	}
+
+	for (UserFunction *func : FuncArgs)
+	{
+		if (!first)
+			SSTemplateArgs << ", ";
+		SSTemplateArgs << SkePU_UF_Prefix << skeletonID << InstanceName << "_" << func->uniqueName;
+		first = false;
+	}
+
+	if (skeleton.type == Skeleton::Type::Map && spmvLayoutOf(InstanceName, *FuncArgs[0]) == SpMVLayout::SELL)
+	{
+		std::string supportHeader = generateSELLSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+	
+	if (skeleton.type == Skeleton::Type::Call && (FuncArgs[0]->indexed3D || FuncArgs[0]->indexed4D))
+		SkePUAbort("Call instance " + InstanceName + ": grid launches take an Index1D or Index2D parameter");
+	
+	// Indexed Call instances get a launch shape from skepu::grid::Call, which launches the CUDA kernel through this struct
+	const bool callGrid = skeleton.type == Skeleton::Type::Call && (FuncArgs[0]->indexed1D || FuncArgs[0]->indexed2D);
+	std::string callGridKernels = "void";
+	if (callGrid)
+	{
+		for (UserFunction::RandomAccessParam &param : FuncArgs[0]->anyContainerParams)
+			if (param.fullTypeName.find("MatRow") != std::string::npos || param.fullTypeName.find("MatCol") != std::string::npos)
+				SkePUAbort("Call instance " + InstanceName + ": grid launches take whole containers, not " + param.fullTypeName);
+		std::string supportHeader = generateCallGridSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+	
+	if (skeleton.type == Skeleton::Type::Histogram)
+	{
+		checkHistogramInstance(InstanceName, *FuncArgs[0], *FuncArgs[1]);
+		std::string supportHeader = generateHistogramSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+	
+	if (skeleton.type == Skeleton::Type::Sort)
+	{
+		checkSortInstance(InstanceName, *FuncArgs[0]);
+		std::string supportHeader = generateSortSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+	
+	if (skeleton.type == Skeleton::Type::Filter)
+	{
+		checkFilterInstance(InstanceName, *FuncArgs[0]);
+		std::string supportHeader = generateFilterSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+	
+	if (skeleton.type == Skeleton::Type::Gather || skeleton.type == Skeleton::Type::Scatter)
+	{
+		if (skeleton.type == Skeleton::Type::Gather)
+			checkGatherInstance(InstanceName, *FuncArgs[0]);
+		else
+			checkScatterInstance(InstanceName, *FuncArgs[0], *FuncArgs[1]);
+		std::string supportHeader = generateIndirectSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+
+	// Absorbing value of the reduce function of a -reduce-early-exit instance, empty for the others
+	std::string earlyExitAbsorbing = earlyExitAbsorbingOf(InstanceName, skeleton, *FuncArgs.back());
+	
+	// The <true> instantiation of the strided kernels, for the instances in -unit-stride
+	const bool unitStride = instanceIsSelected(UnitStrideInstances, InstanceName);
+
+	if (GenCUDA)
+	{
+		PhaseTimer timer(KernelGenTime_CU);
+		std::string KernelName_CU;
+		
+		// Occupancy metadata, emitted next to the kernel include for -launch-metadata instances: (struct suffix, kernel symbol,
+		// dynamic shared bytes per block), the symbols also select the kernels of -split-cuda
+		std::vector<std::tuple<std::string, std::string, std::string>> launchMetadata;
+		auto perThread = [](std::string type, std::string count = "1") { return count + " * skepu_blockSize * sizeof(" + type + ")"; };
+		// Outputs per thread of the 2D MapOverlap kernel, which scale its grid and its tile
+		std::string launchStrips;
+		
+		switch (skeleton.type)
+		{
+		case Skeleton::Type::MapReduce:
+		{
+			bool singlePass = instanceIsSelected(MapReduceSinglePassInstances, InstanceName);
+			KernelName_CU = createMapReduceKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], arity[0], ResultDir, earlyExitAbsorbing, singlePass);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "<false>), decltype(&" << KernelName_CU << "_ReduceOnly)";
+			SSCallArgs << KernelName_CU << "<false>, " << KernelName_CU << "_ReduceOnly";
+			launchMetadata.emplace_back("_Strided", KernelName_CU + "<false>", perThread(reduceResultType_CU(*FuncArgs[1])));
+			launchMetadata.emplace_back("_ReduceOnly", KernelName_CU + "_ReduceOnly", perThread(reduceResultType_CU(*FuncArgs[1])));
+			if (unitStride)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "<true>)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "<true>";
+				launchMetadata.emplace_back("_UnitStride", KernelName_CU + "<true>", perThread(reduceResultType_CU(*FuncArgs[1])));
+			}
+			if (!earlyExitAbsorbing.empty())
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_EarlyExit<false>), decltype(&" << KernelName_CU << "_EarlyExit<true>)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_EarlyExit<false>, " << KernelName_CU << "_EarlyExit<true>";
+				launchMetadata.emplace_back("_EarlyExitStrided", KernelName_CU + "_EarlyExit<false>", perThread(reduceResultType_CU(*FuncArgs[1])));
+				launchMetadata.emplace_back("_EarlyExitUnitStride", KernelName_CU + "_EarlyExit<true>", perThread(reduceResultType_CU(*FuncArgs[1])));
+			}
+			if (singlePass)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_SinglePass<false>), decltype(&" << KernelName_CU << "_SinglePass<true>)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_SinglePass<false>, " << KernelName_CU << "_SinglePass<true>";
+				launchMetadata.emplace_back("_SinglePassStrided", KernelName_CU + "_SinglePass<false>", perThread(reduceResultType_CU(*FuncArgs[1])));
+				launchMetadata.emplace_back("_SinglePassUnitStride", KernelName_CU + "_SinglePass<true>", perThread(reduceResultType_CU(*FuncArgs[1])));
+			}
+			break;
+		}
+
+		case Skeleton::Type::Map:
+		{
+			SpMVLayout spmv = spmvLayoutOf(InstanceName, *FuncArgs[0]);
+			const bool jit = useJITMap(InstanceName, *FuncArgs[0]);
+			if (jit && GlobalRewriter.InsertText(loc, "#include \"" + generateJITSupport(ResultDir) + "\"\n" + lineDirectiveForSourceLoc(loc)))
+				SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+			const bool dynamic = useDynamicMap(InstanceName, *FuncArgs[0]);
+			const bool vectorized = useVectorizedMap_CU(InstanceName, *FuncArgs[0]);
+			const bool gemm = useTiledGEMM_CU(InstanceName, *FuncArgs[0]);
+			KernelName_CU = createMapKernelProgram_CU(skeletonID, *FuncArgs[0], arity[0], ResultDir, spmv, jit, dynamic, vectorized, gemm);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "<false>)";
+			SSCallArgs << KernelName_CU << "<false>";
+			launchMetadata.emplace_back("_Strided", KernelName_CU + "<false>", "0");
+			if (unitStride)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "<true>)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "<true>";
+				launchMetadata.emplace_back("_UnitStride", KernelName_CU + "<true>", "0");
+			}
+			if (vectorized)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_Vectorized)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_Vectorized";
+				launchMetadata.emplace_back("_Vectorized", KernelName_CU + "_Vectorized", "0");
+			}
+			if (spmv != SpMVLayout::None)
+			{
+				std::string launcher = KernelName_CU + (spmv == SpMVLayout::SELL ? "_SpMVSell" : "_SpMV");
+				SSOptionalTemplateArgs << ", decltype(&" << launcher << ")";
+				SSOptionalCallArgs << ", " << launcher;
+			}
+			if (gemm)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_GEMM)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_GEMM";
+			}
+			if (jit)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_JIT)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_JIT";
+			}
+			if (dynamic)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_Dynamic<false>), decltype(&" << KernelName_CU << "_Dynamic<true>)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_Dynamic<false>, " << KernelName_CU << "_Dynamic<true>";
+				launchMetadata.emplace_back("_DynamicStrided", KernelName_CU + "_Dynamic<false>", "0");
+				launchMetadata.emplace_back("_DynamicUnitStride", KernelName_CU + "_Dynamic<true>", "0");
+			}
+			break;
+		}
+
+		case Skeleton::Type::MapPairs:
+		{
+			PairSymmetry symmetry = pairSymmetryOf(InstanceName, *FuncArgs[0]);
+			KernelName_CU = createMapPairsKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir, symmetry);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
+			SSCallArgs << KernelName_CU;
+			launchMetadata.emplace_back("", KernelName_CU, "0");
+			if (useTiledMapPairs_CU(*FuncArgs[0]))
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_Tiled)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_Tiled";
+				launchMetadata.emplace_back("_Tiled", KernelName_CU + "_Tiled", "0");
+			}
+			if (symmetry != PairSymmetry::None)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_Symmetric)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_Symmetric";
+				launchMetadata.emplace_back("_Symmetric", KernelName_CU + "_Symmetric", "0");
+			}
+			break;
+		}
+
+		case Skeleton::Type::MapPairsReduce:
+		{
+			PairSymmetry symmetry = pairSymmetryOf(InstanceName, *FuncArgs[0]);
+			const bool broadcast = useBroadcastMapPairsReduce_CU(InstanceName, *FuncArgs[0]);
+			KernelName_CU = createMapPairsReduceKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir, symmetry, broadcast);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
+			SSCallArgs << KernelName_CU;
+			launchMetadata.emplace_back("", KernelName_CU, perThread(FuncArgs[1]->rawReturnTypeName));
+			if (symmetry != PairSymmetry::None)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_SymmetricTiles), decltype(&" << KernelName_CU << "_SymmetricCombine)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_SymmetricTiles, " << KernelName_CU << "_SymmetricCombine";
+				launchMetadata.emplace_back("_SymmetricTiles", KernelName_CU + "_SymmetricTiles", perThread(FuncArgs[1]->rawReturnTypeName));
+				launchMetadata.emplace_back("_SymmetricCombine", KernelName_CU + "_SymmetricCombine", "0");
+			}
+			if (broadcast)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_Broadcast)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_Broadcast";
+				launchMetadata.emplace_back("_Broadcast", KernelName_CU + "_Broadcast", "0");
+			}
+			break;
+		}
 
 		case Skeleton::Type::Reduce1D:
-			KernelName_CU = createReduce1DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+		{
+			bool batched = instanceIsSelected(BatchedInstances, InstanceName);
+			KernelName_CU = createReduce1DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir, earlyExitAbsorbing, batched);
 			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
 			SSCallArgs << KernelName_CU;
+			launchMetadata.emplace_back("", KernelName_CU, perThread(FuncArgs[0]->resolvedReturnTypeName));
+			if (!earlyExitAbsorbing.empty())
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_EarlyExit)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_EarlyExit";
+				launchMetadata.emplace_back("_EarlyExit", KernelName_CU + "_EarlyExit", perThread(FuncArgs[0]->resolvedReturnTypeName));
+			}
+			if (batched)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_Batched)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_Batched";
+				launchMetadata.emplace_back("_Batched", KernelName_CU + "_Batched", perThread(FuncArgs[0]->resolvedReturnTypeName));
+			}
 			break;
+		}
 
 		case Skeleton::Type::Reduce2D:
-			KernelName_CU = createReduce2DKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
+		{
+			bool singleLaunch = instanceIsSelected(Reduce2DSingleLaunchInstances, InstanceName);
+			KernelName_CU = createReduce2DKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir, singleLaunch);
 			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_RowWise), decltype(&" << KernelName_CU << "_ColWise)";
 			SSCallArgs << KernelName_CU << "_RowWise, " << KernelName_CU << "_ColWise";
+			launchMetadata.emplace_back("_RowWise", KernelName_CU + "_RowWise", perThread(FuncArgs[0]->resolvedReturnTypeName));
+			launchMetadata.emplace_back("_ColWise", KernelName_CU + "_ColWise", perThread(FuncArgs[1]->resolvedReturnTypeName));
+			
+			// Single-launch kernels for the whole matrix, skepu_blockSize counts the threads of the 2D block
+			if (singleLaunch)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_RowWise2D), decltype(&" << KernelName_CU << "_ColWise2D)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_RowWise2D, " << KernelName_CU << "_ColWise2D";
+				launchMetadata.emplace_back("_RowWise2D", KernelName_CU + "_RowWise2D", perThread(FuncArgs[0]->resolvedReturnTypeName));
+				launchMetadata.emplace_back("_ColWise2D", KernelName_CU + "_ColWise2D", perThread(FuncArgs[1]->resolvedReturnTypeName));
+			}
+			break;
+		}
+
+		case Skeleton::Type::ReduceByKey:
+			KernelName_CU = createReduceByKeyKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_SegmentTiles), decltype(&" << KernelName_CU << "_SegmentCarries)";
+			SSCallArgs << KernelName_CU << "_SegmentTiles, " << KernelName_CU << "_SegmentCarries";
+			launchMetadata.emplace_back("_SegmentTiles", KernelName_CU + "_SegmentTiles", perThread(FuncArgs[0]->resolvedReturnTypeName));
+			launchMetadata.emplace_back("_SegmentCarries", KernelName_CU + "_SegmentCarries", perThread(FuncArgs[0]->resolvedReturnTypeName));
+			break;
+
+		case Skeleton::Type::Histogram:
+			KernelName_CU = createHistogramKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_Privatized), decltype(&" << KernelName_CU << "_Merge)";
+			SSCallArgs << KernelName_CU << "_Privatized, " << KernelName_CU << "_Merge";
+			// The privatized bins add skepu_numBins * sizeof(type) on top of this, known only at launch
+			launchMetadata.emplace_back("_Privatized", KernelName_CU + "_Privatized", perThread(FuncArgs[1]->resolvedReturnTypeName));
+			launchMetadata.emplace_back("_Merge", KernelName_CU + "_Merge", "0");
+			break;
+
+		case Skeleton::Type::Sort:
+			KernelName_CU = createSortKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_BlockSort), decltype(&" << KernelName_CU << "_MergePass), decltype(&" << KernelName_CU << "_Permute)";
+			SSCallArgs << KernelName_CU << "_BlockSort, " << KernelName_CU << "_MergePass, " << KernelName_CU << "_Permute";
+			launchMetadata.emplace_back("_BlockSort", KernelName_CU + "_BlockSort", perThread(FuncArgs[0]->elwiseParams[0].resolvedTypeName));
+			launchMetadata.emplace_back("_MergePass", KernelName_CU + "_MergePass", "0");
+			launchMetadata.emplace_back("_Permute", KernelName_CU + "_Permute", "0");
+			
+			// Radix passes for comparators 'a < b' and 'a > b' on arithmetic keys
+			if (sortRadixOf(*FuncArgs[0]).radix)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_RadixCount), decltype(&" << KernelName_CU << "_RadixOffsets), decltype(&" << KernelName_CU << "_RadixScatter)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_RadixCount, " << KernelName_CU << "_RadixOffsets, " << KernelName_CU << "_RadixScatter";
+				launchMetadata.emplace_back("_RadixCount", KernelName_CU + "_RadixCount", "0");
+				launchMetadata.emplace_back("_RadixOffsets", KernelName_CU + "_RadixOffsets", perThread("unsigned int"));
+				launchMetadata.emplace_back("_RadixScatter", KernelName_CU + "_RadixScatter", "0");
+			}
+			break;
+
+		case Skeleton::Type::Filter:
+			KernelName_CU = createFilterKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_Filter)";
+			SSCallArgs << KernelName_CU << "_Filter";
+			// Flag tile plus one slot per warp for the warp totals, as the single-pass Scan kernel
+			launchMetadata.emplace_back("_Filter", KernelName_CU + "_Filter", "(skepu_blockSize + (skepu_blockSize + 31) / 32) * sizeof(size_t)");
+			break;
+
+		case Skeleton::Type::Gather:
+			KernelName_CU = createGatherKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_Gather)";
+			SSCallArgs << KernelName_CU << "_Gather";
+			launchMetadata.emplace_back("_Gather", KernelName_CU + "_Gather", "0");
+			break;
+
+		case Skeleton::Type::Scatter:
+			KernelName_CU = createScatterKernelProgram_CU(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_ScatterSegmented)";
+			SSCallArgs << KernelName_CU << "_ScatterSegmented";
+			launchMetadata.emplace_back("_ScatterSegmented", KernelName_CU + "_ScatterSegmented", "0");
+			
+			// Atomic scatter for combine functions 'a + b' on the types of atomicAdd, otherwise a null kernel,
+			// so that backend::Scatter always takes the same arguments
+			if (histogramUsesAtomics(*FuncArgs[1], {"int", "unsigned int", "unsigned long long", "float"}))
+			{
+				SSTemplateArgs << ", decltype(&" << KernelName_CU << "_ScatterAtomic)";
+				SSCallArgs << ", " << KernelName_CU << "_ScatterAtomic";
+				launchMetadata.emplace_back("_ScatterAtomic", KernelName_CU + "_ScatterAtomic", "0");
+			}
+			else
+			{
+				SSTemplateArgs << ", std::nullptr_t";
+				SSCallArgs << ", nullptr";
+			}
 			break;
 
 		case Skeleton::Type::Scan:
-			KernelName_CU = createScanKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+		{
+			bool singlePass = instanceIsSelected(ScanSinglePassInstances, InstanceName);
+			bool matrix = instanceIsSelected(ScanMatrixInstances, InstanceName);
+			KernelName_CU = createScanKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir, singlePass, matrix);
 			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_ScanKernel), decltype(&" << KernelName_CU << "_ScanUpdate), decltype(&" << KernelName_CU << "_ScanAdd)";
 			SSCallArgs << KernelName_CU << "_ScanKernel, " << KernelName_CU << "_ScanUpdate, " << KernelName_CU << "_ScanAdd";
+			std::string scanType = FuncArgs[0]->resolvedReturnTypeName;
+			launchMetadata.emplace_back("_ScanKernel", KernelName_CU + "_ScanKernel", perThread(scanType, "2"));
+			launchMetadata.emplace_back("_ScanUpdate", KernelName_CU + "_ScanUpdate", perThread(scanType));
+			launchMetadata.emplace_back("_ScanAdd", KernelName_CU + "_ScanAdd", "0");
+			if (singlePass)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_ScanLookback)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_ScanLookback";
+				// Tile buffer plus one slot per warp for the warp totals
+				launchMetadata.emplace_back("_ScanLookback", KernelName_CU + "_ScanLookback", "(skepu_blockSize + (skepu_blockSize + 31) / 32) * sizeof(" + scanType + ")");
+			}
+			if (matrix)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_ScanRowWise), decltype(&" << KernelName_CU << "_ScanColWise)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_ScanRowWise, " << KernelName_CU << "_ScanColWise";
+				// Tile buffer plus the 32 warp totals
+				launchMetadata.emplace_back("_ScanRowWise", KernelName_CU + "_ScanRowWise", "(skepu_blockSize + 32) * sizeof(" + scanType + ")");
+				launchMetadata.emplace_back("_ScanColWise", KernelName_CU + "_ScanColWise", "0");
+			}
 			break;
+		}
 
 		case Skeleton::Type::MapOverlap1D:
 			KernelName_CU = createMapOverlap1DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
@@ -575,27 +1851,77 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 				<< KernelName_CU << "_MapOverlapKernel_CU_Matrix_Col), decltype(&" << KernelName_CU << "_MapOverlapKernel_CU_Matrix_ColMulti)";
 			SSCallArgs << KernelName_CU << "_MapOverlapKernel_CU, " << KernelName_CU << "_MapOverlapKernel_CU_Matrix_Row, "
 				<< KernelName_CU << "_MapOverlapKernel_CU_Matrix_Col, " << KernelName_CU << "_MapOverlapKernel_CU_Matrix_ColMulti";
+			// The halo is per block and depends on the overlap, so the caller passes it as skepu_sharedMemPerBlock
+			for (std::string suffix : {"_MapOverlapKernel_CU", "_MapOverlapKernel_CU_Matrix_Row", "_MapOverlapKernel_CU_Matrix_Col", "_MapOverlapKernel_CU_Matrix_ColMulti"})
+				launchMetadata.emplace_back(suffix, KernelName_CU + suffix, perThread(FuncArgs[0]->regionParam->templateInstantiationType()));
 			break;
 
 		case Skeleton::Type::MapOverlap2D:
-			KernelName_CU = createMapOverlap2DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+		{
+			MapOverlap2DVariants_CU variants;
+			variants.temporal = useTemporalMapOverlap(InstanceName, *FuncArgs[0]);
+			variants.redBlack = useRedBlackMapOverlap(InstanceName, *FuncArgs[0]);
+			std::vector<int> outputs = mapOverlapOutputsOf(InstanceName, skeleton);
+			variants.outputsY = outputs[0];
+			variants.outputsX = outputs[1];
+			if (residual != MapOverlapReductions.end())
+				std::tie(variants.residualMap, variants.residualReduce) = residual->second;
+			KernelName_CU = createMapOverlap2DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir, variants);
 			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_conv_cuda_2D_kernel)";
 			SSCallArgs << KernelName_CU << "_conv_cuda_2D_kernel";
+			std::string strip = std::to_string(outputs[0] * outputs[1]);
+			launchMetadata.emplace_back("_conv_cuda_2D_kernel", KernelName_CU + "_conv_cuda_2D_kernel",
+				perThread(FuncArgs[0]->regionParam->templateInstantiationType(), strip));
+			// One output per thread is the backend default, so only a larger strip is passed on
+			if (outputs[0] * outputs[1] > 1)
+				launchStrips += "struct " + KernelName_CU + "_conv_cuda_2D_kernel_outputs { static constexpr size_t perThreadY = "
+					+ std::to_string(outputs[0]) + ", perThreadX = " + std::to_string(outputs[1]) + "; };\n";
+			if (variants.temporal)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_conv_cuda_2D_temporal_kernel)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_conv_cuda_2D_temporal_kernel";
+				launchMetadata.emplace_back("_conv_cuda_2D_temporal_kernel", KernelName_CU + "_conv_cuda_2D_temporal_kernel", perThread(FuncArgs[0]->regionParam->templateInstantiationType(), "2"));
+			}
+			if (variants.redBlack)
+			{
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_conv_cuda_2D_redblack_kernel)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_conv_cuda_2D_redblack_kernel";
+				launchMetadata.emplace_back("_conv_cuda_2D_redblack_kernel", KernelName_CU + "_conv_cuda_2D_redblack_kernel", perThread(FuncArgs[0]->regionParam->templateInstantiationType(), "2"));
+			}
+			if (variants.residualMap)
+			{
+				// The partials and their presence flags follow the tile, aligned for the partial type
+				std::string residualType = reduceResultType_CU(*variants.residualReduce);
+				SSOptionalTemplateArgs << ", decltype(&" << KernelName_CU << "_conv_cuda_2D_reduce_kernel), decltype(&" << KernelName_CU << "_conv_cuda_2D_reduce_kernel_ReduceOnly)";
+				SSOptionalCallArgs << ", " << KernelName_CU << "_conv_cuda_2D_reduce_kernel, " << KernelName_CU << "_conv_cuda_2D_reduce_kernel_ReduceOnly";
+				launchMetadata.emplace_back("_conv_cuda_2D_reduce_kernel", KernelName_CU + "_conv_cuda_2D_reduce_kernel",
+					perThread(FuncArgs[0]->regionParam->templateInstantiationType(), strip) + " + skepu_blockSize * (sizeof(" + residualType + ") + sizeof(bool)) + alignof(" + residualType + ")");
+				launchMetadata.emplace_back("_conv_cuda_2D_reduce_kernel_ReduceOnly", KernelName_CU + "_conv_cuda_2D_reduce_kernel_ReduceOnly", perThread(residualType));
+			}
 			break;
+		}
 
 		case Skeleton::Type::MapOverlap3D:
 			KernelName_CU = createMapOverlap3DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
 			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_conv_cuda_3D_kernel)";
 			SSCallArgs << KernelName_CU << "_conv_cuda_3D_kernel";
+			launchMetadata.emplace_back("_conv_cuda_3D_kernel", KernelName_CU + "_conv_cuda_3D_kernel", perThread(FuncArgs[0]->regionParam->templateInstantiationType()));
 			break;
 		
 		case Skeleton::Type::MapOverlap4D:
-			SkePUAbort("CUDA MapOverlap 4D disabled in this release");
+			KernelName_CU = createMapOverlap4DKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
+			SSTemplateArgs << ", decltype(&" << KernelName_CU << "_conv_cuda_4D_kernel)";
+			SSCallArgs << KernelName_CU << "_conv_cuda_4D_kernel";
+			launchMetadata.emplace_back("_conv_cuda_4D_kernel", KernelName_CU + "_conv_cuda_4D_kernel", perThread(FuncArgs[0]->regionParam->templateInstantiationType()));
+			break;
 
 		case Skeleton::Type::Call:
 			KernelName_CU = createCallKernelProgram_CU(skeletonID, *FuncArgs[0], ResultDir);
 			SSTemplateArgs << ", decltype(&" << KernelName_CU << ")";
 			SSCallArgs << KernelName_CU;
+			launchMetadata.emplace_back("", KernelName_CU, "0");
+			if (callGrid)
+				callGridKernels = KernelName_CU + "_grid";
 			break;
 		}
 
@@ -606,7 +1932,48 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 		{
 			loc = dyn_cast<FunctionDecl>(DeclCtx)->getSourceRange().getBegin();
 		}*/
-		if (GlobalRewriter.InsertText(loc, "#include \"" + KernelName_CU + ".cu\"\n" + lineDirectiveForSourceLoc(loc)))
+		// The backends launch the _Index32 variants when all sizes and pitches of a call fit in 31 bits
+		if (Index32)
+		{
+			std::set<std::string> kernels32 = appendIndex32Variants_CU(ResultDir + "/" + KernelName_CU + ".cu");
+			for (size_t m = 0, count = launchMetadata.size(); m < count; ++m)
+			{
+				std::string symbol = std::get<1>(launchMetadata[m]);
+				std::string base = symbol.substr(0, symbol.find('<'));
+				if (!kernels32.count(base))
+					continue;
+				std::string symbol32 = base + "_Index32" + symbol.substr(base.size());
+				SSOptionalTemplateArgs << ", decltype(&" << symbol32 << ")";
+				SSOptionalCallArgs << ", " << symbol32;
+				launchMetadata.emplace_back(std::get<0>(launchMetadata[m]) + "_Index32", symbol32, std::get<2>(launchMetadata[m]));
+			}
+		}
+
+		std::string launchBounds = launchBoundsOf(InstanceName);
+		if (!launchBounds.empty())
+			applyLaunchBounds_CU(ResultDir + "/" + KernelName_CU + ".cu", launchBounds);
+
+		// The grid kernel is launched by skepu::grid::Call, not by the runtime, so it is added after the _Index32 variants
+		if (callGridKernels != "void")
+			launchMetadata.emplace_back("_Grid", KernelName_CU + "_Grid", "0");
+		
+		std::string launchCode;
+		if (instanceIsSelected(LaunchMetadataInstances, InstanceName))
+			for (auto &meta : launchMetadata)
+				launchCode += generateLaunchMetadata_CU(KernelName_CU + std::get<0>(meta) + "_launch", std::get<1>(meta), std::get<2>(meta));
+		launchCode += launchStrips;
+		if (callGridKernels != "void")
+			launchCode += "struct " + callGridKernels + "\n{\n\tstatic decltype(&" + KernelName_CU + "_Grid) kernel() { return &" + KernelName_CU + "_Grid; }\n};\n";
+		
+		std::string kernelInclude = "#include \"" + KernelName_CU + ".cu\"\n";
+		if (SplitCUDA)
+		{
+			std::vector<std::string> symbols;
+			for (auto &meta : launchMetadata)
+				symbols.push_back(std::get<1>(meta));
+			kernelInclude = splitKernelInclude_CU(KernelName_CU, symbols);
+		}
+		if (GlobalRewriter.InsertText(loc, kernelInclude + launchCode + lineDirectiveForSourceLoc(loc)))
 			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
 	}
 	else
@@ -624,7 +1991,10 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 
 	if (GenCL)
 	{
+		PhaseTimer timer(KernelGenTime_CL);
 		std::string KernelName_CL;
+		const DeclContext *NamespaceCtx = d->getDeclContext()->getEnclosingNamespaceContext();
+		KernelScope_CL = isa<NamespaceDecl>(NamespaceCtx) ? dyn_cast<NamespaceDecl>(NamespaceCtx)->getQualifiedNameAsString() : "";
 		switch (skeleton.type)
 		{
 		case Skeleton::Type::MapReduce:
@@ -636,11 +2006,11 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 			break;
 
 		case Skeleton::Type::MapPairs:
-			KernelName_CL = createMapPairsKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+			KernelName_CL = createMapPairsKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir, pairSymmetryOf(InstanceName, *FuncArgs[0]));
 			break;
 
 		case Skeleton::Type::MapPairsReduce:
-			KernelName_CL = createMapPairsReduceKernelProgram_CL(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
+			KernelName_CL = createMapPairsReduceKernelProgram_CL(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir, pairSymmetryOf(InstanceName, *FuncArgs[0]));
 			break;
 
 		case Skeleton::Type::Reduce1D:
@@ -651,8 +2021,32 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 			KernelName_CL = createReduce2DKernelProgram_CL(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
 			break;
 
+		case Skeleton::Type::ReduceByKey:
+			KernelName_CL = createReduceByKeyKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+			break;
+
+		case Skeleton::Type::Histogram:
+			KernelName_CL = createHistogramKernelProgram_CL(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
+			break;
+
+		case Skeleton::Type::Sort:
+			KernelName_CL = createSortKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+			break;
+
+		case Skeleton::Type::Filter:
+			KernelName_CL = createFilterKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+			break;
+
+		case Skeleton::Type::Gather:
+			KernelName_CL = createGatherKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+			break;
+
+		case Skeleton::Type::Scatter:
+			KernelName_CL = createScatterKernelProgram_CL(skeletonID, *FuncArgs[0], *FuncArgs[1], ResultDir);
+			break;
+
 		case Skeleton::Type::Scan:
-			KernelName_CL = createScanKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+			KernelName_CL = createScanKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir, instanceIsSelected(ScanMatrixInstances, InstanceName));
 			break;
 
 		case Skeleton::Type::MapOverlap1D:
@@ -660,8 +2054,11 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 			break;
 
 		case Skeleton::Type::MapOverlap2D:
-			KernelName_CL = createMapOverlap2DKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
+		{
+			std::vector<int> outputs = mapOverlapOutputsOf(InstanceName, skeleton);
+			KernelName_CL = createMapOverlap2DKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir, outputs[0], outputs[1]);
 			break;
+		}
 
 		case Skeleton::Type::MapOverlap3D:
 			KernelName_CL = createMapOverlap3DKernelProgram_CL(skeletonID, *FuncArgs[0], ResultDir);
@@ -685,10 +2082,339 @@ bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceN
 	{
 		SSTemplateArgs << ", void";
 	}
+	
+	SSTemplateArgs << SSOptionalTemplateArgs.str();
+	SSCallArgs << SSOptionalCallArgs.str();
 
+	// The device translation unit of -split-cuda leaves out file-scope instances
+	if (SplitCUDA && GenCUDA && d->isFileVarDecl())
+		SSNewDecl << "\n#ifndef SKEPU_DEVICE_TU\n";
 	if(d->getStorageClass() == clang::StorageClass::SC_Static)
 		SSNewDecl << "static ";
-	SSNewDecl << "skepu::backend::" << skeleton.name << "<" << SSTemplateArgs.str() << "> " << InstanceName << "(" << SSCallArgs.str() << ")";
+	
+	std::string SkeletonType = "skepu::backend::" + skeleton.name + "<" + SSTemplateArgs.str() + ">";
+	std::string CtorArgs = SSCallArgs.str();
+	if (!staticOverlap.empty())
+	{
+		std::string supportHeader = generateStaticOverlapSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Innermost, so that the overlap is fixed whichever backend a tuned instance picks
+		SkeletonType = "skepu::overlap::Static<" + SkeletonType;
+		for (int o : staticOverlap)
+			SkeletonType += ", " + std::to_string(o);
+		SkeletonType += ">";
+	}
+	std::string schedulePolicy;
+	size_t scheduleChunk;
+	if (ompScheduleOf(InstanceName, skeleton, schedulePolicy, scheduleChunk))
+	{
+		std::string supportHeader = generateScheduleSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Inside the wrappers choosing the backend, which set OpenMP on it
+		auto structName = [&](size_t i) { return SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[i]->uniqueName; };
+		std::string schedule = "skepu::schedule::Policy::" + schedulePolicy + ", " + std::to_string(scheduleChunk);
+		if (skeleton.type == Skeleton::Type::Map)
+			SkeletonType = "skepu::schedule::Map<" + SkeletonType + ", " + structName(0) + ", " + schedule + ">";
+		else if (skeleton.type == Skeleton::Type::MapReduce)
+			SkeletonType = "skepu::schedule::MapReduce<" + SkeletonType + ", " + structName(0) + ", " + structName(1) + ", " + schedule + ">";
+		else
+			SkeletonType = "skepu::schedule::Hinted<" + SkeletonType + ", " + schedule + ">";
+	}
+	if (instanceIsSelected(OutOfCoreInstances, InstanceName))
+	{
+		auto structName = [&](size_t i) { return SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[i]->uniqueName; };
+		std::string chunk = std::to_string(std::max(1u, (unsigned)OutOfCoreChunkMiB));
+		switch (skeleton.type)
+		{
+		case Skeleton::Type::Map: SkeletonType = "skepu::outofcore::Map<" + SkeletonType + ", " + structName(0) + ", " + chunk + ">"; break;
+		case Skeleton::Type::Reduce1D: SkeletonType = "skepu::outofcore::Reduce<" + SkeletonType + ", " + structName(0) + ", " + chunk + ">"; break;
+		case Skeleton::Type::MapReduce: SkeletonType = "skepu::outofcore::MapReduce<" + SkeletonType + ", " + structName(0) + ", " + structName(1) + ", " + chunk + ">"; break;
+		case Skeleton::Type::MapOverlap1D: SkeletonType = "skepu::outofcore::MapOverlap1D<" + SkeletonType + ", " + structName(0) + ", " + chunk + ">"; break;
+		default: SkePUAbort("Out-of-core instance " + InstanceName + " is not a Map, Reduce, MapReduce or MapOverlap1D");
+		}
+		std::string supportHeader = generateOutOfCoreSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+	}
+	if (instanceIsSelected(BatchedInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::Map && skeleton.type != Skeleton::Type::Reduce1D)
+			SkePUAbort("Batched instance " + InstanceName + " is not a Map or Reduce");
+		std::string supportHeader = generateBatchSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		std::string wrapper = (skeleton.type == Skeleton::Type::Map) ? "skepu::batch::Map<" : "skepu::batch::Reduce<";
+		SkeletonType = wrapper + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName + ">";
+	}
+	if (instanceIsSelected(ScanMatrixInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::Scan)
+			SkePUAbort("Matrix scan instance " + InstanceName + " is not a Scan");
+		std::string supportHeader = generateScanMatrixSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		SkeletonType = "skepu::scanmatrix::Scan<" + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName + ">";
+	}
+	if (skeleton.type == Skeleton::Type::Scan && GenOMP)
+	{
+		std::string supportHeader = generateOMPScanSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		std::string scanStruct = SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName;
+		SkeletonType = "skepu::ompscan::Scan<" + SkeletonType + ", " + scanStruct + ", " + ompScanBlocksOf(*FuncArgs[0], scanStruct) + ">";
+	}
+	if (!earlyExitAbsorbing.empty() && GenOMP)
+	{
+		std::string supportHeader = generateEarlyExitSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// The absorbing value is converted to the result type by the wrapper constructor
+		std::string reduceStruct = SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs.back()->uniqueName;
+		if (skeleton.type == Skeleton::Type::Reduce1D)
+			SkeletonType = "skepu::earlyexit::Reduce<" + SkeletonType + ", " + reduceStruct + ">";
+		else
+			SkeletonType = "skepu::earlyexit::MapReduce<" + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName + ", " + reduceStruct + ">";
+		CtorArgs = "(" + earlyExitAbsorbing + "), " + CtorArgs;
+	}
+	if (instanceIsSelected(TiledOverlapInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::MapOverlap2D && skeleton.type != Skeleton::Type::MapOverlap3D)
+			SkePUAbort("Tiled overlap instance " + InstanceName + " is not a MapOverlap2D or MapOverlap3D");
+		if (!GenOMP)
+			SkePUAbort("Tiled overlap instance " + InstanceName + " needs the OpenMP backend");
+		std::string supportHeader = generateTiledOverlapSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Outside the static overlap wrapper, whose overlap it is given
+		std::string wrapper = (skeleton.type == Skeleton::Type::MapOverlap2D) ? "skepu::tiled::MapOverlap2D<" : "skepu::tiled::MapOverlap3D<";
+		SkeletonType = wrapper + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName
+			+ ", " + FuncArgs[0]->regionParam->templateInstantiationType();
+		for (int o : staticOverlap)
+			SkeletonType += ", " + std::to_string(o);
+		SkeletonType += ">";
+	}
+	if (instanceIsSelected(MultiGPUOverlapInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::MapOverlap2D && skeleton.type != Skeleton::Type::MapOverlap3D)
+			SkePUAbort("Multi-GPU overlap instance " + InstanceName + " is not a MapOverlap2D or MapOverlap3D");
+		if (!GenCUDA)
+			SkePUAbort("Multi-GPU overlap instance " + InstanceName + " needs the CUDA backend");
+		std::string supportHeader = generateMultiGPUSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// The static overlap gives the halo when the instance never sets one
+		std::string wrapper = (skeleton.type == Skeleton::Type::MapOverlap2D) ? "skepu::multigpu::MapOverlap2D<" : "skepu::multigpu::MapOverlap3D<";
+		SkeletonType = wrapper + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName
+			+ ", " + FuncArgs[0]->regionParam->templateInstantiationType();
+		for (int o : staticOverlap)
+			SkeletonType += ", " + std::to_string(o);
+		SkeletonType += ">";
+	}
+	if (callGrid)
+		SkeletonType = "skepu::grid::Call<" + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName + ", " + callGridKernels + ">";
+	if (instanceIsSelected(MultiGPUPairsInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::MapPairs && skeleton.type != Skeleton::Type::MapPairsReduce)
+			SkePUAbort("Multi-GPU pairs instance " + InstanceName + " is not a MapPairs or MapPairsReduce");
+		if (!GenCUDA)
+			SkePUAbort("Multi-GPU pairs instance " + InstanceName + " needs the CUDA backend");
+		if (pairSymmetryOf(InstanceName, *FuncArgs[0]) != PairSymmetry::None)
+			SkePUAbort("Multi-GPU pairs instance " + InstanceName + " cannot be symmetric");
+		std::string supportHeader = generateMultiGPUSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		std::string mapStruct = SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName;
+		std::string arities = std::to_string(FuncArgs[0]->Varity) + ", " + std::to_string(FuncArgs[0]->Harity);
+		if (skeleton.type == Skeleton::Type::MapPairs)
+			SkeletonType = "skepu::multigpu::MapPairs<" + SkeletonType + ", " + mapStruct + ", " + arities + ">";
+		else
+			SkeletonType = "skepu::multigpu::MapPairsReduce<" + SkeletonType + ", " + mapStruct + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[1]->uniqueName + ", " + arities + ">";
+	}
+	if (instanceIsSelected(BlockedPairsInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::MapPairs && skeleton.type != Skeleton::Type::MapPairsReduce)
+			SkePUAbort("Blocked pairs instance " + InstanceName + " is not a MapPairs or MapPairsReduce");
+		if (!GenOMP)
+			SkePUAbort("Blocked pairs instance " + InstanceName + " needs the OpenMP backend");
+		std::string supportHeader = generatePairsSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Block shapes follow from the sizes of the Varity vertical and Harity horizontal elementwise types
+		std::string mapStruct = SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName;
+		std::string arities = std::to_string(FuncArgs[0]->Varity) + ", " + std::to_string(FuncArgs[0]->Harity);
+		if (skeleton.type == Skeleton::Type::MapPairs)
+			SkeletonType = "skepu::pairs::MapPairs<" + SkeletonType + ", " + mapStruct + ", " + arities + ">";
+		else
+			SkeletonType = "skepu::pairs::MapPairsReduce<" + SkeletonType + ", " + mapStruct + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[1]->uniqueName + ", " + arities + ">";
+	}
+	std::string separableRows = separableRowsOf(InstanceName, skeleton);
+	if (!separableRows.empty())
+	{
+		std::string supportHeader = generateSeparableSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// The row instance is referenced by name, so it has to be declared before this one; the intermediate holds
+		// the elements of the regions of the column pass
+		SkeletonType = "skepu::separable::MapOverlap<" + SkeletonType + ", decltype(" + separableRows + "), "
+			+ FuncArgs[0]->regionParam->templateInstantiationType() + ">";
+		CtorArgs = separableRows + ", " + CtorArgs;
+	}
+	if (residual != MapOverlapReductions.end())
+	{
+		std::string supportHeader = generateResidualSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Outside the tiled wrapper, whose OpenMP calls run the stencil of the host reduction
+		SkeletonType = "skepu::residual::MapOverlapReduce<" + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + residual->second.first->uniqueName
+			+ ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + residual->second.second->uniqueName + ">";
+	}
+	if (instanceIsSelected(HybridInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::Map && skeleton.type != Skeleton::Type::MapReduce)
+			SkePUAbort("Hybrid instance " + InstanceName + " is not a Map or MapReduce");
+		if (!GenOMP || !(GenCUDA || GenCL))
+			SkePUAbort("Hybrid instance " + InstanceName + " needs the OpenMP backend and the CUDA or OpenCL backend");
+		if (instanceIsSelected(AutotuneInstances, InstanceName))
+			SkePUAbort("Hybrid instance " + InstanceName + " cannot also be tuned, both choose its backend");
+		std::string supportHeader = generateHybridSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		std::string mapStruct = SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName;
+		if (skeleton.type == Skeleton::Type::Map)
+			SkeletonType = "skepu::hybrid::Map<" + SkeletonType + ", " + mapStruct + ">";
+		else
+			SkeletonType = "skepu::hybrid::MapReduce<" + SkeletonType + ", " + mapStruct + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[1]->uniqueName + ">";
+	}
+	if (instanceIsSelected(AutotuneInstances, InstanceName))
+	{
+		std::string supportHeader = generateAutotuneSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// The tuning key combines the unique skeleton ID with the instance name
+		SkeletonType = "skepu::autotune::Tuned<" + SkeletonType + ">";
+		// The sweep stays within the __launch_bounds__ of the kernels
+		CtorArgs = "\"" + skeletonID + "_" + InstanceName + "\", \"" + TuningDatabase + "\", " + std::to_string(launchBoundThreads()) + ", " + CtorArgs;
+	}
+	if (instanceIsSelected(AutoBackendInstances, InstanceName))
+	{
+		if (skeleton.type == Skeleton::Type::Call)
+			SkePUAbort("Instance " + InstanceName + " has no elements to estimate the cost of a call by");
+		if (instanceIsSelected(AutotuneInstances, InstanceName) || instanceIsSelected(HybridInstances, InstanceName))
+			SkePUAbort("Instance " + InstanceName + " cannot pick its backend by cost and also be tuned or hybrid");
+		std::string supportHeader = generateCostSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		SkeletonType = "skepu::cost::Selected<" + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName + ">";
+	}
+	if (instanceIsSelected(PlanInstances, InstanceName))
+	{
+		if (instanceIsSelected(AutotuneInstances, InstanceName) || instanceIsSelected(HybridInstances, InstanceName) || instanceIsSelected(AutoBackendInstances, InstanceName))
+			SkePUAbort("Instance " + InstanceName + " cannot follow an execution plan and also pick its backend otherwise");
+		std::string supportHeader = generatePlanSupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Map and MapReduce calibrate on prefixes of their elementwise arguments, and a Map output
+		std::string mapStruct = SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName;
+		std::string leading = "0";
+		if (skeleton.type == Skeleton::Type::Map)
+			leading = "1 + std::tuple_size<" + mapStruct + "::ElwiseArgs>::value";
+		else if (skeleton.type == Skeleton::Type::MapReduce)
+			leading = "std::tuple_size<" + mapStruct + "::ElwiseArgs>::value";
+		SkeletonType = "skepu::plan::Planned<" + SkeletonType + ", " + mapStruct + ", " + leading + ">";
+		CtorArgs = "\"" + skeletonID + "_" + InstanceName + "\", \"" + PlanFile + "\", " + std::to_string(launchBoundThreads()) + ", " + CtorArgs;
+	}
+	if (TransferMetrics)
+	{
+		// The support header is included at the start of the main file
+		SkeletonType = "skepu::metrics::Attributed<" + SkeletonType + ">";
+		CtorArgs = "\"" + InstanceName + "\", " + CtorArgs;
+	}
+	if (Instrument)
+	{
+		// Before the kernel includes at loc, which refer to SKEPU_CL_EVENT
+		std::string supportHeader = generateInstrumentSupport(ResultDir);
+		if (GlobalRewriter.InsertTextBefore(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		std::string location = d->getBeginLoc().printToString(GlobalRewriter.getSourceMgr());
+		SkeletonType = "skepu::instrument::Instrumented<" + SkeletonType + ">";
+		CtorArgs = "\"" + InstanceName + " (" + location + ")\", " + CtorArgs;
+	}
+	if (GenMPI)
+	{
+		// Skeletons without a distributed wrapper run whole on every rank
+		auto structName = [&](size_t i) { return SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[i]->uniqueName; };
+		std::string wrapper;
+		switch (skeleton.type)
+		{
+		case Skeleton::Type::Map: wrapper = "skepu::mpi::Map<" + SkeletonType + ", " + structName(0) + ">"; break;
+		case Skeleton::Type::Reduce1D: wrapper = "skepu::mpi::Reduce<" + SkeletonType + ", " + structName(0) + ">"; break;
+		case Skeleton::Type::MapReduce: wrapper = "skepu::mpi::MapReduce<" + SkeletonType + ", " + structName(0) + ", " + structName(1) + ">"; break;
+		case Skeleton::Type::MapOverlap1D: wrapper = "skepu::mpi::MapOverlap1D<" + SkeletonType + ", " + structName(0) + ">"; break;
+		default: break;
+		}
+		if (!wrapper.empty())
+		{
+			std::string supportHeader = generateMPISupport(ResultDir);
+			if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+				SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+			SkeletonType = wrapper;
+		}
+	}
+	std::string partitioning = starpuPartitioningOf(InstanceName, skeletonID);
+	if (!partitioning.empty())
+	{
+		// The support header is included at the start of the main file
+		SkeletonType = "skepu::starpu_mpi::Partitioned<" + SkeletonType + ">";
+		CtorArgs = partitioning + ", " + CtorArgs;
+	}
+	if (Views)
+	{
+		// Calls with views become iterator calls of the wrappers inside
+		auto structName = [&](size_t i) { return SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[i]->uniqueName; };
+		std::string wrapper;
+		switch (skeleton.type)
+		{
+		case Skeleton::Type::Map: wrapper = "void, 1, std::tuple_size<" + structName(0) + "::ElwiseArgs>::value, true"; break;
+		case Skeleton::Type::MapReduce: wrapper = structName(1) + "::Ret, 0, std::tuple_size<" + structName(0) + "::ElwiseArgs>::value, false"; break;
+		case Skeleton::Type::Reduce1D: wrapper = structName(0) + "::Ret, 0, 1, false"; break;
+		case Skeleton::Type::Scan:
+		case Skeleton::Type::MapOverlap1D: wrapper = "void, 1, 1, false"; break;
+		default: break;
+		}
+		if (!wrapper.empty())
+			SkeletonType = "skepu::views::Viewing<" + SkeletonType + ", " + wrapper + ">";
+	}
+	if (instanceIsSelected(LazyInstances, InstanceName))
+	{
+		if (skeleton.type != Skeleton::Type::Map)
+			SkePUAbort("Lazy instance " + InstanceName + " is not a Map");
+		std::string supportHeader = generateLazySupport(ResultDir);
+		if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+			SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
+		
+		// Outermost, so that a recorded call runs the whole instance when the graph is flushed
+		SkeletonType = "skepu::lazy::Deferred<" + SkeletonType + ", " + SkePU_UF_Prefix + skeletonID + InstanceName + "_" + FuncArgs[0]->uniqueName + ">";
+	}
+	SSNewDecl << SkeletonType << " " << InstanceName << "(" << CtorArgs << ")";
 
 	if (GlobalRewriter.InsertText(d->getSourceRange().getBegin(), SSNewDecl.str()))
 		SkePUAbort("Code gen target source loc not rewritable: instance" + InstanceName);
@@ -2,26 +2,143 @@
 
 #include "globals.h"
 
-extern llvm::cl::opt<std::string> ResultName;
+extern thread_local std::string ResultName;
 
 using SkeletonInstance = std::string;
 
+std::string lineDirectiveForSourceLoc(clang::SourceLocation &loc);
+
 void generateUserFunctionStruct(UserFunction &UF, std::string InstanceName, clang::SourceLocation loc);
 
+bool instanceIsSelected(const llvm::cl::list<std::string> &names, const std::string &InstanceName);
+
+// Declared symmetry of a MapPairs(Reduce) user function under exchange of its vertical and horizontal arguments
+enum class PairSymmetry
+{
+	None,
+	Symmetric,     // f(v_i, h_j) == f(v_j, h_i)
+	Antisymmetric  // f(v_i, h_j) == -f(v_j, h_i)
+};
+
+PairSymmetry pairSymmetryOf(const std::string &InstanceName, UserFunction &mapPairsFunc);
+
+// Index2D/3D/4D computed once per thread and advanced by skepu_gridSize with carries (-incremental-index).
+// setup goes after skepu_i and skepu_gridSize are defined, step after each skepu_i += skepu_gridSize.
+struct IncrementalIndexCode
+{
+	std::string setup;
+	std::string step;
+};
+
+IncrementalIndexCode incrementalIndexCode(size_t dim, std::string declaration);
+
+bool useTemporalMapOverlap(const std::string &InstanceName, UserFunction &mapOverlapFunc);
+bool useRedBlackMapOverlap(const std::string &InstanceName, UserFunction &mapOverlapFunc);
+
+enum class SpMVLayout
+{
+	None,
+	CSR,  // -spmv, reads the CSR arrays of the matrix
+	SELL  // -spmv-sell, reads a cached SELL-C-sigma copy of the matrix
+};
+
+// Map instances in -spmv or -spmv-sell: a 1D-indexed row function over a SparseMat and a Vec of its own result type
+SpMVLayout spmvLayoutOf(const std::string &InstanceName, UserFunction &mapFunc);
+
+// Overlap per dimension of a -static-overlap instance, empty if its overlap is set at run time
+std::vector<int> staticOverlapOf(const std::string &InstanceName, const Skeleton &skeleton);
+
+// Row instance of a -separable-overlap column instance, empty if the instance is not separable
+std::string separableRowsOf(const std::string &InstanceName, const Skeleton &skeleton);
+
+// Outputs per GPU thread of a -mapoverlap-outputs instance as {rows, cols}, {1, 1} if it computes one per thread
+std::vector<int> mapOverlapOutputsOf(const std::string &InstanceName, const Skeleton &skeleton);
+
+// OpenMP loop schedule of an -omp-schedule instance, as the enumerator of skepu::schedule::Policy and a chunk of
+// elements (0 for the policy default); false if the instance keeps the schedule of the backend
+bool ompScheduleOf(const std::string &InstanceName, const Skeleton &skeleton, std::string &policy, size_t &chunk);
+
+// Absorbing value of the reduce function of a -reduce-early-exit Reduce or MapReduce instance, as an expression;
+// empty if the instance reduces all elements
+std::string earlyExitAbsorbingOf(const std::string &InstanceName, const Skeleton &skeleton, UserFunction &reduceFunc);
+
+// Block size of the __launch_bounds__ of the CUDA kernels, the -launch-bounds block size or else 1024, which is also
+// the largest block size -autotune instances sweep
+size_t launchBoundThreads();
+
+// __launch_bounds__ arguments of the CUDA kernels of an instance: launchBoundThreads(), with the minimum blocks per
+// multiprocessor that keeps a -max-registers budget; empty if the kernels have no launch bounds
+std::string launchBoundsOf(const std::string &InstanceName);
+
+// Map and MapReduce instances in -transpose-matcol: user functions with MatCol parameters that do not read their cols field
+bool transposedMatColOf(const std::string &InstanceName, const Skeleton &skeleton, UserFunction &mapFunc);
+bool brickedTensorsOf(const std::string &InstanceName, const Skeleton &skeleton, UserFunction &mapFunc);
+
+// Map instances in -jit-specialize: elementwise and uniform scalar parameters of arithmetic types only
+bool useJITMap(const std::string &InstanceName, UserFunction &mapFunc);
+
+// Map instances in -map-dynamic: user functions without a random stream, whose order is tied to the strided kernel
+bool useDynamicMap(const std::string &InstanceName, UserFunction &mapFunc);
+
+// Histogram bin functions take one element and return its bin index, or a (bin index, contribution) pair.
+// Sub-histograms use native atomics when the combine function adds its two parameters on one of atomicTypes.
+void checkHistogramInstance(const std::string &InstanceName, UserFunction &binFunc, UserFunction &combineFunc);
+bool histogramUsesAtomics(UserFunction &combineFunc, const std::set<std::string> &atomicTypes);
+
+// Sort comparators take two keys of one type and return whether the first goes before the second.
+// Keys are radix sorted when the comparator is 'return a < b;' or 'return a > b;' on an arithmetic key type.
+struct SortRadix
+{
+	bool radix = false;
+	bool descending = false;
+	bool floating = false;
+	bool isSigned = false;
+	size_t bytes = 0;
+};
+
+void checkSortInstance(const std::string &InstanceName, UserFunction &comparator);
+SortRadix sortRadixOf(UserFunction &comparator);
+
+// The skepu::ompscan block loops of the parallel OpenMP Scan for the scan function of the instance struct scanStruct
+std::string ompScanBlocksOf(UserFunction &scanFunc, const std::string &scanStruct);
+
+// Filter predicates take one element and return whether it is kept
+void checkFilterInstance(const std::string &InstanceName, UserFunction &predicate);
+
+// Gather and Scatter functions take the one element an index refers to, or is sent from; the Scatter combine
+// function folds those results into the output, and scatters atomically when histogramUsesAtomics holds for it
+void checkGatherInstance(const std::string &InstanceName, UserFunction &gatherFunc);
+void checkScatterInstance(const std::string &InstanceName, UserFunction &scatterFunc, UserFunction &combineFunc);
+
 bool transformSkeletonInvocation(const Skeleton &skeleton, std::string InstanceName, std::vector<UserFunction*> FuncArgs, std::vector<size_t> arity, clang::VarDecl *d);
 
-std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::function<std::string(UserFunction&)> nameFunc);
+std::string replaceReferencesToOtherUFs(Backend backend, UserFunction &UF, std::function<std::string(UserFunction&)> nameFunc, bool storeOutputs = false);
 
 // CUDA generators
-std::string createMapReduceKernelProgram_CU(SkeletonInstance&, UserFunction &mapFunc, UserFunction &reduceFunc, size_t arity, std::string dir);
-std::string createMapKernelProgram_CU(SkeletonInstance&, UserFunction &mapFunc, size_t arity, std::string dir);
-std::string createMapPairsKernelProgram_CU(SkeletonInstance&, UserFunction &mapPairsFunc, std::string dir);
-std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance&, UserFunction &mapFunc, UserFunction &reduceFunc, std::string dir);
-std::string createScanKernelProgram_CU(SkeletonInstance&, UserFunction &scanFunc, std::string dir);
-std::string createReduce1DKernelProgram_CU(SkeletonInstance&, UserFunction &reduceFunc, std::string dir);
-std::string createReduce2DKernelProgram_CU(SkeletonInstance&, UserFunction &rowWiseFunc, UserFunction &colWiseFunc, std::string dir);
+std::string createMapReduceKernelProgram_CU(SkeletonInstance&, UserFunction &mapFunc, UserFunction &reduceFunc, size_t arity, std::string dir, std::string absorbing, bool singlePass);
+std::string createMapKernelProgram_CU(SkeletonInstance&, UserFunction &mapFunc, size_t arity, std::string dir, SpMVLayout spmv, bool jit, bool dynamic, bool vectorized, bool gemm);
+std::string createMapPairsKernelProgram_CU(SkeletonInstance&, UserFunction &mapPairsFunc, std::string dir, PairSymmetry symmetry);
+std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance&, UserFunction &mapFunc, UserFunction &reduceFunc, std::string dir, PairSymmetry symmetry, bool broadcast);
+std::string createScanKernelProgram_CU(SkeletonInstance&, UserFunction &scanFunc, std::string dir, bool singlePass, bool matrix);
+std::string createReduce1DKernelProgram_CU(SkeletonInstance&, UserFunction &reduceFunc, std::string dir, std::string absorbing, bool batched);
+std::string createReduce2DKernelProgram_CU(SkeletonInstance&, UserFunction &rowWiseFunc, UserFunction &colWiseFunc, std::string dir, bool singleLaunch);
+std::string createReduceByKeyKernelProgram_CU(SkeletonInstance&, UserFunction &reduceFunc, std::string dir);
+std::string createHistogramKernelProgram_CU(SkeletonInstance&, UserFunction &binFunc, UserFunction &combineFunc, std::string dir);
+std::string createSortKernelProgram_CU(SkeletonInstance&, UserFunction &comparator, std::string dir);
+std::string createFilterKernelProgram_CU(SkeletonInstance&, UserFunction &predicate, std::string dir);
+std::string createGatherKernelProgram_CU(SkeletonInstance&, UserFunction &gatherFunc, std::string dir);
+std::string createScatterKernelProgram_CU(SkeletonInstance&, UserFunction &scatterFunc, UserFunction &combineFunc, std::string dir);
 std::string createMapOverlap1DKernelProgram_CU(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
-std::string createMapOverlap2DKernelProgram_CU(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
+// Kernels generated for a CUDA MapOverlap2D instance besides the main one, and the strip of its threads
+struct MapOverlap2DVariants_CU
+{
+	bool temporal = false;
+	bool redBlack = false;
+	int outputsY = 1, outputsX = 1;
+	UserFunction *residualMap = nullptr, *residualReduce = nullptr;
+};
+
+std::string createMapOverlap2DKernelProgram_CU(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir, const MapOverlap2DVariants_CU &variants);
 std::string createMapOverlap3DKernelProgram_CU(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
 std::string createMapOverlap4DKernelProgram_CU(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
 std::string createCallKernelProgram_CU(SkeletonInstance&, UserFunction &callFunc, std::string dir);
@@ -30,13 +147,166 @@ std::string createCallKernelProgram_CU(SkeletonInstance&, UserFunction &callFunc
 // OpenCL generators
 std::string createMapReduceKernelProgram_CL(SkeletonInstance&, UserFunction &mapFunc, UserFunction &reduceFunc, std::string dir);
 std::string createMapKernelProgram_CL(SkeletonInstance&, UserFunction &mapFunc, std::string dir);
-std::string createMapPairsKernelProgram_CL(SkeletonInstance&, UserFunction &mapPairsFunc, std::string dir);
-std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance&, UserFunction &mapPairsFunc, UserFunction &reduceFunc, std::string dir);
-std::string createScanKernelProgram_CL(SkeletonInstance&, UserFunction &scanFunc, std::string dir);
+std::string createMapPairsKernelProgram_CL(SkeletonInstance&, UserFunction &mapPairsFunc, std::string dir, PairSymmetry symmetry);
+std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance&, UserFunction &mapPairsFunc, UserFunction &reduceFunc, std::string dir, PairSymmetry symmetry);
+std::string createScanKernelProgram_CL(SkeletonInstance&, UserFunction &scanFunc, std::string dir, bool matrix);
 std::string createReduce1DKernelProgram_CL(SkeletonInstance&, UserFunction &reduceFunc, std::string dir);
 std::string createReduce2DKernelProgram_CL(SkeletonInstance&, UserFunction &rowWiseFunc, UserFunction &colWiseFunc, std::string dir);
+std::string createReduceByKeyKernelProgram_CL(SkeletonInstance&, UserFunction &reduceFunc, std::string dir);
+std::string createHistogramKernelProgram_CL(SkeletonInstance&, UserFunction &binFunc, UserFunction &combineFunc, std::string dir);
+std::string createSortKernelProgram_CL(SkeletonInstance&, UserFunction &comparator, std::string dir);
+std::string createFilterKernelProgram_CL(SkeletonInstance&, UserFunction &predicate, std::string dir);
+std::string createGatherKernelProgram_CL(SkeletonInstance&, UserFunction &gatherFunc, std::string dir);
+std::string createScatterKernelProgram_CL(SkeletonInstance&, UserFunction &scatterFunc, UserFunction &combineFunc, std::string dir);
 std::string createMapOverlap1DKernelProgram_CL(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
-std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
+std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir, int outputsY, int outputsX);
 std::string createMapOverlap3DKernelProgram_CL(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
 std::string createMapOverlap4DKernelProgram_CL(SkeletonInstance&, UserFunction &mapOverlapFunc, std::string dir);
 std::string createCallKernelProgram_CL(SkeletonInstance&, UserFunction &callFunc, std::string dir);
+
+// Qualified namespace of the instance being generated, identical OpenCL kernels are only shared within a namespace
+extern thread_local std::string KernelScope_CL;
+
+// Writes the skepu::autotune runtime support header to dir (once per run) and returns its file name
+std::string generateAutotuneSupport(std::string dir);
+
+// Writes the skepu::histogram host support header to dir (once per run) and returns its file name
+std::string generateHistogramSupport(std::string dir);
+
+// Writes the skepu::sort host support header to dir (once per run) and returns its file name
+std::string generateSortSupport(std::string dir);
+
+// Writes the skepu::filter host support header to dir (once per run) and returns its file name
+std::string generateFilterSupport(std::string dir);
+
+// Writes the skepu::gather and skepu::scatter host support header to dir (once per run) and returns its file name
+std::string generateIndirectSupport(std::string dir);
+
+// Writes the skepu::sell sparse layout support header to dir (once per run) and returns its file name
+std::string generateSELLSupport(std::string dir);
+
+// Writes the skepu::philox counter-based generator header to dir (once per run) and returns its file name
+std::string generatePhiloxSupport(std::string dir);
+
+// Writes the skepu::jit NVRTC specialization support header to dir (once per run) and returns its file name
+std::string generateJITSupport(std::string dir);
+
+// Writes the skepu::transpose MatCol copy support header to dir (once per run) and returns its file name
+std::string generateTransposeSupport(std::string dir);
+
+// Writes the skepu::bricks brick-ordered tensor copy support header to dir (once per run) and returns its file name
+std::string generateBricksSupport(std::string dir);
+
+// Writes the skepu::overlap static overlap support header to dir (once per run) and returns its file name
+std::string generateStaticOverlapSupport(std::string dir);
+
+// Writes the skepu::split kernel launch support header to dir (once per run) and returns its file name
+std::string generateSplitCUDASupport(std::string dir);
+
+// For -split-cuda: the include of a generated kernel file, with host declarations of its kernels outside nvcc
+// and instantiations of the template kernel symbols in the device translation unit
+std::string splitKernelInclude_CU(const std::string &kernelName, const std::vector<std::string> &symbols);
+
+// For -split-cuda: guards the host definitions of the main file and writes the device translation unit including it
+void splitDeviceTranslationUnit_CU(clang::ASTContext &Context, const std::unordered_set<clang::VarDecl*> &instances, const std::string &mainFile);
+
+// Writes the skepu::pool device buffer allocator support header to dir (once per run) and returns its file name
+std::string generateDevicePoolSupport(std::string dir);
+
+// Writes the skepu::eviction device residency tracker support header to dir (once per run) and returns its file name
+std::string generateEvictionSupport(std::string dir);
+
+// Writes the skepu::metrics transfer counter support header to dir (once per run) and returns its file name
+std::string generateMetricsSupport(std::string dir);
+
+// Writes the skepu::starpu_mpi task partitioning support header to dir (once per run) and returns its file name
+std::string generateStarPUMPISupport(std::string dir);
+
+// The constructor arguments of skepu::starpu_mpi::Partitioned for an instance, from its -starpu-partition entry,
+// empty without -starpu-mpi
+std::string starpuPartitioningOf(const std::string &InstanceName, const std::string &skeletonID);
+
+// Writes the skepu::pinned host memory arena support header to dir (once per run) and returns its file name
+std::string generatePinnedHostSupport(std::string dir);
+
+// Writes the skepu::views container view support header to dir (once per run) and returns its file name
+std::string generateViewsSupport(std::string dir);
+
+// Writes the skepu::coherency range tracking support header to dir (once per run) and returns its file name
+std::string generateRangeCoherencySupport(std::string dir);
+
+// Writes the skepu::mapped binary container file support header to dir (once per run) and returns its file name
+std::string generateMappedIOSupport(std::string dir);
+
+// Writes the skepu::zerocopy unified memory support header to dir (once per run) and returns its file name
+std::string generateZeroCopySupport(std::string dir);
+
+// Writes the skepu::async stream scope support header to dir (once per run) and returns its file name
+std::string generateAsyncSupport(std::string dir);
+
+// Writes the skepu::lazy deferred call graph support header to dir (once per run) and returns its file name
+std::string generateLazySupport(std::string dir);
+
+// Writes the skepu::graph capture and replay support header to dir (once per run) and returns its file name
+std::string generateGraphSupport(std::string dir);
+
+// Writes the skepu::mpi distributed skeleton support header to dir (once per run) and returns its file name
+std::string generateMPISupport(std::string dir);
+
+// Writes the skepu::hybrid CPU and GPU work splitting support header to dir (once per run) and returns its file name
+std::string generateHybridSupport(std::string dir);
+
+// Writes the skepu::cost backend selection support header to dir (once per run) and returns its file name
+std::string generateCostSupport(std::string dir);
+
+// Writes the skepu::plan execution plan support header and the autotune header it uses to dir (once per run)
+// and returns its file name
+std::string generatePlanSupport(std::string dir);
+
+// Writes the skepu::numa first-touch placement support header to dir (once per run) and returns its file name
+std::string generateNUMASupport(std::string dir);
+
+// Writes the skepu::partials OpenMP reduction partials support header to dir (once per run) and returns its file name
+std::string generatePartialsSupport(std::string dir);
+
+// Writes the skepu::pairs cache-blocked OpenMP MapPairs support header to dir (once per run) and returns its file name
+std::string generatePairsSupport(std::string dir);
+
+// Writes the skepu::tiled OpenMP MapOverlap support header to dir (once per run) and returns its file name
+std::string generateTiledOverlapSupport(std::string dir);
+
+// Writes the skepu::multigpu MapOverlap and MapPairs support header to dir (once per run) and returns its file name
+std::string generateMultiGPUSupport(std::string dir);
+
+// Writes the skepu::grid launch shape support header for indexed Call instances to dir (once per run) and returns its file name
+std::string generateCallGridSupport(std::string dir);
+
+// Writes the skepu::separable MapOverlap support header to dir (once per run) and returns its file name
+std::string generateSeparableSupport(std::string dir);
+
+// Writes the skepu::residual fused MapOverlap and reduction support header to dir (once per run) and returns its file name
+std::string generateResidualSupport(std::string dir);
+
+// Writes the skepu::scanmatrix row-wise and column-wise Scan support header to dir (once per run) and returns its file name
+std::string generateScanMatrixSupport(std::string dir);
+
+// Writes the skepu::ompscan parallel OpenMP Scan support header to dir (once per run) and returns its file name
+std::string generateOMPScanSupport(std::string dir);
+
+// Writes the skepu::batch batched call support header to dir (once per run) and returns its file name
+std::string generateBatchSupport(std::string dir);
+
+// Writes the skepu::outofcore streaming support header to dir (once per run) and returns its file name
+std::string generateOutOfCoreSupport(std::string dir);
+
+// Writes the skepu::schedule OpenMP loop schedule support header to dir (once per run) and returns its file name
+std::string generateScheduleSupport(std::string dir);
+
+// Writes the skepu::earlyexit OpenMP early-exit reduction support header to dir (once per run) and returns its file name
+std::string generateEarlyExitSupport(std::string dir);
+
+// Writes the skepu::vendor_blas library dispatch support header to dir (once per run) and returns its file name
+std::string generateVendorBLASSupport(std::string dir);
+
+// Writes the skepu::instrument profiling support header to dir (once per run) and returns its file name
+std::string generateInstrumentSupport(std::string dir);
@@ -1,6 +1,9 @@
 #include "code_gen_cl.h"
 #include "code_gen.h"
 
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+
 IndexCodeGen indexInitHelper_CL(UserFunction &uf)
 {
 	IndexCodeGen res;
@@ -70,6 +73,9 @@ IndexCodeGen indexInitHelper_CL(UserFunction &uf)
 		)~~~";
 	}
 	
+	if (res.dim >= 2)
+		res.incremental = incrementalIndexCode(res.dim, "index" + std::to_string(res.dim) + "_t skepu_index;");
+	
 	return res;
 }
 
@@ -251,68 +257,56 @@ static {{CONTAINED_TYPE_CL}} skepu_region_access_4d_{{CONTAINED_TYPE_CL}}(skepu_
 
 
 
+/*
+ *  skepu::complex::complex<REAL> as the native REAL2 vector, re and im being x and y, so that additions and
+ *  subtractions are vector operations and containers of complex numbers are read with vector loads. The operators
+ *  of a user function become calls of these functions, with the suffix r for a real right-hand side and r2 for a
+ *  real left-hand side.
+ */
 static const std::string OpenCLComplexTemplate = R"~~~(
-typedef struct {
-	{{REAL}} re;
-	{{REAL}} im;
-} skepu_complex_{{REAL}};
-
-{{REAL}} complex_{{REAL}}_real(skepu_complex_{{REAL}} z)
-{
-	return z.re;
-}
-
-{{REAL}} complex_{{REAL}}_imag(skepu_complex_{{REAL}} z)
-{
-	return z.im;
-}
-
-// ADD
-
-skepu_complex_{{REAL}} complex_{{REAL}}_add(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs)
-{
-	skepu_complex_{{REAL}} res = { .re = lhs.re + rhs.re, .im = lhs.im + rhs.im };
-	return res;
-}
-
-skepu_complex_{{REAL}} complex_{{REAL}}_addr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs)
-{
-	skepu_complex_{{REAL}} res = { .re = lhs.re + rhs, .im = lhs.im };
-	return res;
-}
+typedef {{REAL}}2 skepu_complex_{{REAL}};
 
-skepu_complex_{{REAL}} complex_{{REAL}}_addr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs)
-{
-	skepu_complex_{{REAL}} res = { .re = rhs.re + lhs, .im = rhs.im };
-	return res;
-}
+static inline {{REAL}} complex_{{REAL}}_real(skepu_complex_{{REAL}} z) { return z.x; }
+static inline {{REAL}} complex_{{REAL}}_imag(skepu_complex_{{REAL}} z) { return z.y; }
 
-// SUB
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_add(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return lhs + rhs; }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_addr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs) { return lhs + (skepu_complex_{{REAL}})(rhs, 0); }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_addr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return (skepu_complex_{{REAL}})(lhs, 0) + rhs; }
 
-skepu_complex_{{REAL}} complex_{{REAL}}_sub(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs)
-{
-	skepu_complex_{{REAL}} res = { .re = lhs.re - lhs.re, .im = lhs.im - rhs.im };
-	return res;
-}
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_sub(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return lhs - rhs; }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_subr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs) { return lhs - (skepu_complex_{{REAL}})(rhs, 0); }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_subr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return (skepu_complex_{{REAL}})(lhs, 0) - rhs; }
 
-skepu_complex_{{REAL}} complex_{{REAL}}_subr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs)
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_mul(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs)
 {
-	skepu_complex_{{REAL}} res = { .re = lhs.re - rhs, .im = lhs.im };
-	return res;
+	return (skepu_complex_{{REAL}})(mad(lhs.x, rhs.x, -lhs.y * rhs.y), mad(lhs.x, rhs.y, lhs.y * rhs.x));
 }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_mulr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs) { return lhs * rhs; }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_mulr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return lhs * rhs; }
 
-skepu_complex_{{REAL}} complex_{{REAL}}_subr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs)
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_div(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs)
 {
-	skepu_complex_{{REAL}} res = { .re = lhs - rhs.re, .im = -rhs.im };
-	return res;
+	{{REAL}} norm = mad(rhs.x, rhs.x, rhs.y * rhs.y);
+	return (skepu_complex_{{REAL}})(mad(lhs.x, rhs.x, lhs.y * rhs.y), mad(lhs.y, rhs.x, -lhs.x * rhs.y)) / norm;
 }
-
-// MUL
-
-
-
-
-
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_divr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs) { return lhs / rhs; }
+static inline skepu_complex_{{REAL}} complex_{{REAL}}_divr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return complex_{{REAL}}_div((skepu_complex_{{REAL}})(lhs, 0), rhs); }
+
+static inline int complex_{{REAL}}_equal(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return all(lhs == rhs); }
+static inline int complex_{{REAL}}_equalr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs) { return lhs.x == rhs && lhs.y == 0; }
+static inline int complex_{{REAL}}_equalr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return complex_{{REAL}}_equalr(rhs, lhs); }
+static inline int complex_{{REAL}}_notequal(skepu_complex_{{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return any(lhs != rhs); }
+static inline int complex_{{REAL}}_notequalr(skepu_complex_{{REAL}} lhs, {{REAL}} rhs) { return lhs.x != rhs || lhs.y != 0; }
+static inline int complex_{{REAL}}_notequalr2({{REAL}} lhs, skepu_complex_{{REAL}} rhs) { return complex_{{REAL}}_notequalr(rhs, lhs); }
+
+#define complex_{{REAL}}_assign_add(lhs, rhs) ((lhs) = complex_{{REAL}}_add((lhs), (rhs)))
+#define complex_{{REAL}}_assign_addr(lhs, rhs) ((lhs) = complex_{{REAL}}_addr((lhs), (rhs)))
+#define complex_{{REAL}}_assign_sub(lhs, rhs) ((lhs) = complex_{{REAL}}_sub((lhs), (rhs)))
+#define complex_{{REAL}}_assign_subr(lhs, rhs) ((lhs) = complex_{{REAL}}_subr((lhs), (rhs)))
+#define complex_{{REAL}}_assign_mul(lhs, rhs) ((lhs) = complex_{{REAL}}_mul((lhs), (rhs)))
+#define complex_{{REAL}}_assign_mulr(lhs, rhs) ((lhs) = complex_{{REAL}}_mulr((lhs), (rhs)))
+#define complex_{{REAL}}_assign_div(lhs, rhs) ((lhs) = complex_{{REAL}}_div((lhs), (rhs)))
+#define complex_{{REAL}}_assign_divr(lhs, rhs) ((lhs) = complex_{{REAL}}_divr((lhs), (rhs)))
 )~~~";
 
 std::string generateOpenCLComplex()
@@ -323,7 +317,8 @@ std::string generateOpenCLComplex()
 	std::string res_double = OpenCLComplexTemplate;
 	replaceTextInString(res_double, "{{REAL}}", "double");
 	
-	return res_float + res_double;
+	// double2 only exists on devices with double precision
+	return res_float + "\n#if defined(cl_khr_fp64) || defined(__opencl_c_fp64)\n" + res_double + "#endif\n";
 }
 
 
@@ -331,6 +326,9 @@ std::string generateOpenCLComplex()
 
 std::string generateOpenCLRandom()
 {
+	if (PhiloxRandom)
+		return generateOpenCLPhilox();
+	
 static const std::string OpenCLRandomTemplate = R"~~~(
 #define RND_STATE_T ulong
 #define RND_NORMALIZED_T double
@@ -375,10 +373,20 @@ void handleRandomParam_CL(
 		sourceStream << generateOpenCLRandom();
 		if (!first) { SSMapFuncArgs << ", "; }
 		first = false;
-		SSMapFuncArgs << "&" << param->name << "[skepu_global_prng_id]";
-		SSKernelArgs << "user_" << param->name << "->getDeviceDataPointer(), ";
-		SSKernelParamList << "__global skepu_random* " << param->name << ", ";
-		SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<skepu::RandomForCL> * user_" << param->name << ", ";
+		if (PhiloxRandom)
+		{
+			SSMapFuncArgs << "skepu_random_init(skepu_prng_seed, skepu_base + skepu_i)";
+			SSKernelArgs << "(cl_ulong)skepu_prng_seed, ";
+			SSKernelParamList << "ulong skepu_prng_seed, ";
+			SSHostKernelParamList << "unsigned long long skepu_prng_seed, ";
+		}
+		else
+		{
+			SSMapFuncArgs << "&" << param->name << "[skepu_global_prng_id]";
+			SSKernelArgs << "user_" << param->name << "->getDeviceDataPointer(), ";
+			SSKernelParamList << "__global skepu_random* " << param->name << ", ";
+			SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<skepu::RandomForCL> * user_" << param->name << ", ";
+		}
 	}
 	else
 	{
@@ -464,13 +472,26 @@ void proxyCodeGenHelper_CL(std::map<ContainerType, std::unordered_set<UserFuncti
 
 
 
+// Uniform scalars of at least -constant-uniform-bytes bytes are read through a __constant buffer
+static bool useConstantUniform_CL(UserFunction::Param &param)
+{
+	if (ConstantUniformBytes == 0)
+		return false;
+	
+	clang::QualType type = param.astDeclNode->getOriginalType().getNonReferenceType();
+	if (type->isDependentType() || type->isIncompleteType())
+		return false;
+	return param.astDeclNode->getASTContext().getTypeSizeInChars(type).getQuantity() >= ConstantUniformBytes;
+}
+
 RandomAccessAndScalarsResult handleRandomAccessAndUniforms_CL(
 	UserFunction &func,
 	std::stringstream& SSMapFuncArgs,
 	std::stringstream& SSHostKernelParamList,
 	std::stringstream& SSKernelParamList,
 	std::stringstream& SSKernelArgs,
-	bool &first
+	bool &first,
+	std::string deviceID
 )
 {
 	RandomAccessAndScalarsResult res;
@@ -483,6 +504,15 @@ RandomAccessAndScalarsResult handleRandomAccessAndUniforms_CL(
 		if (!first) { SSMapFuncArgs << ", "; }
 		SSHostKernelParamList << param.TypeNameHost() << " skepu_container_" << param.name << ", ";
 		res.containerProxyTypes[param.containerType].insert(&param);
+		
+		// The device variant ignores the parameter, which is neither uploaded nor passed
+		if (param.deviceUnused)
+		{
+			SSProxyInitializer << param.TypeNameOpenCL() << " " << param.name << " = {0};\n";
+			SSMapFuncArgs << param.name;
+			first = false;
+			continue;
+		}
 		switch (param.containerType)
 		{
 			case ContainerType::Vector:
@@ -556,10 +586,21 @@ RandomAccessAndScalarsResult handleRandomAccessAndUniforms_CL(
 	for (UserFunction::Param& param : func.anyScalarParams)
 	{
 		if (!first) { SSMapFuncArgs << ", "; }
-		SSKernelParamList << param.resolvedTypeName << " " << param.name << ", ";
 		SSHostKernelParamList << param.resolvedTypeName << " " << param.name << ", ";
-		SSKernelArgs << param.name << ", ";
-		SSMapFuncArgs << param.name;
+		if (useConstantUniform_CL(param))
+		{
+			// One upload cache per launcher and parameter, kept in a lambda-local static
+			SSKernelParamList << "__constant " << param.resolvedTypeName << " *skepu_constant_" << param.name << ", ";
+			SSKernelArgs << "[]() -> skepu_cl_constant_uniform<" << param.resolvedTypeName << ">& { static skepu_cl_constant_uniform<"
+				<< param.resolvedTypeName << "> skepu_cache; return skepu_cache; }().get(" << deviceID << ", " << param.name << "), ";
+			SSMapFuncArgs << "*skepu_constant_" << param.name;
+		}
+		else
+		{
+			SSKernelParamList << param.resolvedTypeName << " " << param.name << ", ";
+			SSKernelArgs << param.name << ", ";
+			SSMapFuncArgs << param.name;
+		}
 		first = false;
 	}
 	
@@ -629,15 +670,744 @@ enum {
 )~~~";
 
 
+/*!
+ *  Host-side program building and kernel bookkeeping shared by all generated OpenCL wrapper classes. When the environment variable
+ *  SKEPU_OPENCL_CACHE_DIR names a writable directory, program binaries are cached there, keyed by a hash of the
+ *  kernel source, device name and driver version. A cache hit skips the source compilation entirely.
+ */
+const std::string ProgramBuilder_CL = R"~~~(
+#ifndef SKEPU_CL_PROGRAM_BUILDER
+#define SKEPU_CL_PROGRAM_BUILDER
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Event argument of the kernel launches, defined by skepu_instrument.h under -instrument
+#ifndef SKEPU_CL_EVENT
+#define SKEPU_CL_EVENT NULL
+#endif
+
+// Queue of the kernel launches, defined by skepu_async.h under -async
+#ifndef SKEPU_CL_QUEUE
+#define SKEPU_CL_QUEUE(skepu_deviceID) (skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue())
+#endif
+
+// Kernel launch function, defined by skepu_graph.h under -graphs to record into command buffers
+#ifndef SKEPU_CL_ENQUEUE_KERNEL
+#define SKEPU_CL_ENQUEUE_KERNEL clEnqueueNDRangeKernel
+#endif
+
+static inline std::string skepu_cl_device_info(cl_device_id skepu_device, cl_device_info skepu_param)
+{
+	size_t skepu_size = 0;
+	if (clGetDeviceInfo(skepu_device, skepu_param, 0, NULL, &skepu_size) != CL_SUCCESS)
+		return "";
+	std::string skepu_value(skepu_size, '\0');
+	clGetDeviceInfo(skepu_device, skepu_param, skepu_size, &skepu_value[0], NULL);
+	return skepu_value;
+}
+
+static inline std::string skepu_cl_cache_path(const char *skepu_dir, cl_device_id skepu_device, const std::string &skepu_source)
+{
+	std::string skepu_key = skepu_source;
+	skepu_key += '\0' + skepu_cl_device_info(skepu_device, CL_DEVICE_NAME);
+	skepu_key += '\0' + skepu_cl_device_info(skepu_device, CL_DRIVER_VERSION);
+	
+	// 64-bit FNV-1a, stable across runs and standard library implementations
+	unsigned long long skepu_hash = 14695981039346656037ull;
+	for (unsigned char skepu_c : skepu_key)
+	{
+		skepu_hash ^= skepu_c;
+		skepu_hash *= 1099511628211ull;
+	}
+	
+	char skepu_name[32];
+	snprintf(skepu_name, sizeof(skepu_name), "skepu_cl_%016llx.bin", skepu_hash);
+	return std::string(skepu_dir) + "/" + skepu_name;
+}
+
+/*
+ *  Build options of programs with collective reduction variants. From OpenCL C 2.0 on, the standard has to be
+ *  requested for the compiler to provide the built-ins and define the feature macros that select the variants.
+ */
+static inline std::string skepu_cl_collective_options(cl_device_id skepu_device)
+{
+	int skepu_major = 0, skepu_minor = 0;
+	if (sscanf(skepu_cl_device_info(skepu_device, CL_DEVICE_VERSION).c_str(), "OpenCL %d.%d", &skepu_major, &skepu_minor) == 2 && skepu_major >= 3)
+		return "-cl-std=CL3.0";
+	if (sscanf(skepu_cl_device_info(skepu_device, CL_DEVICE_OPENCL_C_VERSION).c_str(), "OpenCL C %d.%d", &skepu_major, &skepu_minor) == 2 && skepu_major >= 2)
+		return "-cl-std=CL2.0";
+	return "";
+}
+
+static inline cl_program skepu_cl_build_source(skepu::backend::Device_CL *device, const std::string &source)
+{
+	cl_device_id skepu_device = device->getDeviceID();
+	std::string skepu_options = (source.find("SKEPU_CL_COLLECTIVE_REDUCE") != std::string::npos) ? skepu_cl_collective_options(skepu_device) : "";
+	if (skepu_options.empty())
+		return skepu::backend::cl_helpers::buildProgram(device, source);
+	
+	const char *skepu_text = source.c_str();
+	cl_int skepu_err;
+	cl_program skepu_program = clCreateProgramWithSource(device->getContext(), 1, &skepu_text, NULL, &skepu_err);
+	CL_CHECK_ERROR(skepu_err, "Error creating OpenCL program");
+	if (clBuildProgram(skepu_program, 1, &skepu_device, skepu_options.c_str(), NULL, NULL) != CL_SUCCESS)
+	{
+		size_t skepu_size = 0;
+		clGetProgramBuildInfo(skepu_program, skepu_device, CL_PROGRAM_BUILD_LOG, 0, NULL, &skepu_size);
+		std::string skepu_log(skepu_size, '\0');
+		clGetProgramBuildInfo(skepu_program, skepu_device, CL_PROGRAM_BUILD_LOG, skepu_size, &skepu_log[0], NULL);
+		SKEPU_ERROR("Error building OpenCL program with " << skepu_options << ":\n" << skepu_log);
+	}
+	return skepu_program;
+}
+
+static inline cl_program skepu_cl_build_program(skepu::backend::Device_CL *device, const std::string &source)
+{
+	const char *skepu_cacheDir = std::getenv("SKEPU_OPENCL_CACHE_DIR");
+	if (!skepu_cacheDir || !*skepu_cacheDir)
+		return skepu_cl_build_source(device, source);
+	
+	cl_device_id skepu_device = device->getDeviceID();
+	std::string skepu_path = skepu_cl_cache_path(skepu_cacheDir, skepu_device, source);
+	
+	std::ifstream skepu_in(skepu_path, std::ios::binary);
+	if (skepu_in)
+	{
+		std::vector<unsigned char> skepu_binary{std::istreambuf_iterator<char>(skepu_in), std::istreambuf_iterator<char>()};
+		const unsigned char *skepu_data = skepu_binary.data();
+		size_t skepu_size = skepu_binary.size();
+		cl_int skepu_status, skepu_err;
+		cl_program skepu_program = clCreateProgramWithBinary(device->getContext(), 1, &skepu_device, &skepu_size, &skepu_data, &skepu_status, &skepu_err);
+		if (skepu_err == CL_SUCCESS)
+		{
+			if (skepu_status == CL_SUCCESS && clBuildProgram(skepu_program, 1, &skepu_device, NULL, NULL, NULL) == CL_SUCCESS)
+				return skepu_program;
+			clReleaseProgram(skepu_program);
+		}
+		// Stale or corrupt entry, fall through and rebuild it
+	}
+	
+	cl_program skepu_program = skepu_cl_build_source(device, source);
+	
+	size_t skepu_size = 0;
+	if (clGetProgramInfo(skepu_program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &skepu_size, NULL) == CL_SUCCESS && skepu_size > 0)
+	{
+		std::vector<unsigned char> skepu_binary(skepu_size);
+		unsigned char *skepu_data = skepu_binary.data();
+		if (clGetProgramInfo(skepu_program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &skepu_data, NULL) == CL_SUCCESS)
+		{
+			// Write to a private file first so that concurrent processes never observe a partial binary
+			std::string skepu_tmp = skepu_path + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+			std::ofstream skepu_out(skepu_tmp, std::ios::binary);
+			if (skepu_out.write(reinterpret_cast<const char*>(skepu_data), skepu_size))
+			{
+				skepu_out.close();
+				if (std::rename(skepu_tmp.c_str(), skepu_path.c_str()) == 0)
+					return skepu_program;
+			}
+			std::remove(skepu_tmp.c_str());
+		}
+	}
+	
+	return skepu_program;
+}
+
+/*
+ *  Program from the SPIR-V binary embedded under -opencl-spirv. Falls back to building the source on devices
+ *  without SPIR-V support, or when the OpenCL headers predate clCreateProgramWithIL.
+ */
+static inline cl_program skepu_cl_build_program_il(skepu::backend::Device_CL *device, const unsigned char *il, size_t size, const std::string &source)
+{
+#ifdef CL_VERSION_2_1
+	cl_device_id skepu_device = device->getDeviceID();
+	if (skepu_cl_device_info(skepu_device, CL_DEVICE_IL_VERSION).find("SPIR-V") != std::string::npos)
+	{
+		cl_int skepu_err;
+		cl_program skepu_program = clCreateProgramWithIL(device->getContext(), il, size, &skepu_err);
+		if (skepu_err == CL_SUCCESS)
+		{
+			if (clBuildProgram(skepu_program, 1, &skepu_device, NULL, NULL, NULL) == CL_SUCCESS)
+				return skepu_program;
+			clReleaseProgram(skepu_program);
+		}
+	}
+#endif
+	return skepu_cl_build_program(device, source);
+}
+
+/*
+ *  Kernel objects of the calling thread. cl_kernel argument setting is not thread-safe, so each host thread
+ *  launches its own clone of a shared kernel, made on first use and released when the thread exits, and host
+ *  threads launch in parallel without locks. The clones also remember the argument values last set on them.
+ *  Without clCloneKernel, before OpenCL 2.1 or when the platform fails it, the shared kernel is used and its
+ *  arguments are always set.
+ */
+class skepu_cl_thread_kernels
+{
+public:
+	static skepu_cl_thread_kernels &instance()
+	{
+		thread_local skepu_cl_thread_kernels kernels;
+		return kernels;
+	}
+	
+	cl_kernel get(cl_kernel shared)
+	{
+#ifdef CL_VERSION_2_1
+		auto it = this->m_clones.find(shared);
+		if (it != this->m_clones.end())
+			return it->second;
+		cl_int err;
+		cl_kernel clone = clCloneKernel(shared, &err);
+		if (err != CL_SUCCESS)
+			clone = shared;
+		else
+			this->m_args.emplace(clone, std::vector<std::string>{});
+		this->m_clones.emplace(shared, clone);
+		return clone;
+#else
+		return shared;
+#endif
+	}
+	
+	// Whether argument index of kernel needs setting to the size bytes at value, remembering them if so
+	bool changed(cl_kernel kernel, cl_uint index, const void *value, size_t size)
+	{
+		auto it = this->m_args.find(kernel);
+		if (it == this->m_args.end())
+			return true;
+		std::vector<std::string> &args = it->second;
+		if (args.size() <= index)
+			args.resize(index + 1);
+		std::string bytes(static_cast<const char*>(value), size);
+		if (args[index] == bytes)
+			return false;
+		args[index] = std::move(bytes);
+		return true;
+	}
+	
+	// A failed launch may leave the arguments unknown
+	void forget(cl_kernel kernel)
+	{
+		auto it = this->m_args.find(kernel);
+		if (it != this->m_args.end())
+			it->second.clear();
+	}
+	
+	~skepu_cl_thread_kernels()
+	{
+		for (auto &clone : this->m_args)
+			clReleaseKernel(clone.first);
+	}
+	
+private:
+	std::unordered_map<cl_kernel, cl_kernel> m_clones;
+	std::unordered_map<cl_kernel, std::vector<std::string>> m_args;
+};
+
+template<typename... Args>
+static inline void skepu_cl_set_kernel_args(cl_kernel kernel, Args&&... args)
+{
+	skepu_cl_thread_kernels &kernels = skepu_cl_thread_kernels::instance();
+	cl_uint index = 0;
+	auto set = [&] (const void *value, size_t size)
+	{
+		if (kernels.changed(kernel, index, value, size))
+		{
+			cl_int err = clSetKernelArg(kernel, index, size, value);
+			if (err != CL_SUCCESS)
+				kernels.forget(kernel);
+			CL_CHECK_ERROR(err, "Error setting kernel argument");
+		}
+		++index;
+	};
+	using expand = int[];
+	(void)expand{0, (set(&args, sizeof(typename std::decay<Args>::type)), 0)...};
+}
+
+/*
+ *  Per-device kernel table of a generated wrapper class, sized from the number of OpenCL devices in the
+ *  environment on first use, so that constructing it (from initialize() in the skeleton constructors) does not
+ *  create the environment; runs which never select the OpenCL backend then never probe the OpenCL platforms.
+ *  The program for a device is built the first time one of its kernels is looked up. Lookups return the kernel
+ *  object of the calling thread.
+ */
+template<size_t KernelCount>
+class skepu_cl_kernel_table
+{
+public:
+	using builder_t = void(*)(size_t);
+	
+	explicit skepu_cl_kernel_table(builder_t builder)
+	: m_builder(builder)
+	{}
+	
+	cl_kernel get(size_t deviceID, size_t kernel)
+	{
+		this->ensureBuilt(deviceID);
+		return skepu_cl_thread_kernels::instance().get(this->m_entries[deviceID].kernels[kernel]);
+	}
+	
+	void set(size_t deviceID, size_t kernel, cl_kernel newkernel)
+	{
+		this->checkDevice(deviceID);
+		this->m_entries[deviceID].kernels[kernel] = newkernel;
+	}
+	
+	// Issues the builds for several devices at once, returning when all are done
+	void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		std::vector<std::future<void>> builds;
+		for (size_t deviceID : deviceIDs)
+			builds.push_back(std::async(std::launch::async, [this, deviceID] { this->ensureBuilt(deviceID); }));
+		for (std::future<void> &build : builds)
+			build.get();
+	}
+	
+private:
+	struct entry
+	{
+		std::once_flag built;
+		cl_kernel kernels[KernelCount] {};
+	};
+	
+	void checkDevice(size_t deviceID)
+	{
+		std::call_once(this->m_sized, [this]
+		{
+			this->m_numDevices = skepu::backend::Environment<int>::getInstance()->m_devices_CL.size();
+			this->m_entries.reset(new entry[this->m_numDevices]);
+		});
+		if (deviceID >= this->m_numDevices)
+			SKEPU_ERROR("OpenCL device ID " << deviceID << " out of range (" << this->m_numDevices << " devices)");
+	}
+	
+	void ensureBuilt(size_t deviceID)
+	{
+		this->checkDevice(deviceID);
+		std::call_once(this->m_entries[deviceID].built, this->m_builder, deviceID);
+	}
+	
+	builder_t m_builder;
+	std::once_flag m_sized;
+	size_t m_numDevices = 0;
+	std::unique_ptr<entry[]> m_entries;
+};
+
+/*
+ *  Per-device copy of a uniform scalar argument, for kernels reading it through a __constant pointer, sized
+ *  on first use like the kernel tables. A device's buffer is only rewritten when the value differs from the
+ *  one last uploaded to it.
+ */
+template<typename T>
+class skepu_cl_constant_uniform
+{
+public:
+	cl_mem get(size_t deviceID, const T &value)
+	{
+		std::call_once(this->m_sized, [this]
+		{
+			this->m_numDevices = skepu::backend::Environment<int>::getInstance()->m_devices_CL.size();
+			this->m_entries.reset(new entry[this->m_numDevices]);
+		});
+		if (deviceID >= this->m_numDevices)
+			SKEPU_ERROR("OpenCL device ID " << deviceID << " out of range (" << this->m_numDevices << " devices)");
+		
+		entry &e = this->m_entries[deviceID];
+		std::lock_guard<std::mutex> guard(e.lock);
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		
+		if (!e.buffer)
+		{
+			e.buffer = clCreateBuffer(device->getContext(), CL_MEM_READ_ONLY, sizeof(T), NULL, &err);
+			CL_CHECK_ERROR(err, "Error allocating constant uniform buffer");
+		}
+		
+		if (!e.uploaded || std::memcmp(&e.value, &value, sizeof(T)) != 0)
+		{
+			std::memcpy(&e.value, &value, sizeof(T));
+			err = clEnqueueWriteBuffer(device->getQueue(), e.buffer, CL_TRUE, 0, sizeof(T), &e.value, 0, NULL, NULL);
+			CL_CHECK_ERROR(err, "Error uploading constant uniform");
+			e.uploaded = true;
+		}
+		return e.buffer;
+	}
+	
+private:
+	struct entry
+	{
+		std::mutex lock;
+		cl_mem buffer = NULL;
+		bool uploaded = false;
+		T value;
+	};
+	
+	std::once_flag m_sized;
+	size_t m_numDevices = 0;
+	std::unique_ptr<entry[]> m_entries;
+};
+
+#endif // SKEPU_CL_PROGRAM_BUILDER
+)~~~";
+
+
+/*
+ *  Offline compilation for -opencl-spirv. The kernel source embedded in a wrapper is compiled by clang to SPIR
+ *  LLVM IR and translated to SPIR-V by llvm-spirv, as LLVM has no SPIR-V backend of its own. size_t is replaced
+ *  as replaceSizeT does at run time, for the 64-bit devices the spir64 target describes. A kernel that does not
+ *  compile aborts the precompilation with the compiler output. Returns the definition of the embedded binary.
+ */
+static std::string compileSPIRV_CL(const std::string &kernelName, const std::string &wrapper, const std::string &dir)
+{
+	const std::string begin = "R\"###(", end = ")###\"";
+	size_t first = wrapper.find(begin);
+	size_t last = (first == std::string::npos) ? std::string::npos : wrapper.find(end, first);
+	if (last == std::string::npos)
+		SkePUAbort("No kernel source found in the OpenCL wrapper of " + kernelName);
+	std::string source = wrapper.substr(first + begin.size(), last - first - begin.size());
+	replaceTextInString(source, "size_t", "unsigned long");
+	
+	auto findTool = [] (const std::string &name) -> std::string
+	{
+		llvm::ErrorOr<std::string> path = llvm::sys::findProgramByName(name);
+		if (!path)
+			SkePUAbort("-opencl-spirv requires " + name + " in PATH or given by option");
+		return *path;
+	};
+	std::string clang = findTool(SPIRVClang), translator = findTool(SPIRVTranslator);
+	
+	std::string base = dir + "/" + kernelName;
+	std::string sourceFile = base + ".cl", bitcodeFile = base + ".bc", spirvFile = base + ".spv", logFile = base + ".spirv.log";
+	{
+		std::ofstream out(sourceFile);
+		out << source;
+	}
+	
+	auto run = [&] (const std::string &program, std::vector<llvm::StringRef> args)
+	{
+		llvm::Optional<llvm::StringRef> redirects[] = {llvm::None, llvm::StringRef(logFile), llvm::StringRef(logFile)};
+		if (llvm::sys::ExecuteAndWait(program, args, llvm::None, redirects) != 0)
+		{
+			std::ifstream log(logFile);
+			llvm::errs() << std::string{std::istreambuf_iterator<char>(log), std::istreambuf_iterator<char>()};
+			SkePUAbort("OpenCL kernel " + kernelName + " failed to compile to SPIR-V, see " + sourceFile);
+		}
+	};
+	run(clang, {clang, "-c", "-target", "spir64-unknown-unknown", "-cl-std=CL1.2", "-Xclang", "-finclude-default-header",
+		"-O2", "-emit-llvm", "-o", bitcodeFile, sourceFile});
+	run(translator, {translator, bitcodeFile, "-o", spirvFile});
+	
+	std::ifstream in(spirvFile, std::ios::binary);
+	std::string binary{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+	for (const std::string &file : {sourceFile, bitcodeFile, spirvFile, logFile})
+		llvm::sys::fs::remove(file);
+	
+	std::stringstream SSArray;
+	SSArray << "static const unsigned char skepu_spirv_" << kernelName << "[] = {";
+	for (size_t i = 0; i < binary.size(); ++i)
+		SSArray << (i % 16 ? " " : "\n\t") << (unsigned)(unsigned char)binary[i] << ",";
+	SSArray << "\n};\n";
+	SkePULog() << "OpenCL kernel " << kernelName << " compiled to " << binary.size() << " bytes of SPIR-V\n";
+	return SSArray.str();
+}
+
+
+/*
+ *  Instances built from the same user functions and options generate wrappers that differ only in the kernel
+ *  name, which carries the instance's skeleton ID. Wrappers are keyed by their text with the name factored out,
+ *  and a repeated one reuses the earlier kernel, so it is written, compiled and built at run time once. Every
+ *  instance still includes the file at its own location, the include guard keeps the first one in the source.
+ */
+thread_local std::string KernelScope_CL;
+
+std::string writeKernelProgram_CL(const std::string &kernelName, std::string wrapper, const std::string &dir)
+{
+	static thread_local std::unordered_map<std::string, std::string> generated;
+	replaceTextInString(wrapper, kernelName, "{{KERNEL_NAME}}");
+	
+	// The wrapper class is declared in the namespace of the first including instance
+	auto it = generated.find(KernelScope_CL + '\0' + wrapper);
+	if (it != generated.end())
+	{
+		SkePULog() << "OpenCL kernel " << kernelName << " is identical to " << it->second << ", reusing it\n";
+		return it->second;
+	}
+	generated.emplace(KernelScope_CL + '\0' + wrapper, kernelName);
+	
+	wrapper = templateString(wrapper, {{"{{KERNEL_NAME}}", kernelName}});
+	std::string spirv;
+	if (OpenCLSPIRV)
+	{
+		spirv = compileSPIRV_CL(kernelName, wrapper, dir);
+		replaceTextInString(wrapper, "skepu_cl_build_program(device, skepu_source())",
+			"skepu_cl_build_program_il(device, skepu_spirv_" + kernelName + ", sizeof(skepu_spirv_" + kernelName + "), skepu_source())");
+	}
+	
+	GeneratedFile FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
+	FSOutFile << "#ifndef SKEPU_CL_SOURCE_" << kernelName << "\n#define SKEPU_CL_SOURCE_" << kernelName << "\n"
+		<< ProgramBuilder_CL << spirv << wrapper << "\n#endif\n";
+	return kernelName;
+}
+
+
+std::string precisionExtensions_CL(std::vector<UserFunction const*> funcs)
+{
+	bool doublePrecision = false;
+	int halfPrecision = 0;
+	for (UserFunction const* func : funcs)
+	{
+		doublePrecision = doublePrecision || func->requiresDoublePrecision;
+		halfPrecision |= func->requiresHalfPrecision;
+	}
+	
+	if (halfPrecision & (int)HalfPrecision::BFloat16)
+		SkePUAbort("__nv_bfloat16 has no OpenCL counterpart, disable the OpenCL backend for this program");
+	
+	std::string res;
+	if (doublePrecision)
+		res += "#pragma OPENCL EXTENSION cl_khr_fp64: enable\n";
+	
+	// The CUDA type name is kept in user function code, as an alias of the builtin half
+	if (halfPrecision & (int)HalfPrecision::Half)
+		res += "#pragma OPENCL EXTENSION cl_khr_fp16: enable\ntypedef half __half;\n";
+	return res;
+}
+
+
+static const std::string CollectiveReducePrelude_CL = R"~~~(
+#ifndef SKEPU_CL_COLLECTIVE_REDUCE
+#define SKEPU_CL_COLLECTIVE_REDUCE
+#if defined(__opencl_c_work_group_collective_functions) || (__OPENCL_C_VERSION__ >= 200 && __OPENCL_C_VERSION__ < 300)
+#define SKEPU_CL_WORK_GROUP_REDUCE
+#endif
+#ifdef cl_khr_subgroups
+#pragma OPENCL EXTENSION cl_khr_subgroups: enable
+#endif
+#if defined(cl_khr_subgroups) || defined(__opencl_c_subgroups)
+#define SKEPU_CL_SUB_GROUP_REDUCE
+#ifdef cl_khr_subgroup_shuffle_relative
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle_relative: enable
+#define SKEPU_CL_SUB_GROUP_SHUFFLE
+#endif
+#endif
+#endif
+)~~~";
+
+static const std::string LocalMemoryBlockReduce_CL = R"~~~(
+	{{LOCAL_BUFFER}}[{{TID}}] = {{RESULT}};
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if ({{BLOCK_SIZE}} >= 1024) { if ({{TID}} < 512 && {{TID}} + 512 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} + 512]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=  512) { if ({{TID}} < 256 && {{TID}} + 256 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} + 256]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=  256) { if ({{TID}} < 128 && {{TID}} + 128 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} + 128]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=  128) { if ({{TID}} <  64 && {{TID}} +  64 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +  64]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=   64) { if ({{TID}} <  32 && {{TID}} +  32 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +  32]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=   32) { if ({{TID}} <  16 && {{TID}} +  16 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +  16]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=   16) { if ({{TID}} <   8 && {{TID}} +   8 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +   8]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=    8) { if ({{TID}} <   4 && {{TID}} +   4 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +   4]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=    4) { if ({{TID}} <   2 && {{TID}} +   2 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +   2]); } barrier(CLK_LOCAL_MEM_FENCE); }
+	if ({{BLOCK_SIZE}} >=    2) { if ({{TID}} <   1 && {{TID}} +   1 < {{VALID_COUNT}}) { {{LOCAL_BUFFER}}[{{TID}}] = {{FUNCTION_NAME_REDUCE}}({{LOCAL_BUFFER}}[{{TID}}], {{LOCAL_BUFFER}}[{{TID}} +   1]); } barrier(CLK_LOCAL_MEM_FENCE); }
+)~~~";
+
+/*!
+ *  Work-group and sub-group built-in reductions of a built-in arithmetic operator. Work-items past VALID_COUNT
+ *  contribute the identity of the operator. Across sub-groups, the partials pass through local memory once.
+ */
+static const std::string BuiltinBlockReduce_CL = R"~~~(
+#if defined(SKEPU_CL_WORK_GROUP_REDUCE)
+	{
+		{{REDUCE_RESULT_TYPE}} skepu_value = work_group_reduce_{{OPERATOR}}(({{TID}} < {{VALID_COUNT}}) ? {{RESULT}} : ({{IDENTITY}}));
+		if ({{TID}} == 0)
+			{{LOCAL_BUFFER}}[0] = skepu_value;
+	}
+#elif defined(SKEPU_CL_SUB_GROUP_REDUCE)
+	{
+		{{REDUCE_RESULT_TYPE}} skepu_value = sub_group_reduce_{{OPERATOR}}(({{TID}} < {{VALID_COUNT}}) ? {{RESULT}} : ({{IDENTITY}}));
+		if (get_sub_group_local_id() == 0)
+			{{LOCAL_BUFFER}}[get_sub_group_id()] = skepu_value;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (get_sub_group_id() == 0)
+		{
+			skepu_value = ({{IDENTITY}});
+			for (uint skepu_s = get_sub_group_local_id(); skepu_s < get_num_sub_groups(); skepu_s += get_sub_group_size())
+				skepu_value = {{FUNCTION_NAME_REDUCE}}(skepu_value, {{LOCAL_BUFFER}}[skepu_s]);
+			skepu_value = sub_group_reduce_{{OPERATOR}}(skepu_value);
+			if ({{TID}} == 0)
+				{{LOCAL_BUFFER}}[0] = skepu_value;
+		}
+	}
+#else
+{{LOCAL_MEMORY_REDUCE}}
+#endif
+)~~~";
+
+/*!
+ *  Sub-group shuffle tail for other reduce functions on built-in types. Each sub-group combines its work-items
+ *  in a tree over sub_group_shuffle_down and work-item 0 combines the sub-group partials in order, assuming the
+ *  sub-groups of the one-dimensional work-group are consecutive ranges of get_max_sub_group_size() work-items.
+ */
+static const std::string ShuffleBlockReduce_CL = R"~~~(
+#if defined(SKEPU_CL_SUB_GROUP_SHUFFLE)
+	{
+		size_t skepu_count = ({{BLOCK_SIZE}} < ({{VALID_COUNT}})) ? {{BLOCK_SIZE}} : ({{VALID_COUNT}});
+		uint skepu_lane = get_sub_group_local_id();
+		uint skepu_width = get_sub_group_size();
+		{{REDUCE_RESULT_TYPE}} skepu_value = {{RESULT}};
+
+		for (uint skepu_offset = 1; skepu_offset < skepu_width; skepu_offset *= 2)
+		{
+			{{REDUCE_RESULT_TYPE}} skepu_other = sub_group_shuffle_down(skepu_value, skepu_offset);
+			if (skepu_lane % (2 * skepu_offset) == 0 && skepu_lane + skepu_offset < skepu_width && {{TID}} + skepu_offset < skepu_count)
+				skepu_value = {{FUNCTION_NAME_REDUCE}}(skepu_value, skepu_other);
+		}
+
+		if (skepu_lane == 0)
+			{{LOCAL_BUFFER}}[get_sub_group_id()] = skepu_value;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if ({{TID}} == 0)
+		{
+			size_t skepu_groups = (skepu_count + get_max_sub_group_size() - 1) / get_max_sub_group_size();
+			for (size_t skepu_s = 1; skepu_s < skepu_groups; ++skepu_s)
+				skepu_value = {{FUNCTION_NAME_REDUCE}}(skepu_value, {{LOCAL_BUFFER}}[skepu_s]);
+			{{LOCAL_BUFFER}}[0] = skepu_value;
+		}
+	}
+#else
+{{LOCAL_MEMORY_REDUCE}}
+#endif
+)~~~";
+
+
+// Scalar types of the OpenCL sub-group and work-group built-ins, with the identities of min and max
+static const std::map<std::string, std::pair<std::string, std::string>> CollectiveReduceTypes_CL
+{
+	{"int",           {"INT_MAX",             "INT_MIN"}},
+	{"unsigned int",  {"UINT_MAX",            "0"}},
+	{"long",          {"LONG_MAX",            "LONG_MIN"}},
+	{"unsigned long", {"ULONG_MAX",           "0"}},
+	{"float",         {"INFINITY",            "-INFINITY"}},
+	{"double",        {"(double)INFINITY",    "-(double)INFINITY"}},
+};
+
+static bool collectiveReduceType_CL(UserFunction &reduceFunc)
+{
+	return !NoCollectiveReduce_CL && reduceFunc.multipleReturnTypes.empty() && !reduceFunc.multiReduceMap
+		&& CollectiveReduceTypes_CL.count(reduceFunc.rawReturnTypeName);
+}
+
+// The built-in operator of a reduce function 'return a + b;', min(a, b), max(a, b) or a conditional choosing
+// between the parameters by comparing them, or "" for any other body
+static std::string collectiveReduceOperator_CL(UserFunction &reduceFunc)
+{
+	const clang::FunctionDecl *f = reduceFunc.astDeclNode;
+	if (f->getTemplatedKind() == clang::FunctionDecl::TK_FunctionTemplateSpecialization)
+		f = f->getTemplateInstantiationPattern();
+	const clang::CompoundStmt *Body = clang::dyn_cast_or_null<clang::CompoundStmt>(f->getBody());
+	if (!Body || Body->size() != 1 || f->getNumParams() != 2)
+		return "";
+	for (const clang::ParmVarDecl *p : f->parameters())
+		if (p->getOriginalType().getNonReferenceType().getUnqualifiedType().getCanonicalType() != f->getReturnType().getCanonicalType())
+			return "";
+	const clang::ReturnStmt *Ret = clang::dyn_cast<clang::ReturnStmt>(Body->body_front());
+	if (!Ret || !Ret->getRetValue())
+		return "";
+	
+	const clang::ParmVarDecl *a = f->getParamDecl(0), *b = f->getParamDecl(1);
+	auto paramOf = [] (const clang::Expr *e) -> const clang::ParmVarDecl*
+	{
+		if (auto *Ref = clang::dyn_cast<clang::DeclRefExpr>(e->IgnoreParenImpCasts()))
+			return clang::dyn_cast<clang::ParmVarDecl>(Ref->getDecl());
+		return nullptr;
+	};
+	auto bothParams = [&] (const clang::Expr *lhs, const clang::Expr *rhs)
+	{
+		const clang::ParmVarDecl *l = paramOf(lhs), *r = paramOf(rhs);
+		return (l == a && r == b) || (l == b && r == a);
+	};
+	
+	const clang::Expr *Value = Ret->getRetValue()->IgnoreParenImpCasts();
+	if (auto *Add = clang::dyn_cast<clang::BinaryOperator>(Value))
+		return (Add->getOpcode() == clang::BO_Add && bothParams(Add->getLHS(), Add->getRHS())) ? "add" : "";
+	
+	if (auto *Call = clang::dyn_cast<clang::CallExpr>(Value))
+	{
+		const clang::FunctionDecl *Callee = Call->getDirectCallee();
+		std::string name = Callee ? Callee->getNameAsString() : "";
+		if ((name == "min" || name == "max") && Call->getNumArgs() == 2 && bothParams(Call->getArg(0), Call->getArg(1)))
+			return name;
+		return "";
+	}
+	
+	if (auto *Cond = clang::dyn_cast<clang::ConditionalOperator>(Value))
+	{
+		auto *Cmp = clang::dyn_cast<clang::BinaryOperator>(Cond->getCond()->IgnoreParenImpCasts());
+		if (!Cmp || !Cmp->isRelationalOp() || !bothParams(Cmp->getLHS(), Cmp->getRHS()) || !bothParams(Cond->getTrueExpr(), Cond->getFalseExpr()))
+			return "";
+		bool less = Cmp->getOpcode() == clang::BO_LT || Cmp->getOpcode() == clang::BO_LE;
+		bool takesLHS = paramOf(Cond->getTrueExpr()) == paramOf(Cmp->getLHS());
+		return (less == takesLHS) ? "min" : "max";
+	}
+	return "";
+}
+
+std::string collectiveReducePrelude_CL(std::vector<UserFunction*> reduceFuncs)
+{
+	for (UserFunction *reduceFunc : reduceFuncs)
+		if (collectiveReduceType_CL(*reduceFunc))
+			return CollectiveReducePrelude_CL;
+	return "";
+}
+
+std::string generateBlockReduce_CL(UserFunction &reduceFunc, std::string reduceType, std::string result, std::string localBuffer, std::string tid, std::string blockSize, std::string validCount)
+{
+	std::string localMemoryReduce = templateString(LocalMemoryBlockReduce_CL,
+	{
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.uniqueName},
+		{"{{RESULT}}",               result},
+		{"{{LOCAL_BUFFER}}",         localBuffer},
+		{"{{TID}}",                  tid},
+		{"{{BLOCK_SIZE}}",           blockSize},
+		{"{{VALID_COUNT}}",          validCount}
+	});
+	if (!collectiveReduceType_CL(reduceFunc))
+		return localMemoryReduce;
+	
+	std::string op = collectiveReduceOperator_CL(reduceFunc);
+	auto identities = CollectiveReduceTypes_CL.at(reduceFunc.rawReturnTypeName);
+	return templateString(op.empty() ? ShuffleBlockReduce_CL : BuiltinBlockReduce_CL,
+	{
+		{"{{LOCAL_MEMORY_REDUCE}}",  localMemoryReduce},
+		{"{{OPERATOR}}",             op},
+		{"{{IDENTITY}}",             (op == "add") ? "0" : (op == "min") ? identities.first : identities.second},
+		{"{{REDUCE_RESULT_TYPE}}",   reduceType},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.uniqueName},
+		{"{{RESULT}}",               result},
+		{"{{LOCAL_BUFFER}}",         localBuffer},
+		{"{{TID}}",                  tid},
+		{"{{BLOCK_SIZE}}",           blockSize},
+		{"{{VALID_COUNT}}",          validCount}
+	});
+}
+
 void handleUserTypesConstantsAndPrecision_CL(std::vector<UserFunction const*> funcs, std::stringstream &sourceStream)
 {
-  // Double precision
-  for (UserFunction const* func : funcs)
-    if (func->requiresDoublePrecision)
-    {
-	    sourceStream << "#pragma OPENCL EXTENSION cl_khr_fp64: enable\n";
-      break;
-    }
+  // Double and half precision
+  sourceStream << precisionExtensions_CL(funcs);
 	
   // Predefined types
 	sourceStream << KernelPredefinedTypes_CL;
@@ -688,6 +1458,25 @@ std::string handleOutputs_CL(UserFunction &func, std::stringstream &SSHostKernel
 }
 
 
+void unitStrideHelper_CL(size_t index, std::stringstream &SSUnitStrideParams, std::stringstream &SSUnitStrideInit, std::stringstream &SSUnitStrides)
+{
+	SSUnitStrideParams << "int skepu_unused_stride_" << index << ", ";
+	SSUnitStrideInit << "const int skepu_stride_" << index << " = 1;\n";
+	SSUnitStrides << (index ? " && " : "") << "skepu_strides[" << index << "] == 1";
+}
+
+std::string unitStrideKernel_CL(std::string kernelTemplate, std::string unitStrideParams, std::string unitStrideInit)
+{
+	// Same signature and body, with the strides turned into constants so that the index math folds away
+	return templateString(kernelTemplate,
+	{
+		{"{{KERNEL_NAME}}",   "{{KERNEL_NAME}}_UnitStride"},
+		{"{{STRIDE_PARAMS}}", unitStrideParams},
+		{"{{STRIDE_INIT}}",   unitStrideInit}
+	});
+}
+
+
 std::string generateUserTypeCode_CL(UserType &type)
 {
 	std::string def = getSourceAsString(type.astDeclNode->getSourceRange());
@@ -705,7 +1494,9 @@ std::string generateUserFunctionCode_CL(UserFunction &Func)
 {
 	std::stringstream SSFuncParamList, SSFuncParams, SSFuncSource;
 
-	SSFuncSource << generateOpenCLMultipleReturn(Func);
+	// Composite reduce functions use the struct emitted with the map function
+	if (!Func.multiReduceMap)
+		SSFuncSource << generateOpenCLMultipleReturn(Func);
 
 	bool first = true;
 
@@ -733,7 +1524,7 @@ std::string generateUserFunctionCode_CL(UserFunction &Func)
 	if (UserFunction::RandomParam *param = Func.randomParam)
 	{
 		if (!first) { SSFuncParamList << ", "; }
-		SSFuncParamList << "__global skepu_random *" << param->name;
+		SSFuncParamList << (PhiloxRandom ? "skepu_random " : "__global skepu_random *") << param->name;
 		first = false;
 	}
 	
@@ -792,6 +1583,18 @@ std::string generateUserFunctionCode_CL(UserFunction &Func)
 		SSFuncSource << "typedef " << arg.rawTypeName << " " << arg.paramName << ";\n";
 
 	SSFuncSource << transformedSource << "\n}\n\n";
+	
+	// Map kernels store each result of a multi-return function straight into its output
+	if (Func.storesOutputs())
+	{
+		SSFuncSource << "static void " << Func.uniqueName << "_store(" << SSFuncParamList.str();
+		for (size_t i = 0; i < Func.multipleReturnTypes.size(); ++i)
+			SSFuncSource << ((!first || i > 0) ? ", " : "") << "__global " << Func.multipleReturnTypes[i] << " *skepu_store_" << i;
+		SSFuncSource << ")\n{";
+		for (UserFunction::TemplateArgument &arg : Func.templateArguments)
+			SSFuncSource << "typedef " << arg.rawTypeName << " " << arg.paramName << ";\n";
+		SSFuncSource << replaceReferencesToOtherUFs(Backend::OpenCL, Func, [] (UserFunction &UF) { return UF.uniqueName; }, true) << "\n}\n\n";
+	}
 	return SSFuncSource.str();
 }
 
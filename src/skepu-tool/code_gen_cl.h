@@ -17,12 +17,21 @@ std::string generateOpenCLTensor4Proxy(UserFunction::RandomAccessParam const& pa
 
 std::string generateOpenCLRegion(size_t dim, UserFunction::RegionParam const& param);
 std::string generateOpenCLRandom();
+std::string generateOpenCLPhilox();
 
 std::string generateOpenCLMultipleReturn(UserFunction &UF);
 std::string generateUserFunctionCode_CL(UserFunction &Func);
 std::string generateUserTypeCode_CL(UserType &Type);
 
+// Brent-Kung block scan and ordered block reduction of the Scan kernels, as <kernelName>_ScanBlock and _ScanBlockReduce
+std::string generateScanBlockHelpers_CL(const std::string &kernelName, const std::string &scanType, const std::string &scanFuncName);
+
 extern const std::string KernelPredefinedTypes_CL;
+extern const std::string ProgramBuilder_CL;
+
+// Writes the _cl_source.inl wrapper of a kernel and returns the kernel name to use, which is that of an earlier
+// identical kernel if there is one
+std::string writeKernelProgram_CL(const std::string &kernelName, std::string wrapper, const std::string &dir);
 
 struct IndexCodeGen
 {
@@ -30,6 +39,7 @@ struct IndexCodeGen
 	std::string sizeParams;
 	std::string sizeArgs;
 	std::string indexInit;
+	IncrementalIndexCode incremental;
 	std::string mapFuncParam;
 	std::string templateHeader;
 	bool hasIndex = false;
@@ -55,7 +65,8 @@ RandomAccessAndScalarsResult handleRandomAccessAndUniforms_CL(
 	std::stringstream& SSHostKernelParamList,
 	std::stringstream& SSKernelParamList,
 	std::stringstream& SSKernelArgs,
-	bool &first
+	bool &first,
+	std::string deviceID = "skepu_deviceID"
 );
 
 void handleRandomParam_CL(
@@ -67,6 +78,20 @@ void handleRandomParam_CL(
 	std::stringstream& SSKernelArgs,
 	bool &first
 );
+// Extension pragmas for double and 16-bit floating point types used by any of funcs
+std::string precisionExtensions_CL(std::vector<UserFunction const*> funcs);
+
+// Per-device collective reduction variants, selected when the program is built: work-group or sub-group
+// built-ins for built-in operators on built-in arithmetic types, a sub-group shuffle tail for other reduce
+// functions on those types, and the local memory tree otherwise. The prelude goes ahead of the kernels.
+std::string collectiveReducePrelude_CL(std::vector<UserFunction*> reduceFuncs);
+// Block-wide reduction of result over the first validCount work-items, leaving it in localBuffer[0] for
+// work-item 0
+std::string generateBlockReduce_CL(UserFunction &reduceFunc, std::string reduceType, std::string result, std::string localBuffer, std::string tid, std::string blockSize, std::string validCount);
 void handleUserTypesConstantsAndPrecision_CL(std::vector<UserFunction const*> funcs, std::stringstream &sourceStream);
 
 std::string handleOutputs_CL(UserFunction &func, std::stringstream &SSHostKernelParamList, std::stringstream &SSKernelParamList, std::stringstream &SSKernelArgs, bool strided = false, std::string index = "skepu_i");
+
+// Unit-stride kernel variants: the launcher dispatches to {{KERNEL_NAME}}_UnitStride when all skepu_strides are 1
+void unitStrideHelper_CL(size_t index, std::stringstream &SSUnitStrideParams, std::stringstream &SSUnitStrideInit, std::stringstream &SSUnitStrides);
+std::string unitStrideKernel_CL(std::string kernelTemplate, std::string unitStrideParams, std::string unitStrideInit);
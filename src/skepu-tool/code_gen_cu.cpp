@@ -1,5 +1,7 @@
 #include "code_gen_cl.h"
 
+#include <cctype>
+
 IndexCodeGen indexInitHelper_CU(UserFunction &uf)
 {
 	IndexCodeGen res;
@@ -48,6 +50,9 @@ IndexCodeGen indexInitHelper_CU(UserFunction &uf)
 	)~~~";
 	}
 	
+	if (res.dim >= 2)
+		res.incremental = incrementalIndexCode(res.dim, "skepu::Index" + std::to_string(res.dim) + "D skepu_index;");
+	
 	return res;
 }
 
@@ -70,10 +75,34 @@ RandomAccessAndScalarsResult handleRandomAccessAndUniforms_CU(
 	for (UserFunction::RandomAccessParam& param : func.anyContainerParams)
 	{
 		if (!first) { SSMapFuncArgs << ", "; }
-		SSKernelParamList << param.unqualifiedFullTypeName << " " << param.name << ", ";
+		first = false;
+		
+		// The device variant ignores the parameter, which is neither uploaded nor passed
+		if (param.deviceUnused)
+		{
+			SSMapFuncArgs << param.unqualifiedFullTypeName << "{}";
+			continue;
+		}
 		SSMapFuncArgs << param.name;
+		
+		// Sparse matrices arrive as their three CSR arrays and the element count, as in the OpenCL kernels
+		if (param.containerType == ContainerType::SparseMatrix)
+		{
+			SSKernelParamList
+				<< param.resolvedTypeName << " *skepu_" << param.name << "_data, "
+				<< "size_t *skepu_" << param.name << "_row_offsets, "
+				<< "size_t *skepu_" << param.name << "_col_indices, "
+				<< "size_t skepu_" << param.name << "_count, ";
+			SSProxiesInit << param.unqualifiedFullTypeName << " " << param.name << ";\n"
+				<< param.name << ".data = skepu_" << param.name << "_data;\n"
+				<< param.name << ".row_offsets = skepu_" << param.name << "_row_offsets;\n"
+				<< param.name << ".col_indices = skepu_" << param.name << "_col_indices;\n"
+				<< param.name << ".count = skepu_" << param.name << "_count;\n";
+			continue;
+		}
+		
+		SSKernelParamList << param.unqualifiedFullTypeName << " " << param.name << ", ";
 		SSProxiesInit << param.resolvedTypeName << "* skepu_" << param.name << "_base = " << param.name << ".data;\n";
-		first = false;
 		switch (param.containerType)
 		{
 			case ContainerType::MatRow:
@@ -100,6 +129,31 @@ RandomAccessAndScalarsResult handleRandomAccessAndUniforms_CU(
 	return res;
 }
 
+std::vector<UserType::Field> soaFields_CU(UserFunction &func, UserFunction::Param &param)
+{
+	const clang::CXXRecordDecl *record = param.astDeclNode->getType().getNonReferenceType()->getAsCXXRecordDecl();
+	if (!record)
+		return {};
+	
+	for (auto &pair : UserTypes)
+	{
+		UserType *UT = pair.second;
+		if (!UT->soaLayout || UT->astDeclNode->getCanonicalDecl() != record->getCanonicalDecl())
+			continue;
+		
+		std::set<std::string> read;
+		if (!func.readsOnlyFields(param, read))
+			return UT->fields;
+		
+		std::vector<UserType::Field> fields;
+		for (UserType::Field &field : UT->fields)
+			if (read.count(field.name))
+				fields.push_back(field);
+		return fields;
+	}
+	return {};
+}
+
 void handleRandomParam_CU(
 	UserFunction &func,
 	std::stringstream& SSMapFuncArgs,
@@ -111,8 +165,16 @@ void handleRandomParam_CU(
 	{
 		if (!first) { SSMapFuncArgs << ", "; }
 		first = false;
-		SSMapFuncArgs << param->name << "[skepu_global_prng_id]";
-		SSKernelParamList << "skepu::Random<" << param->randomCount << ">* " << param->name << ", ";
+		if (PhiloxRandom)
+		{
+			SSMapFuncArgs << "skepu::philox::Stream(skepu_prng_seed, skepu_base + skepu_i)";
+			SSKernelParamList << "unsigned long long skepu_prng_seed, ";
+		}
+		else
+		{
+			SSMapFuncArgs << param->name << "[skepu_global_prng_id]";
+			SSKernelParamList << "skepu::Random<" << param->randomCount << ">* " << param->name << ", ";
+		}
 	}
 	else
 	{
@@ -122,13 +184,284 @@ void handleRandomParam_CU(
 
 
 
+static const std::string ShuffleReduceHelpers_CU = R"~~~(
+#ifndef SKEPU_CUDA_SHUFFLE_REDUCE_HELPERS
+#define SKEPU_CUDA_SHUFFLE_REDUCE_HELPERS
+template<typename T>
+__device__ __forceinline__ T skepu_shfl_down(unsigned int skepu_mask, T skepu_val, unsigned int skepu_delta)
+{
+	constexpr size_t skepu_words = (sizeof(T) + sizeof(int) - 1) / sizeof(int);
+	int skepu_buf[skepu_words];
+	memcpy(skepu_buf, &skepu_val, sizeof(T));
+	for (size_t skepu_w = 0; skepu_w < skepu_words; ++skepu_w)
+		skepu_buf[skepu_w] = __shfl_down_sync(skepu_mask, skepu_buf[skepu_w], skepu_delta);
+	memcpy(&skepu_val, skepu_buf, sizeof(T));
+	return skepu_val;
+}
+#endif
+)~~~";
+
+/*!
+ *  Block-wide reduction of skepu_result using warp shuffles. Only the first min(blockSize, VALID_COUNT) threads
+ *  contribute. The partial of each warp passes through shared memory once, so only 32 elements of the shared
+ *  buffer are used. The result ends up in {{SHARED_BUFFER}}[0], as with the shared memory ladder. The shuffles of
+ *  the last warp name only its live lanes, as the block size need not be a multiple of 32.
+ */
+static const std::string ShuffleBlockReduce_CU = R"~~~(
+	{
+		size_t skepu_count = (skepu_blockSize < ({{VALID_COUNT}})) ? skepu_blockSize : ({{VALID_COUNT}});
+		size_t skepu_lane = skepu_tid % 32;
+		size_t skepu_warp = skepu_tid / 32;
+		size_t skepu_lanes = skepu_blockSize - skepu_warp * 32;
+		unsigned int skepu_mask = (skepu_lanes >= 32) ? 0xffffffffu : ((1u << skepu_lanes) - 1);
+
+		for (unsigned int skepu_offset = 16; skepu_offset > 0; skepu_offset /= 2)
+		{
+			{{REDUCE_RESULT_TYPE}} skepu_other = skepu_shfl_down(skepu_mask, skepu_result, skepu_offset);
+			if (skepu_lane + skepu_offset < 32 && skepu_tid + skepu_offset < skepu_count)
+				skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_other);
+		}
+
+		if (skepu_blockSize > 32)
+		{
+			size_t skepu_numWarps = (skepu_count + 31) / 32;
+			if (skepu_lane == 0)
+				{{SHARED_BUFFER}}[skepu_warp] = skepu_result;
+			__syncthreads();
+
+			if (skepu_warp == 0)
+			{
+				// The block has more than 32 threads, so the first warp is full
+				if (skepu_lane < skepu_numWarps)
+					skepu_result = {{SHARED_BUFFER}}[skepu_lane];
+				for (unsigned int skepu_offset = 16; skepu_offset > 0; skepu_offset /= 2)
+				{
+					{{REDUCE_RESULT_TYPE}} skepu_other = skepu_shfl_down(0xffffffffu, skepu_result, skepu_offset);
+					if (skepu_lane + skepu_offset < skepu_numWarps)
+						skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_other);
+				}
+			}
+		}
+
+		if (skepu_tid == 0)
+			{{SHARED_BUFFER}}[0] = skepu_result;
+	}
+)~~~";
+
+
+/*!
+ *  Early exit of the grid-stride loop of a reduction kernel, at the top of each iteration. A thread whose partial
+ *  has reached the absorbing value raises the flag of the launch and stops, as the result is decided; the others
+ *  stop once they see the flag. Their partials still enter the block reduction, which the absorbing one decides.
+ */
+static const std::string EarlyExitCheck_CU = R"~~~(
+		if (skepu_result == ({{ABSORBING}}))
+		{
+			*(volatile unsigned int*)skepu_done = 1;
+			break;
+		}
+		if (*(volatile unsigned int*)skepu_done)
+			break;
+)~~~";
+
+std::string generateEarlyExitCheck_CU(std::string absorbing)
+{
+	if (absorbing.empty())
+		return "";
+	return templateString(EarlyExitCheck_CU, {{"{{ABSORBING}}", absorbing}});
+}
+
+
+bool useShuffleReduce_CU(UserFunction &reduceFunc)
+{
+	return !NoShuffleReduce && reduceFunc.returnTypeTriviallyCopyable;
+}
+
+std::string generateShuffleReduceHelpers_CU()
+{
+	return ShuffleReduceHelpers_CU;
+}
+
+std::string generateShuffleBlockReduce_CU(UserFunction &reduceFunc, std::string reduceType, std::string sharedBuffer, std::string validCount, std::string reduceFuncName)
+{
+	if (!useShuffleReduce_CU(reduceFunc))
+		return "";
+	
+	return templateString(ShuffleBlockReduce_CU,
+	{
+		{"{{REDUCE_RESULT_TYPE}}",   reduceType},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName.empty() ? reduceFunc.funcNameCUDA() : reduceFuncName},
+		{"{{SHARED_BUFFER}}",        sharedBuffer},
+		{"{{VALID_COUNT}}",          validCount}
+	});
+}
+
+
+bool useFloatAccumulation_CU(UserFunction &reduceFunc)
+{
+	if (!ReduceAccumulateFloat || reduceFunc.multipleReturnTypes.size() > 0)
+		return false;
+	
+	// Binary operator on a 16-bit float type, the float variant reuses the body with float parameters
+	const FunctionDecl *f = reduceFunc.astDeclNode;
+	std::string type = f->getReturnType().getCanonicalType().getAsString();
+	if (halfPrecisionOf(type) == HalfPrecision::None || f->getNumParams() != 2)
+		return false;
+	for (const ParmVarDecl *p : f->parameters())
+		if (p->getOriginalType().getNonReferenceType().getUnqualifiedType().getCanonicalType().getAsString() != type)
+			return false;
+	return true;
+}
+
+std::string reduceResultType_CU(UserFunction &reduceFunc)
+{
+	// Composite reduce functions operate on the multi-return struct, not on the host tuple type
+	if (reduceFunc.multiReduceMap)
+		return SkePU_UF_Prefix + reduceFunc.instanceName + "_" + reduceFunc.uniqueName + "::" + reduceFunc.multiReturnTypeNameGPU();
+	return reduceFunc.resolvedReturnTypeName;
+}
+
+std::string reduceAccumulatorType_CU(UserFunction &reduceFunc)
+{
+	return useFloatAccumulation_CU(reduceFunc) ? "float" : reduceResultType_CU(reduceFunc);
+}
+
+std::string reduceFuncName_CU(UserFunction &reduceFunc)
+{
+	return useFloatAccumulation_CU(reduceFunc) ? reduceFunc.funcNameCUDA() + "_float" : reduceFunc.funcNameCUDA();
+}
+
+std::string strideFactor_CU(size_t index)
+{
+	return "(skepu_unit_strides ? 1 : skepu_strides[" + std::to_string(index) + "])";
+}
+
+static const char *LaunchMetadataTemplate_CU = R"~~~(
+struct {{LAUNCH_STRUCT}}
+{
+	// Dynamic shared memory the kernel needs for a block of the given size
+	static __host__ size_t sharedMemBytes(int skepu_blockSize, size_t skepu_sharedMemPerBlock = 0)
+	{
+		return skepu_sharedMemPerBlock + {{SHARED_MEM_BYTES}};
+	}
+
+	static __host__ cudaError_t maxPotentialBlockSize(int *skepu_minGridSize, int *skepu_blockSize, size_t skepu_sharedMemPerBlock = 0, int skepu_blockSizeLimit = 0)
+	{
+		return cudaOccupancyMaxPotentialBlockSizeVariableSMem(skepu_minGridSize, skepu_blockSize, {{KERNEL_SYMBOL}},
+			[skepu_sharedMemPerBlock](int skepu_threads) { return sharedMemBytes(skepu_threads, skepu_sharedMemPerBlock); }, skepu_blockSizeLimit);
+	}
+};
+)~~~";
+
+std::string generateLaunchMetadata_CU(std::string structName, std::string kernelSymbol, std::string sharedMemBytes)
+{
+	return templateString(LaunchMetadataTemplate_CU,
+	{
+		{"{{LAUNCH_STRUCT}}",    structName},
+		{"{{KERNEL_SYMBOL}}",    kernelSymbol},
+		{"{{SHARED_MEM_BYTES}}", sharedMemBytes}
+	});
+}
+
+// Whether the identifier at pos of text is whole, not part of a longer one
+static bool wholeIdentifier(const std::string &text, size_t pos, size_t length)
+{
+	auto identChar = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+	return (pos == 0 || !identChar(text[pos - 1])) && (pos + length >= text.size() || !identChar(text[pos + length]));
+}
+
+std::set<std::string> appendIndex32Variants_CU(const std::string &kernelFile)
+{
+	std::ifstream in(kernelFile, std::ios::binary);
+	std::string source {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+	in.close();
+
+	std::set<std::string> converted;
+	std::stringstream SSVariants;
+	const std::string qualifier = "__global__ void ";
+	for (size_t at = source.find(qualifier); at != std::string::npos; at = source.find(qualifier, at + qualifier.size()))
+	{
+		size_t nameStart = at + qualifier.size();
+		size_t open = source.find('(', nameStart);
+		size_t body = source.find('{', open);
+		if (open == std::string::npos || body == std::string::npos)
+			break;
+		size_t end = body;
+		for (int depth = 0; end < source.size(); ++end)
+		{
+			if (source[end] == '{') ++depth;
+			else if (source[end] == '}' && --depth == 0) break;
+		}
+		std::string name = source.substr(nameStart, open - nameStart);
+		std::string kernel = source.substr(at, end + 1 - at);
+		size_t lineStart = source.rfind('\n', at);
+		bool linkageSpec = source.find_first_not_of(" \t", lineStart == std::string::npos ? 0 : lineStart + 1) != at;
+
+		// Element data in size_t arrays keeps its type, so those kernels stay 64-bit only
+		bool readsSizeArrays = false;
+		for (size_t t = kernel.find("size_t"); t != std::string::npos; t = kernel.find("size_t", t + 6))
+			if (wholeIdentifier(kernel, t, 6) && kernel.find_first_not_of(" \t", t + 6) != std::string::npos && kernel[kernel.find_first_not_of(" \t", t + 6)] == '*')
+				readsSizeArrays = true;
+		if (readsSizeArrays || linkageSpec || converted.count(name))
+			continue;
+
+		// Signed, so that products with negative strides stay negative offsets; shared buffers keep their declarations
+		std::string variant;
+		size_t replaced = 0;
+		std::istringstream lines(kernel);
+		for (std::string line; std::getline(lines, line); )
+		{
+			if (line.find("extern __shared__") == std::string::npos)
+				for (size_t t = line.find("size_t"); t != std::string::npos; t = line.find("size_t", t + 3))
+					if (wholeIdentifier(line, t, 6))
+					{
+						line.replace(t, 6, "int");
+						++replaced;
+					}
+			variant += line + "\n";
+		}
+		if (replaced == 0)
+			continue;
+		variant.replace(qualifier.size(), name.size(), name + "_Index32");
+
+		// A template header is the previous line
+		if (lineStart != std::string::npos && lineStart > 0)
+		{
+			size_t previous = source.rfind('\n', lineStart - 1);
+			previous = (previous == std::string::npos) ? 0 : previous + 1;
+			std::string line = source.substr(previous, lineStart - previous);
+			if (line.compare(0, 9, "template<") == 0)
+				variant = line + "\n" + variant;
+		}
+		SSVariants << "\n" << variant;
+		converted.insert(name);
+	}
+
+	if (!converted.empty())
+		writeFileIfChanged(kernelFile, source + "\n// 32-bit index variants, launched when all sizes and pitches fit in 31 bits\n" + SSVariants.str());
+	return converted;
+}
+
+void applyLaunchBounds_CU(const std::string &kernelFile, const std::string &bounds)
+{
+	std::ifstream in(kernelFile, std::ios::binary);
+	std::string source {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+	in.close();
+
+	const std::string qualifier = "__global__ void ";
+	const std::string attribute = "__launch_bounds__(" + bounds + ") ";
+	for (size_t at = source.find(qualifier); at != std::string::npos; at = source.find(qualifier, at + qualifier.size()))
+		source.insert(at + qualifier.size(), attribute);
+	writeFileIfChanged(kernelFile, source);
+}
+
 std::string handleOutputs_CU(UserFunction &func, std::stringstream &SSKernelParamList, bool strided, std::string index)
 {
 	std::stringstream SSOutputBindings;
 	if (func.multipleReturnTypes.size() == 0)
 	{
 		std::stringstream strideinc;
-		if (strided) strideinc << " * skepu_strides[0]";
+		if (strided) strideinc << " * " << strideFactor_CU(0);
 		SSKernelParamList << func.resolvedReturnTypeName << "* skepu_output, ";
 		SSOutputBindings << "skepu_output[" << index << strideinc.str() << "] = skepu_res;";
 	}
@@ -138,7 +471,7 @@ std::string handleOutputs_CU(UserFunction &func, std::stringstream &SSKernelPara
 		for (std::string& outputType : func.multipleReturnTypes)
 		{
 			std::stringstream strideinc;
-			if (strided) strideinc << " * skepu_strides[" << outCtr << "]";
+			if (strided) strideinc << " * " << strideFactor_CU(outCtr);
 			SSKernelParamList << outputType << "* skepu_output_" << outCtr << ", ";
 			SSOutputBindings << "skepu_output_" << outCtr << "[" << index << strideinc.str() << "] = skepu_res.e" << outCtr << ";\n";
 			outCtr++;
@@ -148,6 +481,17 @@ std::string handleOutputs_CU(UserFunction &func, std::stringstream &SSKernelPara
 	return SSOutputBindings.str();
 }
 
+std::string mapCall_CU(UserFunction &func, std::string args, std::string bindings, const std::vector<std::string> &destinations)
+{
+	if (!func.storesOutputs())
+		return "auto skepu_res = " + func.funcNameCUDA() + "(" + args + ");\n" + bindings;
+	
+	std::string call = func.funcNameCUDA() + "_Store(" + args;
+	for (size_t i = 0; i < destinations.size(); ++i)
+		call += ((i > 0 || !args.empty()) ? ", &" : "&") + destinations[i];
+	return call + ");";
+}
+
 
 
 
@@ -13,6 +13,7 @@ struct IndexCodeGen
 	std::string sizeParams;
 	std::string sizeArgs;
 	std::string indexInit;
+	IncrementalIndexCode incremental;
 	std::string mapFuncParam;
 	std::string templateHeader;
 	bool hasIndex = false;
@@ -43,5 +44,49 @@ void handleRandomParam_CU(
 	bool &first
 );
 
+bool useShuffleReduce_CU(UserFunction &reduceFunc);
+bool useTiledMapPairs_CU(UserFunction &mapPairsFunc);
+bool useBroadcastMapPairsReduce_CU(const std::string &InstanceName, UserFunction &mapPairsFunc);
+bool useVectorizedMap_CU(const std::string &InstanceName, UserFunction &mapFunc);
+bool useTiledGEMM_CU(const std::string &InstanceName, UserFunction &mapFunc);
+std::string generateShuffleReduceHelpers_CU();
+// Flag test at the top of the grid-stride loop of the _EarlyExit reduction kernels, empty without an absorbing value
+std::string generateEarlyExitCheck_CU(std::string absorbing);
+std::string generateShuffleBlockReduce_CU(UserFunction &reduceFunc, std::string reduceType, std::string sharedBuffer, std::string validCount, std::string reduceFuncName = "");
+
+// Tile flags, look-back load and warp scan of the single-pass Scan kernels, as <kernelName>_ScanLookback_load and
+// _ScanLookback_warpScan, for kernels that scan with their own function
+std::string generateScanLookbackHelpers_CU(const std::string &kernelName, const std::string &scanType, const std::string &scanFuncName);
+
+// The kernel combining per-block partials of reduceFunc, as launched after the first pass of MapReduce
+std::string generateReduceOnlyKernel_CU(UserFunction &reduceFunc, std::string kernelName, std::string sharedBuffer);
+
+// -reduce-accumulate-float: __half and __nv_bfloat16 reductions keep the per-thread accumulator in float,
+// calling the CU_float variant of the reduce function. Shared and global partials keep the element type.
+bool useFloatAccumulation_CU(UserFunction &reduceFunc);
+std::string reduceResultType_CU(UserFunction &reduceFunc);
+std::string reduceAccumulatorType_CU(UserFunction &reduceFunc);
+std::string reduceFuncName_CU(UserFunction &reduceFunc);
+
+// Stride of elementwise argument index in kernels templated on bool skepu_unit_strides
+std::string strideFactor_CU(size_t index);
+
+// Occupancy helper struct for one generated kernel; sharedMemBytes is an expression in int skepu_blockSize
+std::string generateLaunchMetadata_CU(std::string structName, std::string kernelSymbol, std::string sharedMemBytes);
+
+// Inserts __launch_bounds__(bounds) into every kernel of the generated kernel file
+void applyLaunchBounds_CU(const std::string &kernelFile, const std::string &bounds);
+
+// -index32: appends an <name>_Index32 copy of each kernel in the generated kernel file whose size_t values are int,
+// and returns the names of the copied kernels. Kernels reading size_t arrays, whose values may not fit, are skipped.
+std::set<std::string> appendIndex32Variants_CU(const std::string &kernelFile);
+
+// -soa: the fields of an elementwise user-type parameter passed as separate arrays, empty if it stays array-of-structs
+std::vector<UserType::Field> soaFields_CU(UserFunction &func, UserFunction::Param &param);
+
 std::string handleOutputs_CU(UserFunction &func, std::stringstream &SSKernelParamList, bool strided = false, std::string index = "skepu_i");
+
+// The call of a Map function on args with the bindings of its results, or, for a multi-return function that
+// stores its outputs, the call of its CU_Store variant writing each result straight to its destination
+std::string mapCall_CU(UserFunction &func, std::string args, std::string bindings, const std::vector<std::string> &destinations);
 std::string generateCUDAMultipleReturn(UserFunction &UF);
\ No newline at end of file
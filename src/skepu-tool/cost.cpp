@@ -0,0 +1,369 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Cost-model backend selection for instances listed in -auto-backend. The user function struct of every instance
+ * carries the static estimate of the precompiler: flopsPerElement, transcendentalsPerElement and bytesPerElement.
+ * skepu::cost::Selected combines it with the problem size of each call, the largest size() of the arguments, and
+ * picks the backend with the lowest predicted time:
+ *
+ *   latency + n * max(flops / flop rate + transcendentals / transcendental rate, bytes / bandwidth)
+ *
+ * plus n * bytes over the host to device rate for GPU backends, as if the arguments were on the host. The rates,
+ * bandwidths and latencies of the backends are measured once per process, on the first selecting call: small
+ * arithmetic and copy loops on the CPU and the OpenMP threads, device copies and transfers on the first CUDA and
+ * OpenCL device. GPU arithmetic rates are derived from the device attributes.
+ */
+static const char *CostSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef SKEPU_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef SKEPU_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace skepu
+{
+	namespace cost
+	{
+		struct Target
+		{
+			Backend::Type type;
+			double flopRate;           // arithmetic operations per second
+			double transcendentalRate; // transcendental function calls per second
+			double bandwidth;          // memory bytes per second
+			double latency;            // seconds per call
+			double transfer;           // host to device bytes per second, 0 for backends working on host memory
+
+			double estimate(double n, double flops, double transcendentals, double bytes) const
+			{
+				double compute = n * (flops / this->flopRate + transcendentals / this->transcendentalRate);
+				double memory = n * bytes / this->bandwidth;
+				double copy = (this->transfer > 0) ? n * bytes / this->transfer : 0;
+				return this->latency + std::max(compute, memory) + copy;
+			}
+		};
+
+		inline double seconds(std::chrono::steady_clock::time_point start)
+		{
+			return std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		// Independent multiply-add chains, as vectorized user functions run them
+		inline double measureFlopRate(size_t threads)
+		{
+			const size_t iterations = 1 << 22;
+			double sink = 0;
+			auto start = std::chrono::steady_clock::now();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) reduction(+:sink) if(threads > 1)
+#endif
+			for (long t = 0; t < (long)threads; ++t)
+			{
+				double x[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+				for (size_t i = 0; i < iterations; ++i)
+					for (size_t k = 0; k < 8; ++k)
+						x[k] = x[k] * 0.999999 + 0.000001;
+				for (size_t k = 0; k < 8; ++k)
+					sink += x[k];
+			}
+			double time = seconds(start);
+			volatile double keep = sink;
+			(void)keep;
+			return 16.0 * iterations * threads / time;
+		}
+
+		inline double measureTranscendentalRate(size_t threads)
+		{
+			const size_t iterations = 1 << 20;
+			double sink = 0;
+			auto start = std::chrono::steady_clock::now();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) reduction(+:sink) if(threads > 1)
+#endif
+			for (long t = 0; t < (long)threads; ++t)
+			{
+				double x = 0.5 + t;
+				for (size_t i = 0; i < iterations; ++i)
+					x = std::exp(-x) + 0.5;
+				sink += x;
+			}
+			double time = seconds(start);
+			volatile double keep = sink;
+			(void)keep;
+			return 1.0 * iterations * threads / time;
+		}
+
+		// Copy bandwidth, counting the bytes read and written
+		inline double measureBandwidth(size_t threads)
+		{
+			const size_t bytes = size_t(64) << 20, chunk = bytes / threads;
+			std::vector<char> from(bytes, 1), to(bytes, 0);
+			std::memcpy(to.data(), from.data(), bytes);
+			auto start = std::chrono::steady_clock::now();
+			for (int rep = 0; rep < 4; ++rep)
+			{
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) if(threads > 1)
+#endif
+				for (long t = 0; t < (long)threads; ++t)
+					std::memcpy(to.data() + t * chunk, from.data() + t * chunk, chunk);
+			}
+			return 2.0 * 4 * chunk * threads / seconds(start);
+		}
+
+		inline Target calibrateCPU()
+		{
+			return {Backend::Type::CPU, measureFlopRate(1), measureTranscendentalRate(1), measureBandwidth(1), 1e-7, 0};
+		}
+
+#ifdef _OPENMP
+		inline Target calibrateOpenMP()
+		{
+			size_t threads = std::max(1, omp_get_max_threads());
+			const int reps = 100;
+			auto start = std::chrono::steady_clock::now();
+			for (int rep = 0; rep < reps; ++rep)
+			{
+#pragma omp parallel
+				{
+					volatile int keep = 0;
+					(void)keep;
+				}
+			}
+			double latency = seconds(start) / reps;
+			return {Backend::Type::OpenMP, measureFlopRate(threads), measureTranscendentalRate(threads), measureBandwidth(threads), latency, 0};
+		}
+#endif
+
+#ifdef SKEPU_CUDA
+		inline bool calibrateCUDA(Target &target)
+		{
+			int count = 0, device = 0;
+			if (cudaGetDeviceCount(&count) != cudaSuccess || count == 0 || cudaGetDevice(&device) != cudaSuccess)
+			{
+				cudaGetLastError();
+				return false;
+			}
+			int sms = 0, clockKHz = 0;
+			cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+			cudaDeviceGetAttribute(&clockKHz, cudaDevAttrClockRate, device);
+
+			const size_t bytes = size_t(64) << 20;
+			void *from = nullptr, *to = nullptr;
+			if (cudaMalloc(&from, bytes) != cudaSuccess || cudaMalloc(&to, bytes) != cudaSuccess)
+			{
+				cudaGetLastError();
+				cudaFree(from);
+				return false;
+			}
+			std::vector<char> host(bytes, 1);
+			cudaEvent_t begin, end;
+			cudaEventCreate(&begin);
+			cudaEventCreate(&end);
+			float ms = 0;
+
+			cudaMemcpy(to, from, bytes, cudaMemcpyDeviceToDevice);
+			cudaEventRecord(begin);
+			for (int rep = 0; rep < 4; ++rep)
+				cudaMemcpy(to, from, bytes, cudaMemcpyDeviceToDevice);
+			cudaEventRecord(end);
+			cudaEventSynchronize(end);
+			cudaEventElapsedTime(&ms, begin, end);
+			double bandwidth = 2.0 * 4 * bytes / std::max(1e-9, ms * 1e-3);
+
+			auto start = std::chrono::steady_clock::now();
+			cudaMemcpy(from, host.data(), bytes, cudaMemcpyHostToDevice);
+			double transfer = bytes / seconds(start);
+
+			// Small asynchronous operations measure the launch overhead
+			const int reps = 100;
+			start = std::chrono::steady_clock::now();
+			for (int rep = 0; rep < reps; ++rep)
+				cudaMemsetAsync(to, 0, 4);
+			cudaDeviceSynchronize();
+			double latency = seconds(start) / reps;
+
+			cudaEventDestroy(begin);
+			cudaEventDestroy(end);
+			cudaFree(from);
+			cudaFree(to);
+
+			double clock = clockKHz * 1e3;
+			target = {Backend::Type::CUDA, 2.0 * 64 * sms * clock, 16.0 * sms * clock, bandwidth, latency, transfer};
+			return true;
+		}
+#endif
+
+#ifdef SKEPU_OPENCL
+		inline bool calibrateOpenCL(Target &target)
+		{
+			auto &devices = skepu::backend::Environment<int>::getInstance()->m_devices_CL;
+			if (devices.empty())
+				return false;
+			cl_command_queue queue = devices.at(0)->getQueue();
+			cl_context context;
+			cl_device_id device;
+			clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(context), &context, NULL);
+			clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+			cl_uint units = 0, clockMHz = 0;
+			clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+			clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clockMHz), &clockMHz, NULL);
+
+			const size_t bytes = size_t(64) << 20;
+			cl_int err1, err2;
+			cl_mem from = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &err1);
+			cl_mem to = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &err2);
+			if (err1 != CL_SUCCESS || err2 != CL_SUCCESS)
+			{
+				if (err1 == CL_SUCCESS) clReleaseMemObject(from);
+				if (err2 == CL_SUCCESS) clReleaseMemObject(to);
+				return false;
+			}
+			std::vector<char> host(bytes, 1);
+
+			clEnqueueWriteBuffer(queue, from, CL_TRUE, 0, bytes, host.data(), 0, NULL, NULL);
+			auto start = std::chrono::steady_clock::now();
+			clEnqueueWriteBuffer(queue, from, CL_TRUE, 0, bytes, host.data(), 0, NULL, NULL);
+			double transfer = bytes / seconds(start);
+
+			clEnqueueCopyBuffer(queue, from, to, 0, 0, bytes, 0, NULL, NULL);
+			clFinish(queue);
+			start = std::chrono::steady_clock::now();
+			for (int rep = 0; rep < 4; ++rep)
+				clEnqueueCopyBuffer(queue, from, to, 0, 0, bytes, 0, NULL, NULL);
+			clFinish(queue);
+			double bandwidth = 2.0 * 4 * bytes / seconds(start);
+
+			const int reps = 100;
+			cl_int zero = 0;
+			start = std::chrono::steady_clock::now();
+			for (int rep = 0; rep < reps; ++rep)
+				clEnqueueFillBuffer(queue, to, &zero, sizeof(zero), 0, sizeof(zero), 0, NULL, NULL);
+			clFinish(queue);
+			double latency = seconds(start) / reps;
+
+			clReleaseMemObject(from);
+			clReleaseMemObject(to);
+
+			double clock = clockMHz * 1e6;
+			target = {Backend::Type::OpenCL, 2.0 * 64 * units * clock, 16.0 * units * clock, bandwidth, latency, transfer};
+			return true;
+		}
+#endif
+
+		class Machine
+		{
+		public:
+			static Machine &instance()
+			{
+				static Machine machine;
+				return machine;
+			}
+
+			Target const& choose(double n, double flops, double transcendentals, double bytes) const
+			{
+				size_t best = 0;
+				for (size_t i = 1; i < this->targets.size(); ++i)
+					if (this->targets[i].estimate(n, flops, transcendentals, bytes) < this->targets[best].estimate(n, flops, transcendentals, bytes))
+						best = i;
+				return this->targets[best];
+			}
+
+			std::vector<Target> const& backends() const { return this->targets; }
+
+		private:
+			Machine()
+			{
+				this->targets.push_back(calibrateCPU());
+#ifdef _OPENMP
+				this->targets.push_back(calibrateOpenMP());
+#endif
+				Target target;
+#ifdef SKEPU_CUDA
+				if (calibrateCUDA(target))
+					this->targets.push_back(target);
+#endif
+#ifdef SKEPU_OPENCL
+				if (calibrateOpenCL(target))
+					this->targets.push_back(target);
+#endif
+				(void)target;
+			}
+
+			std::vector<Target> targets;
+		};
+
+		template<typename T>
+		auto sizeOf(const T &arg, int) -> decltype(arg.size(), size_t())
+		{
+			return arg.size();
+		}
+
+		template<typename T>
+		size_t sizeOf(const T &, long)
+		{
+			return 0;
+		}
+
+		template<typename... Args>
+		size_t problemSize(const Args&... args)
+		{
+			size_t size = 0;
+			for (size_t s : {size_t(0), sizeOf(args, 0)...})
+				size = std::max(size, s);
+			return size;
+		}
+
+		template<typename Skeleton, typename UF>
+		class Selected: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				// Calls on iterators alone keep the current backend
+				size_t n = problemSize(args...);
+				if (n > 0)
+				{
+					Target const& target = Machine::instance().choose(n, UF::flopsPerElement, UF::transcendentalsPerElement, UF::bytesPerElement);
+					this->setBackend(BackendSpec{target.type});
+				}
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateCostSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_cost.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << CostSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 #include <unordered_set>
 #include <unordered_map>
@@ -25,6 +26,23 @@ using namespace clang::ast_matchers;
 extern std::unordered_set<std::string> AllowedFunctionNamesCalledInUFs;
 
 
+// The ret() call returned by a return statement, through copies and temporaries, if any
+static const CallExpr *returnedRetOf(const ReturnStmt *r)
+{
+	const Expr *e = r->getRetValue();
+	while (e)
+	{
+		e = e->IgnoreImplicit()->IgnoreParens();
+		auto *construct = dyn_cast<CXXConstructExpr>(e);
+		if (!construct)
+			break;
+		e = (construct->getNumArgs() == 1) ? construct->getArg(0) : nullptr;
+	}
+	auto *call = dyn_cast_or_null<CallExpr>(e);
+	const FunctionDecl *callee = call ? call->getDirectCallee() : nullptr;
+	return (callee && callee->getIdentifier() && callee->getName() == "ret") ? call : nullptr;
+}
+
 // This visitor traverses a userfunction AST node and finds references to other userfunctions and usertypes.
 class UserFunctionVisitor : public RecursiveASTVisitor<UserFunctionVisitor>
 {
@@ -86,6 +104,7 @@ public:
 		{
 			// Called function is explicitly allowed
 			SkePULog() << "Ignored reference to whitelisted function: '" << name << "'\n";
+			libraryCalls.push_back(c);
 		}
 		else
 		{
@@ -117,6 +136,26 @@ public:
 		return true;
 	}
 
+	// 1 / sqrt(x), a candidate for a reciprocal square root intrinsic in fast-math mode
+	bool VisitBinaryOperator(BinaryOperator *b)
+	{
+		if (b->getOpcode() != BO_Div)
+			return true;
+		
+		const Expr *lhs = b->getLHS()->IgnoreParenImpCasts();
+		bool one = false;
+		if (auto *f = dyn_cast<FloatingLiteral>(lhs))
+			one = f->getValueAsApproximateDouble() == 1.0;
+		else if (auto *i = dyn_cast<IntegerLiteral>(lhs))
+			one = i->getValue() == 1;
+		
+		// No parentheses around the call, the rewrite spans from the literal to the callee name
+		auto *call = dyn_cast<CallExpr>(b->getRHS()->IgnoreImpCasts());
+		if (one && call && call->getDirectCallee() && call->getDirectCallee()->getName() == "sqrt")
+			reciprocalSqrts.push_back(b);
+		return true;
+	}
+
 	bool VisitVarDecl(VarDecl *d)
 	{
 		if (auto *userType = HandleUserType(d->getType().getTypePtr()->getAsCXXRecordDecl()))
@@ -125,11 +164,19 @@ public:
 		return true;
 	}
 
+	bool VisitReturnStmt(ReturnStmt *r)
+	{
+		if (const CallExpr *ret = returnedRetOf(r))
+			returnedRets[ret] = r;
+		return true;
+	}
+
 
 	std::vector<std::pair<const CallExpr*, UserFunction*>> UFReferences{};
 	std::set<UserFunction*> ReferencedUFs{};
 	
 	std::set<const CallExpr*> ReferencedRets{};
+	std::map<const CallExpr*, const ReturnStmt*> returnedRets{};
 	std::set<CXXMemberCallExpr*> ReferencedGets{};
 
 	std::vector<std::pair<const TypeSourceInfo*, UserType*>> UTReferences{};
@@ -137,6 +184,9 @@ public:
 
 	std::vector<CXXOperatorCallExpr*> containerSubscripts{}, containerCalls{};
 	std::vector<CXXOperatorCallExpr*> operatorOverloads{};
+	
+	std::vector<const CallExpr*> libraryCalls{};
+	std::vector<const BinaryOperator*> reciprocalSqrts{};
 };
 
 
@@ -152,6 +202,16 @@ UserConstant::UserConstant(const VarDecl *v)
 }
 
 
+HalfPrecision halfPrecisionOf(const std::string &typeName)
+{
+	if (typeName.find("__nv_bfloat16") != std::string::npos)
+		return HalfPrecision::BFloat16;
+	if (typeName.find("__half") != std::string::npos)
+		return HalfPrecision::Half;
+	return HalfPrecision::None;
+}
+
+
 UserType::UserType(const CXXRecordDecl *t)
 : astDeclNode(t), name(t->getNameAsString()), requiresDoublePrecision(false)
 {
@@ -169,6 +229,8 @@ UserType::UserType(const CXXRecordDecl *t)
 	// End same as Param
 	
 	
+	this->soaLayout = std::find(SoATypes.begin(), SoATypes.end(), this->name) != SoATypes.end();
+	
 	if (const RecordDecl *r = dyn_cast<RecordDecl>(t))
 	{
 		for (const FieldDecl *f : r->fields())
@@ -179,7 +241,53 @@ UserType::UserType(const CXXRecordDecl *t)
 
 			if (typeName == "double")
 				this->requiresDoublePrecision = true;
+			this->requiresHalfPrecision |= (int)halfPrecisionOf(f->getType().getCanonicalType().getAsString());
+			
+			this->fields.push_back({fieldName, f->getType().getCanonicalType().getAsString()});
+			if (this->soaLayout && !f->getType()->isBuiltinType())
+				SkePUAbort("User type " + this->name + " in -soa has field '" + fieldName + "' of non-builtin type");
+		}
+	}
+	
+	// Field mapping for -soa types: the runtime scatters elements into one array per field with it
+	static const std::string SoAFieldsTemplate = R"~~~(
+	#ifndef SKEPU_SOA_FIELDS
+	#define SKEPU_SOA_FIELDS
+	namespace skepu { namespace soa { template<typename T> struct Fields; } }
+	#endif
+	namespace skepu { namespace soa { template<> struct Fields<{{TYPE_NAME}}>
+	{
+		static constexpr size_t count = {{FIELD_COUNT}};
+		static const char *name(size_t field) { static const char *names[] = { {{FIELD_NAMES}} }; return names[field]; }
+		static size_t size(size_t field) { static const size_t sizes[] = { {{FIELD_SIZES}} }; return sizes[field]; }
+		static void scatter(const {{TYPE_NAME}} *skepu_in, size_t skepu_n, void *const *skepu_fields)
+		{
+			for (size_t skepu_i = 0; skepu_i < skepu_n; ++skepu_i)
+			{
+				{{FIELD_SCATTER}}
+			}
 		}
+	}; } }
+	)~~~";
+	
+	if (this->soaLayout && !this->fields.empty())
+	{
+		std::stringstream SSNames, SSSizes, SSScatter;
+		for (size_t i = 0; i < this->fields.size(); ++i)
+		{
+			Field &field = this->fields[i];
+			SSNames << (i ? ", " : "") << "\"" << field.name << "\"";
+			SSSizes << (i ? ", " : "") << "sizeof(" << field.typeName << ")";
+			SSScatter << "static_cast<" << field.typeName << "*>(skepu_fields[" << i << "])[skepu_i] = skepu_in[skepu_i]." << field.name << ";\n";
+		}
+		GlobalRewriter.InsertText(t->getEndLoc().getLocWithOffset(2), templateString(SoAFieldsTemplate,
+		{
+			{"{{TYPE_NAME}}",     this->name},
+			{"{{FIELD_COUNT}}",   std::to_string(this->fields.size())},
+			{"{{FIELD_NAMES}}",   SSNames.str()},
+			{"{{FIELD_SIZES}}",   SSSizes.str()},
+			{"{{FIELD_SCATTER}}", SSScatter.str()}
+		}));
 	}
 
 	static const std::string RunTimeTypeNameFunc = R"~~~(
@@ -509,12 +617,16 @@ std::string UserFunction::RandomAccessParam::TypeNameOpenCL() const
 
 
 
+// The OpenCL vector type of skepu::complex::complex<float> or <double>
+static std::string complexTypeNameOpenCL(const std::string &typeName)
+{
+	return (typeName.find("double") != std::string::npos) ? "skepu_complex_double" : "skepu_complex_float";
+}
+
 std::string UserFunction::Param::typeNameOpenCL() const
 {
 	if (this->resolvedTypeName.find("skepu::complex") != std::string::npos)
-	{
-		return "skepu_complex_float"; // todo fix templated type
-	}
+		return complexTypeNameOpenCL(this->resolvedTypeName);
 	
 	
 	
@@ -524,9 +636,7 @@ std::string UserFunction::Param::typeNameOpenCL() const
 std::string UserFunction::RandomAccessParam::innerTypeNameOpenCL() const
 {
 	if (this->resolvedTypeName.find("skepu::complex") != std::string::npos)
-	{
-		return "skepu_complex_float"; // todo fix templated type
-	}
+		return complexTypeNameOpenCL(this->resolvedTypeName);
 	
 	
 	
@@ -561,6 +671,8 @@ std::string UserFunction::RandomAccessParam::TypeNameHost() const
 
 size_t UserFunction::RandomAccessParam::numKernelArgsCL() const
 {
+	if (this->deviceUnused)
+		return 0;
 	switch (this->containerType)
 	{
 		case ContainerType::Vector:
@@ -696,6 +808,10 @@ UserFunction::UserFunction(FunctionDecl *f)
 				this->resolvedReturnTypeName = arg.resolvedTypeName;
 	}
 	
+	// Values of trivially copyable types can be moved between registers bitwise (e.g., warp shuffles)
+	if (this->multipleReturnTypes.empty())
+		this->returnTypeTriviallyCopyable = f->getReturnType().getCanonicalType().isTriviallyCopyableType(f->getASTContext());
+	
 	// remove 'struct'
 	replaceTextInString(this->resolvedReturnTypeName, "struct ", "");
 	
@@ -727,6 +843,7 @@ UserFunction::UserFunction(FunctionDecl *f)
 	this->UTReferences = UFVisitor.UTReferences;
 	
 	this->ReferencedRets = UFVisitor.ReferencedRets;
+	this->returnedRets = UFVisitor.returnedRets;
 	this->ReferencedGets = UFVisitor.ReferencedGets;
 
 	this->containerSubscripts = UFVisitor.containerSubscripts;
@@ -734,6 +851,9 @@ UserFunction::UserFunction(FunctionDecl *f)
 	
 	this->operatorOverloads = UFVisitor.operatorOverloads;
 	
+	this->libraryCalls = UFVisitor.libraryCalls;
+	this->reciprocalSqrts = UFVisitor.reciprocalSqrts;
+	
 	SkePULog() << "| Traversal analysis summary for UF " << this->uniqueName << "\n";
 	SkePULog() << "| " << this->ReferencedUFs.size() << " unique referenced UFs\n";
 	SkePULog() << "| " << this->UFReferences.size() << " total UF references\n";
@@ -750,6 +870,88 @@ UserFunction::UserFunction(FunctionDecl *f)
 	for (UserType *UT : this->ReferencedUTs)
 		if (UT->requiresDoublePrecision)
 			this->requiresDoublePrecision = true;
+	
+	// 16-bit floats anywhere in the signature, including container element types
+	this->requiresHalfPrecision |= (int)halfPrecisionOf(f->getReturnType().getCanonicalType().getAsString());
+	for (const ParmVarDecl *p : f->parameters())
+		this->requiresHalfPrecision |= (int)halfPrecisionOf(p->getOriginalType().getCanonicalType().getAsString());
+	for (UserType *UT : this->ReferencedUTs)
+		this->requiresHalfPrecision |= UT->requiresHalfPrecision;
+}
+
+UserFunction::UserFunction(UserFunction *producer, UserFunction *consumer, size_t consumedParam)
+: UserFunction(*consumer)
+{
+	this->uniqueName = consumer->uniqueName + "_after_" + producer->uniqueName;
+	SkePULog() << "### [UF] Created composite UserFunction object with unique name '" << this->uniqueName << "'\n";
+	
+	this->fusedProducer = producer;
+	this->fusedParam = new UserFunction::Param(consumer->elwiseParams[consumedParam]);
+	this->ReferencedUFs.insert(producer);
+	this->requiresDoublePrecision = consumer->requiresDoublePrecision || producer->requiresDoublePrecision;
+	this->requiresHalfPrecision = consumer->requiresHalfPrecision | producer->requiresHalfPrecision;
+	
+	// The producer parameters take the place of the consumed one, renamed to avoid clashes with the consumer
+	std::vector<UserFunction::Param> producerParams;
+	for (UserFunction::Param param : producer->elwiseParams)
+	{
+		param.name = "skepu_fused_" + producer->uniqueName + "_" + param.name;
+		this->fusedProducerArgs.push_back(param.name);
+		producerParams.push_back(param);
+	}
+	
+	this->elwiseParams.erase(this->elwiseParams.begin() + consumedParam);
+	this->elwiseParams.insert(this->elwiseParams.begin() + consumedParam, producerParams.begin(), producerParams.end());
+	this->Varity = this->elwiseParams.size();
+}
+
+UserFunction::UserFunction(UserFunction *mapFunc, std::vector<UserFunction*> reducers)
+: UserFunction(*reducers[0])
+{
+	this->uniqueName = "multi_reduce";
+	for (UserFunction *reducer : reducers)
+		this->uniqueName += "_" + reducer->uniqueName;
+	SkePULog() << "### [UF] Created composite reduce UserFunction object with unique name '" << this->uniqueName << "'\n";
+	
+	this->multiReduceMap = mapFunc;
+	this->multiReduceParts = reducers;
+	this->rawReturnTypeName = mapFunc->rawReturnTypeName;
+	this->resolvedReturnTypeName = mapFunc->resolvedReturnTypeName;
+	this->multipleReturnTypes = mapFunc->multipleReturnTypes;
+	
+	// The body is generated from the parts, nothing from the first reducer's AST is rewritten
+	this->UFReferences.clear();
+	this->UTReferences.clear();
+	this->ReferencedRets.clear();
+	this->returnedRets.clear();
+	this->ReferencedGets.clear();
+	this->containerSubscripts.clear();
+	this->containerCalls.clear();
+	this->operatorOverloads.clear();
+	this->libraryCalls.clear();
+	this->reciprocalSqrts.clear();
+	this->ReferencedUFs = std::set<UserFunction*>(reducers.begin(), reducers.end());
+	this->ReferencedUTs = mapFunc->ReferencedUTs;
+	this->requiresDoublePrecision = mapFunc->requiresDoublePrecision;
+	this->requiresHalfPrecision = mapFunc->requiresHalfPrecision;
+	this->returnTypeTriviallyCopyable = true;
+	for (UserFunction *reducer : reducers)
+	{
+		this->returnTypeTriviallyCopyable = this->returnTypeTriviallyCopyable && reducer->returnTypeTriviallyCopyable;
+		this->requiresDoublePrecision = this->requiresDoublePrecision || reducer->requiresDoublePrecision;
+		this->requiresHalfPrecision |= reducer->requiresHalfPrecision;
+	}
+	
+	// Both operands have the map's multi-return type
+	const std::string names[] = {"skepu_multi_a", "skepu_multi_b"};
+	for (size_t i = 0; i < 2; ++i)
+	{
+		UserFunction::Param &param = this->elwiseParams[i];
+		param.name = names[i];
+		param.rawTypeName = param.resolvedTypeName = param.fullTypeName = param.unqualifiedFullTypeName = mapFunc->resolvedReturnTypeName;
+		param.escapedTypeName = mapFunc->multiReturnTypeNameGPU();
+		param.isReferenceType = param.isLValueReference = param.isRValueReference = false;
+	}
 }
 
 std::string UserFunction::funcNameCUDA()
@@ -760,9 +962,7 @@ std::string UserFunction::funcNameCUDA()
 std::string UserFunction::returnTypeNameOpenCL()
 {
 	if (this->resolvedReturnTypeName.find("skepu::complex") != std::string::npos)
-	{
-		return "skepu_complex_float"; // todo fix templated type
-	}
+		return complexTypeNameOpenCL(this->resolvedReturnTypeName);
 	
 	return this->rawReturnTypeName;
 }
@@ -809,8 +1009,338 @@ bool UserFunction::refersTo(UserFunction &other)
 	return false;
 }
 
+// Counts the references to one parameter and collects the fields read through member accesses on it
+class ParamFieldUseVisitor : public RecursiveASTVisitor<ParamFieldUseVisitor>
+{
+public:
+	const ParmVarDecl *param;
+	size_t references = 0;
+	size_t memberAccesses = 0;
+	std::set<std::string> fields;
+	
+	ParamFieldUseVisitor(const ParmVarDecl *p): param(p) {}
+	
+	bool VisitDeclRefExpr(DeclRefExpr *e)
+	{
+		if (e->getDecl() == this->param)
+			this->references++;
+		return true;
+	}
+	
+	bool VisitMemberExpr(MemberExpr *e)
+	{
+		auto *base = dyn_cast<DeclRefExpr>(e->getBase()->IgnoreParenImpCasts());
+		if (base && base->getDecl() == this->param && isa<FieldDecl>(e->getMemberDecl()))
+		{
+			this->memberAccesses++;
+			this->fields.insert(e->getMemberDecl()->getNameAsString());
+		}
+		return true;
+	}
+};
+
+bool UserFunction::readsOnlyFields(const Param &param, std::set<std::string> &fields)
+{
+	ParamFieldUseVisitor visitor(param.astDeclNode);
+	visitor.TraverseStmt(this->astDeclNode->getBody());
+	
+	// Any other use (passing it on, copying, taking its address) needs the whole element
+	if (visitor.references != visitor.memberAccesses)
+		return false;
+	fields = visitor.fields;
+	return true;
+}
+
+bool UserFunction::readsField(const Param &param, const std::string &field)
+{
+	ParamFieldUseVisitor visitor(param.astDeclNode);
+	visitor.TraverseStmt(this->astDeclNode->getBody());
+	return visitor.fields.count(field) > 0;
+}
+
+// Counts the element accesses on a container parameter and those that are targets of plain assignments
+class ParamElementUseVisitor : public RecursiveASTVisitor<ParamElementUseVisitor>
+{
+public:
+	const ParmVarDecl *param;
+	size_t references = 0;
+	size_t memberAccesses = 0;
+	size_t elementAccesses = 0;
+	size_t elementStores = 0;
+	
+	ParamElementUseVisitor(const ParmVarDecl *p): param(p) {}
+	
+	bool isElementAccess(const Expr *e)
+	{
+		auto *call = dyn_cast<CXXOperatorCallExpr>(e->IgnoreParenImpCasts());
+		if (!call || (call->getOperator() != OO_Subscript && call->getOperator() != OO_Call) || call->getNumArgs() == 0)
+			return false;
+		auto *base = dyn_cast<DeclRefExpr>(call->getArg(0)->IgnoreParenImpCasts());
+		return base && base->getDecl() == this->param;
+	}
+	
+	bool VisitDeclRefExpr(DeclRefExpr *e)
+	{
+		if (e->getDecl() == this->param)
+			this->references++;
+		return true;
+	}
+	
+	bool VisitMemberExpr(MemberExpr *e)
+	{
+		auto *base = dyn_cast<DeclRefExpr>(e->getBase()->IgnoreParenImpCasts());
+		if (base && base->getDecl() == this->param && isa<FieldDecl>(e->getMemberDecl()))
+			this->memberAccesses++;
+		return true;
+	}
+	
+	bool VisitCXXOperatorCallExpr(CXXOperatorCallExpr *e)
+	{
+		if (this->isElementAccess(e))
+			this->elementAccesses++;
+		else if (e->getOperator() == OO_Equal && e->getNumArgs() == 2 && this->isElementAccess(e->getArg(0)))
+			this->elementStores++;
+		return true;
+	}
+	
+	bool VisitBinaryOperator(BinaryOperator *e)
+	{
+		if (e->getOpcode() == BO_Assign && this->isElementAccess(e->getLHS()))
+			this->elementStores++;
+		return true;
+	}
+};
+
+bool UserFunction::readsElements(const Param &param)
+{
+	ParamElementUseVisitor visitor(param.astDeclNode);
+	visitor.TraverseStmt(this->astDeclNode->getBody());
+	
+	// Reading the size fields needs no contents, any other use of the parameter may read them
+	return visitor.references != visitor.memberAccesses + visitor.elementAccesses
+		|| visitor.elementAccesses != visitor.elementStores;
+}
+
+bool UserFunction::accessesOnlyElements(const Param &param)
+{
+	ParamElementUseVisitor visitor(param.astDeclNode);
+	visitor.TraverseStmt(this->astDeclNode->getBody());
+	return visitor.references == visitor.memberAccesses + visitor.elementAccesses;
+}
+
+bool UserFunction::storesOutputs()
+{
+	if (this->multipleReturnTypes.empty() || this->multiReduceMap || this->fusedProducer || this->ReferencedRets.empty())
+		return false;
+	
+	// The returns are rewritten in place, so they have to be spelled in the file, outside of macros
+	for (const CallExpr *ret : this->ReferencedRets)
+	{
+		auto returned = this->returnedRets.find(ret);
+		if (returned == this->returnedRets.end() || ret->getNumArgs() != this->multipleReturnTypes.size()
+			|| returned->second->getReturnLoc().isMacroID() || ret->getRParenLoc().isMacroID())
+			return false;
+		for (const Expr *arg : ret->arguments())
+			if (arg->getBeginLoc().isMacroID() || arg->getEndLoc().isMacroID())
+				return false;
+	}
+	return true;
+}
+
+// Counts the references to one parameter outside of the arguments of the host-only variant macros
+class ParamDeviceUseVisitor : public RecursiveASTVisitor<ParamDeviceUseVisitor>
+{
+public:
+	const ParmVarDecl *param;
+	const SourceManager &SM;
+	const LangOptions &LangOpts;
+	size_t deviceReferences = 0;
+	
+	ParamDeviceUseVisitor(const ParmVarDecl *p, const ASTContext &Context): param(p), SM(Context.getSourceManager()), LangOpts(Context.getLangOpts()) {}
+	
+	bool hostOnly(SourceLocation loc)
+	{
+		for (; loc.isMacroID(); loc = SM.getImmediateMacroCallerLoc(loc))
+		{
+			StringRef macro = Lexer::getImmediateMacroName(loc, SM, LangOpts);
+			if (macro == "VARIANT_CPU" || macro == "VARIANT_OPENMP")
+				return true;
+		}
+		return false;
+	}
+	
+	bool VisitDeclRefExpr(DeclRefExpr *e)
+	{
+		if (e->getDecl() == this->param && !this->hostOnly(e->getLocation()))
+			this->deviceReferences++;
+		return true;
+	}
+};
+
+bool UserFunction::usedOnDevice(const Param &param)
+{
+	ParamDeviceUseVisitor visitor(param.astDeclNode, this->astDeclNode->getASTContext());
+	visitor.TraverseStmt(this->astDeclNode->getBody());
+	return visitor.deviceReferences > 0;
+}
+
+// Loops without a literal trip count are assumed to run this many times
+static const double UnknownTripCount = 16;
+
+static const std::set<std::string> TranscendentalFunctions
+{
+	"sin", "cos", "tan", "asin", "acos", "atan", "atan2", "sinh", "cosh", "tanh", "asinh", "acosh", "atanh",
+	"exp", "exp2", "expm1", "log", "log2", "log10", "log1p", "pow", "cbrt", "erf", "erfc", "tgamma", "lgamma"
+};
+
+static double typeBytes(ASTContext &ctx, QualType type)
+{
+	if (type.isNull())
+		return 0;
+	type = type.getNonReferenceType();
+	if (type->isVoidType())
+		return 0;
+	// Template parameters and incomplete types are taken as one word
+	if (type->isDependentType() || type->isIncompleteType())
+		return 4;
+	return ctx.getTypeSizeInChars(type).getQuantity();
+}
+
+// Iterations of for (int i = a; i < b; ++i) and its variants with literal bounds
+static double tripCount(const ForStmt *loop)
+{
+	auto *init = dyn_cast_or_null<DeclStmt>(loop->getInit());
+	auto *cond = dyn_cast_or_null<BinaryOperator>(loop->getCond());
+	if (!init || !init->isSingleDecl() || !cond)
+		return UnknownTripCount;
+	auto *var = dyn_cast<VarDecl>(init->getSingleDecl());
+	auto *lhs = dyn_cast<DeclRefExpr>(cond->getLHS()->IgnoreParenImpCasts());
+	auto *first = var && var->getInit() ? dyn_cast<IntegerLiteral>(var->getInit()->IgnoreParenImpCasts()) : nullptr;
+	auto *last = dyn_cast<IntegerLiteral>(cond->getRHS()->IgnoreParenImpCasts());
+	if (!first || !last || !lhs || lhs->getDecl() != var)
+		return UnknownTripCount;
+	
+	double a = first->getValue().getLimitedValue(), b = last->getValue().getLimitedValue();
+	switch (cond->getOpcode())
+	{
+	case BO_LT: case BO_NE: return std::max(0.0, b - a);
+	case BO_LE: return std::max(0.0, b - a + 1);
+	case BO_GT: return std::max(0.0, a - b);
+	case BO_GE: return std::max(0.0, a - b + 1);
+	default: return UnknownTripCount;
+	}
+}
+
+class CostEstimator
+{
+public:
+	UserFunction &uf;
+	ASTContext &ctx;
+	UserFunction::Cost cost;
+	
+	CostEstimator(UserFunction &uf): uf(uf), ctx(uf.astDeclNode->getASTContext()) {}
+	
+	void add(const Stmt *s, double weight)
+	{
+		if (!s)
+			return;
+		
+		if (auto *loop = dyn_cast<ForStmt>(s))
+		{
+			double trips = tripCount(loop);
+			this->add(loop->getInit(), weight);
+			this->add(loop->getCond(), weight * trips);
+			this->add(loop->getInc(), weight * trips);
+			this->add(loop->getBody(), weight * trips);
+			return;
+		}
+		if (isa<WhileStmt>(s) || isa<DoStmt>(s))
+		{
+			for (const Stmt *child : s->children())
+				this->add(child, weight * UnknownTripCount);
+			return;
+		}
+		
+		if (auto *op = dyn_cast<BinaryOperator>(s))
+		{
+			auto opcode = op->getOpcode();
+			if (op->isAdditiveOp() || op->isMultiplicativeOp() || opcode == BO_MulAssign || opcode == BO_DivAssign
+				|| opcode == BO_RemAssign || opcode == BO_AddAssign || opcode == BO_SubAssign)
+				this->cost.flops += weight;
+		}
+		else if (auto *op = dyn_cast<CXXOperatorCallExpr>(s))
+		{
+			auto ooc = op->getOperator();
+			if ((ooc == OO_Subscript || ooc == OO_Call) && op->getNumArgs() > 0)
+				this->cost.bytes += weight * this->elementBytes(op->getArg(0));
+			else if (ooc == OO_Plus || ooc == OO_Minus || ooc == OO_Star || ooc == OO_Slash
+				|| ooc == OO_PlusEqual || ooc == OO_MinusEqual || ooc == OO_StarEqual || ooc == OO_SlashEqual)
+				this->cost.flops += weight;
+		}
+		else if (auto *call = dyn_cast<CallExpr>(s))
+		{
+			const FunctionDecl *callee = call->getDirectCallee();
+			std::string name = callee ? callee->getNameAsString() : "";
+			if (!name.empty() && name.back() == 'f' && TranscendentalFunctions.count(name.substr(0, name.size() - 1)))
+				name.pop_back();
+			if (TranscendentalFunctions.count(name))
+				this->cost.transcendentals += weight;
+			
+			for (auto &ref : this->uf.UFReferences)
+				if (ref.first == call)
+				{
+					// Arguments of a called user function are passed by value, only its own work counts
+					CostEstimator called(*ref.second);
+					called.add(ref.second->astDeclNode->getBody(), weight);
+					this->cost.flops += called.cost.flops;
+					this->cost.transcendentals += called.cost.transcendentals;
+					this->cost.bytes += called.cost.bytes;
+				}
+		}
+		
+		for (const Stmt *child : s->children())
+			this->add(child, weight);
+	}
+	
+private:
+	double elementBytes(const Expr *container)
+	{
+		auto *ref = dyn_cast<DeclRefExpr>(container->IgnoreParenImpCasts());
+		if (!ref)
+			return 0;
+		for (UserFunction::RandomAccessParam &param : this->uf.anyContainerParams)
+			if (param.astDeclNode == ref->getDecl() && param.containedType)
+				return typeBytes(this->ctx, QualType(param.containedType, 0));
+		return 0;
+	}
+};
+
+UserFunction::Cost UserFunction::estimateCost()
+{
+	CostEstimator estimator(*this);
+	estimator.add(this->astDeclNode->getBody(), 1);
+	Cost cost = estimator.cost;
+	
+	ASTContext &ctx = this->astDeclNode->getASTContext();
+	for (Param &param : this->elwiseParams)
+		cost.bytes += typeBytes(ctx, param.astDeclNode->getType());
+	cost.bytes += typeBytes(ctx, this->astDeclNode->getReturnType());
+	return cost;
+}
+
+size_t UserFunction::paramCount()
+{
+	if (this->fusedProducer)
+		return this->astDeclNode->param_size() - 1 + this->fusedProducer->elwiseParams.size();
+	return this->astDeclNode->param_size();
+}
+
 void UserFunction::updateArgLists(size_t arity, size_t Harity)
 {
+	// The argument lists of composite user functions are fixed on construction
+	if (this->fusedProducer || this->multiReduceMap)
+		return;
+	
 	SkePULog() << "Trying with arity: " << arity << "\n";
 	
 	this->Varity = arity;
@@ -863,6 +1393,10 @@ void UserFunction::updateArgLists(size_t arity, size_t Harity)
 
 	for (auto &param : this->anyScalarParams)
 		scanForType(param.type);
+	
+	if (PruneDeviceArgs)
+		for (auto &param : this->anyContainerParams)
+			param.deviceUnused = !this->usedOnDevice(param);
 
 	SkePULog() << "Deduced indexed: " << (this->indexParam ? "yes" : "no") << "\n"
 		<< "Found random parameter: " << (this->randomParam ? "yes" : "no") << "\n" 
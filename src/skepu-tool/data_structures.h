@@ -17,6 +17,16 @@ enum class Backend
 	CPU, OpenMP, CUDA, OpenCL,
 };
 
+// 16-bit floating point element types: __half (cuda_fp16.h) and __nv_bfloat16 (cuda_bf16.h)
+enum class HalfPrecision
+{
+	None  = 0,
+	Half  = 1,
+	BFloat16 = 2,
+};
+
+HalfPrecision halfPrecisionOf(const std::string &typeName);
+
 enum class AccessMode
 {
 	Read,
@@ -47,6 +57,12 @@ struct Skeleton
 		Map,
 		Reduce1D,
 		Reduce2D,
+		ReduceByKey,
+		Histogram,
+		Sort,
+		Filter,
+		Gather,
+		Scatter,
 		MapReduce,
 		MapPairs,
 		MapPairsReduce,
@@ -87,6 +103,17 @@ public:
 	const clang::Type *type;
 	std::string typeNameOpenCL;
 	bool requiresDoublePrecision;
+	int requiresHalfPrecision = 0; // HalfPrecision flags
+	
+	struct Field
+	{
+		std::string name;
+		std::string typeName;
+	};
+	
+	// Declaration order; soaLayout is set for types in -soa whose fields are all of builtin type
+	std::vector<Field> fields;
+	bool soaLayout = false;
 
 	UserType(const clang::CXXRecordDecl *t);
 };
@@ -122,6 +149,9 @@ public:
 		bool isRValueReference = false;
 		bool isLValueReference = false;
 		
+		// Set by -prune-device-args for container parameters that only the CPU and OpenMP variants use
+		bool deviceUnused = false;
+		
 		static bool constructibleFrom(const clang::ParmVarDecl *p);
 		
 		Param(const clang::ParmVarDecl *p);
@@ -156,6 +186,14 @@ public:
 		RegionParam(const clang::ParmVarDecl *p);
 	};
 	
+	// Approximate work of one evaluation, see estimateCost
+	struct Cost
+	{
+		double flops = 0;
+		double transcendentals = 0;
+		double bytes = 0;
+	};
+
 	struct RandomParam: Param
 	{
 		static bool constructibleFrom(const clang::ParmVarDecl *p);
@@ -166,8 +204,32 @@ public:
 	};
 
 	void updateArgLists(size_t arity, size_t Harity = 0);
+	size_t paramCount();
 
 	bool refersTo(UserFunction &other);
+	
+	// Fields of a user-type parameter that the body reads; false if the parameter is also used as a whole
+	bool readsOnlyFields(const Param &param, std::set<std::string> &fields);
+	
+	// Whether the body reads field through a member access on param
+	bool readsField(const Param &param, const std::string &field);
+	
+	// Whether the body uses the elements of a container parameter other than as the target of plain assignments
+	bool readsElements(const Param &param);
+
+	// Whether the body only indexes param and reads its fields, without passing it on
+	bool accessesOnlyElements(const Param &param);
+	
+	// Whether the GPU variants of a multi-return function can store each result through an output pointer instead
+	// of returning the aggregate: every ret() is returned directly, outside of macros
+	bool storesOutputs();
+	
+	// Whether the body refers to param outside of VARIANT_CPU and VARIANT_OPENMP blocks
+	bool usedOnDevice(const Param &param);
+	
+	// Arithmetic operations, transcendental calls and bytes moved per evaluation: the elementwise arguments,
+	// the results and the container elements accessed. Loop bodies count by their trip count.
+	Cost estimateCost();
 
 	std::string funcNameCUDA();
 	size_t numKernelArgsCL();
@@ -206,6 +268,7 @@ public:
 	
 	
 	std::set<const clang::CallExpr*> ReferencedRets{};
+	std::map<const clang::CallExpr*, const clang::ReturnStmt*> returnedRets{};
 	std::set<clang::CXXMemberCallExpr*> ReferencedGets{};
 
 	std::vector<std::pair<const clang::TypeSourceInfo*, UserType*>> UTReferences{};
@@ -214,6 +277,19 @@ public:
 
 	std::vector<clang::CXXOperatorCallExpr*> containerSubscripts{}, containerCalls{};
 	std::vector<clang::CXXOperatorCallExpr*> operatorOverloads{};
+	
+	// Calls to whitelisted library functions, rewritten to intrinsics by -fast-math
+	std::vector<const clang::CallExpr*> libraryCalls{};
+	std::vector<const clang::BinaryOperator*> reciprocalSqrts{};
+
+	// MatCol parameters read from a transposed copy of the matrix by the CPU and OpenMP variants (-transpose-matcol)
+	bool transposedMatCol = false;
+
+	// Ten3 and Ten4 parameters read from a brick-ordered copy of the tensor by the CPU and OpenMP variants (-brick-tensors)
+	bool brickedTensors = false;
+
+	// Overlap of the region parameter fixed by -static-overlap for the instance being generated, empty if not fixed
+	std::vector<int> staticOverlap {};
 
 	bool fromTemplate = false;
 	bool indexed1D = false;
@@ -221,9 +297,24 @@ public:
 	bool indexed3D = false;
 	bool indexed4D = false;
 	bool requiresDoublePrecision;
+	int requiresHalfPrecision = 0; // HalfPrecision flags
+	bool returnTypeTriviallyCopyable = false;
+	
+	// Composite user functions (Map chain fusion): the consumer parameter fusedParam is
+	// computed by calling fusedProducer on its (renamed) elementwise parameters
+	UserFunction *fusedProducer = nullptr;
+	Param *fusedParam = nullptr;
+	std::vector<std::string> fusedProducerArgs {};
+	
+	// Composite reduce functions (multi-output MapReduce): element k of the multi-return
+	// map result multiReduceMap is combined by multiReduceParts[k]
+	UserFunction *multiReduceMap = nullptr;
+	std::vector<UserFunction*> multiReduceParts {};
 
 
 	UserFunction(clang::FunctionDecl *f);
 	UserFunction(clang::CXXMethodDecl *f, clang::VarDecl *d);
+	UserFunction(UserFunction *producer, UserFunction *consumer, size_t consumedParam);
+	UserFunction(UserFunction *mapFunc, std::vector<UserFunction*> reducers);
 	
 };
@@ -0,0 +1,370 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Caching allocator for the device buffers of containers, enabled by -device-pool. Creating and destroying
+ * temporary containers otherwise calls cudaMalloc/cudaFree or clCreateBuffer/clReleaseMemObject each time,
+ * which is slow and synchronizes the device. The main file defines SKEPU_DEVICE_POOL to the cap in bytes and
+ * includes this header before the SkePU headers, whose device pointers then allocate through it.
+ *
+ * Requests are rounded up to a size class: powers of two up to 1 MiB, multiples of 1 MiB above. A released
+ * buffer is kept per device (CUDA) or context (OpenCL) for reuse by the next request of its class. Buffers
+ * remember the stream or queue that released them. A CUDA buffer taken on another stream makes that stream
+ * wait for an event recorded on release; an OpenCL buffer taken on another queue first finishes the old one.
+ * Cached bytes beyond the cap are freed at once, smallest class first. A failed allocation trims the pool and
+ * is retried. With -device-eviction, it then evicts resident copies of other containers through
+ * skepu::eviction and retries until the buffer fits or nothing is left to evict. setCap changes the cap at run
+ * time, trim frees every cached buffer.
+ */
+static const char *DevicePoolSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifdef SKEPU_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef SKEPU_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace skepu
+{
+	namespace pool
+	{
+		inline size_t sizeClass(size_t bytes)
+		{
+			constexpr size_t MiB = size_t(1) << 20;
+			if (bytes > MiB)
+				return (bytes + MiB - 1) / MiB * MiB;
+			size_t size = 256;
+			while (size < bytes)
+				size *= 2;
+			return size;
+		}
+
+		// Evicts resident copies of a device or context, returning whether anything was freed
+		inline bool evict(std::uintptr_t domain, size_t bytes)
+		{
+#ifdef SKEPU_EVICTION
+			return skepu::eviction::reclaim(domain, bytes) > 0;
+#else
+			(void)domain;
+			(void)bytes;
+			return false;
+#endif
+		}
+
+		// Cached buffers of one device or context, by size class. Handle is the buffer, Queue a stream or queue.
+		template<typename Handle, typename Queue, typename Fence>
+		struct Bins
+		{
+			struct Entry
+			{
+				Handle handle;
+				Queue queue;
+				Fence fence;
+			};
+
+			std::map<size_t, std::vector<Entry>> free;
+			std::map<Handle, size_t> sizes;
+			size_t cached = 0;
+		};
+
+		class Settings
+		{
+		public:
+			static size_t &cap()
+			{
+				static size_t bytes = SKEPU_DEVICE_POOL;
+				return bytes;
+			}
+		};
+
+#ifdef SKEPU_CUDA
+		class CUDA
+		{
+		public:
+			static CUDA &instance()
+			{
+				static CUDA pool;
+				return pool;
+			}
+
+			void *allocate(size_t bytes, cudaStream_t stream)
+			{
+				int device = 0;
+				cudaGetDevice(&device);
+				size_t size = sizeClass(bytes);
+				{
+					std::lock_guard<std::mutex> guard(this->lock);
+					Device &bins = this->devices[device];
+					auto it = bins.free.find(size);
+					if (it != bins.free.end() && !it->second.empty())
+					{
+						// Prefer a buffer released on the same stream, it needs no synchronization
+						auto &entries = it->second;
+						size_t pick = entries.size() - 1;
+						for (size_t k = 0; k < entries.size(); ++k)
+							if (entries[k].queue == stream)
+								pick = k;
+						Device::Entry entry = entries[pick];
+						entries.erase(entries.begin() + pick);
+						bins.cached -= size;
+						if (entry.queue != stream)
+							cudaStreamWaitEvent(stream, entry.fence, 0);
+						cudaEventDestroy(entry.fence);
+						return entry.handle;
+					}
+				}
+
+				void *ptr = nullptr;
+				if (cudaMalloc(&ptr, size) != cudaSuccess)
+				{
+					cudaGetLastError();
+					this->trim(device);
+					while (cudaMalloc(&ptr, size) != cudaSuccess)
+					{
+						cudaGetLastError();
+						ptr = nullptr;
+						// Evicted copies release their buffers into the pool, so it is trimmed again
+						if (!evict(device, size))
+							return nullptr;
+						this->trim(device);
+					}
+				}
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->devices[device].sizes[ptr] = size;
+				return ptr;
+			}
+
+			void release(void *ptr, cudaStream_t stream)
+			{
+				if (!ptr)
+					return;
+				int device = 0;
+				cudaGetDevice(&device);
+				std::lock_guard<std::mutex> guard(this->lock);
+				Device &bins = this->devices[device];
+				auto found = bins.sizes.find(ptr);
+				if (found == bins.sizes.end())
+				{
+					cudaFree(ptr);
+					return;
+				}
+				size_t size = found->second;
+				if (size > Settings::cap())
+				{
+					bins.sizes.erase(found);
+					cudaFree(ptr);
+					return;
+				}
+
+				cudaEvent_t fence;
+				cudaEventCreateWithFlags(&fence, cudaEventDisableTiming);
+				cudaEventRecord(fence, stream);
+				bins.free[size].push_back({ptr, stream, fence});
+				bins.cached += size;
+				this->shrink(bins, Settings::cap());
+			}
+
+			// Frees the cached buffers of device, or of every device if it is negative
+			void trim(int device = -1)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				int current = 0;
+				cudaGetDevice(&current);
+				for (auto &pair : this->devices)
+					if (device < 0 || pair.first == device)
+					{
+						cudaSetDevice(pair.first);
+						this->shrink(pair.second, 0);
+					}
+				cudaSetDevice(current);
+			}
+
+			size_t cached(int device)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				return this->devices[device].cached;
+			}
+
+		private:
+			using Device = Bins<void*, cudaStream_t, cudaEvent_t>;
+			std::mutex lock;
+			std::map<int, Device> devices;
+
+			void shrink(Device &bins, size_t limit)
+			{
+				for (auto it = bins.free.begin(); bins.cached > limit && it != bins.free.end(); ++it)
+					while (bins.cached > limit && !it->second.empty())
+					{
+						Device::Entry entry = it->second.front();
+						it->second.erase(it->second.begin());
+						cudaEventSynchronize(entry.fence);
+						cudaEventDestroy(entry.fence);
+						cudaFree(entry.handle);
+						bins.sizes.erase(entry.handle);
+						bins.cached -= it->first;
+					}
+			}
+		};
+
+		inline void *allocate_CU(size_t bytes, cudaStream_t stream = 0) { return CUDA::instance().allocate(bytes, stream); }
+		inline void release_CU(void *ptr, cudaStream_t stream = 0) { CUDA::instance().release(ptr, stream); }
+#endif
+
+#ifdef SKEPU_OPENCL
+		class OpenCL
+		{
+		public:
+			static OpenCL &instance()
+			{
+				static OpenCL pool;
+				return pool;
+			}
+
+			cl_mem allocate(cl_context context, cl_command_queue queue, cl_mem_flags flags, size_t bytes, cl_int *err)
+			{
+				size_t size = sizeClass(bytes);
+				{
+					std::lock_guard<std::mutex> guard(this->lock);
+					Context &bins = this->contexts[{context, flags}];
+					auto it = bins.free.find(size);
+					if (it != bins.free.end() && !it->second.empty())
+					{
+						auto &entries = it->second;
+						size_t pick = entries.size() - 1;
+						for (size_t k = 0; k < entries.size(); ++k)
+							if (entries[k].queue == queue)
+								pick = k;
+						Context::Entry entry = entries[pick];
+						entries.erase(entries.begin() + pick);
+						bins.cached -= size;
+						if (entry.queue != queue)
+							clFinish(entry.queue);
+						if (err) *err = CL_SUCCESS;
+						return entry.handle;
+					}
+				}
+
+				cl_int status;
+				cl_mem buffer = clCreateBuffer(context, flags, size, nullptr, &status);
+				if (status == CL_MEM_OBJECT_ALLOCATION_FAILURE || status == CL_OUT_OF_RESOURCES)
+				{
+					this->trim(context);
+					buffer = clCreateBuffer(context, flags, size, nullptr, &status);
+					while ((status == CL_MEM_OBJECT_ALLOCATION_FAILURE || status == CL_OUT_OF_RESOURCES)
+						&& evict(reinterpret_cast<std::uintptr_t>(context), size))
+					{
+						this->trim(context);
+						buffer = clCreateBuffer(context, flags, size, nullptr, &status);
+					}
+				}
+				if (err) *err = status;
+				if (status != CL_SUCCESS)
+					return nullptr;
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->contexts[{context, flags}].sizes[buffer] = size;
+				return buffer;
+			}
+
+			void release(cl_context context, cl_command_queue queue, cl_mem_flags flags, cl_mem buffer)
+			{
+				if (!buffer)
+					return;
+				std::lock_guard<std::mutex> guard(this->lock);
+				Context &bins = this->contexts[{context, flags}];
+				auto found = bins.sizes.find(buffer);
+				if (found == bins.sizes.end() || found->second > Settings::cap())
+				{
+					if (found != bins.sizes.end())
+						bins.sizes.erase(found);
+					clReleaseMemObject(buffer);
+					return;
+				}
+				bins.free[found->second].push_back({buffer, queue, 0});
+				bins.cached += found->second;
+				this->shrink(bins, Settings::cap());
+			}
+
+			// Frees the cached buffers of context, or of every context if it is null
+			void trim(cl_context context = nullptr)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				for (auto &pair : this->contexts)
+					if (!context || pair.first.first == context)
+						this->shrink(pair.second, 0);
+			}
+
+		private:
+			using Context = Bins<cl_mem, cl_command_queue, int>;
+			std::mutex lock;
+			std::map<std::pair<cl_context, cl_mem_flags>, Context> contexts;
+
+			void shrink(Context &bins, size_t limit)
+			{
+				for (auto it = bins.free.begin(); bins.cached > limit && it != bins.free.end(); ++it)
+					while (bins.cached > limit && !it->second.empty())
+					{
+						// The runtime keeps the buffer alive until the commands using it have completed
+						clReleaseMemObject(it->second.front().handle);
+						bins.sizes.erase(it->second.front().handle);
+						it->second.erase(it->second.begin());
+						bins.cached -= it->first;
+					}
+			}
+		};
+
+		inline cl_mem allocate_CL(cl_context context, cl_command_queue queue, cl_mem_flags flags, size_t bytes, cl_int *err)
+		{
+			return OpenCL::instance().allocate(context, queue, flags, bytes, err);
+		}
+		inline void release_CL(cl_context context, cl_command_queue queue, cl_mem_flags flags, cl_mem buffer)
+		{
+			OpenCL::instance().release(context, queue, flags, buffer);
+		}
+#endif
+
+		// Cached bytes kept per device or context; lowering it frees the excess on the next release
+		inline void setCap(size_t bytes)
+		{
+			Settings::cap() = bytes;
+		}
+
+		// Frees every cached buffer
+		inline void trim()
+		{
+#ifdef SKEPU_CUDA
+			CUDA::instance().trim();
+#endif
+#ifdef SKEPU_OPENCL
+			OpenCL::instance().trim();
+#endif
+		}
+	}
+}
+)~~~";
+
+
+std::string generateDevicePoolSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_device_pool.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << DevicePoolSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,199 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Short-circuiting reductions for instances listed in -reduce-early-exit as name or name=value, Reduce1D or
+ * MapReduce instances whose reduce function has an absorbing value: one that the reduction keeps once reached, such
+ * as true for a || b or false for a && b, inferred for those two and given as the value otherwise.
+ *
+ * Vector calls of Reduce and vector or matrix calls of MapReduce on the OpenMP backend reduce in chunks of the
+ * elements, each a call of the CPU backend on a copy of the skeleton per thread. A chunk reducing to the absorbing
+ * value sets a shared flag and the chunks not yet started are skipped, the call returning the absorbing value. The
+ * partial results of the other calls are combined in no fixed order, so the reduce function has to be commutative
+ * and the start value an identity of it. Other calls and backends run whole; the CUDA kernels of these instances
+ * have an _EarlyExit variant taking a zeroed flag that their blocks set and poll in the same way.
+ */
+static const char *EarlyExitSupport = R"~~~(
+#pragma once
+
+#include "skepu_schedule.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+namespace skepu
+{
+	namespace earlyexit
+	{
+		constexpr size_t ChunkSize = 1 << 14;
+
+		template<typename Skeleton, typename ReduceUF>
+		class Absorbing: public Skeleton
+		{
+		public:
+			using Ret = typename ReduceUF::Ret;
+
+			template<typename... CallArgs>
+			Absorbing(Ret absorbing, CallArgs&&... args): Skeleton(std::forward<CallArgs>(args)...), absorbing(absorbing) {}
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->openmp = (spec.backend() == Backend::Type::OpenMP);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->openmp = defaultOpenMP();
+				Skeleton::resetBackend();
+			}
+
+		protected:
+			static constexpr bool defaultOpenMP()
+			{
+#if defined(SKEPU_OPENMP) && !defined(SKEPU_CUDA) && !defined(SKEPU_OPENCL)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			// Reduces the chunks of n elements with body(skeleton, first, last), skipping those after an absorbing one
+			template<typename Body>
+			Ret reduceChunks(size_t n, Body &&body)
+			{
+				int threads = omp_get_max_threads();
+				std::vector<Skeleton> workers(threads, static_cast<Skeleton const&>(*this));
+				for (Skeleton &worker : workers)
+					worker.setBackend(BackendSpec{Backend::Type::CPU});
+
+				partials::Slots<Ret> partial(threads);
+				auto reduce = [](Ret const& a, Ret const& b) { return ReduceUF::CPU(a, b); };
+				std::atomic<bool> done {false};
+				const long long chunks = (n + ChunkSize - 1) / ChunkSize;
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+				for (long long c = 0; c < chunks; ++c)
+				{
+					if (done.load(std::memory_order_relaxed))
+						continue;
+					size_t first = c * ChunkSize;
+					size_t last = std::min(n, first + ChunkSize);
+					Ret value = body(workers[omp_get_thread_num()], first, last);
+					if (value == this->absorbing)
+						done.store(true, std::memory_order_relaxed);
+					partial.add(omp_get_thread_num(), value, reduce);
+				}
+
+				if (done.load())
+					return this->absorbing;
+				Ret result {};
+				partial.combine(reduce, result);
+				return result;
+			}
+
+			Ret absorbing;
+			bool openmp = defaultOpenMP();
+		};
+
+		template<typename Skeleton, typename ReduceUF>
+		class Reduce: public Absorbing<Skeleton, ReduceUF>
+		{
+		public:
+			using Absorbing<Skeleton, ReduceUF>::Absorbing;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename T>
+			typename ReduceUF::Ret operator()(Vector<T> &arg)
+			{
+				size_t n = arg.size();
+				if (!this->openmp || n == 0)
+					return Skeleton::operator()(arg);
+
+				schedule::updateHostAll(arg);
+				return this->reduceChunks(n, [&](Skeleton &skeleton, size_t first, size_t last)
+				{
+					return skeleton(arg.begin() + first, arg.begin() + last);
+				});
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF>
+		class MapReduce: public Absorbing<Skeleton, ReduceUF>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename MapUF::ElwiseArgs>::value;
+
+		public:
+			using Absorbing<Skeleton, ReduceUF>::Absorbing;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, chunkable<Args...>(typename schedule::Indices<sizeof...(Args)>::type{})>{},
+					std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args, size_t... I>
+			static constexpr bool chunkable(schedule::Sequence<I...>)
+			{
+				return MapUF::outArity == 1 && !MapUF::usesPRNG && elwise > 0
+					&& schedule::All<(I >= elwise || schedule::IsContainerArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename First, typename... Args>
+			auto call(std::true_type, First &&first, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...))
+			{
+				size_t n = first.size();
+				if (!this->openmp || n == 0)
+					return Skeleton::operator()(std::forward<First>(first), std::forward<Args>(args)...);
+
+				schedule::updateHostAll(first, args...);
+				auto rest = typename schedule::Indices<sizeof...(Args)>::type{};
+				return this->reduceChunks(n, [&](Skeleton &skeleton, size_t begin, size_t end)
+				{
+					return sliced(skeleton, first, begin, end, rest, args...);
+				});
+			}
+
+			// The remaining elementwise arguments follow the first, at positions 0 to elwise - 2
+			template<typename First, typename... Args, size_t... I>
+			static auto sliced(Skeleton &skeleton, First &first, size_t begin, size_t end, schedule::Sequence<I...>, Args&... args)
+				-> decltype(skeleton(first.begin(), first.begin(), schedule::Slice<(I + 1 < elwise)>::of(args, 0)...))
+			{
+				return skeleton(first.begin() + begin, first.begin() + end, schedule::Slice<(I + 1 < elwise)>::of(args, begin)...);
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateEarlyExitSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_early_exit.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		generateScheduleSupport(dir);
+		FSOutFile << EarlyExitSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,192 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Device-copy eviction for -device-eviction, so that programs keeping more containers alive than fit on the device
+ * keep running there. The main file defines SKEPU_EVICTION and includes this header before the SkePU headers,
+ * whose device pointers register each device copy with track, mark it with touch when a call uses it and with
+ * setDirty when a kernel writes it, pin it for the duration of a call, and untrack it when it is released. A
+ * domain is a CUDA device ordinal or an OpenCL context.
+ *
+ * When an allocation fails, reclaim evicts copies of the domain that no call has pinned, least recently used
+ * first, until the requested bytes are free: clean copies are dropped, and only when those do not suffice are
+ * dirty copies written back to the host and dropped. The evict callback of a copy does either, outside of the
+ * tracker lock, and is expected to release the device buffer through untrack. The device pool calls reclaim
+ * after trimming its cache; without -device-pool the runtime calls it before reporting a failed allocation.
+ * Evictions, write-backs and evicted bytes per domain are counted, and printed in the -instrument report.
+ */
+static const char *EvictionSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace eviction
+	{
+		using Domain = std::uintptr_t;
+
+		struct Stats
+		{
+			size_t evictions = 0;
+			size_t writeBacks = 0;
+			double bytes = 0;
+		};
+
+		class Tracker
+		{
+		public:
+			// Drops the device copy, writing it back to the host first if the argument is true
+			using Evict = std::function<void(bool)>;
+
+			static Tracker &instance()
+			{
+				static Tracker tracker;
+				return tracker;
+			}
+
+			void track(Domain domain, const void *key, size_t bytes, Evict evict)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->forget(key);
+				std::list<const void*> &order = this->lru[domain];
+				order.push_back(key);
+				this->copies[key] = Copy{domain, bytes, false, 0, std::move(evict), std::prev(order.end())};
+			}
+
+			void touch(const void *key)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->copies.find(key);
+				if (it != this->copies.end())
+				{
+					std::list<const void*> &order = this->lru[it->second.domain];
+					order.splice(order.end(), order, it->second.position);
+				}
+			}
+
+			void setDirty(const void *key, bool dirty)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->copies.find(key);
+				if (it != this->copies.end())
+					it->second.dirty = dirty;
+			}
+
+			void pin(const void *key)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->copies.find(key);
+				if (it != this->copies.end())
+					it->second.pins += 1;
+			}
+
+			void unpin(const void *key)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->copies.find(key);
+				if (it != this->copies.end() && it->second.pins > 0)
+					it->second.pins -= 1;
+			}
+
+			void untrack(const void *key)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->forget(key);
+			}
+
+			// Evicts unpinned copies of domain, clean ones first, until bytes are freed; returns the bytes evicted
+			size_t reclaim(Domain domain, size_t bytes)
+			{
+				std::vector<std::pair<Evict, bool>> victims;
+				size_t freed = 0;
+				{
+					std::lock_guard<std::mutex> guard(this->lock);
+					std::list<const void*> &order = this->lru[domain];
+					Stats &stats = this->stats[domain];
+					for (bool dirty : {false, true})
+						for (auto it = order.begin(); it != order.end() && freed < bytes; )
+						{
+							Copy &copy = this->copies[*it];
+							if (copy.pins > 0 || copy.dirty != dirty)
+							{
+								++it;
+								continue;
+							}
+							freed += copy.bytes;
+							stats.evictions += 1;
+							stats.writeBacks += dirty;
+							stats.bytes += copy.bytes;
+							victims.emplace_back(std::move(copy.evict), dirty);
+							this->copies.erase(*it);
+							it = order.erase(it);
+						}
+				}
+
+				for (auto &victim : victims)
+					victim.first(victim.second);
+				return freed;
+			}
+
+			std::map<Domain, Stats> statistics()
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				return this->stats;
+			}
+
+		private:
+			struct Copy
+			{
+				Domain domain;
+				size_t bytes;
+				bool dirty;
+				size_t pins;
+				Evict evict;
+				std::list<const void*>::iterator position;
+			};
+
+			Tracker() {}
+
+			void forget(const void *key)
+			{
+				auto it = this->copies.find(key);
+				if (it == this->copies.end())
+					return;
+				this->lru[it->second.domain].erase(it->second.position);
+				this->copies.erase(it);
+			}
+
+			std::mutex lock;
+			std::map<const void*, Copy> copies;
+			std::map<Domain, std::list<const void*>> lru;
+			std::map<Domain, Stats> stats;
+		};
+
+		inline size_t reclaim(Domain domain, size_t bytes)
+		{
+			return Tracker::instance().reclaim(domain, bytes);
+		}
+	}
+}
+)~~~";
+
+
+std::string generateEvictionSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_eviction.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << EvictionSupport;
+		generated = true;
+	}
+	return fileName;
+}
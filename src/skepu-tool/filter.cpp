@@ -0,0 +1,79 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Host side of the Filter skeleton. skepu::filter::cpu and ::omp copy the elements of input[0, n) that satisfy the
+ * generated predicate to output, in input order, and return how many were kept; output needs room for n elements.
+ * The OpenMP variant gives each thread a contiguous chunk and a private buffer it fills without synchronisation,
+ * then scans the per-thread counts and copies every buffer to its offset in parallel, the CPU counterpart of the
+ * flag, scan and scatter passes of the GPU kernels.
+ */
+static const char *FilterSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#ifdef SKEPU_OPENMP
+#include <omp.h>
+#endif
+
+namespace skepu
+{
+	namespace filter
+	{
+		template<typename Pred, typename T>
+		size_t cpu(T const* input, T *output, size_t n)
+		{
+			size_t count = 0;
+			for (size_t i = 0; i < n; ++i)
+				if (Pred::CPU(input[i]))
+					output[count++] = input[i];
+			return count;
+		}
+
+#ifdef SKEPU_OPENMP
+		template<typename Pred, typename T>
+		size_t omp(T const* input, T *output, size_t n)
+		{
+			const size_t chunks = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), n));
+			std::vector<std::vector<T>> buffers(chunks);
+			std::vector<size_t> offsets(chunks + 1, 0);
+
+#pragma omp parallel for schedule(static)
+			for (size_t c = 0; c < chunks; ++c)
+			{
+				std::vector<T> &buffer = buffers[c];
+				for (size_t i = n * c / chunks; i < n * (c + 1) / chunks; ++i)
+					if (Pred::OMP(input[i]))
+						buffer.push_back(input[i]);
+			}
+
+			for (size_t c = 0; c < chunks; ++c)
+				offsets[c + 1] = offsets[c] + buffers[c].size();
+
+#pragma omp parallel for schedule(static)
+			for (size_t c = 0; c < chunks; ++c)
+				std::copy(buffers[c].begin(), buffers[c].end(), output + offsets[c]);
+
+			return offsets[chunks];
+		}
+#endif
+	}
+}
+)~~~";
+
+
+std::string generateFilterSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_filter.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << FilterSupport;
+		generated = true;
+	}
+	return fileName;
+}
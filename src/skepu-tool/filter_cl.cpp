@@ -0,0 +1,213 @@
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  OpenCL gives no forward-progress guarantee between work-groups, so instead of the look-back of the CUDA kernel
+ *  the flags are scanned reduce-then-scan, as in the _ScanReduce and _ScanDownsweep kernels of Scan: _FilterCount
+ *  counts the kept elements of each work-group's contiguous range of tiles into skepu_partials, and _FilterScatter
+ *  evaluates the predicate again, scans the flags of every tile with the block scan of the Scan kernels and writes
+ *  the kept elements at their rank after those of the preceding groups. The last element writes the total to
+ *  *skepu_count. Both launches need the same number of work-groups and skepu_n + skepu_n / 32 elements of local
+ *  memory, skepu_n being the work-group size.
+ */
+static const char *FilterKernelTemplate_CL = R"~~~(
+size_t {{KERNEL_NAME}}_Add(size_t skepu_a, size_t skepu_b)
+{
+	return skepu_a + skepu_b;
+}
+{{SCAN_HELPERS}}
+__kernel void {{KERNEL_NAME}}_FilterCount(__global const {{ELEMENT_TYPE}} * restrict skepu_input, __global size_t *skepu_partials, size_t skepu_n, __local size_t *skepu_sdata)
+{
+	const size_t skepu_tid = get_local_id(0);
+	const size_t skepu_blockSize = get_local_size(0);
+	size_t skepu_tiles = (skepu_n + skepu_blockSize - 1) / skepu_blockSize;
+	size_t skepu_perGroup = (skepu_tiles + get_num_groups(0) - 1) / get_num_groups(0) * skepu_blockSize;
+	size_t skepu_first = get_group_id(0) * skepu_perGroup;
+	size_t skepu_last = min(skepu_n, skepu_first + skepu_perGroup);
+
+	size_t skepu_kept = 0;
+	for (size_t skepu_i = skepu_first + skepu_tid; skepu_i < skepu_last; skepu_i += skepu_blockSize)
+		skepu_kept += {{FUNCTION_NAME_PREDICATE}}(skepu_input[skepu_i]) ? 1 : 0;
+	skepu_sdata[SKEPU_SCAN_CF(skepu_tid)] = skepu_kept;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	{{KERNEL_NAME}}_ScanBlockReduce(skepu_sdata, skepu_tid, skepu_blockSize);
+	if (skepu_tid == 0)
+		skepu_partials[get_group_id(0)] = skepu_sdata[0];
+}
+
+__kernel void {{KERNEL_NAME}}_FilterScatter(__global const {{ELEMENT_TYPE}} * restrict skepu_input, __global {{ELEMENT_TYPE}} *skepu_output, __global const size_t *skepu_partials,
+	size_t skepu_n, __global size_t *skepu_count, __local size_t *skepu_sdata)
+{
+	__local size_t skepu_carry;
+	const size_t skepu_tid = get_local_id(0);
+	const size_t skepu_blockSize = get_local_size(0);
+	size_t skepu_tiles = (skepu_n + skepu_blockSize - 1) / skepu_blockSize;
+	size_t skepu_perGroup = (skepu_tiles + get_num_groups(0) - 1) / get_num_groups(0) * skepu_blockSize;
+	size_t skepu_first = get_group_id(0) * skepu_perGroup;
+	size_t skepu_last = min(skepu_n, skepu_first + skepu_perGroup);
+
+	if (skepu_tid == 0)
+	{
+		skepu_carry = 0;
+		for (size_t skepu_g = 0; skepu_g < get_group_id(0); ++skepu_g)
+			skepu_carry += skepu_partials[skepu_g];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t skepu_base = skepu_first; skepu_base < skepu_last; skepu_base += skepu_blockSize)
+	{
+		size_t skepu_validCount = min(skepu_blockSize, skepu_last - skepu_base);
+		bool skepu_valid = skepu_tid < skepu_validCount;
+		{{ELEMENT_TYPE}} skepu_element;
+		bool skepu_keep = false;
+		if (skepu_valid)
+		{
+			skepu_element = skepu_input[skepu_base + skepu_tid];
+			skepu_keep = {{FUNCTION_NAME_PREDICATE}}(skepu_element);
+			skepu_sdata[SKEPU_SCAN_CF(skepu_tid)] = skepu_keep ? 1 : 0;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		{{KERNEL_NAME}}_ScanBlock(skepu_sdata, skepu_tid, skepu_validCount);
+
+		if (skepu_keep)
+			skepu_output[skepu_carry + skepu_sdata[SKEPU_SCAN_CF(skepu_tid)] - 1] = skepu_element;
+		if (skepu_valid && skepu_base + skepu_tid == skepu_n - 1)
+			*skepu_count = skepu_carry + skepu_sdata[SKEPU_SCAN_CF(skepu_tid)];
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (skepu_tid == 0)
+			skepu_carry += skepu_sdata[SKEPU_SCAN_CF(skepu_validCount - 1)];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+)~~~";
+
+
+const std::string Constructor = R"~~~(
+class {{KERNEL_CLASS}}
+{
+public:
+
+	enum
+	{
+		KERNEL_FILTER_COUNT = 0,
+		KERNEL_FILTER_SCATTER,
+		KERNEL_COUNT
+	};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
+	{
+		if (newkernel)
+		{
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
+			return nullptr;
+		}
+		else return skepu_kernel_table().get(deviceID, kerneltype);
+	}
+
+	static const std::string &skepu_source()
+	{
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_count = clCreateKernel(program, "{{KERNEL_NAME}}_FilterCount", &err);
+		CL_CHECK_ERROR(err, "Error creating Filter count kernel '{{KERNEL_NAME}}'");
+
+		cl_kernel kernel_scatter = clCreateKernel(program, "{{KERNEL_NAME}}_FilterScatter", &err);
+		CL_CHECK_ERROR(err, "Error creating Filter scatter kernel '{{KERNEL_NAME}}'");
+
+		kernels(deviceID, KERNEL_FILTER_COUNT,   &kernel_count);
+		kernels(deviceID, KERNEL_FILTER_SCATTER, &kernel_scatter);
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
+	}
+
+	// skepu_partials holds one count per work-group
+	static void count
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<const {{ELEMENT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<size_t> *skepu_partials, size_t skepu_n
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_FILTER_COUNT);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_partials->getDeviceDataPointer(), skepu_n);
+		clSetKernelArg(kernel, 3, sizeof(size_t) * (localSize + localSize / 32), NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Filter count kernel");
+	}
+
+	// Same work sizes as count; skepu_count receives the number of kept elements
+	static void scatter
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<const {{ELEMENT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<{{ELEMENT_TYPE}}> *skepu_output,
+		skepu::backend::DeviceMemPointer_CL<size_t> *skepu_partials, size_t skepu_n, skepu::backend::DeviceMemPointer_CL<size_t> *skepu_count
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_FILTER_SCATTER);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), skepu_partials->getDeviceDataPointer(), skepu_n, skepu_count->getDeviceDataPointer());
+		clSetKernelArg(kernel, 5, sizeof(size_t) * (localSize + localSize / 32), NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Filter scatter kernel");
+	}
+};
+)~~~";
+
+
+std::string createFilterKernelProgram_CL(SkeletonInstance &instance, UserFunction &predicate, std::string dir)
+{
+	std::stringstream sourceStream;
+
+	sourceStream << precisionExtensions_CL({&predicate});
+
+	// Include user constants as preprocessor macros
+	for (auto pair : UserConstants)
+		sourceStream << "#define " << pair.second->name << " (" << pair.second->definition << ") // " << pair.second->typeName << "\n";
+
+	for (UserType *RefType : predicate.ReferencedUTs)
+		sourceStream << generateUserTypeCode_CL(*RefType);
+
+	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_FilterKernel_" + predicate.uniqueName;
+	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(predicate)
+		<< templateString(FilterKernelTemplate_CL, {{"{{SCAN_HELPERS}}", generateScanBlockHelpers_CL(kernelName, "size_t", kernelName + "_Add")}});
+
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
+	{
+		{"{{OPENCL_KERNEL}}",           sourceStream.str()},
+		{"{{KERNEL_CLASS}}",            "CLWrapperClass_" + kernelName},
+		{"{{ELEMENT_TYPE}}",            predicate.elwiseParams[0].typeNameOpenCL()},
+		{"{{KERNEL_NAME}}",             kernelName},
+		{"{{FUNCTION_NAME_PREDICATE}}", predicate.uniqueName}
+	}), dir);
+}
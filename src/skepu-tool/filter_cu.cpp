@@ -0,0 +1,145 @@
+#include "code_gen.h"
+#include "code_gen_cu.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  Flag, scan and scatter in one launch. Tiles are handed out in order through the tile counter of the single-pass
+ *  Scan kernels; each tile evaluates the predicate on its elements, scans the kept flags with the warp scans of
+ *  those kernels and resolves the number of kept elements before it by decoupled look-back. Kept elements are then
+ *  written to skepu_output at their rank, in input order, and the last tile writes the total to *skepu_count.
+ *
+ *  skepu_tile_flags must hold one entry per tile plus one (the tile counter) and be zeroed before each launch.
+ *  Dynamic shared memory: (blockDim.x + 32) * sizeof(size_t). blockDim.x must be a multiple of 32.
+ */
+static const char *FilterKernelTemplate_CU = R"~~~(
+__device__ inline size_t {{KERNEL_NAME}}_Add(size_t skepu_a, size_t skepu_b)
+{
+	return skepu_a + skepu_b;
+}
+{{SCAN_HELPERS}}
+__global__ void {{KERNEL_NAME}}_Filter(const {{ELEMENT_TYPE}} * __restrict__ skepu_input, {{ELEMENT_TYPE}} *skepu_output,
+	size_t *skepu_tile_aggregates, size_t *skepu_tile_prefixes, unsigned int *skepu_tile_flags, size_t skepu_n, size_t *skepu_count)
+{
+	extern __shared__ size_t {{SHARED_BUFFER}}[];
+	size_t *skepu_warp_sums = {{SHARED_BUFFER}} + blockDim.x;
+
+	__shared__ size_t skepu_tile;
+	__shared__ size_t skepu_tile_exclusive;
+
+	size_t skepu_tid = threadIdx.x;
+	size_t skepu_lane = skepu_tid % 32;
+	size_t skepu_warp = skepu_tid / 32;
+	size_t numTiles = skepu_n / blockDim.x + (skepu_n % blockDim.x == 0 ? 0 : 1);
+	unsigned int *skepu_tile_counter = skepu_tile_flags + numTiles;
+
+	while (true)
+	{
+		if (skepu_tid == 0)
+			skepu_tile = atomicAdd(skepu_tile_counter, 1);
+		__syncthreads();
+
+		size_t tile = skepu_tile;
+		if (tile >= numTiles)
+			return;
+
+		size_t skepu_mem = tile * blockDim.x + skepu_tid;
+		size_t skepu_validCount = min((size_t)blockDim.x, skepu_n - tile * blockDim.x);
+		size_t skepu_numWarps = (skepu_validCount + 31) / 32;
+		bool skepu_valid = skepu_tid < skepu_validCount;
+
+		{{ELEMENT_TYPE}} skepu_element;
+		bool skepu_keep = false;
+		if (skepu_valid)
+		{
+			skepu_element = skepu_input[skepu_mem];
+			skepu_keep = {{FUNCTION_NAME_PREDICATE}}(skepu_element);
+			{{SHARED_BUFFER}}[skepu_tid] = skepu_keep ? 1 : 0;
+		}
+		__syncwarp();
+		{{KERNEL_NAME}}_ScanLookback_warpScan({{SHARED_BUFFER}}, skepu_tid, skepu_lane, skepu_valid);
+
+		if (skepu_valid && (skepu_lane == 31 || skepu_tid == skepu_validCount - 1))
+			skepu_warp_sums[skepu_warp] = {{SHARED_BUFFER}}[skepu_tid];
+		__syncthreads();
+
+		if (skepu_warp == 0)
+			{{KERNEL_NAME}}_ScanLookback_warpScan(skepu_warp_sums, skepu_lane, skepu_lane, skepu_lane < skepu_numWarps);
+		__syncthreads();
+
+		if (skepu_valid && skepu_warp > 0)
+			{{SHARED_BUFFER}}[skepu_tid] += skepu_warp_sums[skepu_warp - 1];
+
+		// Publish the kept count of the tile and resolve the count before it
+		if (skepu_tid == 0)
+		{
+			size_t skepu_aggregate = skepu_warp_sums[skepu_numWarps - 1];
+			volatile unsigned int *skepu_flags = skepu_tile_flags;
+			skepu_tile_exclusive = 0;
+
+			if (tile == 0)
+			{
+				skepu_tile_prefixes[0] = skepu_aggregate;
+				__threadfence();
+				skepu_flags[0] = SKEPU_TILE_PREFIX;
+			}
+			else
+			{
+				skepu_tile_aggregates[tile] = skepu_aggregate;
+				__threadfence();
+				skepu_flags[tile] = SKEPU_TILE_AGGREGATE;
+
+				size_t skepu_exclusive = 0;
+				size_t skepu_pred = tile - 1;
+				while (true)
+				{
+					unsigned int skepu_status;
+					do skepu_status = skepu_flags[skepu_pred]; while (skepu_status == SKEPU_TILE_INVALID);
+					__threadfence();
+
+					skepu_exclusive += {{KERNEL_NAME}}_ScanLookback_load((skepu_status == SKEPU_TILE_PREFIX) ? &skepu_tile_prefixes[skepu_pred] : &skepu_tile_aggregates[skepu_pred]);
+					if (skepu_status == SKEPU_TILE_PREFIX)
+						break;
+					--skepu_pred;
+				}
+
+				skepu_tile_prefixes[tile] = skepu_exclusive + skepu_aggregate;
+				__threadfence();
+				skepu_flags[tile] = SKEPU_TILE_PREFIX;
+				skepu_tile_exclusive = skepu_exclusive;
+			}
+		}
+		__syncthreads();
+
+		if (skepu_keep)
+			skepu_output[skepu_tile_exclusive + {{SHARED_BUFFER}}[skepu_tid] - 1] = skepu_element;
+		if (skepu_valid && skepu_mem == skepu_n - 1)
+			*skepu_count = skepu_tile_exclusive + {{SHARED_BUFFER}}[skepu_tid];
+		__syncthreads();
+	}
+}
+
+#undef SKEPU_TILE_INVALID
+#undef SKEPU_TILE_AGGREGATE
+#undef SKEPU_TILE_PREFIX
+)~~~";
+
+
+std::string createFilterKernelProgram_CU(SkeletonInstance &instance, UserFunction &predicate, std::string dir)
+{
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_FilterKernel_" + predicate.uniqueName;
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(FilterKernelTemplate_CU,
+	{
+		{"{{SCAN_HELPERS}}",            generateScanLookbackHelpers_CU(kernelName, "size_t", kernelName + "_Add")},
+		{"{{ELEMENT_TYPE}}",            predicate.elwiseParams[0].resolvedTypeName},
+		{"{{KERNEL_NAME}}",             kernelName},
+		{"{{FUNCTION_NAME_PREDICATE}}", predicate.funcNameCUDA()},
+		{"{{SHARED_BUFFER}}",           "sdata_" + instance}
+	});
+	return kernelName;
+}
@@ -0,0 +1,128 @@
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+// Same gather as the CUDA kernel, see gather_cu.cpp; restrict on the read-only streams stands in for __ldg
+static const char *GatherKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_Gather(__global const {{INPUT_TYPE}} * restrict skepu_input, __global const size_t * restrict skepu_index, __global const size_t * restrict skepu_order,
+	int skepu_sorted, __global {{OUTPUT_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_inputSize)
+{
+	for (size_t skepu_i = get_global_id(0); skepu_i < skepu_n; skepu_i += get_global_size(0))
+	{
+		size_t skepu_pos = skepu_sorted ? skepu_order[skepu_i] : skepu_i;
+		size_t skepu_src = skepu_index[skepu_pos];
+		if (skepu_src < skepu_inputSize)
+			skepu_output[skepu_pos] = {{FUNCTION_NAME_GATHER}}(skepu_input[skepu_src]);
+	}
+}
+)~~~";
+
+
+const std::string Constructor = R"~~~(
+class {{KERNEL_CLASS}}
+{
+public:
+
+	enum
+	{
+		KERNEL_GATHER = 0,
+		KERNEL_COUNT
+	};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
+	{
+		if (newkernel)
+		{
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
+			return nullptr;
+		}
+		else return skepu_kernel_table().get(deviceID, kerneltype);
+	}
+
+	static const std::string &skepu_source()
+	{
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}_Gather", &err);
+		CL_CHECK_ERROR(err, "Error creating Gather kernel '{{KERNEL_NAME}}'");
+
+		kernels(deviceID, KERNEL_GATHER, &kernel);
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
+	}
+
+	// A null skepu_order gathers in output order
+	static void gather
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<const {{INPUT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<const size_t> *skepu_index,
+		skepu::backend::DeviceMemPointer_CL<const size_t> *skepu_order, skepu::backend::DeviceMemPointer_CL<{{OUTPUT_TYPE}}> *skepu_output,
+		size_t skepu_n, size_t skepu_inputSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_GATHER);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_index->getDeviceDataPointer(),
+			skepu_order ? skepu_order->getDeviceDataPointer() : skepu_index->getDeviceDataPointer(), (int)(skepu_order != nullptr),
+			skepu_output->getDeviceDataPointer(), skepu_n, skepu_inputSize);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Gather kernel");
+	}
+};
+)~~~";
+
+
+std::string createGatherKernelProgram_CL(SkeletonInstance &instance, UserFunction &gatherFunc, std::string dir)
+{
+	std::stringstream sourceStream;
+
+	sourceStream << precisionExtensions_CL({&gatherFunc});
+
+	// Include user constants as preprocessor macros
+	for (auto pair : UserConstants)
+		sourceStream << "#define " << pair.second->name << " (" << pair.second->definition << ") // " << pair.second->typeName << "\n";
+
+	for (UserType *RefType : gatherFunc.ReferencedUTs)
+		sourceStream << generateUserTypeCode_CL(*RefType);
+
+	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(gatherFunc) << GatherKernelTemplate_CL;
+
+	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_GatherKernel_" + gatherFunc.uniqueName;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
+	{
+		{"{{OPENCL_KERNEL}}",        sourceStream.str()},
+		{"{{KERNEL_CLASS}}",         "CLWrapperClass_" + kernelName},
+		{"{{INPUT_TYPE}}",           gatherFunc.elwiseParams[0].typeNameOpenCL()},
+		{"{{OUTPUT_TYPE}}",          gatherFunc.resolvedReturnTypeName},
+		{"{{KERNEL_NAME}}",          kernelName},
+		{"{{FUNCTION_NAME_GATHER}}", gatherFunc.uniqueName}
+	}), dir);
+}
@@ -0,0 +1,44 @@
+#include "code_gen.h"
+#include "code_gen_cu.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  skepu_output[i] = f(skepu_input[skepu_index[i]]) for i < skepu_n. The index and input streams are only read, so
+ *  they go through the read-only data cache: __ldg for the indices and const __restrict__ for the input, which
+ *  lets the compiler do the same for elements of any type. A non-null skepu_order (the positions sorted by their
+ *  index, from skepu::indirect::localityOrder) makes neighbouring threads read neighbouring input elements; the
+ *  results are still written to their own positions. Indices at or past skepu_inputSize leave the output unchanged.
+ */
+static const char *GatherKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_Gather(const {{INPUT_TYPE}} * __restrict__ skepu_input, const size_t * __restrict__ skepu_index, const size_t * __restrict__ skepu_order,
+	{{OUTPUT_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_inputSize)
+{
+	for (size_t skepu_i = blockIdx.x * blockDim.x + threadIdx.x; skepu_i < skepu_n; skepu_i += blockDim.x * gridDim.x)
+	{
+		size_t skepu_pos = skepu_order ? __ldg(&skepu_order[skepu_i]) : skepu_i;
+		size_t skepu_src = __ldg(&skepu_index[skepu_pos]);
+		if (skepu_src < skepu_inputSize)
+			skepu_output[skepu_pos] = {{FUNCTION_NAME_GATHER}}(skepu_input[skepu_src]);
+	}
+}
+)~~~";
+
+
+std::string createGatherKernelProgram_CU(SkeletonInstance &instance, UserFunction &gatherFunc, std::string dir)
+{
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_GatherKernel_" + gatherFunc.uniqueName;
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(GatherKernelTemplate_CU,
+	{
+		{"{{INPUT_TYPE}}",           gatherFunc.elwiseParams[0].resolvedTypeName},
+		{"{{OUTPUT_TYPE}}",          gatherFunc.resolvedReturnTypeName},
+		{"{{KERNEL_NAME}}",          kernelName},
+		{"{{FUNCTION_NAME_GATHER}}", gatherFunc.funcNameCUDA()}
+	});
+	return kernelName;
+}
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <functional>
+#include <iterator>
+#include <mutex>
 #include <unordered_set>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
@@ -27,46 +31,175 @@
 
 
 extern llvm::cl::opt<bool> GenCUDA;
+extern llvm::cl::opt<bool> SplitCUDA;
 extern llvm::cl::opt<bool> GenOMP;
 extern llvm::cl::opt<bool> GenCL;
+extern llvm::cl::opt<bool> GenStarPUMPI;
+extern llvm::cl::opt<bool> GenMPI;
 extern llvm::cl::opt<bool> DoNotGenLineDirectives;
 
-extern llvm::cl::opt<std::string> ResultName;
+extern thread_local std::string ResultName;
 extern llvm::cl::opt<std::string> ResultDir;
 
 extern llvm::cl::opt<bool> Verbose;
 
-extern std::string inputFileName;
+extern llvm::cl::list<std::string> RuntimeSkeletons;
+extern llvm::cl::list<std::string> ScanSinglePassInstances;
+extern llvm::cl::list<std::string> UnitStrideInstances;
+extern llvm::cl::list<std::string> MapDynamicInstances;
+extern llvm::cl::list<std::string> MapReduceSinglePassInstances;
+extern llvm::cl::list<std::string> Reduce2DSingleLaunchInstances;
+extern llvm::cl::list<std::string> ScanMatrixInstances;
+extern llvm::cl::list<std::string> BatchedInstances;
+extern llvm::cl::list<std::string> OutOfCoreInstances;
+extern llvm::cl::opt<unsigned> OutOfCoreChunkMiB;
+extern llvm::cl::opt<bool> NoShuffleReduce;
+extern llvm::cl::opt<bool> NoCollectiveReduce_CL;
+extern llvm::cl::opt<unsigned> LaunchBoundsThreads;
+extern llvm::cl::list<std::string> MaxRegisterInstances;
+extern llvm::cl::opt<bool> Index32;
+extern llvm::cl::list<std::string> VectorizedMapInstances;
+extern llvm::cl::opt<bool> PruneDeviceArgs;
+extern llvm::cl::list<std::string> TiledGEMMInstances;
+extern llvm::cl::opt<bool> IncrementalIndex;
+extern llvm::cl::list<std::string> MapPairsSymmetricInstances;
+extern llvm::cl::list<std::string> MapPairsAntisymmetricInstances;
+extern llvm::cl::opt<unsigned> MapPairsTile;
+extern llvm::cl::list<std::string> MapPairsReduceBroadcastInstances;
+extern llvm::cl::list<std::string> MapOverlapTemporalInstances;
+extern llvm::cl::list<std::string> MapOverlapReduceInstances;
+extern llvm::cl::list<std::string> MapOverlapRedBlackInstances;
+extern llvm::cl::list<std::string> StaticOverlapInstances;
+extern llvm::cl::list<std::string> MapOverlapOutputsInstances;
+extern llvm::cl::list<std::string> SpMVInstances;
+extern llvm::cl::list<std::string> SpMVSellInstances;
+extern llvm::cl::list<std::string> SoATypes;
+extern llvm::cl::opt<bool> PhiloxRandom;
+extern llvm::cl::opt<bool> FuseMaps;
+extern llvm::cl::opt<bool> FuseMapReduce;
+extern llvm::cl::opt<bool> ReduceAccumulateFloat;
+extern llvm::cl::opt<bool> FastMath;
+extern llvm::cl::opt<unsigned> ConstantUniformBytes;
+extern llvm::cl::opt<unsigned> DevicePoolMiB;
+extern llvm::cl::opt<bool> DeviceEviction;
+extern llvm::cl::opt<bool> TransferMetrics;
+extern llvm::cl::opt<bool> PinnedHost;
+extern llvm::cl::opt<bool> OMPPartials;
+extern llvm::cl::opt<bool> NUMA;
+extern llvm::cl::opt<bool> RangeCoherency;
+extern llvm::cl::opt<bool> Views;
+extern llvm::cl::opt<bool> MappedIO;
+extern llvm::cl::opt<bool> ZeroCopy;
+extern llvm::cl::opt<bool> Async;
+extern llvm::cl::opt<bool> Graphs;
+extern llvm::cl::list<std::string> LaunchMetadataInstances;
+extern llvm::cl::list<std::string> AutotuneInstances;
+extern llvm::cl::list<std::string> JITSpecializeInstances;
+extern llvm::cl::list<std::string> TransposeMatColInstances;
+extern llvm::cl::list<std::string> BrickTensorInstances;
+extern llvm::cl::list<std::string> LazyInstances;
+extern llvm::cl::list<std::string> HybridInstances;
+extern llvm::cl::list<std::string> TiledOverlapInstances;
+extern llvm::cl::list<std::string> MultiGPUOverlapInstances;
+extern llvm::cl::list<std::string> SeparableOverlapInstances;
+extern llvm::cl::list<std::string> MultiGPUPairsInstances;
+extern llvm::cl::list<std::string> BlockedPairsInstances;
+extern llvm::cl::opt<bool> OMPSIMD;
+extern llvm::cl::list<std::string> OMPScheduleInstances;
+extern llvm::cl::list<std::string> EarlyExitInstances;
+extern llvm::cl::list<std::string> AutoBackendInstances;
+extern llvm::cl::list<std::string> PlanInstances;
+extern llvm::cl::list<std::string> StarPUPartitionInstances;
+extern llvm::cl::opt<std::string> PlanFile;
+extern llvm::cl::opt<std::string> TuningDatabase;
+extern llvm::cl::opt<bool> TimeReport;
+extern llvm::cl::opt<bool> Instrument;
+extern llvm::cl::opt<bool> VendorBLAS;
+extern llvm::cl::opt<bool> OpenCLSPIRV;
+extern llvm::cl::opt<std::string> SPIRVClang;
+extern llvm::cl::opt<std::string> SPIRVTranslator;
+extern llvm::cl::opt<std::string> PCHHeader;
+
+extern thread_local std::string inputFileName;
+
+// Wall time spent generating device kernels, reported by -time-report
+extern thread_local double KernelGenTime_CU, KernelGenTime_CL;
+
+// Adds the lifetime of the scope to a wall time accumulator
+class PhaseTimer
+{
+public:
+	PhaseTimer(double &total): total(total), start(std::chrono::steady_clock::now()) {}
+	~PhaseTimer() { total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+
+private:
+	double &total;
+	std::chrono::steady_clock::time_point start;
+};
 
 // User functions, name maps to AST entry and indexed indicator
-extern std::unordered_map<const clang::FunctionDecl*, UserFunction*> UserFunctions;
+extern thread_local std::unordered_map<const clang::FunctionDecl*, UserFunction*> UserFunctions;
 
 // User functions, name maps to AST entry and indexed indicator
-extern std::unordered_map<const clang::TypeDecl*, UserType*> UserTypes;
+extern thread_local std::unordered_map<const clang::TypeDecl*, UserType*> UserTypes;
 
 // User functions, name maps to AST entry and indexed indicator
-extern std::unordered_map<const clang::VarDecl*, UserConstant*> UserConstants;
+extern thread_local std::unordered_map<const clang::VarDecl*, UserConstant*> UserConstants;
+
+// -mapoverlap-reduce: MapOverlap2D instances and the map and reduce functions of the residual fused into their kernel
+extern thread_local std::unordered_map<const clang::VarDecl*, std::pair<UserFunction*, UserFunction*>> MapOverlapReductions;
 
 
 extern const std::unordered_map<std::string, Skeleton> Skeletons;
 
 
-extern clang::Rewriter GlobalRewriter;
+extern thread_local clang::Rewriter GlobalRewriter;
 
 //extern clang::SourceManager *SM;
 
 const std::string SkePU_UF_Prefix {"skepu_userfunction_"};
-extern size_t GlobalSkeletonIndex;
+extern thread_local size_t GlobalSkeletonIndex;
 
 [[noreturn]] void SkePUAbort(std::string msg);
 llvm::raw_ostream& SkePULog();
 
+// Content hashes of strings and files, used for the -incremental stamps and the -pch dependencies
+std::string contentHash(const std::string &content);
+bool fileHash(const std::string &path, std::string &hash);
+
+// Precompiles -pch-header for the flags of command unless an up-to-date PCH exists, returns its path or "" on failure
+std::string preparePCH(const clang::tooling::CompileCommand &command);
+
 void replaceTextInString(std::string& text, const std::string &find, const std::string &replace);
-std::string templateString(std::string templ, std::vector<std::pair<std::string, std::string>> replacements);
+std::string templateString(const std::string &templ, const std::vector<std::pair<std::string, std::string>> &replacements);
 std::string transformToCXXIdentifier(std::string &in);
 std::string getSourceAsString(clang::SourceRange range);
 
+// Writes content to path unless the file already holds exactly that content, in which case it keeps its
+// timestamp and build systems do not rebuild what depends on it. Returns true if the file was written.
+bool writeFileIfChanged(const std::string &path, const std::string &content);
+
+// Every file written through writeFileIfChanged in this run
+struct GeneratedFileRecord
+{
+	std::string path;
+	size_t size;
+	bool written;
+};
+extern thread_local std::vector<GeneratedFileRecord> GeneratedFiles;
+
+// Output stream for a generated file, which is written through writeFileIfChanged when the stream is destroyed
+class GeneratedFile: public std::ostringstream
+{
+public:
+	explicit GeneratedFile(std::string path): path(path) {}
+	~GeneratedFile() { writeFileIfChanged(this->path, this->str()); }
+
+private:
+	std::string path;
+};
+
 
 // Library markers
-extern bool didFindBlas;
-extern clang::SourceLocation blasBegin, blasEnd;
\ No newline at end of file
+extern thread_local bool didFindBlas;
+extern thread_local clang::SourceLocation blasBegin, blasEnd;
\ No newline at end of file
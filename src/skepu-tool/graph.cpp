@@ -0,0 +1,281 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Capture and replay of skeleton call sequences for -graphs. Loops that issue the same small skeleton calls
+ * every iteration spend most of their time launching kernels. A skepu::graph::Region records the kernels of a
+ * sequence of calls once and then runs them all with a single launch.
+ *
+ * With CUDA, capture runs the calls with the stream in capture mode, so their kernels are recorded into a graph
+ * rather than run; stream_CU gives the launchers the capturing stream. A later capture of the same sequence
+ * with other scalar arguments updates the instantiated graph in place, which is much cheaper than a new
+ * instantiation. With OpenCL, record_CL records the kernel launches of the generated wrappers into a
+ * cl_khr_command_buffer (revision 0.9 or later), where the device supports it; recording again replaces it.
+ *
+ * Only kernels are recorded, so the containers used in the region must be on the device before the capture,
+ * and launch does not synchronize with the host.
+ */
+static const char *GraphSupport = R"~~~(
+#pragma once
+
+#include <string>
+#include <utility>
+
+#ifdef SKEPU_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef SKEPU_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace skepu
+{
+	namespace graph
+	{
+#ifdef SKEPU_OPENCL
+		// Entry points of cl_khr_command_buffer, looked up per platform
+		struct CommandBufferAPI
+		{
+			using Create = void *(CL_API_CALL *)(cl_uint, const cl_command_queue*, const cl_ulong*, cl_int*);
+			using Kernel = cl_int (CL_API_CALL *)(void*, cl_command_queue, const cl_ulong*, cl_kernel, cl_uint, const size_t*, const size_t*, const size_t*,
+				cl_uint, const cl_uint*, cl_uint*, void**);
+			using Finalize = cl_int (CL_API_CALL *)(void*);
+			using Enqueue = cl_int (CL_API_CALL *)(cl_uint, cl_command_queue*, void*, cl_uint, const cl_event*, cl_event*);
+			using Release = cl_int (CL_API_CALL *)(void*);
+
+			Create create = nullptr;
+			Kernel kernel = nullptr;
+			Finalize finalize = nullptr;
+			Enqueue enqueue = nullptr;
+			Release release = nullptr;
+
+			static bool load(cl_command_queue queue, CommandBufferAPI &api)
+			{
+				cl_device_id device;
+				cl_platform_id platform;
+				size_t size = 0;
+				if (clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL) != CL_SUCCESS
+					|| clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL) != CL_SUCCESS
+					|| clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &size) != CL_SUCCESS)
+					return false;
+				std::string extensions(size, '\0');
+				clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size, &extensions[0], NULL);
+				if (extensions.find("cl_khr_command_buffer") == std::string::npos)
+					return false;
+
+				api.create = (Create)clGetExtensionFunctionAddressForPlatform(platform, "clCreateCommandBufferKHR");
+				api.kernel = (Kernel)clGetExtensionFunctionAddressForPlatform(platform, "clCommandNDRangeKernelKHR");
+				api.finalize = (Finalize)clGetExtensionFunctionAddressForPlatform(platform, "clFinalizeCommandBufferKHR");
+				api.enqueue = (Enqueue)clGetExtensionFunctionAddressForPlatform(platform, "clEnqueueCommandBufferKHR");
+				api.release = (Release)clGetExtensionFunctionAddressForPlatform(platform, "clReleaseCommandBufferKHR");
+				return api.create && api.kernel && api.finalize && api.enqueue && api.release;
+			}
+		};
+
+		struct Recording
+		{
+			CommandBufferAPI *api;
+			void *buffer;
+			cl_int status;
+		};
+
+		inline Recording *&recording_CL()
+		{
+			static thread_local Recording *recording = nullptr;
+			return recording;
+		}
+
+		// Launch function of the generated wrappers: records the kernel while a region records on this thread
+		inline cl_int enqueueKernel_CL(cl_command_queue queue, cl_kernel kernel, cl_uint dims, const size_t *offset, const size_t *global,
+			const size_t *local, cl_uint waitCount, const cl_event *waitList, cl_event *event)
+		{
+			Recording *recording = recording_CL();
+			if (!recording)
+				return clEnqueueNDRangeKernel(queue, kernel, dims, offset, global, local, waitCount, waitList, event);
+
+			// Commands of a buffer run in order, so no sync points are needed
+			if (event)
+				*event = NULL;
+			cl_int err = recording->api->kernel(recording->buffer, NULL, NULL, kernel, dims, offset, global, local, 0, NULL, NULL, NULL);
+			if (err != CL_SUCCESS)
+				recording->status = err;
+			return err;
+		}
+#endif
+
+#ifdef SKEPU_CUDA
+		inline cudaStream_t &capturing_CU()
+		{
+			static thread_local cudaStream_t stream = 0;
+			return stream;
+		}
+
+		// Stream for the launchers: the capturing stream of a region on this thread, or fallback
+		inline cudaStream_t stream_CU(cudaStream_t fallback)
+		{
+			return capturing_CU() ? capturing_CU() : fallback;
+		}
+#endif
+
+		class Region
+		{
+		public:
+			Region() = default;
+			Region(Region const&) = delete;
+			Region &operator=(Region const&) = delete;
+
+			~Region()
+			{
+#ifdef SKEPU_CUDA
+				if (this->exec)
+					cudaGraphExecDestroy(this->exec);
+#endif
+#ifdef SKEPU_OPENCL
+				if (this->buffer)
+					this->api.release(this->buffer);
+#endif
+			}
+
+#ifdef SKEPU_CUDA
+			// Records the kernels launched by calls() on stream; false if the capture failed
+			template<typename Calls>
+			bool capture(cudaStream_t stream, Calls &&calls)
+			{
+				if (cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal) != cudaSuccess)
+					return false;
+				capturing_CU() = stream;
+				std::forward<Calls>(calls)();
+				capturing_CU() = 0;
+
+				cudaGraph_t graph;
+				if (cudaStreamEndCapture(stream, &graph) != cudaSuccess)
+				{
+					cudaGetLastError();
+					return false;
+				}
+
+				// Same kernels with other arguments: update in place
+				bool updated = false;
+				if (this->exec)
+				{
+#if CUDART_VERSION >= 12000
+					cudaGraphExecUpdateResultInfo info;
+					updated = cudaGraphExecUpdate(this->exec, graph, &info) == cudaSuccess;
+#else
+					cudaGraphNode_t node;
+					cudaGraphExecUpdateResult result;
+					updated = cudaGraphExecUpdate(this->exec, graph, &node, &result) == cudaSuccess;
+#endif
+					if (!updated)
+					{
+						cudaGetLastError();
+						cudaGraphExecDestroy(this->exec);
+						this->exec = nullptr;
+					}
+				}
+				if (!updated)
+				{
+#if CUDART_VERSION >= 12000
+					cudaError_t err = cudaGraphInstantiate(&this->exec, graph, 0);
+#else
+					cudaError_t err = cudaGraphInstantiate(&this->exec, graph, NULL, NULL, 0);
+#endif
+					if (err != cudaSuccess)
+						this->exec = nullptr;
+				}
+				cudaGraphDestroy(graph);
+				return this->exec != nullptr;
+			}
+
+			// Runs the captured kernels on stream with one launch
+			void launch(cudaStream_t stream)
+			{
+				if (this->exec)
+					cudaGraphLaunch(this->exec, stream);
+			}
+#endif
+
+#ifdef SKEPU_OPENCL
+			// Records the kernels launched by calls() for queue; false if the device has no command buffers,
+			// in which case the calls have run normally
+			template<typename Calls>
+			bool record_CL(cl_command_queue queue, Calls &&calls)
+			{
+				if (!this->loaded)
+					this->supported = CommandBufferAPI::load(queue, this->api), this->loaded = true;
+				if (!this->supported)
+				{
+					std::forward<Calls>(calls)();
+					return false;
+				}
+
+				if (this->buffer)
+					this->api.release(this->buffer);
+				cl_int err;
+				this->buffer = this->api.create(1, &queue, NULL, &err);
+				if (err != CL_SUCCESS)
+				{
+					this->buffer = nullptr;
+					std::forward<Calls>(calls)();
+					return false;
+				}
+
+				Recording recording {&this->api, this->buffer, CL_SUCCESS};
+				recording_CL() = &recording;
+				std::forward<Calls>(calls)();
+				recording_CL() = nullptr;
+
+				if (recording.status != CL_SUCCESS || this->api.finalize(this->buffer) != CL_SUCCESS)
+				{
+					this->api.release(this->buffer);
+					this->buffer = nullptr;
+					return false;
+				}
+				this->queue = queue;
+				return true;
+			}
+
+			void launch_CL()
+			{
+				if (this->buffer)
+					this->api.enqueue(1, &this->queue, this->buffer, 0, NULL, NULL);
+			}
+#endif
+
+		private:
+#ifdef SKEPU_CUDA
+			cudaGraphExec_t exec = nullptr;
+#endif
+#ifdef SKEPU_OPENCL
+			CommandBufferAPI api;
+			bool loaded = false;
+			bool supported = false;
+			void *buffer = nullptr;
+			cl_command_queue queue = nullptr;
+#endif
+		};
+	}
+}
+
+#ifdef SKEPU_OPENCL
+#define SKEPU_CL_ENQUEUE_KERNEL skepu::graph::enqueueKernel_CL
+#endif
+)~~~";
+
+
+std::string generateGraphSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_graph.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << GraphSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,105 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Host side of the Histogram skeleton. skepu::histogram::cpu and ::omp take the generated bin and combine
+ * functors and fill numBins output bins from init. The OpenMP variant gives every thread its own bin vector
+ * and merges them with the combine function afterwards, the CPU counterpart of the per-block privatization
+ * in the GPU kernels. A bin function returns either a bin index, counting 1 per element, or a
+ * (bin index, contribution) pair. Bin indices outside [0, numBins) are dropped. The bin vectors of the threads
+ * are skepu::partials rows, so the bins of neighbouring threads never share a cache line.
+ */
+static const char *HistogramSupport = R"~~~(
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+#ifdef SKEPU_OPENMP
+#include <omp.h>
+
+#include "skepu_partials.h"
+#endif
+
+namespace skepu
+{
+	namespace histogram
+	{
+		template<typename Bin, typename Value>
+		inline void contributionOf(Bin bin, size_t &index, Value &value)
+		{
+			index = static_cast<size_t>(bin);
+			value = Value(1);
+		}
+
+		template<typename Bin, typename Contribution, typename Value>
+		inline void contributionOf(std::tuple<Bin, Contribution> const& res, size_t &index, Value &value)
+		{
+			index = static_cast<size_t>(std::get<0>(res));
+			value = std::get<1>(res);
+		}
+
+		template<typename BinFunc, typename CombineFunc, typename In, typename Value>
+		void cpu(const In *input, size_t n, Value *output, size_t numBins, Value init)
+		{
+			for (size_t b = 0; b < numBins; ++b)
+				output[b] = init;
+
+			for (size_t i = 0; i < n; ++i)
+			{
+				size_t bin; Value value;
+				contributionOf(BinFunc::CPU(input[i]), bin, value);
+				if (bin < numBins)
+					output[bin] = CombineFunc::CPU(output[bin], value);
+			}
+		}
+
+#ifdef SKEPU_OPENMP
+		template<typename BinFunc, typename CombineFunc, typename In, typename Value>
+		void omp(const In *input, size_t n, Value *output, size_t numBins, Value init)
+		{
+			const size_t numThreads = omp_get_max_threads();
+			std::vector<partials::Row<Value>> subHistograms(numThreads, partials::Row<Value>(numBins, init));
+
+#pragma omp parallel
+			{
+				partials::Row<Value> &bins = subHistograms[omp_get_thread_num()];
+#pragma omp for schedule(static)
+				for (size_t i = 0; i < n; ++i)
+				{
+					size_t bin; Value value;
+					contributionOf(BinFunc::OMP(input[i]), bin, value);
+					if (bin < numBins)
+						bins[bin] = CombineFunc::OMP(bins[bin], value);
+				}
+			}
+
+#pragma omp parallel for schedule(static)
+			for (size_t b = 0; b < numBins; ++b)
+			{
+				Value result = subHistograms[0][b];
+				for (size_t t = 1; t < numThreads; ++t)
+					result = CombineFunc::OMP(result, subHistograms[t][b]);
+				output[b] = result;
+			}
+		}
+#endif
+	}
+}
+)~~~";
+
+
+std::string generateHistogramSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_histogram.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		if (GenOMP)
+			generatePartialsSupport(dir);
+		FSOutFile << HistogramSupport;
+		generated = true;
+	}
+	return fileName;
+}
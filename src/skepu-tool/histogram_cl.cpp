@@ -0,0 +1,220 @@
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+// Same privatization and merge as the CUDA kernels, see histogram_cu.cpp
+static const char *HistogramKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_Privatized(__global const {{INPUT_TYPE}} * restrict skepu_input, __global {{BIN_TYPE}} *skepu_partials, size_t skepu_n, size_t skepu_numBins, {{BIN_TYPE}} skepu_init,
+	__local {{BIN_TYPE}} *skepu_sdata, __local size_t *skepu_bins)
+{
+	size_t skepu_tid = get_local_id(0);
+	size_t skepu_blockSize = get_local_size(0);
+	size_t skepu_gridSize = skepu_blockSize * get_num_groups(0);
+
+	for (size_t skepu_b = skepu_tid; skepu_b < skepu_numBins; skepu_b += skepu_blockSize)
+		skepu_sdata[skepu_b] = skepu_init;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+{{ACCUMULATE}}
+
+	for (size_t skepu_b = skepu_tid; skepu_b < skepu_numBins; skepu_b += skepu_blockSize)
+		skepu_partials[get_group_id(0) * skepu_numBins + skepu_b] = skepu_sdata[skepu_b];
+}
+
+__kernel void {{KERNEL_NAME}}_Merge(__global {{BIN_TYPE}} *skepu_partials, __global {{BIN_TYPE}} *skepu_output, size_t skepu_numBins, size_t skepu_numPartials)
+{
+	for (size_t skepu_b = get_global_id(0); skepu_b < skepu_numBins; skepu_b += get_global_size(0))
+	{
+		{{BIN_TYPE}} skepu_result = skepu_partials[skepu_b];
+		for (size_t skepu_p = 1; skepu_p < skepu_numPartials; ++skepu_p)
+			skepu_result = {{FUNCTION_NAME_COMBINE}}(skepu_result, skepu_partials[skepu_p * skepu_numBins + skepu_b]);
+		skepu_output[skepu_b] = skepu_result;
+	}
+}
+)~~~";
+
+static const char *HistogramAtomicAccumulate_CL = R"~~~(
+	for (size_t skepu_i = get_global_id(0); skepu_i < skepu_n; skepu_i += skepu_gridSize)
+	{
+		{{BIN_CONTRIBUTION}}
+		if (skepu_bin < skepu_numBins)
+			atomic_add(&skepu_sdata[skepu_bin], skepu_value);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+)~~~";
+
+static const char *HistogramReductionAccumulate_CL = R"~~~(
+	__local {{BIN_TYPE}} *skepu_values = skepu_sdata + skepu_numBins;
+
+	for (size_t skepu_base = get_group_id(0) * skepu_blockSize; skepu_base < skepu_n; skepu_base += skepu_gridSize)
+	{
+		size_t skepu_i = skepu_base + skepu_tid;
+		skepu_bins[skepu_tid] = skepu_numBins;
+		if (skepu_i < skepu_n)
+		{
+			{{BIN_CONTRIBUTION}}
+			skepu_bins[skepu_tid] = skepu_bin;
+			skepu_values[skepu_tid] = skepu_value;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (size_t skepu_owned = skepu_tid; skepu_owned < skepu_numBins; skepu_owned += skepu_blockSize)
+		{
+			{{BIN_TYPE}} skepu_result = skepu_sdata[skepu_owned];
+			for (size_t skepu_j = 0; skepu_j < skepu_blockSize; ++skepu_j)
+				if (skepu_bins[skepu_j] == skepu_owned)
+					skepu_result = {{FUNCTION_NAME_COMBINE}}(skepu_result, skepu_values[skepu_j]);
+			skepu_sdata[skepu_owned] = skepu_result;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+)~~~";
+
+
+const std::string Constructor = R"~~~(
+class {{KERNEL_CLASS}}
+{
+public:
+
+	enum
+	{
+		KERNEL_PRIVATIZED = 0,
+		KERNEL_MERGE,
+		KERNEL_COUNT
+	};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
+	{
+		if (newkernel)
+		{
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
+			return nullptr;
+		}
+		else return skepu_kernel_table().get(deviceID, kerneltype);
+	}
+
+	static const std::string &skepu_source()
+	{
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_privatized = clCreateKernel(program, "{{KERNEL_NAME}}_Privatized", &err);
+		CL_CHECK_ERROR(err, "Error creating Histogram kernel '{{KERNEL_NAME}}'");
+
+		cl_kernel kernel_merge = clCreateKernel(program, "{{KERNEL_NAME}}_Merge", &err);
+		CL_CHECK_ERROR(err, "Error creating Histogram merge kernel '{{KERNEL_NAME}}'");
+
+		kernels(deviceID, KERNEL_PRIVATIZED, &kernel_privatized);
+		kernels(deviceID, KERNEL_MERGE,      &kernel_merge);
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
+	}
+
+	// skepu_partials holds numBins bins per work-group
+	static void histogram
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<const {{INPUT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<{{BIN_TYPE}}> *skepu_partials,
+		size_t skepu_n, size_t skepu_numBins, {{BIN_TYPE}} skepu_init
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_PRIVATIZED);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_partials->getDeviceDataPointer(), skepu_n, skepu_numBins, skepu_init);
+		clSetKernelArg(kernel, 5, sizeof({{BIN_TYPE}}) * (skepu_numBins + localSize), NULL);
+		clSetKernelArg(kernel, 6, sizeof(size_t) * localSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Histogram kernel");
+	}
+
+	static void merge
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{BIN_TYPE}}> *skepu_partials, skepu::backend::DeviceMemPointer_CL<{{BIN_TYPE}}> *skepu_output,
+		size_t skepu_numBins, size_t skepu_numPartials
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_MERGE);
+		skepu_cl_set_kernel_args(kernel, skepu_partials->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), skepu_numBins, skepu_numPartials);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Histogram merge kernel");
+	}
+};
+)~~~";
+
+
+std::string createHistogramKernelProgram_CL(SkeletonInstance &instance, UserFunction &binFunc, UserFunction &combineFunc, std::string dir)
+{
+	std::stringstream sourceStream, SSContribution;
+	const std::string binType = combineFunc.resolvedReturnTypeName;
+	const bool atomic = histogramUsesAtomics(combineFunc, {"int", "unsigned int"});
+
+	sourceStream << precisionExtensions_CL({&binFunc, &combineFunc});
+
+	// Include user constants as preprocessor macros
+	for (auto pair : UserConstants)
+		sourceStream << "#define " << pair.second->name << " (" << pair.second->definition << ") // " << pair.second->typeName << "\n";
+
+	std::set<UserType*> referencedUTs = binFunc.ReferencedUTs;
+	referencedUTs.insert(combineFunc.ReferencedUTs.begin(), combineFunc.ReferencedUTs.end());
+	for (UserType *RefType : referencedUTs)
+		sourceStream << generateUserTypeCode_CL(*RefType);
+
+	if (binFunc.multipleReturnTypes.size() == 2)
+		SSContribution << binFunc.multiReturnTypeNameGPU() << " skepu_res = " << binFunc.uniqueName << "(skepu_input[skepu_i]);\n"
+			<< "size_t skepu_bin = skepu_res.e0;\n" << binType << " skepu_value = skepu_res.e1;";
+	else
+		SSContribution << "size_t skepu_bin = " << binFunc.uniqueName << "(skepu_input[skepu_i]);\n"
+			<< binType << " skepu_value = 1;";
+
+	sourceStream << KernelPredefinedTypes_CL;
+	if (binFunc.refersTo(combineFunc))
+		sourceStream << generateUserFunctionCode_CL(binFunc);
+	else if (combineFunc.refersTo(binFunc))
+		sourceStream << generateUserFunctionCode_CL(combineFunc);
+	else
+		sourceStream << generateUserFunctionCode_CL(binFunc) << generateUserFunctionCode_CL(combineFunc);
+	sourceStream << templateString(HistogramKernelTemplate_CL,
+	{
+		{"{{ACCUMULATE}}",         atomic ? HistogramAtomicAccumulate_CL : HistogramReductionAccumulate_CL},
+		{"{{BIN_CONTRIBUTION}}",   SSContribution.str()}
+	});
+
+	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_HistogramKernel_" + binFunc.uniqueName + "_" + combineFunc.uniqueName;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
+	{
+		{"{{OPENCL_KERNEL}}",         sourceStream.str()},
+		{"{{KERNEL_CLASS}}",          "CLWrapperClass_" + kernelName},
+		{"{{INPUT_TYPE}}",            binFunc.elwiseParams[0].typeNameOpenCL()},
+		{"{{BIN_TYPE}}",              binType},
+		{"{{KERNEL_NAME}}",           kernelName},
+		{"{{FUNCTION_NAME_COMBINE}}", combineFunc.uniqueName}
+	}), dir);
+}
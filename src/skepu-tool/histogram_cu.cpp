@@ -0,0 +1,113 @@
+#include "code_gen.h"
+#include "code_gen_cu.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  Each block builds a privatized sub-histogram of skepu_numBins bins in shared memory, starting from skepu_init
+ *  (the identity of the combine function), and writes it to its row of skepu_partials. The _Merge kernel then
+ *  combines the rows bin by bin. Dynamic shared memory: skepu_numBins * sizeof(type), plus blockDim.x *
+ *  sizeof(type) for the reduction accumulation. Bin indices outside [0, skepu_numBins) are dropped.
+ */
+static const char *HistogramKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_Privatized(const {{INPUT_TYPE}} * __restrict__ skepu_input, {{BIN_TYPE}} *skepu_partials, size_t skepu_n, size_t skepu_numBins, {{BIN_TYPE}} skepu_init)
+{
+	extern __shared__ {{BIN_TYPE}} {{SHARED_BUFFER}}[];
+	size_t skepu_tid = threadIdx.x;
+	size_t skepu_gridSize = blockDim.x * gridDim.x;
+
+	for (size_t skepu_b = skepu_tid; skepu_b < skepu_numBins; skepu_b += blockDim.x)
+		{{SHARED_BUFFER}}[skepu_b] = skepu_init;
+	__syncthreads();
+
+{{ACCUMULATE}}
+
+	for (size_t skepu_b = skepu_tid; skepu_b < skepu_numBins; skepu_b += blockDim.x)
+		skepu_partials[blockIdx.x * skepu_numBins + skepu_b] = {{SHARED_BUFFER}}[skepu_b];
+}
+
+__global__ void {{KERNEL_NAME}}_Merge({{BIN_TYPE}} *skepu_partials, {{BIN_TYPE}} *skepu_output, size_t skepu_numBins, size_t skepu_numPartials)
+{
+	for (size_t skepu_b = blockIdx.x * blockDim.x + threadIdx.x; skepu_b < skepu_numBins; skepu_b += blockDim.x * gridDim.x)
+	{
+		{{BIN_TYPE}} skepu_result = skepu_partials[skepu_b];
+		for (size_t skepu_p = 1; skepu_p < skepu_numPartials; ++skepu_p)
+			skepu_result = {{FUNCTION_NAME_COMBINE}}(skepu_result, skepu_partials[skepu_p * skepu_numBins + skepu_b]);
+		skepu_output[skepu_b] = skepu_result;
+	}
+}
+)~~~";
+
+// Integer counts and float sums go straight into the shared bins
+static const char *HistogramAtomicAccumulate_CU = R"~~~(
+	for (size_t skepu_i = blockIdx.x * blockDim.x + skepu_tid; skepu_i < skepu_n; skepu_i += skepu_gridSize)
+	{
+		{{BIN_CONTRIBUTION}}
+		if (skepu_bin < skepu_numBins)
+			atomicAdd(&{{SHARED_BUFFER}}[skepu_bin], skepu_value);
+	}
+	__syncthreads();
+)~~~";
+
+// Any other combine function: the block bins one tile of elements at a time, and each thread folds the tile's
+// contributions to the bins it owns, so no two threads ever update the same bin
+static const char *HistogramReductionAccumulate_CU = R"~~~(
+	__shared__ size_t skepu_bins[1024];
+	{{BIN_TYPE}} *skepu_values = {{SHARED_BUFFER}} + skepu_numBins;
+
+	for (size_t skepu_base = blockIdx.x * blockDim.x; skepu_base < skepu_n; skepu_base += skepu_gridSize)
+	{
+		size_t skepu_i = skepu_base + skepu_tid;
+		skepu_bins[skepu_tid] = skepu_numBins;
+		if (skepu_i < skepu_n)
+		{
+			{{BIN_CONTRIBUTION}}
+			skepu_bins[skepu_tid] = skepu_bin;
+			skepu_values[skepu_tid] = skepu_value;
+		}
+		__syncthreads();
+
+		for (size_t skepu_owned = skepu_tid; skepu_owned < skepu_numBins; skepu_owned += blockDim.x)
+		{
+			{{BIN_TYPE}} skepu_result = {{SHARED_BUFFER}}[skepu_owned];
+			for (size_t skepu_j = 0; skepu_j < blockDim.x; ++skepu_j)
+				if (skepu_bins[skepu_j] == skepu_owned)
+					skepu_result = {{FUNCTION_NAME_COMBINE}}(skepu_result, skepu_values[skepu_j]);
+			{{SHARED_BUFFER}}[skepu_owned] = skepu_result;
+		}
+		__syncthreads();
+	}
+)~~~";
+
+
+std::string createHistogramKernelProgram_CU(SkeletonInstance &instance, UserFunction &binFunc, UserFunction &combineFunc, std::string dir)
+{
+	const std::string binType = combineFunc.resolvedReturnTypeName;
+	const bool atomic = histogramUsesAtomics(combineFunc, {"int", "unsigned int", "unsigned long long", "float"});
+
+	std::stringstream SSContribution;
+	if (binFunc.multipleReturnTypes.size() == 2)
+		SSContribution << "auto skepu_res = " << binFunc.funcNameCUDA() << "(skepu_input[skepu_i]);\n"
+			<< "size_t skepu_bin = skepu_res.e0;\n" << binType << " skepu_value = skepu_res.e1;";
+	else
+		SSContribution << "size_t skepu_bin = " << binFunc.funcNameCUDA() << "(skepu_input[skepu_i]);\n"
+			<< binType << " skepu_value = 1;";
+
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_HistogramKernel_" + binFunc.uniqueName + "_" + combineFunc.uniqueName;
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(HistogramKernelTemplate_CU,
+	{
+		{"{{ACCUMULATE}}",            atomic ? HistogramAtomicAccumulate_CU : HistogramReductionAccumulate_CU},
+		{"{{BIN_CONTRIBUTION}}",      SSContribution.str()},
+		{"{{INPUT_TYPE}}",            binFunc.elwiseParams[0].resolvedTypeName},
+		{"{{BIN_TYPE}}",              binType},
+		{"{{KERNEL_NAME}}",           kernelName},
+		{"{{FUNCTION_NAME_COMBINE}}", combineFunc.funcNameCUDA()},
+		{"{{SHARED_BUFFER}}",         "sdata_" + instance}
+	});
+	return kernelName;
+}
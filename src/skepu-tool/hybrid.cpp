@@ -0,0 +1,282 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Hybrid execution for instances listed in -hybrid. A call of a Map or MapReduce instance on vectors is split
+ * in two: the OpenMP backend computes the first part of the elements on this thread, while a copy of the
+ * skeleton computes the rest on the GPU backend from a second thread, using the iterator interface, so the
+ * kernels get the offset of their part as skepu_base. A GPU backend configured for several devices splits its
+ * part further between them.
+ *
+ * The share of the CPU is adapted after every call from the measured throughput of both parts, smoothed over
+ * calls, so that both parts finish at the same time. Calls on fewer than MinSplit elements, with indexed or
+ * multi-output user functions, or with other arguments than vectors run whole on the instance backend.
+ * MapReduce combines the two partial results with the reduce function, so the start value has to be an
+ * identity of it.
+ */
+static const char *HybridSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace skepu
+{
+	namespace hybrid
+	{
+		constexpr size_t MinSplit = 1 << 14;
+
+		inline BackendSpec deviceSpec()
+		{
+#ifdef SKEPU_CUDA
+			return BackendSpec{Backend::Type::CUDA};
+#else
+			return BackendSpec{Backend::Type::OpenCL};
+#endif
+		}
+
+		// Share of the elements given to the CPU
+		class Ratio
+		{
+		public:
+			double cpuShare() const { return this->share; }
+
+			void update(size_t cpuElements, double cpuTime, size_t deviceElements, double deviceTime)
+			{
+				if (cpuElements == 0 || deviceElements == 0 || cpuTime <= 0 || deviceTime <= 0)
+					return;
+				double cpuRate = cpuElements / cpuTime, deviceRate = deviceElements / deviceTime;
+				double balanced = cpuRate / (cpuRate + deviceRate);
+
+				// Both parts stay measurable, so that the share follows changes in load
+				this->share = std::min(0.98, std::max(0.02, 0.5 * this->share + 0.5 * balanced));
+			}
+
+		private:
+			double share = 0.25;
+		};
+
+		template<typename T> struct IsVector: std::false_type {};
+		template<typename T> struct IsVector<skepu::Vector<T>>: std::true_type {};
+
+		template<typename T>
+		using IsVectorArg = IsVector<typename std::remove_cv<typename std::remove_reference<T>::type>::type>;
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		// Elementwise arguments start at the part, the others are passed on
+		template<bool Elementwise>
+		struct Slice
+		{
+			template<typename Arg>
+			static Arg &of(Arg &arg, size_t) { return arg; }
+		};
+
+		template<>
+		struct Slice<true>
+		{
+			template<typename Arg>
+			static auto of(Arg &arg, size_t first) -> decltype(arg.begin() + first) { return arg.begin() + first; }
+		};
+
+		// A device may hold newer data of any argument, and the CPU part reads the host
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename... Args>
+		void updateHostAll(Args&... args)
+		{
+			int expand[] = {0, (updateHost(args, 0), 0)...};
+			(void)expand;
+		}
+
+		inline double seconds(std::chrono::steady_clock::time_point start)
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		template<typename Skeleton>
+		class Base: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			double cpuShare() const { return this->ratio.cpuShare(); }
+
+		protected:
+			// Runs cpu() on OpenMP and device() on the GPU backend concurrently, and adapts the share from their times
+			template<typename CPU, typename Device>
+			void split(size_t cpuElements, size_t deviceElements, CPU &&cpu, Device &&device)
+			{
+				if (!this->deviceSkeleton)
+					this->deviceSkeleton.reset(new Skeleton(static_cast<Skeleton const&>(*this)));
+				this->deviceSkeleton->setBackend(deviceSpec());
+
+				double deviceTime = 0;
+				std::thread worker([&]
+				{
+					auto start = std::chrono::steady_clock::now();
+					device(*this->deviceSkeleton);
+					deviceTime = seconds(start);
+				});
+
+				this->setBackend(BackendSpec{Backend::Type::OpenMP});
+				auto start = std::chrono::steady_clock::now();
+				cpu(static_cast<Skeleton&>(*this));
+				double cpuTime = seconds(start);
+				this->resetBackend();
+				worker.join();
+
+				this->ratio.update(cpuElements, cpuTime, deviceElements, deviceTime);
+			}
+
+			size_t splitPoint(size_t n) const
+			{
+				return size_t(n * this->ratio.cpuShare());
+			}
+
+		private:
+			std::unique_ptr<Skeleton> deviceSkeleton;
+			Ratio ratio;
+		};
+
+		template<typename Skeleton, typename UF>
+		class Map: public Base<Skeleton>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename UF::ElwiseArgs>::value;
+
+		public:
+			using Base<Skeleton>::Base;
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, splittable<Res, Args...>(typename Indices<sizeof...(Args)>::type{})>{},
+					std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename Res, typename... Args, size_t... I>
+			static constexpr bool splittable(Sequence<I...>)
+			{
+				return UF::outArity == 1 && !UF::indexed && elwise > 0 && IsVectorArg<Res>::value
+					&& All<(I >= elwise || IsVectorArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				size_t n = res.size();
+				if (n < MinSplit)
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<Args>(args)...);
+
+				size_t split = this->splitPoint(n);
+				updateHostAll(res, args...);
+				auto whole = typename Indices<sizeof...(Args)>::type{};
+				this->split(split, n - split,
+					[&](Skeleton &skeleton) { sliced(skeleton, res, 0, split, whole, args...); },
+					[&](Skeleton &skeleton) { sliced(skeleton, res, split, n, whole, args...); res.updateHost(); });
+				return std::forward<Res>(res);
+			}
+
+			template<typename Res, typename... Args, size_t... I>
+			static void sliced(Skeleton &skeleton, Res &res, size_t first, size_t last, Sequence<I...>, Args&... args)
+			{
+				if (last > first)
+					skeleton(res.begin() + first, res.begin() + last, Slice<(I < elwise)>::of(args, first)...);
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF>
+		class MapReduce: public Base<Skeleton>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename MapUF::ElwiseArgs>::value;
+
+		public:
+			using Base<Skeleton>::Base;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, splittable<Args...>(typename Indices<sizeof...(Args)>::type{})>{}, std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args, size_t... I>
+			static constexpr bool splittable(Sequence<I...>)
+			{
+				return MapUF::outArity == 1 && !MapUF::indexed && elwise > 0 && All<(I >= elwise || IsVectorArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename First, typename... Args>
+			auto call(std::true_type, First &&first, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...))
+			{
+				size_t n = first.size();
+				if (n < MinSplit)
+					return Skeleton::operator()(std::forward<First>(first), std::forward<Args>(args)...);
+
+				using R = decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...));
+				size_t split = this->splitPoint(n);
+				updateHostAll(first, args...);
+				auto rest = typename Indices<sizeof...(Args)>::type{};
+				R cpuPart {}, devicePart {};
+				this->split(split, n - split,
+					[&](Skeleton &skeleton) { cpuPart = sliced(skeleton, first, 0, split, rest, args...); },
+					[&](Skeleton &skeleton) { devicePart = sliced(skeleton, first, split, n, rest, args...); });
+				return ReduceUF::CPU(cpuPart, devicePart);
+			}
+
+			// The remaining elementwise arguments follow the first, at positions 0 to elwise - 2
+			template<typename First, typename... Args, size_t... I>
+			static auto sliced(Skeleton &skeleton, First &first, size_t begin, size_t end, Sequence<I...>, Args&... args)
+				-> decltype(skeleton(first.begin(), first.begin(), Slice<(I + 1 < elwise)>::of(args, 0)...))
+			{
+				return skeleton(first.begin() + begin, first.begin() + end, Slice<(I + 1 < elwise)>::of(args, begin)...);
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateHybridSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_hybrid.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << HybridSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,111 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Host side of the Gather and Scatter skeletons. skepu::gather::cpu and ::omp compute output[i] = f(input[index[i]]),
+ * leaving output[i] unchanged for indices at or past inputSize. skepu::scatter::cpu and ::omp fold f(input[i]) into
+ * output[index[i]] with the combine function, in input order per target, and drop indices at or past outputSize.
+ * skepu::indirect::localityOrder sorts the positions stably by their index; it orders the gathers of the GPU
+ * kernels for locality and gives the segmented scatters their runs. The OpenMP scatter splits that order into one
+ * range of runs per thread, so every target is combined by exactly one thread.
+ */
+static const char *IndirectSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#ifdef SKEPU_OPENMP
+#include <omp.h>
+#endif
+
+namespace skepu
+{
+	namespace indirect
+	{
+		inline void localityOrder(const size_t *index, size_t n, size_t *order)
+		{
+			std::iota(order, order + n, size_t(0));
+			std::stable_sort(order, order + n, [index](size_t a, size_t b) { return index[a] < index[b]; });
+		}
+	}
+
+	namespace gather
+	{
+		template<typename GatherFunc, typename In, typename Out>
+		void cpu(const In *input, size_t inputSize, const size_t *index, Out *output, size_t n)
+		{
+			for (size_t i = 0; i < n; ++i)
+				if (index[i] < inputSize)
+					output[i] = GatherFunc::CPU(input[index[i]]);
+		}
+
+#ifdef SKEPU_OPENMP
+		template<typename GatherFunc, typename In, typename Out>
+		void omp(const In *input, size_t inputSize, const size_t *index, Out *output, size_t n)
+		{
+#pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < n; ++i)
+				if (index[i] < inputSize)
+					output[i] = GatherFunc::OMP(input[index[i]]);
+		}
+#endif
+	}
+
+	namespace scatter
+	{
+		template<typename ScatterFunc, typename CombineFunc, typename In, typename Value>
+		void cpu(const In *input, const size_t *index, size_t n, Value *output, size_t outputSize)
+		{
+			for (size_t i = 0; i < n; ++i)
+				if (index[i] < outputSize)
+					output[index[i]] = CombineFunc::CPU(output[index[i]], ScatterFunc::CPU(input[i]));
+		}
+
+#ifdef SKEPU_OPENMP
+		template<typename ScatterFunc, typename CombineFunc, typename In, typename Value>
+		void omp(const In *input, const size_t *index, size_t n, Value *output, size_t outputSize)
+		{
+			std::vector<size_t> order(n);
+			indirect::localityOrder(index, n, order.data());
+
+			const size_t chunks = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), n));
+			std::vector<size_t> bounds(chunks + 1);
+			for (size_t c = 0; c <= chunks; ++c)
+			{
+				// Move every bound forward to the head of a run
+				size_t k = n * c / chunks;
+				while (k > 0 && k < n && index[order[k]] == index[order[k - 1]])
+					++k;
+				bounds[c] = k;
+			}
+
+#pragma omp parallel for schedule(static)
+			for (size_t c = 0; c < chunks; ++c)
+				for (size_t k = bounds[c]; k < bounds[c + 1]; ++k)
+				{
+					size_t target = index[order[k]];
+					if (target < outputSize)
+						output[target] = CombineFunc::OMP(output[target], ScatterFunc::OMP(input[order[k]]));
+				}
+		}
+#endif
+	}
+}
+)~~~";
+
+
+std::string generateIndirectSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_indirect.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << IndirectSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,265 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Runtime support for -instrument. The generated declaration of every instance wraps the backend skeleton in
+ * skepu::instrument::Instrumented, named after the instance and its source location. Each call is an NVTX range
+ * of that name when CUDA is enabled and the header-only NVTX 3 is available. OpenCL launches in the generated
+ * wrappers pass SKEPU_CL_EVENT as their event, which collects the events of the calling instance so that their
+ * profiling times can be read back after the call. This requires a queue created with CL_QUEUE_PROFILING_ENABLE,
+ * otherwise only the launches are counted.
+ *
+ * Calls synchronize the device before and after, so the wall time covers the device work at the cost of any
+ * overlap between instances. Bytes moved is the total size of the container arguments of each call. The
+ * per-instance totals are printed to stderr at exit, and written as CSV to $SKEPU_INSTRUMENT_REPORT if set.
+ * With -device-eviction the report also lists the evictions, write-backs and evicted bytes of each device.
+ */
+static const char *InstrumentSupport = R"~~~(
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#if defined(SKEPU_CUDA) && defined(__has_include)
+#if __has_include(<nvtx3/nvToolsExt.h>)
+#include <nvtx3/nvToolsExt.h>
+#define SKEPU_INSTRUMENT_NVTX 1
+#endif
+#endif
+
+namespace skepu
+{
+	namespace instrument
+	{
+		struct Stats
+		{
+			std::string name;
+			size_t calls = 0;
+			size_t launches = 0;
+			double seconds = 0;
+			double kernelSeconds = 0;
+			double bytes = 0;
+		};
+
+		class Registry
+		{
+		public:
+			static Registry &instance()
+			{
+				static Registry registry;
+				return registry;
+			}
+
+			Stats &stats(const std::string &name)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				Stats &stats = this->entries[name];
+				stats.name = name;
+				return stats;
+			}
+
+			void record(Stats &stats, double seconds, double kernelSeconds, size_t launches, double bytes)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				stats.calls += 1;
+				stats.launches += launches;
+				stats.seconds += seconds;
+				stats.kernelSeconds += kernelSeconds;
+				stats.bytes += bytes;
+			}
+
+			~Registry()
+			{
+				std::fprintf(stderr, "===-- SkePU instrumentation report --===\n");
+				std::fprintf(stderr, "%8s %10s %12s %12s %12s  %s\n", "calls", "launches", "time (s)", "kernel (s)", "GB moved", "instance");
+				for (auto const& entry : this->entries)
+				{
+					Stats const& s = entry.second;
+					std::fprintf(stderr, "%8zu %10zu %12.6f %12.6f %12.3f  %s\n", s.calls, s.launches, s.seconds, s.kernelSeconds, s.bytes * 1e-9, s.name.c_str());
+				}
+#ifdef SKEPU_EVICTION
+				auto evictions = skepu::eviction::Tracker::instance().statistics();
+				if (!evictions.empty())
+				{
+					std::fprintf(stderr, "%10s %11s %12s  %s\n", "evictions", "write-backs", "GB evicted", "device");
+					for (auto const& entry : evictions)
+						std::fprintf(stderr, "%10zu %11zu %12.3f  %#jx\n", entry.second.evictions, entry.second.writeBacks, entry.second.bytes * 1e-9, uintmax_t(entry.first));
+				}
+#endif
+
+				const char *path = std::getenv("SKEPU_INSTRUMENT_REPORT");
+				if (path && *path)
+					if (FILE *file = std::fopen(path, "w"))
+					{
+						std::fprintf(file, "instance,calls,launches,seconds,kernel_seconds,bytes\n");
+						for (auto const& entry : this->entries)
+						{
+							Stats const& s = entry.second;
+							std::fprintf(file, "\"%s\",%zu,%zu,%.9f,%.9f,%.0f\n", s.name.c_str(), s.calls, s.launches, s.seconds, s.kernelSeconds, s.bytes);
+						}
+#ifdef SKEPU_EVICTION
+						// Evictions of a device are a row whose calls are evictions, launches write-backs, bytes evicted
+						for (auto const& entry : evictions)
+							std::fprintf(file, "\"eviction:%#jx\",%zu,%zu,0,0,%.0f\n", uintmax_t(entry.first), entry.second.evictions, entry.second.writeBacks, entry.second.bytes);
+#endif
+						std::fclose(file);
+					}
+			}
+
+		private:
+			// The tracker is created first so that it outlives the report
+			Registry()
+			{
+#ifdef SKEPU_EVICTION
+				skepu::eviction::Tracker::instance();
+#endif
+			}
+
+			std::mutex lock;
+			std::map<std::string, Stats> entries;
+		};
+
+		inline void synchronize()
+		{
+#ifdef SKEPU_CUDA
+			cudaDeviceSynchronize();
+#endif
+		}
+
+#ifdef SKEPU_OPENCL
+		// Events of the OpenCL launches made by the innermost instrumented call on this thread
+		inline std::deque<cl_event> *&currentEvents()
+		{
+			static thread_local std::deque<cl_event> *events = nullptr;
+			return events;
+		}
+
+		inline cl_event *clEvent()
+		{
+			std::deque<cl_event> *events = currentEvents();
+			if (!events)
+				return NULL;
+			events->push_back(NULL);
+			return &events->back();
+		}
+#endif
+
+		template<typename T>
+		auto bytesOf(const T &arg, int) -> decltype(arg.size() * sizeof(typename T::value_type), double())
+		{
+			return static_cast<double>(arg.size() * sizeof(typename T::value_type));
+		}
+
+		template<typename T>
+		double bytesOf(const T &, long)
+		{
+			return 0;
+		}
+
+		template<typename... Args>
+		double bytesMoved(const Args&... args)
+		{
+			double bytes = 0;
+			for (double b : {0.0, bytesOf(args, 0)...})
+				bytes += b;
+			return bytes;
+		}
+
+		class Scope
+		{
+		public:
+			Scope(Stats &stats, double bytes): stats(stats), bytes(bytes)
+			{
+#ifdef SKEPU_INSTRUMENT_NVTX
+				nvtxRangePushA(stats.name.c_str());
+#endif
+#ifdef SKEPU_OPENCL
+				this->outer = currentEvents();
+				currentEvents() = &this->events;
+#endif
+				synchronize();
+				this->start = std::chrono::steady_clock::now();
+			}
+
+			~Scope()
+			{
+				synchronize();
+				size_t launches = 0;
+				double kernelSeconds = 0;
+#ifdef SKEPU_OPENCL
+				currentEvents() = this->outer;
+				for (cl_event event : this->events)
+				{
+					if (!event)
+						continue;
+					cl_ulong begin, end;
+					clWaitForEvents(1, &event);
+					if (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(begin), &begin, NULL) == CL_SUCCESS
+						&& clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) == CL_SUCCESS)
+						kernelSeconds += (end - begin) * 1e-9;
+					clReleaseEvent(event);
+					++launches;
+				}
+#endif
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+				Registry::instance().record(this->stats, seconds, kernelSeconds, launches, this->bytes);
+#ifdef SKEPU_INSTRUMENT_NVTX
+				nvtxRangePop();
+#endif
+			}
+
+		private:
+			Stats &stats;
+			double bytes;
+			std::chrono::steady_clock::time_point start;
+#ifdef SKEPU_OPENCL
+			std::deque<cl_event> events;
+			std::deque<cl_event> *outer;
+#endif
+		};
+
+		template<typename Skeleton>
+		class Instrumented: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			Instrumented(const char *name, CallArgs&&... args)
+			: Skeleton(std::forward<CallArgs>(args)...), stats(Registry::instance().stats(name)) {}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				Scope scope(this->stats, bytesMoved(args...));
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+		private:
+			Stats &stats;
+		};
+	}
+}
+
+#ifdef SKEPU_OPENCL
+#define SKEPU_CL_EVENT (skepu::instrument::clEvent())
+#endif
+)~~~";
+
+std::string generateInstrumentSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_instrument.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << InstrumentSupport;
+		generated = true;
+	}
+	return fileName;
+}
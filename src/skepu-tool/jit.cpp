@@ -0,0 +1,159 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Runtime support for -jit-specialize. The CUDA Map kernel of a listed instance gets a launcher that compiles an
+ * embedded copy of the kernel with NVRTC, with the uniform scalar arguments of the call defined as compile-time
+ * constants, so that loops bounded by them are unrolled and arithmetic on them folded. Modules are cached per
+ * device, kernel and set of values, so a value is compiled once per run. If NVRTC or loading the module fails,
+ * the launcher falls back to the precompiled kernel and reports the error once.
+ *
+ * Programs using it link libnvrtc and libcuda. The generated PTX is compiled by the driver for the device.
+ */
+static const char *JITSupport = R"~~~(
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <cuda.h>
+#include <nvrtc.h>
+
+namespace skepu
+{
+	namespace jit
+	{
+		template<typename T>
+		typename std::enable_if<std::is_floating_point<T>::value, std::string>::type literal(T value)
+		{
+			// Hexadecimal floating point keeps every bit of the value
+			char buffer[64];
+			snprintf(buffer, sizeof(buffer), "%a", (double)value);
+			return std::string(std::is_same<T, float>::value ? "(float)" : "(double)") + buffer;
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value, std::string>::type literal(T value)
+		{
+			if (std::is_same<T, bool>::value)
+				return value ? "true" : "false";
+			return std::is_signed<T>::value ? "(" + std::to_string((long long)value) + "ll)" : "(" + std::to_string((unsigned long long)value) + "ull)";
+		}
+
+		template<typename T>
+		std::string define(const char *name, T value)
+		{
+			return std::string("-D") + name + "=" + literal(value);
+		}
+
+		class Cache
+		{
+		public:
+			static Cache &instance()
+			{
+				static Cache cache;
+				return cache;
+			}
+
+			// Kernel compiled from source with the given options for the current device, nullptr on failure
+			CUfunction kernel(const char *name, const char *source, std::vector<std::string> const& options)
+			{
+				int device = 0;
+				cudaGetDevice(&device);
+				std::string key = std::to_string(device) + '\0' + name;
+				for (std::string const& option : options)
+					key += '\0' + option;
+
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->kernels.find(key);
+				if (it != this->kernels.end())
+					return it->second;
+				return this->kernels[key] = this->compile(device, name, source, options);
+			}
+
+		private:
+			std::mutex lock;
+			std::map<std::string, CUfunction> kernels;
+			bool reported = false;
+
+			CUfunction fail(const char *name, const std::string &message)
+			{
+				if (!this->reported)
+					fprintf(stderr, "[SkePU] JIT specialization of %s failed, using the precompiled kernel: %s\n", name, message.c_str());
+				this->reported = true;
+				return nullptr;
+			}
+
+			CUfunction compile(int device, const char *name, const char *source, std::vector<std::string> options)
+			{
+				int major = 0, minor = 0;
+				cudaDeviceGetAttribute(&major, cudaDevAttrComputeCapabilityMajor, device);
+				cudaDeviceGetAttribute(&minor, cudaDevAttrComputeCapabilityMinor, device);
+				options.push_back("--gpu-arch=compute_" + std::to_string(major * 10 + minor));
+				std::vector<const char*> args;
+				for (std::string const& option : options)
+					args.push_back(option.c_str());
+
+				nvrtcProgram program;
+				if (nvrtcCreateProgram(&program, source, name, 0, nullptr, nullptr) != NVRTC_SUCCESS)
+					return this->fail(name, "nvrtcCreateProgram");
+
+				nvrtcResult result = nvrtcCompileProgram(program, (int)args.size(), args.data());
+				if (result != NVRTC_SUCCESS)
+				{
+					size_t size = 0;
+					nvrtcGetProgramLogSize(program, &size);
+					std::string log(size, '\0');
+					nvrtcGetProgramLog(program, &log[0]);
+					nvrtcDestroyProgram(&program);
+					return this->fail(name, std::string(nvrtcGetErrorString(result)) + "\n" + log);
+				}
+
+				size_t size = 0;
+				nvrtcGetPTXSize(program, &size);
+				std::string ptx(size, '\0');
+				nvrtcGetPTX(program, &ptx[0]);
+				nvrtcDestroyProgram(&program);
+
+				// The runtime has made the primary context of the device current
+				CUmodule module;
+				CUfunction function;
+				if (cuModuleLoadData(&module, ptx.c_str()) != CUDA_SUCCESS)
+					return this->fail(name, "cuModuleLoadData");
+				if (cuModuleGetFunction(&function, module, name) != CUDA_SUCCESS)
+					return this->fail(name, "cuModuleGetFunction");
+				return function;
+			}
+		};
+
+		inline CUfunction kernel(const char *name, const char *source, std::vector<std::string> const& options)
+		{
+			return Cache::instance().kernel(name, source, options);
+		}
+
+		inline void launch(CUfunction function, dim3 grid, dim3 block, size_t sharedMem, cudaStream_t stream, void **args)
+		{
+			cuLaunchKernel(function, grid.x, grid.y, grid.z, block.x, block.y, block.z, (unsigned)sharedMem, (CUstream)stream, args, nullptr);
+		}
+	}
+}
+)~~~";
+
+
+std::string generateJITSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_jit.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << JITSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,244 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Deferred execution for -lazy Map instances. A call of a listed instance is recorded into the skeleton call
+ * graph of the current thread instead of running, together with the containers it reads and writes. The
+ * argument positions come from the user function struct: outArity outputs, then ElwiseArgs, ContainerArgs with
+ * anyAccessMode, and the uniform arguments, which are copied.
+ *
+ * flush runs the recorded calls in order, after dropping calls whose results are overwritten by a later call
+ * before anything reads them. Map outputs count as overwritten completely, skepu::write containers do not.
+ * Call flush, or need with a container, before the host reads a container written by a deferred call, and
+ * before such containers are destroyed. A deferred instance flushes the graph when it is destroyed. Calls
+ * with temporary containers or iterators as arguments flush the graph and run at once.
+ *
+ * Elementwise Map chains are merged at compile time by -fuse-maps, which also covers the instances here.
+ */
+static const char *LazySupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace lazy
+	{
+		struct Node
+		{
+			std::function<void()> run;
+			std::vector<const void*> reads;
+			std::vector<const void*> writes;
+			std::vector<const void*> overwrites;
+		};
+
+		class Graph
+		{
+		public:
+			static Graph &instance()
+			{
+				static thread_local Graph graph;
+				return graph;
+			}
+
+			void record(Node node)
+			{
+				this->nodes.push_back(std::move(node));
+			}
+
+			void flush()
+			{
+				// Recorded calls may record again if they flush themselves, so run a detached list
+				std::vector<Node> pending;
+				std::swap(pending, this->nodes);
+
+				// Backwards: a container is dead from its last overwrite until a read before it
+				std::set<const void*> dead;
+				std::vector<bool> keep(pending.size(), true);
+				for (size_t k = pending.size(); k-- > 0;)
+				{
+					// Only calls that overwrite all they write can be dropped, they have no other effect
+					Node &node = pending[k];
+					keep[k] = node.writes.empty() || node.writes.size() != node.overwrites.size()
+						|| !std::all_of(node.writes.begin(), node.writes.end(), [&](const void *c) { return dead.count(c) > 0; });
+					if (!keep[k])
+						continue;
+					for (const void *c : node.overwrites)
+						dead.insert(c);
+					for (const void *c : node.writes)
+						if (std::find(node.overwrites.begin(), node.overwrites.end(), c) == node.overwrites.end())
+							dead.erase(c);
+					for (const void *c : node.reads)
+						dead.erase(c);
+				}
+
+				this->dropped += std::count(keep.begin(), keep.end(), false);
+				for (size_t k = 0; k < pending.size(); ++k)
+					if (keep[k])
+						pending[k].run();
+			}
+
+			size_t size() const { return this->nodes.size(); }
+
+			// Calls left out by flush so far
+			size_t droppedCalls() const { return this->dropped; }
+
+		private:
+			std::vector<Node> nodes;
+			size_t dropped = 0;
+		};
+
+		inline void flush()
+		{
+			Graph::instance().flush();
+		}
+
+		// Makes container up to date on the host side of the graph; runs every recorded call
+		template<typename Container>
+		void need(Container const&)
+		{
+			flush();
+		}
+
+		template<typename T> struct IsContainer: std::false_type {};
+		template<typename T> struct IsContainer<skepu::Vector<T>>: std::true_type {};
+		template<typename T> struct IsContainer<skepu::Matrix<T>>: std::true_type {};
+		template<typename T> struct IsContainer<skepu::Tensor3<T>>: std::true_type {};
+		template<typename T> struct IsContainer<skepu::Tensor4<T>>: std::true_type {};
+		template<typename T> struct IsContainer<skepu::SparseMatrix<T>>: std::true_type {};
+
+		// Containers are kept by reference, uniform arguments by value
+		template<bool Uniform, typename T>
+		struct Stored
+		{
+			using type = typename std::conditional<Uniform, typename std::decay<T>::type,
+				std::reference_wrapper<typename std::remove_reference<T>::type>>::type;
+		};
+
+		template<typename R>
+		struct Result
+		{
+			template<typename First, typename... Rest>
+			static R of(First &&first, Rest&&...) { return std::forward<First>(first); }
+		};
+
+		template<>
+		struct Result<void>
+		{
+			template<typename... Args>
+			static void of(Args&&...) {}
+		};
+
+		template<typename Skeleton, typename UF>
+		class Deferred: public Skeleton
+		{
+			static constexpr size_t outputs = UF::outArity;
+			static constexpr size_t elwise = std::tuple_size<typename UF::ElwiseArgs>::value;
+			static constexpr size_t containers = std::tuple_size<typename UF::ContainerArgs>::value;
+
+		public:
+			using Skeleton::Skeleton;
+
+			~Deferred()
+			{
+				flush();
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				using R = decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...));
+				Node node;
+				bool deferrable = true;
+				size_t position = 0;
+				int expand[] = {0, (this->classify(node, deferrable, position++, std::is_lvalue_reference<Args&&>::value, &args), 0)...};
+				(void)expand;
+
+				if (!deferrable)
+				{
+					flush();
+					return Skeleton::operator()(std::forward<Args>(args)...);
+				}
+
+				auto stored = this->store(typename Indices<sizeof...(Args)>::type{}, args...);
+				node.run = [this, stored]() { this->call(*stored, typename Indices<sizeof...(Args)>::type{}); };
+				Graph::instance().record(std::move(node));
+				return Result<R>::of(std::forward<Args>(args)...);
+			}
+
+		private:
+			template<size_t... I> struct Sequence {};
+			template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+			template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+			template<typename T>
+			static T &unwrap(std::reference_wrapper<T> arg) { return arg.get(); }
+			template<typename T>
+			static T &unwrap(T &arg) { return arg; }
+
+			template<size_t... I, typename... Args>
+			static std::shared_ptr<std::tuple<typename Stored<(I >= outputs + elwise + containers), Args&>::type...>> store(Sequence<I...>, Args&... args)
+			{
+				return std::make_shared<std::tuple<typename Stored<(I >= outputs + elwise + containers), Args&>::type...>>(args...);
+			}
+
+			template<typename Tuple, size_t... I>
+			void call(Tuple &args, Sequence<I...>)
+			{
+				Skeleton::operator()(unwrap(std::get<I>(args))...);
+			}
+
+			template<typename T>
+			void classify(Node &node, bool &deferrable, size_t position, bool lvalue, T *arg)
+			{
+				if (position >= outputs + elwise + containers)
+					return;
+				// Iterators and temporaries do not identify the container they access
+				if (!lvalue || !IsContainer<typename std::remove_const<T>::type>::value)
+				{
+					deferrable = false;
+					return;
+				}
+				const void *c = static_cast<const void*>(arg);
+				if (position < outputs)
+				{
+					node.writes.push_back(c);
+					node.overwrites.push_back(c);
+				}
+				else if (position < outputs + elwise)
+					node.reads.push_back(c);
+				else
+				{
+					skepu::AccessMode mode = UF::anyAccessMode[position - outputs - elwise];
+					if (mode != skepu::AccessMode::Write)
+						node.reads.push_back(c);
+					if (mode != skepu::AccessMode::Read)
+						node.writes.push_back(c);
+				}
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateLazySupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_lazy.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << LazySupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -15,6 +15,7 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} {{SIZE_PARAMS}} {{STRIDE_PARAMS}
 	size_t skepu_gridSize = get_local_size(0) * get_num_groups(0);
 	{{CONTAINER_PROXIES}}
 	{{STRIDE_INIT}}
+	{{INDEX_SETUP}}
 
 	while (skepu_i < skepu_n)
 	{
@@ -23,10 +24,10 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} {{SIZE_PARAMS}} {{STRIDE_PARAMS}
 #if !{{USE_MULTIRETURN}}
 		skepu_output[skepu_i * skepu_stride_0] = {{FUNCTION_NAME_MAP}}({{MAP_ARGS}});
 #else
-		{{MULTI_TYPE}} skepu_out_temp = {{FUNCTION_NAME_MAP}}({{MAP_ARGS}});
-		{{OUTPUT_ASSIGN}}
+		{{MULTI_CALL}}
 #endif
 		skepu_i += skepu_gridSize;
+		{{INDEX_STEP}}
 	}
 }
 )~~~";
@@ -37,38 +38,60 @@ class {{KERNEL_CLASS}}
 {
 public:
 
-	static cl_kernel skepu_kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
+	enum
+	{
+		KERNEL_MAP = 0,
+		KERNEL_MAP_UNIT_STRIDE,
+		KERNEL_COUNT
+	};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel skepu_kernels(size_t deviceID, cl_kernel *newkernel = nullptr, size_t kerneltype = KERNEL_MAP)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
-
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating map kernel '{{KERNEL_NAME}}'");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating map kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_unit_stride = clCreateKernel(program, "{{KERNEL_NAME}}_UnitStride", &err);
+		CL_CHECK_ERROR(err, "Error creating map kernel '{{KERNEL_NAME}}_UnitStride'");
+
+		skepu_kernels(deviceID, &kernel);
+		skepu_kernels(deviceID, &kernel_unit_stride, KERNEL_MAP_UNIT_STRIDE);
+	}
 
-			skepu_kernels(counter++, &kernel);
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	{{TEMPLATE_HEADER}}
@@ -79,8 +102,9 @@ public:
 		size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides
 	)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(skepu_kernels(skepu_deviceID), {{KERNEL_ARGS}} {{SIZE_ARGS}} {{STRIDE_ARGS}} skepu_n, skepu_base);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(), skepu_kernels(skepu_deviceID), 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, NULL);
+		cl_kernel skepu_kernel = skepu_kernels(skepu_deviceID, nullptr, ({{UNIT_STRIDES}}) ? KERNEL_MAP_UNIT_STRIDE : KERNEL_MAP);
+		skepu_cl_set_kernel_args(skepu_kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}} {{STRIDE_ARGS}} skepu_n, skepu_base);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching Map kernel");
 	}
 };
@@ -90,7 +114,7 @@ public:
 std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapFunc, std::string dir)
 {
 	std::stringstream sourceStream, SSMapFuncArgs, SSKernelParamList, SSHostKernelParamList, SSKernelArgs;
-	std::stringstream SSStrideParams, SSStrideArgs, SSStrideInit;
+	std::stringstream SSStrideParams, SSStrideArgs, SSStrideInit, SSUnitStrideParams, SSUnitStrideInit, SSUnitStrides;
 	IndexCodeGen indexInfo = indexInitHelper_CL(mapFunc);
 	bool first = !indexInfo.hasIndex;
 	SSMapFuncArgs << indexInfo.mapFuncParam;
@@ -105,6 +129,7 @@ std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &
 		SSStrideParams << "int skepu_stride_" << stride_counter << ", ";
 		SSStrideArgs << "skepu_strides[" << stride_counter << "], ";
 		SSStrideInit << "if (skepu_stride_" << stride_counter << " < 0) { skepu_output" << namesuffix.str() << " += (-skepu_n + 1) * skepu_stride_" << stride_counter << "; }\n";
+		unitStrideHelper_CL(stride_counter, SSUnitStrideParams, SSUnitStrideInit, SSUnitStrides);
 		stride_counter++;
 	}
 	
@@ -115,7 +140,8 @@ std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &
 		SSStrideParams << "int skepu_stride_" << stride_counter << ", ";
 		SSStrideArgs << "skepu_strides[" << stride_counter << "], ";
 		SSStrideInit << "if (skepu_stride_" << stride_counter << " < 0) { " << param.name << " += (-skepu_n + 1) * skepu_stride_" << stride_counter << "; }\n";
-		SSKernelParamList << "__global " << param.typeNameOpenCL() << " *" << param.name << ", ";
+		unitStrideHelper_CL(stride_counter, SSUnitStrideParams, SSUnitStrideInit, SSUnitStrides);
+		SSKernelParamList << "__global const " << param.typeNameOpenCL() << " *" << param.name << ", ";
 		SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << param.resolvedTypeName << "> *" << param.name << ", ";
 		SSKernelArgs << param.name << "->getDeviceDataPointer(), ";
 		SSMapFuncArgs << param.name << "[skepu_i * skepu_stride_" << stride_counter++ << "]";
@@ -126,6 +152,7 @@ std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &
 	handleUserTypesConstantsAndPrecision_CL({&mapFunc}, sourceStream);
 	proxyCodeGenHelper_CL(argsInfo.containerProxyTypes, sourceStream);
 	sourceStream << generateUserFunctionCode_CL(mapFunc) << MapKernelTemplate_CL;
+	sourceStream << unitStrideKernel_CL(MapKernelTemplate_CL, SSUnitStrideParams.str(), SSUnitStrideInit.str());
 	
 	std::stringstream SSKernelName;
 	SSKernelName << instance << "_" << transformToCXXIdentifier(ResultName) << "_MapKernel_" << mapFunc.uniqueName << "_arity_" << mapFunc.Varity;
@@ -134,8 +161,17 @@ std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &
 	std::stringstream SSStrideCount;
 	SSStrideCount << (mapFunc.elwiseParams.size() + std::max<size_t>(1, mapFunc.multipleReturnTypes.size()));
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor,
+	// A multi-return function that stores its outputs writes each result straight to its output
+	std::string multiCall = mapFunc.multiReturnTypeNameGPU() + " skepu_out_temp = " + mapFunc.uniqueName + "(" + SSMapFuncArgs.str() + ");\n" + multiOutputAssign;
+	if (mapFunc.storesOutputs())
+	{
+		multiCall = mapFunc.uniqueName + "_store(" + SSMapFuncArgs.str();
+		for (size_t i = 0; i < mapFunc.multipleReturnTypes.size(); ++i)
+			multiCall += ((i > 0 || !SSMapFuncArgs.str().empty()) ? ", " : "") + std::string("&skepu_output_") + std::to_string(i) + "[skepu_i * skepu_stride_" + std::to_string(i) + "]";
+		multiCall += ");";
+	}
+	
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
 	{
 		{"{{OPENCL_KERNEL}}",          sourceStream.str()},
 		{"{{KERNEL_NAME}}",            kernelName},
@@ -143,7 +179,9 @@ std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &
 		{"{{KERNEL_PARAMS}}",          SSKernelParamList.str()},
 		{"{{HOST_KERNEL_PARAMS}}",     SSHostKernelParamList.str()},
 		{"{{MAP_ARGS}}",               SSMapFuncArgs.str()},
-		{"{{INDEX_INITIALIZER}}",      indexInfo.indexInit},
+		{"{{INDEX_INITIALIZER}}",      indexInfo.incremental.setup.empty() ? indexInfo.indexInit : ""},
+		{"{{INDEX_SETUP}}",            indexInfo.incremental.setup},
+		{"{{INDEX_STEP}}",             indexInfo.incremental.step},
 		{"{{KERNEL_CLASS}}",           "CLWrapperClass_" + kernelName},
 		{"{{KERNEL_ARGS}}",            SSKernelArgs.str()},
 		{"{{CONTAINER_PROXIES}}",      argsInfo.proxyInitializer},
@@ -155,11 +193,9 @@ std::string createMapKernelProgram_CL(SkeletonInstance &instance, UserFunction &
 		{"{{STRIDE_ARGS}}",            SSStrideArgs.str()},
 		{"{{STRIDE_COUNT}}",           SSStrideCount.str()},
 		{"{{STRIDE_INIT}}",            SSStrideInit.str()},
+		{"{{UNIT_STRIDES}}",           SSUnitStrides.str()},
 		{"{{TEMPLATE_HEADER}}",        indexInfo.templateHeader},
-		{"{{MULTI_TYPE}}",             mapFunc.multiReturnTypeNameGPU()},
 		{"{{USE_MULTIRETURN}}",        (mapFunc.multipleReturnTypes.size() > 0) ? "1" : "0"},
-		{"{{OUTPUT_ASSIGN}}",          multiOutputAssign}
-	});
-
-	return kernelName;
+		{"{{MULTI_CALL}}",             multiCall}
+	}), dir);
 }
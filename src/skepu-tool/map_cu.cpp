@@ -7,33 +7,451 @@ using namespace clang;
 // Kernel templates
 // ------------------------------
 
+// Instantiated for skepu_unit_strides = true as well for -unit-stride instances, where all stride arithmetic folds away
 const char *MapKernelTemplate_CU = R"~~~(
+template<bool skepu_unit_strides>
 __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides)
 {
 	size_t skepu_i = blockIdx.x * blockDim.x + threadIdx.x;
 	size_t skepu_global_prng_id = skepu_i;
 	size_t skepu_gridSize = blockDim.x * gridDim.x;
 	{{PROXIES_INIT}}
-	{{STRIDE_INIT}}
+	{{INDEX_SETUP}}
+	if (!skepu_unit_strides)
+	{
+		{{STRIDE_INIT}}
+	}
 
 	while (skepu_i < skepu_n)
 	{
 		{{INDEX_INITIALIZER}}
 		{{PROXIES_UPDATE}}
-		auto skepu_res = {{FUNCTION_NAME_MAP}}({{MAP_ARGS}});
-		{{OUTPUT_BINDINGS}}
+		{{MAP_CALL}}
 		skepu_i += skepu_gridSize;
+		{{INDEX_STEP}}
+	}
+}
+)~~~";
+
+/*!
+ *  Persistent-thread variant for instances listed in -map-dynamic, taking the arguments of the strided kernel. It is
+ *  launched with just enough blocks to fill the device (the minimum grid size of its launch metadata), and every warp
+ *  fetches the next SKEPU_DYNAMIC_CHUNK elements from a global work counter until none are left, so warps that drew
+ *  cheap elements keep taking work instead of idling while others finish expensive ones. The last block to finish
+ *  resets the counters for the next launch, so launches of one instance on a device must be ordered on one stream.
+ *  Requires a block size that is a multiple of 32.
+ */
+const char *MapDynamicKernelTemplate_CU = R"~~~(
+#define SKEPU_DYNAMIC_CHUNK 64
+
+__device__ unsigned long long {{KERNEL_NAME}}_DynamicNext;
+__device__ unsigned int {{KERNEL_NAME}}_DynamicDone;
+
+template<bool skepu_unit_strides>
+__global__ void {{KERNEL_NAME}}_Dynamic({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides)
+{
+	size_t skepu_lane = threadIdx.x % 32;
+	{{PROXIES_INIT}}
+	if (!skepu_unit_strides)
+	{
+		{{STRIDE_INIT}}
+	}
+
+	while (true)
+	{
+		unsigned long long skepu_first = 0;
+		if (skepu_lane == 0)
+			skepu_first = atomicAdd(&{{KERNEL_NAME}}_DynamicNext, SKEPU_DYNAMIC_CHUNK);
+		skepu_first = __shfl_sync(0xffffffffu, skepu_first, 0);
+		if (skepu_first >= skepu_n)
+			break;
+
+		size_t skepu_end = min((size_t)skepu_first + SKEPU_DYNAMIC_CHUNK, skepu_n);
+		for (size_t skepu_i = skepu_first + skepu_lane; skepu_i < skepu_end; skepu_i += 32)
+		{
+			{{INDEX_INITIALIZER}}
+			{{PROXIES_UPDATE}}
+			{{MAP_CALL}}
+		}
+	}
+
+	__syncthreads();
+	if (threadIdx.x == 0)
+	{
+		__threadfence();
+		if (atomicAdd(&{{KERNEL_NAME}}_DynamicDone, 1) == gridDim.x - 1)
+		{
+			{{KERNEL_NAME}}_DynamicNext = 0;
+			{{KERNEL_NAME}}_DynamicDone = 0;
+		}
+	}
+}
+
+#undef SKEPU_DYNAMIC_CHUNK
+)~~~";
+
+// Unit-stride variant: each thread handles chunks of {{VECTOR_WIDTH}} consecutive elements, reading and writing them
+// with vector loads and stores, followed by a scalar peel for the tail. Requires all pointers aligned to the vector type.
+const char *MapVectorizedKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_Vectorized({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base)
+{
+	size_t skepu_thread = blockIdx.x * blockDim.x + threadIdx.x;
+	size_t skepu_gridSize = blockDim.x * gridDim.x;
+	size_t skepu_chunks = skepu_n / {{VECTOR_WIDTH}};
+	{{PROXIES_INIT}}
+
+	for (size_t skepu_chunk = skepu_thread; skepu_chunk < skepu_chunks; skepu_chunk += skepu_gridSize)
+	{
+		{{VECTOR_LOADS}}
+		#pragma unroll
+		for (size_t skepu_lane = 0; skepu_lane < {{VECTOR_WIDTH}}; ++skepu_lane)
+		{
+			size_t skepu_i = skepu_chunk * {{VECTOR_WIDTH}} + skepu_lane;
+			{{INDEX_INITIALIZER}}
+			{{PROXIES_UPDATE}}
+			{{VECTOR_MAP_CALL}}
+		}
+		{{VECTOR_STORES}}
+	}
+
+	for (size_t skepu_i = skepu_chunks * {{VECTOR_WIDTH}} + skepu_thread; skepu_i < skepu_n; skepu_i += skepu_gridSize)
+	{
+		{{INDEX_INITIALIZER}}
+		{{PROXIES_UPDATE}}
+		{{MAP_CALL_UNIT}}
 	}
 }
 )~~~";
 
+/*!
+ *  CSR sparse matrix-vector product for Map instances listed in -spmv. Each row is handled by a group of
+ *  skepu_vector consecutive lanes, which stride over the row's nonzeros and combine their partial sums with
+ *  warp shuffles. Rows are assigned per warp so that every lane of a warp takes part in each shuffle.
+ *  The host launcher picks the group width from the mean row length, up to a full warp per row for long rows.
+ *  Requires a block size that is a multiple of 32.
+ */
+const char *MapSpMVKernelTemplate_CU = R"~~~(
+template<unsigned int skepu_vector>
+__global__ void {{KERNEL_NAME}}_SpMVKernel({{TYPE}} *skepu_output, const {{TYPE}} * __restrict__ skepu_values, const size_t * __restrict__ skepu_row_offsets,
+	const size_t * __restrict__ skepu_col_indices, const {{TYPE}} * __restrict__ skepu_x, size_t skepu_rows)
+{
+	constexpr size_t skepu_rowsPerWarp = 32 / skepu_vector;
+	size_t skepu_thread = blockIdx.x * blockDim.x + threadIdx.x;
+	size_t skepu_lane = threadIdx.x % skepu_vector;
+	size_t skepu_stride = (blockDim.x * gridDim.x) / skepu_vector;
+
+	for (size_t skepu_warpRow = (skepu_thread / 32) * skepu_rowsPerWarp; skepu_warpRow < skepu_rows; skepu_warpRow += skepu_stride)
+	{
+		size_t skepu_row = skepu_warpRow + (threadIdx.x % 32) / skepu_vector;
+		{{TYPE}} skepu_sum = 0;
+		if (skepu_row < skepu_rows)
+			for (size_t skepu_k = skepu_row_offsets[skepu_row] + skepu_lane; skepu_k < skepu_row_offsets[skepu_row + 1]; skepu_k += skepu_vector)
+				skepu_sum += skepu_values[skepu_k] * __ldg(&skepu_x[skepu_col_indices[skepu_k]]);
 
-std::string createMapKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapFunc, size_t arity, std::string dir)
+		for (unsigned int skepu_offset = skepu_vector / 2; skepu_offset > 0; skepu_offset /= 2)
+			skepu_sum += __shfl_down_sync(0xffffffffu, skepu_sum, skepu_offset, skepu_vector);
+
+		if (skepu_row < skepu_rows && skepu_lane == 0)
+			skepu_output[skepu_row] = skepu_sum;
+	}
+}
+
+static void {{KERNEL_NAME}}_SpMV(size_t skepu_numBlocks, size_t skepu_numThreads, cudaStream_t skepu_stream, {{TYPE}} *skepu_output, const {{TYPE}} *skepu_values,
+	const size_t *skepu_row_offsets, const size_t *skepu_col_indices, const {{TYPE}} *skepu_x, size_t skepu_rows, size_t skepu_nnz)
+{
+	size_t skepu_meanRow = skepu_rows ? skepu_nnz / skepu_rows : 0;
+	if (skepu_meanRow > 16)
+		{{KERNEL_NAME}}_SpMVKernel<32><<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_values, skepu_row_offsets, skepu_col_indices, skepu_x, skepu_rows);
+	else if (skepu_meanRow > 8)
+		{{KERNEL_NAME}}_SpMVKernel<16><<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_values, skepu_row_offsets, skepu_col_indices, skepu_x, skepu_rows);
+	else if (skepu_meanRow > 4)
+		{{KERNEL_NAME}}_SpMVKernel<8><<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_values, skepu_row_offsets, skepu_col_indices, skepu_x, skepu_rows);
+	else if (skepu_meanRow > 2)
+		{{KERNEL_NAME}}_SpMVKernel<4><<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_values, skepu_row_offsets, skepu_col_indices, skepu_x, skepu_rows);
+	else if (skepu_meanRow > 1)
+		{{KERNEL_NAME}}_SpMVKernel<2><<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_values, skepu_row_offsets, skepu_col_indices, skepu_x, skepu_rows);
+	else
+		{{KERNEL_NAME}}_SpMVKernel<1><<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_values, skepu_row_offsets, skepu_col_indices, skepu_x, skepu_rows);
+}
+)~~~";
+
+/*!
+ *  SELL-C-sigma variant for instances listed in -spmv-sell, see skepu_sell.h for the layout. One thread per row
+ *  of the sorted order: the lanes of a warp form one slice and read consecutive elements of each padded slice
+ *  column, and sorting by length keeps their trip counts close.
+ */
+const char *MapSpMVSellKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_SpMVSellKernel({{TYPE}} *skepu_output, const {{TYPE}} * __restrict__ skepu_values, const size_t * __restrict__ skepu_col_indices,
+	const size_t * __restrict__ skepu_slice_offsets, const size_t * __restrict__ skepu_row_lengths, const size_t * __restrict__ skepu_perm, const {{TYPE}} * __restrict__ skepu_x, size_t skepu_rows)
+{
+	constexpr size_t skepu_C = skepu::sell::SliceHeight;
+	for (size_t skepu_r = blockIdx.x * blockDim.x + threadIdx.x; skepu_r < skepu_rows; skepu_r += blockDim.x * gridDim.x)
+	{
+		size_t skepu_base = skepu_slice_offsets[skepu_r / skepu_C] + skepu_r % skepu_C;
+		{{TYPE}} skepu_sum = 0;
+		for (size_t skepu_j = 0; skepu_j < skepu_row_lengths[skepu_r]; ++skepu_j)
+			skepu_sum += skepu_values[skepu_base + skepu_j * skepu_C] * __ldg(&skepu_x[skepu_col_indices[skepu_base + skepu_j * skepu_C]]);
+		skepu_output[skepu_perm[skepu_r]] = skepu_sum;
+	}
+}
+
+static void {{KERNEL_NAME}}_SpMVSell(size_t skepu_numBlocks, size_t skepu_numThreads, cudaStream_t skepu_stream, {{TYPE}} *skepu_output,
+	skepu::sell::DeviceLayout<{{TYPE}}> const& skepu_matrix, const {{TYPE}} *skepu_x)
+{
+	{{KERNEL_NAME}}_SpMVSellKernel<<<skepu_numBlocks, skepu_numThreads, 0, skepu_stream>>>(skepu_output, skepu_matrix.values, skepu_matrix.col_indices,
+		skepu_matrix.slice_offsets, skepu_matrix.row_lengths, skepu_matrix.perm, skepu_x, skepu_matrix.rows);
+}
+)~~~";
+
+/*!
+ *  Tiled matrix product for -tiled-gemm Map instances whose user function is sum_k row(k) * col(k) over a MatRow and a MatCol,
+ *  see useTiledGEMM_CU. Each block computes a skepu_tile x skepu_tile block of the output, staging matching tiles
+ *  of the row and column matrices in shared memory, so every element read from global memory is used
+ *  skepu_tile times. The terms are summed in the same order as the user function.
+ *  The launcher takes the arguments of the strided kernel. Calls over whole output rows with unit strides use
+ *  the tiled kernel, other calls run the strided kernel.
+ */
+const char *MapGEMMKernelTemplate_CU = R"~~~(
+template<size_t skepu_tile>
+__global__ void {{KERNEL_NAME}}_GEMMKernel({{TYPE}} *skepu_output, const {{TYPE}} * __restrict__ skepu_A, const {{TYPE}} * __restrict__ skepu_B,
+	size_t skepu_rows, size_t skepu_cols, size_t skepu_inner)
+{
+	__shared__ {{TYPE}} skepu_tileA[skepu_tile][skepu_tile];
+	__shared__ {{TYPE}} skepu_tileB[skepu_tile][skepu_tile];
+	size_t skepu_row = blockIdx.y * skepu_tile + threadIdx.y;
+	size_t skepu_col = blockIdx.x * skepu_tile + threadIdx.x;
+	{{TYPE}} skepu_sum = 0;
+
+	for (size_t skepu_k0 = 0; skepu_k0 < skepu_inner; skepu_k0 += skepu_tile)
+	{
+		size_t skepu_ka = skepu_k0 + threadIdx.x, skepu_kb = skepu_k0 + threadIdx.y;
+		skepu_tileA[threadIdx.y][threadIdx.x] = (skepu_row < skepu_rows && skepu_ka < skepu_inner) ? skepu_A[skepu_row * skepu_inner + skepu_ka] : {{TYPE}}(0);
+		skepu_tileB[threadIdx.y][threadIdx.x] = (skepu_kb < skepu_inner && skepu_col < skepu_cols) ? skepu_B[skepu_kb * skepu_cols + skepu_col] : {{TYPE}}(0);
+		__syncthreads();
+
+		size_t skepu_kEnd = skepu_inner - skepu_k0 < skepu_tile ? skepu_inner - skepu_k0 : skepu_tile;
+		#pragma unroll
+		for (size_t skepu_k = 0; skepu_k < skepu_tile; ++skepu_k)
+			if (skepu_k < skepu_kEnd)
+				skepu_sum += skepu_tileA[threadIdx.y][skepu_k] * skepu_tileB[skepu_k][threadIdx.x];
+		__syncthreads();
+	}
+
+	if (skepu_row < skepu_rows && skepu_col < skepu_cols)
+		skepu_output[skepu_row * skepu_cols + skepu_col] = skepu_sum;
+}
+
+static void {{KERNEL_NAME}}_GEMM(dim3 skepu_grid, dim3 skepu_block, size_t skepu_sharedMem, cudaStream_t skepu_stream,
+	{{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides)
+{
+	if (skepu_strides[0] != 1 || skepu_w2 == 0 || skepu_w2 != {{COL_PARAM}}.cols || skepu_base % skepu_w2 != 0 || skepu_n % skepu_w2 != 0)
+	{
+		{{KERNEL_NAME}}<false><<<skepu_grid, skepu_block, skepu_sharedMem, skepu_stream>>>({{KERNEL_ARGS}} skepu_w2, skepu_w3, skepu_w4, skepu_n, skepu_base, skepu_strides);
+		return;
+	}
+
+	constexpr size_t skepu_tile = 16;
+	size_t skepu_rows = skepu_n / skepu_w2;
+	dim3 skepu_tileGrid((skepu_w2 + skepu_tile - 1) / skepu_tile, (skepu_rows + skepu_tile - 1) / skepu_tile);
+	{{KERNEL_NAME}}_GEMMKernel<skepu_tile><<<skepu_tileGrid, dim3(skepu_tile, skepu_tile), 0, skepu_stream>>>(skepu_output,
+		{{ROW_PARAM}}.data + (skepu_base / skepu_w2) * {{ROW_PARAM}}.cols, {{COL_PARAM}}.data, skepu_rows, skepu_w2, {{ROW_PARAM}}.cols);
+}
+)~~~";
+
+
+// CUDA vector type families for the scalar element types the vectorized kernel supports
+static const std::map<std::string, std::pair<size_t, std::string>> MapVectorTypes_CU =
+{
+	{"float",              {4, "float"}},
+	{"int",                {4, "int"}},
+	{"unsigned int",       {4, "uint"}},
+	{"double",             {8, "double"}},
+	{"long",               {8, "long"}},
+	{"unsigned long",      {8, "ulong"}},
+	{"long long",          {8, "longlong"}},
+	{"unsigned long long", {8, "ulonglong"}},
+};
+
+// Elements per 128-bit access, or 0 if some element or result type has no vector type
+static size_t mapVectorWidth_CU(UserFunction &mapFunc)
+{
+	std::vector<std::string> types = mapFunc.multipleReturnTypes;
+	if (types.empty())
+		types.push_back(mapFunc.resolvedReturnTypeName);
+	for (UserFunction::Param& param : mapFunc.elwiseParams)
+		types.push_back(param.resolvedTypeName);
+	
+	size_t largest = 0;
+	for (std::string &type : types)
+	{
+		auto it = MapVectorTypes_CU.find(type);
+		if (it == MapVectorTypes_CU.end())
+			return 0;
+		largest = std::max(largest, it->second.first);
+	}
+	return 16 / largest;
+}
+
+/*!
+ *  NVRTC-specialized variant for instances listed in -jit-specialize, see skepu_jit.h. The launcher takes the
+ *  arguments of the strided kernel. Calls with unit strides run a copy of the kernel compiled at run time with the
+ *  uniform scalar arguments as constants, other calls and failed compilations run the precompiled kernel.
+ */
+const char *MapJITKernelTemplate_CU = R"~~~(
+static const char *{{KERNEL_NAME}}_JITSource = R"skepu_jit(
+#define VARIANT_CPU(block)
+#define VARIANT_OPENMP(block)
+#define VARIANT_CUDA(block) block
+
+__device__ inline {{TYPE}} skepu_jit_userfunction({{UF_PARAMS}})
+{
+{{UF_BODY}}
+}
+
+extern "C" __global__ void {{KERNEL_NAME}}_JITKernel({{TYPE}} *skepu_output, {{JIT_PARAMS}} unsigned long long skepu_n, unsigned long long skepu_base)
+{
+	for (unsigned long long skepu_i = blockIdx.x * blockDim.x + threadIdx.x; skepu_i < skepu_n; skepu_i += blockDim.x * gridDim.x)
+		skepu_output[skepu_i] = skepu_jit_userfunction({{JIT_UF_ARGS}});
+}
+)skepu_jit";
+
+static void {{KERNEL_NAME}}_JIT(dim3 skepu_grid, dim3 skepu_block, size_t skepu_sharedMem, cudaStream_t skepu_stream,
+	{{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides)
+{
+	bool skepu_unit = true;
+	for (size_t skepu_k = 0; skepu_k < {{STRIDE_COUNT}}; ++skepu_k)
+		skepu_unit = skepu_unit && skepu_strides[skepu_k] == 1;
+	
+	CUfunction skepu_function = skepu_unit ? skepu::jit::kernel("{{KERNEL_NAME}}_JITKernel", {{KERNEL_NAME}}_JITSource, { {{JIT_DEFINES}} }) : nullptr;
+	if (!skepu_function)
+	{
+		{{KERNEL_NAME}}<false><<<skepu_grid, skepu_block, skepu_sharedMem, skepu_stream>>>({{KERNEL_ARGS}} skepu_w2, skepu_w3, skepu_w4, skepu_n, skepu_base, skepu_strides);
+		return;
+	}
+	
+	void *skepu_args[] = { {{JIT_ARGS}} &skepu_n, &skepu_base };
+	skepu::jit::launch(skepu_function, skepu_grid, skepu_block, skepu_sharedMem, skepu_stream, skepu_args);
+}
+)~~~";
+
+static std::string mapVectorType_CU(const std::string &type, size_t width)
+{
+	return MapVectorTypes_CU.at(type).second + std::to_string(width);
+}
+
+bool useVectorizedMap_CU(const std::string &InstanceName, UserFunction &mapFunc)
+{
+	// Random streams are tied to the per-thread iteration order of the strided kernel
+	return instanceIsSelected(VectorizedMapInstances, InstanceName) && !mapFunc.randomParam && mapVectorWidth_CU(mapFunc) > 1;
+}
+
+static const ParmVarDecl *referencedParam(const Expr *e)
+{
+	if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+		return dyn_cast<ParmVarDecl>(Ref->getDecl());
+	return nullptr;
+}
+
+static const VarDecl *referencedVar(const Expr *e)
+{
+	if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+		return dyn_cast<VarDecl>(Ref->getDecl());
+	return nullptr;
+}
+
+static bool isZero(const Expr *e)
+{
+	e = e->IgnoreParenImpCasts();
+	if (auto *Int = dyn_cast<IntegerLiteral>(e))
+		return Int->getValue() == 0;
+	if (auto *Float = dyn_cast<FloatingLiteral>(e))
+		return Float->getValue().isZero();
+	return false;
+}
+
+// The single variable of a declaration statement, initialized to zero
+static const VarDecl *zeroInitializedVar(const Stmt *s)
+{
+	auto *Decl = dyn_cast_or_null<DeclStmt>(s);
+	const VarDecl *Var = (Decl && Decl->isSingleDecl()) ? dyn_cast<VarDecl>(Decl->getSingleDecl()) : nullptr;
+	return (Var && Var->getInit() && isZero(Var->getInit())) ? Var : nullptr;
+}
+
+// proxy(k), with proxy a MatRow or MatCol parameter
+static bool isProxyAccess(const Expr *e, const ParmVarDecl *proxy, const VarDecl *k)
+{
+	auto *Call = dyn_cast<CXXOperatorCallExpr>(e->IgnoreParenImpCasts());
+	return Call && Call->getOperator() == OO_Call && Call->getNumArgs() == 2
+		&& referencedParam(Call->getArg(0)) == proxy && referencedVar(Call->getArg(1)) == k;
+}
+
+bool useTiledGEMM_CU(const std::string &InstanceName, UserFunction &mapFunc)
+{
+	// T res = 0; for (size_t k = 0; k < row.cols; ++k) res += row(k) * col(k); return res;
+	static const std::set<std::string> types = {"float", "double", "int", "unsigned int", "long long", "unsigned long long"};
+	if (!instanceIsSelected(TiledGEMMInstances, InstanceName) || !types.count(mapFunc.resolvedReturnTypeName) || mapFunc.multipleReturnTypes.size() > 0
+		|| mapFunc.indexParam || mapFunc.randomParam || !mapFunc.elwiseParams.empty() || !mapFunc.anyScalarParams.empty()
+		|| mapFunc.anyContainerParams.size() != 2 || !mapFunc.ReferencedUFs.empty() || mapFunc.fusedProducer)
+		return false;
+	
+	UserFunction::RandomAccessParam &rowParam = mapFunc.anyContainerParams[0], &colParam = mapFunc.anyContainerParams[1];
+	if (rowParam.containerType != ContainerType::MatRow || colParam.containerType != ContainerType::MatCol
+		|| rowParam.resolvedTypeName != mapFunc.resolvedReturnTypeName || colParam.resolvedTypeName != mapFunc.resolvedReturnTypeName)
+		return false;
+	const ParmVarDecl *row = rowParam.astDeclNode, *col = colParam.astDeclNode;
+	
+	const CompoundStmt *Body = dyn_cast_or_null<CompoundStmt>(mapFunc.astDeclNode->getBody());
+	if (!Body || Body->size() != 3)
+		return false;
+	auto it = Body->body_begin();
+	const VarDecl *Res = zeroInitializedVar(*it++);
+	const ForStmt *Loop = dyn_cast<ForStmt>(*it++);
+	const ReturnStmt *Ret = dyn_cast<ReturnStmt>(*it);
+	if (!Res || !Loop || !Ret || !Ret->getRetValue() || referencedVar(Ret->getRetValue()) != Res)
+		return false;
+	
+	const VarDecl *K = zeroInitializedVar(Loop->getInit());
+	const BinaryOperator *Cond = dyn_cast_or_null<BinaryOperator>(Loop->getCond());
+	const UnaryOperator *Inc = dyn_cast_or_null<UnaryOperator>(Loop->getInc());
+	if (!K || !Cond || Cond->getOpcode() != BO_LT || referencedVar(Cond->getLHS()) != K
+		|| !Inc || !Inc->isIncrementOp() || referencedVar(Inc->getSubExpr()) != K)
+		return false;
+	
+	// The inner dimension, as row.cols or col.rows
+	const MemberExpr *Bound = dyn_cast<MemberExpr>(Cond->getRHS()->IgnoreParenImpCasts());
+	if (!Bound)
+		return false;
+	const ParmVarDecl *BoundOf = referencedParam(Bound->getBase());
+	std::string field = Bound->getMemberDecl()->getNameAsString();
+	if (!((BoundOf == row && field == "cols") || (BoundOf == col && field == "rows")))
+		return false;
+	
+	const Stmt *Step = Loop->getBody();
+	if (auto *Block = dyn_cast_or_null<CompoundStmt>(Step))
+		Step = Block->size() == 1 ? Block->body_front() : nullptr;
+	const CompoundAssignOperator *Acc = dyn_cast_or_null<CompoundAssignOperator>(Step);
+	if (!Acc || Acc->getOpcode() != BO_AddAssign || referencedVar(Acc->getLHS()) != Res)
+		return false;
+	
+	const BinaryOperator *Mul = dyn_cast<BinaryOperator>(Acc->getRHS()->IgnoreParenImpCasts());
+	return Mul && Mul->getOpcode() == BO_Mul
+		&& ((isProxyAccess(Mul->getLHS(), row, K) && isProxyAccess(Mul->getRHS(), col, K))
+		 || (isProxyAccess(Mul->getLHS(), col, K) && isProxyAccess(Mul->getRHS(), row, K)));
+}
+
+
+std::string createMapKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapFunc, size_t arity, std::string dir, SpMVLayout spmv, bool jit, bool dynamic, bool vectorized, bool gemm)
 {
 	std::stringstream SSKernelParamList, SSMapFuncArgs, SSStrideInit, SSStrideCount;
+	std::stringstream SSVectorArgs, SSUnitArgs, SSVectorLoads, SSVectorStores, SSVectorOutputs, SSUnusedParams, SSSoAGather;
+	std::vector<std::string> destinations, unitDestinations, vectorDestinations;
 	IndexCodeGen indexInfo = indexInitHelper_CU(mapFunc);
 	bool first = !indexInfo.hasIndex;
 	SSMapFuncArgs << indexInfo.mapFuncParam;
+	SSVectorArgs << indexInfo.mapFuncParam;
+	SSUnitArgs << indexInfo.mapFuncParam;
+	const size_t width = vectorized ? mapVectorWidth_CU(mapFunc) : 0;
+	std::string unitOutputAssign = handleOutputs_CU(mapFunc, SSUnusedParams);
 	std::string multiOutputAssign = handleOutputs_CU(mapFunc, SSKernelParamList, true);
 	handleRandomParam_CU(mapFunc, SSMapFuncArgs, SSKernelParamList, first);
 	
@@ -43,36 +461,167 @@ std::string createMapKernelProgram_CU(SkeletonInstance &instance, UserFunction &
 		std::stringstream namesuffix;
 		if (mapFunc.multipleReturnTypes.size()) namesuffix << "_" << stride_counter;
 		SSStrideInit << "if (skepu_strides[" << stride_counter << "] < 0) { skepu_output" << namesuffix.str() << " += (-skepu_n + 1) * skepu_strides[" << stride_counter << "]; }\n";
+		destinations.push_back("skepu_output" + namesuffix.str() + "[skepu_i * " + strideFactor_CU(stride_counter) + "]");
+		unitDestinations.push_back("skepu_output" + namesuffix.str() + "[skepu_i]");
 		stride_counter++;
+		
+		if (vectorized)
+		{
+			std::string type = mapFunc.multipleReturnTypes.size() ? mapFunc.multipleReturnTypes[er] : mapFunc.resolvedReturnTypeName;
+			std::string vectorType = mapVectorType_CU(type, width);
+			std::string field = mapFunc.multipleReturnTypes.size() ? ".e" + std::to_string(er) : "";
+			SSVectorLoads << vectorType << " skepu_vout" << namesuffix.str() << ";\n";
+			SSVectorOutputs << "reinterpret_cast<" << type << "*>(&skepu_vout" << namesuffix.str() << ")[skepu_lane] = skepu_res" << field << ";\n";
+			vectorDestinations.push_back("reinterpret_cast<" + type + "*>(&skepu_vout" + namesuffix.str() + ")[skepu_lane]");
+			SSVectorStores << "reinterpret_cast<" << vectorType << "*>(skepu_output" << namesuffix.str() << ")[skepu_chunk] = skepu_vout" << namesuffix.str() << ";\n";
+		}
 	}
 	
 	for (UserFunction::Param& param : mapFunc.elwiseParams)
 	{
-		if (!first) { SSMapFuncArgs << ", "; }
+		if (!first) { SSMapFuncArgs << ", "; SSVectorArgs << ", "; SSUnitArgs << ", "; }
+		
+		// Struct-of-arrays argument: only the fields the user function reads are loaded, the rest stay value-initialized
+		std::vector<UserType::Field> soaFields = soaFields_CU(mapFunc, param);
+		if (!soaFields.empty())
+		{
+			std::string gather = "skepu_gather_" + param.name;
+			SSSoAGather << "auto " << gather << " = [&](size_t skepu_idx) { " << param.resolvedTypeName << " skepu_elem{}; ";
+			for (UserType::Field &field : soaFields)
+			{
+				std::string array = param.name + "_" + field.name;
+				SSKernelParamList << "const " << field.typeName << " *" << array << ", ";
+				SSStrideInit << "if (skepu_strides[" << stride_counter << "] < 0) { " << array << " += (-skepu_n + 1) * skepu_strides[" << stride_counter << "]; }\n";
+				SSSoAGather << "skepu_elem." << field.name << " = " << array << "[skepu_idx]; ";
+			}
+			SSSoAGather << "return skepu_elem; };\n";
+			SSMapFuncArgs << gather << "(skepu_i * " << strideFactor_CU(stride_counter++) << ")";
+			SSUnitArgs << gather << "(skepu_i)";
+			first = false;
+			continue;
+		}
+		
 		SSStrideInit << "if (skepu_strides[" << stride_counter << "] < 0) { " << param.name << " += (-skepu_n + 1) * skepu_strides[" << stride_counter << "]; }\n";
-		SSKernelParamList << param.resolvedTypeName << " *" << param.name << ", ";
-		SSMapFuncArgs << param.name << "[skepu_i * skepu_strides[" << stride_counter++ << "]]";
+		SSKernelParamList << "const " << param.resolvedTypeName << " *" << param.name << ", ";
+		SSMapFuncArgs << param.name << "[skepu_i * " << strideFactor_CU(stride_counter++) << "]";
+		SSUnitArgs << param.name << "[skepu_i]";
+		if (vectorized)
+		{
+			std::string vectorType = mapVectorType_CU(param.resolvedTypeName, width);
+			SSVectorLoads << vectorType << " skepu_v_" << param.name << " = reinterpret_cast<const " << vectorType << "*>(" << param.name << ")[skepu_chunk];\n";
+			SSVectorArgs << "reinterpret_cast<const " << param.resolvedTypeName << "*>(&skepu_v_" << param.name << ")[skepu_lane]";
+		}
 		first = false;
 	}
-	auto argsInfo = handleRandomAccessAndUniforms_CU(mapFunc, SSMapFuncArgs, SSKernelParamList, first);
+	std::stringstream SSArgsSuffix;
+	auto argsInfo = handleRandomAccessAndUniforms_CU(mapFunc, SSArgsSuffix, SSKernelParamList, first);
+	SSMapFuncArgs << SSArgsSuffix.str();
+	SSVectorArgs << SSArgsSuffix.str();
+	SSUnitArgs << SSArgsSuffix.str();
 
 	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_MapKernel_" + mapFunc.uniqueName;
 	SSStrideCount << (mapFunc.elwiseParams.size() + std::max<size_t>(1, mapFunc.multipleReturnTypes.size()));
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
 	FSOutFile << templateString(MapKernelTemplate_CU,
 	{
+		{"{{INDEX_SETUP}}",       indexInfo.incremental.setup},
+		{"{{INDEX_STEP}}",        indexInfo.incremental.step},
 		{"{{KERNEL_NAME}}",       kernelName},
-		{"{{FUNCTION_NAME_MAP}}", mapFunc.funcNameCUDA()},
 		{"{{KERNEL_PARAMS}}",     SSKernelParamList.str()},
-		{"{{MAP_ARGS}}",          SSMapFuncArgs.str()},
-		{"{{INDEX_INITIALIZER}}", indexInfo.indexInit},
-		{"{{OUTPUT_BINDINGS}}",   multiOutputAssign},
+		{"{{MAP_CALL}}",          mapCall_CU(mapFunc, SSMapFuncArgs.str(), multiOutputAssign, destinations)},
+		{"{{INDEX_INITIALIZER}}", indexInfo.incremental.setup.empty() ? indexInfo.indexInit : ""},
 		{"{{PROXIES_UPDATE}}",    argsInfo.proxyInitializerInner},
-		{"{{PROXIES_INIT}}",      argsInfo.proxyInitializer},
+		{"{{PROXIES_INIT}}",      SSSoAGather.str() + argsInfo.proxyInitializer},
 		{"{{STRIDE_COUNT}}",      SSStrideCount.str()},
 		{"{{STRIDE_INIT}}",       SSStrideInit.str()}
 	});
 	
+	if (vectorized)
+		FSOutFile << templateString(MapVectorizedKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",            kernelName},
+			{"{{KERNEL_PARAMS}}",          SSKernelParamList.str()},
+			{"{{VECTOR_MAP_CALL}}",        mapCall_CU(mapFunc, SSVectorArgs.str(), SSVectorOutputs.str(), vectorDestinations)},
+			{"{{MAP_CALL_UNIT}}",          mapCall_CU(mapFunc, SSUnitArgs.str(), unitOutputAssign, unitDestinations)},
+			{"{{VECTOR_WIDTH}}",           std::to_string(width)},
+			{"{{VECTOR_LOADS}}",           SSVectorLoads.str()},
+			{"{{VECTOR_STORES}}",          SSVectorStores.str()},
+			{"{{INDEX_INITIALIZER}}",      indexInfo.indexInit},
+			{"{{PROXIES_UPDATE}}",         argsInfo.proxyInitializerInner},
+			{"{{PROXIES_INIT}}",           SSSoAGather.str() + argsInfo.proxyInitializer}
+		});
+	
+	if (dynamic)
+		FSOutFile << templateString(MapDynamicKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",       kernelName},
+			{"{{KERNEL_PARAMS}}",     SSKernelParamList.str()},
+			{"{{MAP_CALL}}",          mapCall_CU(mapFunc, SSMapFuncArgs.str(), multiOutputAssign, destinations)},
+			{"{{INDEX_INITIALIZER}}", indexInfo.indexInit},
+			{"{{PROXIES_UPDATE}}",    argsInfo.proxyInitializerInner},
+			{"{{PROXIES_INIT}}",      SSSoAGather.str() + argsInfo.proxyInitializer},
+			{"{{STRIDE_COUNT}}",      SSStrideCount.str()},
+			{"{{STRIDE_INIT}}",       SSStrideInit.str()}
+		});
+	
+	if (spmv != SpMVLayout::None)
+		FSOutFile << templateString(spmv == SpMVLayout::SELL ? MapSpMVSellKernelTemplate_CU : MapSpMVKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}", kernelName},
+			{"{{TYPE}}",        mapFunc.resolvedReturnTypeName}
+		});
+	
+	if (gemm)
+		FSOutFile << templateString(MapGEMMKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",   kernelName},
+			{"{{TYPE}}",          mapFunc.resolvedReturnTypeName},
+			{"{{ROW_PARAM}}",     mapFunc.anyContainerParams[0].name},
+			{"{{COL_PARAM}}",     mapFunc.anyContainerParams[1].name},
+			{"{{KERNEL_ARGS}}",   "skepu_output, skepu::PRNG::Placeholder{}, " + mapFunc.anyContainerParams[0].name + ", " + mapFunc.anyContainerParams[1].name + ", "},
+			{"{{KERNEL_PARAMS}}", SSKernelParamList.str()},
+			{"{{STRIDE_COUNT}}",  SSStrideCount.str()}
+		});
+	
+	if (jit)
+	{
+		// Restricted by useJITMap to elementwise and uniform scalar parameters: skepu_output, the unnamed random
+		// placeholder, the elementwise pointers and the scalars, in this order
+		std::stringstream SSUFParams, SSJITParams, SSJITArgs, SSJITUFArgs, SSJITDefines, SSKernelArgs;
+		SSKernelArgs << "skepu_output, skepu::PRNG::Placeholder{}, ";
+		SSJITArgs << "&skepu_output, ";
+		for (UserFunction::Param& param : mapFunc.elwiseParams)
+		{
+			SSUFParams << (SSUFParams.tellp() ? ", " : "") << param.resolvedTypeName << " " << param.name;
+			SSJITParams << "const " << param.resolvedTypeName << " *" << param.name << ", ";
+			SSJITUFArgs << (SSJITUFArgs.tellp() ? ", " : "") << param.name << "[skepu_i]";
+			SSJITArgs << "&" << param.name << ", ";
+			SSKernelArgs << param.name << ", ";
+		}
+		for (UserFunction::Param& param : mapFunc.anyScalarParams)
+		{
+			SSUFParams << (SSUFParams.tellp() ? ", " : "") << param.resolvedTypeName << " " << param.name;
+			SSJITUFArgs << (SSJITUFArgs.tellp() ? ", " : "") << "SKEPU_JIT_" << param.name;
+			SSJITDefines << (SSJITDefines.tellp() ? ", " : "") << "skepu::jit::define(\"SKEPU_JIT_" << param.name << "\", " << param.name << ")";
+			SSKernelArgs << param.name << ", ";
+		}
+		
+		FSOutFile << templateString(MapJITKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",  kernelName},
+			{"{{TYPE}}",         mapFunc.resolvedReturnTypeName},
+			{"{{UF_PARAMS}}",    SSUFParams.str()},
+			{"{{UF_BODY}}",      replaceReferencesToOtherUFs(Backend::CUDA, mapFunc, [] (UserFunction &UF) { return UF.uniqueName; })},
+			{"{{JIT_PARAMS}}",   SSJITParams.str()},
+			{"{{JIT_UF_ARGS}}",  SSJITUFArgs.str()},
+			{"{{JIT_DEFINES}}",  SSJITDefines.str()},
+			{"{{JIT_ARGS}}",     SSJITArgs.str()},
+			{"{{KERNEL_ARGS}}",  SSKernelArgs.str()},
+			{"{{KERNEL_PARAMS}}", SSKernelParamList.str()},
+			{"{{STRIDE_COUNT}}", SSStrideCount.str()}
+		});
+	}
+	
 	return kernelName;
 }
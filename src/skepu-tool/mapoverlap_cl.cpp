@@ -392,51 +392,62 @@ public:
 		KERNEL_COUNT
 	};
 
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8][KERNEL_COUNT]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID][kerneltype] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID][kerneltype];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_vector = clCreateKernel(program, "{{KERNEL_NAME}}_Vector", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 1D vector kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel_vector = clCreateKernel(program, "{{KERNEL_NAME}}_Vector", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 1D vector kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_matrix_row = clCreateKernel(program, "{{KERNEL_NAME}}_MatRowWise", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 1D matrix row-wise kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel kernel_matrix_row = clCreateKernel(program, "{{KERNEL_NAME}}_MatRowWise", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 1D matrix row-wise kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_matrix_col = clCreateKernel(program, "{{KERNEL_NAME}}_MatColWise", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 1D matrix col-wise kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel kernel_matrix_col = clCreateKernel(program, "{{KERNEL_NAME}}_MatColWise", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 1D matrix col-wise kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_matrix_col_multi = clCreateKernel(program, "{{KERNEL_NAME}}_MatColWiseMulti", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 1D matrix col-wise multi kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel kernel_matrix_col_multi = clCreateKernel(program, "{{KERNEL_NAME}}_MatColWiseMulti", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 1D matrix col-wise multi kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, KERNEL_VECTOR,           &kernel_vector);
+		kernels(deviceID, KERNEL_MATRIX_ROW,       &kernel_matrix_row);
+		kernels(deviceID, KERNEL_MATRIX_COL,       &kernel_matrix_col);
+		kernels(deviceID, KERNEL_MATRIX_COL_MULTI, &kernel_matrix_col_multi);
+	}
 
-			kernels(counter, KERNEL_VECTOR,           &kernel_vector);
-			kernels(counter, KERNEL_MATRIX_ROW,       &kernel_matrix_row);
-			kernels(counter, KERNEL_MATRIX_COL,       &kernel_matrix_col);
-			kernels(counter, KERNEL_MATRIX_COL_MULTI, &kernel_matrix_col_multi);
-			counter++;
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	{{TEMPLATE_HEADER}}
@@ -450,10 +461,10 @@ public:
 	)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_VECTOR);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
+		skepu_cl_set_kernel_args(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
 			skepu_wrap->getDeviceDataPointer(), skepu_n, skepu_overlap, out_offset, out_numelements, skepu_poly, skepu_pad);
 		clSetKernelArg(kernel, {{KERNEL_ARG_COUNT}} + 7, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching MapOverlap 1D vector kernel");
 	}
 
@@ -468,11 +479,11 @@ public:
 	)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_MATRIX_ROW);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
+		skepu_cl_set_kernel_args(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
 			skepu_wrap->getDeviceDataPointer(), skepu_n, skepu_overlap, out_offset, out_numelements, skepu_poly, skepu_pad, blocksPerRow, rowWidth);
 		clSetKernelArg(kernel, {{KERNEL_ARG_COUNT}} + 9, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(),
-			kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID),
+			kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching MapOverlap 1D matrix row-wise kernel");
 	}
 
@@ -487,11 +498,11 @@ public:
 	)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_MATRIX_COL);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
+		skepu_cl_set_kernel_args(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
 			skepu_wrap->getDeviceDataPointer(), skepu_n, skepu_overlap, out_offset, out_numelements, skepu_poly, skepu_pad, blocksPerCol, rowWidth, colWidth);
 		clSetKernelArg(kernel, {{KERNEL_ARG_COUNT}} + 10, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(),
-			kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID),
+			kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching MapOverlap 1D matrix col-wise kernel");
 	}
 
@@ -506,11 +517,11 @@ public:
 	)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_MATRIX_COL_MULTI);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
+		skepu_cl_set_kernel_args(kernel, {{KERNEL_ARGS}} {{SIZE_ARGS}}
 			skepu_wrap->getDeviceDataPointer(), skepu_n, skepu_overlap, in_offset, out_numelements, skepu_poly, deviceType, skepu_pad, blocksPerCol, rowWidth, colWidth);
 		clSetKernelArg(kernel, {{KERNEL_ARG_COUNT}} + 11, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(),
-			kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID),
+			kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching MapOverlap 1D matrix col-wise multi kernel");
 	}
 };
@@ -531,13 +542,13 @@ std::string createMapOverlap1DKernelProgram_CL(SkeletonInstance &instance, UserF
 	SSMapOverlapFuncArgs << "skepu_region";
 	SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << overlapParam.resolvedTypeName << "> *skepu_input, ";
 	SSKernelArgs << "skepu_input->getDeviceDataPointer(), ";
-	SSKernelParamList << "__global " << overlapParam.typeNameOpenCL() << "* " << overlapParam.name << ", "; 
+	SSKernelParamList << "__global const " << overlapParam.typeNameOpenCL() << " *" << overlapParam.name << ", "; 
 	
 	std::string proxy = "skepu_region1d_" + transformToCXXIdentifier(overlapParam.resolvedTypeName) + " skepu_region = { .data = &sdata[skepu_tid+skepu_overlap], .oi = skepu_overlap, .stride = 1 };\n";
 	
 	handleUserTypesConstantsAndPrecision_CL({&mapOverlapFunc}, sourceStream);
 	sourceStream << generateOpenCLRegion(1, overlapParam);
-	auto argsInfo = handleRandomAccessAndUniforms_CL(mapOverlapFunc, SSMapOverlapFuncArgs, SSHostKernelParamList, SSKernelParamList, SSKernelArgs, first);
+	auto argsInfo = handleRandomAccessAndUniforms_CL(mapOverlapFunc, SSMapOverlapFuncArgs, SSHostKernelParamList, SSKernelParamList, SSKernelArgs, first, "deviceID");
 	proxyCodeGenHelper_CL(argsInfo.containerProxyTypes, sourceStream);
 	sourceStream << generateUserFunctionCode_CL(mapOverlapFunc)
 	             << MapOverlapKernel_CL << MapOverlapKernel_CL_Matrix_Row
@@ -547,8 +558,7 @@ std::string createMapOverlap1DKernelProgram_CL(SkeletonInstance &instance, UserF
 	std::stringstream SSKernelArgCount;
 	SSKernelArgCount << (mapOverlapFunc.numKernelArgsCL());
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor1D,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor1D,
 	{
 		{"{{OPENCL_KERNEL}}",            sourceStream.str()},
 		{"{{MAPOVERLAP_INPUT_TYPE}}",    overlapParam.resolvedTypeName},
@@ -573,9 +583,7 @@ std::string createMapOverlap1DKernelProgram_CL(SkeletonInstance &instance, UserF
 		{"{{MULTI_TYPE}}",               mapOverlapFunc.multiReturnTypeNameGPU()},
 		{"{{USE_MULTIRETURN}}",          (mapOverlapFunc.multipleReturnTypes.size() > 0) ? "1" : "0"},
 		{"{{OUTPUT_ASSIGN}}",            multiOutputAssign}
-	});
-
-	return kernelName;
+	}), dir);
 }
 
 
@@ -583,6 +591,7 @@ std::string createMapOverlap1DKernelProgram_CL(SkeletonInstance &instance, UserF
 
 /*!
 * The mapoverlap OpenCL kernel to apply a user function on neighbourhood of each element in the matrix.
+* Each work-item computes a strip of rows x cols outputs (-mapoverlap-outputs, 1 x 1 by default).
 */
 static const std::string MatrixConvol2D_CL = R"~~~(
 __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}}
@@ -593,10 +602,10 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}}
 	int skepu_edge, {{MAPOVERLAP_INPUT_TYPE_OPENCL}} skepu_pad, __global {{MAPOVERLAP_INPUT_TYPE_OPENCL}}* skepu_wrap,
 	__local {{MAPOVERLAP_INPUT_TYPE_OPENCL}}* skepu_sdata)
 {
-	size_t skepu_xx = ((size_t)(get_global_id(0) / get_local_size(0))) * get_local_size(0);
-	size_t skepu_yy = ((size_t)(get_global_id(1) / get_local_size(1))) * get_local_size(1);
-	size_t skepu_x = get_global_id(0);
-	size_t skepu_y = get_global_id(1);
+	size_t skepu_xx = get_group_id(0) * get_local_size(0) * {{OUTPUTS_X}};
+	size_t skepu_yy = get_group_id(1) * get_local_size(1) * {{OUTPUTS_Y}};
+	size_t skepu_x = skepu_xx + get_local_id(0);
+	size_t skepu_y = skepu_yy + get_local_id(1);
 	{{CONTAINER_PROXIES}}
 	{{CONTAINER_PROXIE_INNER}}
 
@@ -656,18 +665,29 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}}
 	*/
 
 	barrier(CLK_LOCAL_MEM_FENCE);
-	if (skepu_x < skepu_out_cols && skepu_y < skepu_out_rows)
+	
+	// The work-item's strip: consecutive rows, and columns a local size apart so neighbours read consecutive elements
+	for (size_t skepu_sy = 0; skepu_sy < {{OUTPUTS_Y}}; ++skepu_sy)
+	for (size_t skepu_sx = 0; skepu_sx < {{OUTPUTS_X}}; ++skepu_sx)
 	{
-		size_t skepu_i = skepu_y * skepu_out_cols + skepu_x;
-		size_t skepu_global_prng_id = skepu_i;
-		{{INDEX_INITIALIZER}}
-		{{CONTAINER_PROXIE_INNER}}
+		size_t skepu_tx = get_local_id(0) + skepu_sx * get_local_size(0);
+		size_t skepu_ty = get_local_id(1) * {{OUTPUTS_Y}} + skepu_sy;
+		size_t skepu_x = skepu_xx + skepu_tx;
+		size_t skepu_y = skepu_yy + skepu_ty;
+		if (skepu_x < skepu_out_cols && skepu_y < skepu_out_rows)
+		{
+			size_t skepu_i = skepu_y * skepu_out_cols + skepu_x;
+			size_t skepu_global_prng_id = skepu_i;
+			{{INDEX_INITIALIZER}}
+			{{CONTAINER_PROXIE_INNER}}
+			skepu_region.data = &skepu_sdata[(skepu_ty + skepu_overlap_y) * skepu_sharedCols + (skepu_tx + skepu_overlap_x)];
 #if !{{USE_MULTIRETURN}}
-		skepu_output[skepu_i] = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
+			skepu_output[skepu_i] = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
 #else
-		{{MULTI_TYPE}} skepu_out_temp = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
-		{{OUTPUT_ASSIGN}}
+			{{MULTI_TYPE}} skepu_out_temp = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
+			{{OUTPUT_ASSIGN}}
 #endif
+		}
 	}
 }
 )~~~";
@@ -678,38 +698,55 @@ class {{KERNEL_CLASS}}
 {
 public:
 
+	// Outputs per work-item (-mapoverlap-outputs): the global size covers the output divided by these, rounded up to
+	// the local size, and the tile is localSize[1] * outputsPerThreadY by localSize[0] * outputsPerThreadX plus the halo
+	static constexpr size_t outputsPerThreadY = {{OUTPUTS_Y}};
+	static constexpr size_t outputsPerThreadX = {{OUTPUTS_X}};
+
+	static skepu_cl_kernel_table<1> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<1> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, 0, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, 0);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 2D kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 2D kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, &kernel);
+	}
 
-			kernels(counter++, &kernel);
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	{{TEMPLATE_HEADER}}
@@ -724,12 +761,12 @@ public:
 		size_t sharedMemSize
 	)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(kernels(deviceID), {{KERNEL_ARGS}}
+		skepu_cl_set_kernel_args(kernels(deviceID), {{KERNEL_ARGS}}
 			out_rows, out_cols, skepu_overlap_y, skepu_overlap_x, in_rows, in_cols, sharedRows, sharedCols,
 			skepu_edge, skepu_pad, skepu_wrap->getDeviceDataPointer());
 		clSetKernelArg(kernels(deviceID), {{KERNEL_ARG_COUNT}} + 11, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(),
-			kernels(deviceID), 2, NULL, globalSize, localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID),
+			kernels(deviceID), 2, NULL, globalSize, localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching MapOverlap 2D kernel");
 	}
 };
@@ -737,7 +774,7 @@ public:
 
 
 
-std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapOverlapFunc, std::string dir)
+std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapOverlapFunc, std::string dir, int outputsY, int outputsX)
 {
 	std::stringstream sourceStream, SSMapOverlapFuncArgs, SSKernelParamList, SSHostKernelParamList, SSKernelArgs;
 	std::string indexInit = "";
@@ -757,13 +794,13 @@ std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance &instance, UserF
 	SSMapOverlapFuncArgs << "skepu_region";
 	SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << overlapParam.resolvedTypeName << "> *skepu_input, ";
 	SSKernelArgs << "skepu_input->getDeviceDataPointer(), ";
-	SSKernelParamList << "__global " << overlapParam.typeNameOpenCL() << "* " << overlapParam.name << ", "; 
+	SSKernelParamList << "__global const " << overlapParam.typeNameOpenCL() << " *" << overlapParam.name << ", "; 
 	
 	std::string proxy = "skepu_region2d_" + transformToCXXIdentifier(overlapParam.resolvedTypeName) + " skepu_region = { .data = &skepu_sdata[(get_local_id(1) + skepu_overlap_y) * skepu_sharedCols + (get_local_id(0) + skepu_overlap_x)], .oi = skepu_overlap_y, .oj = skepu_overlap_x, .stride = skepu_sharedCols };\n";
 	
 	handleUserTypesConstantsAndPrecision_CL({&mapOverlapFunc}, sourceStream);
 	sourceStream << generateOpenCLRegion(2, overlapParam);
-	auto argsInfo = handleRandomAccessAndUniforms_CL(mapOverlapFunc, SSMapOverlapFuncArgs, SSHostKernelParamList, SSKernelParamList, SSKernelArgs, first);
+	auto argsInfo = handleRandomAccessAndUniforms_CL(mapOverlapFunc, SSMapOverlapFuncArgs, SSHostKernelParamList, SSKernelParamList, SSKernelArgs, first, "deviceID");
 	proxyCodeGenHelper_CL(argsInfo.containerProxyTypes, sourceStream);
 	sourceStream << generateUserFunctionCode_CL(mapOverlapFunc) << MatrixConvol2D_CL;
 
@@ -771,8 +808,7 @@ std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance &instance, UserF
 	std::stringstream SSKernelArgCount;
 	SSKernelArgCount << (mapOverlapFunc.numKernelArgsCL());
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor2D,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor2D,
 	{
 		{"{{OPENCL_KERNEL}}",            sourceStream.str()},
 		{"{{MAPOVERLAP_INPUT_TYPE}}",    overlapParam.resolvedTypeName},
@@ -796,10 +832,10 @@ std::string createMapOverlap2DKernelProgram_CL(SkeletonInstance &instance, UserF
 		{"{{TEMPLATE_HEADER}}",          indexInfo.templateHeader},
 		{"{{MULTI_TYPE}}",               mapOverlapFunc.multiReturnTypeNameGPU()},
 		{"{{USE_MULTIRETURN}}",          (mapOverlapFunc.multipleReturnTypes.size() > 0) ? "1" : "0"},
-		{"{{OUTPUT_ASSIGN}}",            multiOutputAssign}
-	});
-
-	return kernelName;
+		{"{{OUTPUT_ASSIGN}}",            multiOutputAssign},
+		{"{{OUTPUTS_Y}}",                std::to_string(outputsY)},
+		{"{{OUTPUTS_X}}",                std::to_string(outputsX)}
+	}), dir);
 }
 
 
@@ -920,38 +956,50 @@ class {{KERNEL_CLASS}}
 {
 public:
 
+	static skepu_cl_kernel_table<1> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<1> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, 0, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, 0);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 3D kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 3D kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, &kernel);
+	}
 
-			kernels(counter++, &kernel);
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	{{TEMPLATE_HEADER}}
@@ -968,7 +1016,7 @@ public:
 		size_t skepu_sharedMemSize
 	)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(kernels(skepu_deviceID), {{KERNEL_ARGS}}
+		skepu_cl_set_kernel_args(kernels(skepu_deviceID), {{KERNEL_ARGS}}
 			skepu_out_i, skepu_out_j, skepu_out_k,
 			skepu_overlap_i, skepu_overlap_j, skepu_overlap_k,
 	 		skepu_in_size_i, skepu_in_size_j, skepu_in_size_k,
@@ -976,8 +1024,8 @@ public:
 			skepu_edge, skepu_pad, skepu_wrap->getDeviceDataPointer()
 		);
 		clSetKernelArg(kernels(skepu_deviceID), {{KERNEL_ARG_COUNT}} + 15, skepu_sharedMemSize, NULL);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(),
-			kernels(skepu_deviceID), 3, NULL, skepu_globalSize, skepu_localSize, 0, NULL, NULL);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID),
+			kernels(skepu_deviceID), 3, NULL, skepu_globalSize, skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching MapOverlap 3D kernel");
 	}
 };
@@ -1005,7 +1053,7 @@ std::string createMapOverlap3DKernelProgram_CL(SkeletonInstance &instance, UserF
 	SSMapOverlapFuncArgs << "skepu_region";
 	SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << overlapParam.resolvedTypeName << "> *skepu_input, ";
 	SSKernelArgs << "skepu_input->getDeviceDataPointer(), ";
-	SSKernelParamList << "__global " << overlapParam.typeNameOpenCL() << "* " << overlapParam.name << ", "; 
+	SSKernelParamList << "__global const " << overlapParam.typeNameOpenCL() << " *" << overlapParam.name << ", "; 
 	
 	std::string proxy = "skepu_region3d_" + transformToCXXIdentifier(overlapParam.resolvedTypeName) + " skepu_region = { .data = &skepu_sdata[(get_local_id(2) + skepu_overlap_i) * skepu_shared_size_j * skepu_shared_size_k + (get_local_id(1) + skepu_overlap_j) * skepu_shared_size_k + (get_local_id(0) + skepu_overlap_k)], .oi = skepu_overlap_i, .oj = skepu_overlap_j, .ok = skepu_overlap_k, .stride1 = skepu_shared_size_j, .stride2 = skepu_shared_size_k };\n";
 	
@@ -1019,8 +1067,7 @@ std::string createMapOverlap3DKernelProgram_CL(SkeletonInstance &instance, UserF
 	std::stringstream SSKernelArgCount;
 	SSKernelArgCount << (mapOverlapFunc.numKernelArgsCL());
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor3D,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor3D,
 	{
 		{"{{OPENCL_KERNEL}}",            sourceStream.str()},
 		{"{{MAPOVERLAP_INPUT_TYPE}}",    overlapParam.resolvedTypeName},
@@ -1045,9 +1092,7 @@ std::string createMapOverlap3DKernelProgram_CL(SkeletonInstance &instance, UserF
 		{"{{MULTI_TYPE}}",               mapOverlapFunc.multiReturnTypeNameGPU()},
 		{"{{USE_MULTIRETURN}}",          (mapOverlapFunc.multipleReturnTypes.size() > 0) ? "1" : "0"},
 		{"{{OUTPUT_ASSIGN}}",            multiOutputAssign}
-	});
-
-	return kernelName;
+	}), dir);
 }
 
 
@@ -1200,38 +1245,50 @@ class {{KERNEL_CLASS}}
 {
 public:
 
+	static skepu_cl_kernel_table<1> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<1> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, 0, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, 0);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating MapOverlap 4D kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating MapOverlap 4D kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, &kernel);
+	}
 
-			kernels(counter++, &kernel);
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	{{TEMPLATE_HEADER}}
@@ -1248,7 +1305,7 @@ public:
 		size_t skepu_sharedMemSize
 	)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(kernels(skepu_deviceID), {{KERNEL_ARGS}}
+		skepu_cl_set_kernel_args(kernels(skepu_deviceID), {{KERNEL_ARGS}}
 			skepu_out_i, skepu_out_j, skepu_out_k, skepu_out_l,
 			skepu_overlap_i, skepu_overlap_j, skepu_overlap_k, skepu_overlap_l,
 	 		skepu_in_size_i, skepu_in_size_j, skepu_in_size_k, skepu_in_size_l,
@@ -1256,8 +1313,8 @@ public:
 			skepu_edge, skepu_pad, skepu_wrap->getDeviceDataPointer()
 		);
 		clSetKernelArg(kernels(skepu_deviceID), {{KERNEL_ARG_COUNT}} + 19, skepu_sharedMemSize, NULL);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(),
-			kernels(skepu_deviceID), 3, NULL, skepu_globalSize, skepu_localSize, 0, NULL, NULL);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID),
+			kernels(skepu_deviceID), 3, NULL, skepu_globalSize, skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching MapOverlap 4D kernel");
 	}
 };
@@ -1284,7 +1341,7 @@ std::string createMapOverlap4DKernelProgram_CL(SkeletonInstance &instance, UserF
 	SSMapOverlapFuncArgs << "skepu_region";
 	SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << overlapParam.resolvedTypeName << "> *skepu_input, ";
 	SSKernelArgs << "skepu_input->getDeviceDataPointer(), ";
-	SSKernelParamList << "__global " << overlapParam.typeNameOpenCL() << "* " << overlapParam.name << ", "; 
+	SSKernelParamList << "__global const " << overlapParam.typeNameOpenCL() << " *" << overlapParam.name << ", "; 
 	
 	std::string proxy = "skepu_region4d_" + transformToCXXIdentifier(overlapParam.resolvedTypeName) + " skepu_region = { .data = &skepu_sdata [(get_local_id(2) + skepu_overlap_i) * skepu_shared_size_j * skepu_shared_size_k * skepu_shared_size_l + (get_local_id(1) + skepu_overlap_j) * skepu_shared_size_k * skepu_shared_size_l + ((get_local_id(0) / skepu_out_size_l) + skepu_overlap_k) * skepu_shared_size_l + ((get_local_id(0) % skepu_out_size_l) + skepu_overlap_l)], .oi = skepu_overlap_i, .oj = skepu_overlap_j, .ok = skepu_overlap_k, .ol = skepu_overlap_l, .stride1 = skepu_shared_size_j, .stride2 = skepu_shared_size_k, .stride3 = skepu_shared_size_l };\n";
 	
@@ -1298,8 +1355,7 @@ std::string createMapOverlap4DKernelProgram_CL(SkeletonInstance &instance, UserF
 	std::stringstream SSKernelArgCount;
 	SSKernelArgCount << (mapOverlapFunc.numKernelArgsCL());
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor4D,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor4D,
 	{
 		{"{{OPENCL_KERNEL}}",            sourceStream.str()},
 		{"{{MAPOVERLAP_INPUT_TYPE}}",    overlapParam.resolvedTypeName},
@@ -1324,7 +1380,5 @@ std::string createMapOverlap4DKernelProgram_CL(SkeletonInstance &instance, UserF
 		{"{{MULTI_TYPE}}",               mapOverlapFunc.multiReturnTypeNameGPU()},
 		{"{{USE_MULTIRETURN}}",          (mapOverlapFunc.multipleReturnTypes.size() > 0) ? "1" : "0"},
 		{"{{OUTPUT_ASSIGN}}",            multiOutputAssign}
-	});
-
-	return kernelName;
+	}), dir);
 }
\ No newline at end of file
@@ -478,6 +478,8 @@ __global__ void {{KERNEL_NAME}}_MapOverlapKernel_CU_Matrix_ColMulti({{KERNEL_PAR
 
 /*!
 * The mapoverlap OpenCL kernel to apply a user function on neighbourhood of each element in the matrix.
+* Each thread computes a strip of rows x cols outputs (-mapoverlap-outputs, 1 x 1 by default), so a block covers
+* blockDim.y * rows by blockDim.x * cols outputs and its tile is that plus the halo.
 */
 static const std::string MatrixConvol2D_CU = R"~~~(
 __global__ void {{KERNEL_NAME}}_conv_cuda_2D_kernel({{KERNEL_PARAMS}}
@@ -490,49 +492,63 @@ __global__ void {{KERNEL_NAME}}_conv_cuda_2D_kernel({{KERNEL_PARAMS}}
 )
 {
   extern __shared__ {{MAPOVERLAP_INPUT_TYPE}} {{SHARED_BUFFER}}[];
-	size_t skepu_xx = blockIdx.x * blockDim.x;
-	size_t skepu_yy = blockIdx.y * blockDim.y;
+	size_t skepu_xx = blockIdx.x * blockDim.x * {{OUTPUTS_X}};
+	size_t skepu_yy = blockIdx.y * blockDim.y * {{OUTPUTS_Y}};
 
 	size_t skepu_x = skepu_xx + threadIdx.x;
 	size_t skepu_y = skepu_yy + threadIdx.y;
 	
 	
+	// Block-uniform: tiles that lie within the input are loaded without edge handling
+	const bool skepu_interior = skepu_xx >= skepu_overlap_x && skepu_yy >= skepu_overlap_y
+		&& skepu_xx + skepu_sharedCols <= skepu_in_cols + skepu_overlap_x && skepu_yy + skepu_sharedRows <= skepu_in_rows + skepu_overlap_y;
+	
 	if (skepu_x < skepu_out_cols + skepu_overlap_x * 2 && skepu_y < skepu_out_rows + skepu_overlap_y * 2)
 	{
-		size_t skepu_shared_x = threadIdx.x;
-		size_t skepu_shared_y = threadIdx.y;
-		while (skepu_shared_y < skepu_sharedRows)
+		if (skepu_interior)
 		{
-			while (skepu_shared_x < skepu_sharedCols)
+			auto *skepu_tile = {{INPUT_PARAM_NAME}} + (skepu_yy - skepu_overlap_y) * skepu_in_cols + (skepu_xx - skepu_overlap_x);
+			for (size_t skepu_shared_y = threadIdx.y; skepu_shared_y < skepu_sharedRows; skepu_shared_y += blockDim.y)
+				for (size_t skepu_shared_x = threadIdx.x; skepu_shared_x < skepu_sharedCols; skepu_shared_x += blockDim.x)
+					{{SHARED_BUFFER}}[skepu_shared_y * skepu_sharedCols + skepu_shared_x] = skepu_tile[skepu_shared_y * skepu_in_cols + skepu_shared_x];
+		}
+		else
+		{
+			size_t skepu_shared_x = threadIdx.x;
+			size_t skepu_shared_y = threadIdx.y;
+			while (skepu_shared_y < skepu_sharedRows)
 			{
-				size_t skepu_sharedIdx = skepu_shared_y * skepu_sharedCols + skepu_shared_x;
-				int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_overlap_x);
-				int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_overlap_y);
-				
-				if ((skepu_global_y >= 0 && skepu_global_y < skepu_in_rows) && (skepu_global_x >= 0 && skepu_global_x < skepu_in_cols))
-					{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_y * skepu_in_cols + skepu_global_x];
-				else
+				while (skepu_shared_x < skepu_sharedCols)
 				{
-					if (skepu_edge == skepu::Edge::Pad)
-						{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
-					else if (skepu_edge == skepu::Edge::Duplicate)
-					{
-						{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
-							skepu::cuda::clamp(skepu_global_y, 0, (int)skepu_in_rows - 1) * skepu_in_cols +
-							skepu::cuda::clamp(skepu_global_x, 0, (int)skepu_in_cols - 1)];
-					}
-					else if (skepu_edge == skepu::Edge::Cyclic)
+					size_t skepu_sharedIdx = skepu_shared_y * skepu_sharedCols + skepu_shared_x;
+					int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_overlap_x);
+					int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_overlap_y);
+					
+					if ((skepu_global_y >= 0 && skepu_global_y < skepu_in_rows) && (skepu_global_x >= 0 && skepu_global_x < skepu_in_cols))
+						{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_y * skepu_in_cols + skepu_global_x];
+					else
 					{
-						{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
-							((skepu_global_y + skepu_in_rows) % skepu_in_rows) * skepu_in_cols +
-							((skepu_global_x + skepu_in_cols) % skepu_in_cols)];
+						if (skepu_edge == skepu::Edge::Pad)
+							{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
+						else if (skepu_edge == skepu::Edge::Duplicate)
+						{
+							{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+								skepu::cuda::clamp(skepu_global_y, 0, (int)skepu_in_rows - 1) * skepu_in_cols +
+								skepu::cuda::clamp(skepu_global_x, 0, (int)skepu_in_cols - 1)];
+						}
+						else if (skepu_edge == skepu::Edge::Cyclic)
+						{
+							{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+								((skepu_global_y + skepu_in_rows) % skepu_in_rows) * skepu_in_cols +
+								((skepu_global_x + skepu_in_cols) % skepu_in_cols)];
+						}
 					}
+					
+					skepu_shared_x += blockDim.x;
 				}
-				
-				skepu_shared_x += blockDim.x;
+				skepu_shared_x  = threadIdx.x;
+				skepu_shared_y += blockDim.y;
 			}
-			skepu_shared_x  = threadIdx.x;
-			skepu_shared_y += blockDim.y;
 		}
 	}
 
@@ -540,6 +556,206 @@ __global__ void {{KERNEL_NAME}}_conv_cuda_2D_kernel({{KERNEL_PARAMS}}
 	
 	{{PROXIES_INIT}}
 
+	// The thread's strip: consecutive rows, and columns blockDim.x apart so a warp reads consecutive shared elements
+#pragma unroll
+	for (size_t skepu_sy = 0; skepu_sy < {{OUTPUTS_Y}}; ++skepu_sy)
+#pragma unroll
+	for (size_t skepu_sx = 0; skepu_sx < {{OUTPUTS_X}}; ++skepu_sx)
+	{
+		const size_t skepu_tx = threadIdx.x + skepu_sx * blockDim.x;
+		const size_t skepu_ty = threadIdx.y * {{OUTPUTS_Y}} + skepu_sy;
+		size_t skepu_x = skepu_xx + skepu_tx;
+		size_t skepu_y = skepu_yy + skepu_ty;
+		if (skepu_x < skepu_out_cols && skepu_y < skepu_out_rows)
+		{
+			size_t skepu_w2 = skepu_out_cols;
+			size_t skepu_i = skepu_y * skepu_out_cols + skepu_x;
+			size_t skepu_global_prng_id = skepu_i;
+			size_t skepu_base = 0;
+			{{INDEX_INITIALIZER}}
+			{{PROXIES_UPDATE}}
+			auto skepu_res = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
+			{{OUTPUT_BINDINGS}}
+		}
+	}
+}
+)~~~";
+
+
+
+/*!
+* Temporally blocked 2D variant (-mapoverlap-temporal), for instances whose output is the next iteration's input.
+* One launch advances skepu_steps time steps: the block loads its tile with a halo of skepu_steps * overlap and
+* updates it in shared memory, ping-ponging between the two halves of the buffer, while the valid part of the tile
+* shrinks by one overlap per step. Input and output have the same size and must not alias. Cells outside the matrix
+* are treated per step: Cyclic computes them on the periodic image, Duplicate copies the nearest border cell and
+* Pad (or None) keeps the pad value. The shared buffer holds 2 * (blockDim.y + 2 * skepu_steps * skepu_overlap_y)
+* * (blockDim.x + 2 * skepu_steps * skepu_overlap_x) elements.
+*/
+static const std::string MatrixConvol2DTemporal_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_conv_cuda_2D_temporal_kernel({{KERNEL_PARAMS}}
+	const size_t skepu_in_rows, const size_t skepu_in_cols,
+	size_t skepu_overlap_y, size_t skepu_overlap_x,
+	const size_t skepu_steps,
+	skepu::Edge skepu_edge, {{MAPOVERLAP_INPUT_TYPE}} skepu_pad
+)
+{
+  extern __shared__ {{MAPOVERLAP_INPUT_TYPE}} {{SHARED_BUFFER}}[];
+	const size_t skepu_halo_y = skepu_steps * skepu_overlap_y;
+	const size_t skepu_halo_x = skepu_steps * skepu_overlap_x;
+	const size_t skepu_sharedRows = blockDim.y + 2 * skepu_halo_y;
+	const size_t skepu_sharedCols = blockDim.x + 2 * skepu_halo_x;
+	{{MAPOVERLAP_INPUT_TYPE}} *skepu_src = {{SHARED_BUFFER}};
+	{{MAPOVERLAP_INPUT_TYPE}} *skepu_dst = {{SHARED_BUFFER}} + skepu_sharedRows * skepu_sharedCols;
+	const int skepu_rows = skepu_in_rows, skepu_cols = skepu_in_cols;
+	
+	size_t skepu_xx = blockIdx.x * blockDim.x;
+	size_t skepu_yy = blockIdx.y * blockDim.y;
+	
+	for (size_t skepu_shared_y = threadIdx.y; skepu_shared_y < skepu_sharedRows; skepu_shared_y += blockDim.y)
+	{
+		for (size_t skepu_shared_x = threadIdx.x; skepu_shared_x < skepu_sharedCols; skepu_shared_x += blockDim.x)
+		{
+			size_t skepu_sharedIdx = skepu_shared_y * skepu_sharedCols + skepu_shared_x;
+			int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_halo_x);
+			int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_halo_y);
+			
+			if ((skepu_global_y >= 0 && skepu_global_y < skepu_rows) && (skepu_global_x >= 0 && skepu_global_x < skepu_cols))
+				skepu_src[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_y * skepu_in_cols + skepu_global_x];
+			else if (skepu_edge == skepu::Edge::Duplicate)
+				skepu_src[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					skepu::cuda::clamp(skepu_global_y, 0, skepu_rows - 1) * skepu_in_cols +
+					skepu::cuda::clamp(skepu_global_x, 0, skepu_cols - 1)];
+			else if (skepu_edge == skepu::Edge::Cyclic)
+				skepu_src[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					((skepu_global_y % skepu_rows + skepu_rows) % skepu_rows) * skepu_in_cols +
+					((skepu_global_x % skepu_cols + skepu_cols) % skepu_cols)];
+			else
+				skepu_src[skepu_sharedIdx] = skepu_pad;
+		}
+	}
+	
+	__syncthreads();
+	
+	{{PROXIES_INIT}}
+	
+	for (size_t skepu_step = 1; skepu_step <= skepu_steps; ++skepu_step)
+	{
+		const size_t skepu_lo_y = skepu_step * skepu_overlap_y, skepu_hi_y = skepu_sharedRows - skepu_lo_y;
+		const size_t skepu_lo_x = skepu_step * skepu_overlap_x, skepu_hi_x = skepu_sharedCols - skepu_lo_x;
+		
+		for (size_t skepu_shared_y = skepu_lo_y + threadIdx.y; skepu_shared_y < skepu_hi_y; skepu_shared_y += blockDim.y)
+		{
+			for (size_t skepu_shared_x = skepu_lo_x + threadIdx.x; skepu_shared_x < skepu_hi_x; skepu_shared_x += blockDim.x)
+			{
+				int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_halo_x);
+				int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_halo_y);
+				bool skepu_inside = (skepu_global_y >= 0 && skepu_global_y < skepu_rows) && (skepu_global_x >= 0 && skepu_global_x < skepu_cols);
+				
+				if (skepu_inside || skepu_edge == skepu::Edge::Cyclic)
+				{
+					size_t skepu_w2 = skepu_in_cols;
+					size_t skepu_i = ((skepu_global_y % skepu_rows + skepu_rows) % skepu_rows) * skepu_in_cols + ((skepu_global_x % skepu_cols + skepu_cols) % skepu_cols);
+					size_t skepu_base = 0;
+					{{INDEX_INITIALIZER}}
+					{{PROXIES_UPDATE}}
+					skepu_dst[skepu_shared_y * skepu_sharedCols + skepu_shared_x] = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_TEMPORAL_ARGS}});
+				}
+				else if (skepu_edge != skepu::Edge::Duplicate)
+					skepu_dst[skepu_shared_y * skepu_sharedCols + skepu_shared_x] = skepu_pad;
+			}
+		}
+		__syncthreads();
+		
+		// The nearest border cell lies inside the valid part of the tile whenever the outside cell does
+		if (skepu_edge == skepu::Edge::Duplicate)
+		{
+			for (size_t skepu_shared_y = skepu_lo_y + threadIdx.y; skepu_shared_y < skepu_hi_y; skepu_shared_y += blockDim.y)
+			{
+				for (size_t skepu_shared_x = skepu_lo_x + threadIdx.x; skepu_shared_x < skepu_hi_x; skepu_shared_x += blockDim.x)
+				{
+					int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_halo_x);
+					int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_halo_y);
+					int skepu_border_x = skepu::cuda::clamp(skepu_global_x, 0, skepu_cols - 1);
+					int skepu_border_y = skepu::cuda::clamp(skepu_global_y, 0, skepu_rows - 1);
+					if (skepu_border_x != skepu_global_x || skepu_border_y != skepu_global_y)
+						skepu_dst[skepu_shared_y * skepu_sharedCols + skepu_shared_x] =
+							skepu_dst[(skepu_shared_y + skepu_border_y - skepu_global_y) * skepu_sharedCols + (skepu_shared_x + skepu_border_x - skepu_global_x)];
+				}
+			}
+			__syncthreads();
+		}
+		
+		{{MAPOVERLAP_INPUT_TYPE}} *skepu_swap = skepu_src;
+		skepu_src = skepu_dst;
+		skepu_dst = skepu_swap;
+	}
+	
+	size_t skepu_x = skepu_xx + threadIdx.x;
+	size_t skepu_y = skepu_yy + threadIdx.y;
+	if (skepu_x < skepu_in_cols && skepu_y < skepu_in_rows)
+		skepu_output[skepu_y * skepu_in_cols + skepu_x] = skepu_src[(threadIdx.y + skepu_halo_y) * skepu_sharedCols + (threadIdx.x + skepu_halo_x)];
+}
+)~~~";
+
+
+/*!
+* Red-black variant (-mapoverlap-redblack), for in-place instances with UpdateMode::RedBlack. A launch updates the
+* cells of one colour, those with (y + x) % 2 == skepu_parity, one per thread: a block covers blockDim.y rows and
+* 2 * blockDim.x columns, and each thread computes the cell of the colour among the two columns of its pair, so the
+* grid covers half of the columns, rounded up, and no thread idles on a cell of the other colour. The runtime runs
+* parity 0 and then parity 1 for one update. The shared buffer holds (blockDim.y + 2 * skepu_overlap_y) *
+* (2 * blockDim.x + 2 * skepu_overlap_x) elements, and cells outside the matrix are loaded as in the main kernel.
+*/
+static const std::string MatrixConvol2DRedBlack_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_conv_cuda_2D_redblack_kernel({{KERNEL_PARAMS}}
+	const size_t skepu_in_rows, const size_t skepu_in_cols,
+	const size_t skepu_out_rows, const size_t skepu_out_cols,
+	size_t skepu_overlap_y, size_t skepu_overlap_x,
+	skepu::Edge skepu_edge, {{MAPOVERLAP_INPUT_TYPE}} skepu_pad, int skepu_parity
+)
+{
+  extern __shared__ {{MAPOVERLAP_INPUT_TYPE}} {{SHARED_BUFFER}}[];
+	const size_t skepu_sharedRows = blockDim.y + 2 * skepu_overlap_y;
+	const size_t skepu_sharedCols = 2 * blockDim.x + 2 * skepu_overlap_x;
+	const int skepu_rows = skepu_in_rows, skepu_cols = skepu_in_cols;
+	
+	size_t skepu_xx = blockIdx.x * blockDim.x * 2;
+	size_t skepu_yy = blockIdx.y * blockDim.y;
+	
+	// Both colours are loaded, the stencil of a cell reads its neighbours of the other colour
+	for (size_t skepu_shared_y = threadIdx.y; skepu_shared_y < skepu_sharedRows; skepu_shared_y += blockDim.y)
+	{
+		for (size_t skepu_shared_x = threadIdx.x; skepu_shared_x < skepu_sharedCols; skepu_shared_x += blockDim.x)
+		{
+			size_t skepu_sharedIdx = skepu_shared_y * skepu_sharedCols + skepu_shared_x;
+			int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_overlap_x);
+			int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_overlap_y);
+			
+			if ((skepu_global_y >= 0 && skepu_global_y < skepu_rows) && (skepu_global_x >= 0 && skepu_global_x < skepu_cols))
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_y * skepu_in_cols + skepu_global_x];
+			else if (skepu_edge == skepu::Edge::Pad)
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
+			else if (skepu_edge == skepu::Edge::Duplicate)
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					skepu::cuda::clamp(skepu_global_y, 0, skepu_rows - 1) * skepu_in_cols +
+					skepu::cuda::clamp(skepu_global_x, 0, skepu_cols - 1)];
+			else if (skepu_edge == skepu::Edge::Cyclic)
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					((skepu_global_y % skepu_rows + skepu_rows) % skepu_rows) * skepu_in_cols +
+					((skepu_global_x % skepu_cols + skepu_cols) % skepu_cols)];
+		}
+	}
+	
+	__syncthreads();
+	
+	{{PROXIES_INIT}}
+	
+	// The block origin is on an even column, so the colour of the pair's first column only depends on the row
+	const size_t skepu_ty = threadIdx.y;
+	const size_t skepu_y = skepu_yy + skepu_ty;
+	const size_t skepu_tx = 2 * threadIdx.x + ((skepu_y + skepu_parity) & 1);
+	const size_t skepu_x = skepu_xx + skepu_tx;
 	if (skepu_x < skepu_out_cols && skepu_y < skepu_out_rows)
 	{
 		size_t skepu_w2 = skepu_out_cols;
@@ -556,6 +772,117 @@ __global__ void {{KERNEL_NAME}}_conv_cuda_2D_kernel({{KERNEL_PARAMS}}
 
 
 
+/*!
+* Fused stencil and residual (-mapoverlap-reduce), for iterative solvers that reduce over the new and the old grid after
+* each step. The kernel is the main 2D kernel, strips included, that also maps each output and its input element through
+* the map function of the residual MapReduce instance and reduces the results of the block into one partial, stored at
+* skepu_partials[blockIdx.y * gridDim.x + blockIdx.x] and combined by the _ReduceOnly kernel as in MapReduce. After the
+* tile, aligned for the partial type, the shared buffer holds a partial and a presence flag per thread.
+*/
+static const std::string MatrixConvol2DReduce_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_conv_cuda_2D_reduce_kernel({{KERNEL_PARAMS}}
+	const size_t skepu_in_rows, const size_t skepu_in_cols,
+	const size_t skepu_out_rows, const size_t skepu_out_cols,
+	size_t skepu_overlap_y, size_t skepu_overlap_x,
+	size_t skepu_in_pitch, size_t skepu_out_pitch,
+	const size_t skepu_sharedRows, const size_t skepu_sharedCols,
+	skepu::Edge skepu_edge, {{MAPOVERLAP_INPUT_TYPE}} skepu_pad,
+	{{RESIDUAL_TYPE}} *skepu_partials
+)
+{
+  extern __shared__ {{MAPOVERLAP_INPUT_TYPE}} {{SHARED_BUFFER}}[];
+	size_t skepu_xx = blockIdx.x * blockDim.x * {{OUTPUTS_X}};
+	size_t skepu_yy = blockIdx.y * blockDim.y * {{OUTPUTS_Y}};
+	const int skepu_rows = skepu_in_rows, skepu_cols = skepu_in_cols;
+	
+	for (size_t skepu_shared_y = threadIdx.y; skepu_shared_y < skepu_sharedRows; skepu_shared_y += blockDim.y)
+	{
+		for (size_t skepu_shared_x = threadIdx.x; skepu_shared_x < skepu_sharedCols; skepu_shared_x += blockDim.x)
+		{
+			size_t skepu_sharedIdx = skepu_shared_y * skepu_sharedCols + skepu_shared_x;
+			int skepu_global_x = (skepu_xx + skepu_shared_x - skepu_overlap_x);
+			int skepu_global_y = (skepu_yy + skepu_shared_y - skepu_overlap_y);
+			
+			if ((skepu_global_y >= 0 && skepu_global_y < skepu_rows) && (skepu_global_x >= 0 && skepu_global_x < skepu_cols))
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_y * skepu_in_cols + skepu_global_x];
+			else if (skepu_edge == skepu::Edge::Pad)
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
+			else if (skepu_edge == skepu::Edge::Duplicate)
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					skepu::cuda::clamp(skepu_global_y, 0, skepu_rows - 1) * skepu_in_cols +
+					skepu::cuda::clamp(skepu_global_x, 0, skepu_cols - 1)];
+			else if (skepu_edge == skepu::Edge::Cyclic)
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					((skepu_global_y % skepu_rows + skepu_rows) % skepu_rows) * skepu_in_cols +
+					((skepu_global_x % skepu_cols + skepu_cols) % skepu_cols)];
+		}
+	}
+	
+	__syncthreads();
+	
+	{{PROXIES_INIT}}
+	
+	{{RESIDUAL_TYPE}} skepu_partial{};
+	bool skepu_present = false;
+#pragma unroll
+	for (size_t skepu_sy = 0; skepu_sy < {{OUTPUTS_Y}}; ++skepu_sy)
+#pragma unroll
+	for (size_t skepu_sx = 0; skepu_sx < {{OUTPUTS_X}}; ++skepu_sx)
+	{
+		const size_t skepu_tx = threadIdx.x + skepu_sx * blockDim.x;
+		const size_t skepu_ty = threadIdx.y * {{OUTPUTS_Y}} + skepu_sy;
+		size_t skepu_x = skepu_xx + skepu_tx;
+		size_t skepu_y = skepu_yy + skepu_ty;
+		if (skepu_x < skepu_out_cols && skepu_y < skepu_out_rows)
+		{
+			size_t skepu_w2 = skepu_out_cols;
+			size_t skepu_i = skepu_y * skepu_out_cols + skepu_x;
+			size_t skepu_global_prng_id = skepu_i;
+			size_t skepu_base = 0;
+			{{INDEX_INITIALIZER}}
+			{{PROXIES_UPDATE}}
+			auto skepu_res = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
+			{{OUTPUT_BINDINGS}}
+			{{RESIDUAL_TYPE}} skepu_term = {{RESIDUAL_MAP}}(skepu_res, {{SHARED_BUFFER}}[(skepu_ty + skepu_overlap_y) * skepu_sharedCols + (skepu_tx + skepu_overlap_x)]);
+			skepu_partial = skepu_present ? {{RESIDUAL_REDUCE}}(skepu_partial, skepu_term) : skepu_term;
+			skepu_present = true;
+		}
+	}
+	
+	// Past the tile, which other threads may still read
+	const size_t skepu_tileBytes = skepu_sharedRows * skepu_sharedCols * sizeof({{MAPOVERLAP_INPUT_TYPE}});
+	const size_t skepu_align = alignof({{RESIDUAL_TYPE}});
+	{{RESIDUAL_TYPE}} *skepu_sharedPartials = reinterpret_cast<{{RESIDUAL_TYPE}}*>(
+		reinterpret_cast<char*>({{SHARED_BUFFER}}) + (skepu_tileBytes + skepu_align - 1) / skepu_align * skepu_align);
+	const size_t skepu_threads = blockDim.x * blockDim.y;
+	bool *skepu_sharedPresent = reinterpret_cast<bool*>(skepu_sharedPartials + skepu_threads);
+	const size_t skepu_tid = threadIdx.y * blockDim.x + threadIdx.x;
+	skepu_sharedPartials[skepu_tid] = skepu_partial;
+	skepu_sharedPresent[skepu_tid] = skepu_present;
+	__syncthreads();
+	
+	// Pairwise in thread order, for any block size
+	for (size_t skepu_stride = 1; skepu_stride < skepu_threads; skepu_stride *= 2)
+	{
+		if (skepu_tid % (2 * skepu_stride) == 0 && skepu_tid + skepu_stride < skepu_threads && skepu_sharedPresent[skepu_tid + skepu_stride])
+		{
+			skepu_sharedPartials[skepu_tid] = skepu_sharedPresent[skepu_tid]
+				? {{RESIDUAL_REDUCE}}(skepu_sharedPartials[skepu_tid], skepu_sharedPartials[skepu_tid + skepu_stride])
+				: skepu_sharedPartials[skepu_tid + skepu_stride];
+			skepu_sharedPresent[skepu_tid] = true;
+		}
+		__syncthreads();
+	}
+	
+	// Thread 0 computes the first output of the block, so every block has a partial
+	if (skepu_tid == 0)
+		skepu_partials[blockIdx.y * gridDim.x + blockIdx.x] = skepu_sharedPartials[0];
+}
+)~~~";
+
+
+
+
 /*!
 * The mapoverlap OpenCL kernel to apply a user function on neighbourhood of each element in the matrix.
 */
@@ -578,51 +905,69 @@ __global__ void {{KERNEL_NAME}}_conv_cuda_3D_kernel({{KERNEL_PARAMS}}
 	size_t skepu_i = skepu_ii + threadIdx.z;
 	
 	
+	// Block-uniform: tiles that lie within the input are loaded without edge handling
+	const bool skepu_interior = skepu_ii >= skepu_overlap_i && skepu_jj >= skepu_overlap_j && skepu_kk >= skepu_overlap_k
+		&& skepu_ii + skepu_shared_size_i <= skepu_in_size_i + skepu_overlap_i
+		&& skepu_jj + skepu_shared_size_j <= skepu_in_size_j + skepu_overlap_j
+		&& skepu_kk + skepu_shared_size_k <= skepu_in_size_k + skepu_overlap_k;
+	
 	if (skepu_i < skepu_out_size_i + skepu_overlap_i * 2 && skepu_j < skepu_out_size_j + skepu_overlap_j * 2 && skepu_k < skepu_out_size_k + skepu_overlap_k * 2)
 	{
-		size_t skepu_shared_k = threadIdx.x;
-		size_t skepu_shared_j = threadIdx.y;
-		size_t skepu_shared_i = threadIdx.z;
-		while (skepu_shared_i < skepu_shared_size_i)
+		if (skepu_interior)
 		{
-			while (skepu_shared_j < skepu_shared_size_j)
+			auto *skepu_tile = {{INPUT_PARAM_NAME}} + ((skepu_ii - skepu_overlap_i) * skepu_in_size_j + (skepu_jj - skepu_overlap_j)) * skepu_in_size_k + (skepu_kk - skepu_overlap_k);
+			for (size_t skepu_shared_i = threadIdx.z; skepu_shared_i < skepu_shared_size_i; skepu_shared_i += blockDim.z)
+				for (size_t skepu_shared_j = threadIdx.y; skepu_shared_j < skepu_shared_size_j; skepu_shared_j += blockDim.y)
+					for (size_t skepu_shared_k = threadIdx.x; skepu_shared_k < skepu_shared_size_k; skepu_shared_k += blockDim.x)
+						{{SHARED_BUFFER}}[(skepu_shared_i * skepu_shared_size_j + skepu_shared_j) * skepu_shared_size_k + skepu_shared_k]
+							= skepu_tile[(skepu_shared_i * skepu_in_size_j + skepu_shared_j) * skepu_in_size_k + skepu_shared_k];
+		}
+		else
+		{
+			size_t skepu_shared_k = threadIdx.x;
+			size_t skepu_shared_j = threadIdx.y;
+			size_t skepu_shared_i = threadIdx.z;
+			while (skepu_shared_i < skepu_shared_size_i)
 			{
-				while (skepu_shared_k < skepu_shared_size_k)
+				while (skepu_shared_j < skepu_shared_size_j)
 				{
-					size_t skepu_sharedIdx = skepu_shared_i * skepu_shared_size_j * skepu_shared_size_k + skepu_shared_j * skepu_shared_size_k + skepu_shared_k;
-					int skepu_global_k = (skepu_kk + skepu_shared_k - skepu_overlap_k);
-					int skepu_global_j = (skepu_jj + skepu_shared_j - skepu_overlap_j);
-					int skepu_global_i = (skepu_ii + skepu_shared_i - skepu_overlap_i);
-					
-					if ((skepu_global_i >= 0 && skepu_global_i < skepu_in_size_i) && (skepu_global_j >= 0 && skepu_global_j < skepu_in_size_j) && (skepu_global_k >= 0 && skepu_global_k < skepu_in_size_k))
-						{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_i * skepu_in_size_j * skepu_in_size_k + skepu_global_j * skepu_in_size_k + skepu_global_k];
-					else
+					while (skepu_shared_k < skepu_shared_size_k)
 					{
-						if (skepu_edge == skepu::Edge::Pad)
-							{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
-						else if (skepu_edge == skepu::Edge::Duplicate)
-						{
-							{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
-								skepu::cuda::clamp(skepu_global_i, 0, (int)skepu_in_size_i - 1) * skepu_in_size_j * skepu_in_size_k +
-								skepu::cuda::clamp(skepu_global_j, 0, (int)skepu_in_size_j - 1) * skepu_in_size_k +
-								skepu::cuda::clamp(skepu_global_k, 0, (int)skepu_in_size_k - 1)];
-						}
-						else if (skepu_edge == skepu::Edge::Cyclic)
+						size_t skepu_sharedIdx = skepu_shared_i * skepu_shared_size_j * skepu_shared_size_k + skepu_shared_j * skepu_shared_size_k + skepu_shared_k;
+						int skepu_global_k = (skepu_kk + skepu_shared_k - skepu_overlap_k);
+						int skepu_global_j = (skepu_jj + skepu_shared_j - skepu_overlap_j);
+						int skepu_global_i = (skepu_ii + skepu_shared_i - skepu_overlap_i);
+						
+						if ((skepu_global_i >= 0 && skepu_global_i < skepu_in_size_i) && (skepu_global_j >= 0 && skepu_global_j < skepu_in_size_j) && (skepu_global_k >= 0 && skepu_global_k < skepu_in_size_k))
+							{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[skepu_global_i * skepu_in_size_j * skepu_in_size_k + skepu_global_j * skepu_in_size_k + skepu_global_k];
+						else
 						{
-							{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
-								((skepu_global_i + skepu_in_size_i) % skepu_in_size_i) * skepu_in_size_j * skepu_in_size_k +
-								((skepu_global_j + skepu_in_size_j) % skepu_in_size_j) * skepu_in_size_k +
-								((skepu_global_k + skepu_in_size_k) % skepu_in_size_k)];
+							if (skepu_edge == skepu::Edge::Pad)
+								{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
+							else if (skepu_edge == skepu::Edge::Duplicate)
+							{
+								{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+									skepu::cuda::clamp(skepu_global_i, 0, (int)skepu_in_size_i - 1) * skepu_in_size_j * skepu_in_size_k +
+									skepu::cuda::clamp(skepu_global_j, 0, (int)skepu_in_size_j - 1) * skepu_in_size_k +
+									skepu::cuda::clamp(skepu_global_k, 0, (int)skepu_in_size_k - 1)];
+							}
+							else if (skepu_edge == skepu::Edge::Cyclic)
+							{
+								{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+									((skepu_global_i + skepu_in_size_i) % skepu_in_size_i) * skepu_in_size_j * skepu_in_size_k +
+									((skepu_global_j + skepu_in_size_j) % skepu_in_size_j) * skepu_in_size_k +
+									((skepu_global_k + skepu_in_size_k) % skepu_in_size_k)];
+							}
 						}
+						
+						skepu_shared_k += blockDim.x;
 					}
-					
-					skepu_shared_k += blockDim.x;
+					skepu_shared_k  = threadIdx.x;
+					skepu_shared_j += blockDim.y;
 				}
-				skepu_shared_k  = threadIdx.x;
-				skepu_shared_j += blockDim.y;
+				skepu_shared_j  = threadIdx.y;
+				skepu_shared_i += blockDim.z;
 			}
-			skepu_shared_j  = threadIdx.y;
-			skepu_shared_i += blockDim.z;
 		}
 	}
 
@@ -644,10 +989,120 @@ __global__ void {{KERNEL_NAME}}_conv_cuda_3D_kernel({{KERNEL_PARAMS}}
 }
 )~~~";
 
-static const std::string MatrixConvol4D_CU = R"~~~()~~~";
+/*!
+* The 4D variant. CUDA blocks have three dimensions, so the x and y dimensions of the block and grid map to l and k
+* while the z dimensions fold j and i: threadIdx.z = ti * skepu_block_size_j + tj, blockIdx.z = bi * skepu_grid_size_j + bj.
+* The shared tile holds (block extent + 2 * overlap) elements per dimension and is loaded in linear order so that
+* consecutive threads read consecutive l. Elements outside the input are resolved according to the edge mode;
+* Edge::None uses the pad value, those elements never reach a computed output.
+*/
+static const std::string MatrixConvol4D_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_conv_cuda_4D_kernel({{KERNEL_PARAMS}}
+	const size_t skepu_in_size_i, const size_t skepu_in_size_j, const size_t skepu_in_size_k, const size_t skepu_in_size_l,
+	const size_t skepu_out_size_i, const size_t skepu_out_size_j, const size_t skepu_out_size_k, const size_t skepu_out_size_l,
+	size_t skepu_overlap_i, size_t skepu_overlap_j, size_t skepu_overlap_k, size_t skepu_overlap_l,
+	const size_t skepu_shared_size_i, const size_t skepu_shared_size_j, const size_t skepu_shared_size_k, const size_t skepu_shared_size_l,
+	const size_t skepu_block_size_j, const size_t skepu_grid_size_j,
+	skepu::Edge skepu_edge, {{MAPOVERLAP_INPUT_TYPE}} skepu_pad
+)
+{
+  extern __shared__ {{MAPOVERLAP_INPUT_TYPE}} {{SHARED_BUFFER}}[];
+	const size_t skepu_tl = threadIdx.x;
+	const size_t skepu_tk = threadIdx.y;
+	const size_t skepu_tj = threadIdx.z % skepu_block_size_j;
+	const size_t skepu_ti = threadIdx.z / skepu_block_size_j;
+	
+	size_t skepu_ll = blockIdx.x * blockDim.x;
+	size_t skepu_kk = blockIdx.y * blockDim.y;
+	size_t skepu_jj = (blockIdx.z % skepu_grid_size_j) * skepu_block_size_j;
+	size_t skepu_ii = (blockIdx.z / skepu_grid_size_j) * (blockDim.z / skepu_block_size_j);
+	
+	size_t skepu_l = skepu_ll + skepu_tl;
+	size_t skepu_k = skepu_kk + skepu_tk;
+	size_t skepu_j = skepu_jj + skepu_tj;
+	size_t skepu_i = skepu_ii + skepu_ti;
+	
+	const size_t skepu_stride_l = skepu_shared_size_l;
+	const size_t skepu_stride_k = skepu_shared_size_k * skepu_stride_l;
+	const size_t skepu_stride_j = skepu_shared_size_j * skepu_stride_k;
+	const size_t skepu_shared_total = skepu_shared_size_i * skepu_stride_j;
+	const size_t skepu_threads = blockDim.x * blockDim.y * blockDim.z;
+	
+	// Block-uniform: tiles that lie within the input are loaded without edge handling
+	const bool skepu_interior = skepu_ii >= skepu_overlap_i && skepu_jj >= skepu_overlap_j && skepu_kk >= skepu_overlap_k && skepu_ll >= skepu_overlap_l
+		&& skepu_ii + skepu_shared_size_i <= skepu_in_size_i + skepu_overlap_i
+		&& skepu_jj + skepu_shared_size_j <= skepu_in_size_j + skepu_overlap_j
+		&& skepu_kk + skepu_shared_size_k <= skepu_in_size_k + skepu_overlap_k
+		&& skepu_ll + skepu_shared_size_l <= skepu_in_size_l + skepu_overlap_l;
+	
+	if (skepu_interior)
+	{
+		auto *skepu_tile = {{INPUT_PARAM_NAME}} + (((skepu_ii - skepu_overlap_i) * skepu_in_size_j + (skepu_jj - skepu_overlap_j)) * skepu_in_size_k + (skepu_kk - skepu_overlap_k)) * skepu_in_size_l + (skepu_ll - skepu_overlap_l);
+		for (size_t skepu_sharedIdx = (threadIdx.z * blockDim.y + threadIdx.y) * blockDim.x + threadIdx.x; skepu_sharedIdx < skepu_shared_total; skepu_sharedIdx += skepu_threads)
+		{
+			size_t skepu_tile_l = skepu_sharedIdx % skepu_shared_size_l;
+			size_t skepu_tile_k = (skepu_sharedIdx / skepu_stride_l) % skepu_shared_size_k;
+			size_t skepu_tile_j = (skepu_sharedIdx / skepu_stride_k) % skepu_shared_size_j;
+			size_t skepu_tile_i = skepu_sharedIdx / skepu_stride_j;
+			{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_tile[((skepu_tile_i * skepu_in_size_j + skepu_tile_j) * skepu_in_size_k + skepu_tile_k) * skepu_in_size_l + skepu_tile_l];
+		}
+	}
+	else
+	{
+		for (size_t skepu_sharedIdx = (threadIdx.z * blockDim.y + threadIdx.y) * blockDim.x + threadIdx.x; skepu_sharedIdx < skepu_shared_total; skepu_sharedIdx += skepu_threads)
+		{
+			int skepu_global_l = (skepu_ll + skepu_sharedIdx % skepu_shared_size_l - skepu_overlap_l);
+			int skepu_global_k = (skepu_kk + (skepu_sharedIdx / skepu_stride_l) % skepu_shared_size_k - skepu_overlap_k);
+			int skepu_global_j = (skepu_jj + (skepu_sharedIdx / skepu_stride_k) % skepu_shared_size_j - skepu_overlap_j);
+			int skepu_global_i = (skepu_ii + skepu_sharedIdx / skepu_stride_j - skepu_overlap_i);
+			
+			if ((skepu_global_i >= 0 && skepu_global_i < skepu_in_size_i) && (skepu_global_j >= 0 && skepu_global_j < skepu_in_size_j)
+			 && (skepu_global_k >= 0 && skepu_global_k < skepu_in_size_k) && (skepu_global_l >= 0 && skepu_global_l < skepu_in_size_l))
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[((skepu_global_i * skepu_in_size_j + skepu_global_j) * skepu_in_size_k + skepu_global_k) * skepu_in_size_l + skepu_global_l];
+			else if (skepu_edge == skepu::Edge::Duplicate)
+			{
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					((skepu::cuda::clamp(skepu_global_i, 0, (int)skepu_in_size_i - 1) * skepu_in_size_j +
+					skepu::cuda::clamp(skepu_global_j, 0, (int)skepu_in_size_j - 1)) * skepu_in_size_k +
+					skepu::cuda::clamp(skepu_global_k, 0, (int)skepu_in_size_k - 1)) * skepu_in_size_l +
+					skepu::cuda::clamp(skepu_global_l, 0, (int)skepu_in_size_l - 1)];
+			}
+			else if (skepu_edge == skepu::Edge::Cyclic)
+			{
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = {{INPUT_PARAM_NAME}}[
+					((((skepu_global_i + skepu_in_size_i) % skepu_in_size_i) * skepu_in_size_j +
+					((skepu_global_j + skepu_in_size_j) % skepu_in_size_j)) * skepu_in_size_k +
+					((skepu_global_k + skepu_in_size_k) % skepu_in_size_k)) * skepu_in_size_l +
+					((skepu_global_l + skepu_in_size_l) % skepu_in_size_l)];
+			}
+			else
+				{{SHARED_BUFFER}}[skepu_sharedIdx] = skepu_pad;
+		}
+	}
+
+	__syncthreads();
+	
+	{{PROXIES_INIT}}
+
+	if (skepu_i < skepu_out_size_i && skepu_j < skepu_out_size_j && skepu_k < skepu_out_size_k && skepu_l < skepu_out_size_l)
+	{
+		size_t skepu_w2 = skepu_out_size_j;
+		size_t skepu_w3 = skepu_out_size_k;
+		size_t skepu_w4 = skepu_out_size_l;
+		skepu_i = ((skepu_i * skepu_out_size_j + skepu_j) * skepu_out_size_k + skepu_k) * skepu_out_size_l + skepu_l;
+		size_t skepu_global_prng_id = skepu_i;
+		size_t skepu_base = 0;
+		{{INDEX_INITIALIZER}}
+		{{PROXIES_UPDATE}}
+		auto skepu_res = {{FUNCTION_NAME_MAPOVERLAP}}({{MAPOVERLAP_ARGS}});
+		{{OUTPUT_BINDINGS}}
+	}
+}
+)~~~";
 
 
-std::string createMapOverlapKernelProgramHelper_CU(SkeletonInstance &instance, UserFunction &mapOverlapFunc, int dim, std::string dir, std::string kernelSource, std::string kernelTag)
+std::string createMapOverlapKernelProgramHelper_CU(SkeletonInstance &instance, UserFunction &mapOverlapFunc, int dim, std::string dir, std::string kernelSource, std::string kernelTag,
+	int outputsY = 1, int outputsX = 1, std::vector<std::pair<std::string, std::string>> extraReplacements = {})
 {
 	std::stringstream SSMapOverlapFuncArgs, SSKernelParamList;
 	IndexCodeGen indexInfo = indexInitHelper_CU(mapOverlapFunc);
@@ -659,22 +1114,31 @@ std::string createMapOverlapKernelProgramHelper_CU(SkeletonInstance &instance, U
 	first = false;
 	
 	std::string sdataName = "sdata_" + instance;
+	std::string argsPrefix = SSMapOverlapFuncArgs.str();
 	if (dim == 1)
 		SSMapOverlapFuncArgs << "{(int)overlap, 1, &" << sdataName << "[skepu_tid + overlap]}";
 	else if (dim == 2)
-		SSMapOverlapFuncArgs << "{(int)skepu_overlap_y, (int)skepu_overlap_x, skepu_sharedCols, &" << sdataName << "[(threadIdx.y + skepu_overlap_y) * skepu_sharedCols + (threadIdx.x + skepu_overlap_x)]}";
+		SSMapOverlapFuncArgs << "{(int)skepu_overlap_y, (int)skepu_overlap_x, skepu_sharedCols, &" << sdataName << "[(skepu_ty + skepu_overlap_y) * skepu_sharedCols + (skepu_tx + skepu_overlap_x)]}";
 	else if (dim == 3)
 		SSMapOverlapFuncArgs
 			<< "{(int)skepu_overlap_i, (int)skepu_overlap_j, (int)skepu_overlap_k, skepu_shared_size_j * skepu_shared_size_k, skepu_shared_size_k, &"
 			<< sdataName << "[(threadIdx.z + skepu_overlap_i) * skepu_shared_size_j * skepu_shared_size_k + (threadIdx.y + skepu_overlap_j) * skepu_shared_size_k + (threadIdx.x + skepu_overlap_k)]}";
+	else if (dim == 4)
+		SSMapOverlapFuncArgs
+			<< "{(int)skepu_overlap_i, (int)skepu_overlap_j, (int)skepu_overlap_k, (int)skepu_overlap_l, skepu_stride_j, skepu_stride_k, skepu_stride_l, &"
+			<< sdataName << "[(skepu_ti + skepu_overlap_i) * skepu_stride_j + (skepu_tj + skepu_overlap_j) * skepu_stride_k + (skepu_tk + skepu_overlap_k) * skepu_stride_l + (skepu_tl + skepu_overlap_l)]}";
+	
+	SSKernelParamList << "const " << mapOverlapFunc.regionParam->templateInstantiationType() << " *skepu_input, ";
 	
-	SSKernelParamList << mapOverlapFunc.regionParam->templateInstantiationType() << " *skepu_input, ";
+	std::stringstream SSArgsSuffix;
+	auto argsInfo = handleRandomAccessAndUniforms_CU(mapOverlapFunc, SSArgsSuffix, SSKernelParamList, first);
+	SSMapOverlapFuncArgs << SSArgsSuffix.str();
 	
-	auto argsInfo = handleRandomAccessAndUniforms_CU(mapOverlapFunc, SSMapOverlapFuncArgs, SSKernelParamList, first);
+	// The temporally blocked kernel passes a region into its current tile buffer instead
+	std::string temporalArgs = argsPrefix + "{(int)skepu_overlap_y, (int)skepu_overlap_x, skepu_sharedCols, &skepu_src[skepu_shared_y * skepu_sharedCols + skepu_shared_x]}" + SSArgsSuffix.str();
 	
 	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_" + kernelTag + "_" + mapOverlapFunc.uniqueName;
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
-	FSOutFile << templateString(kernelSource,
+	std::vector<std::pair<std::string, std::string>> replacements =
 	{
 		{"{{MAPOVERLAP_INPUT_TYPE}}",    mapOverlapFunc.regionParam->templateInstantiationType()},
 		{"{{KERNEL_NAME}}",              kernelName},
@@ -682,12 +1146,19 @@ std::string createMapOverlapKernelProgramHelper_CU(SkeletonInstance &instance, U
 		{"{{INPUT_PARAM_NAME}}",         "skepu_input"},
 		{"{{KERNEL_PARAMS}}",            SSKernelParamList.str()},
 		{"{{MAPOVERLAP_ARGS}}",          SSMapOverlapFuncArgs.str()},
+		{"{{MAPOVERLAP_TEMPORAL_ARGS}}", temporalArgs},
 		{"{{INDEX_INITIALIZER}}",        indexInfo.indexInit},
 		{"{{OUTPUT_BINDINGS}}",          multiOutputAssign},
 		{"{{PROXIES_UPDATE}}",           argsInfo.proxyInitializerInner},
 		{"{{PROXIES_INIT}}",             argsInfo.proxyInitializer},
-		{"{{SHARED_BUFFER}}",            sdataName}
-	});
+		{"{{SHARED_BUFFER}}",            sdataName},
+		{"{{OUTPUTS_Y}}",                std::to_string(outputsY)},
+		{"{{OUTPUTS_X}}",                std::to_string(outputsX)}
+	};
+	replacements.insert(replacements.end(), extraReplacements.begin(), extraReplacements.end());
+	
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(kernelSource, replacements);
 	return kernelName;
 }
 
@@ -698,9 +1169,37 @@ std::string createMapOverlap1DKernelProgram_CU(SkeletonInstance &instance, UserF
 		"Overlap1DKernel");
 }
 
-std::string createMapOverlap2DKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapOverlapFunc, std::string dir)
+std::string createMapOverlap2DKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapOverlapFunc, std::string dir, const MapOverlap2DVariants_CU &variants)
 {
-	return createMapOverlapKernelProgramHelper_CU(instance, mapOverlapFunc, 2, dir, MatrixConvol2D_CU, "Overlap2DKernel");
+	// Kernels are named after the user function, so instances with other strips get kernels of their own
+	std::string kernelTag = "Overlap2DKernel";
+	if (variants.outputsY != 1 || variants.outputsX != 1)
+		kernelTag += "_" + std::to_string(variants.outputsY) + "x" + std::to_string(variants.outputsX);
+	std::string kernelSource = MatrixConvol2D_CU;
+	if (variants.temporal)
+		kernelSource += MatrixConvol2DTemporal_CU;
+	if (variants.redBlack)
+	{
+		kernelSource += MatrixConvol2DRedBlack_CU;
+		kernelTag += "_RedBlack";
+	}
+	
+	std::vector<std::pair<std::string, std::string>> extraReplacements;
+	if (variants.residualMap)
+	{
+		UserFunction &reduceFunc = *variants.residualReduce;
+		if (useShuffleReduce_CU(reduceFunc))
+			kernelSource = generateShuffleReduceHelpers_CU() + kernelSource;
+		kernelSource += MatrixConvol2DReduce_CU + generateReduceOnlyKernel_CU(reduceFunc, "{{KERNEL_NAME}}_conv_cuda_2D_reduce_kernel_ReduceOnly", "{{SHARED_BUFFER}}_partials");
+		kernelTag += "_" + variants.residualMap->uniqueName + "_" + reduceFunc.uniqueName;
+		extraReplacements =
+		{
+			{"{{RESIDUAL_TYPE}}",   reduceResultType_CU(reduceFunc)},
+			{"{{RESIDUAL_MAP}}",    variants.residualMap->funcNameCUDA()},
+			{"{{RESIDUAL_REDUCE}}", reduceFunc.funcNameCUDA()}
+		};
+	}
+	return createMapOverlapKernelProgramHelper_CU(instance, mapOverlapFunc, 2, dir, kernelSource, kernelTag, variants.outputsY, variants.outputsX, extraReplacements);
 }
 
 std::string createMapOverlap3DKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapOverlapFunc, std::string dir)
@@ -31,44 +31,125 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_n, size_t skepu_Vsi
 }
 )~~~";
 
+// Symmetric variant, see MapPairsSymmetricKernelTemplate_CU
+const char *MapPairsSymmetricKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_Symmetric({{KERNEL_PARAMS}} size_t skepu_n, size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base)
+{
+	size_t skepu_global_prng_id = get_global_id(0);
+	size_t skepu_pairs = skepu_Vsize * (skepu_Vsize + 1) / 2;
+	size_t skepu_p = get_global_id(0);
+	size_t skepu_gridSize = get_local_size(0) * get_num_groups(0);
+	const float skepu_b = 2.0f * skepu_Vsize + 1.0f;
+	{{CONTAINER_PROXIES}}
+	
+	while (skepu_p < skepu_pairs)
+	{
+		// Row r starts at pair r * Vsize - r * (r - 1) / 2; estimate r and correct for rounding
+		size_t skepu_row = (size_t)((skepu_b - sqrt(skepu_b * skepu_b - 8.0f * skepu_p)) / 2.0f);
+		while (skepu_row > 0 && skepu_row * skepu_Vsize - skepu_row * (skepu_row - 1) / 2 > skepu_p) --skepu_row;
+		while ((skepu_row + 1) * skepu_Vsize - (skepu_row + 1) * skepu_row / 2 <= skepu_p) ++skepu_row;
+		size_t skepu_col = skepu_row + skepu_p - (skepu_row * skepu_Vsize - skepu_row * (skepu_row - 1) / 2);
+		
+		size_t skepu_i = skepu_row * skepu_Hsize + skepu_col;
+		{{INDEX_INITIALIZER}}
+		{{CONTAINER_PROXIE_INNER}}
+#if !{{USE_MULTIRETURN}}
+		{{MAPPAIRS_RESULT_TYPE}} skepu_res = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+		skepu_output[skepu_i] = skepu_res;
+		if (skepu_row != skepu_col)
+			skepu_output[skepu_col * skepu_Hsize + skepu_row] = {{MIRROR_SIGN}}skepu_res;
+#else
+		{{MULTI_TYPE}} skepu_out_temp = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+		{{OUTPUT_ASSIGN}}
+		if (skepu_row != skepu_col)
+		{
+			skepu_i = skepu_col * skepu_Hsize + skepu_row;
+			{{OUTPUT_ASSIGN}}
+		}
+#endif
+		skepu_p += skepu_gridSize;
+	}
+}
+)~~~";
+
+const std::string SymmetricBuild = R"~~~(
+		cl_kernel kernel_symmetric = clCreateKernel(program, "{{KERNEL_NAME}}_Symmetric", &err);
+		CL_CHECK_ERROR(err, "Error creating symmetric mappairs kernel '{{KERNEL_NAME}}_Symmetric'");
+		skepu_kernels(deviceID, &kernel_symmetric, KERNEL_SYMMETRIC);
+)~~~";
+
+const std::string SymmetricLauncher = R"~~~(
+	static void mapSymmetric
+	(
+		size_t skepu_deviceID, size_t skepu_localSize, size_t skepu_globalSize, {{HOST_KERNEL_PARAMS}}
+		size_t skepu_n, size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base
+	)
+	{
+		cl_kernel skepu_kernel = skepu_kernels(skepu_deviceID, nullptr, KERNEL_SYMMETRIC);
+		skepu_cl_set_kernel_args(skepu_kernel, {{KERNEL_ARGS}} skepu_n, skepu_Vsize, skepu_Hsize, skepu_base);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(skepu_err, "Error launching symmetric MapPairs kernel");
+	}
+)~~~";
+
 
 const std::string Constructor = R"~~~(
 class {{KERNEL_CLASS}}
 {
 public:
 	
-	static cl_kernel skepu_kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
+	enum
+	{
+		KERNEL_MAPPAIRS = 0,
+		KERNEL_SYMMETRIC,
+		KERNEL_COUNT
+	};
+	
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel skepu_kernels(size_t deviceID, cl_kernel *newkernel = nullptr, size_t kerneltype = KERNEL_MAPPAIRS)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 	
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
-		
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
-		
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating mappairs kernel '{{KERNEL_NAME}}'");
-			
-			skepu_kernels(counter++, &kernel);
-		}
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating mappairs kernel '{{KERNEL_NAME}}'");
 		
-		initialized = true;
+		skepu_kernels(deviceID, &kernel);
+		{{SYMMETRIC_BUILD}}
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 	
 	static void map
@@ -77,15 +158,16 @@ public:
 		size_t skepu_n, size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base
 	)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(skepu_kernels(skepu_deviceID), {{KERNEL_ARGS}} skepu_n, skepu_Vsize, skepu_Hsize, skepu_base);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(), skepu_kernels(skepu_deviceID), 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, NULL);
+		skepu_cl_set_kernel_args(skepu_kernels(skepu_deviceID), {{KERNEL_ARGS}} skepu_n, skepu_Vsize, skepu_Hsize, skepu_base);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernels(skepu_deviceID), 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching MapPairs kernel");
 	}
+	{{SYMMETRIC_LAUNCHER}}
 };
 )~~~";
 
 
-std::string createMapPairsKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapPairsFunc, std::string dir)
+std::string createMapPairsKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapPairsFunc, std::string dir, PairSymmetry symmetry)
 {
 	std::stringstream sourceStream, SSMapPairsFuncArgs, SSKernelParamList, SSHostKernelParamList, SSKernelArgs;
 	IndexCodeGen indexInfo = indexInitHelper_CL(mapPairsFunc);
@@ -98,7 +180,7 @@ std::string createMapPairsKernelProgram_CL(SkeletonInstance &instance, UserFunct
 	for (UserFunction::Param& param : mapPairsFunc.elwiseParams)
 	{
 		if (!first) { SSMapPairsFuncArgs << ", "; }
-		SSKernelParamList << "__global " << param.typeNameOpenCL() << " *" << param.name << ", ";
+		SSKernelParamList << "__global const " << param.typeNameOpenCL() << " *" << param.name << ", ";
 		SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << param.resolvedTypeName << "> *" << param.name << ", ";
 		SSKernelArgs << param.name << "->getDeviceDataPointer(), ";
 		if (ctr++ < mapPairsFunc.Varity) // vertical containers
@@ -112,14 +194,18 @@ std::string createMapPairsKernelProgram_CL(SkeletonInstance &instance, UserFunct
 	handleUserTypesConstantsAndPrecision_CL({&mapPairsFunc}, sourceStream);
 	proxyCodeGenHelper_CL(argsInfo.containerProxyTypes, sourceStream);
 	sourceStream << generateUserFunctionCode_CL(mapPairsFunc) << MapPairsKernelTemplate_CL;
+	if (symmetry != PairSymmetry::None)
+		sourceStream << MapPairsSymmetricKernelTemplate_CL;
 	
 	std::stringstream SSKernelName;
 	SSKernelName << instance << "_" << transformToCXXIdentifier(ResultName) << "_MapPairsKernel_" << mapPairsFunc.uniqueName << "_Varity_" << mapPairsFunc.Varity << "_Harity_" << mapPairsFunc.Harity;
 	const std::string kernelName = SSKernelName.str();
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor,
+	bool symmetric = symmetry != PairSymmetry::None;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
 	{
+		{"{{SYMMETRIC_BUILD}}",         symmetric ? SymmetricBuild : ""},
+		{"{{SYMMETRIC_LAUNCHER}}",      symmetric ? SymmetricLauncher : ""},
 		{"{{OPENCL_KERNEL}}",           sourceStream.str()},
 		{"{{KERNEL_NAME}}",             kernelName},
 		{"{{FUNCTION_NAME_MAPPAIRS}}",  mapPairsFunc.uniqueName},
@@ -133,8 +219,8 @@ std::string createMapPairsKernelProgram_CL(SkeletonInstance &instance, UserFunct
 		{"{{CONTAINER_PROXIE_INNER}}",  argsInfo.proxyInitializerInner},
 		{"{{MULTI_TYPE}}",              mapPairsFunc.multiReturnTypeNameGPU()},
 		{"{{USE_MULTIRETURN}}",         (mapPairsFunc.multipleReturnTypes.size() > 0) ? "1" : "0"},
-		{"{{OUTPUT_ASSIGN}}",           multiOutputAssign}
-	});
-	
-	return kernelName;
+		{"{{OUTPUT_ASSIGN}}",           multiOutputAssign},
+		{"{{MAPPAIRS_RESULT_TYPE}}",    mapPairsFunc.returnTypeNameOpenCL()},
+		{"{{MIRROR_SIGN}}",             (symmetry == PairSymmetry::Antisymmetric) ? "-" : ""}
+	}), dir);
 }
\ No newline at end of file
@@ -26,8 +26,98 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t ske
 }
 )~~~";
 
+// Shared-memory tiled variant (-mappairs-tile): each block stages a {{TILE_V}} x {{TILE_H}} tile of the
+// vertical and horizontal elementwise arguments in shared memory, and each thread keeps the horizontal
+// operands of its column in registers while sweeping a strided set of rows of the tile.
+const char *MapPairsTiledKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_Tiled({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base)
+{
+	{{TILE_DECLARATIONS}}
+	const size_t skepu_w2 = skepu_Hsize;
+	const size_t skepu_tileH = ({{TILE_H}} < blockDim.x) ? {{TILE_H}} : blockDim.x;
+	const size_t skepu_tilesV = (skepu_Vsize + {{TILE_V}} - 1) / {{TILE_V}};
+	const size_t skepu_tilesH = (skepu_Hsize + skepu_tileH - 1) / skepu_tileH;
+	const size_t skepu_col = threadIdx.x % skepu_tileH;
+	const size_t skepu_rowGroup = threadIdx.x / skepu_tileH;
+	const size_t skepu_rowGroups = blockDim.x / skepu_tileH;
+
+	for (size_t skepu_tile = blockIdx.x; skepu_tile < skepu_tilesV * skepu_tilesH; skepu_tile += gridDim.x)
+	{
+		const size_t skepu_v0 = (skepu_tile / skepu_tilesH) * {{TILE_V}};
+		const size_t skepu_h0 = (skepu_tile % skepu_tilesH) * skepu_tileH;
+
+		__syncthreads();
+		for (size_t skepu_t = threadIdx.x; skepu_t < {{TILE_V}} && skepu_v0 + skepu_t < skepu_Vsize; skepu_t += blockDim.x)
+		{
+			{{LOAD_V_TILE}}
+		}
+		for (size_t skepu_t = threadIdx.x; skepu_t < skepu_tileH && skepu_h0 + skepu_t < skepu_Hsize; skepu_t += blockDim.x)
+		{
+			{{LOAD_H_TILE}}
+		}
+		__syncthreads();
+
+		const size_t skepu_h = skepu_h0 + skepu_col;
+		if (skepu_rowGroup < skepu_rowGroups && skepu_h < skepu_Hsize)
+		{
+			{{LOAD_H_REGISTERS}}
+			for (size_t skepu_r = skepu_rowGroup; skepu_r < {{TILE_V}} && skepu_v0 + skepu_r < skepu_Vsize; skepu_r += skepu_rowGroups)
+			{
+				size_t skepu_i = (skepu_v0 + skepu_r) * skepu_Hsize + skepu_h;
+				{{INDEX_INITIALIZER}}
+				auto skepu_res = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+				{{OUTPUT_BINDINGS}}
+			}
+		}
+	}
+}
+)~~~";
 
-std::string createMapPairsKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapPairsFunc, std::string dir)
+// Symmetric variant (-mappairs-symmetric/-mappairs-antisymmetric): Vsize == Hsize, only the upper triangle
+// including the diagonal is evaluated, in row-major order, and each result is mirrored below the diagonal.
+const char *MapPairsSymmetricKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_Symmetric({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base)
+{
+	size_t skepu_pairs = skepu_Vsize * (skepu_Vsize + 1) / 2;
+	size_t skepu_p = blockIdx.x * blockDim.x + threadIdx.x;
+	size_t skepu_gridSize = blockDim.x * gridDim.x;
+	size_t skepu_w2 = skepu_Hsize;
+	const double skepu_b = 2.0 * skepu_Vsize + 1.0;
+
+	while (skepu_p < skepu_pairs)
+	{
+		// Row r starts at pair r * Vsize - r * (r - 1) / 2; estimate r and correct for rounding
+		size_t skepu_row = (size_t)((skepu_b - sqrt(skepu_b * skepu_b - 8.0 * skepu_p)) / 2.0);
+		while (skepu_row > 0 && skepu_row * skepu_Vsize - skepu_row * (skepu_row - 1) / 2 > skepu_p) --skepu_row;
+		while ((skepu_row + 1) * skepu_Vsize - (skepu_row + 1) * skepu_row / 2 <= skepu_p) ++skepu_row;
+		size_t skepu_col = skepu_row + skepu_p - (skepu_row * skepu_Vsize - skepu_row * (skepu_row - 1) / 2);
+
+		size_t skepu_i = skepu_row * skepu_Hsize + skepu_col;
+		{{INDEX_INITIALIZER}}
+		auto skepu_res = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+		{{OUTPUT_BINDINGS}}
+		if (skepu_row != skepu_col)
+		{
+			skepu_i = skepu_col * skepu_Hsize + skepu_row;
+			{{MIRROR_RESULT}}
+			{{OUTPUT_BINDINGS}}
+		}
+		skepu_p += skepu_gridSize;
+	}
+}
+)~~~";
+
+// Width of the horizontal tile, one warp
+static const size_t MapPairsTileH_CU = 32;
+
+
+bool useTiledMapPairs_CU(UserFunction &mapPairsFunc)
+{
+	// Random streams are tied to the per-thread iteration order of the untiled kernel
+	return MapPairsTile > 0 && !mapPairsFunc.randomParam && !mapPairsFunc.elwiseParams.empty();
+}
+
+std::string createMapPairsKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapPairsFunc, std::string dir, PairSymmetry symmetry)
 {
 	std::stringstream SSKernelParamList, SSMapPairsFuncArgs;
 	IndexCodeGen indexInfo = indexInitHelper_CU(mapPairsFunc);
@@ -40,7 +130,7 @@ std::string createMapPairsKernelProgram_CU(SkeletonInstance &instance, UserFunct
 	for (UserFunction::Param& param : mapPairsFunc.elwiseParams)
 	{
 		if (!first) { SSMapPairsFuncArgs << ", "; }
-		SSKernelParamList << param.resolvedTypeName << " *" << param.name << ", ";
+		SSKernelParamList << "const " << param.resolvedTypeName << " *" << param.name << ", ";
 		if (ctr++ < mapPairsFunc.Varity) // vertical containers
 			SSMapPairsFuncArgs << param.name << "[skepu_i / skepu_Hsize]";
 		else // horizontal containers
@@ -53,7 +143,7 @@ std::string createMapPairsKernelProgram_CU(SkeletonInstance &instance, UserFunct
 	SSKernelName << instance + "_" + transformToCXXIdentifier(ResultName) << "_MapPairsKernel_" << mapPairsFunc.uniqueName << "_Varity_" << mapPairsFunc.Varity << "_Harity_" << mapPairsFunc.Harity;
 	const std::string kernelName = SSKernelName.str();
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
 	FSOutFile << templateString(MapPairsKernelTemplate_CU,
 	{
 		{"{{KERNEL_NAME}}",            kernelName},
@@ -65,5 +155,64 @@ std::string createMapPairsKernelProgram_CU(SkeletonInstance &instance, UserFunct
 		{"{{PROXIES_UPDATE}}",         argsInfo.proxyInitializerInner},
 		{"{{PROXIES_INIT}}",           argsInfo.proxyInitializer}
 	});
+	
+	if (symmetry != PairSymmetry::None)
+		FSOutFile << templateString(MapPairsSymmetricKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",            kernelName},
+			{"{{FUNCTION_NAME_MAPPAIRS}}", mapPairsFunc.funcNameCUDA()},
+			{"{{KERNEL_PARAMS}}",          SSKernelParamList.str()},
+			{"{{MAPPAIRS_ARGS}}",          SSMapPairsFuncArgs.str()},
+			{"{{INDEX_INITIALIZER}}",      indexInfo.indexInit},
+			{"{{OUTPUT_BINDINGS}}",        multiOutputAssign},
+			{"{{MIRROR_RESULT}}",          (symmetry == PairSymmetry::Antisymmetric) ? "skepu_res = -skepu_res;" : ""}
+		});
+	
+	if (useTiledMapPairs_CU(mapPairsFunc))
+	{
+		std::stringstream SSTiledArgs, SSTileDecls, SSLoadV, SSLoadH, SSLoadHRegisters, SSTiledParamList;
+		bool firstTiled = !indexInfo.hasIndex;
+		SSTiledArgs << indexInfo.mapFuncParam;
+		std::string tiledOutputAssign = handleOutputs_CU(mapPairsFunc, SSTiledParamList);
+		
+		ctr = 0;
+		for (UserFunction::Param& param : mapPairsFunc.elwiseParams)
+		{
+			if (!firstTiled) { SSTiledArgs << ", "; }
+			SSTiledParamList << param.resolvedTypeName << " *" << param.name << ", ";
+			if (ctr++ < mapPairsFunc.Varity) // vertical containers
+			{
+				SSTileDecls << "__shared__ " << param.resolvedTypeName << " skepu_vtile_" << param.name << "[" << MapPairsTile << "];\n";
+				SSLoadV << "skepu_vtile_" << param.name << "[skepu_t] = " << param.name << "[skepu_v0 + skepu_t];\n";
+				SSTiledArgs << "skepu_vtile_" << param.name << "[skepu_r]";
+			}
+			else // horizontal containers
+			{
+				SSTileDecls << "__shared__ " << param.resolvedTypeName << " skepu_htile_" << param.name << "[" << MapPairsTileH_CU << "];\n";
+				SSLoadH << "skepu_htile_" << param.name << "[skepu_t] = " << param.name << "[skepu_h0 + skepu_t];\n";
+				SSLoadHRegisters << param.resolvedTypeName << " skepu_hreg_" << param.name << " = skepu_htile_" << param.name << "[skepu_col];\n";
+				SSTiledArgs << "skepu_hreg_" << param.name;
+			}
+			firstTiled = false;
+		}
+		handleRandomAccessAndUniforms_CU(mapPairsFunc, SSTiledArgs, SSTiledParamList, firstTiled);
+		
+		FSOutFile << templateString(MapPairsTiledKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",            kernelName},
+			{"{{FUNCTION_NAME_MAPPAIRS}}", mapPairsFunc.funcNameCUDA()},
+			{"{{KERNEL_PARAMS}}",          SSTiledParamList.str()},
+			{"{{MAPPAIRS_ARGS}}",          SSTiledArgs.str()},
+			{"{{INDEX_INITIALIZER}}",      indexInfo.indexInit},
+			{"{{OUTPUT_BINDINGS}}",        tiledOutputAssign},
+			{"{{TILE_DECLARATIONS}}",      SSTileDecls.str()},
+			{"{{LOAD_V_TILE}}",            SSLoadV.str()},
+			{"{{LOAD_H_TILE}}",            SSLoadH.str()},
+			{"{{LOAD_H_REGISTERS}}",       SSLoadHRegisters.str()},
+			{"{{TILE_V}}",                 std::to_string(MapPairsTile)},
+			{"{{TILE_H}}",                 std::to_string(MapPairsTileH_CU)}
+		});
+	}
+	
 	return kernelName;
 }
\ No newline at end of file
@@ -58,20 +58,7 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_n, size_t skepu_Vsi
 			skepu_lookup_V += skepu_blockSize;
 	}
 	
-	skepu_sdata[skepu_tid] = skepu_result;
-	
-	barrier(CLK_LOCAL_MEM_FENCE);
-	
-	if (skepu_blockSize >= 1024) { if (skepu_tid < 512 && skepu_tid + 512 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 512]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  512) { if (skepu_tid < 256 && skepu_tid + 256 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 256]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  256) { if (skepu_tid < 128 && skepu_tid + 128 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 128]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  128) { if (skepu_tid <  64 && skepu_tid +  64 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  64]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   64) { if (skepu_tid <  32 && skepu_tid +  32 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  32]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   32) { if (skepu_tid <  16 && skepu_tid +  16 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  16]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   16) { if (skepu_tid <   8 && skepu_tid +   8 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   8]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    8) { if (skepu_tid <   4 && skepu_tid +   4 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   4]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    4) { if (skepu_tid <   2 && skepu_tid +   2 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   2]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    2) { if (skepu_tid <   1 && skepu_tid +   1 < skepu_Hsize) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   1]); } barrier(CLK_LOCAL_MEM_FENCE); }
+{{BLOCK_REDUCE}}
 	
 
 	if (skepu_tid == 0)
@@ -81,44 +68,192 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_n, size_t skepu_Vsi
 }
 )~~~";
 
+// Symmetric variant, see MapPairsReduceSymmetricKernelTemplate_CU. The tile-local column partials and their
+// validity flags live in two local buffers of get_local_size(0) elements each.
+const char *MapPairsReduceSymmetricKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_SymmetricTiles({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base, int skepu_transposed, __global {{REDUCE_RESULT_TYPE}} *skepu_partials, __local {{REDUCE_RESULT_TYPE}} *skepu_sdata, __local int *skepu_col_valid)
+{
+	size_t skepu_global_prng_id = get_global_id(0);
+	const size_t skepu_T = get_local_size(0);
+	const size_t skepu_tid = get_local_id(0);
+	const size_t skepu_tiles = (skepu_Vsize + skepu_T - 1) / skepu_T;
+	const size_t skepu_tilePairs = skepu_tiles * (skepu_tiles + 1) / 2;
+	const float skepu_b = 2.0f * skepu_tiles + 1.0f;
+	{{CONTAINER_PROXIES}}
+	
+	for (size_t skepu_p = get_group_id(0); skepu_p < skepu_tilePairs; skepu_p += get_num_groups(0))
+	{
+		// Tile row I starts at pair I * tiles - I * (I - 1) / 2; estimate I and correct for rounding
+		size_t skepu_I = (size_t)((skepu_b - sqrt(skepu_b * skepu_b - 8.0f * skepu_p)) / 2.0f);
+		while (skepu_I > 0 && skepu_I * skepu_tiles - skepu_I * (skepu_I - 1) / 2 > skepu_p) --skepu_I;
+		while ((skepu_I + 1) * skepu_tiles - (skepu_I + 1) * skepu_I / 2 <= skepu_p) ++skepu_I;
+		size_t skepu_J = skepu_I + skepu_p - (skepu_I * skepu_tiles - skepu_I * (skepu_I - 1) / 2);
+		
+		const size_t skepu_row = skepu_I * skepu_T + skepu_tid;
+		{{REDUCE_RESULT_TYPE}} skepu_result;
+		int skepu_row_valid = 0;
+		skepu_col_valid[skepu_tid] = 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		
+		// Diagonal sweep: in step k thread t visits tile column (t + k) % T, so the columns of one step are distinct
+		for (size_t skepu_k = 0; skepu_k < skepu_T; ++skepu_k)
+		{
+			const size_t skepu_c = (skepu_tid + skepu_k) % skepu_T;
+			const size_t skepu_col = skepu_J * skepu_T + skepu_c;
+			
+			// Diagonal tiles visit each unordered pair twice, keep the one on or above the diagonal
+			if (skepu_row < skepu_Vsize && skepu_col < skepu_Vsize && (skepu_I != skepu_J || skepu_tid <= skepu_c))
+			{
+				size_t skepu_lookup_V = skepu_row;
+				size_t skepu_lookup_H = skepu_col;
+				{{INDEX_INITIALIZER}}
+				{{CONTAINER_PROXIE_INNER}}
+				{{MAPPAIRS_RESULT_TYPE}} skepu_value = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+				{{MAPPAIRS_RESULT_TYPE}} skepu_mirrored = {{MIRROR_SIGN}}skepu_value;
+				{{MAPPAIRS_RESULT_TYPE}} skepu_to_row = (skepu_transposed && skepu_row != skepu_col) ? skepu_mirrored : skepu_value;
+				{{MAPPAIRS_RESULT_TYPE}} skepu_to_col = skepu_transposed ? skepu_value : skepu_mirrored;
+				
+				skepu_result = skepu_row_valid ? {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_to_row) : skepu_to_row;
+				skepu_row_valid = 1;
+				if (skepu_row != skepu_col)
+				{
+					skepu_sdata[skepu_c] = skepu_col_valid[skepu_c] ? {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_c], skepu_to_col) : skepu_to_col;
+					skepu_col_valid[skepu_c] = 1;
+				}
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+		
+		// Row partials belong to tile column J, column partials (rows of tile J) to tile column I
+		if (skepu_I == skepu_J)
+		{
+			if (skepu_col_valid[skepu_tid])
+				skepu_result = skepu_row_valid ? {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_sdata[skepu_tid]) : skepu_sdata[skepu_tid];
+			if (skepu_row < skepu_Vsize)
+				skepu_partials[skepu_J * skepu_Vsize + skepu_row] = skepu_result;
+		}
+		else
+		{
+			if (skepu_row < skepu_Vsize)
+				skepu_partials[skepu_J * skepu_Vsize + skepu_row] = skepu_result;
+			if (skepu_J * skepu_T + skepu_tid < skepu_Vsize)
+				skepu_partials[skepu_I * skepu_Vsize + skepu_J * skepu_T + skepu_tid] = skepu_sdata[skepu_tid];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+__kernel void {{KERNEL_NAME}}_SymmetricCombine(__global {{REDUCE_RESULT_TYPE}} *skepu_output, __global {{REDUCE_RESULT_TYPE}} *skepu_partials, size_t skepu_Vsize, size_t skepu_tiles)
+{
+	for (size_t skepu_i = get_global_id(0); skepu_i < skepu_Vsize; skepu_i += get_global_size(0))
+	{
+		{{REDUCE_RESULT_TYPE}} skepu_result = skepu_partials[skepu_i];
+		for (size_t skepu_tile = 1; skepu_tile < skepu_tiles; ++skepu_tile)
+			skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_partials[skepu_tile * skepu_Vsize + skepu_i]);
+		skepu_output[skepu_i] = skepu_result;
+	}
+}
+)~~~";
+
+const std::string SymmetricBuild = R"~~~(
+		cl_kernel kernel_symmetric_tiles = clCreateKernel(program, "{{KERNEL_NAME}}_SymmetricTiles", &err);
+		CL_CHECK_ERROR(err, "Error creating MapPairsReduce kernel '{{KERNEL_NAME}}_SymmetricTiles'");
+		cl_kernel kernel_symmetric_combine = clCreateKernel(program, "{{KERNEL_NAME}}_SymmetricCombine", &err);
+		CL_CHECK_ERROR(err, "Error creating MapPairsReduce kernel '{{KERNEL_NAME}}_SymmetricCombine'");
+		
+		skepu_kernels(deviceID, &kernel_symmetric_tiles, KERNEL_SYMMETRIC_TILES);
+		skepu_kernels(deviceID, &kernel_symmetric_combine, KERNEL_SYMMETRIC_COMBINE);
+)~~~";
+
+const std::string SymmetricLauncher = R"~~~(
+	static void mapPairsReduceSymmetricTiles
+	(
+		size_t skepu_deviceID, size_t skepu_localSize, size_t skepu_globalSize, {{HOST_KERNEL_PARAMS}}
+		size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base, int skepu_transposed,
+		skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_CPU}}> *skepu_partials
+	)
+	{
+		cl_kernel skepu_kernel = skepu_kernels(skepu_deviceID, nullptr, KERNEL_SYMMETRIC_TILES);
+		skepu_cl_set_kernel_args(skepu_kernel, {{KERNEL_ARGS}} skepu_Vsize, skepu_Hsize, skepu_base, skepu_transposed, skepu_partials->getDeviceDataPointer());
+		clSetKernelArg(skepu_kernel, {{KERNEL_ARG_COUNT}} + 5, sizeof({{REDUCE_RESULT_CPU}}) * skepu_localSize, NULL);
+		clSetKernelArg(skepu_kernel, {{KERNEL_ARG_COUNT}} + 6, sizeof(cl_int) * skepu_localSize, NULL);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(skepu_err, "Error launching MapPairsReduce symmetric tile kernel");
+	}
+	
+	static void mapPairsReduceSymmetricCombine
+	(
+		size_t skepu_deviceID, size_t skepu_localSize, size_t skepu_globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_CPU}}> *skepu_output, skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_CPU}}> *skepu_partials,
+		size_t skepu_Vsize, size_t skepu_tiles
+	)
+	{
+		cl_kernel skepu_kernel = skepu_kernels(skepu_deviceID, nullptr, KERNEL_SYMMETRIC_COMBINE);
+		skepu_cl_set_kernel_args(skepu_kernel, skepu_output->getDeviceDataPointer(), skepu_partials->getDeviceDataPointer(), skepu_Vsize, skepu_tiles);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(skepu_err, "Error launching MapPairsReduce symmetric combine kernel");
+	}
+)~~~";
+
 
 const std::string Constructor = R"~~~(
 class {{KERNEL_CLASS}}
 {
 public:
 
-	static cl_kernel skepu_kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
+	enum
+	{
+		KERNEL_MAPPAIRSREDUCE = 0,
+		KERNEL_SYMMETRIC_TILES,
+		KERNEL_SYMMETRIC_COMBINE,
+		KERNEL_COUNT
+	};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel skepu_kernels(size_t deviceID, cl_kernel *newkernel = nullptr, size_t kerneltype = KERNEL_MAPPAIRSREDUCE)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_mappairsreduce = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating MapPairsReduce kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel_mappairsreduce = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating MapPairsReduce kernel '{{KERNEL_NAME}}'");
+		skepu_kernels(deviceID, &kernel_mappairsreduce);
+		{{SYMMETRIC_BUILD}}
+	}
 
-			skepu_kernels(counter++, &kernel_mappairsreduce);
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 	
 	static void mapPairsReduce
@@ -128,18 +263,18 @@ public:
 		size_t skepu_sharedMemSize
 	)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(skepu_kernels(skepu_deviceID), {{KERNEL_ARGS}} skepu_n, skepu_Vsize, skepu_Hsize, skepu_base, skepu_transposed);
+		skepu_cl_set_kernel_args(skepu_kernels(skepu_deviceID), {{KERNEL_ARGS}} skepu_n, skepu_Vsize, skepu_Hsize, skepu_base, skepu_transposed);
 		clSetKernelArg(skepu_kernels(skepu_deviceID), {{KERNEL_ARG_COUNT}} + 5, skepu_sharedMemSize, NULL);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(), skepu_kernels(skepu_deviceID), 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, NULL);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernels(skepu_deviceID), 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching MapPairsReduce kernel");
 	}
-	
+	{{SYMMETRIC_LAUNCHER}}
 	
 };
 )~~~";
 
 
-std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapPairsFunc, UserFunction &reduceFunc, std::string dir)
+std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapPairsFunc, UserFunction &reduceFunc, std::string dir, PairSymmetry symmetry)
 {
 	std::stringstream sourceStream, SSMapPairsFuncArgs, SSKernelParamList, SSHostKernelParamList, SSKernelArgs;
 	std::string indexInit = "";
@@ -157,7 +292,7 @@ std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance &instance, Use
 	for (UserFunction::Param& param : mapPairsFunc.elwiseParams)
 	{
 		if (!first) { SSMapPairsFuncArgs << ", "; }
-		SSKernelParamList << "__global " << param.resolvedTypeName << " *" << param.name << ", ";
+		SSKernelParamList << "__global const " << param.resolvedTypeName << " *" << param.name << ", ";
 		SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<" << param.resolvedTypeName << "> *" << param.name << ", ";
 		SSKernelArgs << param.name << "->getDeviceDataPointer(), ";
 		if (ctr++ < mapPairsFunc.Varity) // vertical containers
@@ -177,7 +312,9 @@ std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance &instance, Use
 		sourceStream << generateUserFunctionCode_CL(reduceFunc);
 	else
 		sourceStream << generateUserFunctionCode_CL(mapPairsFunc) << generateUserFunctionCode_CL(reduceFunc);
-	sourceStream << MapPairsReduceKernelTemplate_CL;
+	sourceStream << collectiveReducePrelude_CL({&reduceFunc}) << MapPairsReduceKernelTemplate_CL;
+	if (symmetry != PairSymmetry::None)
+		sourceStream << MapPairsReduceSymmetricKernelTemplate_CL;
 	
 	std::stringstream SSKernelName;
 	SSKernelName << instance << "_" << transformToCXXIdentifier(ResultName) << "_MapPairsReduceKernel_" << mapPairsFunc.uniqueName << "_Varity_" << mapPairsFunc.Varity << "_Harity_" << mapPairsFunc.Harity;
@@ -186,10 +323,13 @@ std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance &instance, Use
 	std::stringstream SSKernelArgCount;
 	SSKernelArgCount << mapPairsFunc.numKernelArgsCL();
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor,
+	bool symmetric = symmetry != PairSymmetry::None;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
 	{
+		{"{{SYMMETRIC_BUILD}}",         symmetric ? SymmetricBuild : ""},
+		{"{{SYMMETRIC_LAUNCHER}}",      symmetric ? SymmetricLauncher : ""},
 		{"{{OPENCL_KERNEL}}",           sourceStream.str()},
+		{"{{BLOCK_REDUCE}}",            generateBlockReduce_CL(reduceFunc, reduceFunc.rawReturnTypeName, "skepu_result", "skepu_sdata", "skepu_tid", "skepu_blockSize", "skepu_Hsize")},
 		{"{{KERNEL_NAME}}",             kernelName},
 		{"{{FUNCTION_NAME_MAPPAIRS}}",  mapPairsFunc.uniqueName},
 		{"{{KERNEL_PARAMS}}",           SSKernelParamList.str()},
@@ -209,7 +349,6 @@ std::string createMapPairsReduceKernelProgram_CL(SkeletonInstance &instance, Use
 		{"{{REDUCE_RESULT_TYPE}}",      reduceFunc.rawReturnTypeName},
 		{"{{REDUCE_RESULT_CPU}}",       reduceFunc.resolvedReturnTypeName},
 		{"{{FUNCTION_NAME_REDUCE}}",    reduceFunc.uniqueName},
-	});
-	
-	return kernelName;
+		{"{{MIRROR_SIGN}}",             (symmetry == PairSymmetry::Antisymmetric) ? "-" : ""},
+	}), dir);
 }
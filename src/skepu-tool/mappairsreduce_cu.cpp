@@ -50,6 +50,9 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t ske
 	}
 	
 	
+#if {{USE_SHUFFLE_REDUCE}}
+{{SHUFFLE_REDUCE}}
+#else
 	{{SHARED_BUFFER}}[skepu_tid] = skepu_result;
 	
 	__syncthreads();
@@ -74,6 +77,7 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t ske
 		if (skepu_blockSize >=   4) { if (skepu_tid <  2) { skepu_smem[skepu_tid] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_smem[skepu_tid +  2]); } __syncwarp(); }
 		if (skepu_blockSize >=   2) { if (skepu_tid <  1) { skepu_smem[skepu_tid] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_smem[skepu_tid +  1]); } __syncwarp(); }
 	}
+#endif
 
 	if (skepu_tid == 0)
 	{
@@ -83,7 +87,151 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t ske
 )~~~";
 
 
-std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapPairsFunc, UserFunction &reduceFunc, std::string dir)
+// Symmetric variant (-mappairs-symmetric/-mappairs-antisymmetric), for Vsize == Hsize. The iteration space is cut
+// into blockDim x blockDim tiles and each block evaluates tiles (I, J) with I <= J only. A pair contributes its value
+// to its own row and its mirrored value to the other one (swapped for column-wise reduction), giving one partial
+// result per tile column and row in skepu_partials[tile * Vsize + row], which _SymmetricCombine then reduces.
+// The partials buffer holds ceil(Vsize / blockDim) * Vsize elements and both kernels use the same block size.
+const char *MapPairsReduceSymmetricKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_SymmetricTiles({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base, bool skepu_transposed, {{REDUCE_RESULT_TYPE}} *skepu_partials)
+{
+	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
+	__shared__ bool skepu_col_valid[1024];
+	
+	const size_t skepu_T = blockDim.x;
+	const size_t skepu_tid = threadIdx.x;
+	const size_t skepu_tiles = (skepu_Vsize + skepu_T - 1) / skepu_T;
+	const size_t skepu_tilePairs = skepu_tiles * (skepu_tiles + 1) / 2;
+	const double skepu_b = 2.0 * skepu_tiles + 1.0;
+	
+	for (size_t skepu_p = blockIdx.x; skepu_p < skepu_tilePairs; skepu_p += gridDim.x)
+	{
+		// Tile row I starts at pair I * tiles - I * (I - 1) / 2; estimate I and correct for rounding
+		size_t skepu_I = (size_t)((skepu_b - sqrt(skepu_b * skepu_b - 8.0 * skepu_p)) / 2.0);
+		while (skepu_I > 0 && skepu_I * skepu_tiles - skepu_I * (skepu_I - 1) / 2 > skepu_p) --skepu_I;
+		while ((skepu_I + 1) * skepu_tiles - (skepu_I + 1) * skepu_I / 2 <= skepu_p) ++skepu_I;
+		size_t skepu_J = skepu_I + skepu_p - (skepu_I * skepu_tiles - skepu_I * (skepu_I - 1) / 2);
+		
+		const size_t skepu_row = skepu_I * skepu_T + skepu_tid;
+		{{REDUCE_RESULT_TYPE}} skepu_result{};
+		bool skepu_row_valid = false;
+		skepu_col_valid[skepu_tid] = false;
+		__syncthreads();
+		
+		// Diagonal sweep: in step k thread t visits tile column (t + k) % T, so the columns of one step are distinct
+		for (size_t skepu_k = 0; skepu_k < skepu_T; ++skepu_k)
+		{
+			const size_t skepu_c = (skepu_tid + skepu_k) % skepu_T;
+			const size_t skepu_col = skepu_J * skepu_T + skepu_c;
+			
+			// Diagonal tiles visit each unordered pair twice, keep the one on or above the diagonal
+			if (skepu_row < skepu_Vsize && skepu_col < skepu_Vsize && (skepu_I != skepu_J || skepu_tid <= skepu_c))
+			{
+				size_t skepu_lookup_V = skepu_row;
+				size_t skepu_lookup_H = skepu_col;
+				{{INDEX_INITIALIZER}}
+				{{MAPPAIRS_RESULT_TYPE}} skepu_value = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+				{{MAPPAIRS_RESULT_TYPE}} skepu_mirrored = {{MIRROR_SIGN}}skepu_value;
+				{{MAPPAIRS_RESULT_TYPE}} skepu_to_row = (skepu_transposed && skepu_row != skepu_col) ? skepu_mirrored : skepu_value;
+				{{MAPPAIRS_RESULT_TYPE}} skepu_to_col = skepu_transposed ? skepu_value : skepu_mirrored;
+				
+				skepu_result = skepu_row_valid ? {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_to_row) : skepu_to_row;
+				skepu_row_valid = true;
+				if (skepu_row != skepu_col)
+				{
+					{{SHARED_BUFFER}}[skepu_c] = skepu_col_valid[skepu_c] ? {{FUNCTION_NAME_REDUCE}}({{SHARED_BUFFER}}[skepu_c], skepu_to_col) : skepu_to_col;
+					skepu_col_valid[skepu_c] = true;
+				}
+			}
+			__syncthreads();
+		}
+		
+		// Row partials belong to tile column J, column partials (rows of tile J) to tile column I
+		if (skepu_I == skepu_J)
+		{
+			if (skepu_col_valid[skepu_tid])
+				skepu_result = skepu_row_valid ? {{FUNCTION_NAME_REDUCE}}(skepu_result, {{SHARED_BUFFER}}[skepu_tid]) : {{SHARED_BUFFER}}[skepu_tid];
+			if (skepu_row < skepu_Vsize)
+				skepu_partials[skepu_J * skepu_Vsize + skepu_row] = skepu_result;
+		}
+		else
+		{
+			if (skepu_row < skepu_Vsize)
+				skepu_partials[skepu_J * skepu_Vsize + skepu_row] = skepu_result;
+			if (skepu_J * skepu_T + skepu_tid < skepu_Vsize)
+				skepu_partials[skepu_I * skepu_Vsize + skepu_J * skepu_T + skepu_tid] = {{SHARED_BUFFER}}[skepu_tid];
+		}
+		__syncthreads();
+	}
+}
+
+__global__ void {{KERNEL_NAME}}_SymmetricCombine({{REDUCE_RESULT_TYPE}} *skepu_output, {{REDUCE_RESULT_TYPE}} *skepu_partials, size_t skepu_Vsize, size_t skepu_tiles)
+{
+	for (size_t skepu_i = blockIdx.x * blockDim.x + threadIdx.x; skepu_i < skepu_Vsize; skepu_i += blockDim.x * gridDim.x)
+	{
+		{{REDUCE_RESULT_TYPE}} skepu_result = skepu_partials[skepu_i];
+		for (size_t skepu_tile = 1; skepu_tile < skepu_tiles; ++skepu_tile)
+			skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_partials[skepu_tile * skepu_Vsize + skepu_i]);
+		skepu_output[skepu_i] = skepu_result;
+	}
+}
+)~~~";
+
+
+// N-body variant for many results: one thread per result, accumulating in a register, while the block streams the
+// reduced dimension through shared memory tiles of MapPairsReduceBroadcastTile_CU elements, so that each element of that side is read from
+// global memory once per block instead of once per result. Launched with one thread per result, from result skepu_base,
+// with no dynamic shared memory. The default kernel keeps the results with few of them and long reductions, where one
+// block per result is the only way to occupy the device; this one pays off once there are enough results to fill it.
+const char *MapPairsReduceBroadcastKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_Broadcast({{KERNEL_PARAMS}} size_t skepu_Vsize, size_t skepu_Hsize, size_t skepu_base, bool skepu_transposed)
+{
+	{{TILE_DECLARATIONS}}
+	const size_t skepu_out = skepu_base + blockIdx.x * blockDim.x + threadIdx.x;
+	const bool skepu_active = skepu_out < skepu_Vsize;
+	{{LOAD_OWN_REGISTERS}}
+	{{REDUCE_RESULT_TYPE}} skepu_result{};
+	
+	for (size_t skepu_h0 = 0; skepu_h0 < skepu_Hsize; skepu_h0 += {{TILE}})
+	{
+		const size_t skepu_count = (skepu_Hsize - skepu_h0 < {{TILE}}) ? skepu_Hsize - skepu_h0 : {{TILE}};
+		__syncthreads();
+		for (size_t skepu_t = threadIdx.x; skepu_t < skepu_count; skepu_t += blockDim.x)
+		{
+			{{LOAD_TILE}}
+		}
+		__syncthreads();
+		
+		if (skepu_active)
+			for (size_t skepu_t = 0; skepu_t < skepu_count; ++skepu_t)
+			{
+				size_t skepu_lookup_V = skepu_transposed ? skepu_h0 + skepu_t : skepu_out;
+				size_t skepu_lookup_H = skepu_transposed ? skepu_out : skepu_h0 + skepu_t;
+				{{INDEX_INITIALIZER}}
+				{{MAPPAIRS_RESULT_TYPE}} skepu_value = {{FUNCTION_NAME_MAPPAIRS}}({{MAPPAIRS_ARGS}});
+				skepu_result = (skepu_h0 + skepu_t == 0) ? skepu_value : {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_value);
+			}
+	}
+	
+	if (skepu_active)
+		skepu_output[skepu_out] = skepu_result;
+}
+)~~~";
+
+// Elements of the streamed side per shared memory tile of the _Broadcast kernel
+static const size_t MapPairsReduceBroadcastTile_CU = 128;
+
+bool useBroadcastMapPairsReduce_CU(const std::string &InstanceName, UserFunction &mapPairsFunc)
+{
+	if (!instanceIsSelected(MapPairsReduceBroadcastInstances, InstanceName))
+		return false;
+	// Random streams are tied to the per-thread iteration order of the default kernel
+	if (mapPairsFunc.randomParam)
+		SkePUAbort("Broadcast MapPairsReduce instance " + InstanceName + " cannot take a random stream");
+	return true;
+}
+
+std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapPairsFunc, UserFunction &reduceFunc, std::string dir, PairSymmetry symmetry, bool broadcast)
 {
 	std::stringstream SSMapPairsFuncArgs, SSKernelParamList, SSHostKernelParamList, SSStrideInit, SSStrideCount;
 	std::string indexInit = "";
@@ -102,7 +250,7 @@ std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance &instance, Use
 	{
 		if (!first) { SSMapPairsFuncArgs << ", "; }
 		SSStrideInit << "if (skepu_strides[" << stride_counter << "] < 0) { " << param.name << " += (-Vsize + 1) * skepu_strides[" << stride_counter << "]; }\n"; // TODO, group V and H
-		SSKernelParamList << param.resolvedTypeName << " *" << param.name << ", ";
+		SSKernelParamList << "const " << param.resolvedTypeName << " *" << param.name << ", ";
 		if (ctr++ < mapPairsFunc.Varity) // vertical containers
 			SSMapPairsFuncArgs << param.name << "[skepu_lookup_V]";
 		else // horizontal containers
@@ -110,12 +258,18 @@ std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance &instance, Use
 		first = false;
 	}
 	
+	// The _Broadcast kernel has the same parameters, random parameters aside
+	std::stringstream SSBroadcastArgs, SSBroadcastParamList;
+	bool firstBroadcast = first;
+	
 	auto argsInfo = handleRandomAccessAndUniforms_CU(mapPairsFunc, SSMapPairsFuncArgs, SSKernelParamList, first);
 	
 	std::stringstream SSKernelName;
 	SSKernelName << instance << "_" << transformToCXXIdentifier(ResultName) << "_MapPairsReduceKernel_" << mapPairsFunc.uniqueName << "_Varity_" << mapPairsFunc.Varity << "_Harity_" << mapPairsFunc.Harity;
 	const std::string kernelName = SSKernelName.str();
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	if (useShuffleReduce_CU(reduceFunc))
+		FSOutFile << generateShuffleReduceHelpers_CU();
 	FSOutFile << templateString(MapPairsReduceKernelTemplate_CU,
 	{
 		{"{{KERNEL_NAME}}",             kernelName},
@@ -133,8 +287,62 @@ std::string createMapPairsReduceKernelProgram_CU(SkeletonInstance &instance, Use
 		{"{{REDUCE_RESULT_TYPE}}",      reduceFunc.rawReturnTypeName},
 		{"{{REDUCE_RESULT_CPU}}",       reduceFunc.resolvedReturnTypeName},
 		{"{{FUNCTION_NAME_REDUCE}}",    reduceFunc.funcNameCUDA()},
-		{"{{SHARED_BUFFER}}",           "sdata_" + instance}
+		{"{{SHARED_BUFFER}}",           "sdata_" + instance},
+		{"{{USE_SHUFFLE_REDUCE}}",      useShuffleReduce_CU(reduceFunc) ? "1" : "0"},
+		{"{{SHUFFLE_REDUCE}}",          generateShuffleBlockReduce_CU(reduceFunc, reduceFunc.rawReturnTypeName, "sdata_" + instance, "skepu_Hsize")}
 	});
 	
+	if (broadcast)
+	{
+		// The side each thread owns is vertical, horizontal when transposed; the other one is streamed through tiles
+		std::stringstream SSTileDecls, SSLoadTile, SSLoadOwn;
+		SSBroadcastArgs << (mapPairsFunc.indexed2D ? "skepu_index" : "");
+		firstBroadcast = !mapPairsFunc.indexed2D;
+		ctr = 0;
+		for (UserFunction::Param& param : mapPairsFunc.elwiseParams)
+		{
+			const bool vertical = ctr++ < mapPairsFunc.Varity;
+			const std::string tile = "skepu_tile_" + param.name, own = "skepu_own_" + param.name;
+			if (!firstBroadcast) { SSBroadcastArgs << ", "; }
+			SSTileDecls << "__shared__ " << param.resolvedTypeName << " " << tile << "[" << MapPairsReduceBroadcastTile_CU << "];\n";
+			SSLoadTile << "if (" << (vertical ? "" : "!") << "skepu_transposed) " << tile << "[skepu_t] = " << param.name << "[skepu_h0 + skepu_t];\n";
+			SSLoadOwn << param.resolvedTypeName << " " << own << " = (skepu_active && " << (vertical ? "!" : "") << "skepu_transposed) ? " << param.name << "[skepu_out] : " << param.resolvedTypeName << "{};\n";
+			SSBroadcastArgs << (vertical ? "(skepu_transposed ? " + tile + "[skepu_t] : " + own + ")" : "(skepu_transposed ? " + own + " : " + tile + "[skepu_t])");
+			firstBroadcast = false;
+		}
+		handleRandomAccessAndUniforms_CU(mapPairsFunc, SSBroadcastArgs, SSBroadcastParamList, firstBroadcast);
+		
+		FSOutFile << templateString(MapPairsReduceBroadcastKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",             kernelName},
+			{"{{FUNCTION_NAME_MAPPAIRS}}",  mapPairsFunc.funcNameCUDA()},
+			{"{{KERNEL_PARAMS}}",           SSKernelParamList.str()},
+			{"{{MAPPAIRS_ARGS}}",           SSBroadcastArgs.str()},
+			{"{{INDEX_INITIALIZER}}",       indexInit},
+			{"{{MAPPAIRS_RESULT_TYPE}}",    mapPairsFunc.rawReturnTypeName},
+			{"{{REDUCE_RESULT_TYPE}}",      reduceFunc.rawReturnTypeName},
+			{"{{FUNCTION_NAME_REDUCE}}",    reduceFunc.funcNameCUDA()},
+			{"{{TILE_DECLARATIONS}}",       SSTileDecls.str()},
+			{"{{LOAD_TILE}}",               SSLoadTile.str()},
+			{"{{LOAD_OWN_REGISTERS}}",      SSLoadOwn.str()},
+			{"{{TILE}}",                    std::to_string(MapPairsReduceBroadcastTile_CU)}
+		});
+	}
+	
+	if (symmetry != PairSymmetry::None)
+		FSOutFile << templateString(MapPairsReduceSymmetricKernelTemplate_CU,
+		{
+			{"{{KERNEL_NAME}}",             kernelName},
+			{"{{FUNCTION_NAME_MAPPAIRS}}",  mapPairsFunc.funcNameCUDA()},
+			{"{{KERNEL_PARAMS}}",           SSKernelParamList.str()},
+			{"{{MAPPAIRS_ARGS}}",           SSMapPairsFuncArgs.str()},
+			{"{{INDEX_INITIALIZER}}",       indexInit},
+			{"{{MAPPAIRS_RESULT_TYPE}}",    mapPairsFunc.rawReturnTypeName},
+			{"{{REDUCE_RESULT_TYPE}}",      reduceFunc.rawReturnTypeName},
+			{"{{FUNCTION_NAME_REDUCE}}",    reduceFunc.funcNameCUDA()},
+			{"{{SHARED_BUFFER}}",           "sdata_" + instance},
+			{"{{MIRROR_SIGN}}",             (symmetry == PairSymmetry::Antisymmetric) ? "-" : ""}
+		});
+	
 	return kernelName;
 }
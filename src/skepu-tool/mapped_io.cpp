@@ -0,0 +1,200 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Binary container files for -mapped-io. A file is a 4 KiB header followed by the raw elements in row-major
+ * order: the magic SKEPUBIN, the format version, the element size in bytes, the rank, the layout (0 for row-major)
+ * and up to four dimensions, outermost first. save writes a vector or matrix in one write of its host storage.
+ *
+ * A Mapped container maps such a file and uses the mapping as its host storage, through the pointer constructors
+ * of the containers, so opening a file is O(1) and elements are paged in on first access; device uploads read
+ * straight from the page cache. ReadOnly maps the file copy-on-write, so the container can still be written
+ * without changing the file. WriteBack maps it shared, and sync and the destructor first bring the host storage
+ * up to date with the device, then flush the mapping to the file. Opening a file whose element size or rank
+ * does not match the container throws std::runtime_error. The header is included before the SkePU headers and
+ * is only available on POSIX systems.
+ */
+static const char *MappedIOSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace skepu
+{
+	template<typename T> class Vector;
+	template<typename T> class Matrix;
+
+	namespace mapped
+	{
+		constexpr size_t HeaderBytes = 4096;
+
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t elementBytes;
+			uint32_t rank;
+			uint32_t layout;
+			uint64_t dims[4];
+		};
+
+		enum class Mode
+		{
+			ReadOnly, WriteBack
+		};
+
+		template<typename Container> struct Shape;
+
+		template<typename T>
+		struct Shape<skepu::Vector<T>>
+		{
+			static constexpr uint32_t rank = 1;
+			static void dims(skepu::Vector<T> &c, uint64_t *dims) { dims[0] = c.size(); }
+			static skepu::Vector<T> make(T *data, const uint64_t *dims) { return skepu::Vector<T>(data, dims[0], false); }
+		};
+
+		template<typename T>
+		struct Shape<skepu::Matrix<T>>
+		{
+			static constexpr uint32_t rank = 2;
+			static void dims(skepu::Matrix<T> &c, uint64_t *dims) { dims[0] = c.total_rows(); dims[1] = c.total_cols(); }
+			static skepu::Matrix<T> make(T *data, const uint64_t *dims) { return skepu::Matrix<T>(data, dims[0], dims[1], false); }
+		};
+
+		inline std::runtime_error error(std::string const& path, std::string const& what)
+		{
+			return std::runtime_error("skepu::mapped: " + path + ": " + what);
+		}
+
+		template<typename Container>
+		void save(std::string const& path, Container &c)
+		{
+			using T = typename Container::value_type;
+			char block[HeaderBytes] = {};
+			Header header {};
+			std::memcpy(header.magic, "SKEPUBIN", 8);
+			header.version = 1;
+			header.elementBytes = sizeof(T);
+			header.rank = Shape<Container>::rank;
+			Shape<Container>::dims(c, header.dims);
+			std::memcpy(block, &header, sizeof(header));
+
+			c.updateHost();
+			int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				throw error(path, "cannot be created");
+			const char *parts[2] = {block, reinterpret_cast<const char*>(c.getAddress())};
+			size_t sizes[2] = {HeaderBytes, c.size() * sizeof(T)};
+			for (size_t p = 0; p < 2; ++p)
+				for (size_t done = 0; done < sizes[p]; )
+				{
+					ssize_t written = ::write(fd, parts[p] + done, sizes[p] - done);
+					if (written <= 0)
+					{
+						::close(fd);
+						throw error(path, "write failed");
+					}
+					done += written;
+				}
+			::close(fd);
+		}
+
+		template<typename Container>
+		class Mapped
+		{
+			using T = typename Container::value_type;
+
+		public:
+			Mapped(std::string const& path, Mode mode = Mode::ReadOnly): mode(mode), base(map(path, mode, bytes)),
+				container(Shape<Container>::make(reinterpret_cast<T*>(static_cast<char*>(base) + HeaderBytes), header().dims)) {}
+
+			~Mapped()
+			{
+				if (this->mode == Mode::WriteBack)
+					this->sync();
+				::munmap(this->base, this->bytes);
+			}
+
+			Mapped(Mapped const&) = delete;
+			Mapped &operator=(Mapped const&) = delete;
+
+			Container &get() { return this->container; }
+
+			// Writes the current contents of the container to the file
+			void sync()
+			{
+				this->container.updateHost();
+				if (this->mode == Mode::WriteBack)
+					::msync(this->base, this->bytes, MS_SYNC);
+			}
+
+		private:
+			Header const& header() const { return *static_cast<Header const*>(this->base); }
+
+			static void *map(std::string const& path, Mode mode, size_t &bytes)
+			{
+				int fd = ::open(path.c_str(), mode == Mode::WriteBack ? O_RDWR : O_RDONLY);
+				if (fd < 0)
+					throw error(path, "cannot be opened");
+				struct stat info;
+				if (::fstat(fd, &info) != 0 || size_t(info.st_size) < HeaderBytes)
+				{
+					::close(fd);
+					throw error(path, "is not a SkePU container file");
+				}
+				bytes = info.st_size;
+				void *base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, mode == Mode::WriteBack ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+				::close(fd);
+				if (base == MAP_FAILED)
+					throw error(path, "cannot be mapped");
+
+				Header const& header = *static_cast<Header const*>(base);
+				size_t elements = 1;
+				for (uint32_t d = 0; d < header.rank && d < 4; ++d)
+					elements *= header.dims[d];
+				const char *problem = nullptr;
+				if (std::memcmp(header.magic, "SKEPUBIN", 8) != 0 || header.version != 1 || header.layout != 0)
+					problem = "is not a SkePU container file";
+				else if (header.elementBytes != sizeof(T) || header.rank != Shape<Container>::rank)
+					problem = "does not match the element size or rank of the container";
+				else if (bytes < HeaderBytes + elements * sizeof(T))
+					problem = "is truncated";
+				if (problem)
+				{
+					::munmap(base, bytes);
+					throw error(path, problem);
+				}
+				return base;
+			}
+
+			Mode mode;
+			size_t bytes = 0;
+			void *base;
+			Container container;
+		};
+	}
+}
+)~~~";
+
+
+std::string generateMappedIOSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_mapped_io.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << MappedIOSupport;
+		generated = true;
+	}
+	return fileName;
+}
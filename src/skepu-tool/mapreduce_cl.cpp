@@ -19,6 +19,7 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} __global {{REDUCE_RESULT_TYPE}}*
 	{{REDUCE_RESULT_TYPE}} skepu_result;
 	{{CONTAINER_PROXIES}}
 	{{STRIDE_INIT}}
+	{{INDEX_SETUP}}
 
 	if (skepu_i < skepu_n)
 	{
@@ -26,6 +27,7 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} __global {{REDUCE_RESULT_TYPE}}*
 		{{CONTAINER_PROXIE_INNER}}
 		skepu_result = {{FUNCTION_NAME_MAP}}({{MAP_PARAMS}});
 		skepu_i += skepu_gridSize;
+		{{INDEX_STEP}}
 	}
 
 	while (skepu_i < skepu_n)
@@ -35,21 +37,10 @@ __kernel void {{KERNEL_NAME}}({{KERNEL_PARAMS}} __global {{REDUCE_RESULT_TYPE}}*
 		{{MAP_RESULT_TYPE}} tempMap = {{FUNCTION_NAME_MAP}}({{MAP_PARAMS}});
 		skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, tempMap);
 		skepu_i += skepu_gridSize;
+		{{INDEX_STEP}}
 	}
 
-	skepu_sdata[skepu_tid] = skepu_result;
-	barrier(CLK_LOCAL_MEM_FENCE);
-	
-	if (skepu_blockSize >= 1024) { if (skepu_tid < 512 && skepu_tid + 512 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 512]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  512) { if (skepu_tid < 256 && skepu_tid + 256 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 256]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  256) { if (skepu_tid < 128 && skepu_tid + 128 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 128]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  128) { if (skepu_tid <  64 && skepu_tid +  64 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  64]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   64) { if (skepu_tid <  32 && skepu_tid +  32 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  32]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   32) { if (skepu_tid <  16 && skepu_tid +  16 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  16]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   16) { if (skepu_tid <   8 && skepu_tid +   8 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   8]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    8) { if (skepu_tid <   4 && skepu_tid +   4 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   4]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    4) { if (skepu_tid <   2 && skepu_tid +   2 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   2]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    2) { if (skepu_tid <   1 && skepu_tid +   1 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   1]); } barrier(CLK_LOCAL_MEM_FENCE); }
+{{BLOCK_REDUCE}}
 
 	if (skepu_tid == 0)
 	{
@@ -79,19 +70,7 @@ __kernel void {{KERNEL_NAME}}_ReduceOnly(__global {{REDUCE_RESULT_TYPE}}* skepu_
 		skepu_i += skepu_gridSize;
 	}
 
-	skepu_sdata[skepu_tid] = skepu_result;
-	barrier(CLK_LOCAL_MEM_FENCE);
-	
-	if (skepu_blockSize >= 1024) { if (skepu_tid < 512 && skepu_tid + 512 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 512]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  512) { if (skepu_tid < 256 && skepu_tid + 256 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 256]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  256) { if (skepu_tid < 128 && skepu_tid + 128 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid + 128]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=  128) { if (skepu_tid <  64 && skepu_tid +  64 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  64]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   64) { if (skepu_tid <  32 && skepu_tid +  32 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  32]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   32) { if (skepu_tid <  16 && skepu_tid +  16 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +  16]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=   16) { if (skepu_tid <   8 && skepu_tid +   8 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   8]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    8) { if (skepu_tid <   4 && skepu_tid +   4 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   4]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    4) { if (skepu_tid <   2 && skepu_tid +   2 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   2]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (skepu_blockSize >=    2) { if (skepu_tid <   1 && skepu_tid +   1 < skepu_n) { skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_sdata[skepu_tid], skepu_sdata[skepu_tid +   1]); } barrier(CLK_LOCAL_MEM_FENCE); }
+{{BLOCK_REDUCE}}
 
 	if (skepu_tid == 0)
 	{
@@ -109,47 +88,63 @@ public:
 	enum
 	{
 		KERNEL_MAPREDUCE = 0,
+		KERNEL_MAPREDUCE_UNIT_STRIDE,
 		KERNEL_REDUCE,
 		KERNEL_COUNT
 	};
 
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8][KERNEL_COUNT]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID][kerneltype] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID][kerneltype];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_mapreduce = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating MapReduce kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel_mapreduce = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating MapReduce kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_mapreduce_unit_stride = clCreateKernel(program, "{{KERNEL_NAME}}_UnitStride", &err);
+		CL_CHECK_ERROR(err, "Error creating MapReduce kernel '{{KERNEL_NAME}}_UnitStride'");
 
-			cl_kernel kernel_reduce = clCreateKernel(program, "{{KERNEL_NAME}}_ReduceOnly", &err);
-			CL_CHECK_ERROR(err, "Error creating MapReduce kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_reduce = clCreateKernel(program, "{{KERNEL_NAME}}_ReduceOnly", &err);
+		CL_CHECK_ERROR(err, "Error creating MapReduce kernel '{{KERNEL_NAME}}'");
 
-			kernels(counter, KERNEL_MAPREDUCE, &kernel_mapreduce);
-			kernels(counter, KERNEL_REDUCE,    &kernel_reduce);
-			counter++;
-		}
+		kernels(deviceID, KERNEL_MAPREDUCE, &kernel_mapreduce);
+		kernels(deviceID, KERNEL_MAPREDUCE_UNIT_STRIDE, &kernel_mapreduce_unit_stride);
+		kernels(deviceID, KERNEL_REDUCE,    &kernel_reduce);
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	{{TEMPLATE_HEADER}}
@@ -162,10 +157,10 @@ public:
 		size_t skepu_sharedMemSize
 	)
 	{
-		cl_kernel skepu_kernel = kernels(skepu_deviceID, KERNEL_MAPREDUCE);
-		skepu::backend::cl_helpers::setKernelArgs(skepu_kernel, {{KERNEL_ARGS}} skepu_output->getDeviceDataPointer(), {{SIZE_ARGS}} {{STRIDE_ARGS}} skepu_n, skepu_base);
+		cl_kernel skepu_kernel = kernels(skepu_deviceID, ({{UNIT_STRIDES}}) ? KERNEL_MAPREDUCE_UNIT_STRIDE : KERNEL_MAPREDUCE);
+		skepu_cl_set_kernel_args(skepu_kernel, {{KERNEL_ARGS}} skepu_output->getDeviceDataPointer(), {{SIZE_ARGS}} {{STRIDE_ARGS}} skepu_n, skepu_base);
 		clSetKernelArg(skepu_kernel, {{KERNEL_ARG_COUNT}}, skepu_sharedMemSize, NULL);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, NULL);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching MapReduce kernel");
 	}
 
@@ -177,9 +172,9 @@ public:
 	)
 	{
 		cl_kernel skepu_kernel = kernels(skepu_deviceID, KERNEL_REDUCE);
-		skepu::backend::cl_helpers::setKernelArgs(skepu_kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), skepu_n);
+		skepu_cl_set_kernel_args(skepu_kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), skepu_n);
 		clSetKernelArg(skepu_kernel, 3, skepu_sharedMemSize, NULL);
-		cl_int skepu_err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(skepu_deviceID)->getQueue(), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, NULL);
+		cl_int skepu_err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(skepu_deviceID), skepu_kernel, 1, NULL, &skepu_globalSize, &skepu_localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(skepu_err, "Error launching MapReduce reduce-only kernel");
 	}
 };
@@ -189,7 +184,7 @@ public:
 std::string createMapReduceKernelProgram_CL(SkeletonInstance &instance, UserFunction &mapFunc, UserFunction &reduceFunc, std::string dir)
 {
 	std::stringstream sourceStream, SSKernelParamList, SSMapFuncArgs, SSHostKernelParamList, SSKernelArgs;
-	std::stringstream SSStrideParams, SSStrideArgs, SSStrideInit;
+	std::stringstream SSStrideParams, SSStrideArgs, SSStrideInit, SSUnitStrideParams, SSUnitStrideInit, SSUnitStrides;
 	IndexCodeGen indexInfo = indexInitHelper_CL(mapFunc);
 	bool first = !indexInfo.hasIndex;
 	SSMapFuncArgs << indexInfo.mapFuncParam;
@@ -203,7 +198,8 @@ std::string createMapReduceKernelProgram_CL(SkeletonInstance &instance, UserFunc
 		SSStrideParams << "int skepu_stride_" << stride_counter << ", ";
 		SSStrideArgs << "skepu_strides[" << stride_counter << "], ";
 		SSStrideInit << "if (skepu_stride_" << stride_counter << " < 0) { " << param.name << " += (-skepu_n + 1) * skepu_stride_" << stride_counter << "; }\n";
-		SSKernelParamList << "__global " << param.typeNameOpenCL() << " * " << param.name << ", ";
+		unitStrideHelper_CL(stride_counter, SSUnitStrideParams, SSUnitStrideInit, SSUnitStrides);
+		SSKernelParamList << "__global const " << param.typeNameOpenCL() << " *" << param.name << ", ";
 		SSHostKernelParamList << "skepu::backend::DeviceMemPointer_CL<const " << param.resolvedTypeName << "> * " << param.name << ", ";
 		SSKernelArgs << param.name << "->getDeviceDataPointer(), ";
 		SSMapFuncArgs << param.name << "[skepu_i * skepu_stride_" << stride_counter++ << "]";
@@ -222,21 +218,24 @@ std::string createMapReduceKernelProgram_CL(SkeletonInstance &instance, UserFunc
 	else
 		sourceStream << generateUserFunctionCode_CL(mapFunc) << generateUserFunctionCode_CL(reduceFunc);
 
-	sourceStream << MapReduceKernelTemplate_CL << ReduceKernelTemplate_CL;
+	sourceStream << collectiveReducePrelude_CL({&reduceFunc}) << MapReduceKernelTemplate_CL << ReduceKernelTemplate_CL;
+	sourceStream << unitStrideKernel_CL(MapReduceKernelTemplate_CL, SSUnitStrideParams.str(), SSUnitStrideInit.str());
 	
 	std::stringstream SSKernelName;
 	SSKernelName << instance << "_" << transformToCXXIdentifier(ResultName) << "_MapReduceKernel_" << mapFunc.uniqueName << "_" << reduceFunc.uniqueName << "_arity_" << mapFunc.Varity << "uid_" << GlobalSkeletonIndex++;
 	const std::string kernelName = SSKernelName.str();
 	std::stringstream SSKernelArgCount;
-	SSKernelArgCount << mapFunc.numKernelArgsCL() + 2 + std::max<int>(0, indexInfo.dim - 1) + stride_counter;
+	// numKernelArgsCL counts one output per map return value, the reduction writes a single one
+	size_t extraOutputs = reduceFunc.multiReduceMap ? mapFunc.multipleReturnTypes.size() - 1 : 0;
+	SSKernelArgCount << mapFunc.numKernelArgsCL() - extraOutputs + 2 + std::max<int>(0, indexInfo.dim - 1) + stride_counter;
 	
 	std::stringstream SSStrideCount;
 	SSStrideCount << mapFunc.elwiseParams.size();
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
 	{
 		{"{{OPENCL_KERNEL}}",          sourceStream.str()},
+		{"{{BLOCK_REDUCE}}",           generateBlockReduce_CL(reduceFunc, reduceFunc.rawReturnTypeName, "skepu_result", "skepu_sdata", "skepu_tid", "skepu_blockSize", "skepu_n")},
 		{"{{KERNEL_CLASS}}",           "CLWrapperClass_" + kernelName},
 		{"{{KERNEL_ARGS}}",            SSKernelArgs.str()},
 		{"{{KERNEL_ARG_COUNT}}",       SSKernelArgCount.str()},
@@ -245,13 +244,15 @@ std::string createMapReduceKernelProgram_CL(SkeletonInstance &instance, UserFunc
 		{"{{CONTAINER_PROXIE_INNER}}", argsInfo.proxyInitializerInner},
 		{"{{KERNEL_PARAMS}}",          SSKernelParamList.str()},
 		{"{{MAP_PARAMS}}",             SSMapFuncArgs.str()},
-		{"{{REDUCE_RESULT_TYPE}}",     reduceFunc.rawReturnTypeName},
+		{"{{REDUCE_RESULT_TYPE}}",     reduceFunc.multiReduceMap ? reduceFunc.multiReturnTypeNameGPU() : reduceFunc.rawReturnTypeName},
 		{"{{REDUCE_RESULT_CPU}}",      reduceFunc.resolvedReturnTypeName},
-		{"{{MAP_RESULT_TYPE}}",        mapFunc.rawReturnTypeName},
+		{"{{MAP_RESULT_TYPE}}",        reduceFunc.multiReduceMap ? mapFunc.multiReturnTypeNameGPU() : mapFunc.rawReturnTypeName},
 		{"{{FUNCTION_NAME_MAP}}",      mapFunc.uniqueName},
 		{"{{FUNCTION_NAME_REDUCE}}",   reduceFunc.uniqueName},
 		{"{{KERNEL_NAME}}",            kernelName},
-		{"{{INDEX_INITIALIZER}}",      indexInfo.indexInit},
+		{"{{INDEX_INITIALIZER}}",      indexInfo.incremental.setup.empty() ? indexInfo.indexInit : ""},
+		{"{{INDEX_SETUP}}",            indexInfo.incremental.setup},
+		{"{{INDEX_STEP}}",             indexInfo.incremental.step},
 		{"{{SIZE_PARAMS}}",            indexInfo.sizeParams},
 		{"{{SIZE_ARGS}}",              indexInfo.sizeArgs},
 		{"{{SIZES_TUPLE_PARAM}}",      indexInfo.sizesTupleParam},
@@ -259,8 +260,7 @@ std::string createMapReduceKernelProgram_CL(SkeletonInstance &instance, UserFunc
 		{"{{STRIDE_ARGS}}",            SSStrideArgs.str()},
 		{"{{STRIDE_COUNT}}",           SSStrideCount.str()},
 		{"{{STRIDE_INIT}}",            SSStrideInit.str()},
+		{"{{UNIT_STRIDES}}",           SSUnitStrides.str().empty() ? "true" : SSUnitStrides.str()},
 		{"{{TEMPLATE_HEADER}}",        indexInfo.templateHeader}
-	});
-
-	return kernelName;
+	}), dir);
 }
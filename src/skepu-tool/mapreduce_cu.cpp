@@ -7,8 +7,10 @@ using namespace clang;
 // Kernel templates
 // ------------------------------
 
+// Instantiated for skepu_unit_strides = true as well for -unit-stride instances, where all stride arithmetic folds away
 const char *MapReduceKernelTemplate_CU = R"~~~(
-__global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides)
+template<bool skepu_unit_strides>
+__global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_w3, size_t skepu_w4, size_t skepu_n, size_t skepu_base, skepu::StrideList<{{STRIDE_COUNT}}> skepu_strides{{EARLY_EXIT_PARAMS}}{{SINGLE_PASS_PARAMS}})
 {
 	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
 	
@@ -17,8 +19,12 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_
 	size_t skepu_tid = threadIdx.x;
 	size_t skepu_i = blockIdx.x * skepu_blockSize + skepu_tid;
 	size_t skepu_gridSize = skepu_blockSize * gridDim.x;
-	{{REDUCE_RESULT_TYPE}} skepu_result;
-	{{STRIDE_INIT}}
+	{{REDUCE_ACCUMULATOR_TYPE}} skepu_result;
+	{{INDEX_SETUP}}
+	if (!skepu_unit_strides)
+	{
+		{{STRIDE_INIT}}
+	}
 
 	if (skepu_i < skepu_n)
 	{
@@ -26,16 +32,22 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_
 		skepu_result = {{FUNCTION_NAME_MAP}}({{MAP_ARGS}});
 		//{{OUTPUT_BINDINGS}}
 		skepu_i += skepu_gridSize;
+		{{INDEX_STEP}}
 	}
 
 	while (skepu_i < skepu_n)
 	{
+{{EARLY_EXIT_CHECK}}
 		{{INDEX_INITIALIZER}}
 		auto skepu_tempMap = {{FUNCTION_NAME_MAP}}({{MAP_ARGS}});
 		skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_tempMap);
 		skepu_i += skepu_gridSize;
+		{{INDEX_STEP}}
 	}
 
+#if {{USE_SHUFFLE_REDUCE}}
+{{SHUFFLE_REDUCE}}
+#else
 	{{SHARED_BUFFER}}[skepu_tid] = skepu_result;
 	__syncthreads();
 
@@ -49,12 +61,52 @@ __global__ void {{KERNEL_NAME}}({{KERNEL_PARAMS}} size_t skepu_w2, size_t skepu_
 	if (skepu_blockSize >=    8) { if (skepu_tid <   4 && skepu_tid +   4 < skepu_n) { {{SHARED_BUFFER}}[skepu_tid] = {{FUNCTION_NAME_REDUCE}}({{SHARED_BUFFER}}[skepu_tid], {{SHARED_BUFFER}}[skepu_tid +   4]); } __syncthreads(); }
 	if (skepu_blockSize >=    4) { if (skepu_tid <   2 && skepu_tid +   2 < skepu_n) { {{SHARED_BUFFER}}[skepu_tid] = {{FUNCTION_NAME_REDUCE}}({{SHARED_BUFFER}}[skepu_tid], {{SHARED_BUFFER}}[skepu_tid +   2]); } __syncthreads(); }
 	if (skepu_blockSize >=    2) { if (skepu_tid <   1 && skepu_tid +   1 < skepu_n) { {{SHARED_BUFFER}}[skepu_tid] = {{FUNCTION_NAME_REDUCE}}({{SHARED_BUFFER}}[skepu_tid], {{SHARED_BUFFER}}[skepu_tid +   1]); } __syncthreads(); }
+#endif
 
 	if (skepu_tid == 0)
 		skepu_output[blockIdx.x] = {{SHARED_BUFFER}}[skepu_tid];
+{{SINGLE_PASS_FINALIZE}}
 }
 )~~~";
 
+// The last block to finish reduces the partials of all blocks into skepu_output[0] and resets the counter
+const char *MapReduceSinglePassFinalize_CU = R"~~~(
+	__shared__ bool skepu_last;
+	if (skepu_tid == 0)
+	{
+		__threadfence();
+		skepu_last = atomicAdd(skepu_blocks_done, 1) == gridDim.x - 1;
+	}
+	__syncthreads();
+	if (!skepu_last)
+		return;
+
+	size_t skepu_count = min((size_t)gridDim.x, skepu_blockSize);
+	if (skepu_tid < skepu_count)
+	{
+		{{REDUCE_RESULT_TYPE}} skepu_partial = skepu_output[skepu_tid];
+		for (size_t skepu_p = skepu_tid + skepu_blockSize; skepu_p < gridDim.x; skepu_p += skepu_blockSize)
+			skepu_partial = {{FUNCTION_NAME_REDUCE}}(skepu_partial, skepu_output[skepu_p]);
+		{{SHARED_BUFFER}}[skepu_tid] = skepu_partial;
+	}
+	__syncthreads();
+
+	for (size_t skepu_s = skepu_count; skepu_s > 1; )
+	{
+		size_t skepu_half = (skepu_s + 1) / 2;
+		if (skepu_tid < skepu_s - skepu_half)
+			{{SHARED_BUFFER}}[skepu_tid] = {{FUNCTION_NAME_REDUCE}}({{SHARED_BUFFER}}[skepu_tid], {{SHARED_BUFFER}}[skepu_tid + skepu_half]);
+		__syncthreads();
+		skepu_s = skepu_half;
+	}
+
+	if (skepu_tid == 0)
+	{
+		skepu_output[0] = {{SHARED_BUFFER}}[0];
+		*skepu_blocks_done = 0;
+	}
+)~~~";
+
 const char *ReduceKernelTemplate_CU = R"~~~(
 __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RESULT_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_blockSize, bool skepu_nIsPow2)
 {
@@ -65,7 +117,7 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 	size_t skepu_tid = threadIdx.x;
 	size_t skepu_i = blockIdx.x * skepu_blockSize*2 + threadIdx.x;
 	size_t skepu_gridSize = skepu_blockSize * 2 * gridDim.x;
-	{{REDUCE_RESULT_TYPE}} skepu_result;
+	{{REDUCE_ACCUMULATOR_TYPE}} skepu_result;
 
 	if(skepu_i < skepu_n)
 	{
@@ -91,6 +143,9 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 		skepu_i += skepu_gridSize;
 	}
 
+#if {{USE_SHUFFLE_REDUCE}}
+{{SHUFFLE_REDUCE}}
+#else
 	// each thread puts its local sum into shared memory
 	{{SHARED_BUFFER}}[skepu_tid] = skepu_result;
 	__syncthreads();
@@ -115,6 +170,7 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 		if (skepu_blockSize >=   4) { if (skepu_tid <  2) { skepu_smem[skepu_tid] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_smem[skepu_tid +  2]); } __syncwarp(); }
 		if (skepu_blockSize >=   2) { if (skepu_tid <  1) { skepu_smem[skepu_tid] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_smem[skepu_tid +  1]); } __syncwarp(); }
 	}
+#endif
 
 	// write result for this block to global mem
 	if (skepu_tid == 0)
@@ -123,13 +179,17 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 )~~~";
 
 
-std::string createMapReduceKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapFunc, UserFunction &reduceFunc, size_t arity, std::string dir)
+std::string createMapReduceKernelProgram_CU(SkeletonInstance &instance, UserFunction &mapFunc, UserFunction &reduceFunc, size_t arity, std::string dir, std::string absorbing, bool singlePass)
 {
 	std::stringstream SSKernelParamList, SSMapFuncArgs, SSStrideInit, SSStrideCount;
 	IndexCodeGen indexInfo = indexInitHelper_CU(mapFunc);
 	bool first = !indexInfo.hasIndex;
 	SSMapFuncArgs << indexInfo.mapFuncParam;
-	std::string multiOutputAssign = handleOutputs_CU(mapFunc, SSKernelParamList);
+	std::string multiOutputAssign;
+	if (reduceFunc.multiReduceMap)
+		SSKernelParamList << reduceResultType_CU(reduceFunc) << "* skepu_output, ";
+	else
+		multiOutputAssign = handleOutputs_CU(mapFunc, SSKernelParamList);
 	handleRandomParam_CU(mapFunc, SSMapFuncArgs, SSKernelParamList, first);
 	
 	size_t stride_counter = 0;
@@ -137,8 +197,8 @@ std::string createMapReduceKernelProgram_CU(SkeletonInstance &instance, UserFunc
 	{
 		if (!first) { SSMapFuncArgs << ", "; }
 		SSStrideInit << "if (skepu_strides[" << stride_counter << "] < 0) { " << param.name << " += (-skepu_n + 1) * skepu_strides[" << stride_counter << "]; }\n";
-		SSKernelParamList << param.resolvedTypeName << " *" << param.name << ", ";
-		SSMapFuncArgs << param.name << "[skepu_i * skepu_strides[" << stride_counter++ << "]]";
+		SSKernelParamList << "const " << param.resolvedTypeName << " *" << param.name << ", ";
+		SSMapFuncArgs << param.name << "[skepu_i * " << strideFactor_CU(stride_counter++) << "]";
 		first = false;
 	}
 	auto argsInfo = handleRandomAccessAndUniforms_CU(mapFunc, SSMapFuncArgs, SSKernelParamList, first);
@@ -146,29 +206,63 @@ std::string createMapReduceKernelProgram_CU(SkeletonInstance &instance, UserFunc
 	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_MapReduceKernel_" + mapFunc.uniqueName + "_" + reduceFunc.uniqueName;
 	SSStrideCount << mapFunc.elwiseParams.size();
 	
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
-	FSOutFile << templateString(MapReduceKernelTemplate_CU,
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	if (useShuffleReduce_CU(reduceFunc))
+		FSOutFile << generateShuffleReduceHelpers_CU();
+	// The _EarlyExit variant of an instance with an absorbing value takes the zeroed flag of the launch, and the
+	// _SinglePass variant a zeroed block counter, which it leaves zeroed
+	enum class Variant { Plain, EarlyExit, SinglePass };
+	for (Variant variant : {Variant::Plain, Variant::EarlyExit, Variant::SinglePass})
 	{
-		{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
-		{"{{KERNEL_NAME}}",          kernelName},
-		{"{{FUNCTION_NAME_MAP}}",    mapFunc.funcNameCUDA()},
-		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.funcNameCUDA()},
-		{"{{KERNEL_PARAMS}}",        SSKernelParamList.str()},
-		{"{{MAP_ARGS}}",             SSMapFuncArgs.str()},
-		{"{{INDEX_INITIALIZER}}",    indexInfo.indexInit},
-		{"{{OUTPUT_BINDINGS}}",      multiOutputAssign},
-		{"{{PROXIES_UPDATE}}",       argsInfo.proxyInitializerInner},
-		{"{{PROXIES_INIT}}",         argsInfo.proxyInitializer},
-		{"{{STRIDE_COUNT}}",         SSStrideCount.str()},
-		{"{{STRIDE_INIT}}",          SSStrideInit.str()},
-		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
-	});
-	FSOutFile << templateString(ReduceKernelTemplate_CU,
+		if ((variant == Variant::EarlyExit && absorbing.empty()) || (variant == Variant::SinglePass && !singlePass))
+			continue;
+		bool earlyExit = variant == Variant::EarlyExit;
+		std::string finalize = (variant != Variant::SinglePass) ? "" : templateString(MapReduceSinglePassFinalize_CU,
+		{
+			{"{{REDUCE_RESULT_TYPE}}",   reduceResultType_CU(reduceFunc)},
+			{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(reduceFunc)},
+			{"{{SHARED_BUFFER}}",        "sdata_" + instance}
+		});
+		FSOutFile << templateString(MapReduceKernelTemplate_CU,
+		{
+			{"{{REDUCE_RESULT_TYPE}}",   reduceResultType_CU(reduceFunc)},
+			{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(reduceFunc)},
+			{"{{KERNEL_NAME}}",          kernelName + (earlyExit ? "_EarlyExit" : variant == Variant::SinglePass ? "_SinglePass" : "")},
+			{"{{FUNCTION_NAME_MAP}}",    mapFunc.funcNameCUDA()},
+			{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(reduceFunc)},
+			{"{{KERNEL_PARAMS}}",        SSKernelParamList.str()},
+			{"{{MAP_ARGS}}",             SSMapFuncArgs.str()},
+			{"{{INDEX_INITIALIZER}}",    indexInfo.incremental.setup.empty() ? indexInfo.indexInit : ""},
+			{"{{INDEX_SETUP}}",          indexInfo.incremental.setup},
+			{"{{INDEX_STEP}}",           indexInfo.incremental.step},
+			{"{{OUTPUT_BINDINGS}}",      multiOutputAssign},
+			{"{{PROXIES_UPDATE}}",       argsInfo.proxyInitializerInner},
+			{"{{PROXIES_INIT}}",         argsInfo.proxyInitializer},
+			{"{{STRIDE_COUNT}}",         SSStrideCount.str()},
+			{"{{STRIDE_INIT}}",          SSStrideInit.str()},
+			{"{{SHARED_BUFFER}}",        "sdata_" + instance},
+			{"{{EARLY_EXIT_PARAMS}}",    earlyExit ? ", unsigned int *skepu_done" : ""},
+			{"{{EARLY_EXIT_CHECK}}",     earlyExit ? generateEarlyExitCheck_CU(absorbing) : ""},
+			{"{{SINGLE_PASS_PARAMS}}",   variant == Variant::SinglePass ? ", unsigned int *skepu_blocks_done" : ""},
+			{"{{SINGLE_PASS_FINALIZE}}", finalize},
+			{"{{USE_SHUFFLE_REDUCE}}",   useShuffleReduce_CU(reduceFunc) ? "1" : "0"},
+			{"{{SHUFFLE_REDUCE}}",       generateShuffleBlockReduce_CU(reduceFunc, reduceAccumulatorType_CU(reduceFunc), "sdata_" + instance, "skepu_n", reduceFuncName_CU(reduceFunc))}
+		});
+	}
+	FSOutFile << generateReduceOnlyKernel_CU(reduceFunc, kernelName + "_ReduceOnly", "sdata_" + instance);
+	return kernelName;
+}
+
+std::string generateReduceOnlyKernel_CU(UserFunction &reduceFunc, std::string kernelName, std::string sharedBuffer)
+{
+	return templateString(ReduceKernelTemplate_CU,
 	{
-		{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
-		{"{{KERNEL_NAME}}",          kernelName + "_ReduceOnly"},
-		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.funcNameCUDA()},
-		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
+		{"{{REDUCE_RESULT_TYPE}}",   reduceResultType_CU(reduceFunc)},
+		{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(reduceFunc)},
+		{"{{KERNEL_NAME}}",          kernelName},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(reduceFunc)},
+		{"{{SHARED_BUFFER}}",        sharedBuffer},
+		{"{{USE_SHUFFLE_REDUCE}}",   useShuffleReduce_CU(reduceFunc) ? "1" : "0"},
+		{"{{SHUFFLE_REDUCE}}",       generateShuffleBlockReduce_CU(reduceFunc, reduceAccumulatorType_CU(reduceFunc), sharedBuffer, "skepu_blockSize", reduceFuncName_CU(reduceFunc))}
 	});
-	return kernelName;
 }
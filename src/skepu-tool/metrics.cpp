@@ -0,0 +1,258 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Transfer and coherency counters for -transfer-metrics. The main file defines SKEPU_TRANSFER_METRICS and includes
+ * this header before the SkePU headers, whose device pointers then report every upload, download, device
+ * allocation and invalidation of a device copy to record, with the container it belongs to and its bytes. Every
+ * instance is wrapped in skepu::metrics::Attributed, named after the instance, which makes the instance current on
+ * the calling thread for the duration of a call; events outside of any call, such as the download of a container
+ * read on the host after a GPU call, are attributed to HostAccess.
+ *
+ * The counters are kept in total, per instance and per container, and can be read with snapshot, cleared with
+ * reset and rendered as JSON with json. Containers are keyed by address and listed with the label given to them
+ * with label, if any. At exit the JSON is written to $SKEPU_METRICS_JSON if set.
+ */
+static const char *MetricsSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace skepu
+{
+	namespace metrics
+	{
+		enum class Event
+		{
+			Upload, Download, Allocation, Invalidation
+		};
+
+		struct Counter
+		{
+			size_t count = 0;
+			double bytes = 0;
+		};
+
+		struct Counters
+		{
+			Counter uploads, downloads, allocations, invalidations;
+
+			Counter &operator[](Event event)
+			{
+				switch (event)
+				{
+				case Event::Upload: return this->uploads;
+				case Event::Download: return this->downloads;
+				case Event::Allocation: return this->allocations;
+				default: return this->invalidations;
+				}
+			}
+		};
+
+		struct Snapshot
+		{
+			Counters total;
+			std::map<std::string, Counters> instances;
+			std::map<const void*, Counters> containers;
+			std::map<const void*, std::string> labels;
+		};
+
+		constexpr const char *HostAccess = "(host access)";
+
+		// Instance whose call is running on this thread, HostAccess outside of calls
+		inline const char *&currentInstance()
+		{
+			static thread_local const char *instance = HostAccess;
+			return instance;
+		}
+
+		class Recorder
+		{
+		public:
+			static Recorder &instance()
+			{
+				static Recorder recorder;
+				return recorder;
+			}
+
+			void record(Event event, const void *container, size_t bytes)
+			{
+				const char *instance = currentInstance();
+				std::lock_guard<std::mutex> guard(this->lock);
+				for (Counters *counters : {&this->state.total, &this->state.instances[instance], &this->state.containers[container]})
+				{
+					Counter &counter = (*counters)[event];
+					counter.count += 1;
+					counter.bytes += bytes;
+				}
+			}
+
+			void label(const void *container, std::string name)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->state.labels[container] = std::move(name);
+			}
+
+			Snapshot snapshot()
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				return this->state;
+			}
+
+			// Clears the counters, keeping the container labels
+			void reset()
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->state = Snapshot{{}, {}, {}, std::move(this->state.labels)};
+			}
+
+			~Recorder()
+			{
+				const char *path = std::getenv("SKEPU_METRICS_JSON");
+				if (path && *path)
+					if (FILE *file = std::fopen(path, "w"))
+					{
+						std::fputs(json(this->state).c_str(), file);
+						std::fclose(file);
+					}
+			}
+
+			static std::string json(Snapshot const& snapshot)
+			{
+				std::ostringstream out;
+				out << "{\n  \"total\": " << json(snapshot.total) << ",\n  \"instances\": {";
+				const char *separator = "\n";
+				for (auto const& entry : snapshot.instances)
+				{
+					out << separator << "    \"" << escaped(entry.first) << "\": " << json(entry.second);
+					separator = ",\n";
+				}
+				out << "\n  },\n  \"containers\": [";
+				separator = "\n";
+				for (auto const& entry : snapshot.containers)
+				{
+					auto label = snapshot.labels.find(entry.first);
+					out << separator << "    {\"address\": \"0x" << std::hex << uintptr_t(entry.first) << std::dec << "\", \"label\": \""
+						<< (label != snapshot.labels.end() ? escaped(label->second) : "") << "\", \"counters\": " << json(entry.second) << "}";
+					separator = ",\n";
+				}
+				out << "\n  ]\n}\n";
+				return out.str();
+			}
+
+		private:
+			Recorder() = default;
+
+			static std::string json(Counters const& c)
+			{
+				std::ostringstream out;
+				out.precision(17);
+				auto counter = [&](const char *name, Counter const& counter)
+				{
+					out << "\"" << name << "\": {\"count\": " << counter.count << ", \"bytes\": " << counter.bytes << "}";
+				};
+				out << "{";
+				counter("uploads", c.uploads);
+				out << ", ";
+				counter("downloads", c.downloads);
+				out << ", ";
+				counter("allocations", c.allocations);
+				out << ", ";
+				counter("invalidations", c.invalidations);
+				out << "}";
+				return out.str();
+			}
+
+			static std::string escaped(std::string const& s)
+			{
+				std::string out;
+				for (char c : s)
+				{
+					if (c == '"' || c == '\\')
+						out += '\\';
+					out += c;
+				}
+				return out;
+			}
+
+			std::mutex lock;
+			Snapshot state;
+		};
+
+		// Runtime hooks
+		inline void record(Event event, const void *container, size_t bytes)
+		{
+			Recorder::instance().record(event, container, bytes);
+		}
+
+		// User API
+		inline Snapshot snapshot() { return Recorder::instance().snapshot(); }
+		inline void reset() { Recorder::instance().reset(); }
+		inline std::string json() { return Recorder::json(snapshot()); }
+
+		template<typename Container>
+		void label(Container const& container, std::string name)
+		{
+			Recorder::instance().label(&container, std::move(name));
+		}
+
+		class Scope
+		{
+		public:
+			explicit Scope(const char *instance): outer(currentInstance())
+			{
+				currentInstance() = instance;
+			}
+
+			~Scope()
+			{
+				currentInstance() = this->outer;
+			}
+
+		private:
+			const char *outer;
+		};
+
+		template<typename Skeleton>
+		class Attributed: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			Attributed(const char *name, CallArgs&&... args)
+			: Skeleton(std::forward<CallArgs>(args)...), name(name) {}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				Scope scope(this->name);
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+		private:
+			const char *name;
+		};
+	}
+}
+)~~~";
+
+
+std::string generateMetricsSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_metrics.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << MetricsSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,332 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Distributed execution for -mpi. Map, Reduce, MapReduce and MapOverlap1D instances are wrapped in the classes
+ * below, which split a call on vectors into one block per rank, with the block boundaries of range. Every rank
+ * holds whole containers. A rank computes its block with the wrapped skeleton on any of its backends, and
+ * exchanges only the results:
+ *
+ * Map and MapOverlap1D gather the output blocks with a non-blocking MPI_Iallgatherv, which overlaps with
+ * whatever the ranks do until the next distributed call, or until wait. Call wait before reading a Map
+ * result on the host outside of distributed calls.
+ * Reduce and MapReduce combine the partial results of the ranks with the reduce function after an
+ * MPI_Allgather; the start value has to be an identity of the reduce function, or the function idempotent.
+ * MapOverlap1D computes each block from the block and the overlap elements on both sides, and drops the
+ * results of the overlap elements, so the halo of a block is read where it lies. Calls with cyclic edges,
+ * indexed user functions, several outputs, iterators or non-vector containers run whole on every rank.
+ *
+ * Elements are exchanged as bytes, so element types must be trivially copyable, and a block must be under
+ * 2 GiB. MPI must be initialized before the first distributed call.
+ */
+static const char *MPISupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+namespace skepu
+{
+	namespace mpi
+	{
+		inline int rank()
+		{
+			int r = 0;
+			MPI_Comm_rank(MPI_COMM_WORLD, &r);
+			return r;
+		}
+
+		inline int ranks()
+		{
+			int n = 1;
+			MPI_Comm_size(MPI_COMM_WORLD, &n);
+			return n;
+		}
+
+		// Block [first, second) of n elements owned by rank r
+		inline std::pair<size_t, size_t> range(size_t n, int r)
+		{
+			size_t p = ranks();
+			return {n * r / p, n * (r + 1) / p};
+		}
+
+		class Pending
+		{
+		public:
+			static Pending &instance()
+			{
+				static Pending pending;
+				return pending;
+			}
+
+			void add(MPI_Request request, std::vector<int> counts, std::vector<int> offsets)
+			{
+				this->requests.push_back(request);
+				this->buffers.emplace_back(std::move(counts), std::move(offsets));
+			}
+
+			void wait()
+			{
+				if (!this->requests.empty())
+					MPI_Waitall((int)this->requests.size(), this->requests.data(), MPI_STATUSES_IGNORE);
+				this->requests.clear();
+				this->buffers.clear();
+			}
+
+		private:
+			std::vector<MPI_Request> requests;
+			std::vector<std::pair<std::vector<int>, std::vector<int>>> buffers;
+		};
+
+		// Completes the gathers of earlier distributed calls
+		inline void wait()
+		{
+			Pending::instance().wait();
+		}
+
+		// Starts gathering the blocks of data, which holds n elements, on every rank
+		template<typename T>
+		void gather(T *data, size_t n)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "distributed elements are exchanged as bytes");
+			int p = ranks();
+			std::vector<int> counts(p), offsets(p);
+			for (int r = 0; r < p; ++r)
+			{
+				auto block = range(n, r);
+				counts[r] = (int)((block.second - block.first) * sizeof(T));
+				offsets[r] = (int)(block.first * sizeof(T));
+			}
+			MPI_Request request;
+			MPI_Iallgatherv(MPI_IN_PLACE, 0, MPI_BYTE, data, counts.data(), offsets.data(), MPI_BYTE, MPI_COMM_WORLD, &request);
+			Pending::instance().add(request, std::move(counts), std::move(offsets));
+		}
+
+		template<typename T, typename Combine>
+		T combine(T partial, Combine combine)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "distributed elements are exchanged as bytes");
+			std::vector<T> partials(ranks());
+			MPI_Allgather(&partial, sizeof(T), MPI_BYTE, partials.data(), sizeof(T), MPI_BYTE, MPI_COMM_WORLD);
+			T result = partials[0];
+			for (size_t r = 1; r < partials.size(); ++r)
+				result = combine(result, partials[r]);
+			return result;
+		}
+
+		template<typename T> struct IsVector: std::false_type {};
+		template<typename T> struct IsVector<skepu::Vector<T>>: std::true_type {};
+
+		template<typename T>
+		using IsVectorArg = IsVector<typename std::remove_cv<typename std::remove_reference<T>::type>::type>;
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		// Elementwise arguments start at the block, the others are passed on
+		template<bool Elementwise>
+		struct Slice
+		{
+			template<typename Arg>
+			static auto of(Arg &&arg, size_t) -> decltype(std::forward<Arg>(arg)) { return std::forward<Arg>(arg); }
+		};
+
+		template<>
+		struct Slice<true>
+		{
+			template<typename Arg>
+			static auto of(Arg &&arg, size_t first) -> decltype(arg.begin() + first) { return arg.begin() + first; }
+		};
+
+		template<typename Skeleton, typename UF>
+		class Map: public Skeleton
+		{
+			static constexpr size_t elwise = std::tuple_size<typename UF::ElwiseArgs>::value;
+
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				wait();
+				return this->call(std::integral_constant<bool, distributable<Res, Args...>(typename Indices<sizeof...(Args)>::type{})>{},
+					std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename Res, typename... Args, size_t... I>
+			static constexpr bool distributable(Sequence<I...>)
+			{
+				return UF::outArity == 1 && !UF::indexed && elwise > 0 && IsVectorArg<Res>::value
+					&& All<(I >= elwise || IsVectorArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				auto block = range(res.size(), rank());
+				if (block.second > block.first)
+					this->sliced(res, block, typename Indices<sizeof...(Args)>::type{}, std::forward<Args>(args)...);
+				res.updateHost();
+				res.invalidateDeviceData();
+				gather(res.getAddress(), res.size());
+				return std::forward<Res>(res);
+			}
+
+			template<typename Res, typename... Args, size_t... I>
+			void sliced(Res &res, std::pair<size_t, size_t> block, Sequence<I...>, Args&&... args)
+			{
+				Skeleton::operator()(res.begin() + block.first, res.begin() + block.second,
+					Slice<(I < elwise)>::of(std::forward<Args>(args), block.first)...);
+			}
+		};
+
+		template<typename Skeleton, typename ReduceUF>
+		class Reduce: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename Arg>
+			auto operator()(Arg &&arg) -> decltype(std::declval<Skeleton&>()(std::forward<Arg>(arg)))
+			{
+				wait();
+				return this->call(IsVectorArg<Arg>{}, std::forward<Arg>(arg));
+			}
+
+		private:
+			template<typename Arg>
+			auto call(std::false_type, Arg &&arg) -> decltype(std::declval<Skeleton&>()(std::forward<Arg>(arg)))
+			{
+				return Skeleton::operator()(std::forward<Arg>(arg));
+			}
+
+			template<typename Arg>
+			auto call(std::true_type, Arg &&arg) -> decltype(std::declval<Skeleton&>()(std::forward<Arg>(arg)))
+			{
+				auto block = range(arg.size(), rank());
+				auto partial = Skeleton::operator()(arg.begin() + block.first, arg.begin() + block.second);
+				return combine(partial, [](decltype(partial) a, decltype(partial) b) { return ReduceUF::CPU(a, b); });
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF>
+		class MapReduce: public Skeleton
+		{
+			static constexpr size_t elwise = std::tuple_size<typename MapUF::ElwiseArgs>::value;
+
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				wait();
+				return this->call(std::integral_constant<bool, distributable<Args...>(typename Indices<sizeof...(Args)>::type{})>{}, std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args, size_t... I>
+			static constexpr bool distributable(Sequence<I...>)
+			{
+				return MapUF::outArity == 1 && !MapUF::indexed && elwise > 0 && All<(I >= elwise || IsVectorArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename First, typename... Args>
+			auto call(std::true_type, First &&first, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...))
+			{
+				auto block = range(first.size(), rank());
+				auto partial = this->sliced(first, block, typename Indices<sizeof...(Args)>::type{}, std::forward<Args>(args)...);
+				return combine(partial, [](decltype(partial) a, decltype(partial) b) { return ReduceUF::CPU(a, b); });
+			}
+
+			// The remaining elementwise arguments follow the first, at positions 0 to elwise - 2
+			template<typename First, typename... Args, size_t... I>
+			auto sliced(First &first, std::pair<size_t, size_t> block, Sequence<I...>, Args&&... args)
+				-> decltype(std::declval<Skeleton&>()(first.begin(), first.begin(), Slice<(I + 1 < elwise)>::of(std::forward<Args>(args), 0)...))
+			{
+				return Skeleton::operator()(first.begin() + block.first, first.begin() + block.second,
+					Slice<(I + 1 < elwise)>::of(std::forward<Args>(args), block.first)...);
+			}
+		};
+
+		template<typename Skeleton, typename UF>
+		class MapOverlap1D: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename T, typename... Args>
+			skepu::Vector<T> &operator()(skepu::Vector<T> &res, skepu::Vector<T> &arg, Args&&... args)
+			{
+				wait();
+				if (this->getEdgeMode() == skepu::Edge::Cyclic || res.size() != arg.size())
+					return Skeleton::operator()(res, arg, std::forward<Args>(args)...);
+
+				// The block with its halo, clipped at the ends of the vector, where edge handling applies
+				size_t n = arg.size(), overlap = this->getOverlap();
+				auto block = range(n, rank());
+				size_t first = block.first > overlap ? block.first - overlap : 0;
+				size_t last = std::min(n, block.second + overlap);
+				if (block.second > block.first)
+				{
+					arg.updateHost();
+					skepu::Vector<T> local(last - first), localRes(last - first);
+					std::copy(arg.getAddress() + first, arg.getAddress() + last, local.getAddress());
+					Skeleton::operator()(localRes, local, std::forward<Args>(args)...);
+					localRes.updateHost();
+					res.updateHost();
+					std::copy(localRes.getAddress() + (block.first - first), localRes.getAddress() + (block.second - first), res.getAddress() + block.first);
+				}
+				res.invalidateDeviceData();
+				gather(res.getAddress(), n);
+				return res;
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				wait();
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateMPISupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_mpi.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << MPISupport;
+		generated = true;
+	}
+	return fileName;
+}
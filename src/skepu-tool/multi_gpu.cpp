@@ -0,0 +1,593 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Multi-GPU MapOverlap2D and MapOverlap3D for instances listed in -multi-gpu-overlap, the single-node counterpart
+ * of the MPI halo exchange. The rows of a matrix (planes of a tensor) are split into one partition per CUDA device,
+ * each held in a container of its own with the halo of the first overlap rows (planes) on either side, and every
+ * device runs the instance on its partition. The partitions of the output stay resident on their devices: once
+ * all have been computed, only the halo rows are copied between neighbouring devices with cudaMemcpyPeerAsync, as
+ * soon as the computation of both neighbours has finished, while the others still run. A later call whose input
+ * is that output then starts on the devices right away, so that an iterated stencil swapping its input and
+ * output moves only halos between calls.
+ *
+ * An output stays on the devices until gather is called with it on the instance, or it is passed to a call which
+ * does not run split; the instance should not be given a resident container which has been written otherwise
+ * in the meantime. Halos wrap around under Edge::Cyclic; the other edge modes apply at the outer edges of the
+ * first and last partition, which are those of the container. Calls of instances whose overlap or edge mode has
+ * not been set, with indexed, PRNG or multi-output user functions, on other containers than matrices (tensors in
+ * 3D) of the same size, with fewer than two CUDA devices or partitions thinner than the overlap, or not on the
+ * CUDA backend run on the instance backend as one call.
+ *
+ * MapPairs and MapPairsReduce instances listed in -multi-gpu-pairs split the vertical elementwise arguments
+ * (the horizontal ones for column-wise reductions) into one block of rows per CUDA device. Every device gets its
+ * rows of those arguments and the other arguments whole, runs the instance on them into its own rows of the
+ * output, and the rows are gathered into the host copy of the output once all devices have been launched. The
+ * horizontal arguments keep their copies on each device between calls. Calls with indexed, PRNG, container or
+ * multi-output user functions, with arguments other than vectors, outputs not of the size of the pair space,
+ * fewer than two CUDA devices or rows, or not on the CUDA backend run on the instance backend as one call.
+ */
+static const char *MultiGPUSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+namespace skepu
+{
+	namespace multigpu
+	{
+		// The slowest dimension of a container and the elements of one of its rows (planes)
+		template<typename C> struct Layout;
+
+		template<typename T> struct Layout<skepu::Vector<T>>
+		{
+			static size_t outer(skepu::Vector<T> const& c) { return c.size(); }
+			static size_t inner(skepu::Vector<T> const&) { return 1; }
+			static skepu::Vector<T> make(size_t outer, skepu::Vector<T> const&) { return skepu::Vector<T>(outer); }
+		};
+
+		template<typename T> struct Layout<skepu::Matrix<T>>
+		{
+			static size_t outer(skepu::Matrix<T> const& c) { return c.total_rows(); }
+			static size_t inner(skepu::Matrix<T> const& c) { return c.total_cols(); }
+			static skepu::Matrix<T> make(size_t outer, skepu::Matrix<T> const& like) { return skepu::Matrix<T>(outer, like.total_cols()); }
+		};
+
+		template<typename T> struct Layout<skepu::Tensor3<T>>
+		{
+			static size_t outer(skepu::Tensor3<T> const& c) { return c.size_i(); }
+			static size_t inner(skepu::Tensor3<T> const& c) { return c.size_j() * c.size_k(); }
+			static skepu::Tensor3<T> make(size_t outer, skepu::Tensor3<T> const& like) { return skepu::Tensor3<T>(outer, like.size_j(), like.size_k()); }
+		};
+
+		template<typename T, size_t Dims> struct ContainerOf;
+		template<typename T> struct ContainerOf<T, 2> { using type = skepu::Matrix<T>; };
+		template<typename T> struct ContainerOf<T, 3> { using type = skepu::Tensor3<T>; };
+
+		// Rows [first, first + count) of the container with before and after halo rows around them in slab
+		template<typename C>
+		struct Partition
+		{
+			size_t first, count, before, after;
+			C slab;
+		};
+
+		// An output stays on the devices, an input is copied to them again on every call
+		template<typename C>
+		struct Resident
+		{
+			size_t outer, inner, halo;
+			bool cyclic, output;
+			std::vector<Partition<C>> parts;
+		};
+
+		template<typename C>
+		typename C::value_type *devicePointer(C &c, int device)
+		{
+			return c.updateDevice_CU(c.getAddress(), c.size(), device, AccessMode::ReadWrite)->getDeviceDataPointer();
+		}
+
+		template<typename Skeleton, typename UF, typename T, size_t Dims, int... Static>
+		class MapOverlap: public Skeleton
+		{
+			using C = typename ContainerOf<T, Dims>::type;
+			using L = Layout<C>;
+
+		public:
+			using Skeleton::Skeleton;
+
+			~MapOverlap()
+			{
+				for (cudaStream_t stream : this->streams)
+					cudaStreamDestroy(stream);
+			}
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->cuda = (spec.backend() == Backend::Type::CUDA);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->cuda = defaultCUDA();
+				Skeleton::resetBackend();
+			}
+
+			// A single value applies to every dimension, as in the backend skeleton
+			template<typename... Rest>
+			void setOverlap(int first, Rest... rest)
+			{
+				this->overlap = first;
+				this->overlapKnown = true;
+				Skeleton::setOverlap(first, rest...);
+			}
+
+			void setEdgeMode(Edge edge)
+			{
+				this->edge = edge;
+				this->edgeKnown = true;
+				Skeleton::setEdgeMode(edge);
+			}
+
+			// Writes a resident output back to the host copy of container
+			void gather(C &container)
+			{
+				auto it = this->resident.find(&container);
+				if (it == this->resident.end())
+					return;
+				if (!it->second.output)
+					return void(this->resident.erase(it));
+				T *host = container.getAddress();
+				for (auto &part : it->second.parts)
+				{
+					part.slab.updateHost();
+					std::memcpy(host + part.first * it->second.inner, part.slab.getAddress() + part.before * it->second.inner, part.count * it->second.inner * sizeof(T));
+				}
+				container.invalidateDeviceData();
+				this->resident.erase(it);
+			}
+
+			template<typename Res, typename In, typename... Args>
+			auto operator()(Res &&res, In &&in, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...))
+			{
+				constexpr bool split = splittable() && std::is_same<typename std::remove_reference<Res>::type, C>::value
+					&& std::is_same<typename std::remove_reference<In>::type, C>::value;
+				return this->call(std::integral_constant<bool, split>{}, std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...);
+			}
+
+		private:
+			static constexpr bool defaultCUDA()
+			{
+#ifdef SKEPU_CUDA
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			static constexpr bool splittable()
+			{
+				return !UF::indexed && !UF::usesPRNG && UF::outArity == 1;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename In, typename... Args>
+			auto call(std::true_type, Res &&res, In &&in, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...))
+			{
+				const size_t devices = this->partitions(in);
+				if (devices < 2 || (void*)&res == (void*)&in || L::outer(res) != L::outer(in) || L::inner(res) != L::inner(in))
+				{
+					this->gather(in);
+					this->resident.erase(&res);
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...);
+				}
+
+				Resident<C> &input = this->residentInput(in, devices);
+				Resident<C> &output = this->residentOutput(res, input);
+
+				// Launches return before the kernels finish, so the devices compute together
+				auto &environment = *skepu::backend::Environment<int>::getInstance();
+				const auto previous = environment.bestCUDADevID;
+				Skeleton device(static_cast<Skeleton const&>(*this));
+				device.setBackend(BackendSpec{Backend::Type::CUDA});
+				for (size_t d = 0; d < devices; ++d)
+				{
+					environment.bestCUDADevID = d;
+					cudaSetDevice(d);
+					device(output.parts[d].slab, input.parts[d].slab, args...);
+				}
+				environment.bestCUDADevID = previous;
+
+				this->exchange(output);
+				cudaSetDevice(previous);
+				return std::forward<Res>(res);
+			}
+
+			// Partitions the rows of in over the CUDA devices, 0 if the call does not split
+			size_t partitions(C const& in) const
+			{
+				if (!this->cuda || !this->overlapKnown || !this->edgeKnown || in.size() == 0)
+					return 0;
+				const size_t halo = std::max(this->overlap, 1);
+				const size_t devices = skepu::backend::Environment<int>::getInstance()->m_devices_CU.size();
+				return std::min(devices, L::outer(in) / halo);
+			}
+
+			void partition(Resident<C> &layout, size_t devices) const
+			{
+				const size_t rows = layout.outer / devices, rest = layout.outer % devices;
+				size_t first = 0;
+				for (size_t d = 0; d < devices; ++d)
+				{
+					const size_t count = rows + (d < rest);
+					const size_t before = (d > 0 || layout.cyclic) ? layout.halo : 0;
+					const size_t after = (d + 1 < devices || layout.cyclic) ? layout.halo : 0;
+					layout.parts.push_back({first, count, before, after, C{}});
+					first += count;
+				}
+			}
+
+			bool matches(Resident<C> const& layout, C const& c, size_t devices) const
+			{
+				return layout.outer == L::outer(c) && layout.inner == L::inner(c) && layout.halo == (size_t)this->overlap
+					&& layout.cyclic == (this->edge == Edge::Cyclic) && layout.parts.size() == devices;
+			}
+
+			// The partitions of in, copied from its host copy with their halos unless it is a resident output
+			Resident<C> &residentInput(C &in, size_t devices)
+			{
+				auto it = this->resident.find(&in);
+				const bool known = it != this->resident.end() && this->matches(it->second, in, devices);
+				if (known && it->second.output)
+					return it->second;
+				this->gather(in);
+
+				in.updateHost();
+				Resident<C> &layout = this->resident[&in];
+				if (!known)
+				{
+					layout = Resident<C>{L::outer(in), L::inner(in), (size_t)this->overlap, this->edge == Edge::Cyclic, false, {}};
+					this->partition(layout, devices);
+				}
+				const T *host = in.getAddress();
+				for (auto &part : layout.parts)
+				{
+					const size_t rows = part.before + part.count + part.after;
+					if (!known)
+						part.slab = L::make(rows, in);
+					for (size_t r = 0; r < rows; ++r)
+					{
+						const size_t g = (part.first + layout.outer + r - part.before) % layout.outer;
+						std::memcpy(part.slab.getAddress() + r * layout.inner, host + g * layout.inner, layout.inner * sizeof(T));
+					}
+					part.slab.invalidateDeviceData();
+				}
+				return layout;
+			}
+
+			Resident<C> &residentOutput(C &res, Resident<C> const& input)
+			{
+				Resident<C> &layout = this->resident[&res];
+				if (!layout.output || !this->matches(layout, res, input.parts.size()))
+				{
+					layout = Resident<C>{input.outer, input.inner, input.halo, input.cyclic, true, {}};
+					this->partition(layout, input.parts.size());
+					for (auto &part : layout.parts)
+						part.slab = L::make(part.before + part.count + part.after, res);
+				}
+				return layout;
+			}
+
+			// Fills the halos of the output partitions from their neighbours, each pair once both have been computed
+			void exchange(Resident<C> &layout)
+			{
+				const size_t devices = layout.parts.size();
+				while (this->streams.size() < devices)
+				{
+					cudaSetDevice(this->streams.size());
+					cudaStream_t stream;
+					cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking);
+					this->streams.push_back(stream);
+				}
+
+				std::vector<T*> pointers(devices);
+				auto pair = [&](size_t a, size_t b)
+				{
+					Partition<C> &upper = layout.parts[a], &lower = layout.parts[b];
+					const size_t rowBytes = layout.inner * sizeof(T);
+					cudaMemcpyPeerAsync(pointers[b], b, pointers[a] + (upper.before + upper.count - lower.before) * layout.inner, a, lower.before * rowBytes, this->streams[b]);
+					cudaMemcpyPeerAsync(pointers[a] + (upper.before + upper.count) * layout.inner, a, pointers[b] + lower.before * layout.inner, b, upper.after * rowBytes, this->streams[a]);
+				};
+
+				for (size_t d = 0; d < devices; ++d)
+				{
+					cudaSetDevice(d);
+					cudaDeviceSynchronize();
+					pointers[d] = devicePointer(layout.parts[d].slab, d);
+					if (d > 0)
+						pair(d - 1, d);
+				}
+				if (layout.cyclic)
+					pair(devices - 1, 0);
+
+				for (size_t d = 0; d < devices; ++d)
+				{
+					cudaSetDevice(d);
+					cudaStreamSynchronize(this->streams[d]);
+				}
+			}
+
+			std::map<const void*, Resident<C>> resident;
+			std::vector<cudaStream_t> streams;
+			int overlap = std::initializer_list<int>{Static..., 0}.begin()[0];
+			bool overlapKnown = sizeof...(Static) > 0;
+			Edge edge = Edge::None;
+			bool edgeKnown = false;
+			bool cuda = defaultCUDA();
+		};
+
+		template<typename Skeleton, typename UF, typename T, int... Static>
+		using MapOverlap2D = MapOverlap<Skeleton, UF, T, 2, Static...>;
+
+		template<typename Skeleton, typename UF, typename T, int... Static>
+		using MapOverlap3D = MapOverlap<Skeleton, UF, T, 3, Static...>;
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		template<typename T> struct IsVector: std::false_type {};
+		template<typename T> struct IsVector<skepu::Vector<T>>: std::true_type {};
+
+		template<typename T>
+		using Bare = typename std::remove_cv<typename std::remove_reference<T>::type>::type;
+
+		// Argument I of a device call: its rows from the split arguments, or the argument itself
+		template<bool InSplit>
+		struct Pick
+		{
+			template<size_t I, size_t Offset, typename Split, typename All>
+			static auto get(Split &, All &all) -> decltype(std::get<I>(all)) { return std::get<I>(all); }
+		};
+
+		template<>
+		struct Pick<true>
+		{
+			template<size_t I, size_t Offset, typename Split, typename All>
+			static auto get(Split &split, All &) -> decltype(std::get<I - Offset>(split)) { return std::get<I - Offset>(split); }
+		};
+
+		template<typename Skeleton>
+		class RowSplit: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->cuda = (spec.backend() == Backend::Type::CUDA);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->cuda = defaultCUDA();
+				Skeleton::resetBackend();
+			}
+
+		protected:
+			static constexpr bool defaultCUDA()
+			{
+#ifdef SKEPU_CUDA
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			template<typename UF, size_t V, size_t H, typename... Args, size_t... I>
+			static constexpr bool splittable(Sequence<I...>)
+			{
+				return !UF::indexed && !UF::usesPRNG && UF::outArity == 1 && V > 0 && H > 0
+					&& std::tuple_size<typename UF::ContainerArgs>::value == 0
+					&& All<(I >= V + H || IsVector<Bare<Args>>::value)...>::value;
+			}
+
+			// Devices to split rows over, 0 if the call does not split
+			size_t devices(size_t rows) const
+			{
+				if (!this->cuda)
+					return 0;
+				const size_t devices = std::min(skepu::backend::Environment<int>::getInstance()->m_devices_CU.size(), rows);
+				return (devices < 2) ? 0 : devices;
+			}
+
+			// Runs the instance on every device with its rows of res and of the Count arguments from Offset,
+			// then gathers the rows into res
+			template<size_t Offset, size_t Count, typename Res, typename... Args>
+			void split(Res &res, size_t devices, Args&... args)
+			{
+				this->launch<Offset>(res, devices, typename Indices<Count>::type{}, typename Indices<sizeof...(Args)>::type{}, args...);
+			}
+
+		private:
+			template<size_t Offset, typename Res, typename... Args, size_t... SI, size_t... I>
+			void launch(Res &res, size_t devices, Sequence<SI...>, Sequence<I...>, Args&... args)
+			{
+				using L = Layout<Res>;
+				using Rows = std::tuple<Bare<typename std::tuple_element<Offset + SI, std::tuple<Args...>>::type>...>;
+				struct Part
+				{
+					size_t first, count;
+					Rows rows;
+					Res out;
+				};
+
+				auto all = std::forward_as_tuple(args...);
+				const size_t outer = L::outer(res), inner = L::inner(res);
+				std::vector<Part> parts(devices);
+				size_t first = 0;
+				for (size_t d = 0; d < devices; ++d)
+				{
+					Part &part = parts[d];
+					part.first = first;
+					part.count = outer / devices + (d < outer % devices);
+					part.out = L::make(part.count, res);
+					int expand[] = {0, (std::get<SI>(part.rows) = this->slice(std::get<Offset + SI>(all), part.first, part.count), 0)...};
+					(void)expand;
+					first += part.count;
+				}
+
+				// Launches return before the kernels finish, so the devices compute together
+				auto &environment = *skepu::backend::Environment<int>::getInstance();
+				const auto previous = environment.bestCUDADevID;
+				Skeleton device(static_cast<Skeleton const&>(*this));
+				device.setBackend(BackendSpec{Backend::Type::CUDA});
+				for (size_t d = 0; d < devices; ++d)
+				{
+					environment.bestCUDADevID = d;
+					cudaSetDevice(d);
+					device(parts[d].out, Pick<(I >= Offset && I < Offset + sizeof...(SI))>::template get<I, Offset>(parts[d].rows, all)...);
+				}
+				environment.bestCUDADevID = previous;
+
+				auto *host = res.getAddress();
+				for (size_t d = 0; d < devices; ++d)
+				{
+					cudaSetDevice(d);
+					parts[d].out.updateHost();
+					std::copy(parts[d].out.getAddress(), parts[d].out.getAddress() + parts[d].count * inner, host + parts[d].first * inner);
+				}
+				res.invalidateDeviceData();
+				cudaSetDevice(previous);
+			}
+
+			template<typename T>
+			static skepu::Vector<T> slice(skepu::Vector<T> &arg, size_t first, size_t count)
+			{
+				arg.updateHost();
+				skepu::Vector<T> rows(count);
+				std::copy(arg.getAddress() + first, arg.getAddress() + first + count, rows.getAddress());
+				return rows;
+			}
+
+			bool cuda = defaultCUDA();
+		};
+
+		template<typename Skeleton, typename UF, size_t V, size_t H>
+		class MapPairs: public RowSplit<Skeleton>
+		{
+		public:
+			using RowSplit<Skeleton>::RowSplit;
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				constexpr bool split = std::is_same<Bare<Res>, skepu::Matrix<typename UF::Ret>>::value
+					&& RowSplit<Skeleton>::template splittable<UF, V, H, Args...>(typename Indices<sizeof...(Args)>::type{});
+				return this->call(std::integral_constant<bool, split>{}, std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				auto all = std::forward_as_tuple(args...);
+				const size_t devices = this->devices(res.total_rows());
+				if (devices == 0 || res.total_rows() != std::get<0>(all).size() || res.total_cols() != std::get<V>(all).size())
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<Args>(args)...);
+
+				this->template split<0, V>(res, devices, args...);
+				return std::forward<Res>(res);
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF, size_t V, size_t H>
+		class MapPairsReduce: public RowSplit<Skeleton>
+		{
+		public:
+			using RowSplit<Skeleton>::RowSplit;
+
+			void setReduceMode(ReduceMode mode)
+			{
+				this->mode = mode;
+				Skeleton::setReduceMode(mode);
+			}
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				constexpr bool split = std::is_same<Bare<Res>, skepu::Vector<typename MapUF::Ret>>::value
+					&& RowSplit<Skeleton>::template splittable<MapUF, V, H, Args...>(typename Indices<sizeof...(Args)>::type{});
+				return this->call(std::integral_constant<bool, split>{}, std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			// A device reduces its results over the whole other dimension, so the start value applies once each
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				auto all = std::forward_as_tuple(args...);
+				const bool rowWise = (this->mode == ReduceMode::RowWise);
+				const size_t results = rowWise ? std::get<0>(all).size() : std::get<V>(all).size();
+				const size_t devices = this->devices(results);
+				if (devices == 0 || res.size() != results)
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<Args>(args)...);
+
+				if (rowWise)
+					this->template split<0, V>(res, devices, args...);
+				else
+					this->template split<V, H>(res, devices, args...);
+				return std::forward<Res>(res);
+			}
+
+			ReduceMode mode = ReduceMode::RowWise;
+		};
+	}
+}
+)~~~";
+
+
+std::string generateMultiGPUSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_multigpu.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << MultiGPUSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,125 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * NUMA placement for the OpenMP backend, enabled by -numa. Pages are placed on the node of the thread that first
+ * writes them, so containers initialized by one thread are remote for most of the threads of later skeleton calls.
+ * The main file defines SKEPU_NUMA and includes this header before the SkePU headers, whose containers then
+ * allocate their host storage through allocate and release.
+ *
+ * allocate returns page-aligned storage first touched in parallel with schedule(static) over the elements, the
+ * schedule of the parallel loops of the OpenMP backend, so each thread finds the elements it computes on its own
+ * node. The partition only repeats with the same threads on the same cores, so the header fixes the team size and,
+ * unless the environment sets them already, binds the threads to cores spread over the sockets (OMP_PLACES=cores,
+ * OMP_PROC_BIND=spread) during static initialization. Runtimes that read the environment when the library loads,
+ * such as libgomp, need these set in the environment of the process; bound tells whether the threads are bound.
+ */
+static const char *NUMASupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <omp.h>
+
+namespace skepu
+{
+	namespace numa
+	{
+		constexpr size_t PageSize = 4096;
+
+		inline bool place()
+		{
+#ifdef _WIN32
+			if (!std::getenv("OMP_PLACES")) _putenv_s("OMP_PLACES", "cores");
+			if (!std::getenv("OMP_PROC_BIND")) _putenv_s("OMP_PROC_BIND", "spread");
+			if (!std::getenv("OMP_DYNAMIC")) _putenv_s("OMP_DYNAMIC", "false");
+#else
+			setenv("OMP_PLACES", "cores", 0);
+			setenv("OMP_PROC_BIND", "spread", 0);
+			setenv("OMP_DYNAMIC", "false", 0);
+#endif
+			omp_set_dynamic(0);
+			return true;
+		}
+
+		// Before main, and so before the first parallel region of most programs
+		static const bool placed = place();
+
+		// Whether the threads are bound, false if the OpenMP runtime started before place
+		inline bool bound()
+		{
+			return omp_get_proc_bind() != omp_proc_bind_false;
+		}
+
+		// Touches n elements of elementSize bytes from storage with the static schedule of the skeletons
+		inline void firstTouch(void *storage, size_t n, size_t elementSize)
+		{
+			char *bytes = static_cast<char*>(storage);
+#pragma omp parallel for schedule(static)
+			for (long long i = 0; i < (long long)n; ++i)
+				std::memset(bytes + i * elementSize, 0, elementSize);
+		}
+
+		inline void *allocate(size_t bytes, size_t elementSize)
+		{
+			void *ptr = nullptr;
+			size_t size = (bytes + PageSize - 1) / PageSize * PageSize;
+#ifdef _WIN32
+			ptr = _aligned_malloc(size ? size : PageSize, PageSize);
+#else
+			if (posix_memalign(&ptr, PageSize, size ? size : PageSize) != 0)
+				ptr = nullptr;
+#endif
+			if (!ptr)
+				throw std::bad_alloc();
+			if (elementSize > 0)
+				firstTouch(ptr, bytes / elementSize, elementSize);
+			return ptr;
+		}
+
+		inline void release(void *ptr)
+		{
+#ifdef _WIN32
+			_aligned_free(ptr);
+#else
+			std::free(ptr);
+#endif
+		}
+
+		// Standard allocator over allocate, for host buffers that skeletons read alongside containers
+		template<typename T>
+		struct Allocator
+		{
+			using value_type = T;
+
+			Allocator() = default;
+			template<typename U> Allocator(Allocator<U> const&) {}
+
+			T *allocate(size_t n) { return static_cast<T*>(numa::allocate(n * sizeof(T), sizeof(T))); }
+			void deallocate(T *ptr, size_t) { numa::release(ptr); }
+		};
+
+		template<typename T, typename U>
+		bool operator==(Allocator<T> const&, Allocator<U> const&) { return true; }
+		template<typename T, typename U>
+		bool operator!=(Allocator<T> const&, Allocator<U> const&) { return false; }
+	}
+}
+)~~~";
+
+
+std::string generateNUMASupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_numa.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << NUMASupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,314 @@
+#include "globals.h"
+#include "code_gen.h"
+
+using namespace clang;
+
+/*!
+ * Parallel OpenMP Scan. Every Scan instance of a build with the OpenMP backend is wrapped in skepu::ompscan::Scan,
+ * whose vector calls on the OpenMP backend scan in two passes over one contiguous block per thread: each thread
+ * reduces its block, one thread scans the block totals, and each thread then scans its block again starting from
+ * the total of the blocks before it. Inclusive and exclusive scans keep the results of the sequential scan,
+ * including the exclusive start value, which comes first and is combined from the left with every prefix.
+ *
+ * When the scan function is a single arithmetic or bitwise operator on its two parameters (a + b, a * b, a & b,
+ * a | b or a ^ b) of an arithmetic type, the instance passes the operator, and the block loops use it as an
+ * OpenMP simd reduction, the rescan as an inscan reduction with OpenMP 5. Floating point results then differ from
+ * the sequential scan by the reassociation of the sums, as on the GPU backends. Scans of fewer than ParallelMin
+ * elements, other calls and backends run on the instance backend.
+ */
+static const char *OMPScanSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#define SKEPU_OMPSCAN_PRAGMA(x) _Pragma(#x)
+
+namespace skepu
+{
+	namespace ompscan
+	{
+		constexpr size_t ParallelMin = 1 << 16;
+
+		// Block loops of the scan function ScanUF, combining sequentially
+		template<typename ScanUF>
+		struct Function
+		{
+			template<typename T>
+			static T reduce(const T *in, size_t n)
+			{
+				T acc = in[0];
+				for (size_t i = 1; i < n; ++i)
+					acc = ScanUF::OMP(acc, in[i]);
+				return acc;
+			}
+
+			// out[i] is carry combined with in[0..i], without carry for the first block
+			template<typename T>
+			static void inclusive(const T *in, T *out, size_t n, T carry, bool first)
+			{
+				T acc = first ? in[0] : ScanUF::OMP(carry, in[0]);
+				out[0] = acc;
+				for (size_t i = 1; i < n; ++i)
+				{
+					acc = ScanUF::OMP(acc, in[i]);
+					out[i] = acc;
+				}
+			}
+
+			// out[i] is start combined with carry and in[0..i-1], start alone for the first element of the first block
+			template<typename T>
+			static void exclusive(const T *in, T *out, size_t n, T carry, bool first, T start)
+			{
+				T acc = carry;
+				for (size_t i = 0; i < n; ++i)
+				{
+					T value = in[i];
+					out[i] = first ? start : ScanUF::OMP(start, acc);
+					acc = first ? value : ScanUF::OMP(acc, value);
+					first = false;
+				}
+			}
+		};
+
+		// Block loops of an operator with an identity, vectorized as OpenMP reductions
+#if defined(_OPENMP) && _OPENMP >= 201811
+#define SKEPU_OMPSCAN_INSCAN(OP) \
+			template<typename T> \
+			static void inclusive(const T *in, T *out, size_t n, T carry, bool first) \
+			{ \
+				T acc = first ? identity<T>() : carry; \
+				SKEPU_OMPSCAN_PRAGMA(omp simd reduction(inscan, OP:acc)) \
+				for (size_t i = 0; i < n; ++i) \
+				{ \
+					acc = acc OP in[i]; \
+					SKEPU_OMPSCAN_PRAGMA(omp scan inclusive(acc)) \
+					out[i] = acc; \
+				} \
+			} \
+			template<typename T> \
+			static void exclusive(const T *in, T *out, size_t n, T carry, bool first, T start) \
+			{ \
+				if (in == out) \
+					return Function<Operator>::exclusive(in, out, n, carry, first, start); \
+				T acc = first ? identity<T>() : carry; \
+				SKEPU_OMPSCAN_PRAGMA(omp simd reduction(inscan, OP:acc)) \
+				for (size_t i = 0; i < n; ++i) \
+				{ \
+					out[i] = start OP acc; \
+					SKEPU_OMPSCAN_PRAGMA(omp scan exclusive(acc)) \
+					acc = acc OP in[i]; \
+				} \
+			}
+#else
+#define SKEPU_OMPSCAN_INSCAN(OP) \
+			template<typename T> \
+			static void inclusive(const T *in, T *out, size_t n, T carry, bool first) \
+			{ \
+				Function<Operator>::inclusive(in, out, n, carry, first); \
+			} \
+			template<typename T> \
+			static void exclusive(const T *in, T *out, size_t n, T carry, bool first, T start) \
+			{ \
+				Function<Operator>::exclusive(in, out, n, carry, first, start); \
+			}
+#endif
+
+#define SKEPU_OMPSCAN_OPERATOR(NAME, OP, IDENTITY) \
+		struct NAME \
+		{ \
+			struct Operator \
+			{ \
+				template<typename T> \
+				static T OMP(T a, T b) { return a OP b; } \
+			}; \
+			template<typename T> \
+			static T identity() { return IDENTITY; } \
+			template<typename T> \
+			static T reduce(const T *in, size_t n) \
+			{ \
+				T acc = identity<T>(); \
+				SKEPU_OMPSCAN_PRAGMA(omp simd reduction(OP:acc)) \
+				for (size_t i = 0; i < n; ++i) \
+					acc = acc OP in[i]; \
+				return acc; \
+			} \
+			SKEPU_OMPSCAN_INSCAN(OP) \
+		};
+
+		SKEPU_OMPSCAN_OPERATOR(Plus, +, T(0))
+		SKEPU_OMPSCAN_OPERATOR(Multiplies, *, T(1))
+		SKEPU_OMPSCAN_OPERATOR(BitAnd, &, T(~T(0)))
+		SKEPU_OMPSCAN_OPERATOR(BitOr, |, T(0))
+		SKEPU_OMPSCAN_OPERATOR(BitXor, ^, T(0))
+
+#undef SKEPU_OMPSCAN_OPERATOR
+#undef SKEPU_OMPSCAN_INSCAN
+
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename T>
+		auto invalidateDevice(T &arg, int) -> decltype(arg.invalidateDeviceData(), void())
+		{
+			arg.invalidateDeviceData();
+		}
+
+		template<typename T>
+		void invalidateDevice(T &, long) {}
+
+		template<typename Skeleton, typename ScanUF, typename Blocks = Function<ScanUF>>
+		class Scan: public Skeleton
+		{
+			using Ret = typename ScanUF::Ret;
+
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->openmp = (spec.backend() == Backend::Type::OpenMP);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->openmp = defaultOpenMP();
+				Skeleton::resetBackend();
+			}
+
+			void setScanMode(ScanMode mode)
+			{
+				this->inclusive = (mode == ScanMode::Inclusive);
+				Skeleton::setScanMode(mode);
+			}
+
+			void setStartValue(Ret value)
+			{
+				this->start = value;
+				Skeleton::setStartValue(value);
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			Vector<Ret> &operator()(Vector<Ret> &res, Vector<Ret> &arg)
+			{
+				const size_t n = arg.size();
+				const size_t threads = std::min<size_t>(omp_get_max_threads(), n / (ParallelMin / 4) + 1);
+				if (!this->openmp || res.size() != n || n < ParallelMin || threads < 2)
+					return Skeleton::operator()(res, arg);
+
+				updateHost(arg, 0);
+				updateHost(res, 0);
+				this->scan(res.getAddress(), arg.getAddress(), n, threads);
+				invalidateDevice(res, 0);
+				return res;
+			}
+
+		private:
+			static constexpr bool defaultOpenMP()
+			{
+#if defined(SKEPU_OPENMP) && !defined(SKEPU_CUDA) && !defined(SKEPU_OPENCL)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			// Block t covers [n * t / threads, n * (t + 1) / threads); each block is read before it is written
+			void scan(Ret *out, const Ret *in, size_t n, size_t threads)
+			{
+				std::vector<Ret> totals(threads);
+#pragma omp parallel num_threads(threads)
+				{
+					const size_t t = omp_get_thread_num();
+					const size_t first = n * t / threads, count = n * (t + 1) / threads - first;
+					totals[t] = Blocks::reduce(in + first, count);
+
+#pragma omp barrier
+#pragma omp single
+					for (size_t b = 1; b < threads - 1; ++b)
+						totals[b] = ScanUF::OMP(totals[b - 1], totals[b]);
+
+					const Ret carry = (t > 0) ? totals[t - 1] : Ret{};
+					if (this->inclusive)
+						Blocks::inclusive(in + first, out + first, count, carry, t == 0);
+					else
+						Blocks::exclusive(in + first, out + first, count, carry, t == 0, this->start);
+				}
+			}
+
+			bool inclusive = true;
+			Ret start {};
+			bool openmp = defaultOpenMP();
+		};
+	}
+}
+)~~~";
+
+
+std::string generateOMPScanSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_omp_scan.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << OMPScanSupport;
+		generated = true;
+	}
+	return fileName;
+}
+
+// The skepu::ompscan block loops for the scan function: an operator tag for a single arithmetic or bitwise
+// operator on the two parameters, the generic loops calling the user function otherwise
+std::string ompScanBlocksOf(UserFunction &scanFunc, const std::string &scanStruct)
+{
+	const std::string generic = "skepu::ompscan::Function<" + scanStruct + ">";
+	static const std::map<BinaryOperatorKind, std::string> operators
+	{
+		{BO_Add, "Plus"}, {BO_Mul, "Multiplies"}, {BO_And, "BitAnd"}, {BO_Or, "BitOr"}, {BO_Xor, "BitXor"},
+	};
+
+	const FunctionDecl *f = scanFunc.astDeclNode;
+	if (f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplateSpecialization)
+		f = f->getTemplateInstantiationPattern();
+	if (f->getNumParams() != 2 || !f->getReturnType().getCanonicalType()->isArithmeticType()
+		|| f->getReturnType().getCanonicalType() != f->getParamDecl(0)->getType().getNonReferenceType().getCanonicalType().getUnqualifiedType()
+		|| f->getReturnType().getCanonicalType() != f->getParamDecl(1)->getType().getNonReferenceType().getCanonicalType().getUnqualifiedType())
+		return generic;
+
+	// The body has to be 'return a OP b;' on the two parameters, in either order for these commutative operators
+	const CompoundStmt *Body = dyn_cast_or_null<CompoundStmt>(f->getBody());
+	if (!Body || Body->size() != 1)
+		return generic;
+	const ReturnStmt *Ret = dyn_cast<ReturnStmt>(Body->body_front());
+	const BinaryOperator *Op = (Ret && Ret->getRetValue()) ? dyn_cast<BinaryOperator>(Ret->getRetValue()->IgnoreParenImpCasts()) : nullptr;
+	if (!Op || !operators.count(Op->getOpcode()))
+		return generic;
+
+	auto paramOf = [] (const Expr *e) -> const ParmVarDecl*
+	{
+		if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+			return dyn_cast<ParmVarDecl>(Ref->getDecl());
+		return nullptr;
+	};
+	const ParmVarDecl *lhs = paramOf(Op->getLHS()), *rhs = paramOf(Op->getRHS());
+	if (!lhs || !rhs || lhs == rhs || std::find(f->param_begin(), f->param_end(), lhs) == f->param_end() || std::find(f->param_begin(), f->param_end(), rhs) == f->param_end())
+		return generic;
+	return "skepu::ompscan::" + operators.at(Op->getOpcode());
+}
@@ -0,0 +1,401 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Streaming execution for instances listed in -out-of-core, for vectors larger than device memory. Map, Reduce,
+ * MapReduce and MapOverlap1D calls on vectors are split into chunks of about ChunkMiB MiB of elementwise data,
+ * set by -out-of-core-chunk, and each chunk is a call of the skeleton on staging vectors of the wrapper, so the
+ * device only holds the staging vectors of two chunks at a time, whatever the size of the call.
+ *
+ * The staging vectors are double-buffered: Map and MapOverlap1D issue the call on chunk k before they read back
+ * the results of chunk k - 1, so that download overlaps the upload and kernel of chunk k, which the backends
+ * run asynchronously until the host reads, and the host copies of chunk k + 1 go to the other buffer. The
+ * staging vectors keep their device buffers between chunks and calls. Reduce and MapReduce carry the partial
+ * result of the chunks in order with the reduce function, so the start value has to be an identity of it.
+ * MapOverlap1D stages each chunk with the overlap elements on both sides and drops their results, so the halo
+ * of a chunk is read where it lies and edge handling only applies at the ends of the vector.
+ *
+ * Calls that fit into one chunk, calls on the CPU and OpenMP backends, and calls with indexed or random user
+ * functions, several outputs, iterators, container arguments other than the elementwise vectors, or cyclic
+ * edges, run whole on the wrapped skeleton.
+ */
+static const char *OutOfCoreSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace skepu
+{
+	namespace outofcore
+	{
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		template<typename T>
+		using Bare = typename std::remove_cv<typename std::remove_reference<T>::type>::type;
+
+		template<typename T> struct IsVector: std::false_type {};
+		template<typename T> struct IsVector<skepu::Vector<T>>: std::true_type {};
+		template<typename T> struct IsContainer: IsVector<T> {};
+		template<typename T> struct IsContainer<skepu::Matrix<T>>: std::true_type {};
+
+		template<typename T> struct ElementBytes: std::integral_constant<size_t, 0> {};
+		template<typename T> struct ElementBytes<skepu::Vector<T>>: std::integral_constant<size_t, sizeof(T)> {};
+
+		template<size_t... N> struct Sum: std::integral_constant<size_t, 0> {};
+		template<size_t First, size_t... Rest> struct Sum<First, Rest...>: std::integral_constant<size_t, First + Sum<Rest...>::value> {};
+
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename... Args>
+		void updateHostAll(Args&... args)
+		{
+			int expand[] = {0, (updateHost(args, 0), 0)...};
+			(void)expand;
+		}
+
+		// Elementwise vectors are copied into a staging vector per chunk, other arguments are passed on
+		template<typename Arg, bool Elementwise>
+		struct Stage
+		{
+			Stage(Arg &arg): arg(arg) {}
+			void load(size_t, size_t) {}
+			Arg &get() { return this->arg; }
+
+			Arg &arg;
+		};
+
+		template<typename T>
+		struct Stage<skepu::Vector<T>, true>
+		{
+			Stage(skepu::Vector<T> &arg): arg(arg) {}
+
+			void load(size_t first, size_t last)
+			{
+				if (this->buffer.size() != last - first)
+					this->buffer.resize(last - first);
+				std::copy(this->arg.getAddress() + first, this->arg.getAddress() + last, this->buffer.getAddress());
+				this->buffer.invalidateDeviceData();
+			}
+
+			skepu::Vector<T> &get() { return this->buffer; }
+
+			skepu::Vector<T> &arg;
+			skepu::Vector<T> buffer;
+		};
+
+		// Results of a chunk, read back into res from offset skip of the staging vector
+		template<typename T>
+		void store(skepu::Vector<T> &res, skepu::Vector<T> &staged, size_t first, size_t last, size_t skip)
+		{
+			staged.updateHost();
+			std::copy(staged.getAddress() + skip, staged.getAddress() + skip + (last - first), res.getAddress() + first);
+		}
+
+		template<typename Skeleton, size_t ChunkMiB>
+		class Streamed: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->device = (spec.backend() == Backend::Type::CUDA || spec.backend() == Backend::Type::OpenCL);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->device = defaultDevice();
+				Skeleton::resetBackend();
+			}
+
+		protected:
+			static constexpr bool defaultDevice()
+			{
+#if defined(SKEPU_CUDA) || defined(SKEPU_OPENCL)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			// Elements per chunk for elements of the given total bytes over all staged vectors
+			static size_t chunkElements(size_t bytes)
+			{
+				size_t elements = (ChunkMiB << 20) / (bytes > 0 ? bytes : 1);
+				return elements > 0 ? elements : 1;
+			}
+
+			bool device = defaultDevice();
+		};
+
+		template<typename Skeleton, typename UF, size_t ChunkMiB>
+		class Map: public Streamed<Skeleton, ChunkMiB>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename UF::ElwiseArgs>::value;
+
+		public:
+			using Streamed<Skeleton, ChunkMiB>::Streamed;
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, streamable<Res, Args...>(typename Indices<sizeof...(Args)>::type{})>{},
+					std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename Res, typename... Args, size_t... I>
+			static constexpr bool streamable(Sequence<I...>)
+			{
+				return UF::outArity == 1 && !UF::indexed && !UF::usesPRNG && elwise > 0 && IsVector<Bare<Res>>::value
+					&& All<(I < elwise ? IsVector<Bare<Args>>::value : !IsContainer<Bare<Args>>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				auto whole = typename Indices<sizeof...(Args)>::type{};
+				const size_t n = res.size();
+				const size_t chunk = this->chunkElements(ElementBytes<Bare<Res>>::value + bytes<Args...>(whole));
+				if (!this->device || n <= chunk)
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<Args>(args)...);
+
+				updateHostAll(res, args...);
+				this->stream(res, n, chunk, whole, args...);
+				res.invalidateDeviceData();
+				return std::forward<Res>(res);
+			}
+
+			template<typename... Args, size_t... I>
+			static constexpr size_t bytes(Sequence<I...>)
+			{
+				return Sum<(I < elwise ? ElementBytes<Bare<Args>>::value : 0)...>::value;
+			}
+
+			template<typename T, typename... Args, size_t... I>
+			void stream(skepu::Vector<T> &res, size_t n, size_t chunk, Sequence<I...>, Args&... args)
+			{
+				using Stages = std::tuple<Stage<Bare<Args>, (I < elwise)>...>;
+				Stages stages[2] = {Stages(args...), Stages(args...)};
+				skepu::Vector<T> results[2];
+				const size_t chunks = (n + chunk - 1) / chunk;
+				for (size_t k = 0; k <= chunks; ++k)
+				{
+					if (k < chunks)
+					{
+						const size_t first = k * chunk, last = std::min(n, first + chunk);
+						Stages &stage = stages[k % 2];
+						int expand[] = {0, (std::get<I>(stage).load(first, last), 0)...};
+						(void)expand;
+						if (results[k % 2].size() != last - first)
+							results[k % 2].resize(last - first);
+						Skeleton::operator()(results[k % 2], std::get<I>(stage).get()...);
+					}
+
+					// The previous chunk is read back after the next one is issued
+					if (k > 0)
+					{
+						const size_t first = (k - 1) * chunk, last = std::min(n, first + chunk);
+						store(res, results[(k - 1) % 2], first, last, 0);
+					}
+				}
+			}
+		};
+
+		template<typename Skeleton, typename ReduceUF, size_t ChunkMiB>
+		class Reduce: public Streamed<Skeleton, ChunkMiB>
+		{
+		public:
+			using Streamed<Skeleton, ChunkMiB>::Streamed;
+
+			template<typename Arg>
+			auto operator()(Arg &&arg) -> decltype(std::declval<Skeleton&>()(std::forward<Arg>(arg)))
+			{
+				return this->call(IsVector<Bare<Arg>>{}, std::forward<Arg>(arg));
+			}
+
+		private:
+			template<typename Arg>
+			auto call(std::false_type, Arg &&arg) -> decltype(std::declval<Skeleton&>()(std::forward<Arg>(arg)))
+			{
+				return Skeleton::operator()(std::forward<Arg>(arg));
+			}
+
+			template<typename Arg>
+			auto call(std::true_type, Arg &&arg) -> decltype(std::declval<Skeleton&>()(std::forward<Arg>(arg)))
+			{
+				const size_t n = arg.size();
+				const size_t chunk = this->chunkElements(ElementBytes<Bare<Arg>>::value);
+				if (!this->device || n <= chunk)
+					return Skeleton::operator()(std::forward<Arg>(arg));
+
+				arg.updateHost();
+				Stage<Bare<Arg>, true> stages[2] = {arg, arg};
+				decltype(std::declval<Skeleton&>()(arg)) result {};
+				for (size_t k = 0, first = 0; first < n; ++k, first += chunk)
+				{
+					const size_t last = std::min(n, first + chunk);
+					stages[k % 2].load(first, last);
+					auto partial = Skeleton::operator()(stages[k % 2].get());
+					result = (k > 0) ? ReduceUF::CPU(result, partial) : partial;
+				}
+				return result;
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF, size_t ChunkMiB>
+		class MapReduce: public Streamed<Skeleton, ChunkMiB>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename MapUF::ElwiseArgs>::value;
+
+		public:
+			using Streamed<Skeleton, ChunkMiB>::Streamed;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, streamable<Args...>(typename Indices<sizeof...(Args)>::type{})>{}, std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args, size_t... I>
+			static constexpr bool streamable(Sequence<I...>)
+			{
+				return MapUF::outArity == 1 && !MapUF::indexed && !MapUF::usesPRNG && elwise > 0
+					&& All<(I < elwise ? IsVector<Bare<Args>>::value : !IsContainer<Bare<Args>>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename First, typename... Args>
+			auto call(std::true_type, First &&first, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...))
+			{
+				auto whole = typename Indices<sizeof...(Args) + 1>::type{};
+				const size_t n = first.size();
+				const size_t chunk = this->chunkElements(bytes<First, Args...>(whole));
+				if (!this->device || n <= chunk)
+					return Skeleton::operator()(std::forward<First>(first), std::forward<Args>(args)...);
+
+				updateHostAll(first, args...);
+				return this->stream(n, chunk, whole, first, args...);
+			}
+
+			template<typename... Args, size_t... I>
+			static constexpr size_t bytes(Sequence<I...>)
+			{
+				return Sum<(I < elwise ? ElementBytes<Bare<Args>>::value : 0)...>::value;
+			}
+
+			template<typename... Args, size_t... I>
+			auto stream(size_t n, size_t chunk, Sequence<I...>, Args&... args) -> decltype(std::declval<Skeleton&>()(args...))
+			{
+				using Stages = std::tuple<Stage<Bare<Args>, (I < elwise)>...>;
+				Stages stages[2] = {Stages(args...), Stages(args...)};
+				decltype(std::declval<Skeleton&>()(args...)) result {};
+				for (size_t k = 0, first = 0; first < n; ++k, first += chunk)
+				{
+					const size_t last = std::min(n, first + chunk);
+					Stages &stage = stages[k % 2];
+					int expand[] = {0, (std::get<I>(stage).load(first, last), 0)...};
+					(void)expand;
+					auto partial = Skeleton::operator()(std::get<I>(stage).get()...);
+					result = (k > 0) ? ReduceUF::CPU(result, partial) : partial;
+				}
+				return result;
+			}
+		};
+
+		template<typename Skeleton, typename UF, size_t ChunkMiB>
+		class MapOverlap1D: public Streamed<Skeleton, ChunkMiB>
+		{
+		public:
+			using Streamed<Skeleton, ChunkMiB>::Streamed;
+
+			template<typename T, typename... Args>
+			skepu::Vector<T> &operator()(skepu::Vector<T> &res, skepu::Vector<T> &arg, Args&&... args)
+			{
+				const size_t n = arg.size();
+				const size_t chunk = this->chunkElements(2 * sizeof(T));
+				const size_t overlap = this->getOverlap();
+				if (!this->device || n <= chunk || chunk <= 2 * overlap || res.size() != n || this->getEdgeMode() == skepu::Edge::Cyclic)
+					return Skeleton::operator()(res, arg, std::forward<Args>(args)...);
+
+				arg.updateHost();
+				res.updateHost();
+				Stage<skepu::Vector<T>, true> stages[2] = {arg, arg};
+				skepu::Vector<T> results[2];
+				const size_t chunks = (n + chunk - 1) / chunk;
+				for (size_t k = 0; k <= chunks; ++k)
+				{
+					// The chunk with its halo, clipped at the ends of the vector, where edge handling applies
+					if (k < chunks)
+					{
+						const size_t first = k * chunk, last = std::min(n, first + chunk);
+						const size_t from = first > overlap ? first - overlap : 0, to = std::min(n, last + overlap);
+						stages[k % 2].load(from, to);
+						if (results[k % 2].size() != to - from)
+							results[k % 2].resize(to - from);
+						Skeleton::operator()(results[k % 2], stages[k % 2].get(), args...);
+					}
+
+					if (k > 0)
+					{
+						const size_t first = (k - 1) * chunk, last = std::min(n, first + chunk);
+						const size_t from = first > overlap ? first - overlap : 0;
+						store(res, results[(k - 1) % 2], first, last, first - from);
+					}
+				}
+				res.invalidateDeviceData();
+				return res;
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateOutOfCoreSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_out_of_core.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << OutOfCoreSupport;
+		generated = true;
+	}
+	return fileName;
+}
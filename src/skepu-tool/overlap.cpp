@@ -0,0 +1,58 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Runtime support for -static-overlap. The user function of a listed MapOverlap instance is generated with its
+ * overlap fields replaced by literals, so the device and host compilers see constant loop bounds over the region
+ * and can unroll them. The generated declaration wraps the backend skeleton in skepu::overlap::Static, which sets
+ * the fixed overlap on construction. Since the generated code is only valid for that overlap, a later setOverlap
+ * call must repeat it and reports an error otherwise.
+ */
+static const char *StaticOverlapSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace skepu
+{
+	namespace overlap
+	{
+		template<typename Skeleton, int... Overlap>
+		class Static: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			Static(CallArgs&&... args): Skeleton(std::forward<CallArgs>(args)...)
+			{
+				Skeleton::setOverlap(Overlap...);
+			}
+
+			// A single value applies to every dimension, as in the backend skeleton
+			template<typename... Rest>
+			void setOverlap(int first, Rest... rest)
+			{
+				const int fixed[] = {Overlap...};
+				const int given[] = {first, static_cast<int>(rest)...};
+				for (size_t k = 0; k < sizeof...(Overlap); ++k)
+					if (given[k % (1 + sizeof...(Rest))] != fixed[k])
+						SKEPU_ERROR("The overlap of a static overlap instance cannot be changed");
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateStaticOverlapSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_static_overlap.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << StaticOverlapSupport;
+		generated = true;
+	}
+	return fileName;
+}
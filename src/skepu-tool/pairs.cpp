@@ -0,0 +1,293 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Cache-blocked OpenMP MapPairs and MapPairsReduce for instances listed in -blocked-pairs. The V x H pair
+ * space is walked in blocks of BlockRows vertical by BlockCols horizontal elements, sized from the bytes of the
+ * elementwise arguments (the elements of ElwiseArgs before and after Varity): the horizontal elements of a block
+ * fit in half of L1Bytes and the vertical elements of a row of blocks in half of L2Bytes, so each horizontal block
+ * is read from memory once per row of blocks instead of once per row.
+ *
+ * MapPairs runs the blocks in parallel. MapPairsReduce runs the rows of blocks in parallel for row-wise
+ * reductions and the columns of blocks for column-wise ones, and visits the blocks of each in order, so every
+ * result is reduced in the same order as unblocked; the start value and reduce mode set on the instance are kept.
+ * Calls with indexed, PRNG, container or multi-output user functions, with arguments other than vectors or
+ * results not of the size of the pair space, and calls not on the OpenMP backend run on the instance backend.
+ * The instance runs on OpenMP when that backend is set on it, or without a backend of its own in builds whose
+ * only parallel backend is OpenMP.
+ */
+static const char *PairsSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace skepu
+{
+	namespace pairs
+	{
+		constexpr size_t L1Bytes = 32 << 10;
+		constexpr size_t L2Bytes = 256 << 10;
+
+		template<size_t... N> struct Sum: std::integral_constant<size_t, 0> {};
+		template<size_t First, size_t... Rest> struct Sum<First, Rest...>: std::integral_constant<size_t, First + Sum<Rest...>::value> {};
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		// Bytes of Count elements of Tuple from First
+		template<typename Tuple, size_t First, typename Seq> struct BytesOf;
+		template<typename Tuple, size_t First, size_t... I>
+		struct BytesOf<Tuple, First, Sequence<I...>>: Sum<sizeof(typename std::tuple_element<First + I, Tuple>::type)...> {};
+
+		template<typename UF, size_t V, size_t H>
+		struct Shape
+		{
+			static constexpr size_t verticalBytes = BytesOf<typename UF::ElwiseArgs, 0, typename Indices<V>::type>::value;
+			static constexpr size_t horizontalBytes = BytesOf<typename UF::ElwiseArgs, V, typename Indices<H>::type>::value;
+			static constexpr size_t BlockCols = (L1Bytes / 2 / horizontalBytes > 16) ? L1Bytes / 2 / horizontalBytes : 16;
+			static constexpr size_t BlockRows = (L2Bytes / 2 / verticalBytes > 16) ? L2Bytes / 2 / verticalBytes : 16;
+		};
+
+		template<typename T> struct IsVector: std::false_type {};
+		template<typename T> struct IsVector<skepu::Vector<T>>: std::true_type {};
+		template<typename T> struct IsMatrix: std::false_type {};
+		template<typename T> struct IsMatrix<skepu::Matrix<T>>: std::true_type {};
+
+		template<typename T>
+		using Bare = typename std::remove_cv<typename std::remove_reference<T>::type>::type;
+
+		// The blocked loops read and write the host storage of all arguments
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename T>
+		auto invalidateDevice(T &arg, int) -> decltype(arg.invalidateDeviceData(), void())
+		{
+			arg.invalidateDeviceData();
+		}
+
+		template<typename T>
+		void invalidateDevice(T &, long) {}
+
+		template<typename... Args>
+		void updateHostAll(Args&... args)
+		{
+			int expand[] = {0, (updateHost(args, 0), 0)...};
+			(void)expand;
+		}
+
+		template<typename Skeleton>
+		class Tracked: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->openmp = (spec.backend() == Backend::Type::OpenMP);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->openmp = defaultOpenMP();
+				Skeleton::resetBackend();
+			}
+
+		protected:
+			static constexpr bool defaultOpenMP()
+			{
+#if defined(SKEPU_OPENMP) && !defined(SKEPU_CUDA) && !defined(SKEPU_OPENCL)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			template<typename UF, size_t V, size_t H, typename... Args, size_t... I>
+			static constexpr bool blockable(Sequence<I...>)
+			{
+				return !UF::indexed && !UF::usesPRNG && UF::outArity == 1 && V > 0 && H > 0
+					&& std::tuple_size<typename UF::ContainerArgs>::value == 0
+					&& All<(I >= V + H || IsVector<Bare<Args>>::value)...>::value;
+			}
+
+			bool openmp = defaultOpenMP();
+		};
+
+		template<typename Skeleton, typename UF, size_t V, size_t H>
+		class MapPairs: public Tracked<Skeleton>
+		{
+		public:
+			using Tracked<Skeleton>::Tracked;
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				constexpr bool blocked = IsMatrix<Bare<Res>>::value
+					&& Tracked<Skeleton>::template blockable<UF, V, H, Args...>(typename Indices<sizeof...(Args)>::type{});
+				return this->call(std::integral_constant<bool, blocked>{}, std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				auto all = std::forward_as_tuple(args...);
+				if (!this->openmp || res.size() == 0 || res.total_rows() != std::get<0>(all).size() || res.total_cols() != std::get<V>(all).size())
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<Args>(args)...);
+
+				updateHostAll(res, args...);
+				blocked(res, typename Indices<V>::type{}, typename Indices<H>::type{}, typename Indices<sizeof...(Args) - V - H>::type{}, args...);
+				invalidateDevice(res, 0);
+				return std::forward<Res>(res);
+			}
+
+			template<typename Res, typename... Args, size_t... VI, size_t... HI, size_t... UI>
+			static void blocked(Res &res, Sequence<VI...>, Sequence<HI...>, Sequence<UI...>, Args&... args)
+			{
+				using Block = Shape<UF, V, H>;
+				auto all = std::forward_as_tuple(args...);
+				auto vertical = std::make_tuple(std::get<VI>(all).getAddress()...);
+				auto horizontal = std::make_tuple(std::get<V + HI>(all).getAddress()...);
+				auto out = res.getAddress();
+				const long long rows = res.total_rows(), cols = res.total_cols();
+				const long long rowBlocks = (rows + Block::BlockRows - 1) / Block::BlockRows;
+				const long long colBlocks = (cols + Block::BlockCols - 1) / Block::BlockCols;
+
+#pragma omp parallel for collapse(2) schedule(static)
+				for (long long bi = 0; bi < rowBlocks; ++bi)
+					for (long long bj = 0; bj < colBlocks; ++bj)
+					{
+						const long long rowEnd = std::min<long long>(rows, (bi + 1) * Block::BlockRows);
+						const long long colEnd = std::min<long long>(cols, (bj + 1) * Block::BlockCols);
+						for (long long i = bi * Block::BlockRows; i < rowEnd; ++i)
+							for (long long j = bj * Block::BlockCols; j < colEnd; ++j)
+								out[i * cols + j] = UF::OMP(std::get<VI>(vertical)[i]..., std::get<HI>(horizontal)[j]..., std::get<V + H + UI>(all)...);
+					}
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF, size_t V, size_t H>
+		class MapPairsReduce: public Tracked<Skeleton>
+		{
+			using Ret = typename MapUF::Ret;
+
+		public:
+			using Tracked<Skeleton>::Tracked;
+
+			void setStartValue(Ret value)
+			{
+				this->start = value;
+				Skeleton::setStartValue(value);
+			}
+
+			void setReduceMode(ReduceMode mode)
+			{
+				this->mode = mode;
+				Skeleton::setReduceMode(mode);
+			}
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				constexpr bool blocked = IsVector<Bare<Res>>::value
+					&& Tracked<Skeleton>::template blockable<MapUF, V, H, Args...>(typename Indices<sizeof...(Args)>::type{});
+				return this->call(std::integral_constant<bool, blocked>{}, std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				auto all = std::forward_as_tuple(args...);
+				size_t results = (this->mode == ReduceMode::RowWise) ? std::get<0>(all).size() : std::get<V>(all).size();
+				if (!this->openmp || res.size() == 0 || res.size() != results)
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<Args>(args)...);
+
+				updateHostAll(res, args...);
+				this->blocked(res, typename Indices<V>::type{}, typename Indices<H>::type{}, typename Indices<sizeof...(Args) - V - H>::type{}, args...);
+				invalidateDevice(res, 0);
+				return std::forward<Res>(res);
+			}
+
+			template<typename Res, typename... Args, size_t... VI, size_t... HI, size_t... UI>
+			void blocked(Res &res, Sequence<VI...>, Sequence<HI...>, Sequence<UI...>, Args&... args) const
+			{
+				using Block = Shape<MapUF, V, H>;
+				auto all = std::forward_as_tuple(args...);
+				auto vertical = std::make_tuple(std::get<VI>(all).getAddress()...);
+				auto horizontal = std::make_tuple(std::get<V + HI>(all).getAddress()...);
+				auto out = res.getAddress();
+				const bool rowWise = (this->mode == ReduceMode::RowWise);
+				const long long rows = std::get<0>(all).size(), cols = std::get<V>(all).size();
+				const long long rowBlocks = (rows + Block::BlockRows - 1) / Block::BlockRows;
+				const long long colBlocks = (cols + Block::BlockCols - 1) / Block::BlockCols;
+				const long long results = res.size();
+				for (long long r = 0; r < results; ++r)
+					out[r] = this->start;
+
+				// Each thread owns whole rows (columns) of blocks, and reduces the blocks of its results in order
+				const long long outer = rowWise ? rowBlocks : colBlocks, inner = rowWise ? colBlocks : rowBlocks;
+#pragma omp parallel for schedule(static)
+				for (long long bo = 0; bo < outer; ++bo)
+					for (long long bn = 0; bn < inner; ++bn)
+					{
+						const long long bi = rowWise ? bo : bn, bj = rowWise ? bn : bo;
+						const long long rowEnd = std::min<long long>(rows, (bi + 1) * Block::BlockRows);
+						const long long colEnd = std::min<long long>(cols, (bj + 1) * Block::BlockCols);
+						for (long long i = bi * Block::BlockRows; i < rowEnd; ++i)
+							for (long long j = bj * Block::BlockCols; j < colEnd; ++j)
+							{
+								Ret &result = out[rowWise ? i : j];
+								result = ReduceUF::OMP(result, MapUF::OMP(std::get<VI>(vertical)[i]..., std::get<HI>(horizontal)[j]..., std::get<V + H + UI>(all)...));
+							}
+					}
+			}
+
+			Ret start {};
+			ReduceMode mode = ReduceMode::RowWise;
+		};
+	}
+}
+)~~~";
+
+
+std::string generatePairsSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_pairs.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << PairsSupport;
+		generated = true;
+	}
+	return fileName;
+}
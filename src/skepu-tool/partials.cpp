@@ -0,0 +1,138 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Per-thread partial results of the OpenMP reductions. OpenMP builds define SKEPU_OMP_PARTIALS and include this
+ * header before the SkePU headers, whose Reduce, MapReduce and MapPairsReduce implementations keep their partials
+ * in it, and the generated OpenMP reductions of skepu_schedule.h and skepu_histogram.h use it as well.
+ *
+ * Slots holds one partial per cache line, so threads updating their own partial in the loop do not invalidate
+ * the lines of their neighbours, and combines the partials in a tree of pairwise rounds, in slot order, so only the
+ * associativity of the reduce function is relied on. The rounds run in parallel while they have at least
+ * ParallelPairs pairs, from 128 threads on. Row is a padded vector for partials of several elements, such as
+ * sub-histograms, whose storage starts and ends on cache line boundaries.
+ */
+static const char *PartialsSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace skepu
+{
+	namespace partials
+	{
+		constexpr size_t CacheLine = 64;
+		constexpr size_t ParallelPairs = 64;
+
+		// Cache-line aligned storage padded to whole lines, also for alignments above that of new before C++17
+		template<typename T>
+		struct Allocator
+		{
+			using value_type = T;
+
+			Allocator() = default;
+			template<typename U> Allocator(Allocator<U> const&) {}
+
+			T *allocate(size_t n)
+			{
+				size_t bytes = (n * sizeof(T) + CacheLine - 1) / CacheLine * CacheLine;
+				void *ptr = nullptr;
+#ifdef _WIN32
+				ptr = _aligned_malloc(bytes ? bytes : CacheLine, CacheLine);
+#else
+				if (posix_memalign(&ptr, CacheLine, bytes ? bytes : CacheLine) != 0)
+					ptr = nullptr;
+#endif
+				if (!ptr)
+					throw std::bad_alloc();
+				return static_cast<T*>(ptr);
+			}
+
+			void deallocate(T *ptr, size_t)
+			{
+#ifdef _WIN32
+				_aligned_free(ptr);
+#else
+				std::free(ptr);
+#endif
+			}
+		};
+
+		template<typename T, typename U>
+		bool operator==(Allocator<T> const&, Allocator<U> const&) { return true; }
+		template<typename T, typename U>
+		bool operator!=(Allocator<T> const&, Allocator<U> const&) { return false; }
+
+		template<typename T>
+		using Row = std::vector<T, Allocator<T>>;
+
+		template<typename T>
+		struct alignas(CacheLine) Slot
+		{
+			T value;
+			bool present;
+		};
+
+		template<typename T>
+		class Slots
+		{
+		public:
+			explicit Slots(size_t count): slots(count, Slot<T>{T{}, false}) {}
+
+			size_t size() const { return this->slots.size(); }
+
+			// Sets the partial of slot, or combines value into it
+			template<typename Reduce>
+			void add(size_t slot, T const& value, Reduce reduce)
+			{
+				Slot<T> &s = this->slots[slot];
+				s.value = s.present ? reduce(s.value, value) : value;
+				s.present = true;
+			}
+
+			void set(size_t slot, T const& value)
+			{
+				this->slots[slot] = Slot<T>{value, true};
+			}
+
+			// Combines the present partials into result, false if there are none
+			template<typename Reduce>
+			bool combine(Reduce reduce, T &result)
+			{
+				long long n = this->slots.size();
+				for (long long stride = 1; stride < n; stride *= 2)
+				{
+#pragma omp parallel for schedule(static) if(n / (2 * stride) >= (long long)ParallelPairs)
+					for (long long i = 0; i < n - stride; i += 2 * stride)
+						if (this->slots[i + stride].present)
+							this->add(i, this->slots[i + stride].value, reduce);
+				}
+				if (n == 0 || !this->slots[0].present)
+					return false;
+				result = this->slots[0].value;
+				return true;
+			}
+
+		private:
+			std::vector<Slot<T>, Allocator<Slot<T>>> slots;
+		};
+	}
+}
+)~~~";
+
+
+std::string generatePartialsSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_partials.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << PartialsSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,134 @@
+#include "globals.h"
+
+#include "clang/Basic/Version.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <map>
+
+using namespace clang;
+
+/*!
+ * Precompiled SkePU headers for -pch. Parsing the SkePU headers and the standard library headers they pull in
+ * is most of the work for small sources, and it is identical between runs with the same compiler flags.
+ *
+ * The header named by -pch-header is precompiled once into the output directory, in a file named after the
+ * hash of the compile command, the header name and the clang version. The source files are then parsed with
+ * -include-pch, which also turns their own #include of the header into a no-op. Next to the PCH, a .deps file
+ * lists the content hash of every file that went into it. The PCH is rebuilt when any of these has changed,
+ * so that clang never rejects it as out of date.
+ *
+ * Declarations read from the PCH are not passed to HandleTopLevelDecl, so the header must not contain code the
+ * visitor has to see, such as the BLAS precompiler markers of skepu-lib.
+ */
+
+namespace
+{
+	class PCHAction: public GeneratePCHAction
+	{
+	public:
+		PCHAction(std::string output): output(output) {}
+
+		bool BeginInvocation(CompilerInstance &CI) override
+		{
+			CI.getFrontendOpts().OutputFile = this->output;
+			return GeneratePCHAction::BeginInvocation(CI);
+		}
+
+		void EndSourceFileAction() override
+		{
+			SourceManager &SM = this->getCompilerInstance().getSourceManager();
+			std::ofstream deps(this->output + ".deps");
+			for (auto it = SM.fileinfo_begin(); it != SM.fileinfo_end(); ++it)
+			{
+				std::string path = it->first->getName().str(), hash;
+				if (fileHash(path, hash))
+					deps << hash << " " << path << "\n";
+			}
+			GeneratePCHAction::EndSourceFileAction();
+		}
+
+	private:
+		std::string output;
+	};
+
+	class PCHActionFactory: public tooling::FrontendActionFactory
+	{
+	public:
+		PCHActionFactory(std::string output): output(output) {}
+
+		FrontendAction *create() override
+		{
+			return new PCHAction(this->output);
+		}
+
+	private:
+		std::string output;
+	};
+
+	bool dependenciesUnchanged(const std::string &pch)
+	{
+		std::ifstream deps(pch + ".deps");
+		if (!deps || !llvm::sys::fs::exists(pch))
+			return false;
+
+		std::string hash, path, current;
+		while (deps >> hash >> std::ws && std::getline(deps, path))
+			if (!fileHash(path, current) || current != hash)
+			{
+				SkePULog() << "PCH dependency changed: " << path << "\n";
+				return false;
+			}
+		return true;
+	}
+}
+
+std::string preparePCH(const tooling::CompileCommand &command)
+{
+	// Flags of the source file, without the compiler name, the file itself and its output
+	std::vector<std::string> args;
+	for (size_t i = 1; i < command.CommandLine.size(); ++i)
+	{
+		const std::string &arg = command.CommandLine[i];
+		if (arg == "-o" && i + 1 < command.CommandLine.size())
+			++i;
+		else if (arg != command.Filename && arg != "-c")
+			args.push_back(arg);
+	}
+
+	std::string key = getClangFullVersion() + '\0' + std::string(PCHHeader) + '\0' + command.Directory;
+	for (std::string &arg : args)
+		key += '\0' + arg;
+
+	std::string base = ResultDir + "/skepu_pch_" + contentHash(key);
+	std::string pch = base + ".pch";
+
+	// Workers of -j share the PCH of equal compile commands
+	static std::mutex lock;
+	static std::map<std::string, bool> prepared;
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto it = prepared.find(pch);
+	if (it != prepared.end())
+		return it->second ? pch : "";
+
+	bool ok = dependenciesUnchanged(pch);
+	if (!ok)
+	{
+		SkePULog() << "Precompiling <" << PCHHeader << "> into " << pch << "\n";
+		std::string header = base + ".hpp";
+		writeFileIfChanged(header, "#include <" + std::string(PCHHeader) + ">\n");
+
+		tooling::FixedCompilationDatabase compilations(command.Directory, args);
+		tooling::ClangTool Tool(compilations, {header});
+		PCHActionFactory factory(pch);
+		ok = Tool.run(&factory) == 0 && llvm::sys::fs::exists(pch);
+		if (!ok)
+		{
+			llvm::sys::fs::remove(pch + ".deps");
+			llvm::errs() << "[SKEPU] Warning: could not precompile <" << PCHHeader << ">, parsing without PCH\n";
+		}
+	}
+	prepared[pch] = ok;
+	return ok ? pch : "";
+}
@@ -0,0 +1,134 @@
+#include "globals.h"
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+/*!
+ * Stateless random numbers for -philox-random. A draw is Philox4x32-10 applied to the counter
+ * (draw / 2, element index) under the 64-bit seed as key, and one Philox block serves two consecutive
+ * 64-bit draws. A skepu::Random argument becomes a Stream of (seed, element index) that starts at draw 0
+ * for every element, so streams do not depend on the launch configuration and no generator state is
+ * kept in device memory. The C++ and OpenCL implementations below are bit-identical.
+ */
+static const char *PhiloxSupport = R"~~~(
+#pragma once
+
+#include <cstdint>
+
+#ifdef __CUDACC__
+#define SKEPU_PHILOX_HOST_DEVICE __host__ __device__
+#else
+#define SKEPU_PHILOX_HOST_DEVICE
+#endif
+
+namespace skepu
+{
+	namespace philox
+	{
+		SKEPU_PHILOX_HOST_DEVICE inline void mixRound(uint32_t *ctr, const uint32_t *key)
+		{
+			uint64_t p0 = (uint64_t)0xD2511F53u * ctr[0];
+			uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr[2];
+			uint32_t c1 = ctr[1], c3 = ctr[3];
+			ctr[0] = (uint32_t)(p1 >> 32) ^ c1 ^ key[0];
+			ctr[1] = (uint32_t)p1;
+			ctr[2] = (uint32_t)(p0 >> 32) ^ c3 ^ key[1];
+			ctr[3] = (uint32_t)p0;
+		}
+
+		SKEPU_PHILOX_HOST_DEVICE inline void block(uint32_t *ctr, uint64_t seed)
+		{
+			uint32_t key[2] = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+			for (int r = 0; r < 10; ++r)
+			{
+				mixRound(ctr, key);
+				key[0] += 0x9E3779B9u;
+				key[1] += 0xBB67AE85u;
+			}
+		}
+
+		struct Stream
+		{
+			uint64_t seed;
+			uint64_t element;
+			uint64_t draw;
+
+			SKEPU_PHILOX_HOST_DEVICE Stream(uint64_t seed, uint64_t element): seed(seed), element(element), draw(0) {}
+
+			SKEPU_PHILOX_HOST_DEVICE uint64_t get()
+			{
+				uint32_t ctr[4] = { (uint32_t)(draw >> 1), (uint32_t)(draw >> 33), (uint32_t)element, (uint32_t)(element >> 32) };
+				block(ctr, seed);
+				size_t w = (draw++ & 1) * 2;
+				return ((uint64_t)ctr[w] << 32) | ctr[w + 1];
+			}
+
+			// Uniform in [0, 1) with 53 random bits
+			SKEPU_PHILOX_HOST_DEVICE double getNormalized()
+			{
+				return (double)(get() >> 11) * (1.0 / 9007199254740992.0);
+			}
+		};
+	}
+}
+)~~~";
+
+static const char *PhiloxSource_CL = R"~~~(
+typedef struct {
+	ulong seed;
+	ulong element;
+	ulong draw;
+} skepu_random;
+
+skepu_random skepu_random_init(ulong seed, ulong element)
+{
+	skepu_random prng;
+	prng.seed = seed;
+	prng.element = element;
+	prng.draw = 0;
+	return prng;
+}
+
+ulong skepu_random_get(skepu_random *prng)
+{
+	uint ctr[4] = { (uint)(prng->draw >> 1), (uint)(prng->draw >> 33), (uint)prng->element, (uint)(prng->element >> 32) };
+	uint key[2] = { (uint)prng->seed, (uint)(prng->seed >> 32) };
+	for (int r = 0; r < 10; ++r)
+	{
+		uint c1 = ctr[1], c3 = ctr[3];
+		uint hi0 = mul_hi(0xD2511F53u, ctr[0]), lo0 = 0xD2511F53u * ctr[0];
+		uint hi1 = mul_hi(0xCD9E8D57u, ctr[2]), lo1 = 0xCD9E8D57u * ctr[2];
+		ctr[0] = hi1 ^ c1 ^ key[0];
+		ctr[1] = lo1;
+		ctr[2] = hi0 ^ c3 ^ key[1];
+		ctr[3] = lo0;
+		key[0] += 0x9E3779B9u;
+		key[1] += 0xBB67AE85u;
+	}
+	size_t w = (prng->draw++ & 1) * 2;
+	return ((ulong)ctr[w] << 32) | ctr[w + 1];
+}
+
+double skepu_random_get_normalized(skepu_random *prng)
+{
+	return (double)(skepu_random_get(prng) >> 11) * (1.0 / 9007199254740992.0);
+}
+)~~~";
+
+
+std::string generatePhiloxSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_philox.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << PhiloxSupport;
+		generated = true;
+	}
+	return fileName;
+}
+
+std::string generateOpenCLPhilox()
+{
+	return PhiloxSource_CL;
+}
@@ -0,0 +1,298 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Page-locked host storage for containers, enabled by -pinned-host. Copies from pageable memory are staged by
+ * the driver through a bounce buffer, at about half the bandwidth and without overlap with kernels. The main
+ * file defines SKEPU_PINNED_HOST and includes this header before the SkePU headers, whose containers then
+ * allocate their host storage through allocate and release.
+ *
+ * Page-locked memory is expensive to allocate, so released blocks are kept in an arena by size class (powers
+ * of two from 4 KiB up to 1 MiB, multiples of 1 MiB above) until trim. With CUDA the blocks come from
+ * cudaHostAlloc. With OpenCL they are CL_MEM_ALLOC_HOST_PTR buffers of the context passed to useContext_CL,
+ * kept mapped while in use; without a context, or for other backends, storage is pageable.
+ *
+ * Pinning is on for every container by default. setDefault changes that, and a Scope changes it for the
+ * containers created by the current thread while it lives.
+ */
+static const char *PinnedHostSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef SKEPU_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef SKEPU_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace skepu
+{
+	namespace pinned
+	{
+		inline size_t sizeClass(size_t bytes)
+		{
+			constexpr size_t MiB = size_t(1) << 20;
+			if (bytes > MiB)
+				return (bytes + MiB - 1) / MiB * MiB;
+			size_t size = 4096;
+			while (size < bytes)
+				size *= 2;
+			return size;
+		}
+
+		class Policy
+		{
+		public:
+			static bool &global()
+			{
+				static bool enabled = true;
+				return enabled;
+			}
+
+			// -1 follows the global setting
+			static int &local()
+			{
+				static thread_local int enabled = -1;
+				return enabled;
+			}
+
+			static bool enabled()
+			{
+				return local() < 0 ? global() : local() != 0;
+			}
+		};
+
+		inline void setDefault(bool enabled)
+		{
+			Policy::global() = enabled;
+		}
+
+		// Containers created by this thread while the scope lives are pinned or not, regardless of the default
+		class Scope
+		{
+		public:
+			explicit Scope(bool enabled = true): previous(Policy::local())
+			{
+				Policy::local() = enabled;
+			}
+
+			~Scope()
+			{
+				Policy::local() = this->previous;
+			}
+
+			Scope(Scope const&) = delete;
+			Scope &operator=(Scope const&) = delete;
+
+		private:
+			int previous;
+		};
+
+		class Arena
+		{
+		public:
+			static Arena &instance()
+			{
+				static Arena arena;
+				return arena;
+			}
+
+#ifdef SKEPU_OPENCL
+			void useContext_CL(cl_context context, cl_command_queue queue)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->context = context;
+				this->queue = queue;
+			}
+#endif
+
+			void *allocate(size_t bytes)
+			{
+				if (!Policy::enabled() || !this->pinnable())
+					return this->pageable(bytes);
+
+				size_t size = sizeClass(bytes);
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->free.find(size);
+				if (it != this->free.end() && !it->second.empty())
+				{
+					Block block = it->second.back();
+					it->second.pop_back();
+					this->used[block.ptr] = block;
+					return block.ptr;
+				}
+
+				Block block = this->pin(size);
+				if (!block.ptr)
+				{
+					// Out of page-locked memory: give back the cached blocks and retry once
+					this->clear();
+					block = this->pin(size);
+					if (!block.ptr)
+						return this->pageable(bytes);
+				}
+				this->used[block.ptr] = block;
+				return block.ptr;
+			}
+
+			void release(void *ptr)
+			{
+				if (!ptr)
+					return;
+				std::lock_guard<std::mutex> guard(this->lock);
+				auto it = this->used.find(ptr);
+				if (it == this->used.end())
+				{
+					std::free(ptr);
+					return;
+				}
+				this->free[it->second.size].push_back(it->second);
+				this->used.erase(it);
+			}
+
+			// Frees every cached block; blocks in use are not affected
+			void trim()
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->clear();
+			}
+
+		private:
+			struct Block
+			{
+				void *ptr = nullptr;
+				size_t size = 0;
+#ifdef SKEPU_OPENCL
+				cl_mem buffer = nullptr;
+#endif
+			};
+
+			std::mutex lock;
+			std::map<size_t, std::vector<Block>> free;
+			std::map<void*, Block> used;
+#ifdef SKEPU_OPENCL
+			cl_context context = nullptr;
+			cl_command_queue queue = nullptr;
+#endif
+
+			bool pinnable()
+			{
+#if defined(SKEPU_CUDA)
+				return true;
+#elif defined(SKEPU_OPENCL)
+				std::lock_guard<std::mutex> guard(this->lock);
+				return this->context != nullptr;
+#else
+				return false;
+#endif
+			}
+
+			void *pageable(size_t bytes)
+			{
+				void *ptr = std::malloc(bytes ? bytes : 1);
+				if (!ptr)
+					throw std::bad_alloc();
+				return ptr;
+			}
+
+			Block pin(size_t size)
+			{
+				Block block;
+				block.size = size;
+#if defined(SKEPU_CUDA)
+				if (cudaHostAlloc(&block.ptr, size, cudaHostAllocPortable) != cudaSuccess)
+				{
+					cudaGetLastError();
+					block.ptr = nullptr;
+				}
+#elif defined(SKEPU_OPENCL)
+				cl_int err;
+				block.buffer = clCreateBuffer(this->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr, &err);
+				if (err == CL_SUCCESS)
+				{
+					block.ptr = clEnqueueMapBuffer(this->queue, block.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, nullptr, nullptr, &err);
+					if (err != CL_SUCCESS)
+					{
+						clReleaseMemObject(block.buffer);
+						block.ptr = nullptr;
+					}
+				}
+				else
+					block.ptr = nullptr;
+#endif
+				return block;
+			}
+
+			void unpin(Block &block)
+			{
+#if defined(SKEPU_CUDA)
+				cudaFreeHost(block.ptr);
+#elif defined(SKEPU_OPENCL)
+				clEnqueueUnmapMemObject(this->queue, block.buffer, block.ptr, 0, nullptr, nullptr);
+				clFinish(this->queue);
+				clReleaseMemObject(block.buffer);
+#endif
+			}
+
+			void clear()
+			{
+				for (auto &pair : this->free)
+					for (Block &block : pair.second)
+						this->unpin(block);
+				this->free.clear();
+			}
+		};
+
+		inline void *allocate(size_t bytes) { return Arena::instance().allocate(bytes); }
+		inline void release(void *ptr) { Arena::instance().release(ptr); }
+		inline void trim() { Arena::instance().trim(); }
+#ifdef SKEPU_OPENCL
+		inline void useContext_CL(cl_context context, cl_command_queue queue) { Arena::instance().useContext_CL(context, queue); }
+#endif
+
+		// Standard allocator over the arena, for host storage kept in standard containers
+		template<typename T>
+		struct Allocator
+		{
+			using value_type = T;
+
+			Allocator() = default;
+			template<typename U>
+			Allocator(Allocator<U> const&) {}
+
+			T *allocate(size_t n) { return static_cast<T*>(skepu::pinned::allocate(n * sizeof(T))); }
+			void deallocate(T *ptr, size_t) { skepu::pinned::release(ptr); }
+
+			template<typename U>
+			bool operator==(Allocator<U> const&) const { return true; }
+			template<typename U>
+			bool operator!=(Allocator<U> const&) const { return false; }
+		};
+	}
+}
+)~~~";
+
+
+std::string generatePinnedHostSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_pinned_host.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << PinnedHostSupport;
+		generated = true;
+	}
+	return fileName;
+}
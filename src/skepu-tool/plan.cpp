@@ -0,0 +1,286 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Execution plans for instances listed in -plan. An execution plan file maps problem size ranges of each instance
+ * to a backend configuration; skepu::plan::Planned loads it on first use and sets the configuration of the range
+ * of each call, keeping the backend default for sizes and instances the plan does not cover.
+ *
+ * A run with SKEPU_CALIBRATE set in the environment writes the plan. The first call of each planned instance runs
+ * a size sweep on every candidate configuration of skepu_autotune.h, times the calls and fits the crossover points
+ * between the fastest configurations of neighbouring sizes from linear models of their times. Map and MapReduce
+ * calls on vectors sweep prefixes of their arguments, from 1024 elements up to the call size by factors of four;
+ * other calls are timed at their own size only. As with -autotune, calibrated calls are evaluated repeatedly and
+ * must not alias an output with an input.
+ */
+static const char *PlanSupport = R"~~~(
+#pragma once
+
+#include "skepu_autotune.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace plan
+	{
+		using autotune::Config;
+
+		// Sizes from first up to, but not including, the first of the next range
+		struct Range
+		{
+			size_t first;
+			Config config;
+		};
+
+		class Plan
+		{
+		public:
+			static Plan &open(const std::string &path)
+			{
+				static std::map<std::string, Plan> plans;
+				static std::mutex lock;
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = plans.find(path);
+				if (it == plans.end())
+					it = plans.emplace(path, Plan(path)).first;
+				return it->second;
+			}
+
+			bool lookup(const std::string &key, size_t size, Config &config) const
+			{
+				auto it = this->entries.find(key);
+				if (it == this->entries.end())
+					return false;
+				for (auto range = it->second.rbegin(); range != it->second.rend(); ++range)
+					if (range->first <= size)
+					{
+						config = range->config;
+						return true;
+					}
+				return false;
+			}
+
+			// Replaces the ranges of key and rewrites the plan file
+			void store(const std::string &key, std::vector<Range> ranges)
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->entries[key] = std::move(ranges);
+				std::ofstream file(this->path, std::ios::trunc);
+				for (auto &entry : this->entries)
+					for (const Range &range : entry.second)
+						file << entry.first << " " << range.first << " " << static_cast<int>(range.config.type) << " "
+							<< range.config.threads << " " << range.config.blocks << "\n";
+			}
+
+			Plan(Plan &&other): path(std::move(other.path)), entries(std::move(other.entries)) {}
+
+		private:
+			Plan(const std::string &path): path(path)
+			{
+				std::ifstream file(path);
+				std::string line;
+				while (std::getline(file, line))
+				{
+					std::istringstream fields(line);
+					std::string key;
+					int type;
+					Range range;
+					if (fields >> key >> range.first >> type >> range.config.threads >> range.config.blocks)
+					{
+						range.config.type = static_cast<Backend::Type>(type);
+						this->entries[key].push_back(range);
+					}
+				}
+				for (auto &entry : this->entries)
+					std::sort(entry.second.begin(), entry.second.end(), [](Range const& a, Range const& b) { return a.first < b.first; });
+			}
+
+			std::string path;
+			std::map<std::string, std::vector<Range>> entries;
+			std::mutex lock;
+		};
+
+		inline bool calibrating()
+		{
+			return std::getenv("SKEPU_CALIBRATE") != nullptr;
+		}
+
+		// Times of every candidate at one size of the sweep
+		struct Sample
+		{
+			size_t size;
+			std::vector<double> times;
+
+			size_t best() const
+			{
+				return std::min_element(this->times.begin(), this->times.end()) - this->times.begin();
+			}
+		};
+
+		// Size where candidates a and b, fastest at two neighbouring samples, take the same time on the lines
+		// through their times at both samples; the geometric mean of the sizes if the lines do not cross between them
+		inline size_t crossover(Sample const& low, Sample const& high, size_t a, size_t b)
+		{
+			double x0 = low.size, x1 = high.size;
+			double d0 = low.times[a] - low.times[b], d1 = high.times[a] - high.times[b];
+			double x = (d0 != d1) ? x0 + (x1 - x0) * d0 / (d0 - d1) : -1;
+			if (!(x > x0 && x < x1))
+				x = std::sqrt(x0 * x1);
+			return static_cast<size_t>(x);
+		}
+
+		inline std::vector<Range> fit(std::vector<Sample> const& samples, std::vector<Config> const& configs)
+		{
+			std::vector<Range> ranges;
+			ranges.push_back({0, configs[samples[0].best()]});
+			for (size_t s = 1; s < samples.size(); ++s)
+			{
+				size_t a = samples[s - 1].best(), b = samples[s].best();
+				if (a != b)
+					ranges.push_back({crossover(samples[s - 1], samples[s], a, b), configs[b]});
+			}
+			return ranges;
+		}
+
+		template<typename T> struct IsVector: std::false_type {};
+		template<typename T> struct IsVector<skepu::Vector<T>>: std::true_type {};
+
+		template<typename T>
+		using IsVectorArg = IsVector<typename std::remove_cv<typename std::remove_reference<T>::type>::type>;
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		template<bool Leading>
+		struct Prefix
+		{
+			template<typename Arg>
+			static Arg &of(Arg &arg) { return arg; }
+		};
+
+		template<>
+		struct Prefix<true>
+		{
+			template<typename Arg>
+			static auto of(Arg &arg) -> decltype(arg.begin()) { return arg.begin(); }
+		};
+
+		// Leading is the number of elementwise positions, including a Map output, 0 for skeletons without prefixes
+		template<typename Skeleton, typename UF, size_t Leading>
+		class Planned: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			Planned(const char *key, const char *plan, size_t maxThreads, CallArgs&&... args)
+			: Skeleton(std::forward<CallArgs>(args)...), key(key), plan(plan), maxThreads(maxThreads) {}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				Plan &plan = Plan::open(this->plan);
+				if (calibrating() && !this->calibrated)
+				{
+					this->calibrate(plan, std::integral_constant<bool, prefixable<Args...>(typename Indices<sizeof...(Args)>::type{})>{}, args...);
+					this->calibrated = true;
+				}
+
+				// Configurations past the launch bounds of the kernels keep the backend default too
+				Config config;
+				if (plan.lookup(this->key, autotune::problemSize(args...), config) && config.threads <= this->maxThreads)
+					this->setBackend(config.spec());
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args, size_t... I>
+			static constexpr bool prefixable(Sequence<I...>)
+			{
+				return Leading > 0 && UF::outArity == 1 && !UF::indexed && All<(I >= Leading || IsVectorArg<Args>::value)...>::value;
+			}
+
+			template<typename Run, typename... Args>
+			void sweep(Plan &plan, size_t size, std::vector<size_t> const& sizes, Run &&run, Args&... args)
+			{
+				std::vector<Config> configs = autotune::candidates(size, this->maxThreads);
+				std::vector<Sample> samples;
+				for (size_t m : sizes)
+				{
+					Sample sample {m, {}};
+					for (Config const& config : configs)
+					{
+						this->setBackend(config.spec());
+						auto start = std::chrono::steady_clock::now();
+						run(m);
+						autotune::flushAll(args...);
+						sample.times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+					}
+					samples.push_back(std::move(sample));
+				}
+				plan.store(this->key, fit(samples, configs));
+			}
+
+			template<typename... Args>
+			void calibrate(Plan &plan, std::false_type, Args&... args)
+			{
+				size_t size = autotune::problemSize(args...);
+				this->sweep(plan, size, {size}, [&](size_t) { Skeleton::operator()(args...); }, args...);
+			}
+
+			template<typename First, typename... Rest>
+			void calibrate(Plan &plan, std::true_type, First &first, Rest&... rest)
+			{
+				size_t size = first.size();
+				std::vector<size_t> sizes;
+				for (size_t m = 1024; m < size; m *= 4)
+					sizes.push_back(m);
+				sizes.push_back(size);
+				auto whole = typename Indices<sizeof...(Rest)>::type{};
+				this->sweep(plan, size, sizes, [&](size_t m) { this->prefix(m, whole, first, rest...); }, first, rest...);
+			}
+
+			template<typename First, typename... Rest, size_t... I>
+			void prefix(size_t m, Sequence<I...>, First &first, Rest&... rest)
+			{
+				Skeleton::operator()(first.begin(), first.begin() + m, Prefix<(I + 1 < Leading)>::of(rest)...);
+			}
+
+			std::string key;
+			std::string plan;
+			size_t maxThreads;
+			bool calibrated = false;
+		};
+	}
+}
+)~~~";
+
+
+std::string generatePlanSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_plan.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		generateAutotuneSupport(dir);
+		FSOutFile << PlanSupport;
+		generated = true;
+	}
+	return fileName;
+}
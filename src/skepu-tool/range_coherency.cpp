@@ -0,0 +1,184 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Range-granular coherency for -range-coherency, so that host code inspecting a few elements or one row of a
+ * container only transfers that part from the device. The main file defines SKEPU_RANGE_COHERENCY and includes
+ * this header before the SkePU headers, whose device pointers then keep a Ranges set of the elements that are
+ * newer on the device: kernels add the range they write, updateHostRange(first, last) copies back only the parts
+ * of [first, last) in the set and removes them, and host element access v(i) and m(i, j) calls it for the one
+ * element. Adjacent and overlapping ranges are merged, so a kernel writing a whole container is one range.
+ *
+ * coherency::read(c, first, count) and coherency::write(c, first, count) name an element range of a container,
+ * readRows and writeRows whole rows of a matrix, and read(view) and write(view) a -views slice or row range.
+ * coherency::external(accesses..., func, accesses...) brings the ranges to the host, runs func, and then marks
+ * the written ranges as newer on the host through invalidateDeviceRange, as skepu::external does for whole
+ * containers. Containers without the range interface are updated and invalidated whole.
+ */
+static const char *RangeCoherencySupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace coherency
+	{
+		// A set of disjoint half-open element ranges, by first element
+		class Ranges
+		{
+		public:
+			void add(size_t first, size_t last)
+			{
+				if (first >= last)
+					return;
+				auto it = this->ranges.upper_bound(first);
+				if (it != this->ranges.begin() && std::prev(it)->second >= first)
+					--it;
+				while (it != this->ranges.end() && it->first <= last)
+				{
+					first = std::min(first, it->first);
+					last = std::max(last, it->second);
+					it = this->ranges.erase(it);
+				}
+				this->ranges.emplace(first, last);
+			}
+
+			// Removes and returns the parts of the set inside [first, last)
+			std::vector<std::pair<size_t, size_t>> take(size_t first, size_t last)
+			{
+				std::vector<std::pair<size_t, size_t>> taken;
+				auto it = this->ranges.upper_bound(first);
+				if (it != this->ranges.begin() && std::prev(it)->second > first)
+					--it;
+				while (it != this->ranges.end() && it->first < last)
+				{
+					size_t lo = it->first, hi = it->second;
+					it = this->ranges.erase(it);
+					if (lo < first)
+						this->ranges.emplace(lo, first);
+					if (hi > last)
+						it = this->ranges.emplace(last, hi).first;
+					taken.emplace_back(std::max(lo, first), std::min(hi, last));
+				}
+				return taken;
+			}
+
+			bool contains(size_t first, size_t last) const
+			{
+				auto it = this->ranges.upper_bound(first);
+				return (it != this->ranges.begin() && std::prev(it)->second > first) || (it != this->ranges.end() && it->first < last);
+			}
+
+			bool empty() const { return this->ranges.empty(); }
+			void clear() { this->ranges.clear(); }
+
+		private:
+			std::map<size_t, size_t> ranges;
+		};
+
+		template<typename Container, bool Writes>
+		struct Access
+		{
+			Container &container;
+			size_t first, last;
+		};
+
+		template<typename Container>
+		Access<Container, false> read(Container &c, size_t first, size_t count) { return {c, first, first + count}; }
+
+		template<typename Container>
+		Access<Container, true> write(Container &c, size_t first, size_t count) { return {c, first, first + count}; }
+
+		template<typename Container>
+		Access<Container, false> readRows(Container &m, size_t row, size_t rows) { return {m, row * m.total_cols(), (row + rows) * m.total_cols()}; }
+
+		template<typename Container>
+		Access<Container, true> writeRows(Container &m, size_t row, size_t rows) { return {m, row * m.total_cols(), (row + rows) * m.total_cols()}; }
+
+		template<typename View>
+		auto read(View &v) -> Access<typename std::remove_reference<decltype(v.getParent())>::type, false> { return {v.getParent(), v.offset(), v.offset() + v.size()}; }
+
+		template<typename View>
+		auto write(View &v) -> Access<typename std::remove_reference<decltype(v.getParent())>::type, true> { return {v.getParent(), v.offset(), v.offset() + v.size()}; }
+
+		template<typename Container>
+		auto fetch(Container &c, size_t first, size_t last, int) -> decltype(c.updateHostRange(first, last), void())
+		{
+			c.updateHostRange(first, last);
+		}
+
+		template<typename Container>
+		auto fetch(Container &c, size_t, size_t, long) -> decltype(c.updateHost(), void())
+		{
+			c.updateHost();
+		}
+
+		template<typename Container>
+		void fetch(Container &, size_t, size_t, ...) {}
+
+		template<typename Container>
+		auto invalidate(Container &c, size_t first, size_t last, int) -> decltype(c.invalidateDeviceRange(first, last), void())
+		{
+			c.invalidateDeviceRange(first, last);
+		}
+
+		template<typename Container>
+		auto invalidate(Container &c, size_t, size_t, long) -> decltype(c.invalidateDeviceData(), void())
+		{
+			c.invalidateDeviceData();
+		}
+
+		template<typename Container>
+		void invalidate(Container &, size_t, size_t, ...) {}
+
+		// Written ranges are fetched too, since the host may write only part of them
+		template<typename Container, bool Writes>
+		void before(Access<Container, Writes> &access) { fetch(access.container, access.first, access.last, 0); }
+
+		template<typename Func>
+		void before(Func &) {}
+
+		template<typename Container, bool Writes>
+		void run(Access<Container, Writes> &) {}
+
+		template<typename Func>
+		void run(Func &func) { func(); }
+
+		template<typename Container>
+		void after(Access<Container, true> &access) { invalidate(access.container, access.first, access.last, 0); }
+
+		template<typename Arg>
+		void after(Arg &) {}
+
+		template<typename... Args>
+		void external(Args&&... args)
+		{
+			using expand = int[];
+			(void)expand{0, (before(args), 0)...};
+			(void)expand{0, (run(args), 0)...};
+			(void)expand{0, (after(args), 0)...};
+		}
+	}
+}
+)~~~";
+
+
+std::string generateRangeCoherencySupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_range_coherency.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << RangeCoherencySupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -30,19 +30,7 @@ __kernel void {{KERNEL_NAME}}(__global {{REDUCE_RESULT_TYPE}}* input, __global {
 		i += gridSize;
 	}
 
-	sdata[tid] = result;
-	barrier(CLK_LOCAL_MEM_FENCE);
-
-	if (blockSize >= 1024) { if (tid < 512 && tid + 512 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid + 512]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=  512) { if (tid < 256 && tid + 256 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid + 256]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=  256) { if (tid < 128 && tid + 128 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid + 128]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=  128) { if (tid <  64 && tid +  64 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +  64]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=   64) { if (tid <  32 && tid +  32 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +  32]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=   32) { if (tid <  16 && tid +  16 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +  16]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=   16) { if (tid <   8 && tid +   8 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +   8]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=    8) { if (tid <   4 && tid +   4 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +   4]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=    4) { if (tid <   2 && tid +   2 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +   2]); } barrier(CLK_LOCAL_MEM_FENCE); }
-	if (blockSize >=    2) { if (tid <   1 && tid +   1 < n) { sdata[tid] = {{FUNCTION_NAME_REDUCE}}(sdata[tid], sdata[tid +   1]); } barrier(CLK_LOCAL_MEM_FENCE); }
+{{BLOCK_REDUCE}}
 
 	if (tid == 0)
 		output[get_group_id(0)] = sdata[tid];
@@ -55,45 +43,57 @@ class {{KERNEL_CLASS}}
 {
 public:
 
+	static skepu_cl_kernel_table<1> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<1> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID] = *newkernel;
+			skepu_kernel_table().set(deviceID, 0, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID];
+		else return skepu_kernel_table().get(deviceID, 0);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
+		CL_CHECK_ERROR(err, "Error creating map kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel = clCreateKernel(program, "{{KERNEL_NAME}}", &err);
-			CL_CHECK_ERROR(err, "Error creating map kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, &kernel);
+	}
 
-			kernels(counter++, &kernel);
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	static void reduce(size_t deviceID, size_t localSize, size_t globalSize, cl_mem input, cl_mem output, size_t n, size_t sharedMemSize)
 	{
-		skepu::backend::cl_helpers::setKernelArgs(kernels(deviceID), input, output, n);
+		skepu_cl_set_kernel_args(kernels(deviceID), input, output, n);
 		clSetKernelArg(kernels(deviceID), 3, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernels(deviceID), 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernels(deviceID), 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching Map kernel");
 	}
 };
@@ -104,8 +104,7 @@ std::string createReduce1DKernelProgram_CL(SkeletonInstance &instance, UserFunct
 {
 	std::stringstream sourceStream;
 
-	if (reduceFunc.requiresDoublePrecision)
-		sourceStream << "#pragma OPENCL EXTENSION cl_khr_fp64: enable\n";
+	sourceStream << precisionExtensions_CL({&reduceFunc}) << collectiveReducePrelude_CL({&reduceFunc});
 
 	// Include user constants as preprocessor macros
 	for (auto pair : UserConstants)
@@ -118,16 +117,15 @@ std::string createReduce1DKernelProgram_CL(SkeletonInstance &instance, UserFunct
 	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_ReduceKernel_" + reduceFunc.uniqueName;
 	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(reduceFunc) << ReduceKernelTemplate_CL;
 
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor1D,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor1D,
 	{
 		{"{{OPENCL_KERNEL}}",        sourceStream.str()},
+		{"{{BLOCK_REDUCE}}",         generateBlockReduce_CL(reduceFunc, reduceFunc.resolvedReturnTypeName, "result", "sdata", "tid", "blockSize", "n")},
 		{"{{KERNEL_CLASS}}",         "CLWrapperClass_" + kernelName},
 		{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
 		{"{{KERNEL_NAME}}",          kernelName},
 		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.uniqueName}
-	});
-	return kernelName;
+	}), dir);
 }
 
 
@@ -144,61 +142,72 @@ public:
 		KERNEL_COUNT
 	};
 
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8][KERNEL_COUNT]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID][kerneltype] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID][kerneltype];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
+		cl_kernel rowwisekernel = clCreateKernel(program, "{{KERNEL_NAME}}_RowWise", &err);
+		CL_CHECK_ERROR(err, "Error creating row-wise Reduce kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel rowwisekernel = clCreateKernel(program, "{{KERNEL_NAME}}_RowWise", &err);
-			CL_CHECK_ERROR(err, "Error creating row-wise Reduce kernel '{{KERNEL_NAME}}'");
+		cl_kernel colwisekernel = clCreateKernel(program, "{{KERNEL_NAME}}_ColWise", &err);
+		CL_CHECK_ERROR(err, "Error creating col-wise Reduce kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel colwisekernel = clCreateKernel(program, "{{KERNEL_NAME}}_ColWise", &err);
-			CL_CHECK_ERROR(err, "Error creating col-wise Reduce kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, KERNEL_ROWWISE, &rowwisekernel);
+		kernels(deviceID, KERNEL_COLWISE, &colwisekernel);
+	}
 
-			kernels(counter, KERNEL_ROWWISE, &rowwisekernel);
-			kernels(counter, KERNEL_COLWISE, &colwisekernel);
-			counter++;
-		}
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
 
-		initialized = true;
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	static void reduceRowWise(size_t deviceID, size_t localSize, size_t globalSize, cl_mem input, cl_mem output, size_t n, size_t sharedMemSize)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_ROWWISE);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, input, output, n);
+		skepu_cl_set_kernel_args(kernel, input, output, n);
 		clSetKernelArg(kernel, 3, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching Map kernel");
 	}
 
 	static void reduceColWise(size_t deviceID, size_t localSize, size_t globalSize, cl_mem input, cl_mem output, size_t n, size_t sharedMemSize)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_COLWISE);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, input, output, n);
+		skepu_cl_set_kernel_args(kernel, input, output, n);
 		clSetKernelArg(kernel, 3, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching Map kernel");
 	}
 
@@ -214,8 +223,7 @@ std::string createReduce2DKernelProgram_CL(SkeletonInstance &instance, UserFunct
 	std::stringstream sourceStream;
 	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_ReduceKernel_" + rowWiseFunc.uniqueName + "_" + colWiseFunc.uniqueName;
 
-	if (rowWiseFunc.requiresDoublePrecision || colWiseFunc.requiresDoublePrecision)
-		sourceStream << "#pragma OPENCL EXTENSION cl_khr_fp64: enable\n";
+	sourceStream << precisionExtensions_CL({&rowWiseFunc, &colWiseFunc}) << collectiveReducePrelude_CL({&rowWiseFunc, &colWiseFunc});
 
 	// Include user constants as preprocessor macros
 	for (auto pair : UserConstants)
@@ -243,12 +251,14 @@ std::string createReduce2DKernelProgram_CL(SkeletonInstance &instance, UserFunct
 
 	sourceStream << templateString(ReduceKernelTemplate_CL,
 	{
+		{"{{BLOCK_REDUCE}}",         generateBlockReduce_CL(rowWiseFunc, rowWiseFunc.resolvedReturnTypeName, "result", "sdata", "tid", "blockSize", "n")},
 		{"{{REDUCE_RESULT_TYPE}}",   rowWiseFunc.resolvedReturnTypeName},
 		{"{{KERNEL_NAME}}",          kernelName + "_RowWise"},
 		{"{{FUNCTION_NAME_REDUCE}}", rowWiseFunc.uniqueName}
 	});
 	sourceStream << templateString(ReduceKernelTemplate_CL,
 	{
+		{"{{BLOCK_REDUCE}}",         generateBlockReduce_CL(colWiseFunc, colWiseFunc.resolvedReturnTypeName, "result", "sdata", "tid", "blockSize", "n")},
 		{"{{REDUCE_RESULT_TYPE}}",   colWiseFunc.resolvedReturnTypeName},
 		{"{{KERNEL_NAME}}",          kernelName + "_ColWise"},
 		{"{{FUNCTION_NAME_REDUCE}}", colWiseFunc.uniqueName}
@@ -259,7 +269,5 @@ std::string createReduce2DKernelProgram_CL(SkeletonInstance &instance, UserFunct
 	replaceTextInString(finalSource, "{{KERNEL_NAME}}", kernelName);
 	replaceTextInString(finalSource, "{{KERNEL_CLASS}}", className);
 
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << finalSource;
-	return kernelName;
+	return writeKernelProgram_CL(kernelName, finalSource, dir);
 }
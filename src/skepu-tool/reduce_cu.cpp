@@ -1,6 +1,7 @@
 #include <algorithm>
 
 #include "code_gen.h"
+#include "code_gen_cu.h"
 
 using namespace clang;
 
@@ -9,7 +10,7 @@ using namespace clang;
 // ------------------------------
 
 static const char *ReduceKernelTemplate_CU = R"~~~(
-__global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RESULT_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_blockSize, bool skepu_nIsPow2)
+__global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RESULT_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_blockSize, bool skepu_nIsPow2{{EARLY_EXIT_PARAMS}})
 {
 	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
 
@@ -19,7 +20,7 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 	size_t skepu_i = blockIdx.x * skepu_blockSize * 2 + threadIdx.x;
 	size_t skepu_gridSize = skepu_blockSize * 2 * gridDim.x;
 
-	{{REDUCE_RESULT_TYPE}} skepu_result;
+	{{REDUCE_ACCUMULATOR_TYPE}} skepu_result;
 
 	if (skepu_i < skepu_n)
 	{
@@ -38,6 +39,7 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 	// in a larger gridSize and therefore fewer elements per thread
 	while (skepu_i < skepu_n)
 	{
+{{EARLY_EXIT_CHECK}}
 		skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_input[skepu_i]);
 		// ensure we don't read out of bounds -- this is optimized away for powerOf2 sized arrays
 		if (skepu_nIsPow2 || skepu_i + skepu_blockSize < skepu_n)
@@ -45,6 +47,9 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 		skepu_i += skepu_gridSize;
 	}
 
+#if {{USE_SHUFFLE_REDUCE}}
+{{SHUFFLE_REDUCE}}
+#else
 	// each thread puts its local sum into shared memory
 	{{SHARED_BUFFER}}[skepu_tid] = skepu_result;
 	__syncthreads();
@@ -68,6 +73,7 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 		if (skepu_blockSize >=   4) { if (skepu_tid <  2) { skepu_smem[skepu_tid] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_smem[skepu_tid +  2]); } __syncwarp(); }
 		if (skepu_blockSize >=   2) { if (skepu_tid <  1) { skepu_smem[skepu_tid] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_smem[skepu_tid +  1]); } __syncwarp(); }
 	}
+#endif
 
 	// write result for this block to global mem
 	if (skepu_tid == 0)
@@ -75,38 +81,229 @@ __global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RE
 }
 )~~~";
 
+/*!
+ * Whole-matrix row-wise reduction in one launch. Each row is reduced by blockDim.x threads, a power of two:
+ * one warp for narrow rows up to the whole block for wide ones, with blockDim.y rows per block. Blocks walk
+ * the rows with a grid stride, the loop bounds are uniform within a block so the barriers are safe.
+ */
+static const char *RowWiseReduce2DKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RESULT_TYPE}} *skepu_output, size_t skepu_rows, size_t skepu_cols)
+{
+	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
+	
+	size_t skepu_lane = threadIdx.x;
+	size_t skepu_width = blockDim.x;
+	size_t skepu_count = (skepu_width < skepu_cols) ? skepu_width : skepu_cols;
+	{{REDUCE_RESULT_TYPE}} *skepu_sdata = {{SHARED_BUFFER}} + threadIdx.y * skepu_width;
+	
+	for (size_t skepu_rowBase = blockIdx.x * blockDim.y; skepu_rowBase < skepu_rows; skepu_rowBase += gridDim.x * blockDim.y)
+	{
+		size_t skepu_row = skepu_rowBase + threadIdx.y;
+		bool skepu_active = skepu_row < skepu_rows && skepu_lane < skepu_count;
+		{{REDUCE_ACCUMULATOR_TYPE}} skepu_result;
+		
+		if (skepu_active)
+		{
+			{{REDUCE_RESULT_TYPE}} *skepu_rowData = skepu_input + skepu_row * skepu_cols;
+			skepu_result = skepu_rowData[skepu_lane];
+			for (size_t skepu_col = skepu_lane + skepu_width; skepu_col < skepu_cols; skepu_col += skepu_width)
+				skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_rowData[skepu_col]);
+			skepu_sdata[skepu_lane] = skepu_result;
+		}
+		__syncthreads();
+		
+		for (size_t skepu_offset = skepu_width / 2; skepu_offset > 0; skepu_offset /= 2)
+		{
+			if (skepu_active && skepu_lane < skepu_offset && skepu_lane + skepu_offset < skepu_count)
+				skepu_sdata[skepu_lane] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_sdata[skepu_lane + skepu_offset]);
+			__syncthreads();
+		}
+		
+		if (skepu_active && skepu_lane == 0)
+			skepu_output[skepu_row] = skepu_sdata[0];
+		__syncthreads();
+	}
+}
+)~~~";
+
+/*!
+ * Whole-matrix column-wise reduction in one launch. The blockDim.x threads along x own consecutive columns, so
+ * every row access is coalesced, and the blockDim.y threads along y (a power of two) split the rows of those
+ * columns. Each thread keeps its column accumulator in a register before the y partials are combined in shared memory.
+ */
+static const char *ColWiseReduce2DKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RESULT_TYPE}} *skepu_output, size_t skepu_rows, size_t skepu_cols)
+{
+	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
+	
+	size_t skepu_slice = threadIdx.y;
+	size_t skepu_slices = blockDim.y;
+	size_t skepu_count = (skepu_slices < skepu_rows) ? skepu_slices : skepu_rows;
+	
+	for (size_t skepu_colBase = blockIdx.x * blockDim.x; skepu_colBase < skepu_cols; skepu_colBase += gridDim.x * blockDim.x)
+	{
+		size_t skepu_col = skepu_colBase + threadIdx.x;
+		bool skepu_active = skepu_col < skepu_cols && skepu_slice < skepu_count;
+		{{REDUCE_ACCUMULATOR_TYPE}} skepu_result;
+		
+		if (skepu_active)
+		{
+			skepu_result = skepu_input[skepu_slice * skepu_cols + skepu_col];
+			for (size_t skepu_row = skepu_slice + skepu_slices; skepu_row < skepu_rows; skepu_row += skepu_slices)
+				skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_input[skepu_row * skepu_cols + skepu_col]);
+			{{SHARED_BUFFER}}[skepu_slice * blockDim.x + threadIdx.x] = skepu_result;
+		}
+		__syncthreads();
+		
+		for (size_t skepu_offset = skepu_slices / 2; skepu_offset > 0; skepu_offset /= 2)
+		{
+			if (skepu_active && skepu_slice < skepu_offset && skepu_slice + skepu_offset < skepu_count)
+				{{SHARED_BUFFER}}[skepu_slice * blockDim.x + threadIdx.x] = skepu_result
+					= {{FUNCTION_NAME_REDUCE}}(skepu_result, {{SHARED_BUFFER}}[(skepu_slice + skepu_offset) * blockDim.x + threadIdx.x]);
+			__syncthreads();
+		}
+		
+		if (skepu_active && skepu_slice == 0)
+			skepu_output[skepu_col] = {{SHARED_BUFFER}}[threadIdx.x];
+		__syncthreads();
+	}
+}
+)~~~";
+
+
+/*!
+ * Batched reduction of many small vectors in one launch, for -batched instances. Item i is the range
+ * [skepu_offsets[i], skepu_offsets[i + 1]) of the flat input and is reduced by one warp, blockDim.x / 32 items per
+ * block, with the start value combined into each result; an empty item reduces to the start value. blockDim.x
+ * must be a multiple of 32, and the warps only synchronize among themselves.
+ */
+static const char *BatchedReduceKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}({{REDUCE_RESULT_TYPE}} *skepu_input, {{REDUCE_RESULT_TYPE}} *skepu_output, size_t *skepu_offsets, size_t skepu_items, {{REDUCE_RESULT_TYPE}} skepu_start)
+{
+	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
+	
+	size_t skepu_lane = threadIdx.x % 32;
+	size_t skepu_warp = threadIdx.x / 32;
+	size_t skepu_warps = blockDim.x / 32;
+	{{REDUCE_RESULT_TYPE}} *skepu_sdata = {{SHARED_BUFFER}} + skepu_warp * 32;
+	
+	for (size_t skepu_item = blockIdx.x * skepu_warps + skepu_warp; skepu_item < skepu_items; skepu_item += gridDim.x * skepu_warps)
+	{
+		size_t skepu_first = skepu_offsets[skepu_item];
+		size_t skepu_last = skepu_offsets[skepu_item + 1];
+		size_t skepu_count = (skepu_last - skepu_first < 32) ? skepu_last - skepu_first : 32;
+		bool skepu_active = skepu_lane < skepu_count;
+		{{REDUCE_ACCUMULATOR_TYPE}} skepu_result;
+		
+		if (skepu_active)
+		{
+			skepu_result = skepu_input[skepu_first + skepu_lane];
+			for (size_t skepu_i = skepu_first + skepu_lane + 32; skepu_i < skepu_last; skepu_i += 32)
+				skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_input[skepu_i]);
+			skepu_sdata[skepu_lane] = skepu_result;
+		}
+		__syncwarp();
+		
+		for (size_t skepu_offset = 16; skepu_offset > 0; skepu_offset /= 2)
+		{
+			if (skepu_active && skepu_lane < skepu_offset && skepu_lane + skepu_offset < skepu_count)
+				skepu_sdata[skepu_lane] = skepu_result = {{FUNCTION_NAME_REDUCE}}(skepu_result, skepu_sdata[skepu_lane + skepu_offset]);
+			__syncwarp();
+		}
+		
+		if (skepu_lane == 0)
+			skepu_output[skepu_item] = (skepu_count > 0) ? {{FUNCTION_NAME_REDUCE}}(skepu_start, skepu_sdata[0]) : skepu_start;
+		__syncwarp();
+	}
+}
+)~~~";
+
 
-std::string createReduce1DKernelProgram_CU(SkeletonInstance &instance, UserFunction &reduceFunc, std::string dir)
+std::string createReduce1DKernelProgram_CU(SkeletonInstance &instance, UserFunction &reduceFunc, std::string dir, std::string absorbing, bool batched)
 {
 	const std::string kernelName = ResultName + "_ReduceKernel_" + reduceFunc.uniqueName;
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
-	FSOutFile << templateString(ReduceKernelTemplate_CU,
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	if (useShuffleReduce_CU(reduceFunc))
+		FSOutFile << generateShuffleReduceHelpers_CU();
+	
+	// The _EarlyExit variant of an instance with an absorbing value takes the zeroed flag of the launch
+	for (bool earlyExit : {false, true})
 	{
-		{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
-		{"{{KERNEL_NAME}}",          kernelName},
-		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.funcNameCUDA()},
-		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
-	});
+		if (earlyExit && absorbing.empty())
+			break;
+		FSOutFile << templateString(ReduceKernelTemplate_CU,
+		{
+			{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
+			{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(reduceFunc)},
+			{"{{KERNEL_NAME}}",          earlyExit ? kernelName + "_EarlyExit" : kernelName},
+			{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(reduceFunc)},
+			{"{{SHARED_BUFFER}}",        "sdata_" + instance},
+			{"{{EARLY_EXIT_PARAMS}}",    earlyExit ? ", unsigned int *skepu_done" : ""},
+			{"{{EARLY_EXIT_CHECK}}",     earlyExit ? generateEarlyExitCheck_CU(absorbing) : ""},
+			{"{{USE_SHUFFLE_REDUCE}}",   useShuffleReduce_CU(reduceFunc) ? "1" : "0"},
+			{"{{SHUFFLE_REDUCE}}",       generateShuffleBlockReduce_CU(reduceFunc, reduceAccumulatorType_CU(reduceFunc), "sdata_" + instance, "skepu_blockSize", reduceFuncName_CU(reduceFunc))}
+		});
+	}
+	if (batched)
+		FSOutFile << templateString(BatchedReduceKernelTemplate_CU,
+		{
+			{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
+			{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(reduceFunc)},
+			{"{{KERNEL_NAME}}",          kernelName + "_Batched"},
+			{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(reduceFunc)},
+			{"{{SHARED_BUFFER}}",        "sdata_" + instance}
+		});
 	return kernelName;
 }
 
 
-std::string createReduce2DKernelProgram_CU(SkeletonInstance &instance, UserFunction &rowWiseFunc, UserFunction &colWiseFunc, std::string dir)
+std::string createReduce2DKernelProgram_CU(SkeletonInstance &instance, UserFunction &rowWiseFunc, UserFunction &colWiseFunc, std::string dir, bool singleLaunch)
 {
 	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_ReduceKernel_" + rowWiseFunc.uniqueName + "_" + colWiseFunc.uniqueName;
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	if (useShuffleReduce_CU(rowWiseFunc) || useShuffleReduce_CU(colWiseFunc))
+		FSOutFile << generateShuffleReduceHelpers_CU();
 	FSOutFile << templateString(ReduceKernelTemplate_CU,
 	{
 		{"{{REDUCE_RESULT_TYPE}}",   rowWiseFunc.resolvedReturnTypeName},
+		{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(rowWiseFunc)},
 		{"{{KERNEL_NAME}}",          kernelName + "_RowWise"},
-		{"{{FUNCTION_NAME_REDUCE}}", rowWiseFunc.funcNameCUDA()},
-		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(rowWiseFunc)},
+		{"{{SHARED_BUFFER}}",        "sdata_" + instance},
+		{"{{EARLY_EXIT_PARAMS}}",    ""},
+		{"{{EARLY_EXIT_CHECK}}",     ""},
+		{"{{USE_SHUFFLE_REDUCE}}",   useShuffleReduce_CU(rowWiseFunc) ? "1" : "0"},
+		{"{{SHUFFLE_REDUCE}}",       generateShuffleBlockReduce_CU(rowWiseFunc, reduceAccumulatorType_CU(rowWiseFunc), "sdata_" + instance, "skepu_blockSize", reduceFuncName_CU(rowWiseFunc))}
 	});
 	FSOutFile << templateString(ReduceKernelTemplate_CU,
 	{
 		{"{{REDUCE_RESULT_TYPE}}",   colWiseFunc.resolvedReturnTypeName},
+		{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(colWiseFunc)},
 		{"{{KERNEL_NAME}}",          kernelName + "_ColWise"},
-		{"{{FUNCTION_NAME_REDUCE}}", colWiseFunc.funcNameCUDA()},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(colWiseFunc)},
+		{"{{SHARED_BUFFER}}",        "sdata_" + instance},
+		{"{{EARLY_EXIT_PARAMS}}",    ""},
+		{"{{EARLY_EXIT_CHECK}}",     ""},
+		{"{{USE_SHUFFLE_REDUCE}}",   useShuffleReduce_CU(colWiseFunc) ? "1" : "0"},
+		{"{{SHUFFLE_REDUCE}}",       generateShuffleBlockReduce_CU(colWiseFunc, reduceAccumulatorType_CU(colWiseFunc), "sdata_" + instance, "skepu_blockSize", reduceFuncName_CU(colWiseFunc))}
+	});
+	if (!singleLaunch)
+		return kernelName;
+	
+	FSOutFile << templateString(RowWiseReduce2DKernelTemplate_CU,
+	{
+		{"{{REDUCE_RESULT_TYPE}}",   rowWiseFunc.resolvedReturnTypeName},
+		{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(rowWiseFunc)},
+		{"{{KERNEL_NAME}}",          kernelName + "_RowWise2D"},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(rowWiseFunc)},
+		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
+	});
+	FSOutFile << templateString(ColWiseReduce2DKernelTemplate_CU,
+	{
+		{"{{REDUCE_RESULT_TYPE}}",   colWiseFunc.resolvedReturnTypeName},
+		{"{{REDUCE_ACCUMULATOR_TYPE}}", reduceAccumulatorType_CU(colWiseFunc)},
+		{"{{KERNEL_NAME}}",          kernelName + "_ColWise2D"},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFuncName_CU(colWiseFunc)},
 		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
 	});
 	return kernelName;
@@ -0,0 +1,270 @@
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+// Same tiling and carry resolution as the CUDA kernels, see reducebykey_cu.cpp
+const std::string SegmentHelpers_CL = R"~~~(
+size_t {{KERNEL_NAME}}_segmentOf(__global const size_t *skepu_offsets, size_t skepu_numSegments, size_t skepu_i)
+{
+	size_t skepu_lo = 0, skepu_hi = skepu_numSegments;
+	while (skepu_lo + 1 < skepu_hi)
+	{
+		size_t skepu_mid = (skepu_lo + skepu_hi) / 2;
+		if (skepu_offsets[skepu_mid] <= skepu_i)
+			skepu_lo = skepu_mid;
+		else
+			skepu_hi = skepu_mid;
+	}
+	return skepu_lo;
+}
+
+void {{KERNEL_NAME}}_segmentedScan(__local {{REDUCE_RESULT_TYPE}} *skepu_vals, __local size_t *skepu_keys, size_t skepu_tid, size_t skepu_count)
+{
+	for (size_t skepu_offset = 1; skepu_offset < get_local_size(0); skepu_offset *= 2)
+	{
+		bool skepu_take = skepu_tid < skepu_count && skepu_tid >= skepu_offset && skepu_keys[skepu_tid - skepu_offset] == skepu_keys[skepu_tid];
+		{{REDUCE_RESULT_TYPE}} skepu_prev;
+		if (skepu_take)
+			skepu_prev = skepu_vals[skepu_tid - skepu_offset];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (skepu_take)
+			skepu_vals[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_prev, skepu_vals[skepu_tid]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+)~~~";
+
+const std::string SegmentTiles_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_SegmentTiles(__global {{REDUCE_RESULT_TYPE}} *skepu_input, __global const size_t *skepu_offsets, __global {{REDUCE_RESULT_TYPE}} *skepu_output,
+	__global {{REDUCE_RESULT_TYPE}} *skepu_tile_heads, __global {{REDUCE_RESULT_TYPE}} *skepu_tile_tails, __global size_t *skepu_tile_keys, size_t skepu_n, size_t skepu_numSegments,
+	__local {{REDUCE_RESULT_TYPE}} *skepu_sdata, __local size_t *skepu_keys)
+{
+	size_t skepu_tid = get_local_id(0);
+	size_t skepu_blockSize = get_local_size(0);
+	size_t skepu_numTiles = (skepu_n + skepu_blockSize - 1) / skepu_blockSize;
+
+	for (size_t skepu_tile = get_group_id(0); skepu_tile < skepu_numTiles; skepu_tile += get_num_groups(0))
+	{
+		size_t skepu_tileStart = skepu_tile * skepu_blockSize;
+		size_t skepu_count = min(skepu_blockSize, skepu_n - skepu_tileStart);
+		size_t skepu_i = skepu_tileStart + skepu_tid;
+		bool skepu_valid = skepu_tid < skepu_count;
+
+		if (skepu_valid)
+		{
+			skepu_sdata[skepu_tid] = skepu_input[skepu_i];
+			skepu_keys[skepu_tid] = {{KERNEL_NAME}}_segmentOf(skepu_offsets, skepu_numSegments, skepu_i);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		{{KERNEL_NAME}}_segmentedScan(skepu_sdata, skepu_keys, skepu_tid, skepu_count);
+
+		size_t skepu_firstKey = skepu_keys[0];
+		bool skepu_continued = skepu_offsets[skepu_firstKey] < skepu_tileStart;
+
+		if (skepu_valid && skepu_offsets[skepu_keys[skepu_tid] + 1] == skepu_i + 1)
+		{
+			if (skepu_continued && skepu_keys[skepu_tid] == skepu_firstKey)
+				skepu_tile_heads[skepu_tile] = skepu_sdata[skepu_tid];
+			else
+				skepu_output[skepu_keys[skepu_tid]] = skepu_sdata[skepu_tid];
+		}
+
+		if (skepu_tid == skepu_count - 1)
+		{
+			skepu_tile_tails[skepu_tile] = skepu_sdata[skepu_tid];
+			skepu_tile_keys[2 * skepu_tile] = skepu_firstKey;
+			skepu_tile_keys[2 * skepu_tile + 1] = skepu_keys[skepu_tid];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+)~~~";
+
+const std::string SegmentCarries_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_SegmentCarries(__global const size_t *skepu_offsets, __global {{REDUCE_RESULT_TYPE}} *skepu_output,
+	__global {{REDUCE_RESULT_TYPE}} *skepu_tile_heads, __global {{REDUCE_RESULT_TYPE}} *skepu_tile_tails, __global size_t *skepu_tile_keys, size_t skepu_n, size_t skepu_tileSize,
+	__local {{REDUCE_RESULT_TYPE}} *skepu_sdata, __local size_t *skepu_keys)
+{
+	__local {{REDUCE_RESULT_TYPE}} skepu_runValue;
+	__local size_t skepu_runKey;
+
+	size_t skepu_tid = get_local_id(0);
+	size_t skepu_blockSize = get_local_size(0);
+	size_t skepu_numTiles = (skepu_n + skepu_tileSize - 1) / skepu_tileSize;
+
+	for (size_t skepu_base = 0; skepu_base < skepu_numTiles; skepu_base += skepu_blockSize)
+	{
+		size_t skepu_count = min(skepu_blockSize, skepu_numTiles - skepu_base);
+		size_t skepu_tile = skepu_base + skepu_tid;
+		bool skepu_valid = skepu_tid < skepu_count;
+
+		if (skepu_valid)
+		{
+			skepu_sdata[skepu_tid] = skepu_tile_tails[skepu_tile];
+			skepu_keys[skepu_tid] = skepu_tile_keys[2 * skepu_tile + 1];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		{{KERNEL_NAME}}_segmentedScan(skepu_sdata, skepu_keys, skepu_tid, skepu_count);
+
+		if (skepu_valid && skepu_base > 0 && skepu_keys[skepu_tid] == skepu_runKey)
+			skepu_sdata[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_runValue, skepu_sdata[skepu_tid]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (skepu_valid && skepu_tile > 0)
+		{
+			size_t skepu_firstKey = skepu_tile_keys[2 * skepu_tile];
+			size_t skepu_tileStart = skepu_tile * skepu_tileSize;
+			size_t skepu_end = skepu_offsets[skepu_firstKey + 1];
+			if (skepu_offsets[skepu_firstKey] < skepu_tileStart && skepu_end <= skepu_tileStart + skepu_tileSize)
+			{
+				{{REDUCE_RESULT_TYPE}} skepu_carry = (skepu_tid > 0) ? skepu_sdata[skepu_tid - 1] : skepu_runValue;
+				skepu_output[skepu_firstKey] = {{FUNCTION_NAME_REDUCE}}(skepu_carry, skepu_tile_heads[skepu_tile]);
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (skepu_tid == skepu_count - 1)
+		{
+			skepu_runValue = skepu_sdata[skepu_tid];
+			skepu_runKey = skepu_keys[skepu_tid];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+)~~~";
+
+
+const std::string Constructor = R"~~~(
+class {{KERNEL_CLASS}}
+{
+public:
+
+	enum
+	{
+		KERNEL_SEGMENT_TILES = 0,
+		KERNEL_SEGMENT_CARRIES,
+		KERNEL_COUNT
+	};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
+	{
+		if (newkernel)
+		{
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
+			return nullptr;
+		}
+		else return skepu_kernel_table().get(deviceID, kerneltype);
+	}
+
+	static const std::string &skepu_source()
+	{
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_tiles = clCreateKernel(program, "{{KERNEL_NAME}}_SegmentTiles", &err);
+		CL_CHECK_ERROR(err, "Error creating ReduceByKey tile kernel '{{KERNEL_NAME}}'");
+
+		cl_kernel kernel_carries = clCreateKernel(program, "{{KERNEL_NAME}}_SegmentCarries", &err);
+		CL_CHECK_ERROR(err, "Error creating ReduceByKey carry kernel '{{KERNEL_NAME}}'");
+
+		kernels(deviceID, KERNEL_SEGMENT_TILES,   &kernel_tiles);
+		kernels(deviceID, KERNEL_SEGMENT_CARRIES, &kernel_carries);
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
+	}
+
+	static void segmentTiles
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<size_t> *skepu_offsets,
+		skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_output,
+		skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_tile_heads, skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_tile_tails,
+		skepu::backend::DeviceMemPointer_CL<size_t> *skepu_tile_keys, size_t skepu_n, size_t skepu_numSegments
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_SEGMENT_TILES);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_offsets->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(),
+			skepu_tile_heads->getDeviceDataPointer(), skepu_tile_tails->getDeviceDataPointer(), skepu_tile_keys->getDeviceDataPointer(), skepu_n, skepu_numSegments);
+		clSetKernelArg(kernel, 8, sizeof({{REDUCE_RESULT_TYPE}}) * localSize, NULL);
+		clSetKernelArg(kernel, 9, sizeof(size_t) * localSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching ReduceByKey tile kernel");
+	}
+
+	// Launched as a single work-group, skepu_tileSize is the local size of the tile kernel
+	static void segmentCarries
+	(
+		size_t deviceID, size_t localSize,
+		skepu::backend::DeviceMemPointer_CL<size_t> *skepu_offsets, skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_output,
+		skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_tile_heads, skepu::backend::DeviceMemPointer_CL<{{REDUCE_RESULT_TYPE}}> *skepu_tile_tails,
+		skepu::backend::DeviceMemPointer_CL<size_t> *skepu_tile_keys, size_t skepu_n, size_t skepu_tileSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_SEGMENT_CARRIES);
+		skepu_cl_set_kernel_args(kernel, skepu_offsets->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(),
+			skepu_tile_heads->getDeviceDataPointer(), skepu_tile_tails->getDeviceDataPointer(), skepu_tile_keys->getDeviceDataPointer(), skepu_n, skepu_tileSize);
+		clSetKernelArg(kernel, 7, sizeof({{REDUCE_RESULT_TYPE}}) * localSize, NULL);
+		clSetKernelArg(kernel, 8, sizeof(size_t) * localSize, NULL);
+		size_t globalSize = localSize;
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching ReduceByKey carry kernel");
+	}
+};
+)~~~";
+
+
+std::string createReduceByKeyKernelProgram_CL(SkeletonInstance &instance, UserFunction &reduceFunc, std::string dir)
+{
+	std::stringstream sourceStream;
+
+	sourceStream << precisionExtensions_CL({&reduceFunc});
+
+	// Include user constants as preprocessor macros
+	for (auto pair : UserConstants)
+		sourceStream << "#define " << pair.second->name << " (" << pair.second->definition << ") // " << pair.second->typeName << "\n";
+
+	for (UserType *RefType : reduceFunc.ReferencedUTs)
+		sourceStream << generateUserTypeCode_CL(*RefType);
+
+	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(reduceFunc) << SegmentHelpers_CL << SegmentTiles_CL << SegmentCarries_CL;
+
+	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_ReduceByKeyKernel_" + reduceFunc.uniqueName;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
+	{
+		{"{{OPENCL_KERNEL}}",        sourceStream.str()},
+		{"{{KERNEL_CLASS}}",         "CLWrapperClass_" + kernelName},
+		{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
+		{"{{KERNEL_NAME}}",          kernelName},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.uniqueName}
+	}), dir);
+}
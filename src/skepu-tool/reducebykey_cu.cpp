@@ -0,0 +1,177 @@
+#include "code_gen.h"
+#include "code_gen_cu.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  Segmented reduction of skepu_input by the CSR-style skepu_offsets (numSegments + 1 entries, offsets[0] = 0,
+ *  offsets[numSegments] = n). Work is split into tiles of blockDim.x elements regardless of where the segments
+ *  start, so very long and very short segments are balanced alike. Each tile runs a segmented scan keyed by the
+ *  segment index of every element and writes the segments it both starts and ends. A segment continued from an
+ *  earlier tile leaves the tile's partial of it in skepu_tile_heads, and the open segment at the tile end leaves
+ *  its partial in skepu_tile_tails; the _SegmentCarries kernel combines those. Empty segments are not written.
+ *
+ *  skepu_tile_keys holds the first and last segment index of each tile.
+ *  Dynamic shared memory: blockDim.x * sizeof(type). blockDim.x is at most 1024.
+ */
+const std::string SegmentHelpers_CU = R"~~~(
+__device__ size_t {{KERNEL_NAME}}_segmentOf(const size_t *skepu_offsets, size_t skepu_numSegments, size_t skepu_i)
+{
+	// Largest s with offsets[s] <= i, which skips the empty segments ending at i
+	size_t skepu_lo = 0, skepu_hi = skepu_numSegments;
+	while (skepu_lo + 1 < skepu_hi)
+	{
+		size_t skepu_mid = (skepu_lo + skepu_hi) / 2;
+		if (skepu_offsets[skepu_mid] <= skepu_i)
+			skepu_lo = skepu_mid;
+		else
+			skepu_hi = skepu_mid;
+	}
+	return skepu_lo;
+}
+
+// Inclusive scan combining neighbours with equal keys, the keys are sorted so runs are contiguous
+__device__ void {{KERNEL_NAME}}_segmentedScan({{REDUCE_RESULT_TYPE}} *skepu_vals, size_t *skepu_keys, size_t skepu_tid, size_t skepu_count)
+{
+	for (size_t skepu_offset = 1; skepu_offset < blockDim.x; skepu_offset *= 2)
+	{
+		bool skepu_take = skepu_tid < skepu_count && skepu_tid >= skepu_offset && skepu_keys[skepu_tid - skepu_offset] == skepu_keys[skepu_tid];
+		{{REDUCE_RESULT_TYPE}} skepu_prev;
+		if (skepu_take)
+			skepu_prev = skepu_vals[skepu_tid - skepu_offset];
+		__syncthreads();
+		if (skepu_take)
+			skepu_vals[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_prev, skepu_vals[skepu_tid]);
+		__syncthreads();
+	}
+}
+)~~~";
+
+const std::string SegmentTiles_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_SegmentTiles({{REDUCE_RESULT_TYPE}} *skepu_input, const size_t *skepu_offsets, {{REDUCE_RESULT_TYPE}} *skepu_output,
+	{{REDUCE_RESULT_TYPE}} *skepu_tile_heads, {{REDUCE_RESULT_TYPE}} *skepu_tile_tails, size_t *skepu_tile_keys, size_t skepu_n, size_t skepu_numSegments)
+{
+	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
+	__shared__ size_t skepu_keys[1024];
+
+	size_t skepu_tid = threadIdx.x;
+	size_t skepu_numTiles = (skepu_n + blockDim.x - 1) / blockDim.x;
+
+	for (size_t skepu_tile = blockIdx.x; skepu_tile < skepu_numTiles; skepu_tile += gridDim.x)
+	{
+		size_t skepu_tileStart = skepu_tile * blockDim.x;
+		size_t skepu_count = min((size_t)blockDim.x, skepu_n - skepu_tileStart);
+		size_t skepu_i = skepu_tileStart + skepu_tid;
+		bool skepu_valid = skepu_tid < skepu_count;
+
+		if (skepu_valid)
+		{
+			{{SHARED_BUFFER}}[skepu_tid] = skepu_input[skepu_i];
+			skepu_keys[skepu_tid] = {{KERNEL_NAME}}_segmentOf(skepu_offsets, skepu_numSegments, skepu_i);
+		}
+		__syncthreads();
+
+		{{KERNEL_NAME}}_segmentedScan({{SHARED_BUFFER}}, skepu_keys, skepu_tid, skepu_count);
+
+		size_t skepu_firstKey = skepu_keys[0];
+		bool skepu_continued = skepu_offsets[skepu_firstKey] < skepu_tileStart;
+
+		// The element ending a segment holds the tile's reduction of it
+		if (skepu_valid && skepu_offsets[skepu_keys[skepu_tid] + 1] == skepu_i + 1)
+		{
+			if (skepu_continued && skepu_keys[skepu_tid] == skepu_firstKey)
+				skepu_tile_heads[skepu_tile] = {{SHARED_BUFFER}}[skepu_tid];
+			else
+				skepu_output[skepu_keys[skepu_tid]] = {{SHARED_BUFFER}}[skepu_tid];
+		}
+
+		if (skepu_tid == skepu_count - 1)
+		{
+			skepu_tile_tails[skepu_tile] = {{SHARED_BUFFER}}[skepu_tid];
+			skepu_tile_keys[2 * skepu_tile] = skepu_firstKey;
+			skepu_tile_keys[2 * skepu_tile + 1] = skepu_keys[skepu_tid];
+		}
+		__syncthreads();
+	}
+}
+)~~~";
+
+/*!
+ *  One block resolves the segments crossing tile boundaries. The tile tails are scanned by segment in chunks of
+ *  blockDim.x, carrying the open run from chunk to chunk, which gives the incoming partial of every tile. The
+ *  cost is proportional to the number of tiles, independent of how the segment lengths are distributed.
+ */
+const std::string SegmentCarries_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_SegmentCarries(const size_t *skepu_offsets, {{REDUCE_RESULT_TYPE}} *skepu_output,
+	{{REDUCE_RESULT_TYPE}} *skepu_tile_heads, {{REDUCE_RESULT_TYPE}} *skepu_tile_tails, size_t *skepu_tile_keys, size_t skepu_n, size_t skepu_tileSize)
+{
+	extern __shared__ {{REDUCE_RESULT_TYPE}} {{SHARED_BUFFER}}[];
+	__shared__ size_t skepu_keys[1024];
+	__shared__ {{REDUCE_RESULT_TYPE}} skepu_runValue;
+	__shared__ size_t skepu_runKey;
+
+	size_t skepu_tid = threadIdx.x;
+	size_t skepu_numTiles = (skepu_n + skepu_tileSize - 1) / skepu_tileSize;
+
+	for (size_t skepu_base = 0; skepu_base < skepu_numTiles; skepu_base += blockDim.x)
+	{
+		size_t skepu_count = min((size_t)blockDim.x, skepu_numTiles - skepu_base);
+		size_t skepu_tile = skepu_base + skepu_tid;
+		bool skepu_valid = skepu_tid < skepu_count;
+
+		if (skepu_valid)
+		{
+			{{SHARED_BUFFER}}[skepu_tid] = skepu_tile_tails[skepu_tile];
+			skepu_keys[skepu_tid] = skepu_tile_keys[2 * skepu_tile + 1];
+		}
+		__syncthreads();
+
+		{{KERNEL_NAME}}_segmentedScan({{SHARED_BUFFER}}, skepu_keys, skepu_tid, skepu_count);
+
+		// Runs reaching back to the chunk start continue the run carried from the previous chunk
+		if (skepu_valid && skepu_base > 0 && skepu_keys[skepu_tid] == skepu_runKey)
+			{{SHARED_BUFFER}}[skepu_tid] = {{FUNCTION_NAME_REDUCE}}(skepu_runValue, {{SHARED_BUFFER}}[skepu_tid]);
+		__syncthreads();
+
+		// A continued segment ending in this tile is completed by the partial carried in from the tile before
+		if (skepu_valid && skepu_tile > 0)
+		{
+			size_t skepu_firstKey = skepu_tile_keys[2 * skepu_tile];
+			size_t skepu_tileStart = skepu_tile * skepu_tileSize;
+			size_t skepu_end = skepu_offsets[skepu_firstKey + 1];
+			if (skepu_offsets[skepu_firstKey] < skepu_tileStart && skepu_end <= skepu_tileStart + skepu_tileSize)
+			{
+				{{REDUCE_RESULT_TYPE}} skepu_carry = (skepu_tid > 0) ? {{SHARED_BUFFER}}[skepu_tid - 1] : skepu_runValue;
+				skepu_output[skepu_firstKey] = {{FUNCTION_NAME_REDUCE}}(skepu_carry, skepu_tile_heads[skepu_tile]);
+			}
+		}
+		__syncthreads();
+
+		if (skepu_tid == skepu_count - 1)
+		{
+			skepu_runValue = {{SHARED_BUFFER}}[skepu_tid];
+			skepu_runKey = skepu_keys[skepu_tid];
+		}
+		__syncthreads();
+	}
+}
+)~~~";
+
+
+std::string createReduceByKeyKernelProgram_CU(SkeletonInstance &instance, UserFunction &reduceFunc, std::string dir)
+{
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_ReduceByKeyKernel_" + reduceFunc.uniqueName;
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(SegmentHelpers_CU + SegmentTiles_CU + SegmentCarries_CU,
+	{
+		{"{{REDUCE_RESULT_TYPE}}",   reduceFunc.resolvedReturnTypeName},
+		{"{{KERNEL_NAME}}",          kernelName},
+		{"{{FUNCTION_NAME_REDUCE}}", reduceFunc.funcNameCUDA()},
+		{"{{SHARED_BUFFER}}",        "sdata_" + instance}
+	});
+	return kernelName;
+}
@@ -0,0 +1,88 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Fused stencil and residual for instances listed in -mapoverlap-reduce as step=residual, a MapOverlap2D instance and
+ * a MapReduce instance mapping two elementwise arguments. mapOverlapReduce(res, arg, args...) runs the stencil of the
+ * instance from arg into res and returns the reduction of the residual map over the elements of res and arg, such as
+ * the largest change of an iterative solver, without the second sweep over both matrices.
+ *
+ * The CUDA kernel of the instance is generated with a fused variant that maps and reduces each output in the launch
+ * computing it, and a _ReduceOnly kernel for its per-block partials; backends providing mapOverlapReduce launch those.
+ * Otherwise the call runs the stencil and reduces on the host. The start value of the residual instance is not used,
+ * the reduction of an empty matrix is the value-initialized result.
+ */
+static const char *ResidualSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace skepu
+{
+	namespace residual
+	{
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF>
+		class MapOverlapReduce: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename R, typename U, typename... Args>
+			typename ReduceUF::Ret mapOverlapReduce(Matrix<R> &res, Matrix<U> &arg, Args&&... args)
+			{
+				return this->fused(0, res, arg, std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto fused(int, Args&&... args) -> decltype(std::declval<Skeleton&>().Skeleton::mapOverlapReduce(std::forward<Args>(args)...))
+			{
+				return Skeleton::mapOverlapReduce(std::forward<Args>(args)...);
+			}
+
+			template<typename R, typename U, typename... Args>
+			typename ReduceUF::Ret fused(long, Matrix<R> &res, Matrix<U> &arg, Args&&... args)
+			{
+				Skeleton::operator()(res, arg, std::forward<Args>(args)...);
+				updateHost(res, 0);
+				updateHost(arg, 0);
+
+				const R *out = res.getAddress();
+				const U *in = arg.getAddress();
+				const size_t n = res.size();
+				if (n == 0)
+					return typename ReduceUF::Ret{};
+
+				typename ReduceUF::Ret result = MapUF::CPU(out[0], in[0]);
+				for (size_t i = 1; i < n; ++i)
+					result = ReduceUF::CPU(result, MapUF::CPU(out[i], in[i]));
+				return result;
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateResidualSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_residual.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << ResidualSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -7,6 +7,53 @@ using namespace clang;
 // Kernel templates
 // ------------------------------
 
+/*!
+ *  Work-efficient block scans. _Scan scans each tile of skepu_n elements with the Brent-Kung up-sweep and
+ *  down-sweep, 2n applications of the scan function instead of n log2(n), in local memory padded by one slot
+ *  every 32 elements so the strided steps of the sweeps do not conflict on the banks.
+ *
+ *  _ScanReduce and _ScanDownsweep are the reduce-then-scan pair: each work-group reduces its contiguous range of
+ *  whole tiles to one partial, then scans the range again with the partials of the preceding groups as its
+ *  offset, applying init and the inclusive/exclusive mode. The input is read twice and the output written once,
+ *  with no update pass; the number of work-groups must be at most the work-group size, and both launches need the
+ *  same number of them and skepu_n + skepu_n / 32 elements of local memory.
+ */
+const std::string ScanBlockHelpers_CL = R"~~~(
+#define SKEPU_SCAN_CF(i) ((i) + ((i) >> 5))
+
+// Inclusive scan of the first count elements of a, in place
+void {{KERNEL_NAME}}_ScanBlock(__local {{SCAN_TYPE}}* a, size_t tid, size_t count)
+{
+	size_t stride;
+	for (stride = 1; stride < count; stride *= 2)
+	{
+		size_t index = (tid + 1) * stride * 2 - 1;
+		if (index < count)
+			a[SKEPU_SCAN_CF(index)] = {{FUNCTION_NAME_SCAN}}(a[SKEPU_SCAN_CF(index - stride)], a[SKEPU_SCAN_CF(index)]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	for (stride /= 2; stride > 0; stride /= 2)
+	{
+		size_t index = (tid + 1) * stride * 2 - 1;
+		if (index + stride < count)
+			a[SKEPU_SCAN_CF(index + stride)] = {{FUNCTION_NAME_SCAN}}(a[SKEPU_SCAN_CF(index)], a[SKEPU_SCAN_CF(index + stride)]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+// Ordered tree reduction of the first count elements of a into a[0]
+void {{KERNEL_NAME}}_ScanBlockReduce(__local {{SCAN_TYPE}}* a, size_t tid, size_t count)
+{
+	for (size_t stride = 1; stride < count; stride *= 2)
+	{
+		if (tid % (2 * stride) == 0 && tid + stride < count)
+			a[SKEPU_SCAN_CF(tid)] = {{FUNCTION_NAME_SCAN}}(a[SKEPU_SCAN_CF(tid)], a[SKEPU_SCAN_CF(tid + stride)]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+)~~~";
+
 const std::string ScanKernel_CL = R"~~~(
 __kernel void {{KERNEL_NAME}}_Scan(__global {{SCAN_TYPE}}* skepu_input, __global {{SCAN_TYPE}}* skepu_output, __global {{SCAN_TYPE}}* blockSums, size_t skepu_n, size_t skepu_numElements, __local {{SCAN_TYPE}}* skepu_sdata)
 {
@@ -14,38 +61,118 @@ __kernel void {{KERNEL_NAME}}_Scan(__global {{SCAN_TYPE}}* skepu_input, __global
 	const size_t blockDim = get_local_size(0);
 	const size_t blockIdx = get_group_id(0);
 	const size_t gridDim = get_num_groups(0);
-	unsigned int pout = 0;
-	unsigned int pin = 1;
 	size_t mem = get_global_id(0);
 	size_t gridSize = blockDim * gridDim;
 	size_t numBlocks = skepu_numElements / blockDim + (skepu_numElements % blockDim == 0 ? 0:1);
 
 	for (size_t blockNr = blockIdx; blockNr < numBlocks; blockNr += gridDim)
 	{
-		skepu_sdata[pout * skepu_n + threadIdx] = (mem < skepu_numElements) ? skepu_input[mem] : 0;
+		skepu_sdata[SKEPU_SCAN_CF(threadIdx)] = (mem < skepu_numElements) ? skepu_input[mem] : 0;
 		barrier(CLK_LOCAL_MEM_FENCE);
 
-		for (size_t skepu_offset = 1; skepu_offset < skepu_n; skepu_offset *=2)
-		{
-			pout = 1 - pout;
-			pin = 1- pout;
-			if (threadIdx >= skepu_offset)
-				skepu_sdata[pout * skepu_n + threadIdx] = {{FUNCTION_NAME_SCAN}}(skepu_sdata[pin * skepu_n + threadIdx], skepu_sdata[pin * skepu_n + threadIdx - skepu_offset]);
-			else
-				skepu_sdata[pout * skepu_n + threadIdx] = skepu_sdata[pin * skepu_n + threadIdx];
-			barrier(CLK_LOCAL_MEM_FENCE);
-		}
+		{{KERNEL_NAME}}_ScanBlock(skepu_sdata, threadIdx, skepu_n);
 
 		if (threadIdx == blockDim - 1)
-			blockSums[blockNr] = skepu_sdata[pout * skepu_n + blockDim - 1];
+			blockSums[blockNr] = skepu_sdata[SKEPU_SCAN_CF(blockDim - 1)];
 
 		if (mem < skepu_numElements)
-			skepu_output[mem] = skepu_sdata[pout * skepu_n + threadIdx];
+			skepu_output[mem] = skepu_sdata[SKEPU_SCAN_CF(threadIdx)];
 		mem += gridSize;
 
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
 }
+
+__kernel void {{KERNEL_NAME}}_ScanReduce(__global {{SCAN_TYPE}}* skepu_input, __global {{SCAN_TYPE}}* skepu_partials, size_t skepu_n, __local {{SCAN_TYPE}}* skepu_sdata)
+{
+	__local {{SCAN_TYPE}} skepu_carry;
+	const size_t threadIdx = get_local_id(0);
+	const size_t blockDim = get_local_size(0);
+	const size_t blockIdx = get_group_id(0);
+	const size_t gridDim = get_num_groups(0);
+	size_t tiles = (skepu_n + blockDim - 1) / blockDim;
+	size_t first = blockIdx * ((tiles + gridDim - 1) / gridDim) * blockDim;
+	size_t last = min(skepu_n, first + ((tiles + gridDim - 1) / gridDim) * blockDim);
+
+	for (size_t base = first; base < last; base += blockDim)
+	{
+		size_t count = min(blockDim, last - base);
+		if (threadIdx < count)
+			skepu_sdata[SKEPU_SCAN_CF(threadIdx)] = skepu_input[base + threadIdx];
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		{{KERNEL_NAME}}_ScanBlockReduce(skepu_sdata, threadIdx, count);
+
+		if (threadIdx == 0)
+			skepu_carry = (base > first) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[0]) : skepu_sdata[0];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (threadIdx == 0 && first < last)
+		skepu_partials[blockIdx] = skepu_carry;
+}
+
+__kernel void {{KERNEL_NAME}}_ScanDownsweep(__global {{SCAN_TYPE}}* skepu_input, __global {{SCAN_TYPE}}* skepu_output, __global {{SCAN_TYPE}}* skepu_partials,
+	int isInclusive, {{SCAN_TYPE}} init, size_t skepu_n, __global {{SCAN_TYPE}}* ret, __local {{SCAN_TYPE}}* skepu_sdata)
+{
+	__local {{SCAN_TYPE}} skepu_carry;
+	__local int skepu_hasCarry;
+	const size_t threadIdx = get_local_id(0);
+	const size_t blockDim = get_local_size(0);
+	const size_t blockIdx = get_group_id(0);
+	const size_t gridDim = get_num_groups(0);
+	size_t tiles = (skepu_n + blockDim - 1) / blockDim;
+	size_t first = blockIdx * ((tiles + gridDim - 1) / gridDim) * blockDim;
+	size_t last = min(skepu_n, first + ((tiles + gridDim - 1) / gridDim) * blockDim);
+
+	// The partials of the preceding groups, combined in order
+	if (threadIdx == 0)
+	{
+		skepu_hasCarry = blockIdx > 0 && first < last;
+		if (skepu_hasCarry)
+		{
+			skepu_carry = skepu_partials[0];
+			for (size_t g = 1; g < blockIdx; ++g)
+				skepu_carry = {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_partials[g]);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t base = first; base < last; base += blockDim)
+	{
+		size_t count = min(blockDim, last - base);
+		bool valid = threadIdx < count;
+		if (valid)
+			skepu_sdata[SKEPU_SCAN_CF(threadIdx)] = skepu_input[base + threadIdx];
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		{{KERNEL_NAME}}_ScanBlock(skepu_sdata, threadIdx, count);
+
+		if (valid)
+		{
+			{{SCAN_TYPE}} inclusive = skepu_hasCarry ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[SKEPU_SCAN_CF(threadIdx)]) : skepu_sdata[SKEPU_SCAN_CF(threadIdx)];
+			{{SCAN_TYPE}} res;
+			if (isInclusive == 1)
+				res = inclusive;
+			else if (threadIdx > 0)
+				res = {{FUNCTION_NAME_SCAN}}(init, skepu_hasCarry ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[SKEPU_SCAN_CF(threadIdx - 1)]) : skepu_sdata[SKEPU_SCAN_CF(threadIdx - 1)]);
+			else
+				res = skepu_hasCarry ? {{FUNCTION_NAME_SCAN}}(init, skepu_carry) : init;
+			skepu_output[base + threadIdx] = res;
+
+			if (base + threadIdx == skepu_n - 1 && ret != 0)
+				*ret = inclusive;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (threadIdx == count - 1)
+		{
+			skepu_carry = skepu_hasCarry ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[SKEPU_SCAN_CF(threadIdx)]) : skepu_sdata[SKEPU_SCAN_CF(threadIdx)];
+			skepu_hasCarry = 1;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
 )~~~";
 
 const std::string ScanUpdate_CL = R"~~~(
@@ -130,6 +257,124 @@ __kernel void {{KERNEL_NAME}}_ScanAdd(__global {{SCAN_TYPE}}* data, {{SCAN_TYPE}
 )~~~";
 
 
+// Row-wise and column-wise matrix scans for -scan-matrix instances, as the CUDA kernels; the row scan works in
+// tiles of the work-group size in local memory
+const std::string ScanMatrix_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_ScanRowWise(__global {{SCAN_TYPE}}* skepu_input, __global {{SCAN_TYPE}}* skepu_output, int isInclusive, {{SCAN_TYPE}} init, size_t skepu_rows, size_t skepu_cols, __local {{SCAN_TYPE}}* skepu_sdata)
+{
+	__local {{SCAN_TYPE}} skepu_carry;
+	const size_t threadIdx = get_local_id(0);
+	const size_t blockDim = get_local_size(0);
+	const size_t blockIdx = get_group_id(0);
+	const size_t gridDim = get_num_groups(0);
+
+	for (size_t row = blockIdx; row < skepu_rows; row += gridDim)
+	{
+		__global {{SCAN_TYPE}}* in = skepu_input + row * skepu_cols;
+		__global {{SCAN_TYPE}}* out = skepu_output + row * skepu_cols;
+
+		for (size_t base = 0; base < skepu_cols; base += blockDim)
+		{
+			size_t validCount = min(blockDim, skepu_cols - base);
+			bool valid = threadIdx < validCount;
+			if (valid)
+				skepu_sdata[threadIdx] = in[base + threadIdx];
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			for (size_t skepu_offset = 1; skepu_offset < validCount; skepu_offset *= 2)
+			{
+				bool take = valid && threadIdx >= skepu_offset;
+				{{SCAN_TYPE}} prev;
+				if (take)
+					prev = skepu_sdata[threadIdx - skepu_offset];
+				barrier(CLK_LOCAL_MEM_FENCE);
+				if (take)
+					skepu_sdata[threadIdx] = {{FUNCTION_NAME_SCAN}}(prev, skepu_sdata[threadIdx]);
+				barrier(CLK_LOCAL_MEM_FENCE);
+			}
+
+			if (valid)
+			{
+				{{SCAN_TYPE}} res;
+				if (isInclusive == 1)
+					res = (base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[threadIdx]) : skepu_sdata[threadIdx];
+				else if (threadIdx > 0)
+					res = {{FUNCTION_NAME_SCAN}}(init, (base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[threadIdx - 1]) : skepu_sdata[threadIdx - 1]);
+				else
+					res = (base > 0) ? {{FUNCTION_NAME_SCAN}}(init, skepu_carry) : init;
+				out[base + threadIdx] = res;
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			if (threadIdx == validCount - 1)
+				skepu_carry = (base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[threadIdx]) : skepu_sdata[threadIdx];
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+	}
+}
+
+__kernel void {{KERNEL_NAME}}_ScanColWise(__global {{SCAN_TYPE}}* skepu_input, __global {{SCAN_TYPE}}* skepu_output, int isInclusive, {{SCAN_TYPE}} init, size_t skepu_rows, size_t skepu_cols)
+{
+	size_t gridSize = get_local_size(0) * get_num_groups(0);
+
+	for (size_t col = get_global_id(0); col < skepu_cols && skepu_rows > 0; col += gridSize)
+	{
+		{{SCAN_TYPE}} acc = skepu_input[col];
+		skepu_output[col] = (isInclusive == 1) ? acc : init;
+
+		for (size_t row = 1; row < skepu_rows; ++row)
+		{
+			size_t mem = row * skepu_cols + col;
+			{{SCAN_TYPE}} value = skepu_input[mem];
+			if (isInclusive == 1)
+			{
+				acc = {{FUNCTION_NAME_SCAN}}(acc, value);
+				skepu_output[mem] = acc;
+			}
+			else
+			{
+				skepu_output[mem] = {{FUNCTION_NAME_SCAN}}(init, acc);
+				acc = {{FUNCTION_NAME_SCAN}}(acc, value);
+			}
+		}
+	}
+}
+)~~~";
+
+const std::string ScanMatrixKernelIds_CL = R"~~~(
+		KERNEL_SCAN_ROW_WISE,
+		KERNEL_SCAN_COL_WISE,)~~~";
+
+const std::string ScanMatrixBuild_CL = R"~~~(
+
+		cl_kernel kernel_scan_row_wise = clCreateKernel(program, "{{KERNEL_NAME}}_ScanRowWise", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan row-wise kernel '{{KERNEL_NAME}}'");
+
+		cl_kernel kernel_scan_col_wise = clCreateKernel(program, "{{KERNEL_NAME}}_ScanColWise", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan column-wise kernel '{{KERNEL_NAME}}'");
+
+		kernels(deviceID, KERNEL_SCAN_ROW_WISE, &kernel_scan_row_wise);
+		kernels(deviceID, KERNEL_SCAN_COL_WISE, &kernel_scan_col_wise);)~~~";
+
+const std::string ScanMatrixLaunch_CL = R"~~~(
+
+	static void scanMatrix
+	(
+		size_t deviceID, size_t localSize, size_t globalSize, bool rowWise,
+		skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *skepu_output,
+		int isInclusive, {{SCAN_TYPE}} init, size_t skepu_rows, size_t skepu_cols, size_t sharedMemSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, rowWise ? KERNEL_SCAN_ROW_WISE : KERNEL_SCAN_COL_WISE);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), isInclusive, init, skepu_rows, skepu_cols);
+		if (rowWise)
+			clSetKernelArg(kernel, 6, sharedMemSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Scan matrix kernel");
+	}
+)~~~";
+
+
 const std::string Constructor = R"~~~(
 class {{KERNEL_CLASS}}
 {
@@ -140,50 +385,71 @@ public:
 		KERNEL_SCAN = 0,
 		KERNEL_SCAN_UPDATE,
 		KERNEL_SCAN_ADD,
+		KERNEL_SCAN_REDUCE,
+		KERNEL_SCAN_DOWNSWEEP,{{MATRIX_KERNEL_IDS}}
 		KERNEL_COUNT
 	};
 
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
 	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
 	{
-		static cl_kernel arr[8][KERNEL_COUNT]; // Hard-coded maximum
 		if (newkernel)
 		{
-			arr[deviceID][kerneltype] = *newkernel;
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
 			return nullptr;
 		}
-		else return arr[deviceID][kerneltype];
+		else return skepu_kernel_table().get(deviceID, kerneltype);
 	}
 
-	static void initialize()
+	static const std::string &skepu_source()
 	{
-		static bool initialized = false;
-		if (initialized)
-			return;
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
 
-		std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_scan = clCreateKernel(program, "{{KERNEL_NAME}}_Scan", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan kernel '{{KERNEL_NAME}}'");
 
-		// Builds the code and creates kernel for all devices
-		size_t counter = 0;
-		for (skepu::backend::Device_CL *device : skepu::backend::Environment<int>::getInstance()->m_devices_CL)
-		{
-			cl_int err;
-			cl_program program = skepu::backend::cl_helpers::buildProgram(device, source);
-			cl_kernel kernel_scan = clCreateKernel(program, "{{KERNEL_NAME}}_Scan", &err);
-			CL_CHECK_ERROR(err, "Error creating Scan kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_scan_update = clCreateKernel(program, "{{KERNEL_NAME}}_ScanUpdate", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan update kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel kernel_scan_update = clCreateKernel(program, "{{KERNEL_NAME}}_ScanUpdate", &err);
-			CL_CHECK_ERROR(err, "Error creating Scan update kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_scan_add = clCreateKernel(program, "{{KERNEL_NAME}}_ScanAdd", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan add kernel '{{KERNEL_NAME}}'");
 
-			cl_kernel kernel_scan_add = clCreateKernel(program, "{{KERNEL_NAME}}_ScanAdd", &err);
-			CL_CHECK_ERROR(err, "Error creating Scan add kernel '{{KERNEL_NAME}}'");
+		cl_kernel kernel_scan_reduce = clCreateKernel(program, "{{KERNEL_NAME}}_ScanReduce", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan reduce kernel '{{KERNEL_NAME}}'");
 
-			kernels(counter, KERNEL_SCAN,        &kernel_scan);
-			kernels(counter, KERNEL_SCAN_UPDATE, &kernel_scan_update);
-			kernels(counter, KERNEL_SCAN_ADD,    &kernel_scan_add);
-			counter++;
-		}
+		cl_kernel kernel_scan_downsweep = clCreateKernel(program, "{{KERNEL_NAME}}_ScanDownsweep", &err);
+		CL_CHECK_ERROR(err, "Error creating Scan downsweep kernel '{{KERNEL_NAME}}'");
 
-		initialized = true;
+		kernels(deviceID, KERNEL_SCAN,           &kernel_scan);
+		kernels(deviceID, KERNEL_SCAN_UPDATE,    &kernel_scan_update);
+		kernels(deviceID, KERNEL_SCAN_ADD,       &kernel_scan_add);
+		kernels(deviceID, KERNEL_SCAN_REDUCE,    &kernel_scan_reduce);
+		kernels(deviceID, KERNEL_SCAN_DOWNSWEEP, &kernel_scan_downsweep);{{MATRIX_KERNEL_BUILD}}
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
 	}
 
 	static void scan
@@ -194,9 +460,9 @@ public:
 	)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_SCAN);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), blockSums->getDeviceDataPointer(), skepu_n, skepu_numElements);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), blockSums->getDeviceDataPointer(), skepu_n, skepu_numElements);
 		clSetKernelArg(kernel, 5, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching Scan kernel");
 	}
 
@@ -211,9 +477,9 @@ public:
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_SCAN_UPDATE);
 		cl_mem retCL = (ret != nullptr) ? ret->getDeviceDataPointer() : NULL;
-		skepu::backend::cl_helpers::setKernelArgs(kernel, data->getDeviceDataPointer(), sums->getDeviceDataPointer(), isInclusive, init, skepu_n, retCL);
+		skepu_cl_set_kernel_args(kernel, data->getDeviceDataPointer(), sums->getDeviceDataPointer(), isInclusive, init, skepu_n, retCL);
 		clSetKernelArg(kernel, 6, sharedMemSize, NULL);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching Scan update kernel");
 	}
 
@@ -225,20 +491,52 @@ public:
 	)
 	{
 		cl_kernel kernel = kernels(deviceID, KERNEL_SCAN_ADD);
-		skepu::backend::cl_helpers::setKernelArgs(kernel, data->getDeviceDataPointer(), skepu_sum, skepu_n);
-		cl_int err = clEnqueueNDRangeKernel(skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID)->getQueue(), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+		skepu_cl_set_kernel_args(kernel, data->getDeviceDataPointer(), skepu_sum, skepu_n);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
 		CL_CHECK_ERROR(err, "Error launching Scan add kernel");
 	}
+
+	// Reduce-then-scan: scanReduce writes one partial per work-group, scanDownsweep scans with them; both launches
+	// take the same sizes, with at most localSize work-groups
+	static void scanReduce
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *partials,
+		size_t skepu_n, size_t sharedMemSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_SCAN_REDUCE);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), partials->getDeviceDataPointer(), skepu_n);
+		clSetKernelArg(kernel, 3, sharedMemSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Scan reduce kernel");
+	}
+
+	static void scanDownsweep
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *skepu_output,
+		skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *partials, int isInclusive, {{SCAN_TYPE}} init, size_t skepu_n,
+		skepu::backend::DeviceMemPointer_CL<{{SCAN_TYPE}}> *ret,
+		size_t sharedMemSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_SCAN_DOWNSWEEP);
+		cl_mem retCL = (ret != nullptr) ? ret->getDeviceDataPointer() : NULL;
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), partials->getDeviceDataPointer(), isInclusive, init, skepu_n, retCL);
+		clSetKernelArg(kernel, 7, sharedMemSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Scan downsweep kernel");
+	}{{MATRIX_KERNEL_LAUNCH}}
 };
 )~~~";
 
 
-std::string createScanKernelProgram_CL(SkeletonInstance &instance, UserFunction &scanFunc, std::string dir)
+std::string createScanKernelProgram_CL(SkeletonInstance &instance, UserFunction &scanFunc, std::string dir, bool matrix)
 {
 	std::stringstream sourceStream;
 
-	if (scanFunc.requiresDoublePrecision)
-		sourceStream << "#pragma OPENCL EXTENSION cl_khr_fp64: enable\n";
+	sourceStream << precisionExtensions_CL({&scanFunc});
 
 	// Include user constants as preprocessor macros
 	for (auto pair : UserConstants)
@@ -249,17 +547,28 @@ std::string createScanKernelProgram_CL(SkeletonInstance &instance, UserFunction
 	for (UserType *RefType : scanFunc.ReferencedUTs)
 		sourceStream << generateUserTypeCode_CL(*RefType);
 
-	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(scanFunc) << ScanKernel_CL << ScanUpdate_CL << ScanAdd_CL;
+	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(scanFunc) << ScanBlockHelpers_CL << ScanKernel_CL << ScanUpdate_CL << ScanAdd_CL << (matrix ? ScanMatrix_CL : "");
 
 	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_ScanKernel_" + scanFunc.uniqueName;
-	std::ofstream FSOutFile {dir + "/" + kernelName + "_cl_source.inl"};
-	FSOutFile << templateString(Constructor,
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
 	{
 		{"{{OPENCL_KERNEL}}", sourceStream.str()},
+		{"{{MATRIX_KERNEL_IDS}}",    matrix ? ScanMatrixKernelIds_CL : ""},
+		{"{{MATRIX_KERNEL_BUILD}}",  matrix ? ScanMatrixBuild_CL : ""},
+		{"{{MATRIX_KERNEL_LAUNCH}}", matrix ? ScanMatrixLaunch_CL : ""},
 		{"{{KERNEL_CLASS}}",  "CLWrapperClass_" + kernelName},
 		{"{{SCAN_TYPE}}",           scanFunc.resolvedReturnTypeName},
 		{"{{KERNEL_NAME}}",         kernelName},
 		{"{{FUNCTION_NAME_SCAN}}",  scanFunc.uniqueName}
+	}), dir);
+}
+
+std::string generateScanBlockHelpers_CL(const std::string &kernelName, const std::string &scanType, const std::string &scanFuncName)
+{
+	return templateString(ScanBlockHelpers_CL,
+	{
+		{"{{SCAN_TYPE}}",          scanType},
+		{"{{KERNEL_NAME}}",        kernelName},
+		{"{{FUNCTION_NAME_SCAN}}", scanFuncName}
 	});
-	return kernelName;
 }
@@ -1,4 +1,5 @@
 #include "code_gen.h"
+#include "code_gen_cu.h"
 
 using namespace clang;
 
@@ -134,11 +135,288 @@ __global__ void {{KERNEL_NAME}}_ScanAdd({{SCAN_TYPE}} *data, {{SCAN_TYPE}} sum,
 )~~~";
 
 
-std::string createScanKernelProgram_CU(SkeletonInstance &instance, UserFunction &scanFunc, std::string dir)
+/*!
+ *  Single-pass scan using chained tile prefixes (decoupled look-back). Tiles of blockDim.x elements are handed out
+ *  in order through an atomic counter, scanned in shared memory and published as an aggregate as soon as they are
+ *  done. The tile then walks backwards over its predecessors until it finds a published inclusive prefix. Every
+ *  element is read from and written to global memory exactly once, and the result includes skepu_init and the
+ *  inclusive/exclusive adjustment so no update pass is needed.
+ *
+ *  skepu_tile_flags must hold one entry per tile plus one (the tile counter) and be zeroed before each launch.
+ *  Dynamic shared memory: (blockDim.x + 32) * sizeof(type). blockDim.x must be a multiple of 32.
+ */
+const std::string ScanLookbackHelpers_CU = R"~~~(
+#define SKEPU_TILE_INVALID   0
+#define SKEPU_TILE_AGGREGATE 1
+#define SKEPU_TILE_PREFIX    2
+
+__device__ {{SCAN_TYPE}} {{KERNEL_NAME}}_ScanLookback_load({{SCAN_TYPE}} *skepu_ptr)
+{
+	{{SCAN_TYPE}} skepu_res;
+	volatile char *skepu_src = (volatile char*)skepu_ptr;
+	char *skepu_dst = (char*)&skepu_res;
+	for (size_t skepu_b = 0; skepu_b < sizeof({{SCAN_TYPE}}); ++skepu_b)
+		skepu_dst[skepu_b] = skepu_src[skepu_b];
+	return skepu_res;
+}
+
+__device__ void {{KERNEL_NAME}}_ScanLookback_warpScan({{SCAN_TYPE}} *skepu_sdata, size_t skepu_tid, size_t skepu_lane, bool skepu_valid)
 {
-	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_Scan_" + scanFunc.uniqueName;
-	std::ofstream FSOutFile {dir + "/" + kernelName + ".cu"};
-	FSOutFile << templateString(ScanKernel_CU + ScanUpdate_CU + ScanAdd_CU,
+	for (size_t skepu_offset = 1; skepu_offset < 32; skepu_offset *= 2)
+	{
+		bool skepu_take = skepu_valid && skepu_lane >= skepu_offset;
+		{{SCAN_TYPE}} skepu_prev;
+		if (skepu_take)
+			skepu_prev = skepu_sdata[skepu_tid - skepu_offset];
+		__syncwarp();
+		if (skepu_take)
+			skepu_sdata[skepu_tid] = {{FUNCTION_NAME_SCAN}}(skepu_prev, skepu_sdata[skepu_tid]);
+		__syncwarp();
+	}
+}
+)~~~";
+
+const std::string ScanLookback_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_ScanLookback({{SCAN_TYPE}} *skepu_input, {{SCAN_TYPE}} *skepu_output,
+	{{SCAN_TYPE}} *skepu_tile_aggregates, {{SCAN_TYPE}} *skepu_tile_prefixes, unsigned int *skepu_tile_flags,
+	int isInclusive, {{SCAN_TYPE}} skepu_init, size_t skepu_n, {{SCAN_TYPE}} *skepu_ret)
+{
+	extern __shared__ {{SCAN_TYPE}} skepu_sdata[];
+	{{SCAN_TYPE}} *skepu_warp_sums = skepu_sdata + blockDim.x;
+
+	__shared__ size_t skepu_tile;
+	__shared__ {{SCAN_TYPE}} skepu_tile_exclusive;
+
+	size_t skepu_tid = threadIdx.x;
+	size_t skepu_lane = skepu_tid % 32;
+	size_t skepu_warp = skepu_tid / 32;
+	size_t numTiles = skepu_n / blockDim.x + (skepu_n % blockDim.x == 0 ? 0 : 1);
+	unsigned int *skepu_tile_counter = skepu_tile_flags + numTiles;
+
+	while (true)
+	{
+		if (skepu_tid == 0)
+			skepu_tile = atomicAdd(skepu_tile_counter, 1);
+		__syncthreads();
+
+		size_t tile = skepu_tile;
+		if (tile >= numTiles)
+			return;
+
+		size_t skepu_mem = tile * blockDim.x + skepu_tid;
+		size_t skepu_validCount = min((size_t)blockDim.x, skepu_n - tile * blockDim.x);
+		size_t skepu_numWarps = (skepu_validCount + 31) / 32;
+		bool skepu_valid = skepu_tid < skepu_validCount;
+
+		// Tile-local inclusive scan: warps first, then the warp totals
+		if (skepu_valid)
+			skepu_sdata[skepu_tid] = skepu_input[skepu_mem];
+		__syncwarp();
+		{{KERNEL_NAME}}_ScanLookback_warpScan(skepu_sdata, skepu_tid, skepu_lane, skepu_valid);
+
+		if (skepu_valid && (skepu_lane == 31 || skepu_tid == skepu_validCount - 1))
+			skepu_warp_sums[skepu_warp] = skepu_sdata[skepu_tid];
+		__syncthreads();
+
+		if (skepu_warp == 0)
+			{{KERNEL_NAME}}_ScanLookback_warpScan(skepu_warp_sums, skepu_lane, skepu_lane, skepu_lane < skepu_numWarps);
+		__syncthreads();
+
+		if (skepu_valid && skepu_warp > 0)
+			skepu_sdata[skepu_tid] = {{FUNCTION_NAME_SCAN}}(skepu_warp_sums[skepu_warp - 1], skepu_sdata[skepu_tid]);
+
+		// Publish the tile and resolve its exclusive prefix from the predecessors
+		if (skepu_tid == 0)
+		{
+			{{SCAN_TYPE}} skepu_aggregate = skepu_warp_sums[skepu_numWarps - 1];
+			volatile unsigned int *skepu_flags = skepu_tile_flags;
+
+			if (tile == 0)
+			{
+				skepu_tile_prefixes[0] = skepu_aggregate;
+				__threadfence();
+				skepu_flags[0] = SKEPU_TILE_PREFIX;
+			}
+			else
+			{
+				skepu_tile_aggregates[tile] = skepu_aggregate;
+				__threadfence();
+				skepu_flags[tile] = SKEPU_TILE_AGGREGATE;
+
+				{{SCAN_TYPE}} skepu_exclusive;
+				bool skepu_first = true;
+				size_t skepu_pred = tile - 1;
+				while (true)
+				{
+					unsigned int skepu_status;
+					do skepu_status = skepu_flags[skepu_pred]; while (skepu_status == SKEPU_TILE_INVALID);
+					__threadfence();
+
+					{{SCAN_TYPE}} skepu_value = {{KERNEL_NAME}}_ScanLookback_load((skepu_status == SKEPU_TILE_PREFIX) ? &skepu_tile_prefixes[skepu_pred] : &skepu_tile_aggregates[skepu_pred]);
+					skepu_exclusive = skepu_first ? skepu_value : {{FUNCTION_NAME_SCAN}}(skepu_value, skepu_exclusive);
+					skepu_first = false;
+
+					if (skepu_status == SKEPU_TILE_PREFIX)
+						break;
+					--skepu_pred;
+				}
+
+				skepu_tile_prefixes[tile] = {{FUNCTION_NAME_SCAN}}(skepu_exclusive, skepu_aggregate);
+				__threadfence();
+				skepu_flags[tile] = SKEPU_TILE_PREFIX;
+				skepu_tile_exclusive = skepu_exclusive;
+			}
+		}
+		__syncthreads();
+
+		if (skepu_valid)
+		{
+			{{SCAN_TYPE}} skepu_res;
+			if (isInclusive == 1)
+			{
+				skepu_res = (tile > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_tile_exclusive, skepu_sdata[skepu_tid]) : skepu_sdata[skepu_tid];
+			}
+			else if (skepu_tid > 0)
+			{
+				skepu_res = (tile > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_tile_exclusive, skepu_sdata[skepu_tid - 1]) : skepu_sdata[skepu_tid - 1];
+				skepu_res = {{FUNCTION_NAME_SCAN}}(skepu_init, skepu_res);
+			}
+			else
+			{
+				skepu_res = (tile > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_init, skepu_tile_exclusive) : skepu_init;
+			}
+			skepu_output[skepu_mem] = skepu_res;
+
+			if (skepu_mem == skepu_n - 1)
+				*skepu_ret = (tile > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_tile_exclusive, skepu_sdata[skepu_tid]) : skepu_sdata[skepu_tid];
+		}
+		__syncthreads();
+	}
+}
+
+#undef SKEPU_TILE_INVALID
+#undef SKEPU_TILE_AGGREGATE
+#undef SKEPU_TILE_PREFIX
+)~~~";
+
+
+
+/*!
+ *  Matrix scans in one launch, for -scan-matrix instances. _ScanRowWise gives each block whole rows, which it scans
+ *  in tiles of blockDim.x elements with warp scans and carries the total of each tile into the next; blockDim.x must
+ *  be a multiple of 32 and the dynamic shared memory is (blockDim.x + 32) * sizeof(type). _ScanColWise gives each
+ *  thread a column and walks down the rows, so the reads and writes of a warp are coalesced along each row.
+ *  Both apply skepu_init and the inclusive/exclusive mode as the vector scans do, and may scan in place.
+ */
+const std::string ScanMatrix_CU = R"~~~(
+__device__ void {{KERNEL_NAME}}_ScanMatrix_warpScan({{SCAN_TYPE}} *skepu_sdata, size_t skepu_tid, size_t skepu_lane, bool skepu_valid)
+{
+	for (size_t skepu_offset = 1; skepu_offset < 32; skepu_offset *= 2)
+	{
+		bool skepu_take = skepu_valid && skepu_lane >= skepu_offset;
+		{{SCAN_TYPE}} skepu_prev;
+		if (skepu_take)
+			skepu_prev = skepu_sdata[skepu_tid - skepu_offset];
+		__syncwarp();
+		if (skepu_take)
+			skepu_sdata[skepu_tid] = {{FUNCTION_NAME_SCAN}}(skepu_prev, skepu_sdata[skepu_tid]);
+		__syncwarp();
+	}
+}
+
+__global__ void {{KERNEL_NAME}}_ScanRowWise({{SCAN_TYPE}} *skepu_input, {{SCAN_TYPE}} *skepu_output, int isInclusive, {{SCAN_TYPE}} skepu_init, size_t skepu_rows, size_t skepu_cols)
+{
+	extern __shared__ {{SCAN_TYPE}} skepu_sdata[];
+	{{SCAN_TYPE}} *skepu_warp_sums = skepu_sdata + blockDim.x;
+
+	__shared__ {{SCAN_TYPE}} skepu_carry;
+
+	size_t skepu_tid = threadIdx.x;
+	size_t skepu_lane = skepu_tid % 32;
+	size_t skepu_warp = skepu_tid / 32;
+
+	for (size_t skepu_row = blockIdx.x; skepu_row < skepu_rows; skepu_row += gridDim.x)
+	{
+		{{SCAN_TYPE}} *skepu_in = skepu_input + skepu_row * skepu_cols;
+		{{SCAN_TYPE}} *skepu_out = skepu_output + skepu_row * skepu_cols;
+
+		for (size_t skepu_base = 0; skepu_base < skepu_cols; skepu_base += blockDim.x)
+		{
+			size_t skepu_validCount = min((size_t)blockDim.x, skepu_cols - skepu_base);
+			size_t skepu_numWarps = (skepu_validCount + 31) / 32;
+			bool skepu_valid = skepu_tid < skepu_validCount;
+
+			// Tile-local inclusive scan: warps first, then the warp totals
+			if (skepu_valid)
+				skepu_sdata[skepu_tid] = skepu_in[skepu_base + skepu_tid];
+			__syncwarp();
+			{{KERNEL_NAME}}_ScanMatrix_warpScan(skepu_sdata, skepu_tid, skepu_lane, skepu_valid);
+
+			if (skepu_valid && (skepu_lane == 31 || skepu_tid == skepu_validCount - 1))
+				skepu_warp_sums[skepu_warp] = skepu_sdata[skepu_tid];
+			__syncthreads();
+
+			if (skepu_warp == 0)
+				{{KERNEL_NAME}}_ScanMatrix_warpScan(skepu_warp_sums, skepu_lane, skepu_lane, skepu_lane < skepu_numWarps);
+			__syncthreads();
+
+			if (skepu_valid && skepu_warp > 0)
+				skepu_sdata[skepu_tid] = {{FUNCTION_NAME_SCAN}}(skepu_warp_sums[skepu_warp - 1], skepu_sdata[skepu_tid]);
+			__syncthreads();
+
+			if (skepu_valid)
+			{
+				{{SCAN_TYPE}} skepu_res;
+				if (isInclusive == 1)
+					skepu_res = (skepu_base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[skepu_tid]) : skepu_sdata[skepu_tid];
+				else if (skepu_tid > 0)
+					skepu_res = {{FUNCTION_NAME_SCAN}}(skepu_init, (skepu_base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[skepu_tid - 1]) : skepu_sdata[skepu_tid - 1]);
+				else
+					skepu_res = (skepu_base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_init, skepu_carry) : skepu_init;
+				skepu_out[skepu_base + skepu_tid] = skepu_res;
+			}
+			__syncthreads();
+
+			if (skepu_tid == skepu_validCount - 1)
+				skepu_carry = (skepu_base > 0) ? {{FUNCTION_NAME_SCAN}}(skepu_carry, skepu_sdata[skepu_tid]) : skepu_sdata[skepu_tid];
+			__syncthreads();
+		}
+	}
+}
+
+__global__ void {{KERNEL_NAME}}_ScanColWise({{SCAN_TYPE}} *skepu_input, {{SCAN_TYPE}} *skepu_output, int isInclusive, {{SCAN_TYPE}} skepu_init, size_t skepu_rows, size_t skepu_cols)
+{
+	size_t gridSize = blockDim.x * gridDim.x;
+
+	for (size_t skepu_col = blockIdx.x * blockDim.x + threadIdx.x; skepu_col < skepu_cols && skepu_rows > 0; skepu_col += gridSize)
+	{
+		{{SCAN_TYPE}} skepu_acc = skepu_input[skepu_col];
+		skepu_output[skepu_col] = (isInclusive == 1) ? skepu_acc : skepu_init;
+
+		for (size_t skepu_row = 1; skepu_row < skepu_rows; ++skepu_row)
+		{
+			size_t skepu_mem = skepu_row * skepu_cols + skepu_col;
+			{{SCAN_TYPE}} skepu_value = skepu_input[skepu_mem];
+			if (isInclusive == 1)
+			{
+				skepu_acc = {{FUNCTION_NAME_SCAN}}(skepu_acc, skepu_value);
+				skepu_output[skepu_mem] = skepu_acc;
+			}
+			else
+			{
+				skepu_output[skepu_mem] = {{FUNCTION_NAME_SCAN}}(skepu_init, skepu_acc);
+				skepu_acc = {{FUNCTION_NAME_SCAN}}(skepu_acc, skepu_value);
+			}
+		}
+	}
+}
+)~~~";
+
+std::string createScanKernelProgram_CU(SkeletonInstance &instance, UserFunction &scanFunc, std::string dir, bool singlePass, bool matrix)
+{
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + (singlePass ? "_ScanSinglePass_" : "_Scan_") + scanFunc.uniqueName;
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(ScanKernel_CU + ScanUpdate_CU + ScanAdd_CU + (singlePass ? ScanLookbackHelpers_CU + ScanLookback_CU : "") + (matrix ? ScanMatrix_CU : ""),
 	{
 		{"{{SCAN_TYPE}}",          scanFunc.resolvedReturnTypeName},
 		{"{{KERNEL_NAME}}",        kernelName},
@@ -146,3 +424,13 @@ std::string createScanKernelProgram_CU(SkeletonInstance &instance, UserFunction
 	});
 	return kernelName;
 }
+
+std::string generateScanLookbackHelpers_CU(const std::string &kernelName, const std::string &scanType, const std::string &scanFuncName)
+{
+	return templateString(ScanLookbackHelpers_CU,
+	{
+		{"{{SCAN_TYPE}}",          scanType},
+		{"{{KERNEL_NAME}}",        kernelName},
+		{"{{FUNCTION_NAME_SCAN}}", scanFuncName}
+	});
+}
@@ -0,0 +1,153 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Row-wise and column-wise Scan for instances listed in -scan-matrix, analogous to the reduce mode of Reduce2D.
+ * After setMatrixMode(Mode::RowWise) or setMatrixMode(Mode::ColWise), calls of the instance on a result and an
+ * argument matrix of the same shape scan each row or each column on its own, with the scan mode and start value
+ * set on the instance, as integral images and per-row cumulative distributions need. Mode::Flat, the default,
+ * keeps the scan of all elements in order.
+ *
+ * The CUDA and OpenCL kernels of the instance get _ScanRowWise and _ScanColWise variants scanning all rows or all
+ * columns in one launch; backends providing scanMatrix launch those. Otherwise the call scans the rows or columns
+ * on the host.
+ */
+static const char *ScanMatrixSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace skepu
+{
+	namespace scanmatrix
+	{
+		enum class Mode
+		{
+			Flat, RowWise, ColWise
+		};
+
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename T>
+		auto invalidateDevice(T &arg, int) -> decltype(arg.invalidateDeviceData(), void())
+		{
+			arg.invalidateDeviceData();
+		}
+
+		template<typename T>
+		void invalidateDevice(T &, long) {}
+
+		template<typename Skeleton, typename ScanUF>
+		class Scan: public Skeleton
+		{
+			using Ret = typename ScanUF::Ret;
+
+		public:
+			using Skeleton::Skeleton;
+
+			void setMatrixMode(Mode mode)
+			{
+				this->matrixMode = mode;
+			}
+
+			void setScanMode(ScanMode mode)
+			{
+				this->inclusive = (mode == ScanMode::Inclusive);
+				Skeleton::setScanMode(mode);
+			}
+
+			void setStartValue(Ret value)
+			{
+				this->start = value;
+				Skeleton::setStartValue(value);
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename T>
+			Matrix<T> &operator()(Matrix<T> &res, Matrix<T> &arg)
+			{
+				if (this->matrixMode == Mode::Flat || res.total_rows() != arg.total_rows() || res.total_cols() != arg.total_cols())
+					return Skeleton::operator()(res, arg);
+				this->scan(0, res, arg);
+				return res;
+			}
+
+		private:
+			template<typename T>
+			auto scan(int, Matrix<T> &res, Matrix<T> &arg) -> decltype(std::declval<Skeleton&>().Skeleton::scanMatrix(res, arg, Mode::RowWise), void())
+			{
+				Skeleton::scanMatrix(res, arg, this->matrixMode);
+			}
+
+			// A row is a line of cols adjacent elements and a column one of rows elements cols apart; each element is
+			// read before it is written, so the scan may be in place
+			template<typename T>
+			void scan(long, Matrix<T> &res, Matrix<T> &arg)
+			{
+				updateHost(arg, 0);
+				updateHost(res, 0);
+				const T *in = arg.getAddress();
+				T *out = res.getAddress();
+				const size_t rows = arg.total_rows(), cols = arg.total_cols();
+				const bool rowWise = (this->matrixMode == Mode::RowWise);
+				const size_t lines = rowWise ? rows : cols, count = rowWise ? cols : rows;
+				const size_t lineStep = rowWise ? cols : 1, step = rowWise ? 1 : cols;
+
+				for (size_t l = 0; l < lines && count > 0; ++l)
+				{
+					const T *lineIn = in + l * lineStep;
+					T *lineOut = out + l * lineStep;
+					Ret acc = lineIn[0];
+					lineOut[0] = this->inclusive ? acc : this->start;
+					for (size_t i = 1; i < count; ++i)
+					{
+						T value = lineIn[i * step];
+						if (this->inclusive)
+						{
+							acc = ScanUF::CPU(acc, value);
+							lineOut[i * step] = acc;
+						}
+						else
+						{
+							lineOut[i * step] = ScanUF::CPU(this->start, acc);
+							acc = ScanUF::CPU(acc, value);
+						}
+					}
+				}
+				invalidateDevice(res, 0);
+			}
+
+			Mode matrixMode = Mode::Flat;
+			bool inclusive = true;
+			Ret start {};
+		};
+	}
+}
+)~~~";
+
+
+std::string generateScanMatrixSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_scan_matrix.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << ScanMatrixSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,184 @@
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+// Same segmented and atomic scatters as the CUDA kernels, see scatter_cu.cpp
+static const char *ScatterKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_ScatterSegmented(__global const {{INPUT_TYPE}} * restrict skepu_input, __global const size_t * restrict skepu_index, __global const size_t * restrict skepu_order,
+	__global {{VALUE_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_outputSize)
+{
+	for (size_t skepu_k = get_global_id(0); skepu_k < skepu_n; skepu_k += get_global_size(0))
+	{
+		size_t skepu_target = skepu_index[skepu_order[skepu_k]];
+		if (skepu_target >= skepu_outputSize || (skepu_k > 0 && skepu_index[skepu_order[skepu_k - 1]] == skepu_target))
+			continue;
+
+		{{VALUE_TYPE}} skepu_result = skepu_output[skepu_target];
+		for (size_t skepu_j = skepu_k; skepu_j < skepu_n; ++skepu_j)
+		{
+			size_t skepu_pos = skepu_order[skepu_j];
+			if (skepu_index[skepu_pos] != skepu_target)
+				break;
+			skepu_result = {{FUNCTION_NAME_COMBINE}}(skepu_result, {{FUNCTION_NAME_SCATTER}}(skepu_input[skepu_pos]));
+		}
+		skepu_output[skepu_target] = skepu_result;
+	}
+}
+)~~~";
+
+static const char *ScatterAtomicKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_ScatterAtomic(__global const {{INPUT_TYPE}} * restrict skepu_input, __global const size_t * restrict skepu_index,
+	__global {{VALUE_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_outputSize)
+{
+	for (size_t skepu_i = get_global_id(0); skepu_i < skepu_n; skepu_i += get_global_size(0))
+	{
+		size_t skepu_target = skepu_index[skepu_i];
+		if (skepu_target < skepu_outputSize)
+			atomic_add(&skepu_output[skepu_target], {{FUNCTION_NAME_SCATTER}}(skepu_input[skepu_i]));
+	}
+}
+)~~~";
+
+
+const std::string Constructor = R"~~~(
+class {{KERNEL_CLASS}}
+{
+public:
+
+	enum
+	{
+		KERNEL_SCATTER_SEGMENTED = 0,
+		KERNEL_SCATTER_ATOMIC,
+		KERNEL_COUNT
+	};
+
+	// Combine functions 'a + b' on int and unsigned int scatter atomically, the atomic kernel exists only then
+	static constexpr bool atomic = {{ATOMIC}};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
+	{
+		if (newkernel)
+		{
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
+			return nullptr;
+		}
+		else return skepu_kernel_table().get(deviceID, kerneltype);
+	}
+
+	static const std::string &skepu_source()
+	{
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		cl_kernel kernel_segmented = clCreateKernel(program, "{{KERNEL_NAME}}_ScatterSegmented", &err);
+		CL_CHECK_ERROR(err, "Error creating Scatter kernel '{{KERNEL_NAME}}'");
+		kernels(deviceID, KERNEL_SCATTER_SEGMENTED, &kernel_segmented);
+
+		if (atomic)
+		{
+			cl_kernel kernel_atomic = clCreateKernel(program, "{{KERNEL_NAME}}_ScatterAtomic", &err);
+			CL_CHECK_ERROR(err, "Error creating Scatter atomic kernel '{{KERNEL_NAME}}'");
+			kernels(deviceID, KERNEL_SCATTER_ATOMIC, &kernel_atomic);
+		}
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
+	}
+
+	// skepu_order holds the positions stably sorted by their index
+	static void scatterSegmented
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<const {{INPUT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<const size_t> *skepu_index,
+		skepu::backend::DeviceMemPointer_CL<const size_t> *skepu_order, skepu::backend::DeviceMemPointer_CL<{{VALUE_TYPE}}> *skepu_output,
+		size_t skepu_n, size_t skepu_outputSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_SCATTER_SEGMENTED);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_index->getDeviceDataPointer(), skepu_order->getDeviceDataPointer(),
+			skepu_output->getDeviceDataPointer(), skepu_n, skepu_outputSize);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Scatter kernel");
+	}
+
+	static void scatterAtomic
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<const {{INPUT_TYPE}}> *skepu_input, skepu::backend::DeviceMemPointer_CL<const size_t> *skepu_index,
+		skepu::backend::DeviceMemPointer_CL<{{VALUE_TYPE}}> *skepu_output, size_t skepu_n, size_t skepu_outputSize
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_SCATTER_ATOMIC);
+		skepu_cl_set_kernel_args(kernel, skepu_input->getDeviceDataPointer(), skepu_index->getDeviceDataPointer(), skepu_output->getDeviceDataPointer(), skepu_n, skepu_outputSize);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Scatter atomic kernel");
+	}
+};
+)~~~";
+
+
+std::string createScatterKernelProgram_CL(SkeletonInstance &instance, UserFunction &scatterFunc, UserFunction &combineFunc, std::string dir)
+{
+	std::stringstream sourceStream;
+	const bool atomic = histogramUsesAtomics(combineFunc, {"int", "unsigned int"});
+
+	sourceStream << precisionExtensions_CL({&scatterFunc, &combineFunc});
+
+	// Include user constants as preprocessor macros
+	for (auto pair : UserConstants)
+		sourceStream << "#define " << pair.second->name << " (" << pair.second->definition << ") // " << pair.second->typeName << "\n";
+
+	std::set<UserType*> referencedUTs = scatterFunc.ReferencedUTs;
+	referencedUTs.insert(combineFunc.ReferencedUTs.begin(), combineFunc.ReferencedUTs.end());
+	for (UserType *RefType : referencedUTs)
+		sourceStream << generateUserTypeCode_CL(*RefType);
+
+	sourceStream << KernelPredefinedTypes_CL;
+	if (scatterFunc.refersTo(combineFunc))
+		sourceStream << generateUserFunctionCode_CL(scatterFunc);
+	else if (combineFunc.refersTo(scatterFunc))
+		sourceStream << generateUserFunctionCode_CL(combineFunc);
+	else
+		sourceStream << generateUserFunctionCode_CL(scatterFunc) << generateUserFunctionCode_CL(combineFunc);
+	sourceStream << ScatterKernelTemplate_CL << (atomic ? ScatterAtomicKernelTemplate_CL : "");
+
+	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_ScatterKernel_" + scatterFunc.uniqueName + "_" + combineFunc.uniqueName;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
+	{
+		{"{{OPENCL_KERNEL}}",         sourceStream.str()},
+		{"{{KERNEL_CLASS}}",          "CLWrapperClass_" + kernelName},
+		{"{{ATOMIC}}",                atomic ? "true" : "false"},
+		{"{{INPUT_TYPE}}",            scatterFunc.elwiseParams[0].typeNameOpenCL()},
+		{"{{VALUE_TYPE}}",            combineFunc.resolvedReturnTypeName},
+		{"{{KERNEL_NAME}}",           kernelName},
+		{"{{FUNCTION_NAME_SCATTER}}", scatterFunc.uniqueName},
+		{"{{FUNCTION_NAME_COMBINE}}", combineFunc.uniqueName}
+	}), dir);
+}
@@ -0,0 +1,69 @@
+#include "code_gen.h"
+#include "code_gen_cu.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  skepu_output[skepu_index[i]] = combine(skepu_output[skepu_index[i]], f(skepu_input[i])) for i < skepu_n, in input
+ *  order per target. _ScatterSegmented works for any combine function: skepu_order holds the positions stably sorted
+ *  by their index (skepu::indirect::localityOrder), so the contributions to one target form one run, and the thread
+ *  at the head of each run folds it into the target, so no two threads ever update the same element.
+ *  _ScatterAtomic is generated for a combine function 'a + b' on int, unsigned int, unsigned long long or float, as
+ *  for Histogram, and adds straight into the output without an order. Indices at or past skepu_outputSize are dropped.
+ */
+static const char *ScatterKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_ScatterSegmented(const {{INPUT_TYPE}} * __restrict__ skepu_input, const size_t * __restrict__ skepu_index, const size_t * __restrict__ skepu_order,
+	{{VALUE_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_outputSize)
+{
+	for (size_t skepu_k = blockIdx.x * blockDim.x + threadIdx.x; skepu_k < skepu_n; skepu_k += blockDim.x * gridDim.x)
+	{
+		size_t skepu_target = __ldg(&skepu_index[__ldg(&skepu_order[skepu_k])]);
+		if (skepu_target >= skepu_outputSize || (skepu_k > 0 && __ldg(&skepu_index[__ldg(&skepu_order[skepu_k - 1])]) == skepu_target))
+			continue;
+
+		{{VALUE_TYPE}} skepu_result = skepu_output[skepu_target];
+		for (size_t skepu_j = skepu_k; skepu_j < skepu_n; ++skepu_j)
+		{
+			size_t skepu_pos = __ldg(&skepu_order[skepu_j]);
+			if (__ldg(&skepu_index[skepu_pos]) != skepu_target)
+				break;
+			skepu_result = {{FUNCTION_NAME_COMBINE}}(skepu_result, {{FUNCTION_NAME_SCATTER}}(skepu_input[skepu_pos]));
+		}
+		skepu_output[skepu_target] = skepu_result;
+	}
+}
+)~~~";
+
+static const char *ScatterAtomicKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_ScatterAtomic(const {{INPUT_TYPE}} * __restrict__ skepu_input, const size_t * __restrict__ skepu_index,
+	{{VALUE_TYPE}} *skepu_output, size_t skepu_n, size_t skepu_outputSize)
+{
+	for (size_t skepu_i = blockIdx.x * blockDim.x + threadIdx.x; skepu_i < skepu_n; skepu_i += blockDim.x * gridDim.x)
+	{
+		size_t skepu_target = __ldg(&skepu_index[skepu_i]);
+		if (skepu_target < skepu_outputSize)
+			atomicAdd(&skepu_output[skepu_target], {{FUNCTION_NAME_SCATTER}}(skepu_input[skepu_i]));
+	}
+}
+)~~~";
+
+
+std::string createScatterKernelProgram_CU(SkeletonInstance &instance, UserFunction &scatterFunc, UserFunction &combineFunc, std::string dir)
+{
+	const bool atomic = histogramUsesAtomics(combineFunc, {"int", "unsigned int", "unsigned long long", "float"});
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_ScatterKernel_" + scatterFunc.uniqueName + "_" + combineFunc.uniqueName;
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(std::string(ScatterKernelTemplate_CU) + (atomic ? ScatterAtomicKernelTemplate_CU : ""),
+	{
+		{"{{INPUT_TYPE}}",            scatterFunc.elwiseParams[0].resolvedTypeName},
+		{"{{VALUE_TYPE}}",            combineFunc.resolvedReturnTypeName},
+		{"{{KERNEL_NAME}}",           kernelName},
+		{"{{FUNCTION_NAME_SCATTER}}", scatterFunc.funcNameCUDA()},
+		{"{{FUNCTION_NAME_COMBINE}}", combineFunc.funcNameCUDA()}
+	});
+	return kernelName;
+}
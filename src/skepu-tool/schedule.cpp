@@ -0,0 +1,357 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * OpenMP loop schedules for instances listed in -omp-schedule, for user functions whose cost varies between
+ * elements. The policy is static, dynamic or guided as in the OpenMP schedule clause, or tasks, which splits the
+ * elements recursively into tasks that idle threads take over. The chunk is the number of elements a thread takes
+ * at a time; without one, static gives each thread one block and the others use a sixteenth of that block.
+ *
+ * Map calls with vector or matrix outputs and MapReduce calls on vector or matrix arguments, whose user functions
+ * do not use the PRNG, are scheduled here when the instance runs on the OpenMP backend: each chunk is a call of
+ * the CPU backend on a copy of the skeleton per thread, through the iterator interface. MapReduce combines the
+ * partial results of the chunks in per-thread skepu::partials slots, in no fixed order, so the reduce function
+ * has to be commutative and the start value an identity of it. Other calls, including all MapPairs calls, run whole with
+ * the schedule set as the run-sched-var of the calling thread, which the OpenMP backend loops use through
+ * schedule(runtime); tasks is set as dynamic there.
+ *
+ * Instances run on the OpenMP backend once it is set on them, or without a backend of their own in builds whose
+ * only parallel backend is OpenMP.
+ */
+static const char *ScheduleSupport = R"~~~(
+#pragma once
+
+#include "skepu_partials.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+namespace skepu
+{
+	namespace schedule
+	{
+		enum class Policy
+		{
+			Static,
+			Dynamic,
+			Guided,
+			Tasks
+		};
+
+		constexpr size_t MinChunk = 64;
+
+		inline size_t chunkSize(Policy policy, size_t chunk, size_t n, size_t threads)
+		{
+			size_t block = (n + threads - 1) / threads;
+			if (chunk > 0)
+				return chunk;
+			if (policy == Policy::Static)
+				return std::max<size_t>(1, block);
+			return std::max(MinChunk, block / 16);
+		}
+
+		// Halves the chunks [first, last) into tasks until one chunk is left for this task
+		template<typename Body>
+		void steal(long long first, long long last, Body *body)
+		{
+			while (last - first > 1)
+			{
+				long long mid = first + (last - first) / 2;
+#pragma omp task firstprivate(mid, last, body)
+				steal(mid, last, body);
+				last = mid;
+			}
+			(*body)(first);
+		}
+
+		// Calls body(thread, first, last) for the chunks of [0, n) in the order of the policy
+		template<typename Body>
+		void forChunks(Policy policy, size_t chunk, size_t n, int threads, Body &&body)
+		{
+			long long chunks = (n + chunk - 1) / chunk;
+			auto run = [&](long long c)
+			{
+				size_t first = c * chunk;
+				body(omp_get_thread_num(), first, std::min(n, first + chunk));
+			};
+
+			switch (policy)
+			{
+			case Policy::Static:
+#pragma omp parallel for schedule(static, 1) num_threads(threads)
+				for (long long c = 0; c < chunks; ++c)
+					run(c);
+				break;
+			case Policy::Dynamic:
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+				for (long long c = 0; c < chunks; ++c)
+					run(c);
+				break;
+			case Policy::Guided:
+#pragma omp parallel for schedule(guided) num_threads(threads)
+				for (long long c = 0; c < chunks; ++c)
+					run(c);
+				break;
+			case Policy::Tasks:
+#pragma omp parallel num_threads(threads)
+#pragma omp single
+				steal(0, chunks, &run);
+				break;
+			}
+		}
+
+		// Sets the run-sched-var of this thread for the lifetime of the hint
+		class Hint
+		{
+		public:
+			Hint(Policy policy, size_t chunk)
+			{
+				omp_get_schedule(&this->kind, &this->chunk);
+				omp_sched_t kind = omp_sched_dynamic;
+				if (policy == Policy::Static)
+					kind = omp_sched_static;
+				else if (policy == Policy::Guided)
+					kind = omp_sched_guided;
+				omp_set_schedule(kind, static_cast<int>(chunk));
+			}
+
+			~Hint()
+			{
+				omp_set_schedule(this->kind, this->chunk);
+			}
+
+		private:
+			omp_sched_t kind;
+			int chunk;
+		};
+
+		template<typename T> struct IsContainer: std::false_type {};
+		template<typename T> struct IsContainer<skepu::Vector<T>>: std::true_type {};
+		template<typename T> struct IsContainer<skepu::Matrix<T>>: std::true_type {};
+
+		template<typename T>
+		using IsContainerArg = IsContainer<typename std::remove_cv<typename std::remove_reference<T>::type>::type>;
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<bool... B> struct All: std::true_type {};
+		template<bool First, bool... Rest> struct All<First, Rest...>: std::integral_constant<bool, First && All<Rest...>::value> {};
+
+		// Elementwise arguments start at the chunk, the others are passed on
+		template<bool Elementwise>
+		struct Slice
+		{
+			template<typename Arg>
+			static Arg &of(Arg &arg, size_t) { return arg; }
+		};
+
+		template<>
+		struct Slice<true>
+		{
+			template<typename Arg>
+			static auto of(Arg &arg, size_t first) -> decltype(arg.begin() + first) { return arg.begin() + first; }
+		};
+
+		// Chunks read and write the host storage of all arguments
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename... Args>
+		void updateHostAll(Args&... args)
+		{
+			int expand[] = {0, (updateHost(args, 0), 0)...};
+			(void)expand;
+		}
+
+		template<typename Skeleton, Policy P, size_t Chunk>
+		class Hinted: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->openmp = (spec.backend() == Backend::Type::OpenMP);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->openmp = defaultOpenMP();
+				Skeleton::resetBackend();
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				Hint hint(P, Chunk);
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+		protected:
+			static constexpr bool defaultOpenMP()
+			{
+#if defined(SKEPU_OPENMP) && !defined(SKEPU_CUDA) && !defined(SKEPU_OPENCL)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			// Copies of the skeleton on the CPU backend, one per thread of the chunked loops
+			std::vector<Skeleton> workers(int threads) const
+			{
+				std::vector<Skeleton> copies(threads, static_cast<Skeleton const&>(*this));
+				for (Skeleton &copy : copies)
+					copy.setBackend(BackendSpec{Backend::Type::CPU});
+				return copies;
+			}
+
+			bool openmp = defaultOpenMP();
+		};
+
+		template<typename Skeleton, typename UF, Policy P, size_t Chunk>
+		class Map: public Hinted<Skeleton, P, Chunk>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename UF::ElwiseArgs>::value;
+
+		public:
+			using Hinted<Skeleton, P, Chunk>::Hinted;
+
+			template<typename Res, typename... Args>
+			auto operator()(Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, chunkable<Res, Args...>(typename Indices<sizeof...(Args)>::type{})>{},
+					std::forward<Res>(res), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename Res, typename... Args, size_t... I>
+			static constexpr bool chunkable(Sequence<I...>)
+			{
+				return UF::outArity == 1 && !UF::usesPRNG && IsContainerArg<Res>::value
+					&& All<(I >= elwise || IsContainerArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Hinted<Skeleton, P, Chunk>::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename... Args>
+			auto call(std::true_type, Res &&res, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<Args>(args)...))
+			{
+				size_t n = res.size();
+				if (!this->openmp || n == 0)
+					return this->call(std::false_type{}, std::forward<Res>(res), std::forward<Args>(args)...);
+
+				int threads = omp_get_max_threads();
+				std::vector<Skeleton> workers = this->workers(threads);
+				updateHostAll(res, args...);
+				auto whole = typename Indices<sizeof...(Args)>::type{};
+				forChunks(P, chunkSize(P, Chunk, n, threads), n, threads, [&](int thread, size_t first, size_t last)
+				{
+					sliced(workers[thread], res, first, last, whole, args...);
+				});
+				return std::forward<Res>(res);
+			}
+
+			template<typename Res, typename... Args, size_t... I>
+			static void sliced(Skeleton &skeleton, Res &res, size_t first, size_t last, Sequence<I...>, Args&... args)
+			{
+				skeleton(res.begin() + first, res.begin() + last, Slice<(I < elwise)>::of(args, first)...);
+			}
+		};
+
+		template<typename Skeleton, typename MapUF, typename ReduceUF, Policy P, size_t Chunk>
+		class MapReduce: public Hinted<Skeleton, P, Chunk>
+		{
+			static constexpr size_t elwise = std::tuple_size<typename MapUF::ElwiseArgs>::value;
+
+		public:
+			using Hinted<Skeleton, P, Chunk>::Hinted;
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return this->call(std::integral_constant<bool, chunkable<Args...>(typename Indices<sizeof...(Args)>::type{})>{}, std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args, size_t... I>
+			static constexpr bool chunkable(Sequence<I...>)
+			{
+				return MapUF::outArity == 1 && !MapUF::usesPRNG && elwise > 0 && All<(I >= elwise || IsContainerArg<Args>::value)...>::value;
+			}
+
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Hinted<Skeleton, P, Chunk>::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename First, typename... Args>
+			auto call(std::true_type, First &&first, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...))
+			{
+				size_t n = first.size();
+				if (!this->openmp || n == 0)
+					return this->call(std::false_type{}, std::forward<First>(first), std::forward<Args>(args)...);
+
+				using R = decltype(std::declval<Skeleton&>()(std::forward<First>(first), std::forward<Args>(args)...));
+				int threads = omp_get_max_threads();
+				std::vector<Skeleton> workers = this->workers(threads);
+				partials::Slots<R> partial(threads);
+				auto reduce = [](R const& a, R const& b) { return ReduceUF::CPU(a, b); };
+				updateHostAll(first, args...);
+				auto rest = typename Indices<sizeof...(Args)>::type{};
+				forChunks(P, chunkSize(P, Chunk, n, threads), n, threads, [&](int thread, size_t begin, size_t end)
+				{
+					partial.add(thread, sliced(workers[thread], first, begin, end, rest, args...), reduce);
+				});
+
+				R result {};
+				partial.combine(reduce, result);
+				return result;
+			}
+
+			// The remaining elementwise arguments follow the first, at positions 0 to elwise - 2
+			template<typename First, typename... Args, size_t... I>
+			static auto sliced(Skeleton &skeleton, First &first, size_t begin, size_t end, Sequence<I...>, Args&... args)
+				-> decltype(skeleton(first.begin(), first.begin(), Slice<(I + 1 < elwise)>::of(args, 0)...))
+			{
+				return skeleton(first.begin() + begin, first.begin() + end, Slice<(I + 1 < elwise)>::of(args, begin)...);
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateScheduleSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_schedule.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		generatePartialsSupport(dir);
+		FSOutFile << ScheduleSupport;
+		generated = true;
+	}
+	return fileName;
+}
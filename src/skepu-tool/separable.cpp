@@ -0,0 +1,71 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Separable MapOverlap for instances listed in -separable-overlap as cols=rows, both MapOverlap 1D instances: rows
+ * on the row function of the stencil, cols on its column function, declared after rows. Matrix calls of cols run
+ * rows row-wise into an intermediate matrix and then the column pass of cols on it, so a stencil of radius r costs
+ * 2(2r+1) instead of (2r+1)^2 user function work per element. Each pass keeps the overlap, edge mode and pad set on
+ * its own instance, and both take the uniform arguments of the call.
+ *
+ * The intermediate belongs to the wrapper and is only resized when the shape of the input changes. It is never
+ * read on the host, so on the GPU backends it stays resident between the passes and between calls. Other calls
+ * of cols run its own pass unchanged.
+ */
+static const char *SeparableSupport = R"~~~(
+#pragma once
+
+#include <utility>
+
+namespace skepu
+{
+	namespace separable
+	{
+		template<typename Skeleton, typename Rows, typename T>
+		class MapOverlap: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			MapOverlap(Rows &rows, CallArgs&&... args): Skeleton(std::forward<CallArgs>(args)...), rows(rows) {}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename R, typename U, typename... Args>
+			auto operator()(Matrix<R> &res, Matrix<U> &arg, Args&&... args)
+				-> decltype(std::declval<Skeleton&>()(res, std::declval<Matrix<T>&>(), std::forward<Args>(args)...))
+			{
+				if (this->intermediate.total_rows() != arg.total_rows() || this->intermediate.total_cols() != arg.total_cols())
+					this->intermediate.resize(arg.total_rows(), arg.total_cols());
+
+				// The modes are set per call, the instances may be configured between calls
+				this->rows.setOverlapMode(Overlap::RowWise);
+				this->rows(this->intermediate, arg, args...);
+				Skeleton::setOverlapMode(Overlap::ColWise);
+				return Skeleton::operator()(res, this->intermediate, std::forward<Args>(args)...);
+			}
+
+		private:
+			Rows &rows;
+			Matrix<T> intermediate;
+		};
+	}
+}
+)~~~";
+
+
+std::string generateSeparableSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_separable.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << SeparableSupport;
+		generated = true;
+	}
+	return fileName;
+}
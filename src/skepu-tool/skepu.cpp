@@ -1,6 +1,12 @@
 #include "globals.h"
 #include "visitor.h"
 
+#include <atomic>
+#include <thread>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
 using namespace clang;
 
 // ------------------------------
@@ -11,13 +17,14 @@ using namespace clang;
 llvm::cl::OptionCategory SkePUCategory("SkePU precompiler options");
 
 llvm::cl::opt<std::string> ResultDir("dir", llvm::cl::desc("Directory of output files"), llvm::cl::cat(SkePUCategory));
-llvm::cl::opt<std::string> ResultName("name", llvm::cl::desc("File name of main output file (without extension, e.g., .cpp or .cu)"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<std::string> ResultNameOption("name", llvm::cl::desc("File name of main output file (without extension, e.g., .cpp or .cu)"), llvm::cl::cat(SkePUCategory));
 
 llvm::cl::opt<bool> GenCUDA("cuda",  llvm::cl::desc("Generate CUDA backend"),   llvm::cl::cat(SkePUCategory));
 llvm::cl::opt<bool> GenOMP("openmp", llvm::cl::desc("Generate OpenMP backend"), llvm::cl::cat(SkePUCategory));
 llvm::cl::opt<bool> GenCL("opencl",  llvm::cl::desc("Generate OpenCL backend"), llvm::cl::cat(SkePUCategory));
 llvm::cl::opt<bool> GenStarPUMPI("starpu-mpi",  llvm::cl::desc("Generate StarPU-MPI backend"), llvm::cl::cat(SkePUCategory));
 llvm::cl::opt<bool> GenMPI("mpi",  llvm::cl::desc("Generate MPI backend"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> SplitCUDA("split-cuda",  llvm::cl::desc("With -cuda, keep the main output a .cpp for the host compiler and compile only the kernels through nvcc, in a separate <name>_device.cu translation unit"), llvm::cl::cat(SkePUCategory));
 
 llvm::cl::opt<bool> Verbose("verbose",  llvm::cl::desc("Verbose logging printout"), llvm::cl::cat(SkePUCategory));
 llvm::cl::opt<bool> Silent("silent",  llvm::cl::desc("Disable normal printouts"), llvm::cl::cat(SkePUCategory));
@@ -27,9 +34,93 @@ llvm::cl::opt<bool> DoNotGenLineDirectives("no-preserve-lines", llvm::cl::desc("
 
 llvm::cl::opt<std::string> AllowedFuncNames("fnames", llvm::cl::desc("Function names which are allowed to be called from user functions (separated by space, e.g. -fnames \"conj csqrt\")"), llvm::cl::cat(SkePUCategory));
 
-// Derived
-static std::string mainFileName;
-std::string inputFileName;
+llvm::cl::list<std::string> RuntimeSkeletons("skeletons", llvm::cl::desc("Skeletons beyond the SkePU 3 set which the SkePU runtime in use provides, only these are recognized and generated: ReduceByKey, Histogram, Sort, Filter, Gather and Scatter (comma separated)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+
+llvm::cl::list<std::string> ScanSinglePassInstances("scan-single-pass", llvm::cl::desc("Scan instances which use the single-pass (decoupled look-back) CUDA kernel (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> UnitStrideInstances("unit-stride", llvm::cl::desc("Map and MapReduce instances also given CUDA kernels specialised for calls whose strides are all 1 (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapDynamicInstances("map-dynamic", llvm::cl::desc("Map instances given a persistent-thread CUDA kernel whose warps fetch chunks of elements from a global work counter, for user functions of irregular cost (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapReduceSinglePassInstances("mapreduce-single-pass", llvm::cl::desc("MapReduce instances given a CUDA kernel whose last block reduces the partials of all blocks, finishing in one launch (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> Reduce2DSingleLaunchInstances("reduce2d-single-launch", llvm::cl::desc("Reduce2D instances also given CUDA kernels that reduce a whole matrix row-wise or column-wise in a single launch of 2D blocks (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> ScanMatrixInstances("scan-matrix", llvm::cl::desc("Scan instances which scan the rows or columns of matrices independently, set with setMatrixMode, given CUDA and OpenCL kernels that scan all of them in one launch (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> BatchedInstances("batched", llvm::cl::desc("Map and Reduce instances called on batches of small vectors with batched, as a flat vector and item offsets or a list of vectors, run in one launch per batch (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> OutOfCoreInstances("out-of-core", llvm::cl::desc("Map, Reduce, MapReduce and MapOverlap1D instances called on vectors larger than device memory, streamed through the device in double-buffered chunks (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<unsigned> OutOfCoreChunkMiB("out-of-core-chunk", llvm::cl::desc("MiB of elementwise data per chunk of -out-of-core instances"), llvm::cl::init(256), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> IncrementalIndex("incremental-index", llvm::cl::desc("Update multi-dimensional indices incrementally in grid-stride Map and MapReduce kernels instead of dividing per element"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<unsigned> LaunchBoundsThreads("launch-bounds", llvm::cl::desc("Emit __launch_bounds__ for this many threads per block, the most the backends launch, on every generated CUDA kernel; -autotune instances sweep block sizes up to it (0 disables)"), llvm::cl::init(0), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MaxRegisterInstances("max-registers", llvm::cl::desc("Instances whose CUDA kernels keep to a register budget per thread, as name=registers, emitted as the minimum blocks per multiprocessor of their launch bounds (comma separated)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> Index32("index32", llvm::cl::desc("Emit a 32-bit index variant of each CUDA kernel, launched instead of the size_t one when the element counts and pitches of a call fit in 31 bits"), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> VectorizedMapInstances("vectorized-map", llvm::cl::desc("Map instances also given a unit-stride CUDA kernel with vector loads and stores, for calls on containers aligned to the vector type (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> PruneDeviceArgs("prune-device-args", llvm::cl::desc("Do not pass container arguments that the device variants of a user function never refer to, outside of VARIANT_CPU and VARIANT_OPENMP, to the CUDA and OpenCL kernels; the backends skip their uploads"), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> TiledGEMMInstances("tiled-gemm", llvm::cl::desc("Map instances whose user function is the dot product of a MatRow and a MatCol, also given a shared-memory tiled CUDA kernel (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> NoShuffleReduce("no-warp-shuffle", llvm::cl::desc("Always use the shared memory reduction tree in CUDA reduction kernels"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> NoCollectiveReduce_CL("no-opencl-collective-reduce", llvm::cl::desc("Always use the local memory reduction tree in OpenCL reduction kernels, not the work-group and sub-group built-ins"), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapPairsSymmetricInstances("mappairs-symmetric", llvm::cl::desc("MapPairs and MapPairsReduce instances whose user function is symmetric in its vertical and horizontal arguments, evaluated on half of the pairs (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapPairsAntisymmetricInstances("mappairs-antisymmetric", llvm::cl::desc("MapPairs and MapPairsReduce instances whose user function is antisymmetric in its vertical and horizontal arguments, evaluated on half of the pairs (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapPairsReduceBroadcastInstances("mappairsreduce-broadcast", llvm::cl::desc("MapPairsReduce instances also given an N-body style CUDA kernel with one thread per result, streaming the other side through shared memory tiles (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapOverlapTemporalInstances("mapoverlap-temporal", llvm::cl::desc("MapOverlap2D instances iterated on their own output, given a CUDA kernel that advances several time steps per launch (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapOverlapReduceInstances("mapoverlap-reduce", llvm::cl::desc("MapOverlap2D instances whose kernel also reduces a residual MapReduce instance over each output and its input element, as step=residual (comma separated, e.g. update=residual)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapOverlapRedBlackInstances("mapoverlap-redblack", llvm::cl::desc("MapOverlap2D instances updated in place with UpdateMode::RedBlack, given a CUDA kernel that updates one colour per launch with one thread per cell of that colour (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> StaticOverlapInstances("static-overlap", llvm::cl::desc("MapOverlap instances whose overlap is fixed at precompile time, as name=overlap with one overlap per dimension separated by x (comma separated, e.g. blur=2x2)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MapOverlapOutputsInstances("mapoverlap-outputs", llvm::cl::desc("MapOverlap2D instances whose CUDA and OpenCL threads each compute a strip of outputs from a larger tile, as name=rowsxcols with at most 16 outputs (comma separated, e.g. blur=4x1)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> SpMVInstances("spmv", llvm::cl::desc("Map instances computing a CSR sparse matrix-vector product row by row, given a CUDA kernel with several threads per row (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> SpMVSellInstances("spmv-sell", llvm::cl::desc("SpMV Map instances whose CUDA kernel reads a cached SELL-C-sigma copy of the matrix instead of its CSR arrays (comma separated instance names, implies -spmv)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> SoATypes("soa", llvm::cl::desc("User types whose elementwise container arguments CUDA Map kernels read as one array per field, gathering only the fields the user function reads (comma separated type names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> PhiloxRandom("philox-random", llvm::cl::desc("Draw skepu::Random values on CUDA and OpenCL from a stateless Philox4x32-10 generator keyed by seed, element index and draw number instead of per-thread state buffers"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<unsigned> MapPairsTile("mappairs-tile", llvm::cl::desc("Rows of the vertical tile staged in shared memory by the tiled CUDA MapPairs kernel (0 disables the tiled kernel)"), llvm::cl::init(0), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> FuseMaps("fuse-map-chains", llvm::cl::desc("Fuse a Map whose output vector is only consumed by the following Map into that Map's user function"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> FuseMapReduce("fuse-map-reduce", llvm::cl::desc("Fuse a Map whose output vector is only consumed by a following Reduce into a MapReduce instance"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> ReduceAccumulateFloat("reduce-accumulate-float", llvm::cl::desc("Accumulate CUDA Reduce and MapReduce results over __half and __nv_bfloat16 in float before rounding to the element type"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> FastMath("fast-math", llvm::cl::desc("Rewrite single precision math library calls in user functions to CUDA intrinsics and OpenCL native_* functions (intrinsic error bounds, pow requires a non-negative base)"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<unsigned> DevicePoolMiB("device-pool", llvm::cl::desc("Reuse the CUDA and OpenCL buffers of destroyed containers through a size-class caching allocator, keeping at most this many MiB cached per device (0 disables)"), llvm::cl::init(0), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> DeviceEviction("device-eviction", llvm::cl::desc("Track the CUDA and OpenCL copies of containers per device and, when an allocation fails, evict the least recently used ones, writing dirty copies back to the host first"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> PinnedHost("pinned-host", llvm::cl::desc("Back the host storage of containers with page-locked memory from a pooled arena, so that host-device copies run at full bandwidth and asynchronously"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> OMPPartials("omp-partials", llvm::cl::desc("Keep the per-thread partials of the OpenMP Reduce, MapReduce and MapPairsReduce implementations on their own cache lines (requires -openmp)"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> NUMA("numa", llvm::cl::desc("Place container host storage on the NUMA nodes of the OpenMP threads computing it, by parallel first touch in the static schedule of the skeletons, and bind the threads to cores"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> RangeCoherency("range-coherency", llvm::cl::desc("Track the device-newer element ranges of containers, so that skepu::coherency::external and host element access transfer only the accessed part"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> Views("views", llvm::cl::desc("Generate skepu::views, vector slices and matrix row-range and block views sharing the storage of their parent, and let Map, MapReduce, Reduce, Scan and MapOverlap1D instances take them as arguments"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> MappedIO("mapped-io", llvm::cl::desc("Generate skepu::mapped, which saves vectors and matrices to a binary container format and opens such files as memory-mapped container host storage"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> ZeroCopy("zero-copy", llvm::cl::desc("Let containers on devices that share memory with the host use their host storage as the device buffer (CUDA managed memory or CL_MEM_USE_HOST_PTR), mapping it instead of copying"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> Async("async", llvm::cl::desc("Let skepu::async::Stream scopes run the OpenCL kernels of skeleton calls on their own queue per device, so that independent calls on different threads overlap"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> Graphs("graphs", llvm::cl::desc("Provide skepu::graph::Region, which captures a sequence of skeleton calls into a CUDA graph or OpenCL command buffer once and replays it with one launch"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<unsigned> ConstantUniformBytes("constant-uniform-bytes", llvm::cl::desc("Uniform scalar arguments of at least this many bytes are passed to OpenCL kernels in a cached __constant buffer (0 disables)"), llvm::cl::init(0), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> LaunchMetadataInstances("launch-metadata", llvm::cl::desc("CUDA instances whose kernels each get a <kernel>_launch struct, with the dynamic shared memory the kernel needs per block size and its occupancy-maximizing block size (comma separated instance names, requires -cuda)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> AutotuneInstances("autotune", llvm::cl::desc("Instances which pick their backend and launch parameters from a tuning database, sweeping the candidates the first time a problem size is seen (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<std::string> TuningDatabase("tuning-db", llvm::cl::desc("Tuning database file used by -autotune instances at run time"), llvm::cl::init("skepu_tuning.db"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> Instrument("instrument", llvm::cl::desc("Wrap every skeleton instance in NVTX ranges and OpenCL profiling events and print per-instance time, bytes moved and launch counts at exit, also written as CSV to $SKEPU_INSTRUMENT_REPORT if set"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> TransferMetrics("transfer-metrics", llvm::cl::desc("Count the uploads, downloads, device allocations and invalidations of container copies per instance and per container, queryable through skepu::metrics and written as JSON to $SKEPU_METRICS_JSON at exit"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> Incremental("incremental", llvm::cl::desc("Skip the run if the source file, every file it includes, the options and the outputs are unchanged since the last run, as recorded in a .skepu-stamp file next to the main output file"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> TimeReport("time-report", llvm::cl::desc("Print per-phase and per-instance wall times and the generated files to stderr"), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> TransposeMatColInstances("transpose-matcol", llvm::cl::desc("Map and MapReduce instances whose CPU and OpenMP variants read their MatCol arguments contiguously from a cached transposed copy of the matrix (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> BrickTensorInstances("brick-tensors", llvm::cl::desc("Map and MapReduce instances whose CPU and OpenMP variants read their Ten3 and Ten4 arguments from a cached copy of the tensor stored in bricks (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> LazyInstances("lazy", llvm::cl::desc("Map instances whose calls are recorded into a per-thread call graph and run by skepu::lazy::flush, dropping calls whose results are overwritten unread (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> HybridInstances("hybrid", llvm::cl::desc("Map and MapReduce instances whose calls on vectors are split between the OpenMP backend and the GPU backend, with the CPU share adapted online from the measured throughput (comma separated instance names, requires -openmp and -cuda or -opencl)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> TiledOverlapInstances("tiled-overlap", llvm::cl::desc("MapOverlap2D and MapOverlap3D instances whose OpenMP calls compute the output in cache-sized tiles copied with their halo, vectorizing along the contiguous dimension (comma separated instance names, requires -openmp)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MultiGPUOverlapInstances("multi-gpu-overlap", llvm::cl::desc("MapOverlap2D and MapOverlap3D instances whose CUDA calls split the rows (planes) over all devices, keeping the output partitions resident and exchanging only their halos peer to peer (comma separated instance names, requires -cuda)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> SeparableOverlapInstances("separable-overlap", llvm::cl::desc("MapOverlap 1D instances on the column function of a separable stencil, as cols=rows with rows the instance on its row function declared before, whose matrix calls chain the row and column passes (comma separated, e.g. blurCols=blurRows)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> MultiGPUPairsInstances("multi-gpu-pairs", llvm::cl::desc("MapPairs and MapPairsReduce instances whose CUDA calls on vectors split the rows of the pair space over all devices and gather the output rows (comma separated instance names, requires -cuda)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> BlockedPairsInstances("blocked-pairs", llvm::cl::desc("MapPairs and MapPairsReduce instances whose OpenMP calls on vectors walk the pairs in cache blocks sized from the element types of their arguments (comma separated instance names, requires -openmp)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> OMPSIMD("omp-simd", llvm::cl::desc("Give pure elementwise user functions of arithmetic scalars, optionally with an Index1D, an OMP_simd variant declared with #pragma omp declare simd, uniform and linear clauses, and set their ompSIMD trait, so that the OpenMP loops vectorize over it"), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> OMPScheduleInstances("omp-schedule", llvm::cl::desc("Instances whose OpenMP loops use a schedule of their own, as name=policy or name=policy:chunk with policy static, dynamic, guided or tasks (comma separated, e.g. mandelbroter=dynamic:256, requires -openmp)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> EarlyExitInstances("reduce-early-exit", llvm::cl::desc("Reduce and MapReduce instances whose reduce function has an absorbing value, at which their CUDA and OpenMP reductions stop reading elements, as name or name=value (comma separated, e.g. anyAbove or floorMin=0; the value of a || b and a && b is inferred)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> AutoBackendInstances("auto-backend", llvm::cl::desc("Instances which pick their backend per call from the static cost estimate of their user function, the problem size and the backend rates measured at startup (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> PlanInstances("plan", llvm::cl::desc("Instances which pick their backend and launch parameters by problem size from an execution plan file, written by a run with SKEPU_CALIBRATE set (comma separated instance names)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> StarPUPartitionInstances("starpu-partition", llvm::cl::desc("Instances whose StarPU-MPI tasks have a block size, distribution and performance model of their own, as name, name=distribution:blocksize or name=distribution:blocksize:model with distribution block or block-cyclic and model history, regression or nl-regression (comma separated, e.g. stencil=block-cyclic:65536, requires -starpu-mpi)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<std::string> PlanFile("plan-file", llvm::cl::desc("Execution plan file used by -plan instances at run time"), llvm::cl::init("skepu_plan.txt"), llvm::cl::cat(SkePUCategory));
+llvm::cl::list<std::string> JITSpecializeInstances("jit-specialize", llvm::cl::desc("Map instances whose CUDA kernel is recompiled at run time with NVRTC, with the uniform scalar arguments of each call as constants (comma separated instance names, requires linking nvrtc and cuda)"), llvm::cl::CommaSeparated, llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> VendorBLAS("vendor-blas", llvm::cl::desc("Route skepu::blas gemm, gemv, dot and axpy calls on float, double and complex containers to cuBLAS in CUDA builds and to CBLAS otherwise, falling back to the skeleton implementation (requires linking cublas or a CBLAS library)"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> OpenCLSPIRV("opencl-spirv", llvm::cl::desc("Compile the OpenCL kernels to SPIR-V during precompilation and create the programs with clCreateProgramWithIL where the device supports it"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<std::string> SPIRVClang("spirv-clang", llvm::cl::desc("Clang executable used by -opencl-spirv to compile OpenCL C to SPIR LLVM IR"), llvm::cl::init("clang"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<std::string> SPIRVTranslator("llvm-spirv", llvm::cl::desc("LLVM IR to SPIR-V translator used by -opencl-spirv"), llvm::cl::init("llvm-spirv"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<bool> UsePCH("pch", llvm::cl::desc("Parse the SkePU headers from a precompiled header, built in the output directory the first time and rebuilt when the flags or headers change"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<std::string> PCHHeader("pch-header", llvm::cl::desc("Header precompiled by -pch, included by the source files (default skepu)"), llvm::cl::init("skepu"), llvm::cl::cat(SkePUCategory));
+llvm::cl::opt<unsigned> Jobs("j", llvm::cl::desc("Number of source files processed concurrently, each into its own main output file"), llvm::cl::init(1), llvm::cl::cat(SkePUCategory));
+
+// Derived, per translation unit
+thread_local std::string ResultName;
+static thread_local std::string mainFileName;
+static thread_local std::string pchFileName;
+static std::string invocationHash;
+thread_local std::string inputFileName;
 
 
 // ------------------------------
@@ -37,13 +128,15 @@ std::string inputFileName;
 // ------------------------------
 
 // User functions, name maps to AST entry and indexed indicator
-std::unordered_map<const FunctionDecl*, UserFunction*> UserFunctions;
+thread_local std::unordered_map<const FunctionDecl*, UserFunction*> UserFunctions;
 
 // User functions, name maps to AST entry and indexed indicator
-std::unordered_map<const TypeDecl*, UserType*> UserTypes;
+thread_local std::unordered_map<const TypeDecl*, UserType*> UserTypes;
 
 // User functions, name maps to AST entry and indexed indicator
-std::unordered_map<const VarDecl*, UserConstant*> UserConstants;
+thread_local std::unordered_map<const VarDecl*, UserConstant*> UserConstants;
+
+thread_local std::unordered_map<const VarDecl*, std::pair<UserFunction*, UserFunction*>> MapOverlapReductions;
 
 // Explicitly allowed functions to call from user functions
 std::unordered_set<std::string> AllowedFunctionNamesCalledInUFs
@@ -68,6 +161,12 @@ const std::unordered_map<std::string, Skeleton> Skeletons =
 	{"MapImpl",              {"Map",                Skeleton::Type::Map,                1, 1}},
 	{"Reduce1D",             {"Reduce1D",           Skeleton::Type::Reduce1D,           1, 1}},
 	{"Reduce2D",             {"Reduce2D",           Skeleton::Type::Reduce2D,           2, 2}},
+	{"ReduceByKey",          {"ReduceByKey",        Skeleton::Type::ReduceByKey,        1, 2}},
+	{"Histogram",            {"Histogram",          Skeleton::Type::Histogram,          2, 2}},
+	{"Sort",                 {"Sort",               Skeleton::Type::Sort,               1, 3}},
+	{"Filter",               {"Filter",             Skeleton::Type::Filter,             1, 1}},
+	{"Gather",               {"Gather",             Skeleton::Type::Gather,             1, 1}},
+	{"Scatter",              {"Scatter",            Skeleton::Type::Scatter,            2, 1}},
 	{"MapReduceImpl",        {"MapReduce",          Skeleton::Type::MapReduce,          2, 2}},
 	{"ScanImpl",             {"Scan",               Skeleton::Type::Scan,               1, 3}},
 	{"MapOverlap1D",         {"MapOverlap1D",       Skeleton::Type::MapOverlap1D,       1, 4}},
@@ -79,12 +178,16 @@ const std::unordered_map<std::string, Skeleton> Skeletons =
 	{"CallImpl",             {"Call",               Skeleton::Type::Call,               1, 1}},
 };
 
-Rewriter GlobalRewriter;
-size_t GlobalSkeletonIndex = 0;
+thread_local std::vector<GeneratedFileRecord> GeneratedFiles;
+
+thread_local Rewriter GlobalRewriter;
+thread_local size_t GlobalSkeletonIndex = 0;
+
+thread_local double KernelGenTime_CU = 0, KernelGenTime_CL = 0;
 
 // Library markers
-bool didFindBlas = false;
-clang::SourceLocation blasBegin, blasEnd;
+thread_local bool didFindBlas = false;
+thread_local clang::SourceLocation blasBegin, blasEnd;
 
 
 
@@ -97,6 +200,155 @@ llvm::raw_ostream& SkePULog()
 }
 
 
+// ------------------------------
+// Incremental runs
+// ------------------------------
+
+// 64-bit FNV-1a as hex, stable across runs and standard library implementations
+std::string contentHash(const std::string &content)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned char c : content)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", hash);
+	return hex;
+}
+
+bool fileHash(const std::string &path, std::string &hash)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	hash = contentHash(std::string{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()});
+	return true;
+}
+
+static std::string stampFileName()
+{
+	return mainFileName + ".skepu-stamp";
+}
+
+/*!
+ * The stamp lists the hash of the command line, the content hash of every file the source manager loaded and
+ * every file generated by the run. A later run with -incremental is skipped when all of these still match.
+ */
+static void writeIncrementalStamp(SourceManager &SM)
+{
+	std::stringstream stamp;
+	stamp << "options " << invocationHash << "\n";
+	for (auto it = SM.fileinfo_begin(); it != SM.fileinfo_end(); ++it)
+	{
+		std::string path = it->first->getName().str(), hash;
+		if (fileHash(path, hash))
+			stamp << "input " << hash << " " << path << "\n";
+	}
+	// The headers parsed from the PCH are not loaded by the source manager
+	std::string pchHash;
+	if (!pchFileName.empty() && fileHash(pchFileName, pchHash))
+		stamp << "input " << pchHash << " " << pchFileName << "\n";
+	for (GeneratedFileRecord const& file : GeneratedFiles)
+		stamp << "output " << file.path << "\n";
+	
+	std::ofstream out(stampFileName());
+	out << stamp.str();
+}
+
+static bool upToDate()
+{
+	std::ifstream stamp(stampFileName());
+	std::string line;
+	if (!std::getline(stamp, line) || line != "options " + invocationHash)
+		return false;
+	
+	while (std::getline(stamp, line))
+	{
+		std::istringstream fields(line);
+		std::string kind, hash, path;
+		fields >> kind;
+		if (kind == "input")
+		{
+			fields >> hash >> std::ws;
+			std::getline(fields, path);
+			std::string current;
+			if (!fileHash(path, current) || current != hash)
+			{
+				SkePULog() << "Changed since the last run: " << path << "\n";
+				return false;
+			}
+		}
+		else if (kind == "output")
+		{
+			std::getline(fields >> std::ws, path);
+			if (!llvm::sys::fs::exists(path))
+			{
+				SkePULog() << "Missing output: " << path << "\n";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+// -time-report printout for one source file
+struct TimeReportData
+{
+	using Clock = std::chrono::steady_clock;
+
+	Clock::time_point begin;
+	size_t firstFile = 0;
+	double parsing = 0, fusion = 0, instances = 0, blas = 0, output = 0;
+	std::vector<std::pair<std::string, double>> instanceTimes;
+
+	static double since(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	void print(llvm::raw_ostream &os) const
+	{
+		std::vector<GeneratedFileRecord> files(GeneratedFiles.begin() + firstFile, GeneratedFiles.end());
+		std::sort(files.begin(), files.end(), [] (GeneratedFileRecord const& a, GeneratedFileRecord const& b) { return a.size > b.size; });
+
+		uint64_t totalBytes = 0;
+		size_t unchanged = 0;
+		for (auto const& file : files)
+		{
+			totalBytes += file.size;
+			unchanged += !file.written;
+		}
+
+		auto row = [&] (std::string name, double seconds)
+		{
+			os << llvm::format("  %10.4f s  ", seconds) << name << "\n";
+		};
+
+		os << "===-- SkePU time report: " << inputFileName << " --===\n";
+		row("Parsing and AST analysis", parsing);
+		row("Map chain fusion", fusion);
+		row("Skeleton instances", instances);
+		row("  CUDA kernel generation", KernelGenTime_CU);
+		row("  OpenCL kernel generation", KernelGenTime_CL);
+		row("  Other instance transformation", instances - KernelGenTime_CU - KernelGenTime_CL);
+		row("BLAS injection", blas);
+		row("Writing main output file", output);
+		row("Total", parsing + fusion + instances + blas + output);
+
+		os << "Skeleton instances (" << instanceTimes.size() << "):\n";
+		for (auto const& instance : instanceTimes)
+			row(instance.first, instance.second);
+
+		os << "Generated files (" << files.size() << ", " << totalBytes << " bytes, " << unchanged << " unchanged):\n";
+		for (auto const& file : files)
+			os << llvm::format("  %10llu B  ", (unsigned long long)file.size) << file.path << (file.written ? "" : " (unchanged)") << "\n";
+	}
+};
+
+
 // For each source file provided to the tool, a new FrontendAction is created.
 class SkePUFrontendAction : public ASTFrontendAction
 {
@@ -105,12 +357,19 @@ public:
 	bool BeginSourceFileAction(CompilerInstance &CI) override
 	{
 		inputFileName = this->getCurrentFile().str();
+		this->timeReport = TimeReportData{};
+		this->timeReport.begin = TimeReportData::Clock::now();
+		this->timeReport.firstFile = GeneratedFiles.size();
+		KernelGenTime_CU = KernelGenTime_CL = 0;
 		if (Verbose) SkePULog() << "** BeginSourceFileAction for: " << inputFileName << "\n";
 		return true;
 	}
 	
 	void EndSourceFileAction() override
 	{
+		this->timeReport.parsing = TimeReportData::since(this->timeReport.begin);
+		auto phaseStart = TimeReportData::Clock::now();
+
 		SourceManager &SM = GlobalRewriter.getSourceMgr();
 		SourceLocation SLStart = SM.getLocForStartOfFile(SM.getMainFileID());
 
@@ -118,14 +377,61 @@ public:
 		if (GenOMP)  GlobalRewriter.InsertText(SLStart, "#define SKEPU_OPENMP 1\n");
 		if (GenCL)   GlobalRewriter.InsertText(SLStart, "#define SKEPU_OPENCL 1\n");
 		if (GenCUDA) GlobalRewriter.InsertText(SLStart, "#define SKEPU_CUDA 1\n");
+		if (GenCUDA && SplitCUDA)
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_CUDA_SPLIT 1\n#include \"" + generateSplitCUDASupport(ResultDir) + "\"\n");
 		if (GenStarPUMPI) GlobalRewriter.InsertText(SLStart, "#define SKEPU_STARPU_MPI 1\n");
+		if (GenStarPUMPI && !StarPUPartitionInstances.empty())
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_STARPU_PARTITIONING 1\n#include \"" + generateStarPUMPISupport(ResultDir) + "\"\n");
 		if (GenMPI) GlobalRewriter.InsertText(SLStart, "#define SKEPU_MPI 1\n");
+		if (DeviceEviction && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_EVICTION 1\n#include \"" + generateEvictionSupport(ResultDir) + "\"\n");
+		if (TransferMetrics)
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_TRANSFER_METRICS 1\n#include \"" + generateMetricsSupport(ResultDir) + "\"\n");
+		if (DevicePoolMiB && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_DEVICE_POOL (size_t(" + std::to_string(DevicePoolMiB) + ") << 20)\n"
+				"#include \"" + generateDevicePoolSupport(ResultDir) + "\"\n");
+		if (PinnedHost && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_PINNED_HOST 1\n#include \"" + generatePinnedHostSupport(ResultDir) + "\"\n");
+		if (ZeroCopy && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_ZERO_COPY 1\n#include \"" + generateZeroCopySupport(ResultDir) + "\"\n");
+		if (Views)
+			GlobalRewriter.InsertText(SLStart, "#include \"" + generateViewsSupport(ResultDir) + "\"\n");
+		if (RangeCoherency && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_RANGE_COHERENCY 1\n#include \"" + generateRangeCoherencySupport(ResultDir) + "\"\n");
+		if (MappedIO)
+			GlobalRewriter.InsertText(SLStart, "#include \"" + generateMappedIOSupport(ResultDir) + "\"\n");
+		if (OMPPartials && GenOMP)
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_OMP_PARTIALS 1\n#include \"" + generatePartialsSupport(ResultDir) + "\"\n");
+		if (NUMA && GenOMP)
+			GlobalRewriter.InsertText(SLStart, "#define SKEPU_NUMA 1\n#include \"" + generateNUMASupport(ResultDir) + "\"\n");
+		if (Async && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#include \"" + generateAsyncSupport(ResultDir) + "\"\n");
+		if (Graphs && (GenCUDA || GenCL))
+			GlobalRewriter.InsertText(SLStart, "#include \"" + generateGraphSupport(ResultDir) + "\"\n");
 //		if (!DoNotGenLineDirectives)
 //			GlobalRewriter.InsertText(SLStart, "#line 1 \"" + inputFileName + "\"\n");
 		
+		if (FuseMaps)
+			FuseMapChains(this->SkeletonInstances);
+		if (FuseMapReduce)
+			FuseMapReduceChains(this->SkeletonInstances);
+		PairMapOverlapReductions(this->SkeletonInstances);
+		this->timeReport.fusion = TimeReportData::since(phaseStart);
+		
+		phaseStart = TimeReportData::Clock::now();
 		for (VarDecl *d : this->SkeletonInstances)
+		{
+			auto instanceStart = TimeReportData::Clock::now();
 			HandleSkeletonInstance(d);
+			if (TimeReport)
+			{
+				std::string line = std::to_string(SM.getSpellingLineNumber(d->getBeginLoc()));
+				this->timeReport.instanceTimes.emplace_back(d->getNameAsString() + " (line " + line + ")", TimeReportData::since(instanceStart));
+			}
+		}
+		this->timeReport.instances = TimeReportData::since(phaseStart);
 		
+		phaseStart = TimeReportData::Clock::now();
 		if (didFindBlas)
 		{
 			std::string blasTransformedCode = GlobalRewriter.getRewrittenText(SourceRange(blasBegin, blasEnd));
@@ -139,15 +445,35 @@ public:
 			
 			GlobalRewriter.InsertText(blasIncludeLoc, blasTransformedCode);
 		}
+		if (VendorBLAS)
+			RouteVendorBLASCalls();
+
+		this->timeReport.blas = TimeReportData::since(phaseStart);
 
 		if (Verbose) SkePULog() << "** EndSourceFileAction for: " << inputFileName << "\n";
 
+		phaseStart = TimeReportData::Clock::now();
+
+		// After all other rewriting, so that the guards enclose the code generated at each declaration
+		if (GenCUDA && SplitCUDA)
+			splitDeviceTranslationUnit_CU(this->getCompilerInstance().getASTContext(), this->SkeletonInstances, mainFileName);
+
 		// Now emit the rewritten buffer.
-		std::error_code EC;
-		llvm::raw_fd_ostream OutFile(
-			mainFileName, EC, llvm::sys::fs::FileAccess::FA_Write);
+		std::string mainSource;
+		llvm::raw_string_ostream OutFile(mainSource);
 		GlobalRewriter.getEditBuffer(SM.getMainFileID()).write(OutFile);
-		OutFile.close();
+		writeFileIfChanged(mainFileName, OutFile.str());
+		
+		if (Incremental)
+			writeIncrementalStamp(SM);
+		this->timeReport.output = TimeReportData::since(phaseStart);
+
+		if (TimeReport)
+		{
+			static std::mutex reportLock;
+			std::lock_guard<std::mutex> guard(reportLock);
+			this->timeReport.print(llvm::errs());
+		}
 	}
 
 	std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI, StringRef file) override
@@ -159,17 +485,59 @@ public:
 
 private:
 	std::unordered_set<clang::VarDecl *> SkeletonInstances;
+	TimeReportData timeReport;
 };
 
 
+/*!
+ * Runs the tool on one source file. Everything the transformation keeps between the AST visitor and the code
+ * generators is thread_local, so each worker of -j processes its translation units independently. The output names
+ * follow source as given, the compilation uses path.
+ */
+static int processSourceFile(tooling::CommonOptionsParser &op, std::string source, std::string path)
+{
+	ResultName = (ResultNameOption == "") ? source : std::string(ResultNameOption);
+	mainFileName = ResultDir + "/" + ResultName + (NoAddExtension ? "" : (GenCUDA && !SplitCUDA ? ".cu" : ".cpp"));
+
+	// Before the -incremental check, so that a rebuilt PCH shows up as a changed input
+	pchFileName = "";
+	if (UsePCH)
+	{
+		std::vector<tooling::CompileCommand> commands = op.getCompilations().getCompileCommands(path);
+		if (!commands.empty())
+			pchFileName = preparePCH(commands[0]);
+	}
+
+	if (Incremental && upToDate())
+	{
+		if (!Silent)
+			SkePULog() << "Outputs are up to date, see " << stampFileName() << "\n";
+		return 0;
+	}
+
+	tooling::ClangTool Tool(op.getCompilations(), {path});
+	// The working directory is process-wide, workers must not restore it under each other
+	if (Jobs > 1)
+		Tool.setRestoreWorkingDir(false);
+	if (!pchFileName.empty())
+		Tool.appendArgumentsAdjuster(tooling::getInsertArgumentAdjuster({"-include-pch", pchFileName}, tooling::ArgumentInsertPosition::BEGIN));
+	return Tool.run(tooling::newFrontendActionFactory<SkePUFrontendAction>().get());
+}
+
 int main(int argc, const char **argv)
 {
 	tooling::CommonOptionsParser op(argc, argv, SkePUCategory);
-	tooling::ClangTool Tool(op.getCompilations(), op.getSourcePathList());
+	std::vector<std::string> sources = op.getSourcePathList();
+
+	if (ResultNameOption != "" && sources.size() > 1)
+		SkePUAbort("-name can not be combined with multiple source files, as they would share one main output file");
 
-	if (ResultName == "")
-		ResultName = op.getSourcePathList()[0];
-	mainFileName = ResultDir + "/" + ResultName + (NoAddExtension ? "" : (GenCUDA ? ".cu" : ".cpp"));
+	// The verbose log goes to llvm::outs(), which is not safe to share between threads
+	if (Verbose && Jobs > 1)
+	{
+		SkePULog() << "-verbose is set, processing source files sequentially\n";
+		Jobs = 1;
+	}
 
 	if (!Silent)
 	{
@@ -180,14 +548,69 @@ int main(int argc, const char **argv)
 		SkePULog() << "   CUDA gen:         " << (GenCUDA ? "ON" : "OFF") << "\n";
 		SkePULog() << "   OpenCL gen:       " << (GenCL ? "ON" : "OFF") << "\n";
 		SkePULog() << "   StarPU-MPI gen:   " << (GenStarPUMPI ? "ON" : "OFF") << "\n";
-		SkePULog() << "   Main output file: " << mainFileName << "\n";
+		for (std::string &source : sources)
+			SkePULog() << "   Main output file: " << ResultDir << "/" << (ResultNameOption == "" ? source : std::string(ResultNameOption)) << (NoAddExtension ? "" : (GenCUDA && !SplitCUDA ? ".cu" : ".cpp")) << "\n";
 		SkePULog() << "# ======================================= #\n";
 	}
 
+	if (Incremental)
+	{
+		std::string invocation;
+		for (int i = 0; i < argc; ++i)
+			invocation += std::string(argv[i]) + '\0';
+		invocationHash = contentHash(invocation);
+	}
+
 	std::istringstream SSNames(AllowedFuncNames);
 	std::vector<std::string> Names{std::istream_iterator<std::string>{SSNames}, std::istream_iterator<std::string>{}};
 	for (std::string &name : Names)
 		AllowedFunctionNamesCalledInUFs.insert(name);
 
-	return Tool.run(tooling::newFrontendActionFactory<SkePUFrontendAction>().get());
+	if (Jobs <= 1 || sources.size() <= 1)
+	{
+		int result = 0;
+		for (std::string &source : sources)
+			result |= processSourceFile(op, source, source);
+		return result;
+	}
+
+	// ClangTool changes into the directory of each compile command and the working directory is process-wide, so the
+	// workers need one such directory for all sources, and paths resolved before the first worker changes into it
+	std::vector<std::string> paths;
+	std::string directory;
+	for (std::string &source : sources)
+	{
+		llvm::SmallString<256> path(source);
+		llvm::sys::fs::make_absolute(path);
+		paths.push_back(path.str().str());
+		for (const tooling::CompileCommand &command : op.getCompilations().getCompileCommands(paths.back()))
+		{
+			if (directory.empty())
+				directory = command.Directory;
+			else if (command.Directory != directory)
+				SkePUAbort("-j requires the compile commands of all source files to share one directory, " + source
+					+ " is compiled in " + command.Directory + " and an earlier one in " + directory);
+		}
+	}
+	if (ResultDir != "")
+	{
+		llvm::SmallString<256> dir(ResultDir.getValue());
+		llvm::sys::fs::make_absolute(dir);
+		ResultDir = dir.str().str();
+	}
+
+	// Workers take the next unprocessed source file until all are done
+	std::atomic<size_t> next{0};
+	std::atomic<int> result{0};
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < std::min<size_t>(Jobs, sources.size()); ++i)
+		workers.emplace_back([&]
+		{
+			for (size_t index; (index = next++) < sources.size();)
+				if (processSourceFile(op, sources[index], paths[index]))
+					result = 1;
+		});
+	for (std::thread &worker : workers)
+		worker.join();
+	return result;
 }
@@ -0,0 +1,134 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Host side of the Sort skeleton. skepu::sort::cpu and ::omp sort n keys in place by the generated comparator,
+ * stably, and key-value sorts move values[i] along with keys[i]. The OpenMP variant sorts one chunk of the keys
+ * per thread and then merges pairs of sorted chunks in parallel rounds between the keys and one buffer, the CPU
+ * counterpart of the block sort and merge passes of the GPU kernels; ties keep the earlier chunk first. Key-value
+ * sorts go through (key, value) pairs, so the values are moved once rather than gathered per round.
+ */
+static const char *SortSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifdef SKEPU_OPENMP
+#include <omp.h>
+#endif
+
+namespace skepu
+{
+	namespace sort
+	{
+		template<typename Less>
+		struct HostLess
+		{
+			template<typename Key>
+			bool operator()(Key const& a, Key const& b) const { return Less::CPU(a, b); }
+
+			template<typename Key, typename Value>
+			bool operator()(std::pair<Key, Value> const& a, std::pair<Key, Value> const& b) const { return Less::CPU(a.first, b.first); }
+		};
+
+		template<typename Less, typename Key>
+		void cpu(Key *keys, size_t n)
+		{
+			std::stable_sort(keys, keys + n, HostLess<Less>{});
+		}
+
+		template<typename Less, typename Key, typename Value>
+		void cpu(Key *keys, Value *values, size_t n)
+		{
+			std::vector<std::pair<Key, Value>> pairs(n);
+			for (size_t i = 0; i < n; ++i)
+				pairs[i] = std::make_pair(keys[i], values[i]);
+			std::stable_sort(pairs.begin(), pairs.end(), HostLess<Less>{});
+			for (size_t i = 0; i < n; ++i)
+			{
+				keys[i] = pairs[i].first;
+				values[i] = pairs[i].second;
+			}
+		}
+
+#ifdef SKEPU_OPENMP
+		template<typename Less>
+		struct ParallelLess
+		{
+			template<typename Key>
+			bool operator()(Key const& a, Key const& b) const { return Less::OMP(a, b); }
+
+			template<typename Key, typename Value>
+			bool operator()(std::pair<Key, Value> const& a, std::pair<Key, Value> const& b) const { return Less::OMP(a.first, b.first); }
+		};
+
+		template<typename Less, typename T>
+		void mergeSort(T *data, size_t n)
+		{
+			const size_t chunks = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), n));
+			std::vector<size_t> bounds(chunks + 1);
+			for (size_t c = 0; c <= chunks; ++c)
+				bounds[c] = n * c / chunks;
+
+#pragma omp parallel for schedule(static)
+			for (size_t c = 0; c < chunks; ++c)
+				std::stable_sort(data + bounds[c], data + bounds[c + 1], ParallelLess<Less>{});
+
+			std::vector<T> buffer(chunks > 1 ? n : 0);
+			T *from = data, *to = buffer.data();
+			for (size_t width = 1; width < chunks; width *= 2)
+			{
+#pragma omp parallel for schedule(static)
+				for (size_t c = 0; c < chunks; c += 2 * width)
+				{
+					size_t lo = bounds[c], mid = bounds[std::min(c + width, chunks)], hi = bounds[std::min(c + 2 * width, chunks)];
+					std::merge(from + lo, from + mid, from + mid, from + hi, to + lo, ParallelLess<Less>{});
+				}
+				std::swap(from, to);
+			}
+			if (from != data)
+				std::copy(from, from + n, data);
+		}
+
+		template<typename Less, typename Key>
+		void omp(Key *keys, size_t n)
+		{
+			mergeSort<Less>(keys, n);
+		}
+
+		template<typename Less, typename Key, typename Value>
+		void omp(Key *keys, Value *values, size_t n)
+		{
+			std::vector<std::pair<Key, Value>> pairs(n);
+#pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < n; ++i)
+				pairs[i] = std::make_pair(keys[i], values[i]);
+			mergeSort<Less>(pairs.data(), n);
+#pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < n; ++i)
+			{
+				keys[i] = pairs[i].first;
+				values[i] = pairs[i].second;
+			}
+		}
+#endif
+	}
+}
+)~~~";
+
+
+std::string generateSortSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_sort.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << SortSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,414 @@
+#include "code_gen.h"
+#include "code_gen_cl.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+// Same merge-path sort as the CUDA kernels, see sort_cu.cpp. Null index buffers are passed as skepu_hasIndices = 0.
+static const char *SortKernelTemplate_CL = R"~~~(
+__kernel void {{KERNEL_NAME}}_BlockSort(__global {{KEY_TYPE}} *skepu_keys, __global unsigned int *skepu_indices, int skepu_hasIndices, size_t skepu_n, __local {{KEY_TYPE}} *skepu_tile)
+{
+	size_t skepu_tid = get_local_id(0);
+	size_t skepu_blockSize = get_local_size(0);
+
+	for (size_t skepu_base = get_group_id(0) * skepu_blockSize; skepu_base < skepu_n; skepu_base += skepu_blockSize * get_num_groups(0))
+	{
+		size_t skepu_count = min(skepu_blockSize, skepu_n - skepu_base);
+		{{KEY_TYPE}} skepu_key;
+		if (skepu_tid < skepu_count)
+			skepu_tile[skepu_tid] = skepu_key = skepu_keys[skepu_base + skepu_tid];
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (skepu_tid < skepu_count)
+		{
+			size_t skepu_rank = 0;
+			for (size_t skepu_j = 0; skepu_j < skepu_count; ++skepu_j)
+				if ({{FUNCTION_NAME_LESS}}(skepu_tile[skepu_j], skepu_key) || (skepu_j < skepu_tid && !{{FUNCTION_NAME_LESS}}(skepu_key, skepu_tile[skepu_j])))
+					++skepu_rank;
+			skepu_keys[skepu_base + skepu_rank] = skepu_key;
+			if (skepu_hasIndices)
+				skepu_indices[skepu_base + skepu_rank] = skepu_base + skepu_tid;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+	}
+}
+
+__kernel void {{KERNEL_NAME}}_MergePass(__global const {{KEY_TYPE}} * restrict skepu_in, __global {{KEY_TYPE}} *skepu_out, __global const unsigned int *skepu_indexIn, __global unsigned int *skepu_indexOut,
+	int skepu_hasIndices, size_t skepu_n, size_t skepu_width)
+{
+	for (size_t skepu_k = get_global_id(0); skepu_k < skepu_n; skepu_k += get_global_size(0))
+	{
+		size_t skepu_start = skepu_k / (2 * skepu_width) * (2 * skepu_width);
+		size_t skepu_mid = min(skepu_start + skepu_width, skepu_n), skepu_stop = min(skepu_start + 2 * skepu_width, skepu_n);
+		size_t skepu_la = skepu_mid - skepu_start, skepu_lb = skepu_stop - skepu_mid, skepu_d = skepu_k - skepu_start;
+		__global const {{KEY_TYPE}} *skepu_a = skepu_in + skepu_start, *skepu_b = skepu_in + skepu_mid;
+
+		size_t skepu_lo = skepu_d > skepu_lb ? skepu_d - skepu_lb : 0, skepu_hi = min(skepu_d, skepu_la);
+		while (skepu_lo < skepu_hi)
+		{
+			size_t skepu_m = (skepu_lo + skepu_hi) / 2;
+			if ({{FUNCTION_NAME_LESS}}(skepu_b[skepu_d - 1 - skepu_m], skepu_a[skepu_m]))
+				skepu_hi = skepu_m;
+			else
+				skepu_lo = skepu_m + 1;
+		}
+		size_t skepu_i = skepu_lo, skepu_j = skepu_d - skepu_lo;
+		bool skepu_first = skepu_j >= skepu_lb || (skepu_i < skepu_la && !{{FUNCTION_NAME_LESS}}(skepu_b[skepu_j], skepu_a[skepu_i]));
+		skepu_out[skepu_k] = skepu_first ? skepu_a[skepu_i] : skepu_b[skepu_j];
+		if (skepu_hasIndices)
+			skepu_indexOut[skepu_k] = skepu_indexIn[skepu_start + (skepu_first ? skepu_i : skepu_la + skepu_j)];
+	}
+}
+
+__kernel void {{KERNEL_NAME}}_Permute(__global const char * restrict skepu_in, __global char *skepu_out, __global const unsigned int *skepu_indices, size_t skepu_n, size_t skepu_bytes)
+{
+	for (size_t skepu_k = get_global_id(0); skepu_k < skepu_n * skepu_bytes; skepu_k += get_global_size(0))
+		skepu_out[skepu_k] = skepu_in[skepu_indices[skepu_k / skepu_bytes] * skepu_bytes + skepu_k % skepu_bytes];
+}
+{{RADIX_KERNELS}}
+)~~~";
+
+// Same radix passes as the CUDA kernels; without warp ballots, the scatter ranks each key among the digits of the
+// tile before it in local memory. skepu_firstPass stands for the null index input of the CUDA kernels.
+static const char *SortRadixKernels_CL = R"~~~(
+{{BITS_TYPE}} {{KERNEL_NAME}}_Bits({{KEY_TYPE}} skepu_key)
+{
+	{{BITS_TYPE}} skepu_bits = {{BITS_OF_KEY}};
+	return {{BITS_ORDER}};
+}
+
+size_t {{KERNEL_NAME}}_Chunk(size_t skepu_n)
+{
+	size_t skepu_perBlock = (skepu_n + get_num_groups(0) - 1) / get_num_groups(0);
+	return (skepu_perBlock + get_local_size(0) - 1) / get_local_size(0) * get_local_size(0);
+}
+
+__kernel void {{KERNEL_NAME}}_RadixCount(__global const {{KEY_TYPE}} * restrict skepu_keys, __global unsigned int *skepu_counts, size_t skepu_n, unsigned int skepu_shift)
+{
+	__local unsigned int skepu_digits[16];
+	size_t skepu_tid = get_local_id(0);
+	if (skepu_tid < 16)
+		skepu_digits[skepu_tid] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	size_t skepu_chunk = {{KERNEL_NAME}}_Chunk(skepu_n);
+	size_t skepu_begin = get_group_id(0) * skepu_chunk, skepu_end = min(skepu_n, skepu_begin + skepu_chunk);
+	for (size_t skepu_i = skepu_begin + skepu_tid; skepu_i < skepu_end; skepu_i += get_local_size(0))
+		atomic_inc(&skepu_digits[({{KERNEL_NAME}}_Bits(skepu_keys[skepu_i]) >> skepu_shift) & 15]);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (skepu_tid < 16)
+		skepu_counts[skepu_tid * get_num_groups(0) + get_group_id(0)] = skepu_digits[skepu_tid];
+}
+
+__kernel void {{KERNEL_NAME}}_RadixOffsets(__global unsigned int *skepu_counts, size_t skepu_numCounts, __local unsigned int *skepu_scan)
+{
+	__local unsigned int skepu_carry;
+	size_t skepu_tid = get_local_id(0);
+	size_t skepu_blockSize = get_local_size(0);
+	if (skepu_tid == 0)
+		skepu_carry = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t skepu_base = 0; skepu_base < skepu_numCounts; skepu_base += skepu_blockSize)
+	{
+		unsigned int skepu_count = skepu_base + skepu_tid < skepu_numCounts ? skepu_counts[skepu_base + skepu_tid] : 0;
+		skepu_scan[skepu_tid] = skepu_count;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		for (size_t skepu_offset = 1; skepu_offset < skepu_blockSize; skepu_offset *= 2)
+		{
+			unsigned int skepu_add = skepu_tid >= skepu_offset ? skepu_scan[skepu_tid - skepu_offset] : 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			skepu_scan[skepu_tid] += skepu_add;
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+		if (skepu_base + skepu_tid < skepu_numCounts)
+			skepu_counts[skepu_base + skepu_tid] = skepu_carry + skepu_scan[skepu_tid] - skepu_count;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (skepu_tid == skepu_blockSize - 1)
+			skepu_carry += skepu_scan[skepu_tid];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+__kernel void {{KERNEL_NAME}}_RadixScatter(__global const {{KEY_TYPE}} * restrict skepu_keysIn, __global {{KEY_TYPE}} *skepu_keysOut, __global const unsigned int *skepu_indexIn, __global unsigned int *skepu_indexOut,
+	int skepu_hasIndices, int skepu_firstPass, __global const unsigned int *skepu_offsets, size_t skepu_n, unsigned int skepu_shift, __local unsigned int *skepu_tileDigits)
+{
+	__local unsigned int skepu_next[16];
+	size_t skepu_tid = get_local_id(0);
+	size_t skepu_blockSize = get_local_size(0);
+	if (skepu_tid < 16)
+		skepu_next[skepu_tid] = skepu_offsets[skepu_tid * get_num_groups(0) + get_group_id(0)];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	size_t skepu_chunk = {{KERNEL_NAME}}_Chunk(skepu_n);
+	size_t skepu_begin = get_group_id(0) * skepu_chunk, skepu_end = min(skepu_n, skepu_begin + skepu_chunk);
+	for (size_t skepu_tile = skepu_begin; skepu_tile < skepu_end; skepu_tile += skepu_blockSize)
+	{
+		size_t skepu_i = skepu_tile + skepu_tid;
+		{{KEY_TYPE}} skepu_key;
+		unsigned int skepu_digit = 16;
+		if (skepu_i < skepu_end)
+		{
+			skepu_key = skepu_keysIn[skepu_i];
+			skepu_digit = ({{KERNEL_NAME}}_Bits(skepu_key) >> skepu_shift) & 15;
+		}
+		skepu_tileDigits[skepu_tid] = skepu_digit;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		unsigned int skepu_position = 0;
+		if (skepu_i < skepu_end)
+		{
+			skepu_position = skepu_next[skepu_digit];
+			for (size_t skepu_j = 0; skepu_j < skepu_tid; ++skepu_j)
+				skepu_position += skepu_tileDigits[skepu_j] == skepu_digit;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// One work-item per digit advances it past the tile
+		if (skepu_tid < 16)
+		{
+			unsigned int skepu_count = 0;
+			for (size_t skepu_j = 0; skepu_j < skepu_blockSize; ++skepu_j)
+				skepu_count += skepu_tileDigits[skepu_j] == skepu_tid;
+			skepu_next[skepu_tid] += skepu_count;
+		}
+
+		if (skepu_i < skepu_end)
+		{
+			skepu_keysOut[skepu_position] = skepu_key;
+			if (skepu_hasIndices)
+				skepu_indexOut[skepu_position] = skepu_firstPass ? (unsigned int)skepu_i : skepu_indexIn[skepu_i];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+)~~~";
+
+
+const std::string Constructor = R"~~~(
+class {{KERNEL_CLASS}}
+{
+public:
+
+	enum
+	{
+		KERNEL_BLOCK_SORT = 0,
+		KERNEL_MERGE_PASS,
+		KERNEL_PERMUTE,
+		KERNEL_RADIX_COUNT,
+		KERNEL_RADIX_OFFSETS,
+		KERNEL_RADIX_SCATTER,
+		KERNEL_COUNT
+	};
+
+	// Radix sorting applies to comparators 'a < b' and 'a > b' on arithmetic keys, the radix kernels exist only then
+	static constexpr bool radix = {{RADIX}};
+
+	static skepu_cl_kernel_table<KERNEL_COUNT> &skepu_kernel_table()
+	{
+		static skepu_cl_kernel_table<KERNEL_COUNT> table(skepu_build);
+		return table;
+	}
+
+	static cl_kernel kernels(size_t deviceID, size_t kerneltype, cl_kernel *newkernel = nullptr)
+	{
+		if (newkernel)
+		{
+			skepu_kernel_table().set(deviceID, kerneltype, *newkernel);
+			return nullptr;
+		}
+		else return skepu_kernel_table().get(deviceID, kerneltype);
+	}
+
+	static const std::string &skepu_source()
+	{
+		static const std::string source = skepu::backend::cl_helpers::replaceSizeT(R"###({{OPENCL_KERNEL}})###");
+		return source;
+	}
+
+	// Builds the code and creates the kernels for one device
+	static void skepu_build(size_t deviceID)
+	{
+		skepu::backend::Device_CL *device = skepu::backend::Environment<int>::getInstance()->m_devices_CL.at(deviceID);
+		cl_int err;
+		cl_program program = skepu_cl_build_program(device, skepu_source());
+		const char *names[KERNEL_COUNT] = {"{{KERNEL_NAME}}_BlockSort", "{{KERNEL_NAME}}_MergePass", "{{KERNEL_NAME}}_Permute",
+			"{{KERNEL_NAME}}_RadixCount", "{{KERNEL_NAME}}_RadixOffsets", "{{KERNEL_NAME}}_RadixScatter"};
+
+		for (size_t k = 0; k < (radix ? KERNEL_COUNT : KERNEL_RADIX_COUNT); ++k)
+		{
+			cl_kernel kernel = clCreateKernel(program, names[k], &err);
+			CL_CHECK_ERROR(err, std::string("Error creating Sort kernel '") + names[k] + "'");
+			kernels(deviceID, k, &kernel);
+		}
+	}
+
+	// Programs are built lazily, the first time a device looks up one of the kernels
+	static void initialize()
+	{
+		skepu_kernel_table();
+	}
+
+	// Builds the programs for the given devices ahead of first use, concurrently
+	static void prepare(std::vector<size_t> const& deviceIDs)
+	{
+		skepu_kernel_table().prepare(deviceIDs);
+	}
+
+	// A null skepu_indices sorts the keys only
+	static void blockSort
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{KEY_TYPE}}> *skepu_keys, skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_indices, size_t skepu_n
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_BLOCK_SORT);
+		skepu_cl_set_kernel_args(kernel, skepu_keys->getDeviceDataPointer(), skepu_indices ? skepu_indices->getDeviceDataPointer() : skepu_keys->getDeviceDataPointer(),
+			(int)(skepu_indices != nullptr), skepu_n);
+		clSetKernelArg(kernel, 4, sizeof({{KEY_TYPE}}) * localSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Sort block kernel");
+	}
+
+	static void mergePass
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{KEY_TYPE}}> *skepu_in, skepu::backend::DeviceMemPointer_CL<{{KEY_TYPE}}> *skepu_out,
+		skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_indexIn, skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_indexOut,
+		size_t skepu_n, size_t skepu_width
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_MERGE_PASS);
+		bool indexed = skepu_indexIn && skepu_indexOut;
+		skepu_cl_set_kernel_args(kernel, skepu_in->getDeviceDataPointer(), skepu_out->getDeviceDataPointer(),
+			indexed ? skepu_indexIn->getDeviceDataPointer() : skepu_in->getDeviceDataPointer(), indexed ? skepu_indexOut->getDeviceDataPointer() : skepu_out->getDeviceDataPointer(),
+			(int)indexed, skepu_n, skepu_width);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Sort merge kernel");
+	}
+
+	// Gathers the values of a key-value sort in the sorted order of the keys
+	template<typename Value>
+	static void permute
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<Value> *skepu_in, skepu::backend::DeviceMemPointer_CL<Value> *skepu_out,
+		skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_indices, size_t skepu_n
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_PERMUTE);
+		skepu_cl_set_kernel_args(kernel, skepu_in->getDeviceDataPointer(), skepu_out->getDeviceDataPointer(), skepu_indices->getDeviceDataPointer(), skepu_n, sizeof(Value));
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Sort permute kernel");
+	}
+
+	// skepu_counts holds 16 digit counts per work-group
+	static void radixCount
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{KEY_TYPE}}> *skepu_keys, skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_counts, size_t skepu_n, unsigned int skepu_shift
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_RADIX_COUNT);
+		skepu_cl_set_kernel_args(kernel, skepu_keys->getDeviceDataPointer(), skepu_counts->getDeviceDataPointer(), skepu_n, skepu_shift);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Sort radix count kernel");
+	}
+
+	// One work-group
+	static void radixOffsets
+	(
+		size_t deviceID, size_t localSize,
+		skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_counts, size_t skepu_numCounts
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_RADIX_OFFSETS);
+		skepu_cl_set_kernel_args(kernel, skepu_counts->getDeviceDataPointer(), skepu_numCounts);
+		clSetKernelArg(kernel, 2, sizeof(unsigned int) * localSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &localSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Sort radix offsets kernel");
+	}
+
+	// Same work sizes as radixCount; a null skepu_indexIn starts the indices at the key positions
+	static void radixScatter
+	(
+		size_t deviceID, size_t localSize, size_t globalSize,
+		skepu::backend::DeviceMemPointer_CL<{{KEY_TYPE}}> *skepu_keysIn, skepu::backend::DeviceMemPointer_CL<{{KEY_TYPE}}> *skepu_keysOut,
+		skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_indexIn, skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_indexOut,
+		skepu::backend::DeviceMemPointer_CL<unsigned int> *skepu_offsets, size_t skepu_n, unsigned int skepu_shift
+	)
+	{
+		cl_kernel kernel = kernels(deviceID, KERNEL_RADIX_SCATTER);
+		cl_mem indexOut = skepu_indexOut ? skepu_indexOut->getDeviceDataPointer() : skepu_keysOut->getDeviceDataPointer();
+		skepu_cl_set_kernel_args(kernel, skepu_keysIn->getDeviceDataPointer(), skepu_keysOut->getDeviceDataPointer(),
+			skepu_indexIn ? skepu_indexIn->getDeviceDataPointer() : indexOut, indexOut,
+			(int)(skepu_indexOut != nullptr), (int)(skepu_indexIn == nullptr), skepu_offsets->getDeviceDataPointer(), skepu_n, skepu_shift);
+		clSetKernelArg(kernel, 9, sizeof(unsigned int) * localSize, NULL);
+		cl_int err = SKEPU_CL_ENQUEUE_KERNEL(SKEPU_CL_QUEUE(deviceID), kernel, 1, NULL, &globalSize, &localSize, 0, NULL, SKEPU_CL_EVENT);
+		CL_CHECK_ERROR(err, "Error launching Sort radix scatter kernel");
+	}
+};
+)~~~";
+
+
+std::string createSortKernelProgram_CL(SkeletonInstance &instance, UserFunction &comparator, std::string dir)
+{
+	std::stringstream sourceStream;
+	const SortRadix radix = sortRadixOf(comparator);
+
+	sourceStream << precisionExtensions_CL({&comparator});
+
+	// Include user constants as preprocessor macros
+	for (auto pair : UserConstants)
+		sourceStream << "#define " << pair.second->name << " (" << pair.second->definition << ") // " << pair.second->typeName << "\n";
+
+	for (UserType *RefType : comparator.ReferencedUTs)
+		sourceStream << generateUserTypeCode_CL(*RefType);
+
+	std::vector<std::pair<std::string, std::string>> replacements
+	{
+		{"{{RADIX_KERNELS}}", radix.radix ? SortRadixKernels_CL : ""}
+	};
+	if (radix.radix)
+	{
+		const bool wide = radix.bytes > 4;
+		const std::string bitsType = wide ? "ulong" : "uint";
+		const std::string sign = wide ? "0x8000000000000000ul" : "0x80000000u";
+		std::string bitsOfKey, bitsOrder = "skepu_bits";
+		if (radix.floating)
+		{
+			bitsOfKey = wide ? "as_ulong(skepu_key)" : "as_uint(skepu_key)";
+			bitsOrder = "(skepu_bits & " + sign + ") ? ~skepu_bits : skepu_bits ^ " + sign;
+		}
+		else if (radix.isSigned)
+		{
+			bitsOfKey = "(" + bitsType + ")(" + (wide ? "long" : "int") + ")skepu_key";
+			bitsOrder = "skepu_bits ^ " + sign;
+		}
+		else
+			bitsOfKey = "(" + bitsType + ")skepu_key";
+		if (radix.descending)
+			bitsOrder = "~(" + bitsOrder + ")";
+
+		replacements.emplace_back("{{BITS_TYPE}}", bitsType);
+		replacements.emplace_back("{{BITS_OF_KEY}}", bitsOfKey);
+		replacements.emplace_back("{{BITS_ORDER}}", bitsOrder);
+	}
+
+	sourceStream << KernelPredefinedTypes_CL << generateUserFunctionCode_CL(comparator) << templateString(SortKernelTemplate_CL, replacements);
+
+	const std::string kernelName = instance + "_" + transformToCXXIdentifier(ResultName) + "_SortKernel_" + comparator.uniqueName;
+	return writeKernelProgram_CL(kernelName, templateString(Constructor,
+	{
+		{"{{OPENCL_KERNEL}}",      sourceStream.str()},
+		{"{{KERNEL_CLASS}}",       "CLWrapperClass_" + kernelName},
+		{"{{RADIX}}",              radix.radix ? "true" : "false"},
+		{"{{KEY_TYPE}}",           comparator.elwiseParams[0].typeNameOpenCL()},
+		{"{{KERNEL_NAME}}",        kernelName},
+		{"{{FUNCTION_NAME_LESS}}", comparator.uniqueName}
+	}), dir);
+}
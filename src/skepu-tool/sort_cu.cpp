@@ -0,0 +1,261 @@
+#include "code_gen.h"
+#include "code_gen_cu.h"
+
+using namespace clang;
+
+// ------------------------------
+// Kernel templates
+// ------------------------------
+
+/*!
+ *  Merge-path sort for any comparator. _BlockSort sorts tiles of blockDim.x keys in place, each thread placing
+ *  its key at its stable rank within the tile; dynamic shared memory: blockDim.x * sizeof(key). _MergePass then
+ *  merges pairs of sorted runs of skepu_width keys from skepu_in into skepu_out, every output element finding
+ *  its split between the two runs by a binary search along its diagonal, and is launched with skepu_width
+ *  doubling from blockDim.x until one run covers skepu_n. Ties take the first run, so the sort is stable.
+ *
+ *  Key-value sorts carry the original position of every key in skepu_indices: _BlockSort starts them and each
+ *  pass moves them with the keys, and _Permute finally gathers the values, as raw bytes of skepu_bytes each, in
+ *  the sorted order. Keys-only sorts pass null index pointers.
+ */
+static const char *SortKernelTemplate_CU = R"~~~(
+__global__ void {{KERNEL_NAME}}_BlockSort({{KEY_TYPE}} *skepu_keys, unsigned int *skepu_indices, size_t skepu_n)
+{
+	extern __shared__ char {{SHARED_BUFFER}}[];
+	{{KEY_TYPE}} *skepu_tile = reinterpret_cast<{{KEY_TYPE}}*>({{SHARED_BUFFER}});
+	size_t skepu_tid = threadIdx.x;
+
+	for (size_t skepu_base = blockIdx.x * blockDim.x; skepu_base < skepu_n; skepu_base += blockDim.x * gridDim.x)
+	{
+		size_t skepu_count = min((size_t)blockDim.x, skepu_n - skepu_base);
+		{{KEY_TYPE}} skepu_key;
+		if (skepu_tid < skepu_count)
+			skepu_tile[skepu_tid] = skepu_key = skepu_keys[skepu_base + skepu_tid];
+		__syncthreads();
+
+		if (skepu_tid < skepu_count)
+		{
+			size_t skepu_rank = 0;
+			for (size_t skepu_j = 0; skepu_j < skepu_count; ++skepu_j)
+				if ({{FUNCTION_NAME_LESS}}(skepu_tile[skepu_j], skepu_key) || (skepu_j < skepu_tid && !{{FUNCTION_NAME_LESS}}(skepu_key, skepu_tile[skepu_j])))
+					++skepu_rank;
+			skepu_keys[skepu_base + skepu_rank] = skepu_key;
+			if (skepu_indices)
+				skepu_indices[skepu_base + skepu_rank] = skepu_base + skepu_tid;
+		}
+		__syncthreads();
+	}
+}
+
+__global__ void {{KERNEL_NAME}}_MergePass(const {{KEY_TYPE}} * __restrict__ skepu_in, {{KEY_TYPE}} *skepu_out, const unsigned int *skepu_indexIn, unsigned int *skepu_indexOut, size_t skepu_n, size_t skepu_width)
+{
+	for (size_t skepu_k = blockIdx.x * blockDim.x + threadIdx.x; skepu_k < skepu_n; skepu_k += blockDim.x * gridDim.x)
+	{
+		size_t skepu_start = skepu_k / (2 * skepu_width) * (2 * skepu_width);
+		size_t skepu_mid = min(skepu_start + skepu_width, skepu_n), skepu_stop = min(skepu_start + 2 * skepu_width, skepu_n);
+		size_t skepu_la = skepu_mid - skepu_start, skepu_lb = skepu_stop - skepu_mid, skepu_d = skepu_k - skepu_start;
+		const {{KEY_TYPE}} *skepu_a = skepu_in + skepu_start, *skepu_b = skepu_in + skepu_mid;
+
+		// Number of elements of the first run among the first skepu_d outputs
+		size_t skepu_lo = skepu_d > skepu_lb ? skepu_d - skepu_lb : 0, skepu_hi = min(skepu_d, skepu_la);
+		while (skepu_lo < skepu_hi)
+		{
+			size_t skepu_m = (skepu_lo + skepu_hi) / 2;
+			if ({{FUNCTION_NAME_LESS}}(skepu_b[skepu_d - 1 - skepu_m], skepu_a[skepu_m]))
+				skepu_hi = skepu_m;
+			else
+				skepu_lo = skepu_m + 1;
+		}
+		size_t skepu_i = skepu_lo, skepu_j = skepu_d - skepu_lo;
+		bool skepu_first = skepu_j >= skepu_lb || (skepu_i < skepu_la && !{{FUNCTION_NAME_LESS}}(skepu_b[skepu_j], skepu_a[skepu_i]));
+		skepu_out[skepu_k] = skepu_first ? skepu_a[skepu_i] : skepu_b[skepu_j];
+		if (skepu_indexOut)
+			skepu_indexOut[skepu_k] = skepu_indexIn[skepu_start + (skepu_first ? skepu_i : skepu_la + skepu_j)];
+	}
+}
+
+__global__ void {{KERNEL_NAME}}_Permute(const char * __restrict__ skepu_in, char *skepu_out, const unsigned int *skepu_indices, size_t skepu_n, size_t skepu_bytes)
+{
+	for (size_t skepu_k = blockIdx.x * blockDim.x + threadIdx.x; skepu_k < skepu_n * skepu_bytes; skepu_k += blockDim.x * gridDim.x)
+		skepu_out[skepu_k] = skepu_in[skepu_indices[skepu_k / skepu_bytes] * skepu_bytes + skepu_k % skepu_bytes];
+}
+{{RADIX_KERNELS}}
+)~~~";
+
+/*!
+ *  LSD radix sort, four bits per pass from the least significant, of keys mapped to unsigned integers of the same
+ *  order by {{KERNEL_NAME}}_Bits. Each block owns a contiguous chunk of the keys, of whole tiles of blockDim.x.
+ *  _RadixCount counts the digits of its chunk into skepu_counts[digit * gridDim.x + block], _RadixOffsets turns
+ *  those counts into their exclusive prefix sums with the carried tile scan of the Scan kernels, one block,
+ *  dynamic shared memory blockDim.x * sizeof(unsigned int), and _RadixScatter moves every key to the offset of
+ *  its digit and block plus its rank among the keys of that digit before it, ranked per warp by ballot. The
+ *  three kernels of a pass use the same grid and block size, a multiple of 32. The scatter is stable, and the
+ *  indices of key-value sorts start in the first pass, whose null skepu_indexIn stands for positions.
+ */
+static const char *SortRadixKernels_CU = R"~~~(
+__device__ inline {{BITS_TYPE}} {{KERNEL_NAME}}_Bits({{KEY_TYPE}} skepu_key)
+{
+	{{BITS_TYPE}} skepu_bits = {{BITS_OF_KEY}};
+	return {{BITS_ORDER}};
+}
+
+__device__ inline size_t {{KERNEL_NAME}}_Chunk(size_t skepu_n)
+{
+	size_t skepu_perBlock = (skepu_n + gridDim.x - 1) / gridDim.x;
+	return (skepu_perBlock + blockDim.x - 1) / blockDim.x * blockDim.x;
+}
+
+__global__ void {{KERNEL_NAME}}_RadixCount(const {{KEY_TYPE}} * __restrict__ skepu_keys, unsigned int *skepu_counts, size_t skepu_n, unsigned int skepu_shift)
+{
+	__shared__ unsigned int skepu_digits[16];
+	size_t skepu_tid = threadIdx.x;
+	if (skepu_tid < 16)
+		skepu_digits[skepu_tid] = 0;
+	__syncthreads();
+
+	size_t skepu_chunk = {{KERNEL_NAME}}_Chunk(skepu_n);
+	size_t skepu_begin = blockIdx.x * skepu_chunk, skepu_end = min(skepu_n, skepu_begin + skepu_chunk);
+	for (size_t skepu_i = skepu_begin + skepu_tid; skepu_i < skepu_end; skepu_i += blockDim.x)
+		atomicAdd(&skepu_digits[({{KERNEL_NAME}}_Bits(skepu_keys[skepu_i]) >> skepu_shift) & 15], 1u);
+	__syncthreads();
+
+	if (skepu_tid < 16)
+		skepu_counts[skepu_tid * gridDim.x + blockIdx.x] = skepu_digits[skepu_tid];
+}
+
+__global__ void {{KERNEL_NAME}}_RadixOffsets(unsigned int *skepu_counts, size_t skepu_numCounts)
+{
+	extern __shared__ unsigned int {{SHARED_BUFFER}}_scan[];
+	__shared__ unsigned int skepu_carry;
+	size_t skepu_tid = threadIdx.x;
+	if (skepu_tid == 0)
+		skepu_carry = 0;
+	__syncthreads();
+
+	for (size_t skepu_base = 0; skepu_base < skepu_numCounts; skepu_base += blockDim.x)
+	{
+		unsigned int skepu_count = skepu_base + skepu_tid < skepu_numCounts ? skepu_counts[skepu_base + skepu_tid] : 0;
+		{{SHARED_BUFFER}}_scan[skepu_tid] = skepu_count;
+		__syncthreads();
+		for (size_t skepu_offset = 1; skepu_offset < blockDim.x; skepu_offset *= 2)
+		{
+			unsigned int skepu_add = skepu_tid >= skepu_offset ? {{SHARED_BUFFER}}_scan[skepu_tid - skepu_offset] : 0;
+			__syncthreads();
+			{{SHARED_BUFFER}}_scan[skepu_tid] += skepu_add;
+			__syncthreads();
+		}
+		if (skepu_base + skepu_tid < skepu_numCounts)
+			skepu_counts[skepu_base + skepu_tid] = skepu_carry + {{SHARED_BUFFER}}_scan[skepu_tid] - skepu_count;
+		__syncthreads();
+		if (skepu_tid == blockDim.x - 1)
+			skepu_carry += {{SHARED_BUFFER}}_scan[skepu_tid];
+		__syncthreads();
+	}
+}
+
+__global__ void {{KERNEL_NAME}}_RadixScatter(const {{KEY_TYPE}} * __restrict__ skepu_keysIn, {{KEY_TYPE}} *skepu_keysOut, const unsigned int *skepu_indexIn, unsigned int *skepu_indexOut,
+	const unsigned int *skepu_offsets, size_t skepu_n, unsigned int skepu_shift)
+{
+	__shared__ unsigned int skepu_next[16];
+	__shared__ unsigned int skepu_warpOffsets[16][32];
+	size_t skepu_tid = threadIdx.x;
+	unsigned int skepu_lane = skepu_tid % 32, skepu_warp = skepu_tid / 32, skepu_numWarps = (blockDim.x + 31) / 32;
+	if (skepu_tid < 16)
+		skepu_next[skepu_tid] = skepu_offsets[skepu_tid * gridDim.x + blockIdx.x];
+	__syncthreads();
+
+	size_t skepu_chunk = {{KERNEL_NAME}}_Chunk(skepu_n);
+	size_t skepu_begin = blockIdx.x * skepu_chunk, skepu_end = min(skepu_n, skepu_begin + skepu_chunk);
+	for (size_t skepu_tile = skepu_begin; skepu_tile < skepu_end; skepu_tile += blockDim.x)
+	{
+		size_t skepu_i = skepu_tile + skepu_tid;
+		{{KEY_TYPE}} skepu_key;
+		unsigned int skepu_digit = 16, skepu_rank = 0;
+		if (skepu_i < skepu_end)
+		{
+			skepu_key = skepu_keysIn[skepu_i];
+			skepu_digit = ({{KERNEL_NAME}}_Bits(skepu_key) >> skepu_shift) & 15;
+		}
+
+		for (unsigned int skepu_d = 0; skepu_d < 16; ++skepu_d)
+		{
+			unsigned int skepu_mask = __ballot_sync(0xffffffff, skepu_digit == skepu_d);
+			if (skepu_digit == skepu_d)
+				skepu_rank = __popc(skepu_mask & ((1u << skepu_lane) - 1));
+			if (skepu_lane == 0)
+				skepu_warpOffsets[skepu_d][skepu_warp] = __popc(skepu_mask);
+		}
+		__syncthreads();
+
+		// One thread per digit turns the warp counts into offsets and advances the digit past the tile
+		if (skepu_tid < 16)
+		{
+			unsigned int skepu_running = skepu_next[skepu_tid];
+			for (unsigned int skepu_w = 0; skepu_w < skepu_numWarps; ++skepu_w)
+			{
+				unsigned int skepu_count = skepu_warpOffsets[skepu_tid][skepu_w];
+				skepu_warpOffsets[skepu_tid][skepu_w] = skepu_running;
+				skepu_running += skepu_count;
+			}
+			skepu_next[skepu_tid] = skepu_running;
+		}
+		__syncthreads();
+
+		if (skepu_i < skepu_end)
+		{
+			unsigned int skepu_position = skepu_warpOffsets[skepu_digit][skepu_warp] + skepu_rank;
+			skepu_keysOut[skepu_position] = skepu_key;
+			if (skepu_indexOut)
+				skepu_indexOut[skepu_position] = skepu_indexIn ? skepu_indexIn[skepu_i] : (unsigned int)skepu_i;
+		}
+		__syncthreads();
+	}
+}
+)~~~";
+
+
+std::string createSortKernelProgram_CU(SkeletonInstance &instance, UserFunction &comparator, std::string dir)
+{
+	const std::string keyType = comparator.elwiseParams[0].resolvedTypeName;
+	const SortRadix radix = sortRadixOf(comparator);
+
+	const std::string kernelName = transformToCXXIdentifier(ResultName) + "_SortKernel_" + comparator.uniqueName;
+	std::vector<std::pair<std::string, std::string>> replacements
+	{
+		{"{{RADIX_KERNELS}}",      radix.radix ? SortRadixKernels_CU : ""},
+		{"{{KEY_TYPE}}",           keyType},
+		{"{{KERNEL_NAME}}",        kernelName},
+		{"{{FUNCTION_NAME_LESS}}", comparator.funcNameCUDA()},
+		{"{{SHARED_BUFFER}}",      "sdata_" + instance}
+	};
+
+	if (radix.radix)
+	{
+		const bool wide = radix.bytes > 4;
+		const std::string bitsType = wide ? "unsigned long long" : "unsigned int";
+		const std::string sign = wide ? "0x8000000000000000ull" : "0x80000000u";
+		std::string bitsOfKey, bitsOrder = "skepu_bits";
+		if (radix.floating)
+		{
+			bitsOfKey = wide ? "(unsigned long long)__double_as_longlong(skepu_key)" : "__float_as_uint(skepu_key)";
+			bitsOrder = "(skepu_bits & " + sign + ") ? ~skepu_bits : skepu_bits ^ " + sign;
+		}
+		else if (radix.isSigned)
+		{
+			bitsOfKey = "(" + bitsType + ")(" + (wide ? "long long" : "int") + ")skepu_key";
+			bitsOrder = "skepu_bits ^ " + sign;
+		}
+		else
+			bitsOfKey = "(" + bitsType + ")skepu_key";
+		if (radix.descending)
+			bitsOrder = "~(" + bitsOrder + ")";
+
+		replacements.emplace_back("{{BITS_TYPE}}", bitsType);
+		replacements.emplace_back("{{BITS_OF_KEY}}", bitsOfKey);
+		replacements.emplace_back("{{BITS_ORDER}}", bitsOrder);
+	}
+
+	GeneratedFile FSOutFile {dir + "/" + kernelName + ".cu"};
+	FSOutFile << templateString(SortKernelTemplate_CU, replacements);
+	return kernelName;
+}
@@ -0,0 +1,260 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * SELL-C-sigma storage for the sparse matrices of -spmv-sell instances. Rows are sorted by decreasing length
+ * within windows of sigma rows and grouped into slices of C = SliceHeight rows. Each slice is padded to its
+ * longest row and stored column-major, so element j of the slice's rows lies in C consecutive entries.
+ * perm maps a sorted row to its original row, rank is its inverse. Padding holds value 0 and column 0.
+ *
+ * layoutOf converts a SparseMatrix once and caches the result by container. The cached copy is rebuilt
+ * when the number of rows or nonzeros changes. Call invalidate after changing the values in place.
+ * With CUDA, deviceLayoutOf uploads the cached copy once per device.
+ */
+static const char *SELLSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#ifdef __CUDACC__
+#define SKEPU_SELL_HOST_DEVICE __host__ __device__
+#else
+#define SKEPU_SELL_HOST_DEVICE
+#endif
+
+namespace skepu
+{
+	namespace sell
+	{
+		constexpr size_t SliceHeight = 32;
+
+		template<typename T>
+		struct Layout
+		{
+			size_t rows = 0;
+			size_t nnz = 0;
+			std::vector<T> values;
+			std::vector<size_t> col_indices;
+			std::vector<size_t> slice_offsets;
+			std::vector<size_t> row_lengths;
+			std::vector<size_t> perm;
+			std::vector<size_t> rank;
+		};
+
+		// Row view over SELL arrays, indexed by the original row number
+		template<typename T>
+		struct Proxy
+		{
+			const T *values;
+			const size_t *col_indices;
+			const size_t *slice_offsets;
+			const size_t *row_lengths;
+			const size_t *rank;
+
+			SKEPU_SELL_HOST_DEVICE size_t length(size_t row) const { return row_lengths[rank[row]]; }
+			SKEPU_SELL_HOST_DEVICE size_t index(size_t row, size_t j) const
+			{
+				size_t r = rank[row];
+				return slice_offsets[r / SliceHeight] + j * SliceHeight + r % SliceHeight;
+			}
+			SKEPU_SELL_HOST_DEVICE T value(size_t row, size_t j) const { return values[index(row, j)]; }
+			SKEPU_SELL_HOST_DEVICE size_t column(size_t row, size_t j) const { return col_indices[index(row, j)]; }
+		};
+
+		template<typename T>
+		Layout<T> convert(const T *values, const size_t *row_offsets, const size_t *col_indices, size_t rows, size_t sigma)
+		{
+			Layout<T> layout;
+			layout.rows = rows;
+			layout.nnz = row_offsets[rows];
+			auto length = [&](size_t r) { return row_offsets[r + 1] - row_offsets[r]; };
+
+			layout.perm.resize(rows);
+			std::iota(layout.perm.begin(), layout.perm.end(), 0);
+			for (size_t w = 0; w < rows; w += sigma)
+				std::stable_sort(layout.perm.begin() + w, layout.perm.begin() + std::min(w + sigma, rows),
+					[&](size_t a, size_t b) { return length(a) > length(b); });
+			layout.rank.resize(rows);
+			for (size_t r = 0; r < rows; ++r)
+				layout.rank[layout.perm[r]] = r;
+
+			size_t numSlices = (rows + SliceHeight - 1) / SliceHeight;
+			layout.row_lengths.assign(numSlices * SliceHeight, 0);
+			for (size_t r = 0; r < rows; ++r)
+				layout.row_lengths[r] = length(layout.perm[r]);
+
+			layout.slice_offsets.assign(numSlices + 1, 0);
+			for (size_t s = 0; s < numSlices; ++s)
+			{
+				auto first = layout.row_lengths.begin() + s * SliceHeight;
+				layout.slice_offsets[s + 1] = layout.slice_offsets[s] + *std::max_element(first, first + SliceHeight) * SliceHeight;
+			}
+
+			layout.values.assign(layout.slice_offsets[numSlices], T(0));
+			layout.col_indices.assign(layout.slice_offsets[numSlices], 0);
+			for (size_t r = 0; r < rows; ++r)
+			{
+				size_t src = row_offsets[layout.perm[r]];
+				size_t dst = layout.slice_offsets[r / SliceHeight] + r % SliceHeight;
+				for (size_t j = 0; j < layout.row_lengths[r]; ++j)
+				{
+					layout.values[dst + j * SliceHeight] = values[src + j];
+					layout.col_indices[dst + j * SliceHeight] = col_indices[src + j];
+				}
+			}
+			return layout;
+		}
+
+		template<typename T>
+		struct Cache
+		{
+			std::mutex mutex;
+			std::map<const void*, Layout<T>> layouts;
+
+			static Cache &instance()
+			{
+				static Cache cache;
+				return cache;
+			}
+		};
+
+		template<typename T>
+		Layout<T> const& layoutOf(skepu::SparseMatrix<T> &matrix, size_t sigma = 8 * SliceHeight)
+		{
+			Cache<T> &cache = Cache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			auto it = cache.layouts.find(&matrix);
+			if (it == cache.layouts.end() || it->second.rows != matrix.total_rows() || it->second.nnz != matrix.total_nnz())
+			{
+				cache.layouts[&matrix] = convert(matrix.get_values(), matrix.get_row_pointers(), matrix.get_col_indices(), matrix.total_rows(), sigma);
+				it = cache.layouts.find(&matrix);
+			}
+			return it->second;
+		}
+
+		template<typename T>
+		Proxy<T> proxyOf(Layout<T> const& layout)
+		{
+			return Proxy<T>{ layout.values.data(), layout.col_indices.data(), layout.slice_offsets.data(), layout.row_lengths.data(), layout.rank.data() };
+		}
+
+#ifdef SKEPU_CUDA
+		template<typename T>
+		struct DeviceLayout
+		{
+			size_t rows = 0;
+			size_t nnz = 0;
+			T *values = nullptr;
+			size_t *col_indices = nullptr;
+			size_t *slice_offsets = nullptr;
+			size_t *row_lengths = nullptr;
+			size_t *perm = nullptr;
+			size_t *rank = nullptr;
+
+			Proxy<T> proxy() const { return Proxy<T>{ values, col_indices, slice_offsets, row_lengths, rank }; }
+		};
+
+		template<typename U>
+		U *upload(std::vector<U> const& host)
+		{
+			U *device = nullptr;
+			cudaMalloc(&device, std::max<size_t>(1, host.size()) * sizeof(U));
+			cudaMemcpy(device, host.data(), host.size() * sizeof(U), cudaMemcpyHostToDevice);
+			return device;
+		}
+
+		template<typename T>
+		void release(DeviceLayout<T> &device)
+		{
+			cudaFree(device.values);
+			cudaFree(device.col_indices);
+			cudaFree(device.slice_offsets);
+			cudaFree(device.row_lengths);
+			cudaFree(device.perm);
+			cudaFree(device.rank);
+			device = DeviceLayout<T>{};
+		}
+
+		template<typename T>
+		struct DeviceCache
+		{
+			std::mutex mutex;
+			std::map<std::pair<const void*, size_t>, DeviceLayout<T>> layouts;
+
+			static DeviceCache &instance()
+			{
+				static DeviceCache cache;
+				return cache;
+			}
+		};
+
+		template<typename T>
+		DeviceLayout<T> const& deviceLayoutOf(skepu::SparseMatrix<T> &matrix, size_t deviceID, size_t sigma = 8 * SliceHeight)
+		{
+			Layout<T> const& host = layoutOf(matrix, sigma);
+			DeviceCache<T> &cache = DeviceCache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			DeviceLayout<T> &device = cache.layouts[{&matrix, deviceID}];
+			if (device.values == nullptr || device.rows != host.rows || device.nnz != host.nnz)
+			{
+				cudaSetDevice(deviceID);
+				release(device);
+				device.rows = host.rows;
+				device.nnz = host.nnz;
+				device.values = upload(host.values);
+				device.col_indices = upload(host.col_indices);
+				device.slice_offsets = upload(host.slice_offsets);
+				device.row_lengths = upload(host.row_lengths);
+				device.perm = upload(host.perm);
+				device.rank = upload(host.rank);
+			}
+			return device;
+		}
+#endif
+
+		// Drops the cached copies of matrix, the next use converts it again
+		template<typename T>
+		void invalidate(skepu::SparseMatrix<T> &matrix)
+		{
+			{
+				Cache<T> &cache = Cache<T>::instance();
+				std::lock_guard<std::mutex> lock(cache.mutex);
+				cache.layouts.erase(&matrix);
+			}
+#ifdef SKEPU_CUDA
+			DeviceCache<T> &cache = DeviceCache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			for (auto it = cache.layouts.begin(); it != cache.layouts.end();)
+			{
+				if (it->first.first == &matrix)
+				{
+					cudaSetDevice(it->first.second);
+					release(it->second);
+					it = cache.layouts.erase(it);
+				}
+				else ++it;
+			}
+#endif
+		}
+	}
+}
+)~~~";
+
+
+std::string generateSELLSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_sell.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << SELLSupport;
+		generated = true;
+	}
+	return fileName;
+}
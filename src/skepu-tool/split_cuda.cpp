@@ -0,0 +1,216 @@
+#include "globals.h"
+#include "code_gen.h"
+
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+
+/*!
+ * Separate host and device translation units for -split-cuda, so that only the kernels go through nvcc. The main
+ * output is then a .cpp for the host compiler, and <name>_device.cu a device translation unit which defines
+ * SKEPU_DEVICE_TU and includes it. Under __CUDACC__ the main file includes the kernel files and the CUDA bodies
+ * of the user function structs; otherwise it declares the host stubs nvcc generates for the kernels, which have
+ * the same names and signatures, and the instances pass those. The main file defines SKEPU_CUDA_SPLIT and
+ * includes this header before the SkePU headers, whose CUDA backends then launch through split::launch, as
+ * cudaLaunchKernel of the stub, instead of the <<<...>>> syntax only nvcc accepts.
+ *
+ * The device translation unit keeps the types, templates and inline functions of the main file, which the
+ * kernels may need, and drops what the host translation unit defines: the bodies of other functions in the main
+ * file, out-of-line member functions, file-scope instances and the initializers of non-constant variables, which
+ * it declares extern. Template kernels are instantiated there by taking their address. Both objects are linked
+ * together, the device one with the CUDA runtime.
+ */
+static const char *SplitCUDASupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+#include <cuda_runtime.h>
+
+namespace skepu
+{
+	namespace split
+	{
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		template<typename... Params, size_t... I>
+		cudaError_t launch(void (*kernel)(Params...), dim3 grid, dim3 block, size_t sharedMem, cudaStream_t stream, std::tuple<Params...> &values, Sequence<I...>)
+		{
+			void *pointers[] = {static_cast<void*>(&std::get<I>(values))..., nullptr};
+			return cudaLaunchKernel(reinterpret_cast<const void*>(kernel), grid, block, pointers, sharedMem, stream);
+		}
+
+		// The arguments are converted to the kernel parameter types, whose addresses cudaLaunchKernel takes
+		template<typename... Params, typename... Args>
+		cudaError_t launch(void (*kernel)(Params...), dim3 grid, dim3 block, size_t sharedMem, cudaStream_t stream, Args&&... args)
+		{
+			std::tuple<Params...> values(std::forward<Args>(args)...);
+			return launch(kernel, grid, block, sharedMem, stream, values, typename Indices<sizeof...(Params)>::type{});
+		}
+	}
+}
+)~~~";
+
+
+std::string generateSplitCUDASupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_split_cuda.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << SplitCUDASupport;
+		generated = true;
+	}
+	return fileName;
+}
+
+
+// Every __global__ function of the generated kernel file, with its template header, as a host declaration
+static std::string hostKernelDeclarations_CU(const std::string &kernelFile)
+{
+	std::ifstream in(kernelFile, std::ios::binary);
+	std::string source {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+	std::stringstream SSDecls;
+	const std::string qualifier = "__global__ ";
+
+	for (size_t at = source.find(qualifier); at != std::string::npos; at = source.find(qualifier, at + qualifier.size()))
+	{
+		size_t lineStart = source.rfind('\n', at);
+		lineStart = (lineStart == std::string::npos) ? 0 : lineStart + 1;
+		std::string prefix = source.substr(lineStart, at - lineStart);
+		if (prefix.find_first_not_of(" \t") != std::string::npos && prefix.find("extern \"C\"") == std::string::npos)
+			continue;
+
+		// Launch bounds only concern the device code, the parameters follow them
+		size_t open = source.find('(', at);
+		size_t bounds = source.find("__launch_bounds__(", at);
+		if (bounds != std::string::npos && bounds < open)
+			open = source.find('(', source.find(") ", bounds) + 2);
+		if (open == std::string::npos)
+			break;
+		size_t close = open;
+		for (int depth = 0; close < source.size(); ++close)
+		{
+			if (source[close] == '(') ++depth;
+			else if (source[close] == ')' && --depth == 0) break;
+		}
+
+		// A template header is the previous line
+		std::string templateHeader;
+		if (lineStart > 1)
+		{
+			size_t previous = source.rfind('\n', lineStart - 2);
+			previous = (previous == std::string::npos) ? 0 : previous + 1;
+			std::string line = source.substr(previous, lineStart - 1 - previous);
+			if (line.compare(0, 9, "template<") == 0)
+				templateHeader = line + "\n";
+		}
+		std::string declaration = source.substr(at + qualifier.size(), close + 1 - at - qualifier.size());
+		if (bounds != std::string::npos && bounds < open)
+			declaration.erase(bounds - at - qualifier.size(), source.find(") ", bounds) + 2 - bounds);
+		SSDecls << templateHeader << prefix << declaration << ";\n";
+	}
+	return SSDecls.str();
+}
+
+
+std::string splitKernelInclude_CU(const std::string &kernelName, const std::vector<std::string> &symbols)
+{
+	std::stringstream SSCode;
+	SSCode << "#ifdef __CUDACC__\n#include \"" << kernelName << ".cu\"\n";
+
+	// Template kernels are instantiated where they are used, which the device translation unit drops
+	std::vector<std::string> templates;
+	for (const std::string &symbol : symbols)
+		if (symbol.find('<') != std::string::npos)
+			templates.push_back(symbol);
+	if (!templates.empty())
+	{
+		SSCode << "#ifdef SKEPU_DEVICE_TU\n__attribute__((used)) static const void *const " << kernelName << "_instantiated[] = {";
+		for (size_t i = 0; i < templates.size(); ++i)
+			SSCode << (i ? ", " : "") << "reinterpret_cast<const void*>(&" << templates[i] << ")";
+		SSCode << "};\n#endif\n";
+	}
+	SSCode << "#else\n" << hostKernelDeclarations_CU(ResultDir + "/" + kernelName + ".cu") << "#endif\n";
+	return SSCode.str();
+}
+
+
+static void guardDefinition(FunctionDecl *f)
+{
+	if (!f->doesThisDeclarationHaveABody() || f->isInlined() || f->isConstexpr() || f->isDefaulted() || f->isDeleted()
+		|| f->isDependentContext() || !f->isExternallyVisible() || f->getTemplatedKind() == FunctionDecl::TK_FunctionTemplate)
+		return;
+
+	// Out-of-line members are declared by their class, free functions keep a declaration
+	if (f->isOutOfLine() && isa<CXXMethodDecl>(f))
+	{
+		GlobalRewriter.InsertText(f->getSourceRange().getBegin(), "\n#ifndef SKEPU_DEVICE_TU\n");
+		GlobalRewriter.InsertTextAfterToken(f->getSourceRange().getEnd(), "\n#endif\n");
+	}
+	else
+	{
+		GlobalRewriter.InsertTextBefore(f->getBody()->getBeginLoc(), "\n#ifdef SKEPU_DEVICE_TU\n;\n#else\n");
+		GlobalRewriter.InsertTextAfterToken(f->getBody()->getEndLoc(), "\n#endif\n");
+	}
+}
+
+static void guardDefinition(VarDecl *v, const std::unordered_set<VarDecl*> &instances, SourceManager &SM, const LangOptions &LangOpts)
+{
+	// File-scope instances open the guard in their rewritten declaration, after the code generated before it
+	bool instance = instances.count(v);
+	if (!v->isFileVarDecl() || (!instance && (!v->isThisDeclarationADefinition() || !v->isExternallyVisible() || v->isStaticDataMember()
+		|| v->getType().isConstQualified() || v->isConstexpr() || v->isInline() || v->getDescribedVarTemplate())))
+		return;
+
+	SourceLocation afterSemi = Lexer::findLocationAfterToken(v->getEndLoc(), tok::semi, SM, LangOpts, false);
+	if (afterSemi.isInvalid())
+		SkePUAbort("Split CUDA output: declaration of " + v->getNameAsString() + " is not followed by a semicolon");
+
+	// Closure types can not be named, those variables are only left out
+	const CXXRecordDecl *record = v->getType()->getAsCXXRecordDecl();
+	if (record && record->isLambda() && !instance)
+		GlobalRewriter.InsertText(v->getSourceRange().getBegin(), "\n#ifndef SKEPU_DEVICE_TU\n");
+	else if (!instance)
+	{
+		std::string declaration;
+		llvm::raw_string_ostream OS(declaration);
+		v->getType().print(OS, PrintingPolicy(LangOpts), v->getName());
+		GlobalRewriter.InsertText(v->getSourceRange().getBegin(), "\n#ifdef SKEPU_DEVICE_TU\nextern " + OS.str() + ";\n#else\n");
+	}
+	GlobalRewriter.InsertText(afterSemi, "\n#endif\n");
+}
+
+static void guardDefinitions(DeclContext *context, const std::unordered_set<VarDecl*> &instances, SourceManager &SM, const LangOptions &LangOpts)
+{
+	for (Decl *d : context->decls())
+	{
+		if (!SM.isInMainFile(d->getLocation()))
+			continue;
+
+		if (NamespaceDecl *ns = dyn_cast<NamespaceDecl>(d))
+		{
+			if (!ns->isAnonymousNamespace())
+				guardDefinitions(ns, instances, SM, LangOpts);
+		}
+		else if (LinkageSpecDecl *linkage = dyn_cast<LinkageSpecDecl>(d))
+			guardDefinitions(linkage, instances, SM, LangOpts);
+		else if (FunctionDecl *f = dyn_cast<FunctionDecl>(d))
+			guardDefinition(f);
+		else if (VarDecl *v = dyn_cast<VarDecl>(d))
+			guardDefinition(v, instances, SM, LangOpts);
+	}
+}
+
+void splitDeviceTranslationUnit_CU(ASTContext &Context, const std::unordered_set<VarDecl*> &instances, const std::string &mainFile)
+{
+	guardDefinitions(Context.getTranslationUnitDecl(), instances, GlobalRewriter.getSourceMgr(), Context.getLangOpts());
+
+	GeneratedFile FSOutFile {ResultDir + "/" + ResultName + "_device.cu"};
+	FSOutFile << "#define SKEPU_DEVICE_TU 1\n#include \"" << llvm::sys::path::filename(mainFile).str() << "\"\n";
+}
@@ -0,0 +1,195 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Task partitioning of the StarPU-MPI backend. With -starpu-mpi and -starpu-partition the main file defines
+ * SKEPU_STARPU_PARTITIONING and includes this header before the SkePU headers, and every listed instance is wrapped
+ * in skepu::starpu_mpi::Partitioned, which makes the Partitioning of the instance current on the calling thread for
+ * the duration of a call; the other instances keep the partitioning of the backend. The backend splits the
+ * containers of a call into tasks of blockSize elements (its own default if 0), assigns the blocks to the ranks
+ * with ownerOf, and gives its codelets the performance model of perfModel.
+ *
+ * Every listed instance has its own history-based model, with the symbol skepu_<skeleton>_<instance>, so the
+ * history that StarPU keeps for the dmda schedulers is per instance and survives across runs of the program; as the
+ * footprint of a task is that of its data, fixed block sizes also keep the footprints, and so the estimates, from
+ * one call to the next. -starpu-partition selects the block size, distribution and model type of an instance at
+ * precompile time, an entry of the name alone keeping the defaults, and setTaskBlockSize, setDistribution and
+ * setPerfModel change them at run time; setPerfModel takes any StarPU model, such as one with a cost function of
+ * its own.
+ */
+static const char *StarPUMPISupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+#include <starpu.h>
+
+namespace skepu
+{
+	namespace starpu_mpi
+	{
+		enum class Distribution
+		{
+			Block, BlockCyclic
+		};
+
+		enum class Model
+		{
+			History, Regression, NonLinearRegression
+		};
+
+		struct Partitioning
+		{
+			size_t blockSize = 0;
+			Distribution distribution = Distribution::Block;
+			starpu_perfmodel *userModel = nullptr;
+			starpu_perfmodel ownModel;
+		};
+
+		// Partitioning of the instance whose call is running on this thread, nullptr outside of calls
+		inline Partitioning *&current()
+		{
+			static thread_local Partitioning *partitioning = nullptr;
+			return partitioning;
+		}
+
+		// Runtime hooks
+
+		// Number of tasks for n elements, one if the block size is left to the backend
+		inline size_t blockCount(Partitioning const& p, size_t n)
+		{
+			return (p.blockSize && n) ? (n + p.blockSize - 1) / p.blockSize : 1;
+		}
+
+		// Rank owning block b of blocks: contiguous runs of blocks per rank, or blocks dealt round robin
+		inline int ownerOf(Partitioning const& p, size_t b, size_t blocks, int ranks)
+		{
+			if (p.distribution == Distribution::BlockCyclic)
+				return int(b % ranks);
+			return int(b * ranks / blocks);
+		}
+
+		// The model of the codelets of the instance, which lives as long as the instance
+		inline starpu_perfmodel *perfModel(Partitioning &p)
+		{
+			return p.userModel ? p.userModel : &p.ownModel;
+		}
+
+		template<typename Skeleton>
+		class Partitioned: public Skeleton
+		{
+		public:
+			template<typename... CallArgs>
+			Partitioned(const char *symbol, size_t blockSize, Distribution distribution, Model model, CallArgs&&... args)
+			: Skeleton(std::forward<CallArgs>(args)...)
+			{
+				this->partitioning.blockSize = blockSize;
+				this->partitioning.distribution = distribution;
+				std::memset(&this->partitioning.ownModel, 0, sizeof this->partitioning.ownModel);
+				this->partitioning.ownModel.type = (model == Model::Regression) ? STARPU_REGRESSION_BASED
+					: (model == Model::NonLinearRegression) ? STARPU_NL_REGRESSION_BASED : STARPU_HISTORY_BASED;
+				this->partitioning.ownModel.symbol = symbol;
+			}
+
+			// Calls running when these are changed keep the settings they started with
+			void setTaskBlockSize(size_t blockSize)
+			{
+				this->partitioning.blockSize = blockSize;
+			}
+
+			void setDistribution(Distribution distribution)
+			{
+				this->partitioning.distribution = distribution;
+			}
+
+			// A model owned by the caller, nullptr for the history-based model of the instance
+			void setPerfModel(starpu_perfmodel *model)
+			{
+				this->partitioning.userModel = model;
+			}
+
+			template<typename... Args>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				Scope scope(&this->partitioning);
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+		private:
+			class Scope
+			{
+			public:
+				explicit Scope(Partitioning *partitioning): outer(current())
+				{
+					current() = partitioning;
+				}
+
+				~Scope()
+				{
+					current() = this->outer;
+				}
+
+			private:
+				Partitioning *outer;
+			};
+
+			Partitioning partitioning;
+		};
+	}
+}
+)~~~";
+
+
+std::string generateStarPUMPISupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_starpu_mpi.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << StarPUMPISupport;
+		generated = true;
+	}
+	return fileName;
+}
+
+// The constructor arguments of skepu::starpu_mpi::Partitioned for the instance: its model symbol and its
+// -starpu-partition entry, name, name=distribution:blocksize or name=distribution:blocksize:model; empty if it has none
+std::string starpuPartitioningOf(const std::string &InstanceName, const std::string &skeletonID)
+{
+	std::string distribution = "Block", model = "History";
+	size_t blockSize = 0;
+	bool partitioned = false;
+	for (const std::string &entry : StarPUPartitionInstances)
+	{
+		std::pair<llvm::StringRef, llvm::StringRef> parts = llvm::StringRef(entry).split('=');
+		if (parts.first != InstanceName)
+			continue;
+		if (!GenStarPUMPI)
+			SkePUAbort("Partitioned instance " + InstanceName + " needs the StarPU-MPI backend");
+		partitioned = true;
+		if (parts.second.empty())
+			continue;
+
+		llvm::SmallVector<llvm::StringRef, 3> fields;
+		parts.second.split(fields, ':');
+		if (fields.size() < 2 || fields.size() > 3 || fields[1].getAsInteger(10, blockSize) || blockSize == 0)
+			SkePUAbort("Malformed -starpu-partition entry " + entry + ", expected name, name=distribution:blocksize or name=distribution:blocksize:model");
+
+		if (fields[0] == "block") distribution = "Block";
+		else if (fields[0] == "block-cyclic") distribution = "BlockCyclic";
+		else SkePUAbort("Unknown distribution " + fields[0].str() + " of instance " + InstanceName + ", expected block or block-cyclic");
+
+		if (fields.size() < 3 || fields[2] == "history") model = "History";
+		else if (fields[2] == "regression") model = "Regression";
+		else if (fields[2] == "nl-regression") model = "NonLinearRegression";
+		else SkePUAbort("Unknown performance model " + fields[2].str() + " of instance " + InstanceName + ", expected history, regression or nl-regression");
+	}
+	if (!partitioned)
+		return "";
+
+	return "\"skepu_" + skeletonID + "_" + InstanceName + "\", " + std::to_string(blockSize) + ", "
+		+ "skepu::starpu_mpi::Distribution::" + distribution + ", skepu::starpu_mpi::Model::" + model;
+}
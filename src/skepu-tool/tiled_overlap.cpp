@@ -0,0 +1,332 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Tiled OpenMP MapOverlap2D and MapOverlap3D for instances listed in -tiled-overlap, the host counterpart of the
+ * shared memory tiles of the GPU kernels. The output is cut into tiles whose input, with the halo of the overlap
+ * on every side, fills half of TileBytes; each thread copies the input of a tile into its own buffer, resolving
+ * the edge mode while copying, and computes the tile from regions into that buffer. The innermost loop runs along
+ * the contiguous dimension with omp simd, since the user function only reads the region and uniform scalars.
+ *
+ * The wrappers record the overlap, edge mode and pad set on the instance, or the overlap of a -static-overlap
+ * instance. Calls of instances whose overlap or edge mode has not been set, with Edge::None, with indexed, PRNG,
+ * container or multi-output user functions, on other containers than matrices (tensors in 3D) of the same size,
+ * or not on the OpenMP backend run on the instance backend. The instance runs on OpenMP when that backend is set
+ * on it, or without a backend of its own in builds whose only parallel backend is OpenMP.
+ */
+static const char *TiledOverlapSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skepu
+{
+	namespace tiled
+	{
+		constexpr size_t TileBytes = 256 << 10;
+		constexpr long long TileWidth = 128;
+		constexpr long long TileDepth = 16;
+
+		template<typename T> struct IsMatrix: std::false_type {};
+		template<typename T> struct IsMatrix<skepu::Matrix<T>>: std::true_type {};
+		template<typename T> struct IsTensor3: std::false_type {};
+		template<typename T> struct IsTensor3<skepu::Tensor3<T>>: std::true_type {};
+
+		template<typename T>
+		using Bare = typename std::remove_cv<typename std::remove_reference<T>::type>::type;
+
+		// Index of coordinate c along an extent n under the edge mode, -1 for the pad value
+		inline long long edgeIndex(long long c, long long n, Edge edge)
+		{
+			if (c >= 0 && c < n)
+				return c;
+			if (edge == Edge::Cyclic)
+				return (c % n + n) % n;
+			if (edge == Edge::Duplicate)
+				return std::min(std::max(c, 0LL), n - 1);
+			return -1;
+		}
+
+		// Rows of a tile of width columns whose input, with a halo of halo rows and columns, fills half of TileBytes
+		inline long long tileRows(long long width, long long haloRows, long long haloCols, size_t elementBytes)
+		{
+			long long rows = (long long)(TileBytes / 2 / elementBytes) / (width + 2 * haloCols) - 2 * haloRows;
+			return std::max(1LL, rows);
+		}
+
+		template<typename T>
+		auto updateHost(T &arg, int) -> decltype(arg.updateHost(), void())
+		{
+			arg.updateHost();
+		}
+
+		template<typename T>
+		void updateHost(T &, long) {}
+
+		template<typename T>
+		auto invalidateDevice(T &arg, int) -> decltype(arg.invalidateDeviceData(), void())
+		{
+			arg.invalidateDeviceData();
+		}
+
+		template<typename T>
+		void invalidateDevice(T &, long) {}
+
+		template<typename Skeleton, typename UF, typename T, size_t Dims, int... Static>
+		class Base: public Skeleton
+		{
+		public:
+			using Skeleton::Skeleton;
+
+			void setBackend(BackendSpec const& spec)
+			{
+				this->openmp = (spec.backend() == Backend::Type::OpenMP);
+				Skeleton::setBackend(spec);
+			}
+
+			void resetBackend()
+			{
+				this->openmp = defaultOpenMP();
+				Skeleton::resetBackend();
+			}
+
+			// A single value applies to every dimension, as in the backend skeleton
+			template<typename... Rest>
+			void setOverlap(int first, Rest... rest)
+			{
+				const int given[] = {first, static_cast<int>(rest)...};
+				for (size_t d = 0; d < Dims; ++d)
+					this->overlap[d] = given[d % (1 + sizeof...(Rest))];
+				this->overlapKnown = true;
+				Skeleton::setOverlap(first, rest...);
+			}
+
+			void setEdgeMode(Edge edge)
+			{
+				this->edge = edge;
+				this->edgeKnown = true;
+				Skeleton::setEdgeMode(edge);
+			}
+
+			void setPad(T pad)
+			{
+				this->pad = pad;
+				Skeleton::setPad(pad);
+			}
+
+		protected:
+			static constexpr bool defaultOpenMP()
+			{
+#if defined(SKEPU_OPENMP) && !defined(SKEPU_CUDA) && !defined(SKEPU_OPENCL)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			static constexpr bool tileable()
+			{
+				return !UF::indexed && !UF::usesPRNG && UF::outArity == 1 && std::tuple_size<typename UF::ContainerArgs>::value == 0;
+			}
+
+			bool tiledCall() const
+			{
+				return this->openmp && this->overlapKnown && this->edgeKnown && this->edge != Edge::None;
+			}
+
+			T edgeValue(const T *in, long long index) const
+			{
+				return (index < 0) ? this->pad : in[index];
+			}
+
+			int overlap[Dims] = {Static...};
+			bool overlapKnown = sizeof...(Static) > 0;
+			Edge edge = Edge::None;
+			bool edgeKnown = false;
+			T pad {};
+			bool openmp = defaultOpenMP();
+		};
+
+		template<typename Skeleton, typename UF, typename T, int... Static>
+		class MapOverlap2D: public Base<Skeleton, UF, T, 2, Static...>
+		{
+			using B = Base<Skeleton, UF, T, 2, Static...>;
+
+		public:
+			using B::B;
+
+			template<typename Res, typename In, typename... Args>
+			auto operator()(Res &&res, In &&in, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...))
+			{
+				constexpr bool tiled = B::tileable() && IsMatrix<Bare<Res>>::value && IsMatrix<Bare<In>>::value;
+				return this->call(std::integral_constant<bool, tiled>{}, std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename In, typename... Args>
+			auto call(std::true_type, Res &&res, In &&in, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...))
+			{
+				if (!this->tiledCall() || res.total_rows() != in.total_rows() || res.total_cols() != in.total_cols() || in.size() == 0)
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...);
+
+				updateHost(in, 0);
+				updateHost(res, 0);
+				this->tiles(res.getAddress(), in.getAddress(), in.total_rows(), in.total_cols(), args...);
+				invalidateDevice(res, 0);
+				return std::forward<Res>(res);
+			}
+
+			template<typename R, typename... Args>
+			void tiles(R *out, const T *in, long long rows, long long cols, Args&... args) const
+			{
+				const long long oy = this->overlap[0], ox = this->overlap[1];
+				const long long width = std::min(TileWidth, cols), height = tileRows(width, oy, ox, sizeof(T));
+				const long long stride = width + 2 * ox;
+				const long long tilesY = (rows + height - 1) / height, tilesX = (cols + width - 1) / width;
+
+#pragma omp parallel
+				{
+					std::vector<T> tile((height + 2 * oy) * stride);
+
+#pragma omp for collapse(2) schedule(static)
+					for (long long by = 0; by < tilesY; ++by)
+						for (long long bx = 0; bx < tilesX; ++bx)
+						{
+							const long long y0 = by * height, x0 = bx * width;
+							const long long h = std::min(height, rows - y0), w = std::min(width, cols - x0);
+							for (long long ty = 0; ty < h + 2 * oy; ++ty)
+							{
+								const long long gy = edgeIndex(y0 + ty - oy, rows, this->edge);
+								for (long long tx = 0; tx < w + 2 * ox; ++tx)
+								{
+									const long long gx = edgeIndex(x0 + tx - ox, cols, this->edge);
+									tile[ty * stride + tx] = this->edgeValue(in, (gy < 0 || gx < 0) ? -1 : gy * cols + gx);
+								}
+							}
+
+							for (long long y = 0; y < h; ++y)
+							{
+								R *row = out + (y0 + y) * cols + x0;
+								const T *center = tile.data() + (y + oy) * stride + ox;
+#pragma omp simd
+								for (long long x = 0; x < w; ++x)
+									row[x] = UF::OMP(skepu::Region2D<T>{(int)oy, (int)ox, (size_t)stride, center + x}, args...);
+							}
+						}
+				}
+			}
+		};
+
+		template<typename Skeleton, typename UF, typename T, int... Static>
+		class MapOverlap3D: public Base<Skeleton, UF, T, 3, Static...>
+		{
+			using B = Base<Skeleton, UF, T, 3, Static...>;
+
+		public:
+			using B::B;
+
+			template<typename Res, typename In, typename... Args>
+			auto operator()(Res &&res, In &&in, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...))
+			{
+				constexpr bool tiled = B::tileable() && IsTensor3<Bare<Res>>::value && IsTensor3<Bare<In>>::value;
+				return this->call(std::integral_constant<bool, tiled>{}, std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...);
+			}
+
+		private:
+			template<typename... Args>
+			auto call(std::false_type, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename Res, typename In, typename... Args>
+			auto call(std::true_type, Res &&res, In &&in, Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...))
+			{
+				if (!this->tiledCall() || res.size_i() != in.size_i() || res.size_j() != in.size_j() || res.size_k() != in.size_k() || in.size() == 0)
+					return Skeleton::operator()(std::forward<Res>(res), std::forward<In>(in), std::forward<Args>(args)...);
+
+				updateHost(in, 0);
+				updateHost(res, 0);
+				this->tiles(res.getAddress(), in.getAddress(), in.size_i(), in.size_j(), in.size_k(), args...);
+				invalidateDevice(res, 0);
+				return std::forward<Res>(res);
+			}
+
+			// Tiles span TileWidth elements along k, TileDepth along j and as many along i as fit
+			template<typename R, typename... Args>
+			void tiles(R *out, const T *in, long long ni, long long nj, long long nk, Args&... args) const
+			{
+				const long long oi = this->overlap[0], oj = this->overlap[1], ok = this->overlap[2];
+				const long long wk = std::min(TileWidth, nk), wj = std::min(TileDepth, nj);
+				const long long planeBytes = (long long)sizeof(T) * (wj + 2 * oj) * (wk + 2 * ok);
+				const long long wi = std::max(1LL, (long long)(TileBytes / 2) / planeBytes - 2 * oi);
+				const long long strideK = wk + 2 * ok, strideJ = (wj + 2 * oj) * strideK;
+				const long long tilesI = (ni + wi - 1) / wi, tilesJ = (nj + wj - 1) / wj, tilesK = (nk + wk - 1) / wk;
+
+#pragma omp parallel
+				{
+					std::vector<T> tile((wi + 2 * oi) * strideJ);
+
+#pragma omp for collapse(3) schedule(static)
+					for (long long bi = 0; bi < tilesI; ++bi)
+						for (long long bj = 0; bj < tilesJ; ++bj)
+							for (long long bk = 0; bk < tilesK; ++bk)
+							{
+								const long long i0 = bi * wi, j0 = bj * wj, k0 = bk * wk;
+								const long long hi = std::min(wi, ni - i0), hj = std::min(wj, nj - j0), hk = std::min(wk, nk - k0);
+								for (long long ti = 0; ti < hi + 2 * oi; ++ti)
+								{
+									const long long gi = edgeIndex(i0 + ti - oi, ni, this->edge);
+									for (long long tj = 0; tj < hj + 2 * oj; ++tj)
+									{
+										const long long gj = edgeIndex(j0 + tj - oj, nj, this->edge);
+										for (long long tk = 0; tk < hk + 2 * ok; ++tk)
+										{
+											const long long gk = edgeIndex(k0 + tk - ok, nk, this->edge);
+											tile[ti * strideJ + tj * strideK + tk] =
+												this->edgeValue(in, (gi < 0 || gj < 0 || gk < 0) ? -1 : (gi * nj + gj) * nk + gk);
+										}
+									}
+								}
+
+								for (long long i = 0; i < hi; ++i)
+									for (long long j = 0; j < hj; ++j)
+									{
+										R *row = out + ((i0 + i) * nj + j0 + j) * nk + k0;
+										const T *center = tile.data() + (i + oi) * strideJ + (j + oj) * strideK + ok;
+#pragma omp simd
+										for (long long k = 0; k < hk; ++k)
+											row[k] = UF::OMP(skepu::Region3D<T>{(int)oi, (int)oj, (int)ok, (size_t)strideJ, (size_t)strideK, center + k}, args...);
+									}
+							}
+				}
+			}
+		};
+	}
+}
+)~~~";
+
+
+std::string generateTiledOverlapSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_tiled_overlap.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << TiledOverlapSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,116 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Transposed copies of the matrices read through MatCol by -transpose-matcol instances. A MatCol proxy steps by
+ * the width of the matrix, so on the host every element of a column comes from another cache line. The user
+ * function structs of these instances have transposedMatCol set, and the CPU and OpenMP backends then build
+ * the proxies with proxyOf over the copy, where column j is row j and the proxy steps by one element.
+ *
+ * layoutOf builds the copy of a Matrix on first use, in cache-sized blocks, and caches it by container. The
+ * copy is rebuilt when the size or the host storage of the matrix changes. Skeletons invalidate the copies of
+ * the matrices they write; call invalidate after writing a matrix through its host accessors.
+ *
+ * GPU kernels keep reading the matrix itself: there, neighbouring threads read neighbouring columns, which is
+ * already coalesced.
+ */
+static const char *TransposeSupport = R"~~~(
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace skepu
+{
+	namespace transpose
+	{
+		constexpr size_t BlockSize = 32;
+
+		template<typename T>
+		struct Layout
+		{
+			const T *source = nullptr;
+			size_t rows = 0;
+			size_t cols = 0;
+			std::vector<T> values;
+		};
+
+		template<typename T>
+		void transposeInto(Layout<T> &layout, const T *data, size_t rows, size_t cols)
+		{
+			layout.source = data;
+			layout.rows = rows;
+			layout.cols = cols;
+			layout.values.resize(rows * cols);
+			T *out = layout.values.data();
+#pragma omp parallel for schedule(static)
+			for (long long jb = 0; jb < (long long)cols; jb += BlockSize)
+				for (size_t ib = 0; ib < rows; ib += BlockSize)
+					for (size_t j = jb; j < std::min<size_t>(jb + BlockSize, cols); ++j)
+						for (size_t i = ib; i < std::min(ib + BlockSize, rows); ++i)
+							out[j * rows + i] = data[i * cols + j];
+		}
+
+		template<typename T>
+		struct Cache
+		{
+			std::mutex mutex;
+			std::map<const void*, Layout<T>> layouts;
+
+			static Cache &instance()
+			{
+				static Cache cache;
+				return cache;
+			}
+		};
+
+		template<typename T>
+		Layout<T> const& layoutOf(skepu::Matrix<T> &matrix)
+		{
+			matrix.updateHost();
+			Cache<T> &cache = Cache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			Layout<T> &layout = cache.layouts[&matrix];
+			if (layout.source != matrix.getAddress() || layout.rows != matrix.total_rows() || layout.cols != matrix.total_cols())
+				transposeInto(layout, matrix.getAddress(), matrix.total_rows(), matrix.total_cols());
+			return layout;
+		}
+
+		// Column col of the matrix, read contiguously from the copy
+		template<typename T>
+		skepu::MatCol<T> proxyOf(Layout<T> const& layout, size_t col)
+		{
+			skepu::MatCol<T> proxy;
+			proxy.data = const_cast<T*>(layout.values.data() + col * layout.rows);
+			proxy.rows = layout.rows;
+			proxy.cols = 1;
+			return proxy;
+		}
+
+		// Drops the cached copy of matrix, the next use transposes it again
+		template<typename T>
+		void invalidate(skepu::Matrix<T> &matrix)
+		{
+			Cache<T> &cache = Cache<T>::instance();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			cache.layouts.erase(&matrix);
+		}
+	}
+}
+)~~~";
+
+
+std::string generateTransposeSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_transpose.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << TransposeSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -0,0 +1,388 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Runtime support for -vendor-blas. Calls to skepu::blas::gemm, gemv, dot and axpy in the main file are
+ * rewritten to the wrappers in skepu::vendor_blas, which hand the operation to cuBLAS in CUDA builds and to CBLAS
+ * (when <cblas.h> is available) otherwise, for float, double and skepu::complex::complex element types. Operands are
+ * taken from the containers' device or host copies through the usual coherency calls, so later skeleton calls see
+ * the result. dot is dispatched for real types only.
+ *
+ * The library is only used for whole containers: gemm and gemv matrices must have exactly the row-major operand
+ * shapes given by m, n and k, the leading dimension arguments are ignored, and gemv on the GPU does not support
+ * ConjTrans. Everything else, including a failing library call, falls back to the skepu::blas implementation.
+ *
+ * Programs using it link cublas in CUDA builds and a CBLAS implementation otherwise.
+ */
+static const char *VendorBLASSupport = R"~~~(
+#pragma once
+
+#include <climits>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#ifdef SKEPU_CUDA
+#include <cublas_v2.h>
+#define SKEPU_VENDOR_BLAS_CUBLAS 1
+#endif
+
+#if !defined(SKEPU_VENDOR_BLAS_CUBLAS) && defined(__has_include)
+#if __has_include(<cblas.h>)
+#include <cblas.h>
+#define SKEPU_VENDOR_BLAS_CBLAS 1
+#endif
+#endif
+
+namespace skepu
+{
+	namespace vendor_blas
+	{
+		namespace detail
+		{
+			template<typename T>
+			struct Routines
+			{
+				static constexpr bool supported = false;
+			};
+
+#ifdef SKEPU_VENDOR_BLAS_CUBLAS
+#define SKEPU_VENDOR_BLAS_CUBLAS_ROUTINES(T, CT, P) \
+			static cublasStatus_t gemm(cublasHandle_t h, cublasOperation_t ta, cublasOperation_t tb, int m, int n, int k, \
+				const T *alpha, const T *A, int lda, const T *B, int ldb, const T *beta, T *C, int ldc) \
+			{ return cublas##P##gemm(h, ta, tb, m, n, k, (const CT*)alpha, (const CT*)A, lda, (const CT*)B, ldb, (const CT*)beta, (CT*)C, ldc); } \
+			static cublasStatus_t gemv(cublasHandle_t h, cublasOperation_t ta, int m, int n, \
+				const T *alpha, const T *A, int lda, const T *x, int incx, const T *beta, T *y, int incy) \
+			{ return cublas##P##gemv(h, ta, m, n, (const CT*)alpha, (const CT*)A, lda, (const CT*)x, incx, (const CT*)beta, (CT*)y, incy); } \
+			static cublasStatus_t axpy(cublasHandle_t h, int n, const T *alpha, const T *x, int incx, T *y, int incy) \
+			{ return cublas##P##axpy(h, n, (const CT*)alpha, (const CT*)x, incx, (CT*)y, incy); }
+#else
+#define SKEPU_VENDOR_BLAS_CUBLAS_ROUTINES(T, CT, P)
+#endif
+
+#ifdef SKEPU_VENDOR_BLAS_CBLAS
+#define SKEPU_VENDOR_BLAS_CBLAS_ROUTINES(T, P, SCALAR) \
+			static void gemm(CBLAS_TRANSPOSE ta, CBLAS_TRANSPOSE tb, int m, int n, int k, \
+				const T &alpha, const T *A, int lda, const T *B, int ldb, const T &beta, T *C, int ldc) \
+			{ cblas_##P##gemm(CblasRowMajor, ta, tb, m, n, k, SCALAR(alpha), A, lda, B, ldb, SCALAR(beta), C, ldc); } \
+			static void gemv(CBLAS_TRANSPOSE ta, int m, int n, \
+				const T &alpha, const T *A, int lda, const T *x, int incx, const T &beta, T *y, int incy) \
+			{ cblas_##P##gemv(CblasRowMajor, ta, m, n, SCALAR(alpha), A, lda, x, incx, SCALAR(beta), y, incy); } \
+			static void axpy(int n, const T &alpha, const T *x, int incx, T *y, int incy) \
+			{ cblas_##P##axpy(n, SCALAR(alpha), x, incx, y, incy); }
+#define SKEPU_VENDOR_BLAS_BY_VALUE(x) (x)
+#define SKEPU_VENDOR_BLAS_BY_POINTER(x) (&(x))
+#else
+#define SKEPU_VENDOR_BLAS_CBLAS_ROUTINES(T, P, SCALAR)
+#endif
+
+			template<>
+			struct Routines<float>
+			{
+				static constexpr bool supported = true, hasDot = true;
+				SKEPU_VENDOR_BLAS_CUBLAS_ROUTINES(float, float, S)
+				SKEPU_VENDOR_BLAS_CBLAS_ROUTINES(float, s, SKEPU_VENDOR_BLAS_BY_VALUE)
+#ifdef SKEPU_VENDOR_BLAS_CUBLAS
+				static cublasStatus_t dot(cublasHandle_t h, int n, const float *x, int incx, const float *y, int incy, float *result)
+				{ return cublasSdot(h, n, x, incx, y, incy, result); }
+#endif
+#ifdef SKEPU_VENDOR_BLAS_CBLAS
+				static float dot(int n, const float *x, int incx, const float *y, int incy) { return cblas_sdot(n, x, incx, y, incy); }
+#endif
+			};
+
+			template<>
+			struct Routines<double>
+			{
+				static constexpr bool supported = true, hasDot = true;
+				SKEPU_VENDOR_BLAS_CUBLAS_ROUTINES(double, double, D)
+				SKEPU_VENDOR_BLAS_CBLAS_ROUTINES(double, d, SKEPU_VENDOR_BLAS_BY_VALUE)
+#ifdef SKEPU_VENDOR_BLAS_CUBLAS
+				static cublasStatus_t dot(cublasHandle_t h, int n, const double *x, int incx, const double *y, int incy, double *result)
+				{ return cublasDdot(h, n, x, incx, y, incy, result); }
+#endif
+#ifdef SKEPU_VENDOR_BLAS_CBLAS
+				static double dot(int n, const double *x, int incx, const double *y, int incy) { return cblas_ddot(n, x, incx, y, incy); }
+#endif
+			};
+
+			// skepu::complex::complex has the (real, imaginary) layout of the library complex types
+			template<>
+			struct Routines<skepu::complex::complex<float>>
+			{
+				static constexpr bool supported = true, hasDot = false;
+				SKEPU_VENDOR_BLAS_CUBLAS_ROUTINES(skepu::complex::complex<float>, cuComplex, C)
+				SKEPU_VENDOR_BLAS_CBLAS_ROUTINES(skepu::complex::complex<float>, c, SKEPU_VENDOR_BLAS_BY_POINTER)
+			};
+
+			template<>
+			struct Routines<skepu::complex::complex<double>>
+			{
+				static constexpr bool supported = true, hasDot = false;
+				SKEPU_VENDOR_BLAS_CUBLAS_ROUTINES(skepu::complex::complex<double>, cuDoubleComplex, Z)
+				SKEPU_VENDOR_BLAS_CBLAS_ROUTINES(skepu::complex::complex<double>, z, SKEPU_VENDOR_BLAS_BY_POINTER)
+			};
+
+			inline bool fitsInt(size_t value)
+			{
+				return value <= (size_t)INT_MAX;
+			}
+
+			// Whole row-major matrix with the rows x cols shape of its operand
+			template<typename T>
+			bool shapeIs(Matrix<T> const& M, blas::Op op, size_t rows, size_t cols)
+			{
+				if (op != blas::Op::NoTrans)
+					std::swap(rows, cols);
+				return M.total_rows() == rows && M.total_cols() == cols && fitsInt(rows) && fitsInt(cols);
+			}
+
+			// Vector covering len elements at positive stride inc
+			template<typename T>
+			bool coversStride(Vector<T> const& v, size_t len, size_t inc)
+			{
+				return inc > 0 && fitsInt(inc) && fitsInt(len) && (len == 0 || v.size() >= 1 + (len - 1) * inc);
+			}
+
+#ifdef SKEPU_VENDOR_BLAS_CUBLAS
+			// One handle per device, nullptr if cuBLAS cannot be initialized
+			inline cublasHandle_t handle(int &device)
+			{
+				static std::mutex lock;
+				static std::map<int, cublasHandle_t> handles;
+				cudaGetDevice(&device);
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = handles.find(device);
+				if (it != handles.end())
+					return it->second;
+				cublasHandle_t h = nullptr;
+				if (cublasCreate(&h) != CUBLAS_STATUS_SUCCESS)
+					h = nullptr;
+				return handles[device] = h;
+			}
+
+			inline cublasOperation_t cuOp(blas::Op op)
+			{
+				return op == blas::Op::NoTrans ? CUBLAS_OP_N : (op == blas::Op::Trans ? CUBLAS_OP_T : CUBLAS_OP_C);
+			}
+
+			template<typename C>
+			const typename C::value_type *deviceRead(C const& c, int device)
+			{
+				C &container = const_cast<C&>(c);
+				return container.updateDevice_CU(container.getAddress(), container.size(), device, AccessMode::Read)->getDeviceDataPointer();
+			}
+
+			template<typename C>
+			typename C::value_type *deviceWrite(C &c, int device)
+			{
+				return c.updateDevice_CU(c.getAddress(), c.size(), device, AccessMode::ReadWrite)->getDeviceDataPointer();
+			}
+#endif
+
+#ifdef SKEPU_VENDOR_BLAS_CBLAS
+			inline CBLAS_TRANSPOSE cblasOp(blas::Op op)
+			{
+				return op == blas::Op::NoTrans ? CblasNoTrans : (op == blas::Op::Trans ? CblasTrans : CblasConjTrans);
+			}
+
+			template<typename C>
+			const typename C::value_type *hostRead(C const& c)
+			{
+				C &container = const_cast<C&>(c);
+				container.updateHost();
+				return container.getAddress();
+			}
+
+			template<typename C>
+			typename C::value_type *hostWrite(C &c)
+			{
+				c.updateHost();
+				c.invalidateDeviceData();
+				return c.getAddress();
+			}
+#endif
+
+			// Returns false where the skeleton implementation has to be used
+			template<typename T, bool Supported = Routines<T>::supported>
+			struct Dispatch
+			{
+				template<typename... Args> static bool gemm(Args&&...) { return false; }
+				template<typename... Args> static bool gemv(Args&&...) { return false; }
+				template<typename... Args> static bool dot(Args&&...) { return false; }
+				template<typename... Args> static bool axpy(Args&&...) { return false; }
+			};
+
+			template<typename T>
+			struct Dispatch<T, true>
+			{
+				template<typename... Args> static bool gemm(Args&&...) { return false; }
+				template<typename... Args> static bool gemv(Args&&...) { return false; }
+				template<typename... Args> static bool dot(Args&&...) { return false; }
+				template<typename... Args> static bool axpy(Args&&...) { return false; }
+
+				static bool gemm(blas::Op transA, blas::Op transB, size_t m, size_t n, size_t k,
+					T alpha, Matrix<T> const& A, Matrix<T> const& B, T beta, Matrix<T> &C)
+				{
+					if (!shapeIs(A, transA, m, k) || !shapeIs(B, transB, k, n) || !shapeIs(C, blas::Op::NoTrans, m, n))
+						return false;
+#if defined(SKEPU_VENDOR_BLAS_CUBLAS)
+					int device;
+					cublasHandle_t h = handle(device);
+					if (!h)
+						return false;
+					const T *dA = deviceRead(A, device), *dB = deviceRead(B, device);
+					T *dC = deviceWrite(C, device);
+					// The column-major view of a row-major matrix is its transpose: C^T = op(B)^T op(A)^T
+					return Routines<T>::gemm(h, cuOp(transB), cuOp(transA), (int)n, (int)m, (int)k,
+						&alpha, dB, (int)B.total_cols(), dA, (int)A.total_cols(), &beta, dC, (int)n) == CUBLAS_STATUS_SUCCESS;
+#elif defined(SKEPU_VENDOR_BLAS_CBLAS)
+					const T *hA = hostRead(A), *hB = hostRead(B);
+					Routines<T>::gemm(cblasOp(transA), cblasOp(transB), (int)m, (int)n, (int)k,
+						alpha, hA, (int)A.total_cols(), hB, (int)B.total_cols(), beta, hostWrite(C), (int)n);
+					return true;
+#else
+					return false;
+#endif
+				}
+
+				static bool gemv(blas::Op trans, size_t m, size_t n, T alpha, Matrix<T> const& A,
+					Vector<T> const& x, size_t incx, T beta, Vector<T> &y, size_t incy)
+				{
+					const bool noTrans = trans == blas::Op::NoTrans;
+					if (!shapeIs(A, blas::Op::NoTrans, m, n) || !coversStride(x, noTrans ? n : m, incx) || !coversStride(y, noTrans ? m : n, incy))
+						return false;
+#if defined(SKEPU_VENDOR_BLAS_CUBLAS)
+					// op(A^T) has no cuBLAS operation for conjugation without transposition
+					if (trans == blas::Op::ConjTrans && !std::is_floating_point<T>::value)
+						return false;
+					int device;
+					cublasHandle_t h = handle(device);
+					if (!h)
+						return false;
+					const T *dA = deviceRead(A, device), *dx = deviceRead(x, device);
+					T *dy = deviceWrite(y, device);
+					return Routines<T>::gemv(h, noTrans ? CUBLAS_OP_T : CUBLAS_OP_N, (int)n, (int)m,
+						&alpha, dA, (int)n, dx, (int)incx, &beta, dy, (int)incy) == CUBLAS_STATUS_SUCCESS;
+#elif defined(SKEPU_VENDOR_BLAS_CBLAS)
+					const T *hA = hostRead(A), *hx = hostRead(x);
+					Routines<T>::gemv(cblasOp(trans), (int)m, (int)n, alpha, hA, (int)n, hx, (int)incx, beta, hostWrite(y), (int)incy);
+					return true;
+#else
+					return false;
+#endif
+				}
+
+				static bool dot(size_t n, Vector<T> const& x, size_t incx, Vector<T> const& y, size_t incy, T &result)
+				{
+					return dotOf(std::integral_constant<bool, Routines<T>::hasDot>(), n, x, incx, y, incy, result);
+				}
+
+				static bool axpy(size_t n, T alpha, Vector<T> const& x, size_t incx, Vector<T> &y, size_t incy)
+				{
+					if (!coversStride(x, n, incx) || !coversStride(y, n, incy))
+						return false;
+#if defined(SKEPU_VENDOR_BLAS_CUBLAS)
+					int device;
+					cublasHandle_t h = handle(device);
+					if (!h)
+						return false;
+					const T *dx = deviceRead(x, device);
+					return Routines<T>::axpy(h, (int)n, &alpha, dx, (int)incx, deviceWrite(y, device), (int)incy) == CUBLAS_STATUS_SUCCESS;
+#elif defined(SKEPU_VENDOR_BLAS_CBLAS)
+					const T *hx = hostRead(x);
+					Routines<T>::axpy((int)n, alpha, hx, (int)incx, hostWrite(y), (int)incy);
+					return true;
+#else
+					return false;
+#endif
+				}
+
+			private:
+				template<typename... Args>
+				static bool dotOf(std::false_type, Args&&...)
+				{
+					return false;
+				}
+
+				template<typename U = T>
+				static bool dotOf(std::true_type, size_t n, Vector<U> const& x, size_t incx, Vector<U> const& y, size_t incy, U &result)
+				{
+					if (!coversStride(x, n, incx) || !coversStride(y, n, incy))
+						return false;
+#if defined(SKEPU_VENDOR_BLAS_CUBLAS)
+					int device;
+					cublasHandle_t h = handle(device);
+					if (!h)
+						return false;
+					return Routines<U>::dot(h, (int)n, deviceRead(x, device), (int)incx, deviceRead(y, device), (int)incy, &result) == CUBLAS_STATUS_SUCCESS;
+#elif defined(SKEPU_VENDOR_BLAS_CBLAS)
+					result = Routines<U>::dot((int)n, hostRead(x), (int)incx, hostRead(y), (int)incy);
+					return true;
+#else
+					return false;
+#endif
+				}
+			};
+
+			template<typename C>
+			typename std::decay<C>::type const& asConst(C &&c)
+			{
+				return c;
+			}
+
+			template<typename C>
+			using ElementOf = typename std::decay<C>::type::value_type;
+		}
+
+		template<typename Alpha, typename MA, typename MB, typename Beta, typename MC>
+		void gemm(blas::Op transA, blas::Op transB, size_t m, size_t n, size_t k, Alpha alpha, MA &&A, size_t lda, MB &&B, size_t ldb, Beta beta, MC &&C, size_t ldc)
+		{
+			using T = detail::ElementOf<MC>;
+			if (!detail::Dispatch<T>::gemm(transA, transB, m, n, k, T(alpha), detail::asConst(A), detail::asConst(B), T(beta), C))
+				skepu::blas::gemm(transA, transB, m, n, k, alpha, std::forward<MA>(A), lda, std::forward<MB>(B), ldb, beta, std::forward<MC>(C), ldc);
+		}
+
+		template<typename Alpha, typename MA, typename VX, typename Beta, typename VY>
+		void gemv(blas::Op trans, size_t m, size_t n, Alpha alpha, MA &&A, size_t lda, VX &&x, size_t incx, Beta beta, VY &&y, size_t incy)
+		{
+			using T = detail::ElementOf<VY>;
+			if (!detail::Dispatch<T>::gemv(trans, m, n, T(alpha), detail::asConst(A), detail::asConst(x), incx, T(beta), y, incy))
+				skepu::blas::gemv(trans, m, n, alpha, std::forward<MA>(A), lda, std::forward<VX>(x), incx, beta, std::forward<VY>(y), incy);
+		}
+
+		template<typename VX, typename VY>
+		auto dot(size_t n, VX &&x, size_t incx, VY &&y, size_t incy) -> decltype(skepu::blas::dot(n, std::forward<VX>(x), incx, std::forward<VY>(y), incy))
+		{
+			using T = detail::ElementOf<VX>;
+			T result;
+			if (detail::Dispatch<T>::dot(n, detail::asConst(x), incx, detail::asConst(y), incy, result))
+				return result;
+			return skepu::blas::dot(n, std::forward<VX>(x), incx, std::forward<VY>(y), incy);
+		}
+
+		template<typename Alpha, typename VX, typename VY>
+		void axpy(size_t n, Alpha alpha, VX &&x, size_t incx, VY &&y, size_t incy)
+		{
+			using T = detail::ElementOf<VY>;
+			if (!detail::Dispatch<T>::axpy(n, T(alpha), detail::asConst(x), incx, y, incy))
+				skepu::blas::axpy(n, alpha, std::forward<VX>(x), incx, std::forward<VY>(y), incy);
+		}
+	}
+}
+)~~~";
+
+
+std::string generateVendorBLASSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_vendor_blas.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << VendorBLASSupport;
+		generated = true;
+	}
+	return fileName;
+}
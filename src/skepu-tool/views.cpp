@@ -0,0 +1,206 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Sub-range views of containers for -views, so that a skeleton runs on part of a vector or matrix in place
+ * instead of on a copy. views::slice(v, first, count) is a VectorView of count elements of v from first, and
+ * views::rows(m, first, count) a MatrixRowsView of count whole rows of m. Both are contiguous, and view the
+ * parent through its iterators: they share its host and device storage and its coherency state, reading and
+ * writing only the viewed part, and allocate nothing. views::block(m, row, rows, col, cols) is a MatrixBlockView,
+ * whose rows are contiguous but not the block itself.
+ *
+ * Every Map, MapReduce, Reduce, Scan and MapOverlap1D instance takes views wherever it takes a container of its
+ * elementwise arguments or result, through the iterator interface of the skeletons: the first argument gives the
+ * range and the other elementwise arguments start at their first element, and must have at least as many. Indices
+ * of indexed user functions are those of the parent. Block views are arguments of Map instances only, which run
+ * one call per row of the result block. The header is included before the SkePU headers.
+ */
+static const char *ViewsSupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace skepu
+{
+	template<typename T> class Vector;
+	template<typename T> class Matrix;
+
+	namespace views
+	{
+		template<typename Container>
+		class Range
+		{
+		public:
+			Range(Container &parent, size_t first, size_t count): parent(parent), first(first), count(count) {}
+
+			auto begin() -> decltype(std::declval<Container&>().begin()) { return this->parent.begin() + this->first; }
+			auto end() -> decltype(std::declval<Container&>().begin()) { return this->begin() + this->count; }
+
+			size_t size() const { return this->count; }
+			size_t offset() const { return this->first; }
+			Container &getParent() { return this->parent; }
+
+		private:
+			Container &parent;
+			size_t first, count;
+		};
+
+		template<typename Container>
+		class Block
+		{
+		public:
+			Block(Container &parent, size_t row, size_t rows, size_t col, size_t cols)
+			: parent(parent), firstRow(row), rowCount(rows), firstCol(col), colCount(cols) {}
+
+			Range<Container> row(size_t i) { return Range<Container>(this->parent, (this->firstRow + i) * this->parent.total_cols() + this->firstCol, this->colCount); }
+
+			size_t total_rows() const { return this->rowCount; }
+			size_t total_cols() const { return this->colCount; }
+			size_t size() const { return this->rowCount * this->colCount; }
+			Container &getParent() { return this->parent; }
+
+		private:
+			Container &parent;
+			size_t firstRow, rowCount, firstCol, colCount;
+		};
+
+		template<typename Container>
+		Range<Container> slice(Container &parent, size_t first, size_t count)
+		{
+			if (first > parent.size() || count > parent.size() - first)
+				throw std::out_of_range("skepu::views::slice: range exceeds the container");
+			return Range<Container>(parent, first, count);
+		}
+
+		template<typename Container>
+		Range<Container> rows(Container &parent, size_t first, size_t count)
+		{
+			if (first > parent.total_rows() || count > parent.total_rows() - first)
+				throw std::out_of_range("skepu::views::rows: rows exceed the matrix");
+			return Range<Container>(parent, first * parent.total_cols(), count * parent.total_cols());
+		}
+
+		template<typename Container>
+		Block<Container> block(Container &parent, size_t row, size_t rows, size_t col, size_t cols)
+		{
+			if (row > parent.total_rows() || rows > parent.total_rows() - row || col > parent.total_cols() || cols > parent.total_cols() - col)
+				throw std::out_of_range("skepu::views::block: block exceeds the matrix");
+			return Block<Container>(parent, row, rows, col, cols);
+		}
+
+		template<typename T> struct IsView: std::false_type {};
+		template<typename Container> struct IsView<Range<Container>>: std::true_type {};
+		template<typename Container> struct IsView<Block<Container>>: std::true_type {};
+
+		template<typename... Args> struct AnyView: std::false_type {};
+		template<typename Arg, typename... Args>
+		struct AnyView<Arg, Args...>: std::integral_constant<bool, IsView<typename std::decay<Arg>::type>::value || AnyView<Args...>::value> {};
+
+		template<size_t... I> struct Sequence {};
+		template<size_t N, size_t... I> struct Indices: Indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct Indices<0, I...> { using type = Sequence<I...>; };
+
+		// Elementwise arguments start at their first element, the others are passed on
+		template<bool Elementwise>
+		struct Pass
+		{
+			template<typename Arg>
+			static Arg &of(Arg &arg, size_t) { return arg; }
+
+			template<typename Arg>
+			static Arg &row(Arg &arg, size_t, size_t) { return arg; }
+		};
+
+		template<>
+		struct Pass<true>
+		{
+			template<typename Arg>
+			static auto of(Arg &arg, size_t count) -> decltype(arg.begin())
+			{
+				if (arg.size() < count)
+					throw std::out_of_range("skepu::views: elementwise argument shorter than the range");
+				return arg.begin();
+			}
+
+			template<typename Container>
+			static auto row(Block<Container> &arg, size_t i, size_t count) -> decltype(arg.row(i).begin())
+			{
+				if (arg.total_cols() < count)
+					throw std::out_of_range("skepu::views: elementwise block narrower than the result");
+				return arg.row(i).begin();
+			}
+		};
+
+		// Results is 1 for skeletons writing their first argument, whose calls return it, and 0 for reductions,
+		// whose calls return Ret; Elwise counts the elementwise arguments after the results
+		template<typename Skeleton, typename Ret, size_t Results, size_t Elwise, bool Blocks>
+		class Viewing: public Skeleton
+		{
+			template<typename First>
+			using Returned = typename std::conditional<Results == 1, First&, Ret>::type;
+
+		public:
+			using Skeleton::Skeleton;
+
+			template<typename... Args, typename std::enable_if<!AnyView<Args...>::value, int>::type = 0>
+			auto operator()(Args&&... args) -> decltype(std::declval<Skeleton&>()(std::forward<Args>(args)...))
+			{
+				return Skeleton::operator()(std::forward<Args>(args)...);
+			}
+
+			template<typename First, typename... Args, typename std::enable_if<AnyView<First, Args...>::value, int>::type = 0>
+			Returned<First> operator()(First &first, Args&... args)
+			{
+				return this->call(std::integral_constant<bool, Results == 1>{}, first, typename Indices<sizeof...(Args)>::type{}, args...);
+			}
+
+		private:
+			template<typename First, typename... Args, size_t... I>
+			First &call(std::true_type, First &first, Sequence<I...>, Args&... args)
+			{
+				Skeleton::operator()(first.begin(), first.end(), Pass<(I + 1 < Results + Elwise)>::of(args, first.size())...);
+				return first;
+			}
+
+			template<typename First, typename... Args, size_t... I>
+			Ret call(std::false_type, First &first, Sequence<I...>, Args&... args)
+			{
+				return Skeleton::operator()(first.begin(), first.end(), Pass<(I + 1 < Results + Elwise)>::of(args, first.size())...);
+			}
+
+			template<typename Container, typename... Args, size_t... I>
+			Block<Container> &call(std::true_type, Block<Container> &res, Sequence<I...>, Args&... args)
+			{
+				static_assert(Blocks, "skepu::views: block views are arguments of Map instances only");
+				for (size_t r = 0; r < res.total_rows(); ++r)
+				{
+					Range<Container> line = res.row(r);
+					Skeleton::operator()(line.begin(), line.end(), Pass<(I + 1 < Results + Elwise)>::row(args, r, line.size())...);
+				}
+				return res;
+			}
+		};
+	}
+
+	template<typename T> using VectorView = views::Range<Vector<T>>;
+	template<typename T> using MatrixRowsView = views::Range<Matrix<T>>;
+	template<typename T> using MatrixBlockView = views::Block<Matrix<T>>;
+}
+)~~~";
+
+
+std::string generateViewsSupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_views.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << ViewsSupport;
+		generated = true;
+	}
+	return fileName;
+}
@@ -1,10 +1,28 @@
+#include <algorithm>
+#include <set>
+
 #include "globals.h"
 #include "code_gen.h"
 #include "visitor.h"
 
 using namespace clang;
 
-std::unordered_set<std::string> SkeletonInstances;
+thread_local std::unordered_set<std::string> SkeletonInstances;
+
+// Call sites of skeleton instances and reference counts of local declarations, used by the fusion passes
+thread_local std::unordered_map<const VarDecl*, std::vector<CXXOperatorCallExpr*>> SkeletonInstanceCalls;
+thread_local std::unordered_map<const VarDecl*, size_t> DeclReferenceCounts, MemberCallCounts;
+
+// Calls to the skepu::blas routines with a vendor library dispatch, rewritten by -vendor-blas
+thread_local std::vector<CallExpr*> VendorBLASCalls;
+
+// Reduce instances fused with the Map instance producing their input
+thread_local std::unordered_map<const VarDecl*, VarDecl*> FusedMapReduceInstances;
+
+// Composite user functions of Map instances fused with the Map producing one of their elementwise inputs,
+// and the instances which are generated with them (a composite may itself be fused into a later skeleton)
+thread_local std::unordered_map<const VarDecl*, UserFunction*> FusedMapUFs;
+thread_local std::unordered_set<const VarDecl*> FusedMapInstances;
 
 [[noreturn]] void SkePUAbort(std::string msg)
 {
@@ -78,6 +96,12 @@ UserFunction *HandleLambdaArg(Expr *ArgExpr, VarDecl *d)
 	return UF;
 }
 
+// Skeletons beyond the SkePU 3 runtime are only recognized when -skeletons lists them
+bool SkeletonIsProvided(const Skeleton &skeleton)
+{
+	static const std::set<std::string> RuntimeOptional {"ReduceByKey", "Histogram", "Sort", "Filter", "Gather", "Scatter"};
+	return !RuntimeOptional.count(skeleton.name) || std::find(RuntimeSkeletons.begin(), RuntimeSkeletons.end(), skeleton.name) != RuntimeSkeletons.end();
+}
 
 const Skeleton::Type* DeclIsValidSkeleton(VarDecl *d)
 {
@@ -128,7 +152,7 @@ const Skeleton::Type* DeclIsValidSkeleton(VarDecl *d)
 	const TemplateDecl *Template = RetType->getAs<TemplateSpecializationType>()->getTemplateName().getAsTemplateDecl();
 	std::string TypeName = Template->getNameAsString();
 
-	if (Skeletons.find(TypeName) == Skeletons.end())
+	if (Skeletons.find(TypeName) == Skeletons.end() || !SkeletonIsProvided(Skeletons.at(TypeName)))
 		return nullptr;
 	
 //	d->dump();
@@ -136,7 +160,8 @@ const Skeleton::Type* DeclIsValidSkeleton(VarDecl *d)
 	return &Skeletons.at(TypeName).type;
 }
 
-bool HandleSkeletonInstance(VarDecl *d)
+// The skepu::<Skeleton>(...) call expression initializing a skeleton instance
+CallExpr *SkeletonFactoryCall(VarDecl *d)
 {
 	if (d->isThisDeclarationADefinition() != VarDecl::DefinitionKind::Definition)
 		SkePUAbort("Not a definition");
@@ -159,14 +184,108 @@ bool HandleSkeletonInstance(VarDecl *d)
 	if (!CExpr)
 		SkePUAbort("Not a call expression");
 
+	return CExpr;
+}
 
+const TemplateSpecializationType *SkeletonTemplate(CallExpr *CExpr)
+{
 	const FunctionDecl *Callee = CExpr->getDirectCallee();
 	const Type *RetType = Callee->getReturnType().getTypePtr();
 
 	if (isa<DecltypeType>(RetType))
 		RetType = dyn_cast<DecltypeType>(RetType)->getUnderlyingType().getTypePtr();
 
-	const TemplateSpecializationType *Template = RetType->getAs<TemplateSpecializationType>();
+	return RetType->getAs<TemplateSpecializationType>();
+}
+
+UserFunction *HandleUserFunctionArg(Expr *expr, VarDecl *d)
+{
+	// The argument may be an implcit cast, get the underlying expression
+	if (ImplicitCastExpr *ImplExpr = dyn_cast<ImplicitCastExpr>(expr))
+		return HandleFunctionPointerArg(ImplExpr->IgnoreImpCasts());
+	
+	// It can also be an explicit cast, get the underlying expression
+	else if (UnaryOperator *UnaryCastExpr = dyn_cast<UnaryOperator>(expr))
+		return HandleFunctionPointerArg(UnaryCastExpr->getSubExpr());
+	
+	// The user function is probably defined as a lambda
+	else
+		return HandleLambdaArg(expr, d);
+}
+
+size_t SkeletonTemplateArity(const TemplateSpecializationType *Template, unsigned i, VarDecl *d)
+{
+	assert(Template->getNumArgs() > i);
+	return Template->getArg(i).getAsExpr()->EvaluateKnownConstInt(d->getASTContext()).getExtValue();
+}
+
+// The user function and elementwise arity of a Map instance, taking earlier fusion into account
+UserFunction *MapInstanceUF(VarDecl *Map, size_t &arity)
+{
+	auto Fused = FusedMapUFs.find(Map);
+	if (Fused != FusedMapUFs.end())
+	{
+		arity = Fused->second->Varity;
+		return Fused->second;
+	}
+	
+	CallExpr *MapCExpr = SkeletonFactoryCall(Map);
+	arity = SkeletonTemplateArity(SkeletonTemplate(MapCExpr), 0, Map);
+	UserFunction *UF = HandleUserFunctionArg(MapCExpr->getArg(0), Map);
+	UF->updateArgLists(arity);
+	return UF;
+}
+
+bool HandleFusedMapReduceInstance(VarDecl *Map, VarDecl *Reduce);
+
+// MapReduce with a multi-return map function and one reduce function per return value,
+// combined into a composite reduce function so that all results come out of one sweep
+bool HandleMultiReduceInstance(CallExpr *CExpr, std::vector<size_t> &arity, std::string InstanceName, VarDecl *d)
+{
+	UserFunction *MapUF = HandleUserFunctionArg(CExpr->getArg(0), d);
+	MapUF->updateArgLists(arity[0]);
+	
+	size_t numReducers = CExpr->getNumArgs() - 1;
+	if (MapUF->multipleReturnTypes.size() != numReducers)
+		SkePUAbort("MapReduce instance " + InstanceName + ": " + std::to_string(numReducers) + " reduce functions given for "
+			+ std::to_string(MapUF->multipleReturnTypes.size()) + " map return values");
+	
+	std::vector<UserFunction*> Reducers;
+	for (size_t k = 0; k < numReducers; ++k)
+	{
+		UserFunction *ReduceUF = HandleUserFunctionArg(CExpr->getArg(k + 1), d);
+		ReduceUF->updateArgLists(2);
+		
+		// Type mismatches surface when compiling the generated code, only the shape is checked here
+		bool binary = ReduceUF->elwiseParams.size() == 2 && ReduceUF->multipleReturnTypes.empty()
+			&& !ReduceUF->indexParam && !ReduceUF->randomParam && ReduceUF->anyContainerParams.empty() && ReduceUF->anyScalarParams.empty();
+		if (!binary)
+			SkePUAbort("MapReduce instance " + InstanceName + ": reduce function " + ReduceUF->rawName
+				+ " must be a binary function on " + MapUF->multipleReturnTypes[k] + ", map return value " + std::to_string(k));
+		Reducers.push_back(ReduceUF);
+	}
+	
+	SkePULog() << "Combining " << numReducers << " reduce functions for MapReduce instance " << InstanceName << "\n";
+	UserFunction *ReduceUF = new UserFunction(MapUF, Reducers);
+	return transformSkeletonInvocation(Skeletons.at("MapReduceImpl"), InstanceName, { MapUF, ReduceUF }, arity, d);
+}
+
+bool HandleSkeletonInstance(VarDecl *d)
+{
+	auto Fused = FusedMapReduceInstances.find(d);
+	if (Fused != FusedMapReduceInstances.end())
+		return HandleFusedMapReduceInstance(Fused->second, d);
+	
+	if (FusedMapInstances.count(d))
+	{
+		std::string InstanceName = d->getNameAsString();
+		SkeletonInstances.insert(InstanceName);
+		UserFunction *UF = FusedMapUFs.at(d);
+		return transformSkeletonInvocation(Skeletons.at("MapImpl"), InstanceName, { UF }, { UF->Varity, 2 }, d);
+	}
+	
+	CallExpr *CExpr = SkeletonFactoryCall(d);
+	const TemplateSpecializationType *Template = SkeletonTemplate(CExpr);
 	std::string TypeName = Template->getTemplateName().getAsTemplateDecl()->getNameAsString();
 	Skeleton::Type skeletonType = Skeletons.at(TypeName).type;
 
@@ -178,14 +297,12 @@ bool HandleSkeletonInstance(VarDecl *d)
 	{
 	case Skeleton::Type::Map:
 	case Skeleton::Type::MapReduce:
-		assert(Template->getNumArgs() > 0);
-		arity[0] = Template->getArg(0).getAsExpr()->EvaluateKnownConstInt(d->getASTContext()).getExtValue();
+		arity[0] = SkeletonTemplateArity(Template, 0, d);
 		break;
 	case Skeleton::Type::MapPairs:
 	case Skeleton::Type::MapPairsReduce:
-		assert(Template->getNumArgs() > 1);
-		arity[0] = Template->getArg(0).getAsExpr()->EvaluateKnownConstInt(d->getASTContext()).getExtValue();
-		arity[1] = Template->getArg(1).getAsExpr()->EvaluateKnownConstInt(d->getASTContext()).getExtValue();
+		arity[0] = SkeletonTemplateArity(Template, 0, d);
+		arity[1] = SkeletonTemplateArity(Template, 1, d);
 		break;
 	case Skeleton::Type::MapOverlap1D:
 		arity[0] = 1; break;
@@ -195,28 +312,28 @@ bool HandleSkeletonInstance(VarDecl *d)
 		arity[0] = 1; break;
 	case Skeleton::Type::MapOverlap4D:
 		arity[0] = 1; break;
+	case Skeleton::Type::Histogram:
+		arity[0] = 1; break;
+	case Skeleton::Type::Sort:
+		arity[0] = 2; break;
+	case Skeleton::Type::Filter:
+		arity[0] = 1; break;
+	case Skeleton::Type::Gather:
+		arity[0] = 1; break;
+	case Skeleton::Type::Scatter:
+		arity[0] = 1; break;
 	default:
 		break;
 	}
 	
+	if (skeletonType == Skeleton::Type::MapReduce && CExpr->getNumArgs() > 2)
+		return HandleMultiReduceInstance(CExpr, arity, InstanceName, d);
+	
 	std::vector<UserFunction*> FuncArgs;
 	size_t i = 0;
 	for (Expr *expr : CExpr->arguments())
 	{
-		UserFunction *UF;
-		
-		// The argument may be an implcit cast, get the underlying expression
-		if (ImplicitCastExpr *ImplExpr = dyn_cast<ImplicitCastExpr>(expr))
-			UF = HandleFunctionPointerArg(ImplExpr->IgnoreImpCasts());
-		
-		// It can also be an explicit cast, get the underlying expression
-		else if (UnaryOperator *UnaryCastExpr = dyn_cast<UnaryOperator>(expr))
-			UF = HandleFunctionPointerArg(UnaryCastExpr->getSubExpr());
-		
-		// The user function is probably defined as a lambda
-		else
-			UF = HandleLambdaArg(expr, d);
-		
+		UserFunction *UF = HandleUserFunctionArg(expr, d);
 		FuncArgs.push_back(UF);
 		
 		if (skeletonType == Skeleton::Type::MapPairs || skeletonType == Skeleton::Type::MapPairsReduce)
@@ -228,6 +345,355 @@ bool HandleSkeletonInstance(VarDecl *d)
 	return transformSkeletonInvocation(Skeletons.at(TypeName), InstanceName, FuncArgs, arity, d);
 }
 
+bool HandleFusedMapReduceInstance(VarDecl *Map, VarDecl *Reduce)
+{
+	CallExpr *ReduceCExpr = SkeletonFactoryCall(Reduce);
+	
+	std::string InstanceName = Reduce->getNameAsString();
+	SkeletonInstances.insert(InstanceName);
+	SkePULog() << "Fusing Map instance " << Map->getNameAsString() << " into Reduce instance " << InstanceName << "\n";
+	
+	std::vector<size_t> arity = { 0, 2 };
+	UserFunction *MapUF = MapInstanceUF(Map, arity[0]);
+	UserFunction *ReduceUF = HandleUserFunctionArg(ReduceCExpr->getArg(0), Reduce);
+	ReduceUF->updateArgLists(arity[1]);
+	
+	return transformSkeletonInvocation(Skeletons.at("MapReduceImpl"), InstanceName, { MapUF, ReduceUF }, arity, Reduce);
+}
+
+// ------------------------------
+// Skeleton fusion
+// ------------------------------
+
+const VarDecl *ReferencedVarDecl(const Expr *e)
+{
+	if (auto *Ref = dyn_cast<DeclRefExpr>(e->IgnoreParenImpCasts()))
+		return dyn_cast<VarDecl>(Ref->getDecl());
+	return nullptr;
+}
+
+// Walks up from an expression to the statement directly contained in a compound statement
+const Stmt *EnclosingStatement(ASTContext &Ctx, const Stmt *s, const CompoundStmt *&Block)
+{
+	ast_type_traits::DynTypedNode Node = ast_type_traits::DynTypedNode::create(*s);
+	const Stmt *Current = s;
+	while (true)
+	{
+		auto Parents = Ctx.getParents(Node);
+		if (Parents.size() != 1)
+			return nullptr;
+		
+		if ((Block = Parents[0].get<CompoundStmt>()))
+			return Current;
+		
+		if (const Stmt *ParentStmt = Parents[0].get<Stmt>())
+			Current = ParentStmt;
+		else if (!Parents[0].get<VarDecl>())
+			return nullptr;
+		
+		Node = Parents[0];
+	}
+}
+
+// True if Producer is an expression statement and Consumer is part of the statement directly
+// following it in the same block, outside of any control flow
+bool AdjacentStatements(ASTContext &Ctx, const CXXOperatorCallExpr *Producer, const CXXOperatorCallExpr *Consumer, const Stmt *&ProducerStmt)
+{
+	const CompoundStmt *ProducerBlock = nullptr, *ConsumerBlock = nullptr;
+	ProducerStmt = EnclosingStatement(Ctx, Producer, ProducerBlock);
+	const Stmt *ConsumerStmt = EnclosingStatement(Ctx, Consumer, ConsumerBlock);
+	if (!ProducerStmt || !ConsumerStmt || ProducerBlock != ConsumerBlock)
+		return false;
+	if (!isa<Expr>(ProducerStmt) || dyn_cast<Expr>(ProducerStmt)->IgnoreImplicit() != Producer)
+		return false;
+	if (!isa<Expr>(ConsumerStmt) && !isa<DeclStmt>(ConsumerStmt) && !isa<ReturnStmt>(ConsumerStmt))
+		return false;
+	
+	auto Next = std::find(ProducerBlock->body_begin(), ProducerBlock->body_end(), ProducerStmt);
+	return Next != ProducerBlock->body_end() && ++Next != ProducerBlock->body_end() && *Next == ConsumerStmt;
+}
+
+// The declaration statement of a local skepu::Vector referenced only by the producer and consumer calls
+const DeclStmt *PrivateIntermediate(ASTContext &Ctx, const VarDecl *Tmp)
+{
+	if (!Tmp || isa<ParmVarDecl>(Tmp) || !Tmp->hasLocalStorage() || DeclReferenceCounts[Tmp] != 2)
+		return nullptr;
+	if (Tmp->getType().getCanonicalType().getAsString().find("skepu::Vector<") == std::string::npos)
+		return nullptr;
+	
+	auto Parents = Ctx.getParents(*Tmp);
+	const DeclStmt *TmpDeclStmt = Parents.size() == 1 ? Parents[0].get<DeclStmt>() : nullptr;
+	if (!TmpDeclStmt || !TmpDeclStmt->isSingleDecl())
+		return nullptr;
+	return TmpDeclStmt;
+}
+
+// A fused skeleton replaces the consumer, so the consumer instance may only be invoked once
+// and otherwise only be configured through member calls
+CXXOperatorCallExpr *SingleInvocation(VarDecl *d)
+{
+	auto &Calls = SkeletonInstanceCalls[d];
+	if (Calls.size() != 1 || DeclReferenceCounts[d] != 1 + MemberCallCounts[d])
+		return nullptr;
+	return Calls[0];
+}
+
+bool AllRewritable(std::initializer_list<SourceRange> ranges)
+{
+	for (SourceRange range : ranges)
+		if (!Rewriter::isRewritable(range.getBegin()) || !Rewriter::isRewritable(range.getEnd()))
+			return false;
+	return true;
+}
+
+// Elementwise arguments of a Map call, as rewritten by earlier fusion
+SourceRange MapCallElwiseArgs(CXXOperatorCallExpr *MapCall)
+{
+	return SourceRange(MapCall->getArg(2)->getBeginLoc(), MapCall->getArg(MapCall->getNumArgs() - 1)->getEndLoc());
+}
+
+// A Map call M(tmp, args...) with a single output whose user function takes only elementwise arguments
+struct MapProducer
+{
+	VarDecl *Map;
+	CXXOperatorCallExpr *Call;
+};
+
+std::unordered_map<const VarDecl*, MapProducer> FindMapProducers(const std::unordered_set<VarDecl*> &instances, bool elwiseOnly)
+{
+	std::unordered_map<const VarDecl*, MapProducer> Producers;
+	for (VarDecl *d : instances)
+	{
+		if (*DeclIsValidSkeleton(d) != Skeleton::Type::Map)
+			continue;
+		
+		CallExpr *MapCExpr = SkeletonFactoryCall(d);
+		size_t arity = SkeletonTemplateArity(SkeletonTemplate(MapCExpr), 0, d);
+		UserFunction *UF = HandleUserFunctionArg(MapCExpr->getArg(0), d);
+		UF->updateArgLists(arity);
+		if (arity == 0 || !UF->multipleReturnTypes.empty() || UF->randomParam)
+			continue;
+		if (elwiseOnly && (UF->indexParam || !UF->anyContainerParams.empty() || !UF->anyScalarParams.empty()))
+			continue;
+		
+		for (CXXOperatorCallExpr *Call : SkeletonInstanceCalls[d])
+			if (Call->getNumArgs() > 2 && (!elwiseOnly || Call->getNumArgs() == 2 + arity))
+				if (const VarDecl *Out = ReferencedVarDecl(Call->getArg(1)))
+					Producers[Out] = { d, Call };
+	}
+	return Producers;
+}
+
+// Finds statement pairs of the form
+//   M1(tmp, args...);
+//   ... M2(out..., a, tmp, b, ...) ...;
+// where tmp is a private intermediate (see above) and M1 takes only elementwise arguments.
+// Each pair is rewritten to M2(out..., a, args..., b, ...) and M2 is generated with a composite
+// user function evaluating M1 in place of its tmp parameter. Pairs are handled in source order,
+// so longer chains fold into the last Map.
+void FuseMapChains(const std::unordered_set<VarDecl*> &instances)
+{
+	struct Link
+	{
+		MapProducer Producer;
+		VarDecl *Consumer;
+		CXXOperatorCallExpr *ConsumerCall;
+		size_t ConsumedArg;
+		const Stmt *ProducerStmt;
+		const DeclStmt *TmpDeclStmt;
+	};
+	std::vector<Link> Links;
+	
+	auto Producers = FindMapProducers(instances, true);
+	for (VarDecl *Consumer : instances)
+	{
+		if (*DeclIsValidSkeleton(Consumer) != Skeleton::Type::Map)
+			continue;
+		
+		CXXOperatorCallExpr *ConsumerCall = SingleInvocation(Consumer);
+		if (!ConsumerCall)
+			continue;
+		
+		ASTContext &Ctx = Consumer->getASTContext();
+		for (unsigned i = 2; i < ConsumerCall->getNumArgs(); ++i)
+		{
+			const VarDecl *Tmp = ReferencedVarDecl(ConsumerCall->getArg(i));
+			const DeclStmt *TmpDeclStmt = PrivateIntermediate(Ctx, Tmp);
+			auto Producer = Producers.find(Tmp);
+			if (!TmpDeclStmt || Producer == Producers.end() || Producer->second.Map == Consumer)
+				continue;
+			
+			const Stmt *ProducerStmt;
+			if (AdjacentStatements(Ctx, Producer->second.Call, ConsumerCall, ProducerStmt))
+				Links.push_back({ Producer->second, Consumer, ConsumerCall, i, ProducerStmt, TmpDeclStmt });
+		}
+	}
+	
+	SourceManager &SM = GlobalRewriter.getSourceMgr();
+	std::sort(Links.begin(), Links.end(), [&SM] (const Link &a, const Link &b)
+	{
+		return SM.isBeforeInTranslationUnit(a.Producer.Call->getBeginLoc(), b.Producer.Call->getBeginLoc());
+	});
+	
+	for (Link &link : Links)
+	{
+		size_t producerArity, consumerArity;
+		UserFunction *ProducerUF = MapInstanceUF(link.Producer.Map, producerArity);
+		UserFunction *ConsumerUF = MapInstanceUF(link.Consumer, consumerArity);
+		
+		// The intermediate has to be passed as an elementwise argument, after the outputs
+		size_t outArity = std::max<size_t>(1, ConsumerUF->multipleReturnTypes.size());
+		if (link.ConsumedArg < 1 + outArity || link.ConsumedArg >= 1 + outArity + consumerArity || ConsumerUF->fusedProducer)
+			continue;
+		size_t consumedParam = link.ConsumedArg - 1 - outArity;
+		
+		SourceRange ProducerArgs = MapCallElwiseArgs(link.Producer.Call);
+		SourceRange ConsumedArg = link.ConsumerCall->getArg(link.ConsumedArg)->getSourceRange();
+		if (!AllRewritable({ ProducerArgs, link.ProducerStmt->getSourceRange(), ConsumedArg, link.TmpDeclStmt->getSourceRange() }))
+			continue;
+		
+		SkePULog() << "Found Map chain: " << link.Producer.Map->getNameAsString() << " -> " << link.Consumer->getNameAsString() << "\n";
+		
+		std::string args = GlobalRewriter.getRewrittenText(ProducerArgs);
+		GlobalRewriter.ReplaceText(ConsumedArg, args);
+		GlobalRewriter.RemoveText(link.ProducerStmt->getSourceRange());
+		GlobalRewriter.RemoveText(link.TmpDeclStmt->getSourceRange());
+		
+		// The producer instance is no longer invoked here, generate it unfused
+		FusedMapInstances.erase(link.Producer.Map);
+		FusedMapUFs[link.Consumer] = new UserFunction(ProducerUF, ConsumerUF, consumedParam);
+		FusedMapInstances.insert(link.Consumer);
+	}
+}
+
+// Finds statement pairs of the form
+//   M(tmp, args...);
+//   ... R(tmp) ...;
+// where M is a Map instance, R a Reduce1D instance and tmp a private intermediate (see above).
+// The pair is rewritten to R(args...) and R is generated as a MapReduce instance, so the
+// intermediate vector is never allocated.
+void FuseMapReduceChains(const std::unordered_set<VarDecl*> &instances)
+{
+	auto Producers = FindMapProducers(instances, false);
+	for (VarDecl *Reduce : instances)
+	{
+		if (*DeclIsValidSkeleton(Reduce) != Skeleton::Type::Reduce1D)
+			continue;
+		
+		CXXOperatorCallExpr *ReduceCall = SingleInvocation(Reduce);
+		if (!ReduceCall || ReduceCall->getNumArgs() != 2)
+			continue;
+		
+		ASTContext &Ctx = Reduce->getASTContext();
+		const VarDecl *Tmp = ReferencedVarDecl(ReduceCall->getArg(1));
+		const DeclStmt *TmpDeclStmt = PrivateIntermediate(Ctx, Tmp);
+		auto Producer = Producers.find(Tmp);
+		if (!TmpDeclStmt || Producer == Producers.end())
+			continue;
+		
+		VarDecl *Map = Producer->second.Map;
+		CXXOperatorCallExpr *MapCall = Producer->second.Call;
+		const Stmt *MapStmt;
+		if (!AdjacentStatements(Ctx, MapCall, ReduceCall, MapStmt))
+			continue;
+		
+		size_t arity;
+		UserFunction *MapUF = MapInstanceUF(Map, arity);
+		UserFunction *ReduceUF = HandleUserFunctionArg(SkeletonFactoryCall(Reduce)->getArg(0), Reduce);
+		if (MapUF->resolvedReturnTypeName != ReduceUF->resolvedReturnTypeName)
+			continue;
+		
+		SourceRange MapArgs = MapCallElwiseArgs(MapCall);
+		if (!AllRewritable({ MapArgs, MapStmt->getSourceRange(), ReduceCall->getArg(1)->getSourceRange(), TmpDeclStmt->getSourceRange() }))
+			continue;
+		
+		SkePULog() << "Found Map-Reduce chain: " << Map->getNameAsString() << " -> " << Reduce->getNameAsString() << "\n";
+		
+		std::string args = GlobalRewriter.getRewrittenText(MapArgs);
+		GlobalRewriter.ReplaceText(ReduceCall->getArg(1)->getSourceRange(), args);
+		GlobalRewriter.RemoveText(MapStmt->getSourceRange());
+		GlobalRewriter.RemoveText(TmpDeclStmt->getSourceRange());
+		
+		FusedMapInstances.erase(Map);
+		FusedMapReduceInstances[Reduce] = Map;
+	}
+}
+
+// -mapoverlap-reduce entries step=residual: the MapOverlap2D instance step is generated with a kernel that also
+// reduces residual, a MapReduce instance over two elementwise arguments, over each output and its centre input
+void PairMapOverlapReductions(const std::unordered_set<VarDecl*> &instances)
+{
+	for (const std::string &entry : MapOverlapReduceInstances)
+	{
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos)
+			SkePUAbort("Malformed -mapoverlap-reduce entry " + entry + ", expected step=residual");
+		
+		VarDecl *Step = nullptr, *Residual = nullptr;
+		for (VarDecl *d : instances)
+		{
+			if (d->getNameAsString() == entry.substr(0, eq))
+				Step = d;
+			if (d->getNameAsString() == entry.substr(eq + 1))
+				Residual = d;
+		}
+		if (!Step || !Residual)
+			SkePUAbort("-mapoverlap-reduce entry " + entry + " does not name two skeleton instances");
+		if (*DeclIsValidSkeleton(Step) != Skeleton::Type::MapOverlap2D)
+			SkePUAbort("Instance " + Step->getNameAsString() + " in -mapoverlap-reduce is not a MapOverlap2D");
+		if (*DeclIsValidSkeleton(Residual) != Skeleton::Type::MapReduce || FusedMapReduceInstances.count(Residual))
+			SkePUAbort("Residual " + Residual->getNameAsString() + " in -mapoverlap-reduce is not a MapReduce instance");
+		
+		CallExpr *ResidualCExpr = SkeletonFactoryCall(Residual);
+		if (SkeletonTemplateArity(SkeletonTemplate(ResidualCExpr), 0, Residual) != 2 || ResidualCExpr->getNumArgs() != 2)
+			SkePUAbort("Residual " + Residual->getNameAsString() + " must map two elementwise arguments with one reduce function");
+		
+		// The kernel evaluates the map on the output and the input element, nothing else
+		UserFunction *MapUF = HandleUserFunctionArg(ResidualCExpr->getArg(0), Residual);
+		MapUF->updateArgLists(2);
+		UserFunction *ReduceUF = HandleUserFunctionArg(ResidualCExpr->getArg(1), Residual);
+		ReduceUF->updateArgLists(2);
+		if (MapUF->indexParam || MapUF->randomParam || !MapUF->anyContainerParams.empty() || !MapUF->anyScalarParams.empty()
+			|| MapUF->multipleReturnTypes.size() > 0)
+			SkePUAbort("Residual " + Residual->getNameAsString() + " must map only its two elementwise arguments to one value");
+		
+		SkePULog() << "Fusing residual " << Residual->getNameAsString() << " into MapOverlap instance " << Step->getNameAsString() << "\n";
+		MapOverlapReductions[Step] = { MapUF, ReduceUF };
+	}
+}
+
+void RouteVendorBLASCalls()
+{
+	std::vector<CallExpr*> Calls;
+	std::swap(Calls, VendorBLASCalls);
+	if (Calls.empty() || !didFindBlas)
+		return;
+	
+	// The wrappers fall back to skepu::blas, so they are included on the line after skepu-lib/blas.hpp
+	SourceManager &SM = GlobalRewriter.getSourceMgr();
+	SourceLocation IncludeLoc = SM.getIncludeLoc(SM.getFileID(blasBegin));
+	while (IncludeLoc.isValid() && !SM.isInMainFile(IncludeLoc))
+		IncludeLoc = SM.getIncludeLoc(SM.getFileID(IncludeLoc));
+	if (IncludeLoc.isInvalid())
+		return;
+	
+	SourceLocation loc = SM.translateLineCol(SM.getMainFileID(), SM.getSpellingLineNumber(IncludeLoc) + 1, 1);
+	std::string supportHeader = generateVendorBLASSupport(ResultDir);
+	if (GlobalRewriter.InsertText(loc, "#include \"" + supportHeader + "\"\n" + lineDirectiveForSourceLoc(loc)))
+		SkePUAbort("Code gen target source loc not rewritable: vendor BLAS support header");
+	
+	for (CallExpr *Call : Calls)
+	{
+		auto *Callee = dyn_cast<DeclRefExpr>(Call->getCallee()->IgnoreImpCasts());
+		if (!Callee || Callee->hasExplicitTemplateArgs() || !AllRewritable({ Callee->getSourceRange() }))
+			continue;
+		
+		std::string name = Callee->getDecl()->getNameAsString();
+		SkePULog() << "Routing BLAS call to vendor library: " << name << "\n";
+		GlobalRewriter.ReplaceText(Callee->getSourceRange(), "skepu::vendor_blas::" + name);
+	}
+}
+
 // Returns nullptr if the user type can be ignored
 UserType *HandleUserType(const CXXRecordDecl *t)
 {
@@ -242,6 +708,10 @@ UserType *HandleUserType(const CXXRecordDecl *t)
 		|| name == "Vec" || name == "Mat" || name == "Ten3" || name == "Ten4" || name == "MatRow" || name == "MatCol"
 		|| name == "complex")
 		return nullptr;
+	
+	// 16-bit floats map to device builtins (half on OpenCL), their CUDA header definitions are not copied
+	if (halfPrecisionOf(name) != HalfPrecision::None)
+		return nullptr;
 
 	SkePULog() << "Found user type: " << name << "\n";
 	
@@ -304,11 +774,24 @@ bool SkePUASTVisitor::VisitVarDecl(VarDecl *d)
 	return RecursiveASTVisitor<SkePUASTVisitor>::VisitVarDecl(d);
 }
 
+bool SkePUASTVisitor::VisitCallExpr(CallExpr *c)
+{
+	static const std::set<std::string> routines = {"skepu::blas::gemm", "skepu::blas::gemv", "skepu::blas::dot", "skepu::blas::axpy"};
+	if (VendorBLAS)
+		if (const FunctionDecl *f = c->getDirectCallee())
+			if (routines.count(f->getQualifiedNameAsString()) && this->Context->getSourceManager().isInMainFile(c->getBeginLoc()))
+				VendorBLASCalls.push_back(c);
+	return RecursiveASTVisitor<SkePUASTVisitor>::VisitCallExpr(c);
+}
+
 bool SkePUASTVisitor::VisitCXXOperatorCallExpr(CXXOperatorCallExpr *c)
 {
-	if (c->getOperator() == OO_Call)
+	if (c->getOperator() == OO_Call && c->getNumArgs() > 0)
 	{
 	//	c->dump();
+		if (const VarDecl *d = ReferencedVarDecl(c->getArg(0)))
+			if (DeclIsValidSkeleton(const_cast<VarDecl*>(d)))
+				SkeletonInstanceCalls[d].push_back(c);
 	}
 	
 	/*return RecursiveASTVisitor<SkePUASTVisitor>::VisitCallExpr(c);
@@ -338,6 +821,21 @@ bool SkePUASTVisitor::VisitCXXOperatorCallExpr(CXXOperatorCallExpr *c)
 	return RecursiveASTVisitor<SkePUASTVisitor>::VisitCallExpr(c);
 }
 
+bool SkePUASTVisitor::VisitCXXMemberCallExpr(CXXMemberCallExpr *c)
+{
+	if (Expr *Object = c->getImplicitObjectArgument())
+		if (const VarDecl *d = ReferencedVarDecl(Object))
+			MemberCallCounts[d]++;
+	return RecursiveASTVisitor<SkePUASTVisitor>::VisitCXXMemberCallExpr(c);
+}
+
+bool SkePUASTVisitor::VisitDeclRefExpr(DeclRefExpr *e)
+{
+	if (const VarDecl *d = dyn_cast<VarDecl>(e->getDecl()))
+		DeclReferenceCounts[d]++;
+	return RecursiveASTVisitor<SkePUASTVisitor>::VisitDeclRefExpr(e);
+}
+
 
 // Implementation of the ASTConsumer interface for reading an AST produced by the Clang parser.
 SkePUASTConsumer::SkePUASTConsumer(ASTContext *ctx, std::unordered_set<clang::VarDecl *> &instanceSet)
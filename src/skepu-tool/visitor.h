@@ -8,6 +8,10 @@
 UserFunction *HandleUserFunction(clang::FunctionDecl *f);
 UserType *HandleUserType(const clang::CXXRecordDecl *t);
 bool HandleSkeletonInstance(clang::VarDecl *d);
+void FuseMapChains(const std::unordered_set<clang::VarDecl*> &instances);
+void FuseMapReduceChains(const std::unordered_set<clang::VarDecl*> &instances);
+void PairMapOverlapReductions(const std::unordered_set<clang::VarDecl*> &instances);
+void RouteVendorBLASCalls();
 
 
 
@@ -19,7 +23,10 @@ public:
 	SkePUASTVisitor(clang::ASTContext *ctx, std::unordered_set<clang::VarDecl *> &instanceSet);
 
 	bool VisitVarDecl(clang::VarDecl *d);
+	bool VisitCallExpr(clang::CallExpr *c);
 	bool VisitCXXOperatorCallExpr(clang::CXXOperatorCallExpr *c);
+	bool VisitCXXMemberCallExpr(clang::CXXMemberCallExpr *c);
+	bool VisitDeclRefExpr(clang::DeclRefExpr *e);
 
 	std::unordered_set<clang::VarDecl *> &SkeletonInstances;
 
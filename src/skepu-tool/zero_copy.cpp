@@ -0,0 +1,152 @@
+#include "globals.h"
+#include "code_gen.h"
+
+/*!
+ * Zero-copy containers for devices that share memory with the host, enabled by -zero-copy. Integrated GPUs and
+ * APUs otherwise get a separate device buffer per container and a copy in each direction, over the same DRAM.
+ * The main file defines SKEPU_ZERO_COPY and includes this header before the SkePU headers.
+ *
+ * unified_CU/unified_CL tell whether a device shares memory with the host: an integrated CUDA device that can
+ * access managed memory concurrently, or an OpenCL device with CL_DEVICE_HOST_UNIFIED_MEMORY. For such devices
+ * the containers take their host storage from allocateHost_CU/_CL and use it as the device buffer: CUDA managed
+ * memory, or an OpenCL buffer created over it with CL_MEM_USE_HOST_PTR. The storage is page-aligned and padded
+ * to a cache line, as the OpenCL drivers require for using the host pointer without a copy.
+ *
+ * Coherency then needs no copies. Before host access, acquireHost_CL maps the buffer and releaseHost_CL unmaps
+ * it again before the next kernel; acquireHost_CU waits for the stream on devices without concurrent managed
+ * access. Other devices keep the copying path.
+ */
+static const char *ZeroCopySupport = R"~~~(
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef SKEPU_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef SKEPU_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace skepu
+{
+	namespace zerocopy
+	{
+		constexpr size_t Alignment = 4096;
+		constexpr size_t Padding = 64;
+
+		inline size_t paddedSize(size_t bytes)
+		{
+			return (bytes + Padding - 1) / Padding * Padding;
+		}
+
+#ifdef SKEPU_CUDA
+		inline bool unified_CU(int device)
+		{
+			int integrated = 0, concurrent = 0;
+			cudaDeviceGetAttribute(&integrated, cudaDevAttrIntegrated, device);
+			cudaDeviceGetAttribute(&concurrent, cudaDevAttrConcurrentManagedAccess, device);
+			return integrated && concurrent;
+		}
+
+		// Host storage that devices use directly, nullptr if managed memory is not available
+		inline void *allocateHost_CU(size_t bytes)
+		{
+			void *ptr = nullptr;
+			if (cudaMallocManaged(&ptr, paddedSize(bytes ? bytes : 1), cudaMemAttachGlobal) != cudaSuccess)
+			{
+				cudaGetLastError();
+				return nullptr;
+			}
+			return ptr;
+		}
+
+		inline void freeHost_CU(void *ptr)
+		{
+			cudaFree(ptr);
+		}
+
+		// Kernels on stream may still write the storage; concurrent access devices need no wait
+		inline void acquireHost_CU(int device, cudaStream_t stream)
+		{
+			int concurrent = 0;
+			cudaDeviceGetAttribute(&concurrent, cudaDevAttrConcurrentManagedAccess, device);
+			if (!concurrent)
+				cudaStreamSynchronize(stream);
+		}
+#endif
+
+#ifdef SKEPU_OPENCL
+		inline bool unified_CL(cl_device_id device)
+		{
+			cl_bool unified = CL_FALSE;
+			clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, nullptr);
+			return unified == CL_TRUE;
+		}
+
+		inline void *allocateHost_CL(size_t bytes)
+		{
+			void *ptr = nullptr;
+#ifdef _WIN32
+			ptr = _aligned_malloc(paddedSize(bytes ? bytes : 1), Alignment);
+#else
+			if (posix_memalign(&ptr, Alignment, paddedSize(bytes ? bytes : 1)) != 0)
+				ptr = nullptr;
+#endif
+			if (!ptr)
+				throw std::bad_alloc();
+			return ptr;
+		}
+
+		inline void freeHost_CL(void *ptr)
+		{
+#ifdef _WIN32
+			_aligned_free(ptr);
+#else
+			std::free(ptr);
+#endif
+		}
+
+		// Device buffer over host storage from allocateHost_CL
+		inline cl_mem createBuffer_CL(cl_context context, cl_mem_flags flags, void *host, size_t bytes, cl_int *err)
+		{
+			flags &= ~(cl_mem_flags)(CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR);
+			return clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR, paddedSize(bytes ? bytes : 1), host, err);
+		}
+
+		// Makes the host storage of buffer coherent for host access; returns the mapped pointer, which is host
+		inline void *acquireHost_CL(cl_command_queue queue, cl_mem buffer, size_t bytes, bool write, cl_int *err)
+		{
+			cl_map_flags flags = write ? (CL_MAP_READ | CL_MAP_WRITE) : CL_MAP_READ;
+			return clEnqueueMapBuffer(queue, buffer, CL_TRUE, flags, 0, paddedSize(bytes ? bytes : 1), 0, nullptr, nullptr, err);
+		}
+
+		// Hands the storage back to the device, before the next kernel using buffer
+		inline cl_int releaseHost_CL(cl_command_queue queue, cl_mem buffer, void *mapped)
+		{
+			return clEnqueueUnmapMemObject(queue, buffer, mapped, 0, nullptr, nullptr);
+		}
+#endif
+	}
+}
+)~~~";
+
+
+std::string generateZeroCopySupport(std::string dir)
+{
+	static thread_local bool generated = false;
+	std::string fileName = "skepu_zero_copy.h";
+	if (!generated)
+	{
+		GeneratedFile FSOutFile {dir + "/" + fileName};
+		FSOutFile << ZeroCopySupport;
+		generated = true;
+	}
+	return fileName;
+}
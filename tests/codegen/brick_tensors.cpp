@@ -0,0 +1,15 @@
+#include <skepu>
+
+// Only precompiled, with and without -brick-tensors, see CMakeLists.txt.
+
+float neighbours_f(skepu::Index3D idx, const skepu::Ten3<float> t)
+{
+	return t(idx.i, idx.j, idx.k) + t(idx.i, idx.j, 0) + t(idx.i, 0, idx.k) + t(0, idx.j, idx.k);
+}
+
+auto neighbours = skepu::Map<0>(neighbours_f);
+
+void sums(skepu::Tensor3<float> &res, skepu::Tensor3<float> &t)
+{
+	neighbours(res, t);
+}
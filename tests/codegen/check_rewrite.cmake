@@ -0,0 +1,31 @@
+# Checks the source rewritten by skepu-tool.
+#
+#	cmake -DFILE=<precompiled source> [-DABSENT=<names>] [-DPRESENT=<names>] -P check_rewrite.cmake
+#
+# Fails if any identifier in ABSENT is left in FILE, or any identifier in
+# PRESENT is missing from it. A name starting with * matches the identifiers
+# ending in the rest of it, for generated names such as *_ScanLookback. An
+# entry may also be a longer regular expression, such as "count = 1ull",
+# matched between non-identifier characters. The rewritten source is printed
+# on failure.
+
+file(READ ${FILE} _source)
+
+macro(check_rewrite_pattern _name)
+	string(REGEX REPLACE "^\\*" "[A-Za-z0-9_]*" _pattern "${_name}")
+	string(REGEX MATCH "[^A-Za-z0-9_]${_pattern}[^A-Za-z0-9_]" _match "${_source}")
+endmacro()
+
+foreach(_name IN LISTS ABSENT)
+	check_rewrite_pattern("${_name}")
+	if(_match)
+		message(FATAL_ERROR "${_name} is still in ${FILE}:\n${_source}")
+	endif()
+endforeach()
+
+foreach(_name IN LISTS PRESENT)
+	check_rewrite_pattern("${_name}")
+	if(NOT _match)
+		message(FATAL_ERROR "${_name} is missing from ${FILE}:\n${_source}")
+	endif()
+endforeach()
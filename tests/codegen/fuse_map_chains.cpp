@@ -0,0 +1,115 @@
+#include <catch2/catch.hpp>
+
+#include <skepu>
+
+// Built with and without -fuse-map-chains. The intermediates named fused_* are
+// removed by the pass and the ones named kept_* have to stay, see CMakeLists.txt.
+
+float square_f(float a)
+{
+	return a * a;
+}
+
+float negate_f(float a)
+{
+	return -a;
+}
+
+float add_f(float a, float b)
+{
+	return a + b;
+}
+
+skepu::multiple<float, float> square_and_cube_f(float a)
+{
+	return skepu::ret(a * a, a * a * a);
+}
+
+auto square = skepu::Map(square_f);
+auto square_and_cube = skepu::Map(square_and_cube_f);
+
+// A fused consumer instance replaces its single call, so every case has its own
+auto add_fused = skepu::Map(add_f);
+auto negate_chained = skepu::Map(negate_f);
+auto add_chained = skepu::Map(add_f);
+auto add_used_elsewhere = skepu::Map(add_f);
+auto add_not_adjacent = skepu::Map(add_f);
+auto add_multi_return = skepu::Map(add_f);
+
+// res = v * v + w
+void fuses(skepu::Vector<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &w)
+{
+	skepu::Vector<float> fused_squares(v.size());
+	square(fused_squares, v);
+	add_fused(res, w, fused_squares);
+}
+
+// res = -(v * v) + w, folded into the last Map
+void fuses_chain(skepu::Vector<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &w)
+{
+	skepu::Vector<float> fused_first(v.size());
+	skepu::Vector<float> fused_second(v.size());
+	square(fused_first, v);
+	negate_chained(fused_second, fused_first);
+	add_chained(res, fused_second, w);
+}
+
+void skips_intermediate_used_elsewhere(skepu::Vector<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &w, float &first)
+{
+	skepu::Vector<float> kept_used(v.size());
+	square(kept_used, v);
+	add_used_elsewhere(res, kept_used, w);
+	first = kept_used(0);
+}
+
+void skips_calls_not_adjacent(skepu::Vector<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &w)
+{
+	skepu::Vector<float> kept_gap(v.size());
+	square(kept_gap, v);
+	w(0) += 0;
+	add_not_adjacent(res, kept_gap, w);
+}
+
+void skips_multi_return_producer(skepu::Vector<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &w, skepu::Vector<float> &cubes)
+{
+	skepu::Vector<float> kept_multi(v.size());
+	square_and_cube(kept_multi, cubes, v);
+	add_multi_return(res, kept_multi, w);
+}
+
+TEST_CASE("Map chain fusion matches the unfused result")
+{
+	const size_t size{1000};
+
+	skepu::Vector<float> v(size), w(size), res(size), cubes(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		v(i) = (float)(i % 7) - 3;
+		w(i) = (float)(i % 5);
+	}
+
+	fuses(res, v, w);
+	for (size_t i = 0; i < size; ++i)
+		CHECK(res(i) == v(i) * v(i) + w(i));
+
+	fuses_chain(res, v, w);
+	for (size_t i = 0; i < size; ++i)
+		CHECK(res(i) == -(v(i) * v(i)) + w(i));
+
+	float first = -1;
+	skips_intermediate_used_elsewhere(res, v, w, first);
+	CHECK(first == v(0) * v(0));
+	for (size_t i = 0; i < size; ++i)
+		CHECK(res(i) == v(i) * v(i) + w(i));
+
+	skips_calls_not_adjacent(res, v, w);
+	for (size_t i = 0; i < size; ++i)
+		CHECK(res(i) == v(i) * v(i) + w(i));
+
+	skips_multi_return_producer(res, v, w, cubes);
+	for (size_t i = 0; i < size; ++i)
+	{
+		CHECK(res(i) == v(i) * v(i) + w(i));
+		CHECK(cubes(i) == v(i) * v(i) * v(i));
+	}
+}
@@ -0,0 +1,88 @@
+#include <catch2/catch.hpp>
+
+#include <skepu>
+
+// Built with and without -fuse-map-reduce. The intermediates named fused_* are
+// removed by the pass and the ones named kept_* have to stay, see CMakeLists.txt.
+
+float square_f(float a)
+{
+	return a * a;
+}
+
+skepu::multiple<float, float> square_and_cube_f(float a)
+{
+	return skepu::ret(a * a, a * a * a);
+}
+
+float plus_f(float a, float b)
+{
+	return a + b;
+}
+
+auto square = skepu::Map(square_f);
+auto square_and_cube = skepu::Map(square_and_cube_f);
+
+// A fused Reduce instance replaces its single call, so every case has its own
+auto sum_fused = skepu::Reduce(plus_f);
+auto sum_used_elsewhere = skepu::Reduce(plus_f);
+auto sum_not_adjacent = skepu::Reduce(plus_f);
+auto sum_multi_return = skepu::Reduce(plus_f);
+
+float reference(skepu::Vector<float> &v, int power)
+{
+	float res = 0;
+	for (size_t i = 0; i < v.size(); ++i)
+		res += power == 2 ? v(i) * v(i) : v(i) * v(i) * v(i);
+	return res;
+}
+
+float fuses(skepu::Vector<float> &v)
+{
+	skepu::Vector<float> fused_squares(v.size());
+	square(fused_squares, v);
+	return sum_fused(fused_squares);
+}
+
+float skips_intermediate_used_elsewhere(skepu::Vector<float> &v, float &first)
+{
+	skepu::Vector<float> kept_used(v.size());
+	square(kept_used, v);
+	float res = sum_used_elsewhere(kept_used);
+	first = kept_used(0);
+	return res;
+}
+
+float skips_calls_not_adjacent(skepu::Vector<float> &v)
+{
+	skepu::Vector<float> kept_gap(v.size());
+	square(kept_gap, v);
+	v(0) += 0;
+	return sum_not_adjacent(kept_gap);
+}
+
+float skips_multi_return_producer(skepu::Vector<float> &v, skepu::Vector<float> &cubes)
+{
+	skepu::Vector<float> kept_multi(v.size());
+	square_and_cube(kept_multi, cubes, v);
+	return sum_multi_return(kept_multi);
+}
+
+TEST_CASE("Map-then-Reduce fusion matches the unfused result")
+{
+	const size_t size{1000};
+
+	// Small integers, so the sums are exact in any order
+	skepu::Vector<float> v(size), cubes(size);
+	for (size_t i = 0; i < size; ++i)
+		v(i) = (float)(i % 7) - 3;
+
+	float first = -1;
+	CHECK(fuses(v) == reference(v, 2));
+	CHECK(skips_intermediate_used_elsewhere(v, first) == reference(v, 2));
+	CHECK(first == v(0) * v(0));
+	CHECK(skips_calls_not_adjacent(v) == reference(v, 2));
+	CHECK(skips_multi_return_producer(v, cubes) == reference(v, 2));
+	for (size_t i = 0; i < size; ++i)
+		CHECK(cubes(i) == v(i) * v(i) * v(i));
+}
@@ -0,0 +1,22 @@
+#include <skepu>
+
+// Only precompiled, with and without -map-dynamic, see CMakeLists.txt.
+
+// The number of steps varies per element
+int collatz_steps_f(int n)
+{
+	int steps = 0;
+	while (n > 1)
+	{
+		n = (n % 2) ? 3 * n + 1 : n / 2;
+		++steps;
+	}
+	return steps;
+}
+
+auto collatz_steps = skepu::Map(collatz_steps_f);
+
+void steps(skepu::Vector<int> &res, skepu::Vector<int> &v)
+{
+	collatz_steps(res, v);
+}
@@ -0,0 +1,28 @@
+#include <skepu>
+
+// Only precompiled, with and without the CUDA MapOverlap2D options, see CMakeLists.txt.
+
+float average_f(skepu::Region2D<float> r)
+{
+	return (r(-1, 0) + r(0, -1) + r(0, 0) + r(0, 1) + r(1, 0)) / 5;
+}
+
+float squared_change_f(float next, float prev)
+{
+	return (next - prev) * (next - prev);
+}
+
+float plus_f(float a, float b)
+{
+	return a + b;
+}
+
+auto smooth = skepu::MapOverlap(average_f);
+auto change = skepu::MapReduce(squared_change_f, plus_f);
+
+float step(skepu::Matrix<float> &res, skepu::Matrix<float> &m)
+{
+	smooth.setOverlap(1, 1);
+	smooth(res, m);
+	return change(res, m);
+}
@@ -0,0 +1,30 @@
+#include <skepu>
+
+// Only precompiled, with and without -mappairs-symmetric and
+// -mappairs-antisymmetric, see CMakeLists.txt.
+
+float distance_f(float a, float b)
+{
+	return (a - b) * (a - b);
+}
+
+float difference_f(float a, float b)
+{
+	return a - b;
+}
+
+float plus_f(float a, float b)
+{
+	return a + b;
+}
+
+auto distances = skepu::MapPairs(distance_f);
+auto differences = skepu::MapPairs(difference_f);
+auto distance_sums = skepu::MapPairsReduce(distance_f, plus_f);
+
+void pairs(skepu::Matrix<float> &dist, skepu::Matrix<float> &diff, skepu::Vector<float> &sums, skepu::Vector<float> &v)
+{
+	distances(dist, v, v);
+	differences(diff, v, v);
+	distance_sums(sums, v, v);
+}
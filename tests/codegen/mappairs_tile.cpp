@@ -0,0 +1,15 @@
+#include <skepu>
+
+// Only precompiled, with and without -mappairs-tile, see CMakeLists.txt.
+
+float product_f(float a, float b)
+{
+	return a * b;
+}
+
+auto outer_product = skepu::MapPairs(product_f);
+
+void outer(skepu::Matrix<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &h)
+{
+	outer_product(res, v, h);
+}
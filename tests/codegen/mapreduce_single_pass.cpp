@@ -0,0 +1,20 @@
+#include <skepu>
+
+// Only precompiled, with and without -mapreduce-single-pass, see CMakeLists.txt.
+
+float mult_f(float a, float b)
+{
+	return a * b;
+}
+
+float plus_f(float a, float b)
+{
+	return a + b;
+}
+
+auto dot_product = skepu::MapReduce(mult_f, plus_f);
+
+float dot(skepu::Vector<float> &v, skepu::Vector<float> &w)
+{
+	return dot_product(v, w);
+}
@@ -0,0 +1,15 @@
+#include <skepu>
+
+// Only precompiled, with and without -omp-simd, see CMakeLists.txt.
+
+float saxpy_f(float x, float y, float a)
+{
+	return a * x + y;
+}
+
+auto saxpy = skepu::Map(saxpy_f);
+
+void axpy(skepu::Vector<float> &res, skepu::Vector<float> &x, skepu::Vector<float> &y, float a)
+{
+	saxpy(res, x, y, a);
+}
@@ -0,0 +1,18 @@
+#include <skepu>
+
+// Only precompiled, with and without -prune-device-args, see CMakeLists.txt.
+
+// The table is only read by the CPU variant, so it is the one pruned container
+float lookup_f(float a, const skepu::Vec<float> table)
+{
+	float res = a;
+	VARIANT_CPU(res += table(0);)
+	return res;
+}
+
+auto lookup = skepu::Map<1>(lookup_f);
+
+void offsets(skepu::Vector<float> &res, skepu::Vector<float> &v, skepu::Vector<float> &table)
+{
+	lookup(res, v, table);
+}
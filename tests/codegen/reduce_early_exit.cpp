@@ -0,0 +1,32 @@
+#include <skepu>
+
+// Only precompiled, with and without -reduce-early-exit, see CMakeLists.txt.
+
+int or_f(int a, int b)
+{
+	return a || b;
+}
+
+int above_f(float a, float threshold)
+{
+	return a > threshold;
+}
+
+float min_f(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+float floor_f(float a)
+{
+	return a < 0 ? 0 : a;
+}
+
+auto any = skepu::Reduce(or_f);
+auto any_above = skepu::MapReduce(above_f, or_f);
+auto floor_min = skepu::MapReduce(floor_f, min_f);
+
+bool checks(skepu::Vector<int> &flags, skepu::Vector<float> &v, float threshold)
+{
+	return any(flags) || any_above(v, threshold) || floor_min(v) == 0;
+}
@@ -0,0 +1,16 @@
+#include <skepu>
+
+// Only precompiled, with and without the options that add a runtime support
+// header to the rewritten source, see CMakeLists.txt.
+
+float scale_f(float a, float factor)
+{
+	return a * factor;
+}
+
+auto scale = skepu::Map(scale_f);
+
+void rescale(skepu::Vector<float> &res, skepu::Vector<float> &v, float factor)
+{
+	scale(res, v, factor);
+}
@@ -0,0 +1,16 @@
+#include <skepu>
+
+// Only precompiled, with and without -scan-single-pass, see CMakeLists.txt.
+
+float plus_f(float a, float b)
+{
+	return a + b;
+}
+
+auto prefix_sum = skepu::Scan(plus_f);
+
+void scan(skepu::Vector<float> &res, skepu::Vector<float> &v)
+{
+	prefix_sum.setScanMode(skepu::ScanMode::Exclusive);
+	prefix_sum(res, v);
+}
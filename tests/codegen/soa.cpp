@@ -0,0 +1,21 @@
+#include <skepu>
+
+// Only precompiled, with and without -soa, see CMakeLists.txt.
+
+struct Particle
+{
+	float x, y, z;
+	float mass;
+};
+
+float momentum_f(Particle p)
+{
+	return p.mass * p.x;
+}
+
+auto momentum = skepu::Map(momentum_f);
+
+void momenta(skepu::Vector<float> &res, skepu::Vector<Particle> &particles)
+{
+	momentum(res, particles);
+}
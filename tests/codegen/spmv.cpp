@@ -0,0 +1,18 @@
+#include <skepu>
+
+// Only precompiled, with and without -spmv, see CMakeLists.txt.
+
+float row_product_f(skepu::Index1D row, const skepu::SparseMat<float> m, const skepu::Vec<float> x)
+{
+	float res = 0;
+	for (size_t k = m.row_offsets[row.i]; k < m.row_offsets[row.i + 1]; ++k)
+		res += m.data[k] * x[m.col_indices[k]];
+	return res;
+}
+
+auto product = skepu::Map<0>(row_product_f);
+
+void multiply(skepu::Vector<float> &y, skepu::SparseMatrix<float> &m, skepu::Vector<float> &x)
+{
+	product(y, m, x);
+}
@@ -0,0 +1,18 @@
+#include <skepu>
+
+// Only precompiled, with and without -transpose-matcol, see CMakeLists.txt.
+
+float product_f(const skepu::MatRow<float> ar, const skepu::MatCol<float> bc)
+{
+	float res = 0;
+	for (size_t k = 0; k < ar.cols; ++k)
+		res += ar(k) * bc(k);
+	return res;
+}
+
+auto product = skepu::Map<0>(product_f);
+
+void multiply(skepu::Matrix<float> &res, skepu::Matrix<float> &a, skepu::Matrix<float> &b)
+{
+	product(res, a, b);
+}
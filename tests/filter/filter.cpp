@@ -0,0 +1,74 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include <skepu>
+
+
+bool even_f(int a)
+{
+	return a % 2 == 0;
+}
+
+bool positive_f(float a)
+{
+	return a > 0.f;
+}
+
+auto evens = skepu::Filter(even_f);
+auto positives = skepu::Filter(positive_f);
+
+TEST_CASE("Filter fundamentals")
+{
+	// Several tiles, the last one partial
+	const size_t size{100003};
+
+	skepu::Vector<int> v(size), out(size);
+	skepu::Vector<float> f(size), out_f(size);
+	std::vector<int> ref;
+	std::vector<float> ref_f;
+	for (size_t i = 0; i < size; ++i)
+	{
+		v(i) = (i * 7919) % 1013;
+		f(i) = ((i * 104729) % 997) * 0.5f - 100.f;
+		if (v(i) % 2 == 0)
+			ref.push_back(v(i));
+		if (f(i) > 0.f)
+			ref_f.push_back(f(i));
+	}
+
+	size_t kept = evens(out, v);
+	size_t kept_f = positives(out_f, f);
+
+	// The kept elements stay in input order
+	REQUIRE(kept == ref.size());
+	REQUIRE(kept_f == ref_f.size());
+	for (size_t i = 0; i < kept; ++i)
+		CHECK(out(i) == ref[i]);
+	for (size_t i = 0; i < kept_f; ++i)
+		CHECK(out_f(i) == ref_f[i]);
+}
+
+TEST_CASE("Filter keeping all or none")
+{
+	const size_t size{5000};
+
+	skepu::Vector<int> all(size), none(size), out(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		all(i) = 2 * i;
+		none(i) = 2 * i + 1;
+	}
+
+	REQUIRE(evens(out, all) == size);
+	for (size_t i = 0; i < size; ++i)
+		CHECK(out(i) == all(i));
+
+	CHECK(evens(out, none) == 0);
+}
+
+TEST_CASE("Filter on empty input")
+{
+	skepu::Vector<int> v(0), out(0);
+
+	CHECK(evens(out, v) == 0);
+}
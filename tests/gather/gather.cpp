@@ -0,0 +1,58 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include <skepu>
+
+
+float twice_f(float a)
+{
+	return a * 2;
+}
+
+auto gather_twice = skepu::Gather(twice_f);
+
+TEST_CASE("Gather fundamentals")
+{
+	const size_t inSize{1000};
+	const size_t size{10000};
+
+	// Repeated and out-of-range indices
+	skepu::Vector<float> in(inSize), out(size, -1.f);
+	skepu::Vector<size_t> idx(size);
+	for (size_t i = 0; i < inSize; ++i)
+		in(i) = i * 0.5f;
+	for (size_t i = 0; i < size; ++i)
+		idx(i) = (i * 7919) % (inSize + 50);
+
+	gather_twice(out, in, idx);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		// Out-of-range indices leave the output unchanged
+		float expected = idx(i) < inSize ? in(idx(i)) * 2 : -1.f;
+		CHECK(out(i) == expected);
+	}
+}
+
+TEST_CASE("Gather from a single element")
+{
+	const size_t size{500};
+
+	skepu::Vector<float> in(1, 3.f), out(size);
+	skepu::Vector<size_t> idx(size, 0);
+
+	gather_twice(out, in, idx);
+
+	for (size_t i = 0; i < size; ++i)
+		CHECK(out(i) == 6.f);
+}
+
+TEST_CASE("Gather with empty indices")
+{
+	skepu::Vector<float> in(10, 1.f), out(0);
+	skepu::Vector<size_t> idx(0);
+
+	gather_twice(out, in, idx);
+
+	CHECK(out.size() == 0);
+}
@@ -0,0 +1,98 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <skepu>
+
+
+size_t bin_f(int a)
+{
+	return a / 10;
+}
+
+skepu::multiple<size_t, int> weighted_bin_f(int a)
+{
+	return skepu::ret(a / 10, a);
+}
+
+int plus_f(int lhs, int rhs)
+{
+	return lhs + rhs;
+}
+
+int max_f(int lhs, int rhs)
+{
+	return lhs < rhs ? rhs : lhs;
+}
+
+// 'return a + b;' takes the atomic path on the GPU, the other combine functions the owner-computes path
+auto counts = skepu::Histogram(bin_f, plus_f);
+auto weights = skepu::Histogram(weighted_bin_f, plus_f);
+auto maxima = skepu::Histogram(weighted_bin_f, max_f);
+
+TEST_CASE("Histogram fundamentals")
+{
+	const size_t size{100000};
+	const size_t numBins{16};
+
+	// Values past numBins * 10 fall outside the bins and are dropped
+	skepu::Vector<int> v(size);
+	for (size_t i = 0; i < size; ++i)
+		v(i) = (i * 7919) % 200;
+
+	std::vector<int> count(numBins, 0), weight(numBins, 0), max(numBins, -1);
+	for (size_t i = 0; i < size; ++i)
+	{
+		size_t b = v(i) / 10;
+		if (b < numBins)
+		{
+			count[b] += 1;
+			weight[b] += v(i);
+			max[b] = std::max(max[b], v(i));
+		}
+	}
+
+	skepu::Vector<int> c(numBins), w(numBins), m(numBins);
+	counts.setStartValue(0);
+	weights.setStartValue(0);
+	maxima.setStartValue(-1);
+	counts(c, v);
+	weights(w, v);
+	maxima(m, v);
+
+	for (size_t b = 0; b < numBins; ++b)
+	{
+		CHECK(c(b) == count[b]);
+		CHECK(w(b) == weight[b]);
+		CHECK(m(b) == max[b]);
+	}
+}
+
+TEST_CASE("Histogram with a single bin")
+{
+	const size_t size{5000};
+
+	skepu::Vector<int> v(size), c(1);
+	for (size_t i = 0; i < size; ++i)
+		v(i) = i % 20;
+
+	counts.setStartValue(0);
+	counts(c, v);
+
+	// Only the values 0 to 9 land in bin 0
+	CHECK(c(0) == (int)size / 2);
+}
+
+TEST_CASE("Histogram on empty input")
+{
+	const size_t numBins{8};
+
+	skepu::Vector<int> v(0), c(numBins, 42);
+
+	counts.setStartValue(0);
+	counts(c, v);
+
+	// Every bin is still initialized to the start value
+	for (size_t b = 0; b < numBins; ++b)
+		CHECK(c(b) == 0);
+}
@@ -0,0 +1,28 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float saxpy(float x, float y, float a)
+{
+	return a * x + y;
+}
+
+auto map = skepu::Map(saxpy);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "map");
+	const size_t size = 1 << 24;
+
+	skepu::Vector<float> x(size), y(size), res(size);
+	x.randomize(0, 10);
+	y.randomize(0, 10);
+
+	test.measure("saxpy", 3.0 * size * sizeof(float), "GB/s", [&]
+	{
+		map(res, x, y, 2.f);
+		res.flush();
+	});
+
+	return test.result();
+}
@@ -0,0 +1,45 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float average_1d(skepu::Region1D<float> r)
+{
+	return (r(-2) + r(-1) + r(0) + r(1) + r(2)) / 5;
+}
+
+float average_2d(skepu::Region2D<float> r)
+{
+	return (r(-1, 0) + r(0, -1) + r(0, 0) + r(0, 1) + r(1, 0)) / 5;
+}
+
+auto conv1 = skepu::MapOverlap(average_1d);
+auto conv2 = skepu::MapOverlap(average_2d);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "mapoverlap");
+	const size_t size = 1 << 24, n = 1 << 12;
+
+	skepu::Vector<float> v(size), rv(size);
+	skepu::Matrix<float> m(n, n), rm(n, n);
+	v.randomize(0, 10);
+	m.randomize(0, 10);
+
+	conv1.setOverlap(2);
+	conv1.setEdgeMode(skepu::Edge::Pad);
+	test.measure("1d", 2.0 * size * sizeof(float), "GB/s", [&]
+	{
+		conv1(rv, v);
+		rv.flush();
+	});
+
+	conv2.setOverlap(1, 1);
+	conv2.setEdgeMode(skepu::Edge::Pad);
+	test.measure("2d", 2.0 * n * n * sizeof(float), "GB/s", [&]
+	{
+		conv2(rm, m);
+		rm.flush();
+	});
+
+	return test.result();
+}
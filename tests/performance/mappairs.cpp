@@ -0,0 +1,29 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float product(float a, float b)
+{
+	return a * b;
+}
+
+auto outer = skepu::MapPairs(product);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "mappairs");
+	const size_t size = 1 << 12;
+
+	skepu::Vector<float> v(size), h(size);
+	skepu::Matrix<float> res(size, size);
+	v.randomize(0, 10);
+	h.randomize(0, 10);
+
+	test.measure("outer_product", 1.0 * size * size * sizeof(float), "GB/s", [&]
+	{
+		outer(res, v, h);
+		res.flush();
+	});
+
+	return test.result();
+}
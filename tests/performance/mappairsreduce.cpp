@@ -0,0 +1,36 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float interaction(float a, float b)
+{
+	float d = a - b;
+	return 1 / (d * d + 1);
+}
+
+float add(float a, float b)
+{
+	return a + b;
+}
+
+auto forces = skepu::MapPairsReduce(interaction, add);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "mappairsreduce");
+	const size_t size = 1 << 13;
+
+	skepu::Vector<float> v(size), h(size), res(size);
+	v.randomize(0, 10);
+	h.randomize(0, 10);
+
+	// Throughput in pair interactions, the skeleton is compute bound
+	forces.setReduceMode(skepu::ReduceMode::RowWise);
+	test.measure("rowwise", 1.0 * size * size, "Ginteractions/s", [&]
+	{
+		forces(res, v, h);
+		res.flush();
+	});
+
+	return test.result();
+}
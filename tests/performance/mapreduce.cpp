@@ -0,0 +1,33 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float mult(float a, float b)
+{
+	return a * b;
+}
+
+float add(float a, float b)
+{
+	return a + b;
+}
+
+auto dotprod = skepu::MapReduce(mult, add);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "mapreduce");
+	const size_t size = 1 << 24;
+
+	skepu::Vector<float> a(size), b(size);
+	a.randomize(0, 3);
+	b.randomize(0, 2);
+
+	volatile float res;
+	test.measure("dotproduct", 2.0 * size * sizeof(float), "GB/s", [&]
+	{
+		res = dotprod(a, b);
+	});
+
+	return test.result();
+}
@@ -0,0 +1,152 @@
+/*!
+ * Harness of the SkePU performance tests.
+ *
+ * A performance test creates one Test from its command line and calls measure() once per kernel it times, with the
+ * bytes moved (or, for the compute bound skeletons, the operations done) by one call. measure() calls the body once
+ * untimed and then repetitions times timed, and takes the throughput of the fastest call, which is the least
+ * disturbed by the rest of the machine. The body must leave its results on the host (flush the outputs or read a
+ * scalar result), so that device work is included in the measurement.
+ *
+ * The baseline file holds one line per measurement, "<name> <throughput>". A measurement fails when its throughput
+ * is below the baseline by more than the tolerance; a measurement missing from the baseline is recorded, as is every
+ * measurement when SKEPU_PERF_UPDATE is set in the environment. Baselines are per machine, so the file is only
+ * meaningful on the machine that recorded it. The exit code of result() is nonzero if any measurement failed.
+ *
+ * Options:
+ *   --backend <type>     SkePU backend type (cpu, openmp, cuda, opencl), default cpu
+ *   --baseline <file>    baseline file, none by default (report only)
+ *   --tolerance <frac>   fraction of the baseline throughput that may be lost, default 0.2
+ *   --reps <n>           timed calls per measurement, default 10
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <skepu>
+
+namespace skepu
+{
+	namespace perf
+	{
+		class Test
+		{
+		public:
+			Test(int argc, char *argv[], std::string name)
+			: m_name(name)
+			{
+				for (int i = 1; i < argc; ++i)
+				{
+					std::string arg = argv[i];
+					if (i + 1 >= argc)
+						usage(argv[0]);
+					std::string value = argv[++i];
+
+					if (arg == "--backend") m_backend = value;
+					else if (arg == "--baseline") m_baselineFile = value;
+					else if (arg == "--tolerance") m_tolerance = std::stod(value);
+					else if (arg == "--reps") m_repetitions = std::max<size_t>(1, std::stoul(value));
+					else usage(argv[0]);
+				}
+
+				const char *update = std::getenv("SKEPU_PERF_UPDATE");
+				m_update = update && *update && std::string(update) != "0";
+				if (!m_baselineFile.empty())
+					readBaseline();
+
+				skepu::setGlobalBackendSpec(skepu::BackendSpec{m_backend});
+			}
+
+			template<typename Body>
+			void measure(std::string what, double amount, std::string unit, Body &&body)
+			{
+				using clock = std::chrono::steady_clock;
+
+				body();
+				double best = 0;
+				for (size_t i = 0; i < m_repetitions; ++i)
+				{
+					auto start = clock::now();
+					body();
+					double seconds = std::chrono::duration<double>(clock::now() - start).count();
+					if (i == 0 || seconds < best)
+						best = seconds;
+				}
+
+				const std::string key = m_name + "." + what;
+				const double achieved = best > 0 ? amount / best * 1e-9 : 0;
+				std::cout << key << " [" << m_backend << "]: " << achieved << " " << unit;
+
+				auto baseline = m_baseline.find(key);
+				if (m_baselineFile.empty())
+					std::cout << "\n";
+				else if (baseline == m_baseline.end() || m_update)
+				{
+					m_baseline[key] = achieved;
+					m_changed = true;
+					std::cout << ", recorded as baseline\n";
+				}
+				else
+				{
+					const double floor = baseline->second * (1 - m_tolerance);
+					const bool passed = achieved >= floor;
+					std::cout << ", baseline " << baseline->second << " " << unit
+						<< " (" << (achieved / baseline->second - 1) * 100 << "%)" << (passed ? "" : ", REGRESSION") << "\n";
+					m_failed = m_failed || !passed;
+				}
+			}
+
+			// Exit code of the test, writing the recorded baselines
+			int result()
+			{
+				if (m_changed && !writeBaseline())
+				{
+					std::cerr << "Error: cannot write the baseline file: " << m_baselineFile << "\n";
+					return 1;
+				}
+				return m_failed ? 1 : 0;
+			}
+
+		private:
+			std::string m_name;
+			std::string m_backend = "cpu";
+			std::string m_baselineFile;
+			double m_tolerance = 0.2;
+			size_t m_repetitions = 10;
+			bool m_update = false;
+			bool m_changed = false;
+			bool m_failed = false;
+			std::map<std::string, double> m_baseline;
+
+			[[noreturn]] static void usage(const char *program)
+			{
+				std::cerr << "Usage: " << program << " [--backend type] [--baseline file] [--tolerance frac] [--reps n]\n";
+				exit(1);
+			}
+
+			void readBaseline()
+			{
+				std::ifstream in(m_baselineFile);
+				std::string key;
+				double value;
+				while (in >> key >> value)
+					m_baseline[key] = value;
+			}
+
+			bool writeBaseline() const
+			{
+				std::ofstream out(m_baselineFile);
+				out.precision(6);
+				for (auto const& entry : m_baseline)
+					out << entry.first << " " << entry.second << "\n";
+				return bool(out);
+			}
+		};
+	}
+}
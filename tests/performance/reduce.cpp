@@ -0,0 +1,36 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float add(float a, float b)
+{
+	return a + b;
+}
+
+auto sum = skepu::Reduce(add);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "reduce");
+	const size_t size = 1 << 24, rows = 1 << 12;
+
+	skepu::Vector<float> v(size), rv(rows);
+	skepu::Matrix<float> m(rows, size / rows);
+	v.randomize(0, 10);
+	m.randomize(0, 10);
+
+	volatile float res;
+	test.measure("vector", 1.0 * size * sizeof(float), "GB/s", [&]
+	{
+		res = sum(v);
+	});
+
+	sum.setReduceMode(skepu::ReduceMode::RowWise);
+	test.measure("rowwise", 1.0 * size * sizeof(float), "GB/s", [&]
+	{
+		sum(rv, m);
+		rv.flush();
+	});
+
+	return test.result();
+}
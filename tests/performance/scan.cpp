@@ -0,0 +1,36 @@
+#include <skepu>
+
+#include "perf.hpp"
+
+float add(float a, float b)
+{
+	return a + b;
+}
+
+auto prefix_sum = skepu::Scan(add);
+
+int main(int argc, char *argv[])
+{
+	skepu::perf::Test test(argc, argv, "scan");
+	const size_t size = 1 << 24;
+
+	skepu::Vector<float> v(size), r(size);
+	v.randomize(0, 10);
+
+	prefix_sum.setScanMode(skepu::ScanMode::Inclusive);
+	test.measure("inclusive", 2.0 * size * sizeof(float), "GB/s", [&]
+	{
+		prefix_sum(r, v);
+		r.flush();
+	});
+
+	prefix_sum.setScanMode(skepu::ScanMode::Exclusive);
+	prefix_sum.setStartValue(0);
+	test.measure("exclusive", 2.0 * size * sizeof(float), "GB/s", [&]
+	{
+		prefix_sum(r, v);
+		r.flush();
+	});
+
+	return test.result();
+}
@@ -0,0 +1,93 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <skepu>
+
+
+int plus_f(int lhs, int rhs)
+{
+	return lhs + rhs;
+}
+
+int max_f(int lhs, int rhs)
+{
+	return lhs < rhs ? rhs : lhs;
+}
+
+auto segment_sum = skepu::ReduceByKey(plus_f);
+auto segment_max = skepu::ReduceByKey(max_f);
+
+// Segment lengths to CSR offsets, offsets[0] = 0 and offsets[numSegments] = n
+skepu::Vector<size_t> offsets_of(std::vector<size_t> const& lengths)
+{
+	skepu::Vector<size_t> offsets(lengths.size() + 1);
+	offsets(0) = 0;
+	for (size_t s = 0; s < lengths.size(); ++s)
+		offsets(s + 1) = offsets(s) + lengths[s];
+	return offsets;
+}
+
+TEST_CASE("ReduceByKey fundamentals")
+{
+	// Short, empty and long segments, the longest crossing several tiles
+	std::vector<size_t> lengths{1, 7, 0, 300, 2, 0, 0, 5000, 1, 1024, 3};
+	skepu::Vector<size_t> offsets = offsets_of(lengths);
+	const size_t numSegments = lengths.size();
+	const size_t size = offsets(numSegments);
+
+	skepu::Vector<int> v(size), sums(numSegments, -1), maxes(numSegments, -1);
+	for (size_t i = 0; i < size; ++i)
+		v(i) = (i * 7919) % 101 - 50;
+
+	segment_sum(sums, v, offsets);
+	segment_max(maxes, v, offsets);
+
+	for (size_t s = 0; s < numSegments; ++s)
+	{
+		if (lengths[s] == 0)
+		{
+			// Empty segments are not written
+			CHECK(sums(s) == -1);
+			CHECK(maxes(s) == -1);
+			continue;
+		}
+
+		int sum = 0, max = v(offsets(s));
+		for (size_t i = offsets(s); i < offsets(s + 1); ++i)
+		{
+			sum += v(i);
+			max = std::max(max, v(i));
+		}
+		CHECK(sums(s) == sum);
+		CHECK(maxes(s) == max);
+	}
+}
+
+TEST_CASE("ReduceByKey with a single segment")
+{
+	const size_t size{10000};
+
+	skepu::Vector<int> v(size), sums(1);
+	skepu::Vector<size_t> offsets = offsets_of({size});
+	for (size_t i = 0; i < size; ++i)
+		v(i) = i % 13;
+
+	segment_sum(sums, v, offsets);
+
+	int sum = 0;
+	for (size_t i = 0; i < size; ++i)
+		sum += v(i);
+	CHECK(sums(0) == sum);
+}
+
+TEST_CASE("ReduceByKey on empty input")
+{
+	skepu::Vector<int> v(0), sums(3, 42);
+	skepu::Vector<size_t> offsets = offsets_of({0, 0, 0});
+
+	segment_sum(sums, v, offsets);
+
+	for (size_t s = 0; s < 3; ++s)
+		CHECK(sums(s) == 42);
+}
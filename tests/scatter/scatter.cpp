@@ -0,0 +1,86 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include <skepu>
+
+
+int identity_f(int a)
+{
+	return a;
+}
+
+int plus_f(int acc, int a)
+{
+	return acc + a;
+}
+
+// Depends on the order of the contributions to a target
+int shift_in_f(int acc, int a)
+{
+	return acc * 2 + a;
+}
+
+// 'return a + b;' takes the atomic path on CUDA, the other combine functions the segmented path
+auto scatter_add = skepu::Scatter(identity_f, plus_f);
+auto scatter_ordered = skepu::Scatter(identity_f, shift_in_f);
+
+std::vector<int> scatter_reference(skepu::Vector<int> &in, skepu::Vector<size_t> &idx, size_t outSize, int init, bool ordered)
+{
+	std::vector<int> ref(outSize, init);
+	for (size_t i = 0; i < in.size(); ++i)
+		if (idx(i) < outSize)
+			ref[idx(i)] = ordered ? ref[idx(i)] * 2 + in(i) : ref[idx(i)] + in(i);
+	return ref;
+}
+
+TEST_CASE("Scatter fundamentals")
+{
+	const size_t size{1000};
+	const size_t outSize{100};
+
+	// About ten contributions per target, and some indices out of range
+	skepu::Vector<int> in(size), sums(outSize, 0), ordered(outSize, 0);
+	skepu::Vector<size_t> idx(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		in(i) = (i * 31) % 7;
+		idx(i) = (i * 7919) % (outSize + 10);
+	}
+
+	scatter_add(sums, in, idx);
+	scatter_ordered(ordered, in, idx);
+
+	std::vector<int> ref_sums = scatter_reference(in, idx, outSize, 0, false);
+	std::vector<int> ref_ordered = scatter_reference(in, idx, outSize, 0, true);
+	for (size_t t = 0; t < outSize; ++t)
+	{
+		CHECK(sums(t) == ref_sums[t]);
+		CHECK(ordered(t) == ref_ordered[t]);
+	}
+}
+
+TEST_CASE("Scatter to a single target")
+{
+	const size_t size{20};
+
+	skepu::Vector<int> in(size), out(1, 1);
+	skepu::Vector<size_t> idx(size, 0);
+	for (size_t i = 0; i < size; ++i)
+		in(i) = i % 2;
+
+	scatter_ordered(out, in, idx);
+
+	std::vector<int> ref = scatter_reference(in, idx, 1, 1, true);
+	CHECK(out(0) == ref[0]);
+}
+
+TEST_CASE("Scatter on empty input")
+{
+	skepu::Vector<int> in(0), out(5, 42);
+	skepu::Vector<size_t> idx(0);
+
+	scatter_add(out, in, idx);
+
+	for (size_t t = 0; t < 5; ++t)
+		CHECK(out(t) == 42);
+}
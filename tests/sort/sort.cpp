@@ -0,0 +1,97 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <skepu>
+
+
+bool less_f(int a, int b)
+{
+	return a < b;
+}
+
+bool greater_f(float a, float b)
+{
+	return a > b;
+}
+
+// Not a plain comparison, so only the merge-path kernels apply
+bool by_tens_f(int a, int b)
+{
+	return a / 10 < b / 10;
+}
+
+auto ascending = skepu::Sort(less_f);
+auto descending = skepu::Sort(greater_f);
+auto by_tens = skepu::Sort(by_tens_f);
+
+TEST_CASE("Sort keys")
+{
+	const size_t size{10000};
+
+	skepu::Vector<int> v(size);
+	skepu::Vector<float> f(size);
+	std::vector<int> ref_v(size);
+	std::vector<float> ref_f(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		ref_v[i] = v(i) = (int)((i * 7919) % 1013) - 500;
+		ref_f[i] = f(i) = ((i * 104729) % 997) * 0.5f - 200.f;
+	}
+
+	ascending(v);
+	descending(f);
+	std::stable_sort(ref_v.begin(), ref_v.end(), [](int a, int b) { return a < b; });
+	std::stable_sort(ref_f.begin(), ref_f.end(), [](float a, float b) { return a > b; });
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		CHECK(v(i) == ref_v[i]);
+		CHECK(f(i) == ref_f[i]);
+	}
+}
+
+TEST_CASE("Sort key-value pairs stably")
+{
+	const size_t size{10000};
+
+	// Few distinct keys, so every key repeats many times
+	skepu::Vector<int> radix_keys(size), merge_keys(size);
+	skepu::Vector<size_t> radix_values(size), merge_values(size);
+	std::vector<std::pair<int, size_t>> ref_radix(size), ref_merge(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		radix_keys(i) = merge_keys(i) = (int)((i * 7919) % 37);
+		radix_values(i) = merge_values(i) = i;
+		ref_radix[i] = ref_merge[i] = std::make_pair(radix_keys(i), i);
+	}
+
+	ascending(radix_keys, radix_values);
+	by_tens(merge_keys, merge_values);
+	std::stable_sort(ref_radix.begin(), ref_radix.end(), [](std::pair<int, size_t> a, std::pair<int, size_t> b) { return a.first < b.first; });
+	std::stable_sort(ref_merge.begin(), ref_merge.end(), [](std::pair<int, size_t> a, std::pair<int, size_t> b) { return a.first / 10 < b.first / 10; });
+
+	// Equal keys keep their input order, so the values match the stable reference exactly
+	for (size_t i = 0; i < size; ++i)
+	{
+		CHECK(radix_keys(i) == ref_radix[i].first);
+		CHECK(radix_values(i) == ref_radix[i].second);
+		CHECK(merge_keys(i) == ref_merge[i].first);
+		CHECK(merge_values(i) == ref_merge[i].second);
+	}
+}
+
+TEST_CASE("Sort single element and empty input")
+{
+	skepu::Vector<int> one(1, 7), none(0);
+	skepu::Vector<size_t> one_value(1, 3), no_values(0);
+
+	ascending(one, one_value);
+	ascending(none);
+	by_tens(none, no_values);
+
+	CHECK(one(0) == 7);
+	CHECK(one_value(0) == 3);
+	CHECK(none.size() == 0);
+}